@@ -0,0 +1,2 @@
+#define SIM_GIT_COMMIT_ID 73eb1eeb6920084633fb5c415ec8101bbbd820df+uncommitted-changes
+#define SIM_GIT_COMMIT_TIME 2026-10-17 12:44:05+00:00
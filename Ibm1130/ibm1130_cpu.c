@@ -475,19 +475,21 @@ static const char *xio_funcs[] = {
 };
 static int32 ibm1130_qcount ()
 {
-    int32 i, cnt;
-    UNIT *uptr;
+    int32 i, j, n, cnt;
+    UNIT **units;
     DEVICE *dptr;
 
     cnt = 0;
-    for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next) {
-        dptr = find_dev_from_unit (uptr);
+    units = sim_clock_queue_snapshot(&n);
+    for (j = 0; j < n; j++) {
+        dptr = find_dev_from_unit (units[j]);
         for (i=0; sim_devices[i]; i++)
             if (dptr == sim_devices[i]) {
                 cnt++;
                 break;
             }
     }
+    free(units);
     return cnt;
 }
 
@@ -188,7 +188,16 @@ t_stat dpy_reset (DEVICE *dptr)
         display_close(dptr);
         }
     else {
-        display_init(DISPLAY_TYPE, PIX_SCALE, dptr);
+        t_stat r = vid_can_open ();         /* display available? */
+
+        if (r != SCPE_OK) {
+            dptr->flags |= DEV_DIS;
+            return r;
+            }
+        if (!display_init(DISPLAY_TYPE, PIX_SCALE, dptr)) {
+            dptr->flags |= DEV_DIS;
+            return sim_messagef (SCPE_NOFNC, "Display initialization failed\n");
+            }
         display_reset();
         vid_register_quit_callback (&dpy_quit_callback);
         vid_register_gamepad_motion_callback (dpy_joy_motion);
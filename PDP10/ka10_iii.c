@@ -32,6 +32,7 @@
 
 #if NUM_DEVS_III > 0
 #include "display/display.h"
+#include "sim_video.h"
 
 #define III_DEVNUM        0430
 
@@ -646,9 +647,18 @@ t_stat iii_reset (DEVICE *dptr)
     if (dptr->flags & DEV_DIS) {
         display_close(dptr);
     } else {
+        t_stat r = vid_can_open ();             /* display available? */
+
+        if (r != SCPE_OK) {
+            dptr->flags |= DEV_DIS;
+            return r;
+        }
         display_reset();
         dptr->units[0].POS = 0;
-        display_init(DIS_III, 1, dptr);
+        if (!display_init(DIS_III, 1, dptr)) {
+            dptr->flags |= DEV_DIS;
+            return sim_messagef (SCPE_NOFNC, "Display initialization failed\n");
+        }
     }
     return SCPE_OK;
 }
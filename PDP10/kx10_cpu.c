@@ -4526,6 +4526,14 @@ if ((reason = build_dev_tab ()) != SCPE_OK)            /* build, chk dib_tab */
          break;
     }
 
+    if (f_load_pc) {
+#if KL
+         SIM_PROF_SAMPLE (((t_addr)pc_sect << 18) | PC, (FLAGS & USER) != 0);
+#else
+         SIM_PROF_SAMPLE (PC, (FLAGS & USER) != 0);
+#endif
+    }
+
     if (watch_stop) {
          reason = STOP_IBKPT;
          RUN = 0;
@@ -13626,6 +13634,12 @@ static const char *pdp10_clock_precalibrate_commands[] = {
     "PC 100",
     NULL};
 
+/* Profiler contexts */
+
+static const char *pdp10_prof_contexts[] = {
+    "exec", "user",
+    NULL};
+
 /* Reset routine */
 
 t_stat cpu_reset (DEVICE *dptr)
@@ -13704,6 +13718,7 @@ t_stat cpu_reset (DEVICE *dptr)
     sim_brk_types = SWMASK('E') | SWMASK('W') | SWMASK('R');
     sim_brk_dflt = SWMASK ('E');
     sim_clock_precalibrate_commands = pdp10_clock_precalibrate_commands;
+    sim_vm_prof_contexts = pdp10_prof_contexts;
     sim_vm_initial_ips = 4 * SIM_INITIAL_IPS;
     sim_rtcn_init_unit (&cpu_unit[0], cpu_unit[0].wait, TMR_RTC);
     sim_activate(&cpu_unit[0], 1000);
@@ -383,6 +383,12 @@ t_stat dpy_reset (DEVICE *dptr)
     if (dptr->flags & DEV_DIS) {
         display_close(dptr);
     } else {
+        t_stat r = vid_can_open ();             /* display available? */
+
+        if (r != SCPE_OK) {
+            dptr->flags |= DEV_DIS;
+            return r;
+        }
 #if ITS
         if (stk_dev.flags & DEV_DIS) {
             sim_debug(DEBUG_DETAIL, &dpy_dev, "Grabbing keyboard\n");
@@ -328,6 +328,25 @@ int16 inst_pc;                                          /* PC of current instr *
 int32 inst_psw;                                         /* PSW at instr. start */
 int16 reg_mods;                                         /* reg deltas */
 int32 last_pa;                                          /* pa from ReadMW/ReadMB */
+
+/* Software TLB
+
+   For each APR (mode, space and page), tlb_rd and tlb_wr hold the range
+   of virtual addresses that relocR and relocW would translate without
+   any access control, page length or 22b wraparound effect, and the
+   offset from virtual to physical address.  Entries are filled by the
+   full relocation path and only cover pages which lie entirely in
+   memory, so I/O page references always take the full path.  A write
+   entry is only filled once PDR<W> has been set.  tlb_flush must be
+   called whenever a PAR, PDR, MMR0 or MMR3 changes.  */
+
+typedef struct {
+    int32               va;                             /* first virtual address */
+    uint32              lnt;                            /* length, 0 if invalid */
+    int32               off;                            /* physical - virtual */
+    } TLBENT;
+
+TLBENT tlb_rd[64], tlb_wr[64];                          /* read, write TLBs */
 int32 saved_sim_interval;                               /* saved at inst start */
 t_stat reason;                                          /* stop reason */
 
@@ -355,6 +374,8 @@ void relocW_test (int32 va, int32 apridx);
 int32 relocC (int32 va, int32 sw);
 t_bool PLF_test (int32 va, int32 apr);
 void reloc_abort (int32 err, int32 apridx);
+void tlb_fill (TLBENT *tlb, int32 va, int32 apr);
+void tlb_flush (void);
 int32 ReadE (int32 addr);
 int32 ReadW (int32 addr);
 int32 ReadB (int32 addr);
@@ -728,6 +749,99 @@ t_stat sim_instr (void)
 int abortval, i;
 volatile int32 trapea;                                  /* used by setjmp */
 InstHistory *hst_ent = NULL;
+#if defined (SIM_THREADED)
+static const void *const op_dispatch[02000] = {      /* IR<15:6> */
+    [00000] = &&op_NOPND,
+    [00001] = &&op_JMP,
+    [00002] = &&op_RTS,
+    [00003] = &&op_SWAB,
+    [00004 ... 00005] = &&op_BR_F,
+    [00006 ... 00007] = &&op_BR_B,
+    [00010 ... 00011] = &&op_BNE_F,
+    [00012 ... 00013] = &&op_BNE_B,
+    [00014 ... 00015] = &&op_BEQ_F,
+    [00016 ... 00017] = &&op_BEQ_B,
+    [00020 ... 00021] = &&op_BGE_F,
+    [00022 ... 00023] = &&op_BGE_B,
+    [00024 ... 00025] = &&op_BLT_F,
+    [00026 ... 00027] = &&op_BLT_B,
+    [00030 ... 00031] = &&op_BGT_F,
+    [00032 ... 00033] = &&op_BGT_B,
+    [00034 ... 00035] = &&op_BLE_F,
+    [00036 ... 00037] = &&op_BLE_B,
+    [00040 ... 00047] = &&op_JSR,
+    [00050] = &&op_CLR,
+    [00051] = &&op_COM,
+    [00052] = &&op_INC,
+    [00053] = &&op_DEC,
+    [00054] = &&op_NEG,
+    [00055] = &&op_ADC,
+    [00056] = &&op_SBC,
+    [00057] = &&op_TST,
+    [00060] = &&op_ROR,
+    [00061] = &&op_ROL,
+    [00062] = &&op_ASR,
+    [00063] = &&op_ASL,
+    [00064] = &&op_MARK,
+    [00065] = &&op_MFPI,
+    [00066] = &&op_MTPI,
+    [00067] = &&op_SXT,
+    [00070] = &&op_CSM,
+    [00071] = &&op_ILL_000,
+    [00072] = &&op_TSTSET,
+    [00073] = &&op_WRTLCK,
+    [00074 ... 00077] = &&op_ILL_000,
+    [00100 ... 00177] = &&op_MOV,
+    [00200 ... 00277] = &&op_CMP,
+    [00300 ... 00377] = &&op_BIT,
+    [00400 ... 00477] = &&op_BIC,
+    [00500 ... 00577] = &&op_BIS,
+    [00600 ... 00677] = &&op_ADD,
+    [00700 ... 00777] = &&op_EIS,
+    [01000 ... 01001] = &&op_BPL_F,
+    [01002 ... 01003] = &&op_BPL_B,
+    [01004 ... 01005] = &&op_BMI_F,
+    [01006 ... 01007] = &&op_BMI_B,
+    [01010 ... 01011] = &&op_BHI_F,
+    [01012 ... 01013] = &&op_BHI_B,
+    [01014 ... 01015] = &&op_BLOS_F,
+    [01016 ... 01017] = &&op_BLOS_B,
+    [01020 ... 01021] = &&op_BVC_F,
+    [01022 ... 01023] = &&op_BVC_B,
+    [01024 ... 01025] = &&op_BVS_F,
+    [01026 ... 01027] = &&op_BVS_B,
+    [01030 ... 01031] = &&op_BCC_F,
+    [01032 ... 01033] = &&op_BCC_B,
+    [01034 ... 01035] = &&op_BCS_F,
+    [01036 ... 01037] = &&op_BCS_B,
+    [01040 ... 01043] = &&op_EMT,
+    [01044 ... 01047] = &&op_TRAP,
+    [01050] = &&op_CLRB,
+    [01051] = &&op_COMB,
+    [01052] = &&op_INCB,
+    [01053] = &&op_DECB,
+    [01054] = &&op_NEGB,
+    [01055] = &&op_ADCB,
+    [01056] = &&op_SBCB,
+    [01057] = &&op_TSTB,
+    [01060] = &&op_RORB,
+    [01061] = &&op_ROLB,
+    [01062] = &&op_ASRB,
+    [01063] = &&op_ASLB,
+    [01064] = &&op_MTPS,
+    [01065] = &&op_MFPD,
+    [01066] = &&op_MTPD,
+    [01067] = &&op_MFPS,
+    [01070 ... 01077] = &&op_ILL_010,
+    [01100 ... 01177] = &&op_MOVB,
+    [01200 ... 01277] = &&op_CMPB,
+    [01300 ... 01377] = &&op_BITB,
+    [01400 ... 01477] = &&op_BICB,
+    [01500 ... 01577] = &&op_BISB,
+    [01600 ... 01677] = &&op_SUB,
+    [01700 ... 01777] = &&op_FPP,
+    };
+#endif
 
 sim_vm_pc_value = &pdp11_pc_value;
 
@@ -757,6 +871,7 @@ dsenable = calc_ds (cm);
 put_PIRQ (PIRQ);                                        /* rewrite PIRQ */
 STKLIM = STKLIM & STKLIM_RW;                            /* clean up STKLIM */
 MMR0 = MMR0 & ~MMR0_IC;                                 /* usually off */
+tlb_flush ();                                           /* mapping may have changed */
 
 trap_req = calc_ints (ipl, trap_req);                   /* upd int req */
 trapea = 0;
@@ -967,10 +1082,11 @@ while (reason == 0)  {
     saved_sim_interval = sim_interval;
     if (BPT_SUMM_PC) {                                  /* possible breakpoint */
         t_addr pa = relocC (PC, 0);                     /* relocate PC */
-        if (sim_brk_test (PC, BPT_PCVIR) ||             /* Normal PC breakpoint? */
-            sim_brk_test (pa, BPT_PCPHY))               /* Physical Address breakpoint? */
+        if (BPT_TEST (PC, BPT_PCVIR) ||                 /* Normal PC breakpoint? */
+            BPT_TEST (pa, BPT_PCPHY))                   /* Physical Address breakpoint? */
             ABORT (ABRT_BKPT);                          /* stop simulation */
         }
+    SIM_PROF_SAMPLE (PC, cm);                           /* profile */
 
     if (update_MM) {                                    /* if mm not frozen */
         MMR1 = 0;
@@ -1006,13 +1122,16 @@ while (reason == 0)  {
             hst_p = 0;
         }
     PC = (PC + 2) & 0177777;                            /* incr PC, mod 65k */
+#if defined (SIM_THREADED)
+    goto *op_dispatch[IR >> 6];                         /* jump into switch */
+#endif
     switch ((IR >> 12) & 017) {                         /* decode IR<15:12> */
 
 /* Opcode 0: no operands, specials, branches, JSR, SOPs */
 
     case 000:
         switch ((IR >> 6) & 077) {                      /* decode IR<11:6> */
-        case 000:                                       /* no operand */
+        case 000: SIM_OPLABEL (op_NOPND)                /* no operand */
             if (IR >= 000010) {                         /* 000010 - 000077 */
                 setTRAP (TRAP_ILL);                     /* illegal */
                 break;
@@ -1044,6 +1163,7 @@ while (reason == 0)  {
                     STKLIM = 0;                         /* clear STKLIM */
                     MMR0 = 0;                           /* clear MMR0 */
                     MMR3 = 0;                           /* clear MMR3 */
+                    tlb_flush ();
                     cpu_bme = 0;                        /* (also clear bme) */
                     for (i = 0; i < IPL_HLVL; i++)
                         int_req[i] = 0;
@@ -1085,7 +1205,7 @@ while (reason == 0)  {
                 }                                       /* end switch no ops */
             break;                                      /* end case no ops */
 
-        case 001:                                       /* JMP */
+        case 001: SIM_OPLABEL (op_JMP)                  /* JMP */
             if (dstreg)
                 setTRAP (CPUT (HAS_JREG4)? TRAP_PRV: TRAP_ILL);
             else {
@@ -1099,7 +1219,7 @@ while (reason == 0)  {
                 }
             break;                                      /* end JMP */
 
-        case 002:                                       /* RTS et al*/
+        case 002: SIM_OPLABEL (op_RTS)                  /* RTS et al*/
             if (IR < 000210) {                          /* RTS */
                 dstspec = dstspec & 07;
                 if (hst_ent)
@@ -1144,7 +1264,7 @@ while (reason == 0)  {
                 C = 1;
             break;                                      /* end case RTS et al */
 
-        case 003:                                       /* SWAB */
+        case 003: SIM_OPLABEL (op_SWAB)                 /* SWAB */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = ((dst & 0377) << 8) | ((dst >> 8) & 0377);
             N = GET_SIGN_B (dst & 0377);
@@ -1159,86 +1279,86 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;                                      /* end SWAB */
 
-        case 004: case 005:                             /* BR */
+        case 004: case 005: SIM_OPLABEL (op_BR_F)       /* BR */
             BRANCH_F (IR);
             break;
 
-        case 006: case 007:                             /* BR */
+        case 006: case 007: SIM_OPLABEL (op_BR_B)       /* BR */
             BRANCH_B (IR);
             break;
 
-        case 010: case 011:                             /* BNE */
+        case 010: case 011: SIM_OPLABEL (op_BNE_F)      /* BNE */
             if (Z == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 012: case 013:                             /* BNE */
+        case 012: case 013: SIM_OPLABEL (op_BNE_B)      /* BNE */
             if (Z == 0) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 014: case 015:                             /* BEQ */
+        case 014: case 015: SIM_OPLABEL (op_BEQ_F)      /* BEQ */
             if (Z) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 016: case 017:                             /* BEQ */
+        case 016: case 017: SIM_OPLABEL (op_BEQ_B)      /* BEQ */
             if (Z) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 020: case 021:                             /* BGE */
+        case 020: case 021: SIM_OPLABEL (op_BGE_F)      /* BGE */
             if ((N ^ V) == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 022: case 023:                             /* BGE */
+        case 022: case 023: SIM_OPLABEL (op_BGE_B)      /* BGE */
             if ((N ^ V) == 0) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 024: case 025:                             /* BLT */
+        case 024: case 025: SIM_OPLABEL (op_BLT_F)      /* BLT */
             if (N ^ V) {
                 BRANCH_F (IR);
                 }
             break;
 
-        case 026: case 027:                             /* BLT */
+        case 026: case 027: SIM_OPLABEL (op_BLT_B)      /* BLT */
             if (N ^ V) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 030: case 031:                             /* BGT */
+        case 030: case 031: SIM_OPLABEL (op_BGT_F)      /* BGT */
             if ((Z | (N ^ V)) == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 032: case 033:                             /* BGT */
+        case 032: case 033: SIM_OPLABEL (op_BGT_B)      /* BGT */
             if ((Z | (N ^ V)) == 0) { BRANCH_B (IR); }
             break;
 
-        case 034: case 035:                             /* BLE */
+        case 034: case 035: SIM_OPLABEL (op_BLE_F)      /* BLE */
             if (Z | (N ^ V)) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 036: case 037:                             /* BLE */
+        case 036: case 037: SIM_OPLABEL (op_BLE_B)      /* BLE */
             if (Z | (N ^ V)) {
                 BRANCH_B (IR);
                 }
             break;
 
         case 040: case 041: case 042: case 043:         /* JSR */
-        case 044: case 045: case 046: case 047:
+        case 044: case 045: case 046: case 047: SIM_OPLABEL (op_JSR)
             if (dstreg)
                 setTRAP (CPUT (HAS_JREG4)? TRAP_PRV: TRAP_ILL);
             else {
@@ -1261,7 +1381,7 @@ while (reason == 0)  {
                 }
             break;                                      /* end JSR */
 
-        case 050:                                       /* CLR */
+        case 050: SIM_OPLABEL (op_CLR)                  /* CLR */
             N = V = C = 0;
             Z = 1;
             if (hst_ent)
@@ -1271,7 +1391,7 @@ while (reason == 0)  {
             else WriteW (0, GeteaW (dstspec));
             break;
 
-        case 051:                                       /* COM */
+        case 051: SIM_OPLABEL (op_COM)                  /* COM */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = dst ^ 0177777;
             N = GET_SIGN_W (dst);
@@ -1285,7 +1405,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 052:                                       /* INC */
+        case 052: SIM_OPLABEL (op_INC)                  /* INC */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (dst + 1) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1298,7 +1418,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 053:                                       /* DEC */
+        case 053: SIM_OPLABEL (op_DEC)                  /* DEC */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (dst - 1) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1311,7 +1431,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 054:                                       /* NEG */
+        case 054: SIM_OPLABEL (op_NEG)                  /* NEG */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (-dst) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1325,7 +1445,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 055:                                       /* ADC */
+        case 055: SIM_OPLABEL (op_ADC)                  /* ADC */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (dst + C) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1339,7 +1459,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 056:                                       /* SBC */
+        case 056: SIM_OPLABEL (op_SBC)                  /* SBC */
             dst = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (dst - C) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1353,7 +1473,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 057:                                       /* TST */
+        case 057: SIM_OPLABEL (op_TST)                  /* TST */
             dst = dstreg? R[dstspec]: ReadW (GeteaW (dstspec));
             if (hst_ent)
                 hst_ent->dst = dst;
@@ -1362,7 +1482,7 @@ while (reason == 0)  {
             V = C = 0;
             break;
 
-        case 060:                                       /* ROR */
+        case 060: SIM_OPLABEL (op_ROR)                  /* ROR */
             src = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (src >> 1) | (C << 15);
             N = GET_SIGN_W (dst);
@@ -1376,7 +1496,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 061:                                       /* ROL */
+        case 061: SIM_OPLABEL (op_ROL)                  /* ROL */
             src = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = ((src << 1) | C) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1390,7 +1510,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 062:                                       /* ASR */
+        case 062: SIM_OPLABEL (op_ASR)                  /* ASR */
             src = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (src >> 1) | (src & 0100000);
             N = GET_SIGN_W (dst);
@@ -1404,7 +1524,7 @@ while (reason == 0)  {
             else PWriteW (dst, last_pa);
             break;
 
-        case 063:                                       /* ASL */
+        case 063: SIM_OPLABEL (op_ASL)                  /* ASL */
             src = dstreg? R[dstspec]: ReadMW (GeteaW (dstspec));
             dst = (src << 1) & 0177777;
             N = GET_SIGN_W (dst);
@@ -1423,7 +1543,7 @@ while (reason == 0)  {
    - MxPI must set MMR1 for SP recovery in case of fault
 */
 
-        case 064:                                       /* MARK */
+        case 064: SIM_OPLABEL (op_MARK)                 /* MARK */
             if (CPUT (HAS_MARK)) {
                 i = (PC + dstspec + dstspec) & 0177777;
                 JMP_PC (R[5]);
@@ -1433,7 +1553,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 065:                                       /* MFPI */
+        case 065: SIM_OPLABEL (op_MFPI)                 /* MFPI */
             if (CPUT (HAS_MXPY)) {
                 if (dstreg) {
                     if ((dstspec == 6) && (cm != pm))
@@ -1460,7 +1580,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 066:                                       /* MTPI */
+        case 066: SIM_OPLABEL (op_MTPI)                 /* MTPI */
             if (CPUT (HAS_MXPY)) {
                 dst = ReadW (SP | dsenable);
                 N = GET_SIGN_W (dst);
@@ -1481,7 +1601,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 067:                                       /* SXT */
+        case 067: SIM_OPLABEL (op_SXT)                  /* SXT */
             if (CPUT (HAS_SXS)) {
                 dst = N? 0177777: 0;
                 Z = N ^ 1;
@@ -1495,7 +1615,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 070:                                       /* CSM */
+        case 070: SIM_OPLABEL (op_CSM)                  /* CSM */
             if (CPUT (HAS_CSM) && (MMR3 & MMR3_CSM) && (cm != MD_KER)) {
                 dst = dstreg? R[dstspec]: ReadW (GeteaW (dstspec));
                 PSW = get_PSW () & ~PSW_CC;             /* PSW, cc = 0 */
@@ -1514,7 +1634,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 072:                                       /* TSTSET */
+        case 072: SIM_OPLABEL (op_TSTSET)               /* TSTSET */
             if (CPUT (HAS_TSWLK) && !dstreg) {
                 dst = ReadMW (GeteaW (dstspec));
                 N = GET_SIGN_W (dst);
@@ -1529,7 +1649,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 073:                                       /* WRTLCK */
+        case 073: SIM_OPLABEL (op_WRTLCK)               /* WRTLCK */
             if (CPUT (HAS_TSWLK) && !dstreg) {
                 N = GET_SIGN_W (R[0]);
                 Z = GET_Z (R[0]);
@@ -1541,7 +1661,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        default:
+        default: SIM_OPLABEL (op_ILL_000)
             setTRAP (TRAP_ILL);
             break;
             }                                           /* end switch SOPs */
@@ -1558,7 +1678,7 @@ while (reason == 0)  {
    Cmp: v = [sign (src) != sign (src2)] and [sign (src2) = sign (result)]
 */
 
-    case 001:                                           /* MOV */
+    case 001: SIM_OPLABEL (op_MOV)                      /* MOV */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             ea = GeteaW (dstspec);
             dst = R[srcspec];
@@ -1580,7 +1700,7 @@ while (reason == 0)  {
         else WriteW (dst, ea);
         break;
 
-    case 002:                                           /* CMP */
+    case 002: SIM_OPLABEL (op_CMP)                      /* CMP */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadW (GeteaW (dstspec));
             src = R[srcspec];
@@ -1600,7 +1720,7 @@ while (reason == 0)  {
         C = (src < src2);
         break;
 
-    case 003:                                           /* BIT */
+    case 003: SIM_OPLABEL (op_BIT)                      /* BIT */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadW (GeteaW (dstspec));
             src = R[srcspec];
@@ -1619,7 +1739,7 @@ while (reason == 0)  {
         V = 0;
         break;
 
-    case 004:                                           /* BIC */
+    case 004: SIM_OPLABEL (op_BIC)                      /* BIC */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadMW (GeteaW (dstspec));
             src = R[srcspec];
@@ -1641,7 +1761,7 @@ while (reason == 0)  {
         else PWriteW (dst, last_pa);
         break;
 
-    case 005:                                           /* BIS */
+    case 005: SIM_OPLABEL (op_BIS)                      /* BIS */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadMW (GeteaW (dstspec));
             src = R[srcspec];
@@ -1663,7 +1783,7 @@ while (reason == 0)  {
         else PWriteW (dst, last_pa);
         break;
 
-    case 006:                                           /* ADD */
+    case 006: SIM_OPLABEL (op_ADD)                      /* ADD */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadMW (GeteaW (dstspec));
             src = R[srcspec];
@@ -1703,7 +1823,7 @@ while (reason == 0)  {
      extends, then the shift and conditional or does sign extension.
 */
 
-    case 007:
+    case 007: SIM_OPLABEL (op_EIS)
         srcspec = srcspec & 07;
         switch ((IR >> 9) & 07)  {                      /* decode IR<11:9> */
 
@@ -1912,111 +2032,111 @@ while (reason == 0)  {
     case 010:
         switch ((IR >> 6) & 077) {                      /* decode IR<11:6> */
 
-        case 000: case 001:                             /* BPL */
+        case 000: case 001: SIM_OPLABEL (op_BPL_F)      /* BPL */
             if (N == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 002: case 003:                             /* BPL */
+        case 002: case 003: SIM_OPLABEL (op_BPL_B)      /* BPL */
             if (N == 0) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 004: case 005:                             /* BMI */
+        case 004: case 005: SIM_OPLABEL (op_BMI_F)      /* BMI */
             if (N) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 006: case 007:                             /* BMI */
+        case 006: case 007: SIM_OPLABEL (op_BMI_B)      /* BMI */
             if (N) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 010: case 011:                             /* BHI */
+        case 010: case 011: SIM_OPLABEL (op_BHI_F)      /* BHI */
             if ((C | Z) == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 012: case 013:                             /* BHI */
+        case 012: case 013: SIM_OPLABEL (op_BHI_B)      /* BHI */
             if ((C | Z) == 0) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 014: case 015:                             /* BLOS */
+        case 014: case 015: SIM_OPLABEL (op_BLOS_F)     /* BLOS */
             if (C | Z) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 016: case 017:                             /* BLOS */
+        case 016: case 017: SIM_OPLABEL (op_BLOS_B)     /* BLOS */
             if (C | Z) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 020: case 021:                             /* BVC */
+        case 020: case 021: SIM_OPLABEL (op_BVC_F)      /* BVC */
             if (V == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 022: case 023:                             /* BVC */
+        case 022: case 023: SIM_OPLABEL (op_BVC_B)      /* BVC */
             if (V == 0) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 024: case 025:                             /* BVS */
+        case 024: case 025: SIM_OPLABEL (op_BVS_F)      /* BVS */
             if (V) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 026: case 027:                             /* BVS */
+        case 026: case 027: SIM_OPLABEL (op_BVS_B)      /* BVS */
             if (V) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 030: case 031:                             /* BCC */
+        case 030: case 031: SIM_OPLABEL (op_BCC_F)      /* BCC */
             if (C == 0) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 032: case 033:                             /* BCC */
+        case 032: case 033: SIM_OPLABEL (op_BCC_B)      /* BCC */
             if (C == 0) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 034: case 035:                             /* BCS */
+        case 034: case 035: SIM_OPLABEL (op_BCS_F)      /* BCS */
             if (C) {
                 BRANCH_F (IR);
                 } 
             break;
 
-        case 036: case 037:                             /* BCS */
+        case 036: case 037: SIM_OPLABEL (op_BCS_B)      /* BCS */
             if (C) {
                 BRANCH_B (IR);
                 }
             break;
 
-        case 040: case 041: case 042: case 043:         /* EMT */
+        case 040: case 041: case 042: case 043: SIM_OPLABEL (op_EMT) /* EMT */
             setTRAP (TRAP_EMT);
             break;
 
-        case 044: case 045: case 046: case 047:         /* TRAP */
+        case 044: case 045: case 046: case 047: SIM_OPLABEL (op_TRAP) /* TRAP */
             setTRAP (TRAP_TRAP);
             break;
 
-        case 050:                                       /* CLRB */
+        case 050: SIM_OPLABEL (op_CLRB)                 /* CLRB */
             N = V = C = 0;
             Z = 1;
             if (dstreg)
@@ -2029,7 +2149,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 051:                                       /* COMB */
+        case 051: SIM_OPLABEL (op_COMB)                 /* COMB */
             dst = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (dst ^ 0377) & 0377;
             N = GET_SIGN_B (dst);
@@ -2046,7 +2166,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 052:                                       /* INCB */
+        case 052: SIM_OPLABEL (op_INCB)                 /* INCB */
             dst = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (dst + 1) & 0377;
             N = GET_SIGN_B (dst);
@@ -2062,7 +2182,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 053:                                       /* DECB */
+        case 053: SIM_OPLABEL (op_DECB)                 /* DECB */
             dst = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (dst - 1) & 0377;
             N = GET_SIGN_B (dst);
@@ -2078,7 +2198,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 054:                                       /* NEGB */
+        case 054: SIM_OPLABEL (op_NEGB)                 /* NEGB */
             dst = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (-dst) & 0377;
             N = GET_SIGN_B (dst);
@@ -2095,7 +2215,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 055:                                       /* ADCB */
+        case 055: SIM_OPLABEL (op_ADCB)                 /* ADCB */
             dst = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (dst + C) & 0377;
             N = GET_SIGN_B (dst);
@@ -2112,7 +2232,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 056:                                       /* SBCB */
+        case 056: SIM_OPLABEL (op_SBCB)                 /* SBCB */
             dst = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (dst - C) & 0377;
             N = GET_SIGN_B (dst);
@@ -2129,7 +2249,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 057:                                       /* TSTB */
+        case 057: SIM_OPLABEL (op_TSTB)                 /* TSTB */
             dst = dstreg? R[dstspec] & 0377: ReadB (GeteaB (dstspec));
             if (hst_ent)
                 hst_ent->dst = dst;
@@ -2138,7 +2258,7 @@ while (reason == 0)  {
             V = C = 0;
             break;
 
-        case 060:                                       /* RORB */
+        case 060: SIM_OPLABEL (op_RORB)                 /* RORB */
             src = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = ((src & 0377) >> 1) | (C << 7);
             N = GET_SIGN_B (dst);
@@ -2155,7 +2275,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 061:                                       /* ROLB */
+        case 061: SIM_OPLABEL (op_ROLB)                 /* ROLB */
             src = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = ((src << 1) | C) & 0377;
             N = GET_SIGN_B (dst);
@@ -2172,7 +2292,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 062:                                       /* ASRB */
+        case 062: SIM_OPLABEL (op_ASRB)                 /* ASRB */
             src = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = ((src & 0377) >> 1) | (src & 0200);
             N = GET_SIGN_B (dst);
@@ -2189,7 +2309,7 @@ while (reason == 0)  {
             }
             break;
 
-        case 063:                                       /* ASLB */
+        case 063: SIM_OPLABEL (op_ASLB)                 /* ASLB */
             src = dstreg? R[dstspec]: ReadMB (GeteaB (dstspec));
             dst = (src << 1) & 0377;
             N = GET_SIGN_B (dst);
@@ -2212,7 +2332,7 @@ while (reason == 0)  {
    - MxPD must set MMR1 for SP recovery in case of fault
 */
 
-        case 064:                                       /* MTPS */
+        case 064: SIM_OPLABEL (op_MTPS)                 /* MTPS */
             if (CPUT (HAS_MXPS)) {
                 dst = dstreg? R[dstspec]: ReadB (GeteaB (dstspec));
                 if (cm == MD_KER) {
@@ -2227,7 +2347,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 065:                                       /* MFPD */
+        case 065: SIM_OPLABEL (op_MFPD)                 /* MFPD */
             if (CPUT (HAS_MXPY)) {
                 if (dstreg) {
                     if ((dstspec == 6) && (cm != pm))
@@ -2251,7 +2371,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 066:                                       /* MTPD */
+        case 066: SIM_OPLABEL (op_MTPD)                 /* MTPD */
             if (CPUT (HAS_MXPY)) {
                 dst = ReadW (SP | dsenable);
                 N = GET_SIGN_W (dst);
@@ -2273,7 +2393,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        case 067:                                       /* MFPS */
+        case 067: SIM_OPLABEL (op_MFPS)                 /* MFPS */
             if (CPUT (HAS_MXPS)) {
                 dst = get_PSW () & 0377;
                 N = GET_SIGN_B (dst);
@@ -2286,7 +2406,7 @@ while (reason == 0)  {
             else setTRAP (TRAP_ILL);
             break;
 
-        default:
+        default: SIM_OPLABEL (op_ILL_010)
             setTRAP (TRAP_ILL);
             break;
             }                                           /* end switch SOPs */
@@ -2298,7 +2418,7 @@ while (reason == 0)  {
    Sub: v = [sign (src) != sign (src2)] and [sign (src) = sign (result)]
 */
 
-    case 011:                                           /* MOVB */
+    case 011: SIM_OPLABEL (op_MOVB)                     /* MOVB */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             ea = GeteaB (dstspec);
             dst = R[srcspec] & 0377;
@@ -2320,7 +2440,7 @@ while (reason == 0)  {
             }
         break;
 
-    case 012:                                           /* CMPB */
+    case 012: SIM_OPLABEL (op_CMPB)                     /* CMPB */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadB (GeteaB (dstspec));
             src = R[srcspec] & 0377;
@@ -2340,7 +2460,7 @@ while (reason == 0)  {
         C = (src < src2);
         break;
 
-    case 013:                                           /* BITB */
+    case 013: SIM_OPLABEL (op_BITB)                     /* BITB */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadB (GeteaB (dstspec));
             src = R[srcspec] & 0377;
@@ -2359,7 +2479,7 @@ while (reason == 0)  {
         V = 0;
         break;
 
-    case 014:                                           /* BICB */
+    case 014: SIM_OPLABEL (op_BICB)                     /* BICB */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadMB (GeteaB (dstspec));
             src = R[srcspec];
@@ -2381,7 +2501,7 @@ while (reason == 0)  {
         else PWriteB (dst, last_pa);
         break;
 
-    case 015:                                           /* BISB */
+    case 015: SIM_OPLABEL (op_BISB)                     /* BISB */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadMB (GeteaB (dstspec));
             src = R[srcspec];
@@ -2403,7 +2523,7 @@ while (reason == 0)  {
         else PWriteB (dst, last_pa);
         break;
 
-    case 016:                                           /* SUB */
+    case 016: SIM_OPLABEL (op_SUB)                      /* SUB */
         if (CPUT (IS_SDSD) && srcreg && !dstreg) {      /* R,not R */
             src2 = ReadMW (GeteaW (dstspec));
             src = R[srcspec];
@@ -2428,7 +2548,7 @@ while (reason == 0)  {
 
 /* Opcode 17: floating point */
 
-    case 017:
+    case 017: SIM_OPLABEL (op_FPP)
         if (CPUO (OPT_FPP))
             fp11 (IR);                  /* call fpp */
         else setTRAP (TRAP_ILL);
@@ -2636,8 +2756,8 @@ if ((va & 1) && CPUT (HAS_ODD)) {                       /* odd address? */
     }
 pa = relocR (va);                                       /* relocate */
 if (BPT_SUMM_RD &&
-    (sim_brk_test (va & 0177777, BPT_RDVIR) ||
-     sim_brk_test (pa, BPT_RDPHY)))                     /* read breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_RDVIR) ||
+     BPT_TEST (pa, BPT_RDPHY)))                         /* read breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 if (ADDR_IS_MEM (pa))                                   /* memory address? */
     return RdMemW (pa);
@@ -2663,8 +2783,8 @@ if ((va & 1) && CPUT (HAS_ODD)) {                       /* odd address? */
     }
 pa = relocR (va);                                       /* relocate */
 if (BPT_SUMM_RD &&
-    (sim_brk_test (va & 0177777, BPT_RDVIR) ||
-     sim_brk_test (pa, BPT_RDPHY)))                     /* read breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_RDVIR) ||
+     BPT_TEST (pa, BPT_RDPHY)))                         /* read breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 return PReadW (pa);
 }
@@ -2675,8 +2795,8 @@ int32 pa;
 
 pa = relocR (va);                                       /* relocate */
 if (BPT_SUMM_RD &&
-    (sim_brk_test (va & 0177777, BPT_RDVIR) ||
-     sim_brk_test (pa, BPT_RDPHY)))                     /* read breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_RDVIR) ||
+     BPT_TEST (pa, BPT_RDPHY)))                         /* read breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 return PReadB (pa);
 }
@@ -2694,8 +2814,8 @@ if ((va & 1) && CPUT (HAS_ODD)) {                       /* odd address? */
     }
 pa = relocR (va);                                       /* relocate */
 if (BPT_SUMM_RD &&
-    (sim_brk_test (va & 0177777, BPT_RDVIR) ||
-     sim_brk_test (pa, BPT_RDPHY)))                     /* read breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_RDVIR) ||
+     BPT_TEST (pa, BPT_RDPHY)))                         /* read breakpoint? */
     reason = STOP_IBKPT;                                /* report that */
 return PReadW (pa);
 }
@@ -2708,8 +2828,8 @@ if ((va & 1) && CPUT (HAS_ODD)) {                       /* odd address? */
     }
 last_pa = relocW (va);                                  /* reloc, wrt chk */
 if (BPT_SUMM_RW &&
-    (sim_brk_test (va & 0177777, BPT_RWVIR) ||
-     sim_brk_test (last_pa, BPT_RWPHY)))                /* read or write breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_RWVIR) ||
+     BPT_TEST (last_pa, BPT_RWPHY)))                    /* read or write breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 return PReadW (last_pa);
 }
@@ -2718,8 +2838,8 @@ int32 ReadMB (int32 va)
 {
 last_pa = relocW (va);                                  /* reloc, wrt chk */
 if (BPT_SUMM_RW &&
-    (sim_brk_test (va & 0177777, BPT_RWVIR) ||
-     sim_brk_test (last_pa, BPT_RWPHY)))                /* read or write breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_RWVIR) ||
+     BPT_TEST (last_pa, BPT_RWPHY)))                    /* read or write breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 return PReadB (last_pa);
 }
@@ -2777,8 +2897,8 @@ if ((va & 1) && CPUT (HAS_ODD)) {                       /* odd address? */
     }
 pa = relocW (va);                                       /* relocate */
 if (BPT_SUMM_WR &&
-    (sim_brk_test (va & 0177777, BPT_WRVIR) ||
-     sim_brk_test (pa, BPT_WRPHY)))                     /* write breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_WRVIR) ||
+     BPT_TEST (pa, BPT_WRPHY)))                         /* write breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 PWriteW (data, pa);
 }
@@ -2789,8 +2909,8 @@ int32 pa;
 
 pa = relocW (va);                                       /* relocate */
 if (BPT_SUMM_WR &&
-    (sim_brk_test (va & 0177777, BPT_WRVIR) ||
-     sim_brk_test (pa, BPT_WRPHY)))                     /* write breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_WRVIR) ||
+     BPT_TEST (pa, BPT_WRPHY)))                         /* write breakpoint? */
     ABORT (ABRT_BKPT);                                  /* stop simulation */
 PWriteB (data, pa);
 }
@@ -2808,8 +2928,8 @@ if ((va & 1) && CPUT (HAS_ODD)) {                       /* odd address? */
     }
 pa = relocW (va);                                       /* relocate */
 if (BPT_SUMM_WR &&
-    (sim_brk_test (va & 0177777, BPT_WRVIR) ||
-     sim_brk_test (pa, BPT_WRPHY)))                     /* write breakpoint? */
+    (BPT_TEST (va & 0177777, BPT_WRVIR) ||
+     BPT_TEST (pa, BPT_WRPHY)))                         /* write breakpoint? */
     reason = STOP_IBKPT;                                /* report that */
 PWriteW (data, pa);
 }
@@ -2867,7 +2987,10 @@ return;
 int32 relocR (int32 va)
 {
 int32 apridx, apr, pa;
+TLBENT *tlb = &tlb_rd[(va >> VA_V_APF) & 077];
 
+if ((uint32) (va - tlb->va) < tlb->lnt)                 /* TLB hit? */
+    return va + tlb->off;
 if (MMR0 & MMR0_MME) {                                  /* if mmgt */
     apridx = (va >> VA_V_APF) & 077;                    /* index into APR */
     apr = APRFILE[apridx];                              /* with va<18:13> */
@@ -2881,11 +3004,14 @@ if (MMR0 & MMR0_MME) {                                  /* if mmgt */
         if (pa >= 0760000)
             pa = 017000000 | pa;
         }
+    if (((apr & PDR_PRD) == 2) || ((apr & PDR_ACF) == 5))/* no trap? */
+        tlb_fill (tlb, va, apr);
     }
 else {
     pa = va & 0177777;                                  /* mmgt off */
     if (pa >= 0160000)
         pa = 017600000 | pa;
+    else tlb_fill (tlb, va, 0);
     }
 return pa;
 }
@@ -2957,6 +3083,44 @@ ABORT (TRAP_MME);                                       /* abort ref */
 return;
 }
 
+/* Fill a TLB entry after a reference to va has been relocated, if the
+   part of the page allowed by the page length field maps linearly
+   into memory */
+
+void tlb_fill (TLBENT *tlb, int32 va, int32 apr)
+{
+int32 page = va & ~VA_DF;                               /* mode, space, page */
+int32 lo, hi, base, lim;
+
+if (MMR0 & MMR0_MME) {                                  /* mmgt? */
+    int32 plf = (apr & PDR_PLF) >> 2;                   /* extr page length */
+
+    lo = (apr & PDR_ED)? plf: 0;                        /* valid blocks */
+    hi = ((apr & PDR_ED)? VA_BN: plf) | (VA_DF & ~VA_BN);
+    base = (apr >> 10) & 017777700;
+    lim = (MMR3 & MMR3_M22E)? PAMASK: 0757777;          /* no wrap, I/O page */
+    }
+else {
+    lo = 0;
+    hi = VA_DF;
+    base = va & 0160000;
+    lim = 0157777;
+    }
+if (((hi + base) > lim) || !ADDR_IS_MEM (hi + base))    /* not all memory? */
+    return;
+tlb->va = page | lo;
+tlb->lnt = (uint32) (hi - lo + 1);
+tlb->off = base - page;
+return;
+}
+
+void tlb_flush (void)
+{
+memset (tlb_rd, 0, sizeof (tlb_rd));
+memset (tlb_wr, 0, sizeof (tlb_wr));
+return;
+}
+
 /* Relocate virtual address, write access
 
    Inputs:
@@ -2976,7 +3140,10 @@ return;
 int32 relocW (int32 va)
 {
 int32 apridx, apr, pa;
+TLBENT *tlb = &tlb_wr[(va >> VA_V_APF) & 077];
 
+if ((uint32) (va - tlb->va) < tlb->lnt)                 /* TLB hit? */
+    return va + tlb->off;
 if (MMR0 & MMR0_MME) {                                  /* if mmgt */
     apridx = (va >> VA_V_APF) & 077;                    /* index into APR */
     apr = APRFILE[apridx];                              /* with va<18:13> */
@@ -2991,11 +3158,14 @@ if (MMR0 & MMR0_MME) {                                  /* if mmgt */
         if (pa >= 0760000)
             pa = 017000000 | pa;
         }
+    if ((apr & PDR_ACF) == 6)                           /* read/write? */
+        tlb_fill (tlb, va, apr);
     }
 else {
     pa = va & 0177777;                                  /* mmgt off */
     if (pa >= 0160000)
         pa = 017600000 | pa;
+    else tlb_fill (tlb, va, 0);
     }
 return pa;
 }
@@ -3143,6 +3313,7 @@ switch ((pa >> 1) & 3) {                                /* decode pa<2:1> */
             data = (pa & 1)? (MMR0 & 0377) | (data << 8): (MMR0 & ~0377) | data;
         data = data & cpu_tab[cpu_model].mm0;
         MMR0 = (MMR0 & ~MMR0_WR) | (data & MMR0_WR);
+        tlb_flush ();
         return SCPE_OK;
 
     default:                                            /* MMR1, MMR2 */
@@ -3163,6 +3334,7 @@ if (pa & 1)
 MMR3 = data & cpu_tab[cpu_model].mm3;
 cpu_bme = (MMR3 & MMR3_BME) && (cpu_opt & OPT_UBM);
 dsenable = calc_ds (cm);
+tlb_flush ();
 return SCPE_OK;
 }
 
@@ -3220,6 +3392,7 @@ if (left)
         (((uint32) (data & cpu_tab[cpu_model].par)) << 16)) & ~(PDR_A|PDR_W);
 else APRFILE[idx] = ((APRFILE[idx] & ~0177777) |
     (data & cpu_tab[cpu_model].pdr)) & ~(PDR_A|PDR_W);
+tlb_flush ();
 return SCPE_OK;
 }
 
@@ -3382,6 +3555,12 @@ static const char *pdp11_clock_precalibrate_commands[] = {
     "PC 100",
     NULL};
 
+/* Profiler contexts, indexed by current mode */
+
+static const char *pdp11_prof_contexts[] = {
+    "kernel", "supervisor", "illegal", "user",
+    NULL};
+
 /* Special boot command - linked into SCP by initial reset
 
    Syntax: BOOT {CPU}
@@ -3435,12 +3614,14 @@ MMR0 = 0;
 MMR1 = 0;
 MMR2 = 0;
 MMR3 = 0;
+tlb_flush ();
 trap_req = 0;
 wait_state = 0;
 if (M == NULL) {                    /* First time init */
     M = (uint16 *) calloc (MEMSIZE >> 1, sizeof (uint16));
     if (M == NULL)
         return SCPE_MEM;
+    cpu_unit.mem_base = M;                              /* words for SAVE/RESTORE */
     sim_set_pchar (0, "01000023640"); /* ESC, CR, LF, TAB, BS, BEL, ENQ */
     sim_brk_dflt = SWMASK ('E');
     sim_brk_types = sim_brk_dflt|SWMASK ('P')|
@@ -3449,6 +3630,7 @@ if (M == NULL) {                    /* First time init */
     sim_brk_type_desc = cpu_breakpoints;
     sim_vm_is_subroutine_call = &cpu_is_pc_a_subroutine_call;
     sim_clock_precalibrate_commands = pdp11_clock_precalibrate_commands;
+    sim_vm_prof_contexts = pdp11_prof_contexts;
     auto_config(NULL, 0);           /* do an initial auto configure */
     }
 pcq_r = find_reg ("PCQ", NULL, dptr);
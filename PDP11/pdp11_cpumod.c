@@ -1262,6 +1262,7 @@ for (i = 0; i < clim; i = i + 2)
     nM[i >> 1] = M[i >> 1];
 free (M);
 M = nM;
+uptr->mem_base = M;
 MEMSIZE = val;
 if (!(sim_switches & SIM_SW_REST))                      /* unless restore, */
     cpu_set_bus (cpu_opt);                              /* alter periph config */
@@ -862,6 +862,9 @@ typedef struct pdp_dib DIB;
 #define BPT_SUMM_RD (sim_brk_summ & (BPT_RDVIR | BPT_RDPHY))
 #define BPT_SUMM_WR (sim_brk_summ & (BPT_WRVIR | BPT_WRPHY))
 #define BPT_SUMM_RW (sim_brk_summ & (BPT_RWVIR | BPT_RWPHY))
+/* Only call sim_brk_test for addresses in a page holding a breakpoint
+   of the type, so armed watchpoints don't slow down every access.  */
+#define BPT_TEST(a,t) (SIM_BRK_PAGE (a, t) && sim_brk_test (a, t))
 
 /* Function prototypes */
 
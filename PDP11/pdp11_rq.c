@@ -152,6 +152,7 @@ extern int32 MMR2;
 #define RQ_MAXDR        254                             /* max # drives */
 #define RQ_NUMBY        512                             /* bytes per block */
 #define RQ_MAXFR        (1 << 16)                       /* max xfer */
+#define RQ_MAXQD        16                              /* max xfers queued */
 #define RQ_MAPXFER      (1u << 31)                      /* mapped xfer */
 #define RQ_M_PFN        0x1FFFFF                        /* map entry PFN */
 
@@ -170,8 +171,9 @@ extern int32 MMR2;
 #define uf              buf                             /* settable unit flags */
 #define cnum            wait                            /* controller index */
 #define unit_plug       u4                              /* drive unit plug value */
-#define io_status       u5                              /* io status from callback */
-#define io_complete     u6                              /* io completion flag */
+#define io_status       u5                              /* failed xfers, oldest first */
+#define io_complete     u6                              /* io completion count */
+#define io_depth        u3                              /* xfers queued per read */
 /* we can re-use filebuf because we don't set UNIT_BUFABLE in flags */
 #define rqxb            filebuf                         /* xfer buffer */
 #define RQ_RMV(u)       ((drv_tab[GET_DTYPE (u->flags)].flgs & RQDF_RMV)? \
@@ -1148,6 +1150,8 @@ t_stat rq_set_type (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_set_ctype (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_set_plug (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_show_plug (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat rq_set_asynch (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat rq_show_asynch (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat rq_set_drives (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_show_type (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat rq_show_ctype (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
@@ -1382,11 +1386,17 @@ MTAB rq_mod[] = {
       NULL, &rq_show_type, NULL, "Display device type" },
     { MTAB_XTD|MTAB_VUN|MTAB_VALR, 0, "UNIT", "UNIT=val (0-65534)",
       &rq_set_plug, &rq_show_plug, NULL, "Set/Display Unit plug value" },
+    { MTAB_XTD|MTAB_VUN|MTAB_VALR, 0, "ASYNCH", "ASYNCH=depth (1-16)",
+      &rq_set_asynch, &rq_show_asynch, NULL, "Set/Display number of reads queued to the disk at once" },
+    { MTAB_XTD|MTAB_VUN|MTAB_VALR, 0, "CACHE", "CACHE=MB (0 disables)",
+      &sim_disk_set_cache, &sim_disk_show_cache, NULL, "Set/Display disk cache size and hit/miss counts" },
+    { MTAB_XTD|MTAB_VUN|MTAB_VALR, 0, "ACCESS", "ACCESS={MMAP|STDIO}",
+      &sim_disk_set_access, &sim_disk_show_access, NULL, "Set/Display disk container access method" },
     { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, NULL, "DRIVES=val (4-254)",
       &rq_set_drives, NULL, NULL, "Set Number of Drives" },
     { UNIT_NOAUTO, UNIT_NOAUTO, "noautosize", "NOAUTOSIZE", NULL, NULL, NULL, "Disable disk autosize on attach" },
     { UNIT_NOAUTO,           0, "autosize",   "AUTOSIZE",   NULL, NULL, NULL, "Enable disk autosize on attach" },
-    { MTAB_XTD|MTAB_VUN|MTAB_VALR, 0, "FORMAT", "FORMAT={AUTO|SIMH|VHD|RAW}",
+    { MTAB_XTD|MTAB_VUN|MTAB_VALR, 0, "FORMAT", "FORMAT={AUTO|SIMH|VHD|SIMHX|RAW}",
       &sim_disk_set_fmt, &sim_disk_show_fmt, NULL, "Set/Display disk format" },
 #if defined (VM_PDP11)
     { MTAB_XTD|MTAB_VDV|MTAB_VALR, 004, "ADDRESS", "ADDRESS",
@@ -2355,8 +2365,15 @@ MSC *cp = rq_ctxmap[uptr->cnum];
 
 sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_io_complete(status=%d)\n", status);
 
-uptr->io_status = status;
-uptr->io_complete = 1;
+if (uptr->io_complete < 0) {                            /* read of an ended cmd? */
+    uptr->io_complete = uptr->io_complete + 1;          /* discard it */
+    if ((uptr->io_complete == 0) && uptr->cpkt)         /* next cmd waiting? */
+        sim_activate (uptr, 0);
+    return;
+    }
+if (status != SCPE_OK)                                  /* mark this xfer's slot */
+    uptr->io_status = uptr->io_status | (1 << uptr->io_complete);
+uptr->io_complete = uptr->io_complete + 1;
 /* Reschedule for the appropriate delay */
 sim_activate_notbefore (uptr, uptr->iostarttime+rq_xtime);
 }
@@ -2460,10 +2477,11 @@ return Map_WriteW (ba, bc, buf);                        /* unmapped xfer */
 t_stat rq_svc (UNIT *uptr)
 {
 MSC *cp = rq_ctxmap[uptr->cnum];
-uint32 i, t, tbc, abc, wwc;
+uint32 i, t, tbc, abc, wwc, nxf, depth;
 uint32 err = 0;
 int32 pkt = uptr->cpkt;                                 /* get packet */
 uint32 cmd, ba, bc, bl, ma;
+uint16 *xb = (uint16 *)uptr->rqxb;                      /* xfer buffer */
 
 if ((cp == NULL) || (pkt == 0))                         /* what??? */
     return STOP_RQ;
@@ -2499,7 +2517,10 @@ if ((cmd == OP_ERS) || (cmd == OP_WR)) {                /* write op? */
         }
     }
 
-if (!uptr->io_complete) { /* Top End (I/O Initiation) Processing */
+if (uptr->io_complete <= 0) { /* Top End (I/O Initiation) Processing */
+    if (sim_disk_pending (uptr))                        /* earlier reads queued? */
+        return SCPE_OK;                                 /* wait for their callback */
+    uptr->io_status = 0;                                /* no failed xfers */
     if (cmd == OP_ERS) {                                /* erase? */
         wwc = ((tbc + (RQ_NUMBY - 1)) & ~(RQ_NUMBY - 1)) >> 1;
         memset (uptr->rqxb, 0, wwc * sizeof(uint16));   /* clr buf */
@@ -2519,13 +2540,37 @@ if (!uptr->io_complete) { /* Top End (I/O Initiation) Processing */
         }
 
     else {  /* OP_RD & OP_CMP */
-        err = sim_disk_rdsect_a (uptr, bl, (uint8 *)uptr->rqxb, NULL, (tbc + RQ_NUMBY - 1) / RQ_NUMBY, rq_io_complete);
+        /* Queue up to io_depth maximal transfers to the disk at once.  Only
+           the last transfer of a command can be short, so each batch starts
+           on a multiple of io_depth transfers and transfer n of a command
+           always lands in buffer slot (n % io_depth). */
+        depth = (uptr->io_depth > 1) ? uptr->io_depth : 1;
+        nxf = (bc + RQ_MAXFR - 1) / RQ_MAXFR;           /* xfers remaining */
+        if (nxf > depth)
+            nxf = depth;
+        if (nxf > 1) {                                  /* room for the batch? */
+            void *nb = realloc (uptr->rqxb, depth * RQ_MAXFR);
+
+            if (nb == NULL) {                           /* no, fall back */
+                uptr->io_depth = 1;                     /* to one xfer and slot */
+                nxf = 1;
+                }
+            else uptr->rqxb = nb;
+            xb = (uint16 *)uptr->rqxb;
+            }
+        for (i = 0; i < nxf; i++) {
+            t = bc - (i * RQ_MAXFR);                    /* this xfer's count */
+            if (t > RQ_MAXFR)
+                t = RQ_MAXFR;
+            err = sim_disk_rdsect_a (uptr, bl + i * (RQ_MAXFR / RQ_NUMBY), (uint8 *)(xb + i * (RQ_MAXFR >> 1)), NULL, (t + RQ_NUMBY - 1) / RQ_NUMBY, rq_io_complete);
+            }
         }                                               /* end else read */
     return SCPE_OK;                                     /* done for now until callback */    
     }
 else { /* Bottom End (After I/O processing) */
-    uptr->io_complete = 0;
-    err = uptr->io_status;
+    uptr->io_complete = uptr->io_complete - 1;
+    err = uptr->io_status & 1;                          /* this xfer failed? */
+    uptr->io_status = uptr->io_status >> 1;
     if (cmd == OP_ERS) {                                /* erase? */
         }
 
@@ -2542,9 +2587,11 @@ else { /* Bottom End (After I/O processing) */
         }
 
     else {
-        sim_disk_data_trace(uptr, (uint8 *)uptr->rqxb, bl, tbc, "sim_disk_rdsect", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+        if (uptr->io_depth > 1)                         /* batch slot */
+            xb = xb + (((GETP32 (pkt, RW_BCL) - bc) / RQ_MAXFR) % uptr->io_depth) * (RQ_MAXFR >> 1);
+        sim_disk_data_trace(uptr, (uint8 *)xb, bl, tbc, "sim_disk_rdsect", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
         if ((cmd == OP_RD) && !err) {                   /* read? */
-            if ((t = rq_writew (ba, tbc, ma, (uint16 *)uptr->rqxb))) {/* store, nxm? */
+            if ((t = rq_writew (ba, tbc, ma, xb))) {    /* store, nxm? */
                 PUTP32 (pkt, RW_WBCL, bc - (tbc - t));  /* adj bc */
                 PUTP32 (pkt, RW_WBAL, ba + (tbc - t));  /* adj ba */
                 if (rq_hbe (cp, uptr))                  /* post err log */
@@ -2562,7 +2609,7 @@ else { /* Bottom End (After I/O processing) */
                         rq_rw_end (cp, uptr, EF_LOG, ST_HST | SB_HST_NXM);
                     return SCPE_OK;
                     }
-                dby = (((uint16 *)(uptr->rqxb))[i >> 1] >> ((i & 1)? 8: 0)) & 0xFF;
+                dby = (xb[i >> 1] >> ((i & 1)? 8: 0)) & 0xFF;
                 if (mby != dby) {                       /* cmp err? */
                     PUTP32 (pkt, RW_WBCL, bc - i);      /* adj bc */
                     rq_rw_end (cp, uptr, 0, ST_CMP);    /* done */
@@ -2573,6 +2620,7 @@ else { /* Bottom End (After I/O processing) */
         }                                               /* end else read */
     }                                                   /* end else bottom end */
 if (err != 0) {                                         /* error? */
+    uptr->io_complete = -(int32)sim_disk_pending (uptr);/* discard rest of batch */
     if (rq_dte (cp, uptr, ST_DRV))                      /* post err log */
         rq_rw_end (cp, uptr, EF_LOG, ST_DRV);           /* if ok, report err */
     sim_disk_perror (uptr, "RQ I/O error");
@@ -2604,6 +2652,7 @@ DEVICE *dptr = rq_devmap[uptr->cnum];
 sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_rw_end\n");
 
 uptr->cpkt = 0;                                         /* done */
+uptr->io_complete = -(int32)sim_disk_pending (uptr);    /* discard rest of batch */
 PUTP32 (pkt, RW_BCL, bc - wbc);                         /* bytes processed */
 cp->pak[pkt].d[RW_WBAL] = 0;                            /* clear temps */
 cp->pak[pkt].d[RW_WBAH] = 0;
@@ -3158,6 +3207,32 @@ uptr->unit_plug = plug;
 return SCPE_OK;
 }
 
+/* Set number of reads queued to the disk at once */
+
+t_stat rq_set_asynch (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+int32 depth;
+t_stat r;
+
+if ((cptr == NULL) || (*cptr == '\0'))
+    return sim_messagef (SCPE_ARG, "Must specify ASYNCH=depth\n");
+depth = (int32) get_uint (cptr, 10, RQ_MAXQD, &r);
+if ((r != SCPE_OK) || (depth < 1))
+    return sim_messagef (SCPE_ARG, "Invalid Queue Depth: %s\n", cptr);
+if (uptr->cpkt)
+    return sim_messagef (SCPE_NOFNC, "%s: Can't change queue depth while a transfer is in progress\n", sim_uname (uptr));
+uptr->io_depth = depth;
+return SCPE_OK;
+}
+
+/* Show queue depth */
+
+t_stat rq_show_asynch (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+fprintf (st, "asynch depth=%d", (uptr->io_depth > 1) ? uptr->io_depth : 1);
+return SCPE_OK;
+}
+
 /* Set number of drives */
 
 t_stat rq_set_drives (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
@@ -3352,6 +3427,7 @@ for (i = 0; i < dptr->numunits; i++) {                  /* init units */
     uptr = &dptr->units[i];
     sim_cancel (uptr);                                  /* clr activity */
     sim_disk_reset (uptr);
+    uptr->io_complete = -(int32)sim_disk_pending (uptr);/* discard queued reads */
     uptr->cnum = cidx;                                  /* set ctrl index */
     uptr->flags = uptr->flags & ~(UNIT_ONL | UNIT_ATP);
     uptr->uf = 0;                                       /* clr unit flags */
@@ -3617,6 +3693,17 @@ fprintf (st, "RAUSER is a \"user specified\" disk; the user can specify the size
 fprintf (st, "disk in either MB (1000000 bytes) or logical block numbers (LBN's, 512 bytes\n");
 fprintf (st, "each), or binary MB (1024*1024 bytes).  The minimum size is 5MB; the maximum\n");
 fprintf (st, "size is 2GB without extended file support, 1TB with extended file support.\n\n");
+fprintf (st, "SET RQn ASYNCH=depth lets a read or compare which spans more than one 64KB\n");
+fprintf (st, "transfer queue up to depth transfers to the disk at once.  With asynchronous\n");
+fprintf (st, "I/O enabled, these are performed back to back by the drive's I/O thread while\n");
+fprintf (st, "the simulator keeps running and moves completed data into memory.\n\n");
+fprintf (st, "SET RQn CACHE=MB keeps up to MB megabytes of recently used 64KB runs of the\n");
+fprintf (st, "disk in memory.  Sequential reads are recognized and read ahead, and writes\n");
+fprintf (st, "are held in memory until the simulator stops, the SAVE command is issued or\n");
+fprintf (st, "the unit is detached.  SHOW RQn displays the cache's hit and miss counts.\n\n");
+fprintf (st, "SET RQn ACCESS=MMAP maps a SIMH format or RAW disk container into memory,\n");
+fprintf (st, "so transfers are memory copies rather than file system calls.  Other formats,\n");
+fprintf (st, "or containers the host can't map, use normal file I/O (ACCESS=STDIO).\n\n");
 fprintf (st, "The %s controllers support the BOOT command.\n\n", dptr->name);
 fprint_show_help (st, dptr);
 fprint_reg_help (st, dptr);
@@ -498,7 +498,7 @@ static MTAB rr_mod[] = {
         NULL,           NULL,
         "Disable disk autosize on attach" },
     { MTAB_VUN | MTAB_VALR, 0,
-        "FORMAT",       "FORMAT={AUTO|SIMH|VHD|RAW}",
+        "FORMAT",       "FORMAT={AUTO|SIMH|VHD|SIMHX|RAW}",
         sim_disk_set_fmt, sim_disk_show_fmt, NULL,
         "Set/Display disk format" },
     { MTAB_VDV | MTAB_VALR, RP_IOLN/*modulus*/,
@@ -338,8 +338,15 @@ vt_reset(DEVICE *dptr)
         dptr->flags |= DEV_DIS;
         return sim_messagef (SCPE_NOFNC, "VT and NG device can't both be enabled\n");
         }
-    if (!(dptr->flags & DEV_DIS))
+    if (!(dptr->flags & DEV_DIS)) {
+        t_stat r = vid_can_open ();     /* display available? */
+
+        if (r != SCPE_OK) {
+            dptr->flags |= DEV_DIS;
+            return r;
+            }
         vt11_reset(dptr, DEB_VT11);
+        }
     vid_register_quit_callback (&vt_quit_callback);
     sim_debug (DEB_INT, &vt_dev, "CLR_INT(all)\n");
     CLR_INT (VTST);
@@ -2094,28 +2094,33 @@ t_stat xq_process_local (CTLR* xq, ETH_PACK* pack)
   return SCPE_NOFNC;
 }
 
-void xq_read_callback(CTLR* xq, int status)
+void xq_receive(CTLR* xq, ETH_PACK* pack)
 {
   xq->var->stats.recv += 1;
 
   if (DBG_PCK & xq->dev->dctrl)
-    eth_packet_trace_ex(xq->var->etherface, xq->var->read_buffer.msg, xq->var->read_buffer.len, "xq-recvd", DBG_DAT & xq->dev->dctrl, DBG_PCK);
+    eth_packet_trace_ex(xq->var->etherface, pack->msg, pack->len, "xq-recvd", DBG_DAT & xq->dev->dctrl, DBG_PCK);
 
-  xq->var->read_buffer.used = 0;  /* none processed yet */
+  pack->used = 0;  /* none processed yet */
 
   if ((xq->var->csr & XQ_CSR_RE) || (xq->var->mode == XQ_T_DELQA_PLUS)) { /* receiver enabled */
     /* process any packets locally that can be */
-    t_stat status = xq_process_local (xq, &xq->var->read_buffer);
+    t_stat status = xq_process_local (xq, pack);
 
     /* add packet to read queue */
     if (status != SCPE_OK)
-      ethq_insert(&xq->var->ReadQ, 2, &xq->var->read_buffer, status);
+      ethq_insert(&xq->var->ReadQ, 2, pack, status);
   } else {
     xq->var->stats.dropped += 1;
     sim_debug(DBG_WRN, xq->dev, "packet received with receiver disabled\n");
   }
 }
 
+void xq_read_callback(CTLR* xq, int status)
+{
+  xq_receive(xq, &xq->var->read_buffer);
+}
+
 void xqa_read_callback(int status)
 {
   xq_read_callback(&xq_ctrl[0], status);
@@ -2747,7 +2752,7 @@ t_stat xq_svc(UNIT* uptr)
 
   /* if the receiver is enabled */
   if ((xq->var->mode == XQ_T_DELQA_PLUS) || (xq->var->csr & XQ_CSR_RE)) {
-    t_stat status;
+    ETH_PACK* pack;
 
     /* First pump any queued packets into the system */
     if ((xq->var->ReadQ.count > 0) && ((xq->var->mode == XQ_T_DELQA_PLUS) || (~xq->var->csr & XQ_CSR_RL)))
@@ -2755,10 +2760,11 @@ t_stat xq_svc(UNIT* uptr)
 
     /* Now read and queue packets that have arrived */
     /* This is repeated as long as they are available */
-    do {
-      /* read a packet from the ethernet - processing is via the callback */
-      status = eth_read (xq->var->etherface, &xq->var->read_buffer, xq->var->rcallback);
-    } while (status);
+    /* Each packet is queued directly from the receive buffer it arrived in */
+    while (NULL != (pack = eth_read_peek (xq->var->etherface))) {
+      xq_receive (xq, pack);
+      eth_read_consume (xq->var->etherface);
+    }
 
     /* Now pump any still queued packets into the system */
     if ((xq->var->ReadQ.count > 0) && ((xq->var->mode == XQ_T_DELQA_PLUS) || (~xq->var->csr & XQ_CSR_RL)))
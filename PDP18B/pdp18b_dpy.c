@@ -34,6 +34,7 @@
 #if defined(TYPE340)
 #include "display/type340.h"
 #include "display/display.h"
+#include "sim_video.h"
 
 #define DBG_IOT         001         /* IOT instructions. */
 #define DBG_IRQ         002         /* Interrupts. */
@@ -107,6 +108,12 @@ ty340word ty340_fetch(ty340word addr)
 t_stat dpy_reset (DEVICE *dptr)
 {
   if (!(dptr->flags & DEV_DIS)) {
+    t_stat r = vid_can_open ();         /* display available? */
+
+    if (r != SCPE_OK) {
+      dptr->flags |= DEV_DIS;
+      return r;
+    }
     display_reset();
     ty340_reset(dptr);
   }
@@ -124,8 +124,16 @@ dpy_reset(DEVICE *dptr)
     display_close (dptr);
     sim_cancel (&dpy_unit);
   } else {
+    t_stat r = vid_can_open ();
+    if (r != SCPE_OK) {
+      dptr->flags |= DEV_DIS;
+      return r;
+    }
     display_reset ();
-    display_init (DIS_TYPE30, 1, dptr);
+    if (!display_init (DIS_TYPE30, 1, dptr)) {
+      dptr->flags |= DEV_DIS;
+      return sim_messagef (SCPE_NOFNC, "Display initialization failed\n");
+    }
     vid_register_quit_callback (&dpy_quit_callback);
     sim_activate_abs (&dpy_unit, 0);
   }
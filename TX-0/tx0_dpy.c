@@ -150,10 +150,20 @@ t_stat dpy_svc (UNIT *uptr)
 
 t_stat dpy_reset (DEVICE *dptr)
 {
+    t_stat r;
+
     sim_cancel (&dpy_unit);     /* deactivate unit */
     if (dpy_dev.flags & DEV_DIS)                /* disabled? */
         return SCPE_OK;
-    display_init(DIS_TX0, RES_FULL, dptr);
+    r = vid_can_open ();                        /* display available? */
+    if (r != SCPE_OK) {
+        dpy_dev.flags |= DEV_DIS;
+        return r;
+        }
+    if (!display_init(DIS_TX0, RES_FULL, dptr)) {
+        dpy_dev.flags |= DEV_DIS;
+        return sim_messagef (SCPE_NOFNC, "Display initialization failed\n");
+        }
     display_reset();
     vid_register_quit_callback (&dpy_quit_callback);
     iosta = iosta & ~(IOS_PNT | IOS_SPC); /* clear flags */
@@ -30,6 +30,7 @@
 */
 
 #include "vax_defs.h"
+#include "sim_video.h"
 
 #ifdef DONT_USE_INTERNAL_ROM
 #define BOOT_CODE_FILENAME "ka410.bin"
@@ -930,43 +931,56 @@ return SCPE_OK;
 t_stat cpu_set_model (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
 {
 char gbuf[CBUFSIZE];
+t_stat r;
 
 if ((cptr == NULL) || (!*cptr))
     return SCPE_ARG;
 cptr = get_glyph (cptr, gbuf, 0);
 if (MATCH_CMD(gbuf, "MICROVAX") == 0) {
     sys_model = 0;
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
     va_dev.flags = vc_dev.flags | DEV_DIS;               /* disable GPX */
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     lk_dev.flags = lk_dev.flags | DEV_DIS;               /* disable keyboard */
     vs_dev.flags = vs_dev.flags | DEV_DIS;               /* disable mouse */
 #endif
     strcpy (sim_name, "MicroVAX 2000 (KA410)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
     }
 else if (MATCH_CMD(gbuf, "VAXSTATION") == 0) {
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     va_dev.flags = va_dev.flags | DEV_DIS;               /* disable GPX */
     vc_dev.flags = vc_dev.flags & ~DEV_DIS;              /* enable MVO */
     lk_dev.flags = lk_dev.flags & ~DEV_DIS;              /* enable keyboard */
     vs_dev.flags = vs_dev.flags & ~DEV_DIS;              /* enable mouse */
     strcpy (sim_name, "VAXstation 2000 (KA410)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
     }
 else if (MATCH_CMD(gbuf, "VAXSTATIONGPX") == 0) {
-#if defined (USE_SIM_VIDEO) && defined (HAVE_LIBSDL)
+#if defined (USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     va_dev.flags = va_dev.flags & ~DEV_DIS;              /* enable GPX */
     lk_dev.flags = lk_dev.flags & ~DEV_DIS;              /* enable keyboard */
     vs_dev.flags = vs_dev.flags & ~DEV_DIS;              /* enable mouse */
     strcpy (sim_name, "VAXstation 2000/GPX (KA410)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
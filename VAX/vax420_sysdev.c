@@ -30,6 +30,7 @@
 */
 
 #include "vax_defs.h"
+#include "sim_video.h"
 #include "sim_ether.h"
 
 #ifdef DONT_USE_INTERNAL_ROM
@@ -1099,6 +1100,7 @@ return SCPE_OK;
 t_stat cpu_set_model (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
 {
 char gbuf[CBUFSIZE];
+t_stat r;
 
 if ((cptr == NULL) || (!*cptr))
     return SCPE_ARG;
@@ -1111,7 +1113,9 @@ if (MATCH_CMD(gbuf, "MICROVAX") == 0) {
 #else   /* VAX_41D */
     strcpy (sim_name, "MicroVAX 3100 M10e/M20e (KA41-D)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
     }
 else if (MATCH_CMD(gbuf, "VAXSERVER") == 0) {
     sys_model = 1;
@@ -1120,7 +1124,9 @@ else if (MATCH_CMD(gbuf, "VAXSERVER") == 0) {
 #else   /* VAX_41D */
     strcpy (sim_name, "VAXserver 3100 M10e/M20e (KA41-D)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
     }
 else
     return SCPE_ARG;
@@ -1129,7 +1135,7 @@ else
 if ((MATCH_CMD(gbuf, "VAXSERVER") == 0) ||
     (MATCH_CMD(gbuf, "MICROVAX") == 0)) {                /* needed by VA,VC,VE */
     sys_model = 0;
-#if defined (USE_SIM_VIDEO) && defined (HAVE_LIBSDL)
+#if defined (USE_SIM_VIDEO)
     va_dev.flags = vc_dev.flags | DEV_DIS;               /* disable GPX */
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     ve_dev.flags = vc_dev.flags | DEV_DIS;               /* disable SPX */
@@ -1141,10 +1147,15 @@ if ((MATCH_CMD(gbuf, "VAXSERVER") == 0) ||
 #else   /* VAX_42B */
     strcpy (sim_name, "VAXserver 3100 M38 (KA42-B)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
     }
 else if (MATCH_CMD(gbuf, "VAXSTATION") == 0) {
-#if defined (USE_SIM_VIDEO) && defined (HAVE_LIBSDL)
+#if defined (USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     va_dev.flags = va_dev.flags | DEV_DIS;               /* disable GPX */
     ve_dev.flags = ve_dev.flags | DEV_DIS;               /* disable SPX */
@@ -1156,13 +1167,18 @@ else if (MATCH_CMD(gbuf, "VAXSTATION") == 0) {
 #else   /* VAX_42B */
     strcpy (sim_name, "VAXstation 3100 M38 (KA42-B)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
     }
 else if (MATCH_CMD(gbuf, "VAXSTATIONGPX") == 0) {
-#if defined (USE_SIM_VIDEO) && defined (HAVE_LIBSDL)
+#if defined (USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     ve_dev.flags = ve_dev.flags | DEV_DIS;               /* disable SPX */
@@ -1174,13 +1190,18 @@ else if (MATCH_CMD(gbuf, "VAXSTATIONGPX") == 0) {
 #else   /* VAX_42B */
     strcpy (sim_name, "VAXstation 3100 M38/GPX (KA42-B)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
     }
 else if (MATCH_CMD(gbuf, "VAXSTATIONSPX") == 0) {
-#if defined (USE_SIM_VIDEO) && defined (HAVE_LIBSDL)
+#if defined (USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     va_dev.flags = va_dev.flags | DEV_DIS;               /* disable GPX */
@@ -1192,7 +1213,9 @@ else if (MATCH_CMD(gbuf, "VAXSTATIONSPX") == 0) {
 #else   /* VAX_42B */
     strcpy (sim_name, "VAXstation 3100 M38/SPX (KA42-B)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
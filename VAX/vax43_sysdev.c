@@ -30,6 +30,7 @@
 */
 
 #include "vax_defs.h"
+#include "sim_video.h"
 #include "sim_ether.h"
 
 #ifdef DONT_USE_INTERNAL_ROM
@@ -1046,6 +1047,7 @@ return SCPE_OK;
 t_stat cpu_set_model (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
 {
 char gbuf[CBUFSIZE];
+t_stat r;
 
 if ((cptr == NULL) || (!*cptr))
     return SCPE_ARG;
@@ -1053,37 +1055,49 @@ cptr = get_glyph (cptr, gbuf, 0);
 if ((MATCH_CMD(gbuf, "VAXSERVER") == 0) ||
     (MATCH_CMD(gbuf, "MICROVAX") == 0)) {                /* needed by VC,VE */
     sys_model = 0;
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     ve_dev.flags = vc_dev.flags | DEV_DIS;               /* disable SPX */
     lk_dev.flags = lk_dev.flags | DEV_DIS;               /* disable keyboard */
     vs_dev.flags = vs_dev.flags | DEV_DIS;               /* disable mouse */
 #endif
     strcpy (sim_name, "VAXserver 3100 M76 (KA43-A)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
     }
 else if (MATCH_CMD(gbuf, "VAXSTATION") == 0) {
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     ve_dev.flags = ve_dev.flags | DEV_DIS;               /* disable SPX */
     vc_dev.flags = vc_dev.flags & ~DEV_DIS;              /* enable MVO */
     lk_dev.flags = lk_dev.flags & ~DEV_DIS;              /* enable keyboard */
     vs_dev.flags = vs_dev.flags & ~DEV_DIS;              /* enable mouse */
     strcpy (sim_name, "VAXstation 3100 M76 (KA43-A)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
     }
 else if (MATCH_CMD(gbuf, "VAXSTATIONSPX") == 0) {
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     vc_dev.flags = vc_dev.flags | DEV_DIS;               /* disable MVO */
     ve_dev.flags = ve_dev.flags & ~DEV_DIS;              /* enable SPX */
     lk_dev.flags = lk_dev.flags & ~DEV_DIS;              /* enable keyboard */
     vs_dev.flags = vs_dev.flags & ~DEV_DIS;              /* enable mouse */
     strcpy (sim_name, "VAXstation 3100 M76/SPX (KA43-A)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
@@ -30,6 +30,7 @@
 */
 
 #include "vax_defs.h"
+#include "sim_video.h"
 #include "sim_ether.h"
 
 #ifdef DONT_USE_INTERNAL_ROM
@@ -1040,22 +1041,28 @@ return SCPE_OK;
 t_stat cpu_set_model (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
 {
 char gbuf[CBUFSIZE];
+t_stat r;
 
 if ((cptr == NULL) || (!*cptr))
     return SCPE_ARG;
 cptr = get_glyph (cptr, gbuf, 0);
 if (MATCH_CMD(gbuf, "MICROVAX") == 0) {
     sys_model = 0;
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
     lk_dev.flags = lk_dev.flags | DEV_DIS;               /* disable keyboard */
     vs_dev.flags = vs_dev.flags | DEV_DIS;               /* disable mouse */
 #endif
     strcpy (sim_name, "MicroVAX 3100-80 (KA47)");
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
     }
 #if defined (VAX_46) || defined (VAX_48)
 else if (MATCH_CMD(gbuf, "VAXSTATION") == 0) {
-#if defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(USE_SIM_VIDEO)
+    r = vid_can_open ();                                 /* display available? */
+    if (r != SCPE_OK)
+        return r;
     sys_model = 1;
     lk_dev.flags = lk_dev.flags & ~DEV_DIS;              /* enable keyboard */
     vs_dev.flags = vs_dev.flags & ~DEV_DIS;              /* enable mouse */
@@ -1064,7 +1071,9 @@ else if (MATCH_CMD(gbuf, "VAXSTATION") == 0) {
 #else   /* VAX_48 */
     strcpy (sim_name, "VAXstation 4000-VLC (KA48)");
 #endif
-    reset_all (0);                                       /* reset everything */
+    r = reset_all (0);                                   /* reset everything */
+    if (r != SCPE_OK)
+        return r;
 #else
     return sim_messagef (SCPE_ARG, "Simulator built without Graphic Device Support\n");
 #endif
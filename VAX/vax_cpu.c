@@ -180,6 +180,21 @@
 
         vax_defs.h      add device address and interrupt definitions
         vax_sys.c       add sim_devices table entry
+
+   4. Decode cache.  If SET CPU DECODECACHE is in effect, the instruction
+      stream items fetched while decoding an instruction (opcode,
+      specifier bytes, displacements, immediates, branch displacements)
+      are remembered in a direct mapped table keyed by the physical PC.
+      When the same physical PC is decoded again, get_istr returns the
+      remembered items instead of going through the prefetch buffer, so
+      operand references, register side effects and faults still happen
+      in the normal specifier flows.  Instructions whose specifiers are
+      all literals, registers, immediates or branch displacements skip
+      the specifier flows altogether (see dc_predecode).  Physical writes
+      to a page which holds cached instructions bump that page's
+      generation, which invalidates every entry filled from it.  Writes
+      aren't tracked while the cache is disabled, so enabling it always
+      starts from an empty table.
 */
 
 /* Definitions */
@@ -233,6 +248,31 @@
                         r = arl; \
                         rh = arh
 
+#define DC_SIZE         4096                            /* decode cache size */
+#define DC_MASK         (DC_SIZE - 1)
+#define DC_HASH(pa)     (((pa) ^ ((pa) >> 12)) & DC_MASK)
+#define DC_MAXITM       16                              /* max istream items */
+
+#define DC_CONST        16                              /* osrc: constant operand */
+
+typedef struct {
+    int32               pa;                             /* physical PC, -1 = inv */
+    uint32              gen;                            /* page generation */
+    uint8               nitm;                           /* number of items */
+    uint8               ilnt;                           /* instruction length */
+    uint8               lnt[DC_MAXITM];                 /* item lengths */
+    int32               val[DC_MAXITM];                 /* item values */
+    t_bool              fast;                           /* operands predecoded */
+    uint8               nopnd;                          /* number of operands */
+    uint8               osrc[OPND_SIZE];                /* register or DC_CONST */
+    int32               oval[OPND_SIZE];                /* register mask or value */
+    uint8               nspec;                          /* non branch specifiers */
+    uint8               spec, rn;                       /* last specifier */
+    int8                vfl;                            /* vfldrp1 register or -1 */
+    int8                vaoff;                          /* immediate va offset or -1 */
+    int32               brdisp;                         /* branch displacement */
+    } DCENT;
+
 
 uint32 *M = NULL;                                       /* memory */
 int32 R[16];                                            /* registers */
@@ -267,6 +307,13 @@ int32 cpu_astop = 0;
 int32 mchk_va, mchk_ref;                                /* mem ref param */
 int32 ibufl, ibufh;                                     /* prefetch buf */
 int32 ibcnt, ppc;                                       /* prefetch ctl */
+DCENT *dc_tab = NULL;                                   /* decode cache */
+t_bool dc_enb = FALSE;                                  /* dc_tab != NULL */
+DCENT *dc_cur = NULL;                                   /* active entry */
+t_bool dc_fill;                                         /* filling vs replaying */
+int32 dc_pos;                                           /* istream item index */
+int32 dc_spc, dc_spa;                                   /* instr virt, phys PC */
+uint32 dc_pgen[MAXMEMSIZE_X >> VA_N_OFF];               /* code page generations */
 uint32 cpu_idle_mask =                                  /* idle mask */
 #if defined (VAX_411) || defined (VAX_412)
                        VAX_IDLE_INFOSERVER;
@@ -325,11 +372,15 @@ t_stat cpu_show_hist (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat cpu_show_virt (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat cpu_set_idle (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat cpu_show_idle (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat cpu_set_dcache (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_dcache (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat cpu_set_instruction_set (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat cpu_show_instruction_set (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 const char *cpu_description (DEVICE *dptr);
 int32 cpu_get_vsw (int32 sw);
 static SIM_INLINE int32 get_istr (int32 lnt, int32 acc);
+int32 dc_istr (int32 lnt, int32 acc);
+t_bool dc_predecode (DCENT *dc, int32 opc, int32 *opnd);
 int32 ReadOcta (int32 va, int32 *opnd, int32 j, int32 acc);
 t_bool cpu_show_opnd (FILE *st, InstHistory *h, int32 line);
 t_stat cpu_show_hist_records (FILE *st, t_bool do_header, int32 start, int32 count);
@@ -432,6 +483,8 @@ MTAB cpu_mod[] = {
     { UNIT_CONH, UNIT_CONH, "HALT to console", "CONHALT", NULL, NULL, NULL, "Set HALT to trap to console ROM" },
     { MTAB_XTD|MTAB_VDV, 0, "IDLE", "IDLE{=VMS|ULTRIX|ULTRIX-1.X|ULTRIXOLD|NETBSD|NETBSDOLD|OPENBSD|OPENBSDOLD|QUASIJARUS|32V|ELN|MDM|INFOSERVER}{:n}", &cpu_set_idle, &cpu_show_idle, NULL, "Display idle detection mode" },
     { MTAB_XTD|MTAB_VDV, 0, NULL, "NOIDLE", &sim_clr_idle, NULL, NULL,  "Disables idle detection" },
+    { MTAB_XTD|MTAB_VDV, 1, "DECODECACHE", "DECODECACHE", &cpu_set_dcache, &cpu_show_dcache, NULL, "Enable predecoded instruction cache" },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NODECODECACHE", &cpu_set_dcache, NULL, NULL, "Disable predecoded instruction cache" },
     MEM_MODIFIERS,   /* Model specific memory modifiers from vaxXXX_defs.h */
     { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP|MTAB_NC, 0, "HISTORY", "HISTORY=n",
       &cpu_set_hist, &cpu_show_hist, NULL, "Enable/Display instruction history" },
@@ -500,6 +553,138 @@ int32 spec = 0, disp = 0, rn = 0, index = 0, numspec = 0;
 int32 vfldrp1 = 0, brdisp = 0, flg = 0, mstat = 0;
 uint32 va = 0, iad = 0;
 int32 opnd[OPND_SIZE];                                  /* operand queue */
+#if defined (SIM_THREADED)
+static const void *const op_dispatch[NUM_INST] = {  /* threaded dispatch */
+    &&op_HALT, &&op_NOP, &&op_REI, &&op_BPT,                    /* 000 */
+    &&op_RET, &&op_RSB, &&op_LDPCTX, &&op_SVPCTX,               /* 004 */
+    &&op_CVTPL, &&op_CVTPL, &&op_INDEX, &&op_CVTPL,             /* 008 */
+    &&op_PROBER, &&op_PROBER, &&op_INSQUE, &&op_REMQUE,         /* 00C */
+    &&op_BSBB, &&op_BRB, &&op_BNEQ, &&op_BEQL,                  /* 010 */
+    &&op_BGTR, &&op_BLEQ, &&op_JSB, &&op_JMP,                   /* 014 */
+    &&op_BGEQ, &&op_BLSS, &&op_BGTRU, &&op_BLEQU,               /* 018 */
+    &&op_BVC, &&op_BVS, &&op_BGEQU, &&op_BLSSU,                 /* 01C */
+    &&op_CVTPL, &&op_CVTPL, &&op_CVTPL, &&op_CVTPL,             /* 020 */
+    &&op_CVTPL, &&op_CVTPL, &&op_CVTPL, &&op_CVTPL,             /* 024 */
+    &&op_MOVC3, &&op_CMPC3, &&op_SCANC, &&op_SCANC,             /* 028 */
+    &&op_MOVC3, &&op_CMPC3, &&op_CVTPL, &&op_CVTPL,             /* 02C */
+    &&op_BSBW, &&op_BRW, &&op_CVTWL, &&op_CVTWB,                /* 030 */
+    &&op_CVTPL, &&op_CVTPL, &&op_CVTPL, &&op_CVTPL,             /* 034 */
+    &&op_CVTPL, &&op_CVTPL, &&op_LOCC, &&op_LOCC,               /* 038 */
+    &&op_MOVL, &&op_ACBW, &&op_MOVL, &&op_PUSHL,                /* 03C */
+    &&op_ADDF2, &&op_ADDF2, &&op_SUBF2, &&op_SUBF2,             /* 040 */
+    &&op_MULF2, &&op_MULF2, &&op_DIVF2, &&op_DIVF2,             /* 044 */
+    &&op_CVTFB, &&op_CVTFW, &&op_CVTFL, &&op_CVTFL,             /* 048 */
+    &&op_CVTBF, &&op_CVTWF, &&op_CVTLF, &&op_ACBF,              /* 04C */
+    &&op_MOVF, &&op_CMPF, &&op_MNEGF, &&op_TSTF,                /* 050 */
+    &&op_EMODF, &&op_POLYF, &&op_CVTFD, &&op_default,           /* 054 */
+    &&op_ADAWI, &&op_default, &&op_default, &&op_default,       /* 058 */
+    &&op_INSQHI, &&op_INSQTI, &&op_REMQHI, &&op_REMQTI,         /* 05C */
+    &&op_ADDD2, &&op_ADDD2, &&op_SUBD2, &&op_SUBD2,             /* 060 */
+    &&op_MULD2, &&op_MULD2, &&op_DIVD2, &&op_DIVD2,             /* 064 */
+    &&op_CVTFB, &&op_CVTFW, &&op_CVTFL, &&op_CVTFL,             /* 068 */
+    &&op_CVTBD, &&op_CVTWD, &&op_CVTLD, &&op_ACBD,              /* 06C */
+    &&op_MOVD, &&op_CMPD, &&op_MNEGD, &&op_TSTF,                /* 070 */
+    &&op_EMODD, &&op_POLYD, &&op_CVTDF, &&op_default,           /* 074 */
+    &&op_ASHL, &&op_ASHQ, &&op_EMUL, &&op_EDIV,                 /* 078 */
+    &&op_CLRQ, &&op_MOVQ, &&op_MOVL, &&op_PUSHL,                /* 07C */
+    &&op_ADDB2, &&op_ADDB2, &&op_SUBB2, &&op_SUBB2,             /* 080 */
+    &&op_MULB2, &&op_MULB2, &&op_DIVB2, &&op_DIVB2,             /* 084 */
+    &&op_BISB2, &&op_BISB2, &&op_BICB2, &&op_BICB2,             /* 088 */
+    &&op_XORB2, &&op_XORB2, &&op_MNEGB, &&op_CASEB,             /* 08C */
+    &&op_MOVB, &&op_CMPB, &&op_MCOMB, &&op_BITB,                /* 090 */
+    &&op_CLRB, &&op_TSTB, &&op_INCB, &&op_DECB,                 /* 094 */
+    &&op_CVTBL, &&op_CVTBW, &&op_MOVL, &&op_MOVW,               /* 098 */
+    &&op_ROTL, &&op_ACBB, &&op_MOVL, &&op_PUSHL,                /* 09C */
+    &&op_ADDW2, &&op_ADDW2, &&op_SUBW2, &&op_SUBW2,             /* 0A0 */
+    &&op_MULW2, &&op_MULW2, &&op_DIVW2, &&op_DIVW2,             /* 0A4 */
+    &&op_BISW2, &&op_BISW2, &&op_BICW2, &&op_BICW2,             /* 0A8 */
+    &&op_XORW2, &&op_XORW2, &&op_MNEGW, &&op_CASEW,             /* 0AC */
+    &&op_MOVW, &&op_CMPW, &&op_MCOMW, &&op_BITW,                /* 0B0 */
+    &&op_CLRW, &&op_TSTW, &&op_INCW, &&op_DECW,                 /* 0B4 */
+    &&op_BISPSW, &&op_BICPSW, &&op_POPR, &&op_PUSHR,            /* 0B8 */
+    &&op_CHMK, &&op_CHMK, &&op_CHMK, &&op_CHMK,                 /* 0BC */
+    &&op_ADDL2, &&op_ADDL2, &&op_SUBL2, &&op_SUBL2,             /* 0C0 */
+    &&op_MULL2, &&op_MULL2, &&op_DIVL2, &&op_DIVL2,             /* 0C4 */
+    &&op_BISL2, &&op_BISL2, &&op_BICL2, &&op_BICL2,             /* 0C8 */
+    &&op_XORL2, &&op_XORL2, &&op_MNEGL, &&op_CASEL,             /* 0CC */
+    &&op_MOVL, &&op_CMPL, &&op_MCOML, &&op_BITL,                /* 0D0 */
+    &&op_CLRL, &&op_TSTL, &&op_INCL, &&op_DECL,                 /* 0D4 */
+    &&op_ADWC, &&op_SBWC, &&op_MTPR, &&op_MFPR,                 /* 0D8 */
+    &&op_MOVPSL, &&op_PUSHL, &&op_MOVL, &&op_PUSHL,             /* 0DC */
+    &&op_BBS, &&op_BBC, &&op_BBSS, &&op_BBCS,                   /* 0E0 */
+    &&op_BBSC, &&op_BBCC, &&op_BBSS, &&op_BBCC,                 /* 0E4 */
+    &&op_BLBS, &&op_BLBC, &&op_FFS, &&op_FFC,                   /* 0E8 */
+    &&op_CMPV, &&op_CMPZV, &&op_EXTV, &&op_EXTZV,               /* 0EC */
+    &&op_INSV, &&op_ACBL, &&op_AOBLSS, &&op_AOBLEQ,             /* 0F0 */
+    &&op_SOBGEQ, &&op_SOBGTR, &&op_CVTLB, &&op_CVTLW,           /* 0F4 */
+    &&op_CVTPL, &&op_CVTPL, &&op_CALLG, &&op_CALLS,             /* 0F8 */
+    &&op_XFC, &&op_default, &&op_default, &&op_default,         /* 0FC */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 100 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 104 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 108 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 10C */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 110 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 114 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 118 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 11C */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 120 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 124 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 128 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 12C */
+    &&op_default, &&op_default, &&op_TSTH, &&op_CVTGF,          /* 130 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 134 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 138 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 13C */
+    &&op_ADDG2, &&op_ADDG2, &&op_SUBG2, &&op_SUBG2,             /* 140 */
+    &&op_MULG2, &&op_MULG2, &&op_DIVG2, &&op_DIVG2,             /* 144 */
+    &&op_CVTFB, &&op_CVTFW, &&op_CVTFL, &&op_CVTFL,             /* 148 */
+    &&op_CVTBD, &&op_CVTWD, &&op_CVTLD, &&op_ACBG,              /* 14C */
+    &&op_MOVG, &&op_CMPG, &&op_MNEGG, &&op_TSTG,                /* 150 */
+    &&op_EMODG, &&op_POLYG, &&op_TSTH, &&op_default,            /* 154 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 158 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 15C */
+    &&op_TSTH, &&op_TSTH, &&op_TSTH, &&op_TSTH,                 /* 160 */
+    &&op_TSTH, &&op_TSTH, &&op_TSTH, &&op_TSTH,                 /* 164 */
+    &&op_TSTH, &&op_TSTH, &&op_TSTH, &&op_TSTH,                 /* 168 */
+    &&op_TSTH, &&op_TSTH, &&op_TSTH, &&op_TSTH,                 /* 16C */
+    &&op_TSTH, &&op_TSTH, &&op_TSTH, &&op_TSTH,                 /* 170 */
+    &&op_TSTH, &&op_TSTH, &&op_TSTH, &&op_default,              /* 174 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 178 */
+    &&op_PUSHAO, &&op_PUSHAO, &&op_PUSHAO, &&op_PUSHAO,         /* 17C */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 180 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 184 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 188 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 18C */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 190 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 194 */
+    &&op_TSTH, &&op_CVTFG, &&op_default, &&op_default,          /* 198 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 19C */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1A0 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1A4 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1A8 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1AC */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1B0 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1B4 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1B8 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1BC */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1C0 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1C4 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1C8 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1CC */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1D0 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1D4 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1D8 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1DC */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1E0 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1E4 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1E8 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1EC */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1F0 */
+    &&op_default, &&op_default, &&op_TSTH, &&op_TSTH,           /* 1F4 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1F8 */
+    &&op_default, &&op_default, &&op_default, &&op_default,     /* 1FC */
+    };
+#endif
 
 if ((ret = build_dib_tab ()) != SCPE_OK)                /* build, chk dib_tab */
     return ret;
@@ -516,8 +701,10 @@ set_map_reg ();                                         /* set map reg */
 GET_CUR;                                                /* set access mask */
 SET_IRQL;                                               /* eval interrupts */
 FLUSH_ISTR;                                             /* clear prefetch */
+cpu_dc_flush ();                                        /* mem may have changed */
 
 abortval = setjmp (save_env);                           /* set abort hdlr */
+dc_cur = NULL;                                          /* cancel decode cache */
 if (abortval > 0) {                                     /* sim stop? */
     PSL = PSL | cc;                                     /* put PSL together */
     pcq_r->qptr = pcq_p;                                /* update pc q ptr */
@@ -722,12 +909,47 @@ for ( ;; ) {
         }                                               /* end PSL event */
 
     if (sim_brk_summ &&
+        SIM_BRK_PAGE ((uint32) PC, SWMASK ('E')) &&
         sim_brk_test ((uint32) PC, SWMASK ('E'))) {     /* breakpoint? */
         ABORT (STOP_IBKPT);                             /* stop simulation */
         }
+    SIM_PROF_SAMPLE (PC, PSL_GETCUR (PSL));             /* profile */
 
     sim_interval = sim_interval - (1 + (extra_bytes>>5));/* count instr */
     extra_bytes = 0;                                    /* digest string count */
+    if (dc_tab) {                                       /* decode cache? */
+        int32 pa = -1;
+
+        if ((ppc < 0) || ((ibcnt == 0) && (VA_GETOFF (ppc) == 0))) {
+            pa = Test (PC & ~03, RD, &temp);            /* xlate PC */
+            if (pa >= 0) {
+                ibcnt = 0;                              /* prefetch from it */
+                ppc = pa;
+                pa = pa | (PC & 03);
+                }
+            }
+        else if (ibcnt == 0)                            /* ppc is PC's lw */
+            pa = ppc | (PC & 03);
+        else if ((VA_GETOFF (PC & ~03) + ibcnt) <= VA_PAGSIZE)
+            pa = ppc - ibcnt + (PC & 03);               /* ibuf in one page */
+        if ((pa >= 0) && ADDR_IS_MEM (pa)) {
+            DCENT *dc = &dc_tab[DC_HASH (pa)];
+
+            if ((dc->pa == pa) &&                       /* hit, page unchanged? */
+                (dc->gen == dc_pgen[pa >> VA_N_OFF])) {
+                dc_cur = dc;                            /* replay istream */
+                dc_fill = FALSE;
+                }
+            else if ((PSL & PSL_FPD) == 0) {            /* else fill */
+                dc->pa = -1;
+                dc_cur = dc;
+                dc_fill = TRUE;
+                }
+            dc_spc = PC;
+            dc_spa = pa;
+            dc_pos = 0;
+            }
+        }
     GET_ISTR (opc, L_BYTE);                             /* get opcode */
     if (opc == 0xFD) {                                  /* 2 byte op? */
         GET_ISTR (opc, L_BYTE);                         /* get second byte */
@@ -757,6 +979,23 @@ for ( ;; ) {
 #endif
         j = 0;                                          /* no operands */
         }
+    else if (dc_cur && !dc_fill && dc_cur->fast) {      /* predecoded? */
+        DCENT *dc = dc_cur;
+
+        for (j = 0; j < dc->nopnd; j++)
+            opnd[j] = (dc->osrc[j] == DC_CONST)? dc->oval[j]:
+                R[dc->osrc[j]] & dc->oval[j];
+        if (dc->nspec) {
+            spec = dc->spec;
+            rn = dc->rn;
+            }
+        if (dc->vfl >= 0)
+            vfldrp1 = R[dc->vfl];
+        if (dc->vaoff >= 0)
+            va = dc_spc + dc->vaoff;
+        brdisp = dc->brdisp;
+        PC = dc_spc + dc->ilnt;
+        }
     else {
         numspec = numspec & DR_NSPMASK;                 /* get # specifiers */
 
@@ -1558,6 +1797,33 @@ for ( ;; ) {
             }                                           /* end for */
         }                                               /* end if not FPD */
 
+/* Finish decode cache replay or fill.  After a replay the prefetch
+   buffer is restarted at the (physical) end of the decoded istream;
+   a fill is kept only if the instruction lies within one page.
+*/
+
+    if (dc_cur) {                                       /* decode cache active? */
+        int32 lnt = PC - dc_spc;
+
+        if (!dc_fill) {                                 /* replayed? */
+            if ((uint32) lnt <= dc_cur->ilnt) {
+                ibcnt = 0;
+                ppc = (dc_spa + lnt) & ~03;
+                }
+            else FLUSH_ISTR;
+            }
+        else if ((dc_pos <= DC_MAXITM) && (lnt > 0) &&  /* filled, fits? */
+            ((VA_GETOFF (dc_spc) + lnt) <= VA_PAGSIZE)) {
+            dc_pgen[dc_spa >> VA_N_OFF] |= 1;           /* page has code */
+            dc_cur->gen = dc_pgen[dc_spa >> VA_N_OFF];
+            dc_cur->nitm = (uint8) dc_pos;
+            dc_cur->ilnt = (uint8) lnt;
+            dc_cur->fast = dc_predecode (dc_cur, opc, opnd);
+            dc_cur->pa = dc_spa;
+            }
+        dc_cur = NULL;
+        }
+
 /* Optionally record instruction history */
 
     if (hst_lnt) {
@@ -1592,6 +1858,9 @@ for ( ;; ) {
 
 /* Dispatch to instructions */
 
+#if defined (SIM_THREADED)
+    goto *op_dispatch[opc];                             /* jump into switch */
+#endif
     switch (opc) {              
 
 /* Single operand instructions with dest, write only - CLRx dst.wx
@@ -1601,25 +1870,25 @@ for ( ;; ) {
         va      =       virtual address
 */
 
-    case CLRB:
+    case CLRB: SIM_OPLABEL (op_CLRB)
         r = 0;
         WRITE_B (r);                                    /* store result */
         CC_ZZ1P;                                        /* set cc's */
         break;
 
-    case CLRW:
+    case CLRW: SIM_OPLABEL (op_CLRW)
         r = 0;
         WRITE_W (r);                                    /* store result */
         CC_ZZ1P;                                        /* set cc's */
         break;
 
-    case CLRL:
+    case CLRL: SIM_OPLABEL (op_CLRL)
         r = 0;
         WRITE_L (r);                                    /* store result */
         CC_ZZ1P;                                        /* set cc's */
         break;
 
-    case CLRQ:
+    case CLRQ: SIM_OPLABEL (op_CLRQ)
         r = rh = 0;
         WRITE_Q (r, rh);                                /* store result */
         CC_ZZ1P;                                        /* set cc's */
@@ -1630,15 +1899,15 @@ for ( ;; ) {
         opnd[0] =       source
 */
 
-    case TSTB:
+    case TSTB: SIM_OPLABEL (op_TSTB)
         CC_IIZZ_B (op0);                                /* set cc's */
         break;
 
-    case TSTW:
+    case TSTW: SIM_OPLABEL (op_TSTW)
         CC_IIZZ_W (op0);                                /* set cc's */
         break;
 
-    case TSTL:
+    case TSTL: SIM_OPLABEL (op_TSTL)
         CC_IIZZ_L (op0);                                /* set cc's */
         if ((cc == CC_Z) &&                             /* zero result and */
             ((PC - fault_PC) == 6) &&                   /* 6 byte instruction? */
@@ -1662,37 +1931,37 @@ for ( ;; ) {
         va      =       operand address
 */
 
-    case INCB:
+    case INCB: SIM_OPLABEL (op_INCB)
         r = (op0 + 1) & BMASK;                          /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_ADD_B (r, 1, op0);                           /* set cc's */
         break;
 
-    case INCW:
+    case INCW: SIM_OPLABEL (op_INCW)
         r = (op0 + 1) & WMASK;                          /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_ADD_W (r, 1, op0);                           /* set cc's */
         break;
 
-    case INCL:
+    case INCL: SIM_OPLABEL (op_INCL)
         r = (op0 + 1) & LMASK;                          /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_ADD_L (r, 1, op0);                           /* set cc's */
         break;
 
-    case DECB:
+    case DECB: SIM_OPLABEL (op_DECB)
         r = (op0 - 1) & BMASK;                          /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_SUB_B (r, 1, op0);                           /* set cc's */
         break;
 
-    case DECW:
+    case DECW: SIM_OPLABEL (op_DECW)
         r = (op0 - 1) & WMASK;                          /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_SUB_W (r, 1, op0);                           /* set cc's */
         break;
 
-    case DECL:
+    case DECL: SIM_OPLABEL (op_DECL)
         r = (op0 - 1) & LMASK;                          /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_SUB_L (r, 1, op0);                           /* set cc's */
@@ -1703,7 +1972,7 @@ for ( ;; ) {
         opnd[0] =       source
 */
 
-    case PUSHL: case PUSHAB: case PUSHAW: case PUSHAL: case PUSHAQ:
+    case PUSHL: case PUSHAB: case PUSHAW: case PUSHAL: case PUSHAQ: SIM_OPLABEL (op_PUSHL)
         Write (SP - 4, op0, L_LONG, WA);                /* push operand */
         SP = SP - 4;                                    /* decr stack ptr */
         CC_IIZP_L (op0);                                /* set cc's */
@@ -1717,80 +1986,80 @@ for ( ;; ) {
         va      =       operand address
 */
 
-    case MOVB:
+    case MOVB: SIM_OPLABEL (op_MOVB)
         r = op0;
         WRITE_B (r);                                    /* result */
         CC_IIZP_B (r);                                  /* set cc's */
         break;
 
-    case MOVW: case MOVZBW:
+    case MOVW: case MOVZBW: SIM_OPLABEL (op_MOVW)
         r = op0;
         WRITE_W (r);                                    /* result */
         CC_IIZP_W (r);                                  /* set cc's */
         break;
 
-    case MOVL: case MOVZBL: case MOVZWL:
+    case MOVL: case MOVZBL: case MOVZWL: SIM_OPLABEL (op_MOVL)
     case MOVAB: case MOVAW: case MOVAL: case MOVAQ:
         r = op0;
         WRITE_L (r);                                    /* result */
         CC_IIZP_L (r);                                  /* set cc's */
         break;
 
-    case MCOMB:
+    case MCOMB: SIM_OPLABEL (op_MCOMB)
         r = op0 ^ BMASK;                                /* compl opnd */
         WRITE_B (r);                                    /* store result */
         CC_IIZP_B (r);                                  /* set cc's */
         break;
 
-    case MCOMW:
+    case MCOMW: SIM_OPLABEL (op_MCOMW)
         r = op0 ^ WMASK;                                /* compl opnd */
         WRITE_W (r);                                    /* store result */
         CC_IIZP_W (r);                                  /* set cc's */
         break;
 
-    case MCOML:
+    case MCOML: SIM_OPLABEL (op_MCOML)
         r = op0 ^ LMASK;                                /* compl opnd */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
         break;
 
-    case MNEGB:
+    case MNEGB: SIM_OPLABEL (op_MNEGB)
         r = (-op0) & BMASK;                             /* negate opnd */
         WRITE_B (r);                                    /* store result */
         CC_SUB_B (r, op0, 0);                           /* set cc's */
         break;
 
-    case MNEGW:
+    case MNEGW: SIM_OPLABEL (op_MNEGW)
         r = (-op0) & WMASK;                             /* negate opnd */
         WRITE_W (r);                                    /* store result */
         CC_SUB_W (r, op0, 0);                           /* set cc's */
         break;
 
-    case MNEGL:
+    case MNEGL: SIM_OPLABEL (op_MNEGL)
         r = (-op0) & LMASK;                             /* negate opnd */
         WRITE_L (r);                                    /* store result */
         CC_SUB_L (r, op0, 0);                           /* set cc's */
         break;
 
-    case CVTBW:
+    case CVTBW: SIM_OPLABEL (op_CVTBW)
         r = SXTBW (op0);                                /* ext sign */
         WRITE_W (r);                                    /* store result */
         CC_IIZZ_W (r);                                  /* set cc's */
         break;
 
-    case CVTBL:
+    case CVTBL: SIM_OPLABEL (op_CVTBL)
         r = SXTB (op0);                                 /* ext sign */
         WRITE_L (r);                                    /* store result */
         CC_IIZZ_L (r);                                  /* set cc's */
         break;
 
-    case CVTWL:
+    case CVTWL: SIM_OPLABEL (op_CVTWL)
         r = SXTW (op0);                                 /* ext sign */
         WRITE_L (r);                                    /* store result */
         CC_IIZZ_L (r);                                  /* set cc's */
         break;
 
-    case CVTLB:
+    case CVTLB: SIM_OPLABEL (op_CVTLB)
         r = op0 & BMASK;                                /* set result */
         WRITE_B (r);                                    /* store result */
         CC_IIZZ_B (r);                                  /* initial cc's */
@@ -1799,7 +2068,7 @@ for ( ;; ) {
             }
         break;
 
-    case CVTLW:
+    case CVTLW: SIM_OPLABEL (op_CVTLW)
         r = op0 & WMASK;                                /* set result */
         WRITE_W (r);                                    /* store result */
         CC_IIZZ_W (r);                                  /* initial cc's */
@@ -1808,7 +2077,7 @@ for ( ;; ) {
             }
         break;
 
-    case CVTWB:
+    case CVTWB: SIM_OPLABEL (op_CVTWB)
         r = op0 & BMASK;                                /* set result */
         WRITE_B (r);                                    /* store result */
         CC_IIZZ_B (r);                                  /* initial cc's */
@@ -1818,7 +2087,7 @@ for ( ;; ) {
             }
         break;
 
-    case ADAWI:
+    case ADAWI: SIM_OPLABEL (op_ADAWI)
         if (op1 >= 0) temp = R[op1] & WMASK;            /* reg? ADDW2 */
         else {
             if (op2 & 1)                                /* mem? chk align */
@@ -1836,29 +2105,29 @@ for ( ;; ) {
         opnd[1] =       source2
 */
 
-    case CMPB:
+    case CMPB: SIM_OPLABEL (op_CMPB)
         CC_CMP_B (op0, op1);                            /* set cc's */
         break;
 
-    case CMPW:
+    case CMPW: SIM_OPLABEL (op_CMPW)
         CC_CMP_W (op0, op1);                            /* set cc's */
         break;
 
-    case CMPL:
+    case CMPL: SIM_OPLABEL (op_CMPL)
         CC_CMP_L (op0, op1);                            /* set cc's */
         break;
 
-    case BITB:
+    case BITB: SIM_OPLABEL (op_BITB)
         r = op1 & op0;                                  /* calc result */
         CC_IIZP_B (r);                                  /* set cc's */
         break;
 
-    case BITW:
+    case BITW: SIM_OPLABEL (op_BITW)
         r = op1 & op0;                                  /* calc result */
         CC_IIZP_W (r);                                  /* set cc's */
         break;
 
-    case BITL:
+    case BITL: SIM_OPLABEL (op_BITL)
         r = op1 & op0;                                  /* calc result */
         CC_IIZP_L (r);                                  /* set cc's */
         if ((cc == CC_Z) &&
@@ -1881,19 +2150,19 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case ADDB2: case ADDB3:
+    case ADDB2: case ADDB3: SIM_OPLABEL (op_ADDB2)
         r = (op1 + op0) & BMASK;                        /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_ADD_B (r, op0, op1);                         /* set cc's */
         break;
 
-    case ADDW2: case ADDW3:
+    case ADDW2: case ADDW3: SIM_OPLABEL (op_ADDW2)
         r = (op1 + op0) & WMASK;                        /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_ADD_W (r, op0, op1);                         /* set cc's */
         break;
 
-    case ADWC:
+    case ADWC: SIM_OPLABEL (op_ADWC)
         r = (op1 + op0 + (cc & CC_C)) & LMASK;          /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_ADD_L (r, op0, op1);                         /* set cc's */
@@ -1901,25 +2170,25 @@ for ( ;; ) {
             cc = cc | CC_C;
         break;
 
-    case ADDL2: case ADDL3:
+    case ADDL2: case ADDL3: SIM_OPLABEL (op_ADDL2)
         r = (op1 + op0) & LMASK;                        /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_ADD_L (r, op0, op1);                         /* set cc's */
         break;
 
-    case SUBB2: case SUBB3:
+    case SUBB2: case SUBB3: SIM_OPLABEL (op_SUBB2)
         r = (op1 - op0) & BMASK;                        /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_SUB_B (r, op0, op1);                         /* set cc's */
         break;
 
-    case SUBW2: case SUBW3:
+    case SUBW2: case SUBW3: SIM_OPLABEL (op_SUBW2)
         r = (op1 - op0) & WMASK;                        /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_SUB_W (r, op0, op1);                         /* set cc's */
         break;
 
-    case SBWC:
+    case SBWC: SIM_OPLABEL (op_SBWC)
         r = (op1 - op0 - (cc & CC_C)) & LMASK;          /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_SUB_L (r, op0, op1);                         /* set cc's */
@@ -1927,13 +2196,13 @@ for ( ;; ) {
             cc = cc | CC_C;
         break;
 
-    case SUBL2: case SUBL3:
+    case SUBL2: case SUBL3: SIM_OPLABEL (op_SUBL2)
         r = (op1 - op0) & LMASK;                        /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_SUB_L (r, op0, op1);                         /* set cc's */
         break;
 
-    case MULB2: case MULB3:
+    case MULB2: case MULB3: SIM_OPLABEL (op_MULB2)
         temp = SXTB (op0) * SXTB (op1);                 /* multiply */
         r = temp & BMASK;                               /* mask to result */
         WRITE_B (r);                                    /* store result */
@@ -1943,7 +2212,7 @@ for ( ;; ) {
             }
         break;
 
-    case MULW2: case MULW3:
+    case MULW2: case MULW3: SIM_OPLABEL (op_MULW2)
         temp = SXTW (op0) * SXTW (op1);                 /* multiply */
         r = temp & WMASK;                               /* mask to result */
         WRITE_W (r);                                    /* store result */
@@ -1953,7 +2222,7 @@ for ( ;; ) {
             }
         break;
 
-    case MULL2: case MULL3:
+    case MULL2: case MULL3: SIM_OPLABEL (op_MULL2)
         r = op_emul (op0, op1, &rh);                    /* get 64b result */
         WRITE_L (r);                                    /* store result */
         CC_IIZZ_L (r);                                  /* set cc's */
@@ -1962,7 +2231,7 @@ for ( ;; ) {
             }
         break;
 
-    case DIVB2: case DIVB3:
+    case DIVB2: case DIVB3: SIM_OPLABEL (op_DIVB2)
         if (op0 == 0) {                                 /* div by zero? */
             r = op1;
             temp = CC_V;
@@ -1983,7 +2252,7 @@ for ( ;; ) {
         cc = cc | temp;                                 /* error? set V */
         break;
 
-    case DIVW2: case DIVW3:
+    case DIVW2: case DIVW3: SIM_OPLABEL (op_DIVW2)
         if (op0 == 0) {                                 /* div by zero? */
             r = op1;
             temp = CC_V;
@@ -2004,7 +2273,7 @@ for ( ;; ) {
         cc = cc | temp;                                 /* error? set V */
         break;
 
-    case DIVL2: case DIVL3:
+    case DIVL2: case DIVL3: SIM_OPLABEL (op_DIVL2)
         if (op0 == 0) {                                 /* div by zero? */
             r = op1;
             temp = CC_V;
@@ -2026,55 +2295,55 @@ for ( ;; ) {
         cc = cc | temp;                                 /* error? set V */
         break;
 
-    case BISB2: case BISB3:
+    case BISB2: case BISB3: SIM_OPLABEL (op_BISB2)
         r = op1 | op0;                                  /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_IIZP_B (r);                                  /* set cc's */
         break;
 
-    case BISW2: case BISW3:
+    case BISW2: case BISW3: SIM_OPLABEL (op_BISW2)
         r = op1 | op0;                                  /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_IIZP_W (r);                                  /* set cc's */
         break;
 
-    case BISL2: case BISL3:
+    case BISL2: case BISL3: SIM_OPLABEL (op_BISL2)
         r = op1 | op0;                                  /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
         break;
 
-    case BICB2: case BICB3:
+    case BICB2: case BICB3: SIM_OPLABEL (op_BICB2)
         r = op1 & ~op0;                                 /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_IIZP_B (r);                                  /* set cc's */
         break;
 
-    case BICW2: case BICW3:
+    case BICW2: case BICW3: SIM_OPLABEL (op_BICW2)
         r = op1 & ~op0;                                 /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_IIZP_W (r);                                  /* set cc's */
         break;
 
-    case BICL2: case BICL3:
+    case BICL2: case BICL3: SIM_OPLABEL (op_BICL2)
         r = op1 & ~op0;                                 /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
         break;
 
-    case XORB2: case XORB3:
+    case XORB2: case XORB3: SIM_OPLABEL (op_XORB2)
         r = op1 ^ op0;                                  /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_IIZP_B (r);                                  /* set cc's */
         break;
 
-    case XORW2: case XORW3:
+    case XORW2: case XORW3: SIM_OPLABEL (op_XORW2)
         r = op1 ^ op0;                                  /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_IIZP_W (r);                                  /* set cc's */
         break;
 
-    case XORL2: case XORL3:
+    case XORL2: case XORL3: SIM_OPLABEL (op_XORL2)
         r = op1 ^ op0;                                  /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2089,7 +2358,7 @@ for ( ;; ) {
         
 */
 
-    case MOVQ:
+    case MOVQ: SIM_OPLABEL (op_MOVQ)
         WRITE_Q (op0, op1);                             /* store result */
         CC_IIZP_Q (op0, op1);
         break;
@@ -2103,7 +2372,7 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case ROTL:
+    case ROTL: SIM_OPLABEL (op_ROTL)
         j = op0 % 32;                                   /* reduce sc, mod 32 */
         if (j)
             r = ((((uint32) op1) << j) | (((uint32) op1) >> (32 - j))) & LMASK;
@@ -2112,7 +2381,7 @@ for ( ;; ) {
         CC_IIZP_L (r);                                  /* set cc's */
         break;
 
-    case ASHL:
+    case ASHL: SIM_OPLABEL (op_ASHL)
         if (op0 & BSIGN) {                              /* right shift? */
             temp = 0x100 - op0;                         /* get |shift| */
             if (temp > 31)                              /* sc > 31? */
@@ -2137,7 +2406,7 @@ for ( ;; ) {
             }
         break;
 
-    case ASHQ:
+    case ASHQ: SIM_OPLABEL (op_ASHQ)
         r = op_ashq (opnd, &rh, &flg);                  /* do qw shift */
         WRITE_Q (r, rh);                                /* store results */
         CC_IIZZ_Q (r, rh);                              /* set cc's */
@@ -2154,7 +2423,7 @@ for ( ;; ) {
         op3:op4 =       destination (.wq)
 */
 
-    case EMUL:
+    case EMUL: SIM_OPLABEL (op_EMUL)
         r = op_emul (op0, op1, &rh);                    /* calc 64b result */
         r = r + op2;                                    /* add 32b value */
         rh = rh + (((uint32) r) < ((uint32) op2)) -     /* into 64b result */
@@ -2171,7 +2440,7 @@ for ( ;; ) {
         op5:op6 =       remainder address (.wl)
 */
 
-    case EDIV:
+    case EDIV: SIM_OPLABEL (op_EDIV)
         if (op5 < 0)                                    /* wtest remainder */
             Read (op6, L_LONG, WA);
         if (op0 == 0) {                                 /* divide by zero? */
@@ -2200,15 +2469,15 @@ for ( ;; ) {
 
 /* Simple branches and subroutine calls */
 
-    case BRB:
+    case BRB: SIM_OPLABEL (op_BRB)
         BRANCHB (brdisp);                               /* branch  */
         break;
 
-    case BRW:
+    case BRW: SIM_OPLABEL (op_BRW)
         BRANCHW (brdisp);                               /* branch */
         break;
 
-    case BSBB:
+    case BSBB: SIM_OPLABEL (op_BSBB)
         Write (SP - 4, PC, L_LONG, WA);                 /* push PC on stk */
         SP = SP - 4;                                    /* decr stk ptr */
         BRANCHB (brdisp);                               /* branch  */
@@ -2216,7 +2485,7 @@ for ( ;; ) {
             ++step_out_nest_level;
         break;
 
-    case BSBW:
+    case BSBW: SIM_OPLABEL (op_BSBW)
         Write (SP - 4, PC, L_LONG, WA);                 /* push PC on stk */
         SP = SP - 4;                                    /* decr stk ptr */
         BRANCHW (brdisp);                               /* branch */
@@ -2224,22 +2493,22 @@ for ( ;; ) {
             ++step_out_nest_level;
         break;
 
-    case BGEQ:
+    case BGEQ: SIM_OPLABEL (op_BGEQ)
         if (!(cc & CC_N))                               /* br if N = 0 */
             BRANCHB (brdisp);
         break;
 
-    case BLSS:
+    case BLSS: SIM_OPLABEL (op_BLSS)
         if (cc & CC_N)                                  /* br if N = 1 */
             BRANCHB (brdisp);
         break;
 
-    case BNEQ:
+    case BNEQ: SIM_OPLABEL (op_BNEQ)
         if (!(cc & CC_Z))                               /* br if Z = 0 */
             BRANCHB (brdisp);
         break;
 
-    case BEQL:
+    case BEQL: SIM_OPLABEL (op_BEQL)
         if (cc & CC_Z) {                                /* br if Z = 1 */
             BRANCHB (brdisp);
             if ((((PSL & PSL_IS) != 0) &&               /* on IS? */
@@ -2255,12 +2524,12 @@ for ( ;; ) {
             }
         break;
 
-    case BVC:
+    case BVC: SIM_OPLABEL (op_BVC)
         if (!(cc & CC_V))                               /* br if V = 0 */
             BRANCHB (brdisp);
         break;
 
-    case BVS:
+    case BVS: SIM_OPLABEL (op_BVS)
         if (cc & CC_V) {                                /* br if V = 1 */
             BRANCHB (brdisp);
             if ((cpu_idle_mask & VAX_IDLE_INFOSERVER) &&/* INFOSERVER Idle? */
@@ -2271,32 +2540,32 @@ for ( ;; ) {
             }
         break;
 
-    case BGEQU:
+    case BGEQU: SIM_OPLABEL (op_BGEQU)
         if (!(cc & CC_C))                               /* br if C = 0 */
             BRANCHB (brdisp);
         break;
 
-    case BLSSU:
+    case BLSSU: SIM_OPLABEL (op_BLSSU)
         if (cc & CC_C)                                  /* br if C = 1 */
             BRANCHB (brdisp);
         break;
 
-    case BGTR:
+    case BGTR: SIM_OPLABEL (op_BGTR)
         if (!(cc & (CC_N | CC_Z)))                      /* br if N | Z = 0 */
             BRANCHB (brdisp);
         break;
 
-    case BLEQ:
+    case BLEQ: SIM_OPLABEL (op_BLEQ)
         if (cc & (CC_N | CC_Z))                         /* br if N | Z = 1 */
             BRANCHB (brdisp);
         break;
 
-    case BGTRU:
+    case BGTRU: SIM_OPLABEL (op_BGTRU)
         if (!(cc & (CC_C | CC_Z)))                      /* br if C | Z = 0 */
             BRANCHB (brdisp);
         break;
 
-    case BLEQU:
+    case BLEQU: SIM_OPLABEL (op_BLEQU)
         if (cc & (CC_C | CC_Z))                         /* br if C | Z = 1 */
             BRANCHB (brdisp);
         break;
@@ -2306,17 +2575,17 @@ for ( ;; ) {
         opnd[0] =       address
 */
 
-    case JSB:
+    case JSB: SIM_OPLABEL (op_JSB)
         Write (SP - 4, PC, L_LONG, WA);                 /* push PC on stk */
         SP = SP - 4;                                    /* decr stk ptr */
         if (sim_switches & SWMASK ('R'))
             ++step_out_nest_level;
 
-    case JMP:
+    case JMP: SIM_OPLABEL (op_JMP)
         JUMP (op0);                                     /* jump */
         break;
 
-    case RSB:
+    case RSB: SIM_OPLABEL (op_RSB)
         temp = Read (SP, L_LONG, RA);                   /* get top of stk */
         SP = SP + 4;                                    /* incr stk ptr */
         JUMP_ALWAYS (temp);
@@ -2336,7 +2605,7 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case SOBGEQ:
+    case SOBGEQ: SIM_OPLABEL (op_SOBGEQ)
         r = op0 - 1;                                    /* decr index */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2345,7 +2614,7 @@ for ( ;; ) {
             BRANCHB_ALWAYS (brdisp);
         break;
 
-    case SOBGTR:
+    case SOBGTR: SIM_OPLABEL (op_SOBGTR)
         r = op0 - 1;                                    /* decr index */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2363,7 +2632,7 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case AOBLSS:
+    case AOBLSS: SIM_OPLABEL (op_AOBLSS)
         r = op1 + 1;                                    /* incr index */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2372,7 +2641,7 @@ for ( ;; ) {
             BRANCHB_ALWAYS (brdisp);
         break;
 
-    case AOBLEQ:
+    case AOBLEQ: SIM_OPLABEL (op_AOBLEQ)
         r = op1 + 1;                                    /* incr index */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2391,7 +2660,7 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case ACBB:
+    case ACBB: SIM_OPLABEL (op_ACBB)
         r = (op2 + op1) & BMASK;                        /* calc result */
         WRITE_B (r);                                    /* store result */
         CC_IIZP_B (r);                                  /* set cc's */
@@ -2400,7 +2669,7 @@ for ( ;; ) {
             BRANCHW_ALWAYS (brdisp);
         break;
 
-    case ACBW:
+    case ACBW: SIM_OPLABEL (op_ACBW)
         r = (op2 + op1) & WMASK;                        /* calc result */
         WRITE_W (r);                                    /* store result */
         CC_IIZP_W (r);                                  /* set cc's */
@@ -2409,7 +2678,7 @@ for ( ;; ) {
             BRANCHW_ALWAYS (brdisp);
         break;
 
-    case ACBL:
+    case ACBL: SIM_OPLABEL (op_ACBL)
         r = (op2 + op1) & LMASK;                        /* calc result */
         WRITE_L (r);                                    /* store result */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2425,7 +2694,7 @@ for ( ;; ) {
         opnd[2] =       limit
 */
 
-    case CASEB:
+    case CASEB: SIM_OPLABEL (op_CASEB)
         r = (op0 - op1) & BMASK;                        /* sel - base */
         CC_CMP_B (r, op2);                              /* r:limit, set cc's */
         if (r > op2)                                    /* r > limit (unsgnd)? */
@@ -2436,7 +2705,7 @@ for ( ;; ) {
             }
         break;
 
-    case CASEW:
+    case CASEW: SIM_OPLABEL (op_CASEW)
         r = (op0 - op1) & WMASK;                        /* sel - base */
         CC_CMP_W (r, op2);                              /* r:limit, set cc's */
         if (r > op2)                                    /* r > limit (unsgnd)? */
@@ -2447,7 +2716,7 @@ for ( ;; ) {
             }
         break;
 
-    case CASEL:
+    case CASEL: SIM_OPLABEL (op_CASEL)
         r = (op0 - op1) & LMASK;                        /* sel - base */
         CC_CMP_L (r, op2);                              /* r:limit, set cc's */
         if (((uint32) r) > ((uint32) op2))              /* r > limit (unsgnd)? */
@@ -2465,7 +2734,7 @@ for ( ;; ) {
         opnd[2] =       memory address, if memory
 */
 
-    case BBS:
+    case BBS: SIM_OPLABEL (op_BBS)
         if (op_bb_n (opnd, acc)) {                      /* br if bit set */
             BRANCHB_ALWAYS (brdisp);
             if (((PSL & PSL_IS) != 0) &&                /* on IS? */
@@ -2475,37 +2744,37 @@ for ( ;; ) {
             }
         break;
 
-    case BBC:
+    case BBC: SIM_OPLABEL (op_BBC)
         if (!op_bb_n (opnd, acc))                       /* br if bit clr */
             BRANCHB_ALWAYS (brdisp);
         break;
 
-    case BBSS: case BBSSI:
+    case BBSS: case BBSSI: SIM_OPLABEL (op_BBSS)
         if (op_bb_x (opnd, 1, acc))                     /* br if set, set */
             BRANCHB (brdisp);
         break;
 
-    case BBCC: case BBCCI:
+    case BBCC: case BBCCI: SIM_OPLABEL (op_BBCC)
         if (!op_bb_x (opnd, 0, acc))                    /* br if clr, clr*/
             BRANCHB (brdisp);
         break;
 
-    case BBSC:
+    case BBSC: SIM_OPLABEL (op_BBSC)
         if (op_bb_x (opnd, 0, acc))                     /* br if clr, set */
             BRANCHB_ALWAYS (brdisp);
         break;
 
-    case BBCS:
+    case BBCS: SIM_OPLABEL (op_BBCS)
         if (!op_bb_x (opnd, 1, acc))                    /* br if set, clr */
             BRANCHB_ALWAYS (brdisp);
         break;
 
-    case BLBS:
+    case BLBS: SIM_OPLABEL (op_BLBS)
         if (op0 & 1)                                    /* br if bit set */
             BRANCHB (brdisp);
         break;
 
-    case BLBC:
+    case BLBC: SIM_OPLABEL (op_BLBC)
         if ((op0 & 1) == 0) {                           /* br if bit clear */
             if (fault_PC == 0x20040C09)                 /* MicroVAX 2 Boot ROM Character Prompt? */
                 cpu_idle();
@@ -2524,7 +2793,7 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case EXTV:
+    case EXTV: SIM_OPLABEL (op_EXTV)
         r = op_extv (opnd, vfldrp1, acc);               /* get field */
         if (r & byte_sign[op1])
             r = r | ~byte_mask[op1];
@@ -2532,7 +2801,7 @@ for ( ;; ) {
         CC_IIZP_L (r);                                  /* set cc's */
         break;
 
-    case EXTZV:
+    case EXTZV: SIM_OPLABEL (op_EXTZV)
         r = op_extv (opnd, vfldrp1, acc);               /* get field */
         WRITE_L (r);                                    /* store field */
         CC_IIZP_L (r);                                  /* set cc's */
@@ -2547,14 +2816,14 @@ for ( ;; ) {
         opnd[4] =       source2
 */
 
-    case CMPV:
+    case CMPV: SIM_OPLABEL (op_CMPV)
         r = op_extv (opnd, vfldrp1, acc);               /* get field */
         if (r & byte_sign[op1])
             r = r | ~byte_mask[op1];
         CC_CMP_L (r, op4);                              /* set cc's */
         break;
 
-    case CMPZV:
+    case CMPZV: SIM_OPLABEL (op_CMPZV)
         r = op_extv (opnd, vfldrp1, acc);               /* get field */
         CC_CMP_L (r, op4);                              /* set cc's */
         break;
@@ -2570,7 +2839,7 @@ for ( ;; ) {
         va      =       memory address
 */
 
-    case FFS:
+    case FFS: SIM_OPLABEL (op_FFS)
         r = op_extv (opnd, vfldrp1, acc);               /* get field */
         temp = op_ffs (r, op1);                         /* find first 1 */
         WRITE_L (op0 + temp);                           /* store result */
@@ -2584,7 +2853,7 @@ for ( ;; ) {
             cpu_idle();                                 /* idle loop */
         break;
 
-    case FFC:
+    case FFC: SIM_OPLABEL (op_FFC)
         r = op_extv (opnd, vfldrp1, acc);               /* get field */
         r = r ^ byte_mask[op1];                         /* invert bits */
         temp = op_ffs (r, op1);                         /* find first 1 */
@@ -2602,7 +2871,7 @@ for ( ;; ) {
         opnd[4] =       register content/memory address
 */
 
-    case INSV:
+    case INSV: SIM_OPLABEL (op_INSV)
         op_insv (opnd, vfldrp1, acc);                   /* insert field */
         break;
 
@@ -2612,19 +2881,19 @@ for ( ;; ) {
         opnd[1] =       procedure address
 */
 
-    case CALLS:
+    case CALLS: SIM_OPLABEL (op_CALLS)
         cc = op_call (opnd, TRUE, acc);
         if (sim_switches & SWMASK ('R'))
             ++step_out_nest_level;
         break;
 
-    case CALLG:
+    case CALLG: SIM_OPLABEL (op_CALLG)
         cc = op_call (opnd, FALSE, acc);
         if (sim_switches & SWMASK ('R'))
             ++step_out_nest_level;
         break;
 
-    case RET:
+    case RET: SIM_OPLABEL (op_RET)
         cc = op_ret (acc);
         if (sim_switches & SWMASK ('R')) {
             if (step_out_nest_level <= 0)
@@ -2636,7 +2905,7 @@ for ( ;; ) {
 
 /* Miscellaneous instructions */
 
-    case HALT:
+    case HALT: SIM_OPLABEL (op_HALT)
         if (PSL & PSL_CUR)                              /* not kern? rsvd inst */
             RSVD_INST_FAULT(HALT);
         else {
@@ -2657,51 +2926,51 @@ for ( ;; ) {
                 ABORT (STOP_HALT);                      /* halt to simulator */
             }
 
-    case NOP:
+    case NOP: SIM_OPLABEL (op_NOP)
         break;
 
-    case BPT:
+    case BPT: SIM_OPLABEL (op_BPT)
         SETPC (fault_PC);
         PSL = PSL & ~PSL_TP;                                /* clear <tp> */
         cc = intexc (SCB_BPT, cc, 0, IE_EXC);
         GET_CUR;
         break;
 
-    case XFC:
+    case XFC: SIM_OPLABEL (op_XFC)
         SETPC (fault_PC);
         PSL = PSL & ~PSL_TP;                                /* clear <tp> */
         cc = intexc (SCB_XFC, cc, 0, IE_EXC);
         GET_CUR;
         break;
 
-    case BISPSW:
+    case BISPSW: SIM_OPLABEL (op_BISPSW)
         if (opnd[0] & PSW_MBZ)
             RSVD_OPND_FAULT(BISPW);
         PSL = PSL | (opnd[0] & ~CC_MASK);
         cc = cc | (opnd[0] & CC_MASK);
         break;
 
-    case BICPSW:
+    case BICPSW: SIM_OPLABEL (op_BICPSW)
         if (opnd[0] & PSW_MBZ)
             RSVD_OPND_FAULT(BICPSW);
         PSL = PSL & ~opnd[0];
         cc = cc & ~opnd[0];
         break;
 
-    case MOVPSL:
+    case MOVPSL: SIM_OPLABEL (op_MOVPSL)
         r = PSL | cc;
         WRITE_L (r);
         break;
 
-    case PUSHR:
+    case PUSHR: SIM_OPLABEL (op_PUSHR)
         op_pushr (opnd, acc);
         break;
 
-    case POPR:
+    case POPR: SIM_OPLABEL (op_POPR)
         op_popr (opnd, acc);
         break;
 
-    case INDEX:
+    case INDEX: SIM_OPLABEL (op_INDEX)
         if ((op0 < op1) || (op0 > op2))
             SET_TRAP (TRAP_SUBSCR);
         r = (op0 + op4) * op3;
@@ -2711,37 +2980,37 @@ for ( ;; ) {
 
 /* Queue and interlocked queue */
 
-    case INSQUE:
+    case INSQUE: SIM_OPLABEL (op_INSQUE)
         cc = op_insque (opnd, acc);
         break;
 
-    case REMQUE:
+    case REMQUE: SIM_OPLABEL (op_REMQUE)
         cc = op_remque (opnd, acc);
         break;
 
-    case INSQHI:
+    case INSQHI: SIM_OPLABEL (op_INSQHI)
         cc = op_insqhi (opnd, acc);
         break;
 
-    case INSQTI:
+    case INSQTI: SIM_OPLABEL (op_INSQTI)
         cc = op_insqti (opnd, acc);
         break;
 
-    case REMQHI:
+    case REMQHI: SIM_OPLABEL (op_REMQHI)
         cc = op_remqhi (opnd, acc);
         break;
 
-    case REMQTI:
+    case REMQTI: SIM_OPLABEL (op_REMQTI)
         cc = op_remqti (opnd, acc);
         break;
 
 /* String instructions */
 
-    case MOVC3: case MOVC5:
+    case MOVC3: case MOVC5: SIM_OPLABEL (op_MOVC3)
         cc = op_movc (opnd, opc & 4, acc);
         break;
 
-    case CMPC3: case CMPC5:
+    case CMPC3: case CMPC5: SIM_OPLABEL (op_CMPC3)
 #if defined(VAX_610)
         if (opc == CMPC5) {
             cc = cpu_emulate_exception (opnd, cc, opc, acc);
@@ -2751,115 +3020,115 @@ for ( ;; ) {
         cc = op_cmpc (opnd, opc & 4, acc);
         break;
 
-    case LOCC: case SKPC:
+    case LOCC: case SKPC: SIM_OPLABEL (op_LOCC)
         cc = op_locskp (opnd, opc & 1, acc);
         break;
 
-    case SCANC: case SPANC:
+    case SCANC: case SPANC: SIM_OPLABEL (op_SCANC)
         cc = op_scnspn (opnd, opc & 1, acc);
         break;
 
 /* Floating point instructions */
 
-    case TSTF: case TSTD:
+    case TSTF: case TSTD: SIM_OPLABEL (op_TSTF)
         r = op_movfd (op0);
         CC_IIZZ_FP (r);
         break;
 
-    case TSTG:
+    case TSTG: SIM_OPLABEL (op_TSTG)
         r = op_movg (op0);
         CC_IIZZ_FP (r);
         break;
 
-    case MOVF:
+    case MOVF: SIM_OPLABEL (op_MOVF)
         r = op_movfd (op0);
         WRITE_L (r);
         CC_IIZP_FP (r);
         break;
 
-    case MOVD:
+    case MOVD: SIM_OPLABEL (op_MOVD)
         if ((r = op_movfd (op0)) == 0)
             op1 = 0;
         WRITE_Q (r, op1);
         CC_IIZP_FP (r);
         break;
 
-    case MOVG:
+    case MOVG: SIM_OPLABEL (op_MOVG)
         if ((r = op_movg (op0)) == 0)
             op1 = 0;
         WRITE_Q (r, op1);
         CC_IIZP_FP (r);
         break;
 
-    case MNEGF:
+    case MNEGF: SIM_OPLABEL (op_MNEGF)
         r = op_mnegfd (op0);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case MNEGD:
+    case MNEGD: SIM_OPLABEL (op_MNEGD)
         if ((r = op_mnegfd (op0)) == 0)
             op1 = 0;
         WRITE_Q (r, op1);
         CC_IIZZ_FP (r);
         break;
 
-    case MNEGG:
+    case MNEGG: SIM_OPLABEL (op_MNEGG)
         if ((r = op_mnegg (op0)) == 0)
             op1 = 0;
         WRITE_Q (r, op1);
         CC_IIZZ_FP (r);
         break;
 
-    case CMPF:
+    case CMPF: SIM_OPLABEL (op_CMPF)
         cc = op_cmpfd (op0, 0, op1, 0);
         break;
 
-    case CMPD:
+    case CMPD: SIM_OPLABEL (op_CMPD)
         cc = op_cmpfd (op0, op1, op2, op3);
         break;
 
-    case CMPG:
+    case CMPG: SIM_OPLABEL (op_CMPG)
         cc = op_cmpg (op0, op1, op2, op3);
         break;
 
-    case CVTBF:
+    case CVTBF: SIM_OPLABEL (op_CVTBF)
         r = op_cvtifdg (SXTB (op0), NULL, opc);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTWF:
+    case CVTWF: SIM_OPLABEL (op_CVTWF)
         r = op_cvtifdg (SXTW (op0), NULL, opc);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTLF:
+    case CVTLF: SIM_OPLABEL (op_CVTLF)
         r = op_cvtifdg (op0, NULL, opc);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTBD: case CVTBG:
+    case CVTBD: case CVTBG: SIM_OPLABEL (op_CVTBD)
         r = op_cvtifdg (SXTB (op0), &rh, opc);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTWD: case CVTWG:
+    case CVTWD: case CVTWG: SIM_OPLABEL (op_CVTWD)
         r = op_cvtifdg (SXTW (op0), &rh, opc);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTLD: case CVTLG:
+    case CVTLD: case CVTLG: SIM_OPLABEL (op_CVTLD)
         r = op_cvtifdg (op0, &rh, opc);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTFB: case CVTDB: case CVTGB:
+    case CVTFB: case CVTDB: case CVTGB: SIM_OPLABEL (op_CVTFB)
         r = op_cvtfdgi (opnd, &flg, opc) & BMASK;
         WRITE_B (r);
         CC_IIZZ_B (r);
@@ -2868,7 +3137,7 @@ for ( ;; ) {
             }
         break;
 
-    case CVTFW: case CVTDW: case CVTGW:
+    case CVTFW: case CVTDW: case CVTGW: SIM_OPLABEL (op_CVTFW)
         r = op_cvtfdgi (opnd, &flg, opc) & WMASK;
         WRITE_W (r);
         CC_IIZZ_W (r);
@@ -2877,7 +3146,7 @@ for ( ;; ) {
             }
         break;
 
-    case CVTFL: case CVTDL: case CVTGL:
+    case CVTFL: case CVTDL: case CVTGL: SIM_OPLABEL (op_CVTFL)
     case CVTRFL: case CVTRDL: case CVTRGL:
         r = op_cvtfdgi (opnd, &flg, opc) & LMASK;
         WRITE_L (r);
@@ -2887,103 +3156,103 @@ for ( ;; ) {
             }
         break;
 
-    case CVTFD:
+    case CVTFD: SIM_OPLABEL (op_CVTFD)
         r = op_movfd (op0);
         WRITE_Q (r, 0);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTDF:
+    case CVTDF: SIM_OPLABEL (op_CVTDF)
         r = op_cvtdf (opnd);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTFG:
+    case CVTFG: SIM_OPLABEL (op_CVTFG)
         r = op_cvtfg (opnd, &rh);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case CVTGF:
+    case CVTGF: SIM_OPLABEL (op_CVTGF)
         r = op_cvtgf (opnd);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case ADDF2: case ADDF3:
+    case ADDF2: case ADDF3: SIM_OPLABEL (op_ADDF2)
         r = op_addf (opnd, FALSE);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case ADDD2: case ADDD3:
+    case ADDD2: case ADDD3: SIM_OPLABEL (op_ADDD2)
         r = op_addd (opnd, &rh, FALSE);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case ADDG2: case ADDG3:
+    case ADDG2: case ADDG3: SIM_OPLABEL (op_ADDG2)
         r = op_addg (opnd, &rh, FALSE);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case SUBF2: case SUBF3:
+    case SUBF2: case SUBF3: SIM_OPLABEL (op_SUBF2)
         r = op_addf (opnd, TRUE);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case SUBD2: case SUBD3:
+    case SUBD2: case SUBD3: SIM_OPLABEL (op_SUBD2)
         r = op_addd (opnd, &rh, TRUE);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case SUBG2: case SUBG3:
+    case SUBG2: case SUBG3: SIM_OPLABEL (op_SUBG2)
         r = op_addg (opnd, &rh, TRUE);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case MULF2: case MULF3:
+    case MULF2: case MULF3: SIM_OPLABEL (op_MULF2)
         r = op_mulf (opnd);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case MULD2: case MULD3:
+    case MULD2: case MULD3: SIM_OPLABEL (op_MULD2)
         r = op_muld (opnd, &rh);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case MULG2: case MULG3:
+    case MULG2: case MULG3: SIM_OPLABEL (op_MULG2)
         r = op_mulg (opnd, &rh);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case DIVF2: case DIVF3:
+    case DIVF2: case DIVF3: SIM_OPLABEL (op_DIVF2)
         r = op_divf (opnd);
         WRITE_L (r);
         CC_IIZZ_FP (r);
         break;
 
-    case DIVD2: case DIVD3:
+    case DIVD2: case DIVD3: SIM_OPLABEL (op_DIVD2)
         r = op_divd (opnd, &rh);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case DIVG2: case DIVG3:
+    case DIVG2: case DIVG3: SIM_OPLABEL (op_DIVG2)
         r = op_divg (opnd, &rh);
         WRITE_Q (r, rh);
         CC_IIZZ_FP (r);
         break;
 
-    case ACBF:
+    case ACBF: SIM_OPLABEL (op_ACBF)
         r = op_addf (opnd + 1, FALSE);                  /* add + index */
         temp = op_cmpfd (r, 0, op0, 0);                 /* result : limit */
         WRITE_L (r);                                    /* write result */
@@ -2993,7 +3262,7 @@ for ( ;; ) {
            BRANCHW (brdisp);
         break;
 
-    case ACBD:
+    case ACBD: SIM_OPLABEL (op_ACBD)
         r = op_addd (opnd + 2, &rh, FALSE);
         temp = op_cmpfd (r, rh, op0, op1);
         WRITE_Q (r, rh);
@@ -3003,7 +3272,7 @@ for ( ;; ) {
            BRANCHW (brdisp);
         break;
 
-    case ACBG:
+    case ACBG: SIM_OPLABEL (op_ACBG)
         r = op_addg (opnd + 2, &rh, FALSE);
         temp = op_cmpg (r, rh, op0, op1);
         WRITE_Q (r, rh);
@@ -3022,7 +3291,7 @@ for ( ;; ) {
         op5:op6 =       floating destination (flt.wl)
 */
 
-    case EMODF:
+    case EMODF: SIM_OPLABEL (op_EMODF)
         r = op_emodf (opnd, &temp, &flg);
         if (op5 < 0)
             Read (op6, L_LONG, WA);
@@ -3045,7 +3314,7 @@ for ( ;; ) {
         op7:op8 =       floating destination (flt.wq)
 */
 
-    case EMODD:
+    case EMODD: SIM_OPLABEL (op_EMODD)
         r = op_emodd (opnd, &rh, &temp, &flg);
         if (op7 < 0) {
             Read (op8, L_BYTE, WA);
@@ -3061,7 +3330,7 @@ for ( ;; ) {
             }
         break;
 
-    case EMODG:
+    case EMODG: SIM_OPLABEL (op_EMODG)
         r = op_emodg (opnd, &rh, &temp, &flg);
         if (op7 < 0) {
             Read (op8, L_BYTE, WA);
@@ -3079,55 +3348,55 @@ for ( ;; ) {
 
 /* POLY */
 
-    case POLYF:
+    case POLYF: SIM_OPLABEL (op_POLYF)
         op_polyf (opnd, acc);
         CC_IIZZ_FP (R[0]);
         break;
 
-    case POLYD:
+    case POLYD: SIM_OPLABEL (op_POLYD)
         op_polyd (opnd, acc);
         CC_IIZZ_FP (R[0]);
         break;
 
-    case POLYG:
+    case POLYG: SIM_OPLABEL (op_POLYG)
         op_polyg (opnd, acc);
         CC_IIZZ_FP (R[0]);
         break;
 
 /* Operating system instructions */
 
-    case CHMK: case CHME: case CHMS: case CHMU:
+    case CHMK: case CHME: case CHMS: case CHMU: SIM_OPLABEL (op_CHMK)
         cc = op_chm (opnd, cc, opc);                    /* CHMx */
         GET_CUR;                                        /* update cur mode */
         SET_IRQL;                                       /* update intreq */
         break;
 
-    case REI:
+    case REI: SIM_OPLABEL (op_REI)
         cc = op_rei (acc);                              /* REI */
         GET_CUR;                                        /* update cur mode */
         SET_IRQL;                                       /* update intreq */
         break;
 
-    case LDPCTX:
+    case LDPCTX: SIM_OPLABEL (op_LDPCTX)
         op_ldpctx (acc);
         break;
 
-    case SVPCTX:
+    case SVPCTX: SIM_OPLABEL (op_SVPCTX)
         op_svpctx (acc);
         break;
 
-    case PROBER: case PROBEW:
+    case PROBER: case PROBEW: SIM_OPLABEL (op_PROBER)
         cc = (cc & CC_C) | op_probe (opnd, opc & 1);
         break;
 
-    case MTPR:
+    case MTPR: SIM_OPLABEL (op_MTPR)
         mxpr_cc_vc = cc & CC_C;                         /* std: V=0, C unchgd */
         cc = op_mtpr (opnd);
         cc = cc | (mxpr_cc_vc & (CC_V|CC_C));           /* or in V,C */
         SET_IRQL;                                       /* update intreq */
         break;
 
-    case MFPR:
+    case MFPR: SIM_OPLABEL (op_MFPR)
         mxpr_cc_vc = cc & CC_C;                         /* std: V=0, C unchgd */
         r = op_mfpr (opnd);
         WRITE_L (r);
@@ -3137,7 +3406,7 @@ for ( ;; ) {
 
 /* CIS or emulated instructions */
 
-    case CVTPL:
+    case CVTPL: SIM_OPLABEL (op_CVTPL)
     case MOVP: case CMPP3: case CMPP4: case CVTLP:
     case CVTPS: case CVTSP: case CVTTP: case CVTPT:
     case ADDP4: case ADDP6: case SUBP4: case SUBP6:
@@ -3148,12 +3417,12 @@ for ( ;; ) {
 
 /* Octaword or reserved instructions */
 
-    case PUSHAO: case MOVAO: case CLRO: case MOVO:
+    case PUSHAO: case MOVAO: case CLRO: case MOVO: SIM_OPLABEL (op_PUSHAO)
 #if defined(VAX_610)
         cc = cpu_emulate_exception (opnd, cc, opc, acc);
         break;
 #endif
-    case TSTH: case MOVH: case MNEGH: case CMPH:
+    case TSTH: case MOVH: case MNEGH: case CMPH: SIM_OPLABEL (op_TSTH)
     case CVTBH: case CVTWH: case CVTLH:
     case CVTHB: case CVTHW: case CVTHL: case CVTRHL:
     case CVTFH: case CVTDH: case CVTGH:
@@ -3169,7 +3438,7 @@ for ( ;; ) {
             }
         break;
 
-    default:
+    default: SIM_OPLABEL (op_default)
         RSVD_INST_FAULT(opc);
         break;
         }                                               /* end case op */
@@ -3193,6 +3462,8 @@ for ( ;; ) {
    have enough bytes, enough prefetch words are fetched until there
    are.  A longword is only prefetched if data is needed from it,
    so any translation errors are real.
+
+   While a decode cache entry is active, dc_istr supplies the items.
 */
 
 static SIM_INLINE int32 get_istr (int32 lnt, int32 acc)
@@ -3200,6 +3471,8 @@ static SIM_INLINE int32 get_istr (int32 lnt, int32 acc)
 int32 bo = PC & 3;
 int32 sc, val, t;
 
+if (dc_cur)                                             /* decode cache? */
+    return dc_istr (lnt, acc);
 while ((bo + lnt) > ibcnt) {                            /* until enuf bytes */
     if ((ppc < 0) || (VA_GETOFF (ppc) == 0)) {          /* PPC inv, xpg? */
         ppc = Test ((PC + ibcnt) & ~03, RD, &t);        /* xlate PC */
@@ -3232,6 +3505,197 @@ if ((bo + lnt) >= 4) {                                  /* retire ibufl? */
 return val;
 }
 
+/* Decode cache routines
+
+   dc_istr is called by get_istr while a decode cache entry is active.
+   When replaying, the items come from the entry; if the decode flow
+   asks for something other than what was recorded, the replay is
+   abandoned and the prefetch buffer is restarted at the current PC.
+   When filling, the item is fetched through the prefetch buffer and
+   appended to the entry.
+*/
+
+int32 dc_istr (int32 lnt, int32 acc)
+{
+DCENT *dc = dc_cur;
+int32 val;
+
+if (!dc_fill) {                                         /* replaying? */
+    if ((dc_pos < dc->nitm) && (dc->lnt[dc_pos] == lnt)) {
+        PC = PC + lnt;
+        return dc->val[dc_pos++];
+        }
+    dc_cur = NULL;                                      /* out of step */
+    FLUSH_ISTR;
+    return get_istr (lnt, acc);
+    }
+dc_cur = NULL;                                          /* fetch normally */
+val = get_istr (lnt, acc);
+dc_cur = dc;
+if (dc_pos < DC_MAXITM) {
+    dc->lnt[dc_pos] = (uint8) lnt;
+    dc->val[dc_pos] = val;
+    }
+dc_pos = dc_pos + 1;
+return val;
+}
+
+/* Predecode the operands of a just filled entry
+
+   If every specifier of the instruction is a short literal, register,
+   immediate (read access) or branch displacement, the operand queue
+   can be rebuilt without running the specifier flows: each operand is
+   either a constant or a (masked) register.  Constants are taken from
+   the operand queue just built by the specifier flows, or from the
+   recorded istream items for immediates.  Returns TRUE if the entry
+   qualifies.
+*/
+
+t_bool dc_predecode (DCENT *dc, int32 opc, int32 *opnd)
+{
+int32 i, j, k, n, numspec, disp, spec, rn;
+int32 pos = (opc > 0xFF)? 2: 1;                         /* skip opcode items */
+int32 off = pos;                                        /* istream offset */
+
+numspec = drom[opc][0] & DR_NSPMASK;
+dc->nspec = 0;
+dc->vfl = dc->vaoff = -1;
+dc->brdisp = 0;
+for (i = 1, j = 0; i <= numspec; i++) {
+    disp = drom[opc][i];
+    if (pos >= dc->nitm)
+        return FALSE;
+    if (disp >= BB) {                                   /* branch disp */
+        dc->brdisp = dc->val[pos];
+        break;
+        }
+    spec = dc->val[pos++];
+    off = off + 1;
+    rn = spec & RGMASK;
+    dc->spec = (uint8) spec;
+    dc->rn = (uint8) rn;
+    dc->nspec++;
+    disp = (spec & ~RGMASK) | disp;
+    switch (disp) {
+
+    case SH0|RB: case SH0|RW: case SH0|RL: case SH0|RF:
+    case SH1|RB: case SH1|RW: case SH1|RL: case SH1|RF:
+    case SH2|RB: case SH2|RW: case SH2|RL: case SH2|RF:
+    case SH3|RB: case SH3|RW: case SH3|RL: case SH3|RF:
+        n = 1;
+        goto LITERAL;
+
+    case SH0|RQ: case SH1|RQ: case SH2|RQ: case SH3|RQ:
+    case SH0|RD: case SH1|RD: case SH2|RD: case SH3|RD:
+    case SH0|RG: case SH1|RG: case SH2|RG: case SH3|RG:
+        n = 2;
+        goto LITERAL;
+
+    case SH0|RO: case SH1|RO: case SH2|RO: case SH3|RO:
+    case SH0|RH: case SH1|RH: case SH2|RH: case SH3|RH:
+        n = 4;
+    LITERAL:
+        for (k = 0; k < n; k++, j++) {                  /* as just decoded */
+            dc->osrc[j] = DC_CONST;
+            dc->oval[j] = opnd[j];
+            }
+        break;
+
+    case GRN|RB: case GRN|MB:
+        dc->osrc[j] = (uint8) rn;
+        dc->oval[j++] = BMASK;
+        break;
+
+    case GRN|RW: case GRN|MW:
+        dc->osrc[j] = (uint8) rn;
+        dc->oval[j++] = WMASK;
+        break;
+
+    case GRN|VB:
+        if (((rn + 1) & RGMASK) == nPC)                 /* PC mid instruction */
+            return FALSE;
+        dc->vfl = (int8) ((rn + 1) & RGMASK);
+    case GRN|WB: case GRN|WW: case GRN|WL: case GRN|WQ: case GRN|WO:
+        dc->osrc[j] = DC_CONST;
+        dc->oval[j++] = rn;
+    case GRN|RL: case GRN|RF: case GRN|ML:
+        dc->osrc[j] = (uint8) rn;
+        dc->oval[j++] = LMASK;
+        break;
+
+    case GRN|RQ: case GRN|RD: case GRN|RG: case GRN|MQ:
+        n = 2;
+        goto REGISTERS;
+
+    case GRN|RO: case GRN|RH: case GRN|MO:
+        n = 4;
+    REGISTERS:
+        for (k = 0; k < n; k++, j++) {
+            dc->osrc[j] = (uint8) (rn + k);
+            dc->oval[j] = LMASK;
+            }
+        break;
+
+    case AIN|RB: case AIN|RW: case AIN|RL: case AIN|RF:
+    case AIN|RQ: case AIN|RD: case AIN|RG:
+    case AIN|RO: case AIN|RH:
+        if (rn != nPC)                                  /* immediate only */
+            return FALSE;
+        dc->vaoff = (int8) off;
+        n = (DR_LNT (disp) + 3) >> 2;                   /* # istream items */
+        for (k = 0; k < n; k++, j++) {
+            if (pos >= dc->nitm)
+                return FALSE;
+            off = off + dc->lnt[pos];
+            dc->osrc[j] = DC_CONST;
+            dc->oval[j] = dc->val[pos++];
+            }
+        break;
+
+    default:                                            /* memory reference */
+        return FALSE;
+        }
+    }
+dc->nopnd = (uint8) j;
+return TRUE;
+}
+
+void cpu_dc_flush (void)
+{
+uint32 i;
+
+if (dc_tab == NULL)
+    return;
+for (i = 0; i < DC_SIZE; i++)
+    dc_tab[i].pa = -1;
+}
+
+t_stat cpu_set_dcache (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+if (cptr != NULL)
+    return SCPE_ARG;
+if (val == 0) {                                         /* disable? */
+    dc_enb = FALSE;
+    free (dc_tab);
+    dc_tab = NULL;
+    return SCPE_OK;
+    }
+if (dc_tab == NULL) {
+    dc_tab = (DCENT *) calloc (DC_SIZE, sizeof (DCENT));
+    if (dc_tab == NULL)
+        return SCPE_MEM;
+    }
+cpu_dc_flush ();                                        /* writes weren't tracked */
+dc_enb = TRUE;
+return SCPE_OK;
+}
+
+t_stat cpu_show_dcache (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+fprintf (st, (dc_tab != NULL)? "DECODECACHE": "NODECODECACHE");
+return SCPE_OK;
+}
+
 /* Read octaword specifier */
 
 int32 ReadOcta (int32 va, int32 *opnd, int32 j, int32 acc)
@@ -3318,6 +3782,12 @@ static const char *vax_clock_precalibrate_commands[] = {
     "PC 100",
     NULL};
 
+/* Profiler contexts, indexed by PSL<cur_mode> */
+
+static const char *vax_prof_contexts[] = {
+    "kernel", "executive", "supervisor", "user",
+    NULL};
+
 /* Reset */
 
 t_stat cpu_reset (DEVICE *dptr)
@@ -3335,6 +3805,7 @@ if (M == NULL) {                        /* first time init? */
     sim_brk_types = sim_brk_dflt = SWMASK ('E');
     sim_vm_is_subroutine_call = cpu_is_pc_a_subroutine_call;
     sim_clock_precalibrate_commands = vax_clock_precalibrate_commands;
+    sim_vm_prof_contexts = vax_prof_contexts;
     sim_vm_initial_ips = SIM_INITIAL_IPS;
     pcq_r = find_reg ("PCQ", NULL, dptr);
     if (pcq_r == NULL)
@@ -3343,6 +3814,8 @@ if (M == NULL) {                        /* first time init? */
     M = (uint32 *) calloc (((uint32) MEMSIZE) >> 2, sizeof (uint32));
     if (M == NULL)
         return SCPE_MEM;
+    cpu_unit.mem_base = M;                              /* bytes for SAVE/RESTORE */
+    cpu_unit.mem_flags = MEM_PACKED_LE;
     auto_config(NULL, 0);               /* do an initial auto configure */
     }
 return build_dib_tab ();
@@ -3462,6 +3935,7 @@ for (i = 0; i < clim; i = i + 4)
     nM[i >> 2] = M[i >> 2];
 free (M);
 M = nM;
+uptr->mem_base = M;
 MEMSIZE = uval; 
 reset_all (0);
 return SCPE_OK;
@@ -3955,6 +4429,10 @@ cpu_model_help (st, dptr, uptr, flag, cptr);
 fprintf (st, "CPU options include the treatment of the HALT instruction.\n\n");
 fprintf (st, "   sim> SET CPU SIMHALT                 kernel HALT returns to simulator\n");
 fprintf (st, "   sim> SET CPU CONHALT                 kernel HALT returns to boot ROM console\n\n");
+fprintf (st, "Decoding of frequently executed instructions can be sped up by remembering\n");
+fprintf (st, "the instruction stream of each decoded instruction, keyed by physical PC:\n\n");
+fprintf (st, "   sim> SET CPU DECODECACHE             enable the predecoded instruction cache\n");
+fprintf (st, "   sim> SET CPU NODECODECACHE           disable the predecoded instruction cache\n\n");
 fprintf (st, "The CPU also implements a command to display a virtual to physical address\n");
 fprintf (st, "translation:\n\n");
 fprintf (st, "   sim> SHOW {-kesu} CPU VIRTUAL=n      show translation for address n\n");
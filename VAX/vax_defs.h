@@ -699,6 +699,11 @@ enum opcodes {
 #define CMODE_JUMP(d)   do {PCQ_ENTRY; PC = (d); CHECK_FOR_IDLE_LOOP; } while (0)
 #define SETPC(d)        PC = (d), FLUSH_ISTR
 #define FLUSH_ISTR      ibcnt = 0, ppc = -1
+#define DC_WRITE(pa)    do {                                                \
+                            if (dc_enb &&                                   \
+                                (dc_pgen[(pa) >> VA_N_OFF] & 1))            \
+                                dc_pgen[(pa) >> VA_N_OFF]++;                \
+                            } while (0)
 
 /* Character string instructions */
 
@@ -845,6 +850,7 @@ extern char const * const opcode[];
 extern const uint16 drom[NUM_INST][MAX_SPEC + 1];
 extern int32 cpu_emulate_exception (int32 *opnd, int32 cc, int32 opc, int32 acc);
 void cpu_idle (void);
+void cpu_dc_flush (void);
 
 /* Instruction History */
 #define HIST_MIN        64
@@ -886,6 +892,8 @@ extern int32 pcq[PCQ_SIZE];                             /* PC queue */
 extern int32 pcq_p;                                     /* PC queue ptr */
 extern int32 in_ie;                                     /* in exc, int */
 extern int32 ibcnt, ppc;                                /* prefetch ctl */
+extern t_bool dc_enb;                                   /* decode cache enabled */
+extern uint32 dc_pgen[];                                /* code page generations */
 extern int32 hlt_pin;                                   /* HLT pin intr */
 extern int32 mxpr_cc_vc;                                /* cc V & C bits from mtpr/mfpr operations */
 extern int32 mem_err;
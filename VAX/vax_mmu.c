@@ -230,6 +230,8 @@ for (i = 0; i < VA_TBSIZE; i++) {
     if (stb)
         stlb[i].tag = stlb[i].pte = -1;
     }
+if (stb)                                                /* whole TB? */
+    cpu_dc_flush ();                                    /* clear decode cache */
 }
 
 /* Zap single tb entry corresponding to va */
@@ -365,6 +365,7 @@ if (ADDR_IS_MEM (pa)) {
     int32 id = pa >> 2;
     int32 sc = (pa & 3) << 3;
     int32 mask = 0xFF << sc;
+    DC_WRITE (pa);
     M[id] = (M[id] & ~mask) | (val << sc);
     }
 else {
@@ -381,6 +382,7 @@ static SIM_INLINE void WriteW (uint32 pa, int32 val)
 {
 if (ADDR_IS_MEM (pa)) {
     int32 id = pa >> 2;
+    DC_WRITE (pa);
     M[id] = (pa & 2)? (M[id] & 0xFFFF) | (val << 16):
         (M[id] & ~0xFFFF) | val;
     }
@@ -396,8 +398,10 @@ return;
 
 static SIM_INLINE void WriteL (uint32 pa, int32 val)
 {
-if (ADDR_IS_MEM (pa))
+if (ADDR_IS_MEM (pa)) {
+    DC_WRITE (pa);
     M[pa >> 2] = val;
+    }
 else {
     mchk_ref = REF_V;
     if (ADDR_IS_IO (pa))
@@ -410,8 +414,10 @@ return;
 
 static SIM_INLINE void WriteLP (uint32 pa, int32 val)
 {
-if (ADDR_IS_MEM (pa))
+if (ADDR_IS_MEM (pa)) {
+    DC_WRITE (pa);
     M[pa >> 2] = val;
+    }
 else {
     mchk_va = pa;
     mchk_ref = REF_P;
@@ -438,6 +444,7 @@ static SIM_INLINE void WriteU (uint32 pa, int32 val, int32 lnt)
 if (ADDR_IS_MEM (pa)) {
     int32 bo = pa & 3;
     int32 sc = bo << 3;
+    DC_WRITE (pa);
     M[pa >> 2] = (M[pa >> 2] & ~(insert[lnt] << sc)) | ((val & insert[lnt]) << sc);
     }
 else {
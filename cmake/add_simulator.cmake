@@ -76,9 +76,11 @@ function(build_simcore _targ)
         endif (SIMH_ADDR64)
 
         if (SIMH_VIDEO)
+            # It's the video library. Without SDL, its windows can only be
+            # opened headless (SET VIDEO HEADLESS).
+            target_sources(${lib} PRIVATE ${SIM_VIDEO_SOURCES})
+            target_compile_definitions(${lib} PUBLIC USE_SIM_VIDEO)
             if (WITH_VIDEO)
-                # It's the video library
-                target_sources(${lib} PRIVATE ${SIM_VIDEO_SOURCES})
                 target_link_libraries(${lib} PUBLIC simh_video)
             endif ()
             if (CMAKE_HOST_APPLE AND NOT SIMH_BESM6_SDL_HACK)
@@ -227,10 +229,8 @@ function (simh_executable_template _targ)
         target_include_directories("${_targ}" PUBLIC "${_normalized_includes}")
     endif ()
 
-    if (WITH_VIDEO)
-        if (SIMH_FEATURE_DISPLAY)
-            target_compile_definitions(${_targ} PUBLIC USE_DISPLAY)
-        endif ()
+    if (SIMH_FEATURE_DISPLAY)
+        target_compile_definitions(${_targ} PUBLIC USE_DISPLAY)
     endif ()
 
     set(SIMH_SIMLIB simhcore)
@@ -79,6 +79,10 @@ endif (WITH_ASYNC)
 
 if (CMAKE_C_COMPILER_ID STREQUAL "GNU" OR CMAKE_C_COMPILER_ID MATCHES ".*Clang")
     target_compile_definitions(os_features INTERFACE _GNU_SOURCE)
+    if (WITH_THREADED_DISPATCH)
+        ## Labels-as-values instruction dispatch (VAX, PDP-11)
+        target_compile_definitions(os_features INTERFACE SIM_THREADED_DISPATCH)
+    endif ()
 endif ()
 
 ## <sys/ioctl.h>
@@ -46,19 +46,6 @@ _unit_test_header = [
     '##',
     '## ' + '-' * 60 + '\n'
     ]
-## Unset the display variables when not building with video. A +10
-## kludge.
-_unset_display_vars = '''
-if (NOT WITH_VIDEO)
-    ### Hack: Unset these variables so that they don't expand if
-    ### not building with video:
-    set(DISPLAY340 "")
-    set(DISPLAYIII "")
-    set(DISPLAYNG  "")
-    set(DISPLAYVT  "")
-endif ()
-'''
-
 class CMakeBuildSystem:
     """A container for collections of SIMH simulators and automagic
     CMakeLists.txt driver.
@@ -386,8 +373,6 @@ class CMakeBuildSystem:
         with open(simh_subdirs, "w") as stream2:
             stream2.write('\n'.join(_individual_header))
             self.write_vars(stream2)
-            stream2.write('\n## ' + '-' * 40 + '\n')
-            stream2.write(_unset_display_vars)
             stream2.write('\n## ' + '-' * 40 + '\n\n')
             stmts = [ 'add_subdirectory(' + dir + ')' for dir in dirnames ]
             stream2.write('\n'.join(stmts))
@@ -71,17 +71,6 @@ set(SCELBID    "${INTELSYSD}/scelbi")
 
 ## ----------------------------------------
 
-if (NOT WITH_VIDEO)
-    ### Hack: Unset these variables so that they don't expand if
-    ### not building with video:
-    set(DISPLAY340 "")
-    set(DISPLAYIII "")
-    set(DISPLAYNG  "")
-    set(DISPLAYVT  "")
-endif ()
-
-## ----------------------------------------
-
 add_subdirectory(3B2)
 add_subdirectory(ALTAIR)
 add_subdirectory(AltairZ80)
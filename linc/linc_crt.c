@@ -48,7 +48,8 @@ static DEBTAB crt_deb[] = {
   { NULL, 0 }
 };
 
-#ifdef USE_DISPLAY
+/* Without SDL the display only works after SET VIDEO HEADLESS */
+#if defined(USE_DISPLAY) && defined(HAVE_LIBSDL)
 #define CRT_DIS  0
 #else
 #define CRT_DIS  DEV_DIS
@@ -59,7 +60,7 @@ DEVICE crt_dev = {
   1, 8, 12, 1, 8, 12,
   NULL, NULL, &crt_reset,
   NULL, NULL, NULL,
-  NULL, DEV_DISABLE | DEV_DEBUG, 0, crt_deb,
+  NULL, DEV_DISABLE | DEV_DEBUG | CRT_DIS, 0, crt_deb,
   NULL, NULL, NULL, NULL, NULL, NULL
 };
 
@@ -90,8 +91,16 @@ crt_reset (DEVICE *dptr)
     display_close (dptr);
     sim_cancel (&crt_unit);
   } else {
+    t_stat r = vid_can_open ();
+    if (r != SCPE_OK) {
+      dptr->flags |= DEV_DIS;
+      return r;
+    }
     display_reset ();
-    display_init (DIS_LINC, 1, dptr);
+    if (!display_init (DIS_LINC, 1, dptr)) {
+      dptr->flags |= DEV_DIS;
+      return sim_messagef (SCPE_NOFNC, "Display initialization failed\n");
+    }
     vid_register_quit_callback (&crt_quit_callback);
     sim_activate_abs (&crt_unit, 0);
   }
@@ -282,6 +282,8 @@
 #define SRBSIZ          1024                            /* save/restore buffer */
 #define SIM_BRK_INILNT  4096                            /* bpt tbl length */
 #define SIM_BRK_ALLTYP  0xFFFFFFFB
+#define SIM_QUEUE_LIST  0                               /* event queue engines */
+#define SIM_QUEUE_HEAP  1
 #define UPDATE_SIM_TIME                                         \
     if (1) {                                                    \
         int32 _x;                                               \
@@ -473,6 +475,7 @@ t_bool (*sim_vm_fprint_stopped) (FILE *st, t_stat reason) = NULL;
 const char *sim_vm_release = NULL;
 const char *sim_vm_release_message = NULL;
 const char **sim_clock_precalibrate_commands = NULL;
+const char **sim_vm_prof_contexts = NULL;
 
 
 /* Prototypes */
@@ -503,6 +506,7 @@ t_stat show_break (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *c
 t_stat show_on (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
 t_stat show_do (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
 t_stat show_runlimit (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat show_profile (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
 t_stat sim_show_send (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
 t_stat sim_show_expect (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
 t_stat show_device (FILE *st, DEVICE *dptr, int32 flag);
@@ -584,16 +588,20 @@ void int_handler (int signal);
 t_stat set_prompt (int32 flag, CONST char *cptr);
 t_stat set_runlimit (int32 flag, CONST char *cptr);
 t_stat sim_set_asynch (int32 flag, CONST char *cptr);
+t_stat sim_set_queue (int32 flag, CONST char *cptr);
 static const char *_get_dbg_verb (uint32 dbits, DEVICE* dptr, UNIT *uptr);
 static t_stat sim_sanity_check_register_declarations (DEVICE **devices);
 static void fix_writelock_mtab (DEVICE *dptr);
 static t_stat _sim_debug_flush (void);
+static void _sim_debug_record (uint32 dbits, DEVICE* dptr, UNIT *uptr, const char* fmt, va_list arglist);
+static void _sim_debug_record_unterm (void);
 
 /* Global data */
 
 const char *sim_prog_name = NULL;                       /* pointer to the executable name */
 DEVICE *sim_dflt_dev = NULL;
 UNIT *sim_clock_queue = QUEUE_LIST_END;
+static uint32 sim_queue_engine = SIM_QUEUE_LIST;        /* event queue engine */
 int32 sim_interval = 0;
 const char *sim_vm_interval_units = "instructions";     /* Simulator can change to "cycles" as needed */
 const char *sim_vm_step_unit = "instruction";           /* Simulator can change */
@@ -612,6 +620,7 @@ int32 sim_opt_out = 0;
 volatile t_bool sim_is_running = FALSE;
 t_bool sim_processing_event = FALSE;
 uint32 sim_brk_summ = 0;
+uint32 sim_brk_page_summ[SIM_BRK_PAGE_SUMM];
 uint32 sim_brk_types = 0;
 BRKTYPTAB *sim_brk_type_desc = NULL;                /* type descriptions */
 uint32 sim_brk_dflt = 0;
@@ -638,6 +647,7 @@ size_t sim_sub_instr_size = 0;      /* substitution buffer size */
 size_t *sim_sub_instr_off = NULL;   /* offsets in substitution buffer where original data started */
 static double sim_time;
 static uint32 sim_rtime;
+static double sim_event_count = 0;                      /* events dispatched */
 static int32 noqueue_time;
 volatile t_bool stop_cpu = FALSE;
 volatile t_bool sigterm_received = FALSE;
@@ -777,6 +787,7 @@ const char *sim_savename = sim_name;      /* Simulator Name used in SAVE/RESTORE
 /* Tables and strings */
 
 const char save_vercur[] = "V4.0";
+const char save_ver41[] = "V4.1";                   /* SAVE -C or -I image */
 const char save_ver40[] = "V4.0";
 const char save_ver35[] = "V3.5";
 const char save_ver32[] = "V3.2";
@@ -1024,6 +1035,20 @@ static const char simh_help1[] =
       " to a file.  This includes the contents of main memory and all registers,\n"
       " and the I/O connections of devices:\n\n"
       "++SAVE <filename>\n\n"
+      "4Switches\n"
+      " Switches can influence the output and behavior of the SAVE command\n\n"
+      "++-C      Compresses the memory contents in the save file\n"
+      "++-I      Writes an incremental save file\n\n"
+      " An incremental save file only contains the memory blocks which changed\n"
+      " since the previous SAVE -I and refers to that file as its base.  RESTORE\n"
+      " loads the chain of base files first, so they must be kept until a later\n"
+      " save no longer depends on them.  The first SAVE -I, the first one after\n"
+      " a RESTORE, and one which would overwrite a file of its own base chain or\n"
+      " make the chain longer than 32 files, writes a complete memory image.\n"
+      " Each file records the identity and size of its base, and RESTORE\n"
+      " refuses a base file which has since been replaced.\n"
+      " Save files written with -C or -I can't be restored by simulators built\n"
+      " before these switches existed.\n\n"
 #define HLP_RESTORE     "*Commands Saving_and_Restoring_State RESTORE"
       "3RESTORE\n"
       " The RESTORE command (abbreviation REST, alternately GET) restores a\n"
@@ -1085,6 +1110,54 @@ static const char simh_help1[] =
       " The BOOT command (abbreviated BO) resets all devices and bootstraps the\n"
       " device and unit given by its argument.  If no unit is supplied, unit 0 is\n"
       " bootstrapped.  The specified unit must be attached.\n"
+#define HLP_BENCHMARK   "*Commands Running_A_Simulated_Program BENCHMARK"
+      "3BENCHMARK\n"
+      " The BENCHMARK command measures how fast the simulator executes the\n"
+      " program in memory.  Execution resumes at the current PC, as for STEP,\n"
+      " with throttling and idling suspended:\n\n"
+      "++BENCHMARK n {%C|MICROSECONDS|SECONDS|MINUTES|HOURS} {name}\n\n"
+      " If the units are not specified, the default units are %C.  When\n"
+      " execution completes, a single line of name=value pairs is displayed:\n\n"
+      "++name=alu sim=\"PDP-11\" instructions=50000000 seconds=0.812 cpu=0.810\n"
+      "+++ips=61576354 events=1010 eps=1244 calibrated_ips=59826210\n\n"
+      " giving the %Is executed, elapsed and host CPU seconds, the\n"
+      " %Is and simulator events per second and the rate last measured by\n"
+      " the clock calibration.  The same values are saved in the environment\n"
+      " variables SIM_BENCHMARK_NAME, SIM_BENCHMARK_INSTRUCTIONS,\n"
+      " SIM_BENCHMARK_SECONDS, SIM_BENCHMARK_CPU, SIM_BENCHMARK_IPS,\n"
+      " SIM_BENCHMARK_EVENTS and SIM_BENCHMARK_EPS so that command procedures\n"
+      " can compare them against expected values.  A stop before the limit\n"
+      " (HALT, breakpoint, etc.) is reported and ends the measurement early.\n\n"
+      " Sample workloads for several simulators are provided in their tests\n"
+      " directories as <sim>-benchmark.ini.\n"
+      "4Switches\n"
+      " The -Q switch suppresses the display; the environment variables are\n"
+      " still set.\n"
+#define HLP_PROFILE     "*Commands Running_A_Simulated_Program PROFILE"
+      "3PROFILE\n"
+      " The PROFILE command controls a low overhead sampling profiler for the\n"
+      " simulated program.  While profiling is on, the PC and the execution\n"
+      " context (processor mode) of one %I in every n (on average) are\n"
+      " counted in a histogram.  The sample interval is varied slightly around\n"
+      " n so that it does not fall into step with loops in the program.  n may\n"
+      " be at most 1073741823.\n\n"
+      "++PROFILE {ON} {n}       sample every n %Is (default 1000)\n"
+      "++PROFILE OFF            stop sampling, keeping the samples\n"
+      "++PROFILE CLEAR          discard the samples\n"
+      "++PROFILE SYMBOLS file   load a symbol table for reports\n"
+      "++PROFILE FOLDED file    write the samples in folded stack form\n\n"
+      " A symbol table file has one symbol per line: an address in the radix\n"
+      " of the CPU's addresses followed by a name.  Blank lines and lines\n"
+      " starting with ; or # are ignored.  Each sample is credited to the\n"
+      " symbol at or below its PC, which is usually the routine containing it.\n\n"
+      " The folded stack file has one line per context and routine, in the\n"
+      " form used by flame graph tools:\n\n"
+      "++kernel;EXE$QIOW 1520\n\n"
+      " SHOW PROFILE {n} displays the n (default 20) most frequently sampled\n"
+      " PCs; with the -R switch samples are summed by routine.\n\n"
+      " Profiling is only available in simulators whose CPU supports it: the\n"
+      " VAX and PDP-11 simulators and the pdp6, pdp10-ka, pdp10-ki, pdp10-kl\n"
+      " and pdp10-ks simulators.\n"
        /***************** 80 character line width template *************************/
       "2Stopping The Simulator\n"
       " Programs run until the simulator detects an error or stop condition, or\n"
@@ -1422,6 +1495,15 @@ static const char simh_help1[] =
       " The size of the circular memory buffer that is used is specified on\n"
       " the SET DEBUG command line, for example:\n\n"
       "++SET DEBUG -B <sizeinMB> <debug-destination>\n\n"
+      "5-Z\n"
+      " The -Z switch records debug messages in a binary form which defers\n"
+      " the formatting of each message's text.  This greatly reduces the cost\n"
+      " of producing large amounts of debug output.  The debug destination\n"
+      " must be a file.  The recorded file can later be displayed, with the\n"
+      " same output that text mode debugging would have produced, by:\n\n"
+      "++SHOW DEBUG DECODE <debug-file>\n\n"
+      " Decoding must be done by the same simulator program which recorded\n"
+      " the file.\n"
 #define HLP_SET_BREAK  "*Commands SET Breakpoints"
       "3Breakpoints\n"
       "+SET BREAK <list>            set breakpoints\n"
@@ -1470,6 +1552,33 @@ static const char simh_help1[] =
       "3Asynch\n"
       "+SET ASYNCH                  enable asynchronous I/O\n"
       "+SET NOASYNCH                disable asynchronous I/O\n"
+#define HLP_SET_QUEUE "*Commands SET Queue"
+      "3Queue\n"
+      "+SET QUEUE=LIST              use a sorted list for the event queue\n"
+      "+SET QUEUE=HEAP              use a binary heap for the event queue\n\n"
+      " The event queue engine determines how pending events are kept in time\n"
+      " order.  The LIST engine is fastest with a handful of pending events.  The\n"
+      " HEAP engine scales better when many devices have events pending at once.\n"
+      " Both engines dispatch events in exactly the same order, and the engine\n"
+      " may be changed at any time, including while events are pending.  The\n"
+      " SHOW QUEUE command displays pending events in time order with either\n"
+      " engine.\n"
+#define HLP_SET_VIDEO "*Commands SET Video"
+      "3Video\n"
+      "+SET VIDEO HEADLESS          allow video windows without a display\n"
+      "+SET VIDEO NOHEADLESS        disallow headless video windows\n"
+      "+SET VIDEO CAPTURE=file      write changed frames to numbered files\n"
+      "+SET VIDEO NOCAPTURE         stop writing frames\n\n"
+      " Simulators built without SDL video support have no display to show\n"
+      " video devices on.  After SET VIDEO HEADLESS, such devices may still be\n"
+      " used, with their displays kept in memory.  SHOW VIDEO then reports the\n"
+      " frames, draw calls and changed pixels of each video window, and the\n"
+      " SCREENSHOT command saves the current contents of the windows.\n\n"
+      " With SET VIDEO CAPTURE=file, each frame which changed is written to a\n"
+      " file named file-nnnnnn.ext, where nnnnnn is the frame number.  A .raw\n"
+      " file receives 24 bit RGB pixels without any header, a .bmp file a BMP\n"
+      " image, and any other name a PNG image (a BMP image when PNG support is\n"
+      " not available).\n"
 #define HLP_SET_ENVIRON "*Commands SET Environment"
       "3Environment\n"
       "4Explicitily Changing a Variable\n"
@@ -1588,6 +1697,7 @@ static const char simh_help2[] =
       "+sh{ow} re{mote}             show remote console configuration\n"
       "+sh{ow} <dev> RADIX          show device display radix\n"
       "+sh{ow} <dev> DEBUG          show device debug flags\n"
+      "+sh{ow} debug DECODE <file>  display a binary debug trace file\n"
       "+sh{ow} <dev> MODIFIERS      show device modifiers\n"
       "+sh{ow} <dev> NAMES          show device logical name\n"
       "+sh{ow} <dev> SHOW           show device SHOW commands\n"
@@ -1603,6 +1713,7 @@ static const char simh_help2[] =
       "+sh{ow} on                   show on condition actions\n"
       "+sh{ow} do                   show do nesting state\n"
       "+sh{ow} runlimit             show execution limit states\n"
+      "+sh{ow} profile {n}          show profiler samples\n"
       "+h{elp} <dev> show           displays the device specific show commands\n"
       "++++++++                     available\n"
 #define HLP_SHOW_CONFIG         "*Commands SHOW"
@@ -1631,6 +1742,7 @@ static const char simh_help2[] =
 #define HLP_SHOW_ON             "*Commands SHOW"
 #define HLP_SHOW_DO             "*Commands SHOW"
 #define HLP_SHOW_RUNLIMIT       "*Commands SHOW"
+#define HLP_SHOW_PROFILE        "*Commands Running_A_Simulated_Program PROFILE"
 #define HLP_SHOW_SEND           "*Commands SHOW"
 #define HLP_SHOW_EXPECT         "*Commands SHOW"
 #define HLP_HELP                "*Commands HELP"
@@ -2525,7 +2637,23 @@ static const char simh_help2[] =
 #define HLP_DISKINFO    "*Commands Disk_Container_Information"
       "2Disk Container Information\n"
       " Information about a Disk Container can be displayed with the DISKINFO command:\n\n"
-      "++DISKINFO container-spec    show information about a disk container\n\n";
+      "++DISKINFO container-spec    show information about a disk container\n\n"
+#define HLP_DISKSNAPSHOT "*Commands Disk_Container_Snapshot"
+      "2Disk Container Snapshot\n"
+      " The current contents of a disk attached as a SIMHX format container can be\n"
+      " saved in a new SIMHX container with the DISKSNAPSHOT command:\n\n"
+      "++DISKSNAPSHOT unit container    snapshot the disk attached to unit\n\n"
+      " The new container shares all of its data blocks with the attached disk, so\n"
+      " it takes very little space until one or the other is written.  It must be\n"
+      " in the same directory as the attached container and must not exist.\n\n"
+#define HLP_DISKRECLAIM "*Commands Disk_Container_Reclaim"
+      "2Disk Container Reclaim\n"
+      " Deleting a SIMHX container leaves its references to the blocks in its\n"
+      " store.  The blocks which no remaining container uses can be released for\n"
+      " reuse with the DISKRECLAIM command:\n\n"
+      "++DISKRECLAIM store    recount the references to the blocks of a store\n\n"
+      " Every SIMHX container in the store's directory is read, and deleted\n"
+      " containers are forgotten.  None of the store's disks may be attached.\n\n";
 
 
 static CTAB cmd_table[] = {
@@ -2599,9 +2727,13 @@ static CTAB cmd_table[] = {
     { "CURL",       &curl_cmd,      0,          HLP_CURL,       NULL, NULL },
     { "RUNLIMIT",   &runlimit_cmd,  1,          HLP_RUNLIMIT,   NULL, NULL },
     { "NORUNLIMIT", &runlimit_cmd,  0,          HLP_RUNLIMIT,   NULL, NULL },
+    { "BENCHMARK",  &benchmark_cmd, 0,          HLP_BENCHMARK,  NULL, NULL },
+    { "PROFILE",    &profile_cmd,   0,          HLP_PROFILE,    NULL, NULL },
     { "TESTLIB",    &test_lib_cmd,  0,          HLP_TESTLIB,    NULL, NULL },
     { "DISKINFO",   &sim_disk_info_cmd,  0,     HLP_DISKINFO,   NULL, NULL },
     { "ZAPTYPE",    &sim_disk_info_cmd,  1,     NULL,           NULL, NULL },
+    { "DISKSNAPSHOT", &sim_disk_snapshot_cmd, 0, HLP_DISKSNAPSHOT, NULL, NULL },
+    { "DISKRECLAIM", &sim_disk_reclaim_cmd, 0, HLP_DISKRECLAIM, NULL, NULL },
     { NULL,         NULL,           0,          NULL,           NULL, NULL }
     };
 
@@ -2637,6 +2769,8 @@ static CTAB set_glob_tab[] = {
     { "RUNLIMIT",   &set_runlimit,              1, HLP_RUNLIMIT },
     { "NORUNLIMIT", &set_runlimit,              0, HLP_RUNLIMIT },
     { "NOAUTOSIZE", &sim_disk_set_noautosize,   1, HLP_NOAUTOSIZE },
+    { "QUEUE",      &sim_set_queue,             0, HLP_SET_QUEUE },
+    { "VIDEO",      &vid_set,                   0, HLP_SET_VIDEO },
     { NULL,         NULL,                       0 }
     };
 
@@ -2695,6 +2829,7 @@ static SHTAB show_glob_tab[] = {
     { "ON",             &show_on,                  -1, HLP_SHOW_ON },
     { "DO",             &show_do,                   0, HLP_SHOW_DO },
     { "RUNLIMIT",       &show_runlimit,             0, HLP_SHOW_RUNLIMIT },
+    { "PROFILE",        &show_profile,              0, HLP_SHOW_PROFILE },
     { NULL,             NULL,                       0 }
     };
 
@@ -5933,6 +6068,24 @@ for (i = 0; i < sim_external_env_count; i++) {
 return SCPE_OK;
 }
 
+/* Find a global SET command given as name=value (full name only) */
+
+static CTAB *find_set_glob_value (const char *gbuf)
+{
+char name[CBUFSIZE];
+const char *eqptr = strchr (gbuf, '=');
+CTAB *gcmdp;
+
+if (eqptr == NULL)
+    return NULL;
+memcpy (name, gbuf, eqptr - gbuf);
+name[eqptr - gbuf] = '\0';
+gcmdp = find_ctab (set_glob_tab, name);
+if ((gcmdp == NULL) || (strcmp (name, gcmdp->name) != 0))
+    return NULL;
+return gcmdp;
+}
+
 /* Set command */
 
 t_stat set_cmd (int32 flag, CONST char *cptr)
@@ -5971,10 +6124,14 @@ else {
             GET_SWITCHES (cptr);                        /* get more switches */
             return gcmdp->action (gcmdp->arg, cptr);    /* do the rest */
             }
+        else if ((gcmdp = find_set_glob_value (gbuf))) {/* global=value? */
+            cvptr = strchr (svptr, '=');
+            return gcmdp->action (gcmdp->arg, cvptr + 1);/* do the rest */
+            }
         else {
             if (sim_dflt_dev->modifiers) {
                 if ((cvptr = strchr (gbuf, '=')))       /* = value? */
-                    *cvptr++ = 0;
+                    *cvptr = 0;
                 for (mptr = sim_dflt_dev->modifiers; mptr->mask != 0; mptr++) {
                     if (mptr->mstring && (MATCH_CMD (gbuf, mptr->mstring) == 0)) {
                         dptr = sim_dflt_dev;
@@ -5984,6 +6141,8 @@ else {
                         break;
                         }
                     }
+                if (cvptr)                              /* restore full name */
+                    *cvptr = '=';
                 }
             if (!dptr)
                 return sim_messagef (SCPE_NXDEV, "Non-existent device: %s\n", gbuf);/* no match */
@@ -7022,10 +7181,14 @@ if (sim_clock_queue == QUEUE_LIST_END)
 else {
     const char *tim = "";
     double inst_per_sec = sim_timer_inst_per_sec ();
+    UNIT **units;
+    int32 i, cnt;
 
     fprintf (st, "%s event queue status, time = %.0f, executing %s %s/sec\n",
              sim_name, sim_time, sim_fmt_numeric (inst_per_sec), sim_vm_interval_units);
-    for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next) {
+    units = sim_clock_queue_snapshot (&cnt);
+    for (i = 0; i < cnt; i++) {
+        uptr = units[i];
         if (uptr == &sim_step_unit)
             fprintf (st, "  Step timer");
         else
@@ -7050,7 +7213,10 @@ else {
                                             (*tim) ? " (" : "", tim, (*tim) ? ")" : "",
                                             (uptr->flags & UNIT_IDLE) ? " (Idle capable)" : "");
         }
+    free (units);
     }
+if (sim_queue_engine != SIM_QUEUE_LIST)
+    fprintf (st, "%s event queue engine\n", sim_queue_engine_name ());
 sim_show_clock_queues (st, dnotused, unotused, flag, cptr);
 #if defined (SIM_ASYNCH_IO)
 pthread_mutex_lock (&sim_asynch_lock);
@@ -7971,6 +8137,493 @@ else
 return SCPE_OK;
 }
 
+/* Benchmark command
+
+   Runs the simulator from the current PC for a number of instructions
+   (or microseconds, via STEP -T) with throttling and idling suspended
+   and reports the instruction and event rates and the host CPU time.
+*/
+
+t_stat benchmark_cmd (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE], name[CBUFSIZE];
+char step[32], val[32];
+CONST char *tptr;
+int32 num;
+int32 i;
+t_stat r;
+double usec_factor = 0.0;
+const char *units = sim_vm_interval_units;
+double insts, events, secs, cpu;
+double start_inst, start_events, start_secs;
+clock_t start_cpu;
+t_bool saved_idle;
+static struct {
+    const char *name;
+    double usec_factor;
+    } time_units[] = {
+        {"MICROSECONDS",             1.0},
+        {"USECONDS",                 1.0},
+        {"SECONDS",            1000000.0},
+        {"MINUTES",         60*1000000.0},
+        {"HOURS",        60*60*1000000.0},
+        {NULL,                       0.0}};
+
+GET_SWITCHES (cptr);                                    /* get switches */
+cptr = get_glyph (cptr, gbuf, 0);                       /* get count */
+num = (int32) get_uint (gbuf, 10, INT_MAX, &r);
+if ((r != SCPE_OK) || (num == 0))
+    return sim_messagef (SCPE_ARG, "Invalid argument: %s\n", gbuf);
+tptr = get_glyph (cptr, gbuf, 0);                       /* units? */
+if ((gbuf[0] != '\0') && (MATCH_CMD (gbuf, sim_vm_interval_units) == 0))
+    cptr = tptr;
+else {
+    for (i = 0; time_units[i].name; i++) {
+        if ((gbuf[0] != '\0') && (MATCH_CMD (gbuf, time_units[i].name) == 0)) {
+            usec_factor = time_units[i].usec_factor;
+            units = time_units[i].name;
+            cptr = tptr;
+            break;
+            }
+        }
+    }
+cptr = get_glyph_nc (cptr, name, 0);                    /* optional name */
+if (*cptr)
+    return sim_messagef (SCPE_2MARG, "Too many arguments: %s\n", cptr);
+if (name[0] == '\0')
+    strlcpy (name, "benchmark", sizeof (name));
+if ((usec_factor != 0.0) && ((num * usec_factor) > INT_MAX))
+    return sim_messagef (SCPE_ARG, "Benchmark duration too long: %d %s\n", num, units);
+snprintf (step, sizeof (step), "%.0f", (usec_factor != 0.0) ? num * usec_factor : (double)num);
+sim_switches &= ~SWMASK ('T');
+if (usec_factor != 0.0)
+    sim_switches |= SWMASK ('T');                       /* STEP in usecs */
+saved_idle = sim_idle_enab;
+sim_idle_enab = FALSE;                                  /* no idling */
+sim_throt_suspend (TRUE);                               /* no throttling */
+start_inst = sim_gtime ();
+start_events = sim_event_count;
+start_secs = sim_timenow_double ();
+start_cpu = clock ();
+r = run_cmd (RU_STEP, step);
+cpu = ((double)(clock () - start_cpu)) / CLOCKS_PER_SEC;
+secs = sim_timenow_double () - start_secs;
+events = sim_event_count - start_events;
+insts = sim_gtime () - start_inst;
+sim_throt_suspend (FALSE);
+sim_idle_enab = saved_idle;
+if (secs <= 0.0)
+    secs = 1e-6;
+if ((SCPE_BARE_STATUS (r) != SCPE_STEP) &&              /* stopped early? */
+    (!(sim_switches & SWMASK ('Q'))))
+    run_cmd_message (NULL, SCPE_BARE_STATUS (r));
+setenv ("SIM_BENCHMARK_NAME", name, 1);
+snprintf (val, sizeof (val), "%.0f", insts);
+setenv ("SIM_BENCHMARK_INSTRUCTIONS", val, 1);
+snprintf (val, sizeof (val), "%.3f", secs);
+setenv ("SIM_BENCHMARK_SECONDS", val, 1);
+snprintf (val, sizeof (val), "%.3f", cpu);
+setenv ("SIM_BENCHMARK_CPU", val, 1);
+snprintf (val, sizeof (val), "%.0f", insts / secs);
+setenv ("SIM_BENCHMARK_IPS", val, 1);
+snprintf (val, sizeof (val), "%.0f", events);
+setenv ("SIM_BENCHMARK_EVENTS", val, 1);
+snprintf (val, sizeof (val), "%.0f", events / secs);
+setenv ("SIM_BENCHMARK_EPS", val, 1);
+if (!(sim_switches & SWMASK ('Q')))
+    sim_printf ("name=%s sim=\"%s\" instructions=%.0f seconds=%.3f cpu=%.3f ips=%.0f events=%.0f eps=%.0f calibrated_ips=%.0f\n",
+                name, sim_name, insts, secs, cpu, insts / secs,
+                events, events / secs, sim_timer_inst_per_sec ());
+if (SCPE_BARE_STATUS (r) == SCPE_STEP)
+    return SCPE_OK;
+return r | SCPE_NOMESSAGE;
+}
+
+/* Sampling profiler
+
+   A simulator that supports profiling sets sim_vm_prof_contexts to a
+   NULL terminated list of its execution context names and invokes
+   SIM_PROF_SAMPLE once per instruction.  The macro counts sim_prof_count
+   down; when it reaches zero, sim_prof_sample records the PC and context
+   in an open addressed hash table and starts the next interval.  While
+   profiling is off, sim_prof_count is zero and the cost is one test.
+*/
+
+typedef struct {
+    t_addr      pc;                                     /* PC */
+    uint32      ctx;                                    /* context */
+    uint32      count;                                  /* samples */
+    } PROF_ENT;
+
+typedef struct {
+    t_addr      addr;                                   /* address */
+    char        *name;                                  /* name */
+    } PROF_SYM;
+
+typedef struct {
+    uint32      ctx;                                    /* context */
+    int32       sym;                                    /* symbol or -1 */
+    t_addr      pc;                                     /* PC */
+    double      count;                                  /* samples */
+    } PROF_REP;
+
+int32 sim_prof_count = 0;                               /* insts to next sample */
+#define PROF_MAX_INTERVAL (INT_MAX / 2)                 /* jittered count fits int32 */
+
+static int32 sim_prof_interval = 0;                     /* mean interval, 0 = off */
+static uint32 sim_prof_seed = 1;                        /* interval jitter */
+static PROF_ENT *sim_prof_tab = NULL;                   /* histogram */
+static uint32 sim_prof_size = 0;                        /* entries (power of 2) */
+static uint32 sim_prof_used = 0;                        /* entries in use */
+static double sim_prof_samples = 0;                     /* total samples */
+static PROF_SYM *sim_prof_syms = NULL;                  /* symbols, by address */
+static uint32 sim_prof_nsyms = 0;
+
+#define PROF_HASH(pc,ctx)   ((uint32)((((t_uint64)(pc)) * 0x9E3779B1u) >> 4) ^ ((ctx) * 0x85EBCA6Bu))
+
+static PROF_ENT *_sim_prof_find (PROF_ENT *tab, uint32 size, t_addr pc, uint32 ctx)
+{
+uint32 i = PROF_HASH (pc, ctx) & (size - 1);
+
+while ((tab[i].count != 0) &&
+       ((tab[i].pc != pc) || (tab[i].ctx != ctx)))
+    i = (i + 1) & (size - 1);
+return &tab[i];
+}
+
+static t_bool _sim_prof_grow (void)
+{
+uint32 i, size = sim_prof_size ? (sim_prof_size << 1) : 1024;
+PROF_ENT *tab = (PROF_ENT *) calloc (size, sizeof (*tab));
+
+if (tab == NULL)
+    return FALSE;
+for (i = 0; i < sim_prof_size; i++)
+    if (sim_prof_tab[i].count != 0)
+        *_sim_prof_find (tab, size, sim_prof_tab[i].pc, sim_prof_tab[i].ctx) = sim_prof_tab[i];
+free (sim_prof_tab);
+sim_prof_tab = tab;
+sim_prof_size = size;
+return TRUE;
+}
+
+void sim_prof_sample (t_addr pc, uint32 ctx)
+{
+PROF_ENT *p;
+
+sim_prof_seed = sim_prof_seed * 1103515245 + 12345;     /* next interval */
+sim_prof_count = (sim_prof_interval >> 1) + 1 +
+                 (int32)((sim_prof_seed >> 8) % (uint32) sim_prof_interval);
+if (((sim_prof_used + 1) * 4 > sim_prof_size * 3) &&    /* 3/4 full? */
+    (!_sim_prof_grow ()))
+    return;                                             /* drop sample */
+p = _sim_prof_find (sim_prof_tab, sim_prof_size, pc, ctx);
+if (p->count == 0) {                                    /* new PC? */
+    p->pc = pc;
+    p->ctx = ctx;
+    sim_prof_used = sim_prof_used + 1;
+    }
+p->count = p->count + 1;
+sim_prof_samples = sim_prof_samples + 1;
+}
+
+static void _sim_prof_clear (void)
+{
+free (sim_prof_tab);
+sim_prof_tab = NULL;
+sim_prof_size = sim_prof_used = 0;
+sim_prof_samples = 0;
+}
+
+static void _sim_prof_free_syms (void)
+{
+uint32 i;
+
+for (i = 0; i < sim_prof_nsyms; i++)
+    free (sim_prof_syms[i].name);
+free (sim_prof_syms);
+sim_prof_syms = NULL;
+sim_prof_nsyms = 0;
+}
+
+static int _sim_prof_sym_compare (const void *pa, const void *pb)
+{
+const PROF_SYM *a = (const PROF_SYM *) pa;
+const PROF_SYM *b = (const PROF_SYM *) pb;
+
+if (a->addr != b->addr)
+    return (a->addr < b->addr) ? -1 : 1;
+return strcmp (a->name, b->name);
+}
+
+/* Index of the symbol at or below pc, or -1 */
+
+static int32 _sim_prof_sym_lookup (t_addr pc)
+{
+int32 lo = 0, hi = (int32) sim_prof_nsyms - 1, found = -1;
+
+while (lo <= hi) {
+    int32 mid = (lo + hi) / 2;
+
+    if (sim_prof_syms[mid].addr <= pc) {
+        found = mid;
+        lo = mid + 1;
+        }
+    else
+        hi = mid - 1;
+    }
+return found;
+}
+
+static t_stat _sim_prof_load_syms (const char *filename)
+{
+FILE *f;
+char line[CBUFSIZE], gbuf[CBUFSIZE], name[CBUFSIZE];
+CONST char *cptr, *tptr;
+uint32 lnum = 0, max = 0;
+t_addr addr;
+
+f = sim_fopen (filename, "r");
+if (f == NULL)
+    return sim_messagef (SCPE_OPENERR, "Can't open symbol file %s: %s\n", filename, strerror (errno));
+_sim_prof_free_syms ();
+while (fgets (line, sizeof (line), f)) {
+    lnum = lnum + 1;
+    cptr = get_glyph_nc (line, gbuf, 0);                /* address */
+    if ((gbuf[0] == '\0') || (gbuf[0] == ';') || (gbuf[0] == '#'))
+        continue;
+    addr = (t_addr) strtotv (gbuf, &tptr, sim_dflt_dev->aradix);
+    get_glyph_nc (cptr, name, 0);                       /* name */
+    if ((*tptr != '\0') || (name[0] == '\0')) {
+        fclose (f);
+        _sim_prof_free_syms ();
+        return sim_messagef (SCPE_ARG, "%s line %u: invalid symbol: %s", filename, lnum, line);
+        }
+    if (sim_prof_nsyms == max) {
+        PROF_SYM *syms;
+
+        max = max ? max * 2 : 256;
+        syms = (PROF_SYM *) realloc (sim_prof_syms, max * sizeof (*syms));
+        if (syms == NULL) {
+            fclose (f);
+            _sim_prof_free_syms ();
+            return SCPE_MEM;
+            }
+        sim_prof_syms = syms;
+        }
+    sim_prof_syms[sim_prof_nsyms].addr = addr;
+    sim_prof_syms[sim_prof_nsyms].name = strdup (name);
+    sim_prof_nsyms = sim_prof_nsyms + 1;
+    }
+fclose (f);
+qsort (sim_prof_syms, sim_prof_nsyms, sizeof (*sim_prof_syms), _sim_prof_sym_compare);
+return sim_messagef (SCPE_OK, "%u symbols loaded from %s\n", sim_prof_nsyms, filename);
+}
+
+static int _sim_prof_rep_key_compare (const void *pa, const void *pb)
+{
+const PROF_REP *a = (const PROF_REP *) pa;
+const PROF_REP *b = (const PROF_REP *) pb;
+
+if (a->ctx != b->ctx)
+    return (a->ctx < b->ctx) ? -1 : 1;
+if (a->sym != b->sym)
+    return (a->sym < b->sym) ? -1 : 1;
+if ((a->sym < 0) && (a->pc != b->pc))
+    return (a->pc < b->pc) ? -1 : 1;
+return 0;
+}
+
+static int _sim_prof_rep_count_compare (const void *pa, const void *pb)
+{
+const PROF_REP *a = (const PROF_REP *) pa;
+const PROF_REP *b = (const PROF_REP *) pb;
+
+if (a->count != b->count)
+    return (a->count > b->count) ? -1 : 1;
+return _sim_prof_rep_key_compare (pa, pb);
+}
+
+/* Build the report rows, one per PC or, if by_sym, one per routine,
+   sorted by decreasing sample count */
+
+static PROF_REP *_sim_prof_report (t_bool by_sym, uint32 *rows)
+{
+PROF_REP *rep;
+uint32 i, n = 0;
+
+*rows = 0;
+rep = (PROF_REP *) calloc (sim_prof_used + 1, sizeof (*rep));
+if (rep == NULL)
+    return NULL;
+for (i = 0; i < sim_prof_size; i++) {
+    if (sim_prof_tab[i].count == 0)
+        continue;
+    rep[n].ctx = sim_prof_tab[i].ctx;
+    rep[n].pc = sim_prof_tab[i].pc;
+    rep[n].sym = _sim_prof_sym_lookup (rep[n].pc);
+    rep[n].count = sim_prof_tab[i].count;
+    n = n + 1;
+    }
+if (by_sym && (n > 0)) {                                /* merge by routine */
+    uint32 j = 0;
+
+    qsort (rep, n, sizeof (*rep), _sim_prof_rep_key_compare);
+    for (i = 1; i < n; i++) {
+        if (_sim_prof_rep_key_compare (&rep[j], &rep[i]) == 0)
+            rep[j].count = rep[j].count + rep[i].count;
+        else
+            rep[++j] = rep[i];
+        }
+    n = j + 1;
+    }
+qsort (rep, n, sizeof (*rep), _sim_prof_rep_count_compare);
+*rows = n;
+return rep;
+}
+
+static const char *_sim_prof_context (uint32 ctx, char *buf, size_t size)
+{
+uint32 i;
+
+for (i = 0; sim_vm_prof_contexts && sim_vm_prof_contexts[i]; i++)
+    if (i == ctx)
+        return sim_vm_prof_contexts[i];
+snprintf (buf, size, "%u", ctx);
+return buf;
+}
+
+static const char *_sim_prof_location (const PROF_REP *r, t_bool by_sym, char *buf, size_t size)
+{
+char pcbuf[64];
+const PROF_SYM *s;
+
+if (r->sym < 0) {
+    sprint_val (pcbuf, r->pc, sim_dflt_dev->aradix, sim_dflt_dev->awidth, PV_LEFT);
+    snprintf (buf, size, "%s", pcbuf);
+    return buf;
+    }
+s = &sim_prof_syms[r->sym];
+if (by_sym || (r->pc == s->addr))
+    return s->name;
+sprint_val (pcbuf, r->pc - s->addr, sim_dflt_dev->aradix, sim_dflt_dev->awidth, PV_LEFT);
+snprintf (buf, size, "%s+%s", s->name, pcbuf);
+return buf;
+}
+
+static t_stat _sim_prof_write_folded (const char *filename)
+{
+FILE *f;
+PROF_REP *rep;
+uint32 i, rows;
+char cbuf[16], lbuf[CBUFSIZE];
+
+rep = _sim_prof_report (TRUE, &rows);
+if (rep == NULL)
+    return SCPE_MEM;
+f = sim_fopen (filename, "w");
+if (f == NULL) {
+    free (rep);
+    return sim_messagef (SCPE_OPENERR, "Can't open %s: %s\n", filename, strerror (errno));
+    }
+for (i = 0; i < rows; i++)
+    fprintf (f, "%s;%s %.0f\n", _sim_prof_context (rep[i].ctx, cbuf, sizeof (cbuf)),
+                               _sim_prof_location (&rep[i], TRUE, lbuf, sizeof (lbuf)),
+                               rep[i].count);
+fclose (f);
+free (rep);
+return sim_messagef (SCPE_OK, "%u stacks written to %s\n", rows, filename);
+}
+
+t_stat profile_cmd (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+int32 num;
+t_stat r;
+
+GET_SWITCHES (cptr);                                    /* get switches */
+cptr = get_glyph (cptr, gbuf, 0);
+if ((gbuf[0] == '\0') || (MATCH_CMD (gbuf, "ON") == 0) ||
+    isdigit ((unsigned char) gbuf[0])) {
+    if (sim_vm_prof_contexts == NULL)
+        return sim_messagef (SCPE_NOFNC, "Profiling is not supported by the %s simulator\n", sim_name);
+    if (MATCH_CMD (gbuf, "ON") == 0)                    /* skip ON */
+        cptr = get_glyph (cptr, gbuf, 0);
+    if (*cptr)
+        return sim_messagef (SCPE_2MARG, "Too many arguments: %s\n", cptr);
+    num = 1000;
+    if (gbuf[0]) {
+        num = (int32) get_uint (gbuf, 10, PROF_MAX_INTERVAL, &r);
+        if ((r != SCPE_OK) || (num == 0))
+            return sim_messagef (SCPE_ARG, "Invalid sample interval: %s (1-%d)\n", gbuf, PROF_MAX_INTERVAL);
+        }
+    sim_prof_interval = num;
+    sim_prof_count = num;
+    return SCPE_OK;
+    }
+if (MATCH_CMD (gbuf, "OFF") == 0) {
+    if (*cptr)
+        return sim_messagef (SCPE_2MARG, "Too many arguments: %s\n", cptr);
+    sim_prof_interval = sim_prof_count = 0;
+    return SCPE_OK;
+    }
+if (MATCH_CMD (gbuf, "CLEAR") == 0) {
+    if (*cptr)
+        return sim_messagef (SCPE_2MARG, "Too many arguments: %s\n", cptr);
+    _sim_prof_clear ();
+    return SCPE_OK;
+    }
+if (MATCH_CMD (gbuf, "SYMBOLS") == 0) {
+    if (*cptr == '\0')
+        return SCPE_2FARG;
+    get_glyph_nc (cptr, gbuf, 0);
+    return _sim_prof_load_syms (gbuf);
+    }
+if (MATCH_CMD (gbuf, "FOLDED") == 0) {
+    if (*cptr == '\0')
+        return SCPE_2FARG;
+    get_glyph_nc (cptr, gbuf, 0);
+    return _sim_prof_write_folded (gbuf);
+    }
+return sim_messagef (SCPE_ARG, "Unknown PROFILE option: %s\n", gbuf);
+}
+
+t_stat show_profile (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+PROF_REP *rep;
+uint32 i, rows, lim = 20;
+t_bool by_sym = (sim_switches & SWMASK ('R')) != 0;
+char cbuf[16], lbuf[CBUFSIZE];
+t_stat r;
+
+if (cptr && *cptr) {
+    lim = (uint32) get_uint (cptr, 10, 0xFFFFFFFF, &r);
+    if (r != SCPE_OK)
+        return sim_messagef (SCPE_ARG, "Invalid count: %s\n", cptr);
+    }
+if (sim_prof_interval)
+    fprintf (st, "Profiling every %d %s, ", sim_prof_interval, sim_vm_interval_units);
+else
+    fprintf (st, "Profiling off, ");
+fprintf (st, "%.0f samples at %u PCs", sim_prof_samples, sim_prof_used);
+if (sim_prof_nsyms)
+    fprintf (st, ", %u symbols", sim_prof_nsyms);
+fprintf (st, "\n");
+if (sim_prof_samples == 0)
+    return SCPE_OK;
+rep = _sim_prof_report (by_sym, &rows);
+if (rep == NULL)
+    return SCPE_MEM;
+fprintf (st, "\n  Samples       %%  Context     %s\n", by_sym ? "Routine" : "PC");
+for (i = 0; (i < rows) && (i < lim); i++)
+    fprintf (st, "%9.0f  %5.1f%%  %-10s  %s\n", rep[i].count,
+                 (100.0 * rep[i].count) / sim_prof_samples,
+                 _sim_prof_context (rep[i].ctx, cbuf, sizeof (cbuf)),
+                 _sim_prof_location (&rep[i], by_sym, lbuf, sizeof (lbuf)));
+free (rep);
+return SCPE_OK;
+}
+
 /* Reset devices start..end
 
    Inputs:
@@ -8568,6 +9221,278 @@ return uptr->uname = strcpy ((char *)malloc (1 + strlen (uname)), uname);
 }
 
 
+/* Memory array of a memory-like unit, if it can be accessed directly
+
+   The array is only usable if its elements have the size saved for the
+   device and, when they are packed into wider words, the host stores
+   them in the same order. */
+
+static uint8 *sim_unit_mem (DEVICE *dptr, UNIT *uptr)
+{
+if ((uptr->mem_base == NULL) ||
+    ((uptr->mem_flags & MEM_PACKED_LE) && !sim_end) ||
+    (dptr->aincr == 0))
+    return NULL;
+return (uint8 *)uptr->mem_base;
+}
+
+/* Block compression for SAVE -C and SIMHX disk containers
+
+   A small LZF style coder: a control byte below 32 is followed by that
+   many plus one literal bytes; otherwise its top 3 bits hold a match
+   length - 2 (7 means an extension byte follows) and its low 5 bits plus
+   the next byte hold the match offset - 1.  Offsets reach back 8KB,
+   which covers a full SRBSIZ block of the widest element size.
+
+   sim_digest is a 64 bit content digest used to recognize unchanged
+   (SAVE -I) or duplicate (SIMHX) blocks.  It is not cryptographic;
+   callers compare contents before relying on a match.
+
+   sim_lz_compress returns 0 if the data doesn't fit in olen bytes.
+   sim_lz_expand returns the expanded length, or 0 if the input is
+   malformed or doesn't fit in olen bytes. */
+
+#define SAVE_LZ_HBITS   12                              /* match hash table bits */
+#define SAVE_LZ_MAXOFF  8192                            /* max match offset */
+#define SAVE_LZ_MAXLEN  (7 + 255 + 2)                   /* max match length */
+
+size_t sim_lz_compress (const uint8 *in, size_t ilen, uint8 *out, size_t olen)
+{
+const uint8 *htab[1 << SAVE_LZ_HBITS];
+const uint8 *ip = in, *anchor = in, *iend = in + ilen;
+const uint8 *ref = NULL;
+uint8 *op = out, *oend = out + olen;
+size_t n, len, maxlen, off = 0;
+uint32 h;
+
+memset (htab, 0, sizeof (htab));
+while (1) {
+    if (ip + 2 < iend) {
+        h = (((uint32)ip[0] << 16) | ((uint32)ip[1] << 8) | ip[2]);
+        h = (h * 2654435761u) >> (32 - SAVE_LZ_HBITS);
+        ref = htab[h];
+        htab[h] = ip;
+        if ((ref == NULL) ||
+            ((off = (size_t)(ip - ref) - 1) >= SAVE_LZ_MAXOFF) ||
+            (ref[0] != ip[0]) || (ref[1] != ip[1]) || (ref[2] != ip[2])) {
+            ++ip;
+            continue;
+            }
+        }
+    else
+        ip = iend;
+    for (n = (size_t)(ip - anchor); n > 0; ) {          /* flush literals */
+        size_t run = (n > 32) ? 32 : n;
+
+        if ((size_t)(oend - op) < run + 1)
+            return 0;
+        *op++ = (uint8)(run - 1);
+        memcpy (op, anchor, run);
+        op += run;
+        anchor += run;
+        n -= run;
+        }
+    if (ip == iend)
+        break;
+    maxlen = (size_t)(iend - ip);
+    if (maxlen > SAVE_LZ_MAXLEN)
+        maxlen = SAVE_LZ_MAXLEN;
+    for (len = 3; (len < maxlen) && (ref[len] == ip[len]); len++);
+    if ((size_t)(oend - op) < 3)
+        return 0;
+    if (len - 2 < 7)
+        *op++ = (uint8)(((len - 2) << 5) | (off >> 8));
+    else {
+        *op++ = (uint8)((7 << 5) | (off >> 8));
+        *op++ = (uint8)(len - 2 - 7);
+        }
+    *op++ = (uint8)(off & 0xFF);
+    ip += len;
+    anchor = ip;
+    }
+return (size_t)(op - out);
+}
+
+size_t sim_lz_expand (const uint8 *in, size_t ilen, uint8 *out, size_t olen)
+{
+const uint8 *ip = in, *iend = in + ilen;
+uint8 *op = out, *oend = out + olen;
+const uint8 *ref;
+size_t len, off;
+uint8 ctrl;
+
+while (ip < iend) {
+    ctrl = *ip++;
+    if (ctrl < 32) {                                    /* literal run */
+        len = (size_t)ctrl + 1;
+        if (((size_t)(iend - ip) < len) || ((size_t)(oend - op) < len))
+            return 0;
+        memcpy (op, ip, len);
+        op += len;
+        ip += len;
+        continue;
+        }
+    len = ctrl >> 5;                                    /* back reference */
+    if ((len == 7) && (ip < iend))
+        len += *ip++;
+    if (ip >= iend)
+        return 0;
+    off = (((size_t)(ctrl & 0x1F) << 8) | *ip++) + 1;
+    len += 2;
+    if (((size_t)(op - out) < off) || ((size_t)(oend - op) < len))
+        return 0;
+    for (ref = op - off; len > 0; len--)                /* may overlap */
+        *op++ = *ref++;
+    }
+return (size_t)(op - out);
+}
+
+/* Memory block digests for SAVE -I
+
+   Each incremental save records a digest of every memory block it wrote.
+   The next incremental save only writes the blocks whose digest changed
+   and names the previous image as its base; RESTORE loads the base
+   chain first.  Comparing digests rather than tracking stores keeps DMA
+   and other direct memory writes visible without touching the CPUs.
+
+   Every V4.1 image also carries a unique id, and an incremental image
+   records the id and size of its base.  RESTORE refuses a base which
+   doesn't match both, so a base file that was overwritten after the
+   incremental save isn't combined with changes relative to another. */
+
+typedef struct SAVE_DIGEST {
+    UNIT                *uptr;                          /* memory unit */
+    t_addr              capac;                          /* size when digested */
+    uint32              blocks;                         /* number of blocks */
+    t_uint64            *digest;                        /* per block digests */
+    } SAVE_DIGEST;
+
+#define SAVE_MAX_BASES  32                              /* longest base chain */
+
+static SAVE_DIGEST *save_digests = NULL;
+static uint32 save_digest_count = 0;
+static char *save_ckpt_chain[SAVE_MAX_BASES];           /* base chain, oldest first */
+static uint32 save_ckpt_depth = 0;                      /* files in base chain */
+static char *save_ckpt_name = NULL;                     /* base of next SAVE -I */
+static char save_ckpt_id[40];                           /* id of that base */
+static double save_ckpt_size;                           /* size of that base */
+static char save_last_id[40];                           /* id of last image saved */
+static double save_last_size;                           /* size of last image saved */
+
+static void save_ckpt_reset (void)
+{
+uint32 i;
+
+for (i = 0; i < save_digest_count; i++)
+    free (save_digests[i].digest);
+free (save_digests);
+save_digests = NULL;
+save_digest_count = 0;
+for (i = 0; i < save_ckpt_depth; i++)
+    free (save_ckpt_chain[i]);
+save_ckpt_depth = 0;
+save_ckpt_name = NULL;
+}
+
+/* Check whether a file is part of the base chain of the next SAVE -I */
+
+static t_bool save_ckpt_in_chain (const char *fullname)
+{
+uint32 i;
+
+for (i = 0; i < save_ckpt_depth; i++)
+    if (strcmp (fullname, save_ckpt_chain[i]) == 0)
+        return TRUE;
+return FALSE;
+}
+
+/* Find the digest list for a memory unit, (re)creating it if the unit
+   wasn't part of the base image or has changed size since.  *base is set
+   if the existing digests describe the base image. */
+
+static SAVE_DIGEST *save_digest_unit (UNIT *uptr, t_addr high, uint32 blocks, t_bool *base)
+{
+SAVE_DIGEST *sd;
+uint32 i;
+
+*base = FALSE;
+for (i = 0; i < save_digest_count; i++)
+    if (save_digests[i].uptr == uptr)
+        break;
+if (i == save_digest_count) {
+    sd = (SAVE_DIGEST *)realloc (save_digests, (i + 1) * sizeof (*sd));
+    if (sd == NULL)
+        return NULL;
+    save_digests = sd;
+    memset (&save_digests[i], 0, sizeof (*sd));
+    save_digests[i].uptr = uptr;
+    ++save_digest_count;
+    }
+sd = &save_digests[i];
+if ((sd->digest != NULL) && (sd->capac == high) && (sd->blocks == blocks)) {
+    *base = (save_ckpt_name != NULL);
+    return sd;
+    }
+free (sd->digest);
+sd->capac = high;
+sd->blocks = blocks;
+sd->digest = (t_uint64 *)calloc (blocks, sizeof (*sd->digest));
+return (sd->digest == NULL) ? NULL : sd;
+}
+
+/* Make a unique id for a save image */
+
+static void save_image_id (char *id)
+{
+static uint32 count = 0;
+struct {
+    time_t      now;
+    uint32      msec;
+    clock_t     cpu;
+    double      stime;
+    uint32      count;
+    const void  *where;
+    } seed;
+
+memset (&seed, 0, sizeof (seed));
+seed.now = time (NULL);
+seed.msec = sim_os_msec ();
+seed.cpu = clock ();
+seed.stime = sim_time;
+seed.count = count++;
+seed.where = &seed;
+sprintf (id, "%08X%08X", seed.msec, (uint32)seed.now);
+seed.count = count++;
+sprintf (id + 16, "%016" LL_FMT "X", (LL_TYPE)sim_digest ((const uint8 *)&seed, sizeof (seed)));
+}
+
+t_uint64 sim_digest (const uint8 *p, size_t len)
+{
+uint32 h1 = 2166136261u, h2 = 0x9E3779B9u, w;
+
+for ( ; len >= sizeof (w); p += sizeof (w), len -= sizeof (w)) {
+    memcpy (&w, p, sizeof (w));
+    h1 = (h1 ^ w) * 16777619u;
+    h2 = (h2 + w) * 2246822519u;
+    h2 = (h2 << 13) | (h2 >> 19);
+    }
+for ( ; len > 0; p++, len--) {
+    h1 = (h1 ^ *p) * 16777619u;
+    h2 = ((h2 + *p) * 2246822519u);
+    h2 = (h2 << 13) | (h2 >> 19);
+    }
+return ((t_uint64)h1 << 32) | h2;
+}
+
+/* Memory block counts in a V4.1 image may carry these flags: the block is
+   LZ compressed (a 32 bit compressed length and the data follow), or the
+   block is unchanged from the base image (no data follows).  A negative
+   count is an all zero block, as in every earlier format. */
+
+#define SAVE_BLK_LZ     0x40000000
+#define SAVE_BLK_BASE   0x20000000
+#define SAVE_BLK_CNT    0x0FFFFFFF
+
 /* Save command
 
    sa[ve] filename              save state to specified file
@@ -8578,6 +9503,7 @@ t_stat save_cmd (int32 flag, CONST char *cptr)
 FILE *sfile;
 t_stat r;
 char gbuf[4*CBUFSIZE];
+char *fullname;
 
 GET_SWITCHES (cptr);                                    /* get switches */
 if (*cptr == 0)                                         /* must be more */
@@ -8585,37 +9511,64 @@ if (*cptr == 0)                                         /* must be more */
 gbuf[sizeof(gbuf)-1] = '\0';
 strlcpy (gbuf, cptr, sizeof(gbuf));
 sim_trim_endspc (gbuf);
+fullname = sim_filepath_parts (gbuf, "f");
+if ((save_ckpt_name != NULL) &&                         /* overwriting a file */
+    ((fullname == NULL) ||                              /* the next incremental */
+     save_ckpt_in_chain (fullname) ||                   /* save depends on, or */
+     ((save_ckpt_depth == SAVE_MAX_BASES) &&            /* chain full? */
+      (sim_switches & SWMASK ('I')))))
+    save_ckpt_reset ();                                 /* write a full image */
 if ((sfile = sim_fopen (gbuf, "r+b")) == NULL) {    /* try existing file */
-    if ((sfile = sim_fopen (gbuf, "wb")) == NULL)   /* create new empty file */
+    if ((sfile = sim_fopen (gbuf, "wb")) == NULL) { /* create new empty file */
+        free (fullname);
         return SCPE_OPENERR;
+        }
     }
+sim_flush_buffered_files ();                            /* write back cached data */
 r = sim_save (sfile);
 fclose (sfile);
+if (sim_switches & SWMASK ('I')) {                      /* incremental? */
+    if ((r == SCPE_OK) && (fullname != NULL)) {         /* next one builds on it */
+        save_ckpt_chain[save_ckpt_depth++] = fullname;
+        save_ckpt_name = fullname;
+        strcpy (save_ckpt_id, save_last_id);
+        save_ckpt_size = save_last_size;
+        fullname = NULL;
+        }
+    else
+        save_ckpt_reset ();
+    }
+free (fullname);
 return r;
 }
 
 t_stat sim_save (FILE *sfile)
 {
 void *mbuf;
+uint8 *mem, *blk;
+uint8 *cbuf = NULL;
 int32 l, t;
-uint32 i, j, device_count;
+uint32 i, j, b, blocks, clen, device_count;
 t_addr k, high;
 t_value val;
 t_stat r;
-t_bool zeroflg;
+t_bool zeroflg, base;
 size_t sz;
 DEVICE *dptr;
 UNIT *uptr;
 REG *rptr;
+SAVE_DIGEST *sd;
+t_bool compress = ((sim_switches & SWMASK ('C')) != 0);
+t_bool incremental = ((sim_switches & SWMASK ('I')) != 0);
 
 #define WRITE_I(xx) sim_fwrite (&(xx), sizeof (xx), 1, sfile)
 
-sim_debug(SIM_DBG_SAVE, &sim_scp_dev, "sim_save ()\n");
+sim_debug(SIM_DBG_SAVE, &sim_scp_dev, "sim_save (compress=%d, incremental=%d)\n", compress, incremental);
 
 /* Don't make changes below without also changing save_vercur above */
 
 fprintf (sfile, "%s\n%s\n%s\n%s\n%s\n%.0f\n",
-    save_vercur,                                        /* [V2.5] save format */
+    (compress || incremental) ? save_ver41 : save_vercur,/* [V2.5] save format */
     sim_savename,                                       /* sim name */
     sim_si64, sim_sa64, eth_capabilities(),             /* [V3.5] options */
     sim_time);                                          /* [V3.2] sim time */
@@ -8629,6 +9582,14 @@ fprintf (sfile, "git commit id: %8.8s\n", S_xstr(SIM_GIT_COMMIT_ID));
 #else
 fprintf (sfile, "git commit id: unknown\n");
 #endif
+if (compress || incremental) {                          /* [V4.1] image id */
+    save_image_id (save_last_id);
+    fprintf (sfile, "%s\n", save_last_id);
+    if (incremental && save_ckpt_name)                  /* [V4.1] base image */
+        fprintf (sfile, "%s\n%s %.0f\n", save_ckpt_name, save_ckpt_id, save_ckpt_size);
+    else
+        fprintf (sfile, "\n");
+    }
 
 for (device_count = 0; sim_devices[device_count]; device_count++);/* count devices */
 for (i = 0; i < (device_count + sim_internal_device_count); i++) {/* loop thru devices */
@@ -8681,29 +9642,67 @@ for (i = 0; i < (device_count + sim_internal_device_count); i++) {/* loop thru d
              ((high = uptr->capac) != 0)) {             /* memory-like unit? */
             WRITE_I (high);                             /* [V2.5] write size */
             sz = SZ_D (dptr);
-            if ((mbuf = calloc (SRBSIZ, sz)) == NULL) {
-                fclose (sfile);
+            blocks = (uint32)((((high + dptr->aincr - 1) / dptr->aincr) + SRBSIZ - 1) / SRBSIZ);
+            sd = NULL;
+            base = FALSE;
+            if (((mbuf = calloc (SRBSIZ, sz)) == NULL) ||
+                (compress && (cbuf == NULL) &&
+                 ((cbuf = (uint8 *)malloc (SRBSIZ * sizeof (t_value))) == NULL)) ||
+                (incremental &&
+                 ((sd = save_digest_unit (uptr, high, blocks, &base)) == NULL))) {
+                free (mbuf);
+                free (cbuf);
                 return SCPE_MEM;
                 }
-            for (k = 0; k < high; ) {                   /* loop thru mem */
-                zeroflg = TRUE;
-                for (l = 0; (l < SRBSIZ) && (k < high); l++,
-                     k = k + (dptr->aincr)) {           /* check for 0 block */
-                    r = dptr->examine (&val, k, uptr, SIM_SW_REST);
-                    if (r != SCPE_OK) {
-                        free (mbuf);
-                        return r;
+            mem = sim_unit_mem (dptr, uptr);            /* direct access? */
+            for (k = 0, b = 0; k < high; b++) {         /* loop thru mem */
+                if (mem != NULL) {
+                    blk = mem + (k / dptr->aincr) * sz;
+                    l = (int32)((high - k + dptr->aincr - 1) / dptr->aincr);
+                    if (l > SRBSIZ)
+                        l = SRBSIZ;
+                    k = k + l * dptr->aincr;
+                    zeroflg = (memcmp (blk, mbuf, l * sz) == 0);
+                    }
+                else {
+                    blk = (uint8 *)mbuf;
+                    zeroflg = TRUE;
+                    for (l = 0; (l < SRBSIZ) && (k < high); l++,
+                         k = k + (dptr->aincr)) {       /* check for 0 block */
+                        r = dptr->examine (&val, k, uptr, SIM_SW_REST);
+                        if (r != SCPE_OK) {
+                            free (mbuf);
+                            free (cbuf);
+                            return r;
+                            }
+                        if (val) zeroflg = FALSE;
+                        SZ_STORE (sz, val, mbuf, l);
+                        }                               /* end for l */
+                    }
+                if (sd != NULL) {                       /* incremental? */
+                    t_uint64 d = sim_digest (blk, l * sz);
+
+                    if (base && (sd->digest[b] == d)) { /* same as base? */
+                        l |= SAVE_BLK_BASE;
+                        WRITE_I (l);                    /* write only count */
+                        continue;
                         }
-                    if (val) zeroflg = FALSE;
-                    SZ_STORE (sz, val, mbuf, l);
-                    }                                   /* end for l */
+                    sd->digest[b] = d;
+                    }
                 if (zeroflg) {                          /* all zero's? */
                     l = -l;                             /* invert block count */
                     WRITE_I (l);                        /* write only count */
                     }
+                else if (compress &&                    /* compressible? */
+                         ((clen = (uint32)sim_lz_compress (blk, l * sz, cbuf, l * sz - 1)) != 0)) {
+                    l |= SAVE_BLK_LZ;
+                    WRITE_I (l);                        /* block count */
+                    WRITE_I (clen);                     /* compressed size */
+                    sim_fwrite (cbuf, 1, clen, sfile);
+                    }
                 else {
                     WRITE_I (l);                        /* block count */
-                    sim_fwrite (mbuf, sz, l, sfile);
+                    sim_fwrite (blk, sz, l, sfile);
                     }
                 }                                       /* end for k */
             free (mbuf);                                /* dealloc buffer */
@@ -8728,12 +9727,14 @@ for (i = 0; i < (device_count + sim_internal_device_count); i++) {/* loop thru d
     fputc ('\n', sfile);                                /* end registers */
     }
 fputc ('\n', sfile);                                    /* end devices */
+free (cbuf);
 if (!ferror (sfile)) {
     t_offset pos = sim_ftell (sfile);                   /* get current position */
 
     if (pos < 0)                                        /* error? */
         return SCPE_IOERR;                              /* done! */
     sim_set_fsize (sfile, (t_addr)pos);                 /* truncate the save file */
+    save_last_size = (double)pos;
     }
 return (ferror (sfile))? SCPE_IOERR: SCPE_OK;           /* error during save? */
 }
@@ -8757,11 +9758,15 @@ strlcpy (gbuf, cptr, sizeof(gbuf));
 sim_trim_endspc (gbuf);
 if ((rfile = sim_fopen (gbuf, "rb")) == NULL)
     return SCPE_OPENERR;
+save_ckpt_reset ();                                     /* memory no longer matches */
 r = sim_rest (rfile);
 fclose (rfile);
 return r;
 }
 
+static uint32 rest_base_depth = 0;                      /* base images being restored */
+static const char *rest_base_id = NULL;                 /* id the base must have */
+
 t_stat sim_rest (FILE *rfile)
 {
 char buf[CBUFSIZE];
@@ -8770,13 +9775,15 @@ UNIT **attunits = NULL;
 int32 *attswitches = NULL;
 int32 attcnt = 0;
 void *mbuf = NULL;
+uint8 *cbuf = NULL;
+uint8 *mem, *blk;
 int32 j, blkcnt, limit, unitno, time, flg;
-uint32 us, depth;
+uint32 us, depth, clen;
 t_addr k, high, old_capac;
 t_value val, max;
 t_stat r;
 size_t sz;
-t_bool v40, v35, v32;
+t_bool v41, v40, v35, v32;
 DEVICE *dptr;
 UNIT *uptr;
 REG *rptr;
@@ -8803,8 +9810,10 @@ if (fstat (fileno (rfile), &rstat)) {
     }
 READ_S (buf);                                           /* [V2.5+] read version */
 sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "version=%s\n", buf);
-v40 = v35 = v32 = FALSE;
-if (strcmp (buf, save_ver40) == 0)                      /* version 4.0? */
+v41 = v40 = v35 = v32 = FALSE;
+if (strcmp (buf, save_ver41) == 0)                      /* version 4.1? */
+    v41 = v40 = v35 = v32 = TRUE;
+else if (strcmp (buf, save_ver40) == 0)                 /* version 4.0? */
     v40 = v35 = v32 = TRUE;
 else if (strcmp (buf, save_ver35) == 0)                 /* version 3.5? */
     v35 = v32 = TRUE;
@@ -8814,7 +9823,7 @@ else if (strcmp (buf, save_ver30) != 0) {               /* version 3.0? */
     sim_printf ("Invalid file version: %s\n", buf);
     return SCPE_INCOMP;
     }
-if ((strcmp (buf, save_ver40) != 0) && (!sim_quiet) && (!suppress_warning)) {
+if ((!v40) && (!sim_quiet) && (!suppress_warning)) {
     sim_printf ("warning - attempting to restore a saved simulator image in %s image format.\n", buf);
     warned = TRUE;
     }
@@ -8857,6 +9866,56 @@ if (v40) {
 #undef S_xstr
 #endif
     }
+if (v41) {
+    READ_S (buf);                                       /* [V4.1] image id */
+    sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "id=%s\n", buf);
+    if ((rest_base_id != NULL) && (strcmp (buf, rest_base_id) != 0)) {
+        sim_printf ("Base image has been replaced, id %s instead of %s\n", buf, rest_base_id);
+        return SCPE_INCOMP;
+        }
+    READ_S (buf);                                       /* [V4.1] base image */
+    if (buf[0] != '\0') {                               /* incremental? */
+        FILE *bfile;
+        char base_info[CBUFSIZE], base_id[40];
+        double base_size, size;
+
+        sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "base=%s\n", buf);
+        READ_S (base_info);                             /* [V4.1] base id, size */
+        if (sscanf (base_info, "%39s %lf", base_id, &base_size) != 2) {
+            r = SCPE_INCOMP;
+            goto Cleanup_Return;
+            }
+        if ((bfile = sim_fopen (buf, "rb")) == NULL) {
+            sim_printf ("Can't open base image: %s\n", buf);
+            r = SCPE_OPENERR;
+            goto Cleanup_Return;
+            }
+        if (rest_base_depth >= SAVE_MAX_BASES) {        /* looping chain? */
+            fclose (bfile);
+            sim_printf ("Too many nested base images at: %s\n", buf);
+            r = SCPE_INCOMP;
+            goto Cleanup_Return;
+            }
+        size = (double)sim_fsize_ex (bfile);
+        if (size != base_size) {                        /* replaced since? */
+            fclose (bfile);
+            sim_printf ("Base image %s has been replaced, size %.0f instead of %.0f\n", buf, size, base_size);
+            r = SCPE_INCOMP;
+            goto Cleanup_Return;
+            }
+        sim_switches = SWMASK ('D') | SWMASK ('Q');     /* memory and state only */
+        ++rest_base_depth;
+        rest_base_id = base_id;
+        r = sim_rest (bfile);
+        rest_base_id = NULL;
+        --rest_base_depth;
+        fclose (bfile);
+        if (r != SCPE_OK) {
+            sim_printf ("Error restoring base image %s: %s\n", buf, sim_error_text (r));
+            goto Cleanup_Return;
+            }
+        }
+    }
 if (!dont_detach_attach)
     detach_all (0, 0);                                  /* Detach everything to start from a consistent state */
 else {
@@ -8993,28 +10052,58 @@ for ( ;; ) {                                            /* device loop */
                 sim_printf ("\n");
                 }
             sz = SZ_D (dptr);                           /* allocate buffer */
-            if ((mbuf = realloc (mbuf, SRBSIZ * sz)) == NULL) {
+            if (((mbuf = realloc (mbuf, SRBSIZ * sz)) == NULL) ||
+                (v41 && (cbuf == NULL) &&
+                 ((cbuf = (uint8 *)malloc (SRBSIZ * sizeof (t_value))) == NULL))) {
                 r = SCPE_MEM;
                 goto Cleanup_Return;
                 }
+            mem = sim_unit_mem (dptr, uptr);            /* direct access? */
             for (k = 0; k < high; ) {                   /* loop thru mem */
                 if (sim_fread (&blkcnt, sizeof (blkcnt), 1, rfile) == 0) {/* block count */
                     r = SCPE_IOERR;
                     goto Cleanup_Return;
                     }
-                if (blkcnt < 0)                         /* compressed? */
+                if (blkcnt < 0)                         /* zero block? */
                     limit = -blkcnt;
+                else if (v41)                           /* [V4.1] flags */
+                    limit = blkcnt & SAVE_BLK_CNT;
                 else
-                    limit = (int32)sim_fread (mbuf, sz, blkcnt, rfile);
-                if (limit <= 0) {                       /* invalid or err? */
+                    limit = blkcnt;
+                if ((limit <= 0) || (limit > SRBSIZ) || /* invalid or too big? */
+                    ((t_addr)limit > (high - k + dptr->aincr - 1) / dptr->aincr)) {
                     r = SCPE_IOERR;
                     goto Cleanup_Return;
                     }
+                blk = (mem != NULL) ? mem + (k / dptr->aincr) * sz : (uint8 *)mbuf;
+                if (blkcnt < 0)                         /* zero block? */
+                    memset (blk, 0, limit * sz);
+                else if (v41 && (blkcnt & SAVE_BLK_BASE)) { /* unchanged from base? */
+                    k = k + limit * dptr->aincr;
+                    continue;
+                    }
+                else if (v41 && (blkcnt & SAVE_BLK_LZ)) {   /* compressed? */
+                    if ((sim_fread (&clen, sizeof (clen), 1, rfile) == 0) ||
+                        (clen == 0) || (clen >= limit * sz) ||
+                        (sim_fread (cbuf, 1, clen, rfile) != clen) ||
+                        (sim_lz_expand (cbuf, clen, blk, limit * sz) != limit * sz)) {
+                        r = SCPE_IOERR;
+                        goto Cleanup_Return;
+                        }
+                    }
+                else {
+                    limit = (int32)sim_fread (blk, sz, limit, rfile);
+                    if (limit <= 0) {                   /* read error? */
+                        r = SCPE_IOERR;
+                        goto Cleanup_Return;
+                        }
+                    }
+                if (mem != NULL) {                      /* already in place? */
+                    k = k + limit * dptr->aincr;
+                    continue;
+                    }
                 for (j = 0; j < limit; j++, k = k + (dptr->aincr)) {
-                    if (blkcnt < 0)                     /* compressed? */
-                        val = 0;
-                    else
-                        SZ_LOAD (sz, val, mbuf, j);     /* saved value */
+                    SZ_LOAD (sz, val, mbuf, j);         /* saved value */
                     r = dptr->deposit (val, k, uptr, SIM_SW_REST);
                     if (r != SCPE_OK) {
                         goto Cleanup_Return;
@@ -9101,6 +10190,7 @@ for (j=0, r = SCPE_OK; j<attcnt; j++) {
     }
 Cleanup_Return:
 free (mbuf);
+free (cbuf);
 for (j=0; j < attcnt; j++)
     free (attnames[j]);
 free (attnames);
@@ -11923,11 +13013,328 @@ return buf;
                         or 0 (SCPE_OK) if no exceptions
 */
 
+/* Event queue engines
+
+   The event queue is an ordered set of units keyed by the time at which
+   each one is due.  Entries which are due at the same time are processed
+   in the order in which they were scheduled.  Two interchangeable engines
+   implement this ordering:
+
+        LIST    a singly linked list in clock order with each entry's time
+                RELATIVE to the previous entry.  Insert and cancel are O(n),
+                removing the first entry is O(1).
+        HEAP    a binary min heap keyed by absolute due time and insertion
+                sequence.  Insert, cancel and removal of the first entry are
+                all O(log n).
+
+   Both engines present the same view to the rest of the simulator:
+   sim_clock_queue points at the first entry (or is QUEUE_LIST_END) and
+   sim_clock_queue->time is the time until it is due, and uptr->next is
+   non NULL for every queued unit.  Only the LIST engine chains the whole
+   queue through uptr->next, so code which needs to visit every entry
+   should use sim_clock_queue_snapshot.
+
+   Since the HEAP engine derives the relative time of each entry from the
+   difference of absolute due times, and the LIST engine sums the same
+   differences, both engines dispatch events in exactly the same order.
+*/
+
+static const char *sim_queue_engine_names[] = {"LIST", "HEAP"};
+static UNIT **sim_qheap = NULL;                         /* heap of queued units */
+static int32 sim_qheap_cnt = 0;                         /* heap entries */
+static int32 sim_qheap_size = 0;                        /* heap allocation */
+static double sim_qheap_base = 0.0;                     /* queue time when empty */
+static t_uint64 sim_qheap_seq = 0;                      /* insertion sequence */
+
+#define QHEAP_BEFORE(a, b) (((a)->q_due < (b)->q_due) || \
+                            (((a)->q_due == (b)->q_due) && ((a)->q_seq < (b)->q_seq)))
+#define QHEAP_ACTIVE(uptr) (((uptr)->q_index < sim_qheap_cnt) && \
+                            (sim_qheap[(uptr)->q_index] == (uptr)))
+
+/* Current queue time: the due time of the first entry less the time
+   remaining until it fires */
+
+static double _sim_qheap_now (void)
+{
+if (sim_qheap_cnt == 0)
+    return sim_qheap_base;
+return sim_qheap[0]->q_due - sim_qheap[0]->time;
+}
+
+static void _sim_qheap_up (int32 i)
+{
+UNIT *uptr = sim_qheap[i];
+
+while (i > 0) {
+    int32 parent = (i - 1) >> 1;
+
+    if (!QHEAP_BEFORE (uptr, sim_qheap[parent]))
+        break;
+    sim_qheap[i] = sim_qheap[parent];
+    sim_qheap[i]->q_index = i;
+    i = parent;
+    }
+sim_qheap[i] = uptr;
+uptr->q_index = i;
+}
+
+static void _sim_qheap_down (int32 i)
+{
+UNIT *uptr = sim_qheap[i];
+
+while (1) {
+    int32 child = (i << 1) + 1;
+
+    if (child >= sim_qheap_cnt)
+        break;
+    if ((child + 1 < sim_qheap_cnt) &&
+        QHEAP_BEFORE (sim_qheap[child + 1], sim_qheap[child]))
+        ++child;
+    if (!QHEAP_BEFORE (sim_qheap[child], uptr))
+        break;
+    sim_qheap[i] = sim_qheap[child];
+    sim_qheap[i]->q_index = i;
+    i = child;
+    }
+sim_qheap[i] = uptr;
+uptr->q_index = i;
+}
+
+/* Make sim_clock_queue reflect the top of the heap.  A unit which becomes
+   the first entry gets its relative time computed from queue time now */
+
+static void _sim_qheap_head (double now)
+{
+if (sim_qheap_cnt == 0) {
+    sim_clock_queue = QUEUE_LIST_END;
+    sim_qheap_base = now;
+    return;
+    }
+if (sim_clock_queue != sim_qheap[0]) {
+    sim_clock_queue = sim_qheap[0];
+    sim_clock_queue->time = (int32)(sim_clock_queue->q_due - now);
+    }
+}
+
+static t_stat _sim_qheap_insert (UNIT *uptr, int32 event_time)
+{
+double now = _sim_qheap_now ();
+
+if (sim_qheap_cnt >= sim_qheap_size) {
+    int32 size = (sim_qheap_size == 0) ? 64 : 2 * sim_qheap_size;
+    UNIT **heap = (UNIT **)realloc (sim_qheap, size * sizeof (*heap));
+
+    if (heap == NULL)
+        return SCPE_MEM;
+    sim_qheap = heap;
+    sim_qheap_size = size;
+    }
+uptr->q_due = now + event_time;
+uptr->q_seq = sim_qheap_seq++;
+uptr->time = event_time;
+uptr->next = QUEUE_LIST_END;                            /* mark as queued */
+sim_qheap[sim_qheap_cnt] = uptr;
+_sim_qheap_up (sim_qheap_cnt++);
+_sim_qheap_head (now);
+return SCPE_OK;
+}
+
+static void _sim_qheap_remove (UNIT *uptr, double now)
+{
+int32 i = uptr->q_index;
+
+if (i != --sim_qheap_cnt) {
+    sim_qheap[i] = sim_qheap[sim_qheap_cnt];
+    sim_qheap[i]->q_index = i;
+    _sim_qheap_down (i);
+    _sim_qheap_up (sim_qheap[i]->q_index);
+    }
+uptr->next = NULL;                                      /* hygiene */
+uptr->q_index = 0;
+_sim_qheap_head (now);
+}
+
+/* Remove and return the first entry on the queue, advancing queue time
+   to the time that entry was due */
+
+static UNIT *_sim_queue_pop (void)
+{
+UNIT *uptr = sim_clock_queue;
+
+if (sim_queue_engine == SIM_QUEUE_HEAP)
+    _sim_qheap_remove (uptr, uptr->q_due);
+else {
+    sim_clock_queue = uptr->next;                       /* remove first */
+    uptr->next = NULL;                                  /* hygiene */
+    }
+uptr->time = 0;
+return uptr;
+}
+
+/* Return the entry which follows the first entry, and its time relative
+   to the first entry */
+
+static UNIT *_sim_queue_second (int32 *time)
+{
+UNIT *uptr;
+
+if (sim_queue_engine != SIM_QUEUE_HEAP) {
+    uptr = sim_clock_queue->next;
+    if (uptr != QUEUE_LIST_END)
+        *time = uptr->time;
+    return uptr;
+    }
+if (sim_qheap_cnt < 2)
+    return QUEUE_LIST_END;
+uptr = sim_qheap[1];
+if ((sim_qheap_cnt > 2) && QHEAP_BEFORE (sim_qheap[2], uptr))
+    uptr = sim_qheap[2];
+*time = (int32)(uptr->q_due - sim_qheap[0]->q_due);
+return uptr;
+}
+
+static int _sim_qheap_compare (const void *pa, const void *pb)
+{
+const UNIT *a = *(UNIT * const *)pa;
+const UNIT *b = *(UNIT * const *)pb;
+
+return QHEAP_BEFORE (a, b) ? -1 : (QHEAP_BEFORE (b, a) ? 1 : 0);
+}
+
+/* sim_clock_queue_snapshot - return the queued units in clock order
+
+   Inputs:
+        count   =       pointer to the returned entry count
+   Outputs:
+        units   =       malloc'ed array of units, NULL if queue is empty
+                        (caller must free)
+*/
+
+UNIT **sim_clock_queue_snapshot (int32 *count)
+{
+UNIT **units;
+UNIT *uptr;
+int32 cnt = sim_qcount ();
+
+*count = 0;
+if (cnt == 0)
+    return NULL;
+units = (UNIT **)malloc (cnt * sizeof (*units));
+if (units == NULL)
+    return NULL;
+if (sim_queue_engine == SIM_QUEUE_HEAP) {
+    memcpy (units, sim_qheap, cnt * sizeof (*units));
+    qsort (units, cnt, sizeof (*units), _sim_qheap_compare);
+    }
+else {
+    cnt = 0;
+    for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next)
+        units[cnt++] = uptr;
+    }
+*count = cnt;
+return units;
+}
+
+/* Switch event queue engines, preserving the order and relative times
+   of everything currently queued */
+
+static t_stat _sim_queue_set_engine (uint32 engine)
+{
+UNIT **units;
+int32 i, cnt, *times;
+double now;
+
+if (engine == sim_queue_engine)
+    return SCPE_OK;
+UPDATE_SIM_TIME;
+units = sim_clock_queue_snapshot (&cnt);
+times = (int32 *)calloc (cnt + 1, sizeof (*times));
+if ((times == NULL) || ((cnt != 0) && (units == NULL))) {
+    free (units);
+    free (times);
+    return SCPE_MEM;
+    }
+for (i = 0; i < cnt; i++) {                             /* record relative times */
+    if (i == 0)
+        times[i] = units[i]->time;
+    else
+        times[i] = (sim_queue_engine == SIM_QUEUE_HEAP) ?
+                   (int32)(units[i]->q_due - units[i - 1]->q_due) :
+                   units[i]->time;
+    }
+sim_clock_queue = QUEUE_LIST_END;
+sim_qheap_cnt = 0;
+sim_queue_engine = engine;
+if ((engine == SIM_QUEUE_HEAP) && (cnt > sim_qheap_size)) {
+    UNIT **heap = (UNIT **)realloc (sim_qheap, cnt * sizeof (*heap));
+
+    if (heap == NULL) {                                 /* can't grow? */
+        sim_queue_engine = engine = SIM_QUEUE_LIST;     /* stay with LIST */
+        }
+    else {
+        sim_qheap = heap;
+        sim_qheap_size = cnt;
+        }
+    }
+now = sim_qheap_base = 0.0;
+for (i = 0; i < cnt; i++) {                             /* rebuild in order */
+    UNIT *uptr = units[i];
+
+    if (engine == SIM_QUEUE_HEAP) {                     /* sorted array is a heap */
+        now += times[i];
+        uptr->q_due = now;
+        uptr->q_seq = sim_qheap_seq++;
+        uptr->q_index = i;
+        uptr->next = QUEUE_LIST_END;
+        sim_qheap[sim_qheap_cnt++] = uptr;
+        }
+    else
+        uptr->next = (i + 1 < cnt) ? units[i + 1] : QUEUE_LIST_END;
+    uptr->time = times[i];
+    }
+if (cnt != 0)
+    sim_clock_queue = units[0];
+free (units);
+free (times);
+return SCPE_OK;
+}
+
+/* Set/show event queue engine */
+
+t_stat sim_set_queue (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+uint32 engine;
+t_stat r;
+
+if ((cptr == NULL) || (*cptr == 0))
+    return SCPE_2FARG;
+cptr = get_glyph (cptr, gbuf, 0);
+if (*cptr != 0)
+    return SCPE_2MARG;
+for (engine = 0; engine < sizeof (sim_queue_engine_names) / sizeof (sim_queue_engine_names[0]); engine++)
+    if (MATCH_CMD (gbuf, sim_queue_engine_names[engine]) == 0)
+        break;
+if (engine >= sizeof (sim_queue_engine_names) / sizeof (sim_queue_engine_names[0]))
+    return sim_messagef (SCPE_ARG, "Unknown event queue engine: %s\n", gbuf);
+r = _sim_queue_set_engine (engine);
+if (r != SCPE_OK)
+    return r;
+if (sim_queue_engine != engine)
+    return sim_messagef (SCPE_MEM, "Insufficient memory for %s event queue\n", sim_queue_engine_names[engine]);
+return SCPE_OK;
+}
+
+const char *sim_queue_engine_name (void)
+{
+return sim_queue_engine_names[sim_queue_engine];
+}
+
 t_stat sim_process_event (void)
 {
 UNIT *uptr;
 t_stat reason, bare_reason;
-int32 sim_interval_catchup;
+int32 sim_interval_catchup, next_time;
 
 if (stop_cpu) {                                         /* stop CPU? */
     stop_cpu = 0;
@@ -11956,19 +13363,17 @@ if (sim_interval < 0) {
     UPDATE_SIM_TIME;                          /* update sim time */
     sim_debug (SIM_DBG_EVENT_NEG, &sim_scp_dev, "Processing event for %s with sim_interval = %d, event time = %.0f\n",
         sim_uname (sim_clock_queue), sim_interval_catchup, sim_gtime ());
-    if (sim_clock_queue->next != QUEUE_LIST_END)
+    if ((sim_deb) && ((uptr = _sim_queue_second (&next_time)) != QUEUE_LIST_END))
         sim_debug (SIM_DBG_EVENT_NEG, &sim_scp_dev, "- Next event for %s after = %d\n",
-            sim_uname (sim_clock_queue->next), sim_clock_queue->next->time);
+            sim_uname (uptr), next_time);
     sim_time -= sim_clock_queue->time;
     sim_rtime -= sim_clock_queue->time;
     }
 else
     sim_interval_catchup = 0;
 do {
-    uptr = sim_clock_queue;                             /* get first */
-    sim_clock_queue = uptr->next;                       /* remove first */
-    uptr->next = NULL;                                  /* hygiene */
-    uptr->time = 0;
+    uptr = _sim_queue_pop ();                           /* remove first */
+    sim_event_count += 1;
     if (sim_clock_queue != QUEUE_LIST_END) {
         if (sim_interval_catchup < 0)
             sim_interval = -sim_interval_catchup;
@@ -12059,6 +13464,14 @@ UPDATE_SIM_TIME;                                        /* update sim time */
 
 sim_debug (SIM_DBG_ACTIVATE, &sim_scp_dev, "Activating %s delay=%d\n", sim_uname (uptr), event_time);
 
+if (sim_queue_engine == SIM_QUEUE_HEAP) {
+    t_stat r = _sim_qheap_insert (uptr, event_time);
+
+    if (r != SCPE_OK)
+        return r;
+    sim_interval = sim_clock_queue->time;
+    return SCPE_OK;
+    }
 prvptr = NULL;
 accum = 0;
 for (cptr = sim_clock_queue; cptr != QUEUE_LIST_END; cptr = cptr->next) {
@@ -12194,7 +13607,11 @@ UPDATE_SIM_TIME;                                        /* update sim time */
 sim_debug (SIM_DBG_EVENT, &sim_scp_dev, "Canceling Event for %s\n", sim_uname(uptr));
 nptr = QUEUE_LIST_END;
 
-if (sim_clock_queue == uptr) {
+if (sim_queue_engine == SIM_QUEUE_HEAP) {
+    if (QHEAP_ACTIVE (uptr))
+        _sim_qheap_remove (uptr, _sim_qheap_now ());
+    }
+else if (sim_clock_queue == uptr) {
     nptr = sim_clock_queue = uptr->next;
     uptr->next = NULL;                                  /* hygiene */
     }
@@ -12254,6 +13671,13 @@ UNIT *cptr;
 int32 accum;
 
 accum = 0;
+if (sim_queue_engine == SIM_QUEUE_HEAP) {
+    if (!QHEAP_ACTIVE (uptr))
+        return 0;
+    if (sim_interval > 0)
+        accum = sim_interval;
+    return accum + (int32)(uptr->q_due - sim_qheap[0]->q_due) + 1;
+    }
 for (cptr = sim_clock_queue; cptr != QUEUE_LIST_END; cptr = cptr->next) {
     if (cptr == sim_clock_queue) {
         if (sim_interval > 0)
@@ -12289,7 +13713,6 @@ return _sim_activate_time (uptr);
 
 double sim_activate_time_usecs (UNIT *uptr)
 {
-UNIT *cptr;
 int32 accum;
 double result;
 
@@ -12297,17 +13720,9 @@ AIO_VALIDATE(uptr);
 result = sim_timer_activate_time_usecs (uptr);
 if (result >= 0)
     return result;
-accum = 0;
-for (cptr = sim_clock_queue; cptr != QUEUE_LIST_END; cptr = cptr->next) {
-    if (cptr == sim_clock_queue) {
-        if (sim_interval > 0)
-            accum = accum + sim_interval;
-        }
-    else
-        accum = accum + cptr->time;
-    if (cptr == uptr)
-        return 1.0 + uptr->usecs_remaining + ((1000000.0 * accum) / sim_timer_inst_per_sec ());
-    }
+accum = _sim_activate_queue_time (uptr);
+if (accum)
+    return 1.0 + uptr->usecs_remaining + ((1000000.0 * (accum - 1)) / sim_timer_inst_per_sec ());
 return 0.0;
 }
 
@@ -12345,6 +13760,8 @@ int32 sim_qcount (void)
 int32 cnt;
 UNIT *uptr;
 
+if (sim_queue_engine == SIM_QUEUE_HEAP)
+    return sim_qheap_cnt;
 cnt = 0;
 for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next)
     cnt++;
@@ -12370,6 +13787,12 @@ return cnt;
    is the bitwise OR of all the type fields).  A simulator need only check for
    a breakpoint of type X if bit SWMASK('X') is set in sim_brk_summ.
 
+   sim_brk_page_summ holds the same summary for each hashed page of addresses
+   (see SIM_BRK_PAGE in scp.h).  sim_brk_test consults it before searching the
+   table, so an address with no breakpoint nearby costs a single load even
+   with breakpoints or watchpoints set elsewhere, and a simulator can test
+   SIM_BRK_PAGE itself to skip the call.
+
    The package contains the following public routines:
 
         sim_brk_init            initialize
@@ -12407,6 +13830,7 @@ sim_brk_tab = (BRKTAB **) realloc (sim_brk_tab, sim_brk_lnt*sizeof (BRKTAB*));
 if (sim_brk_tab == NULL)
     return SCPE_MEM;
 memset (sim_brk_tab, 0, sim_brk_lnt*sizeof (BRKTAB*));
+memset (sim_brk_page_summ, 0, sizeof (sim_brk_page_summ));
 sim_brk_ent = sim_brk_ins = 0;
 sim_brk_clract ();
 sim_brk_npc (0);
@@ -12540,6 +13964,7 @@ if ((act != NULL) && (*act != 0)) {                     /* new action? */
     bp->act = newp;                                     /* set pointer */
     }
 sim_brk_summ = sim_brk_summ | (sw & ~BRK_TYP_TEMP);
+sim_brk_page_summ[SIM_BRK_PAGE_IDX (loc)] |= (sw & ~BRK_TYP_TEMP);
 return SCPE_OK;
 }
 
@@ -12576,11 +14001,13 @@ if (sim_brk_tab[sim_brk_ins] == NULL) {                 /* erased entry */
     for (i = sim_brk_ins; i < sim_brk_ent; i++)         /* shuffle remaining entries */
         sim_brk_tab[i] = sim_brk_tab[i+1];
     }
-sim_brk_summ = 0;                                       /* recalc summary */
+sim_brk_summ = 0;                                       /* recalc summaries */
+memset (sim_brk_page_summ, 0, sizeof (sim_brk_page_summ));
 for (i = 0; i < sim_brk_ent; i++) {
     bp = sim_brk_tab[i];
     while (bp) {
         sim_brk_summ |= (bp->typ & ~BRK_TYP_TEMP);
+        sim_brk_page_summ[SIM_BRK_PAGE_IDX (bp->addr)] |= (bp->typ & ~BRK_TYP_TEMP);
         bp = bp->next;
         }
     }
@@ -12723,6 +14150,8 @@ uint32 sim_brk_test (t_addr loc, uint32 btyp)
 BRKTAB *bp;
 uint32 spc = (btyp >> SIM_BKPT_V_SPC) & (SIM_BKPT_N_SPC - 1);
 
+if (!SIM_BRK_PAGE (loc, btyp))                          /* none in this page? */
+    return 0;
 if (sim_brk_summ & BRK_TYP_DYN_ALL)
     btyp |= BRK_TYP_DYN_ALL;
 
@@ -12916,6 +14345,8 @@ return msg;
         buf                     the buffer of output data which has been produced
         buf_ins                 the buffer insertion point for the next output data
         buf_size                the buffer size
+        matcher                 the compiled literal match rules
+        re_buf                  the buffer data without NULs for RegEx match rules
 
    The package contains the following public routines:
 
@@ -13030,30 +14461,51 @@ static SIM_INLINE void sim_release_regex(sim_regex_t *re)
 #endif
 }
 
-/* Execute a regular expression match. */
+/* Execute a regular expression match.
+
+   Partial matching reports the earliest offset at which a match might still
+   complete once more data arrives.  Data before that offset can never be
+   part of a match, so the next attempt resumes there rather than rescanning
+   the whole buffer as each byte arrives.  Only used when RegEx support is
+   available. */
+#if USE_REGEX
 static int sim_execute_regex(EXPECT *exp, EXPTAB *ep, sim_regex_matchp_t cbuf)
 {
-#if USE_REGEX
     int rc;
 
 #  if defined(HAVE_PCRE_H)
-    ep->re_ctx.ovector_elts = 3 * (ep->re_nsub + 1);
-    ep->re_ctx.ovector = (int *)calloc((size_t)ep->re_ctx.ovector_elts, sizeof(*ep->re_ctx.ovector));
-    rc = pcre_exec(ep->regex, NULL, cbuf, exp->buf_ins, 0, PCRE_NOTBOL, ep->re_ctx.ovector, ep->re_ctx.ovector_elts);
+    if (ep->re_ctx.ovector == NULL)
+    {
+        ep->re_ctx.ovector_elts = 3 * (ep->re_nsub + 1);
+        ep->re_ctx.ovector = (int *)calloc((size_t)ep->re_ctx.ovector_elts, sizeof(*ep->re_ctx.ovector));
+        if (ep->re_ctx.ovector == NULL)
+            return PCRE_ERROR_NOMEMORY;
+    }
+    rc = pcre_exec(ep->regex, NULL, cbuf, (int)exp->re_buf_data, (int)ep->re_start, PCRE_NOTBOL | PCRE_PARTIAL_SOFT,
+                   ep->re_ctx.ovector, ep->re_ctx.ovector_elts);
+    if (rc == PCRE_ERROR_PARTIAL)
+        ep->re_start = (size_t)ep->re_ctx.ovector[0];
+    else if (rc == PCRE_ERROR_NOMATCH)
+        ep->re_start = exp->re_buf_data;
 #  elif defined(HAVE_PCRE2_H)
-    ep->re_ctx.match_data = pcre2_match_data_create_from_pattern(ep->regex, NULL);
-    rc = pcre2_match(ep->regex, cbuf, exp->buf_ins, 0, PCRE2_NOTBOL, ep->re_ctx.match_data, NULL);
-    if (rc >= 0)
+    if (ep->re_ctx.match_data == NULL)
     {
+        ep->re_ctx.match_data = pcre2_match_data_create_from_pattern(ep->regex, NULL);
+        if (ep->re_ctx.match_data == NULL)
+            return PCRE2_ERROR_NOMEMORY;
         ep->re_ctx.ovector = pcre2_get_ovector_pointer(ep->re_ctx.match_data);
     }
+    rc = pcre2_match(ep->regex, cbuf, exp->re_buf_data, ep->re_start, PCRE2_NOTBOL | PCRE2_PARTIAL_SOFT,
+                     ep->re_ctx.match_data, NULL);
+    if (rc == PCRE2_ERROR_PARTIAL)
+        ep->re_start = ep->re_ctx.ovector[0];
+    else if (rc == PCRE2_ERROR_NOMATCH)
+        ep->re_start = exp->re_buf_data;
 #  endif
 
     return rc;
-#else
-    return -1;
-#endif
 }
+#endif
 
 /* Get capture group's start and end offsets. */
 static SIM_INLINE void sim_capture_offsets(const EXPTAB *ep, size_t capture, int *start_offs, int *end_offs)
@@ -13066,14 +14518,15 @@ static SIM_INLINE void sim_capture_offsets(const EXPTAB *ep, size_t capture, int
 #endif
 }
 
-/* Cleanup after sim_execute_regex(). */
+/* Release the match context used by sim_execute_regex(). */
 static void sim_finish_re_match(EXPTAB *ep)
 {
 #if USE_REGEX
 #  if defined(HAVE_PCRE_H)
     free(ep->re_ctx.ovector);
 #  elif defined(HAVE_PCRE2_H)
-    pcre2_match_data_free(ep->re_ctx.match_data);
+    if (ep->re_ctx.match_data != NULL)
+        pcre2_match_data_free(ep->re_ctx.match_data);
     ep->re_ctx.match_data = NULL;
 #  endif
 
@@ -13091,6 +14544,179 @@ memset (exp, 0, sizeof(*exp));
 return SCPE_OK;
 }
 
+/* Literal expect rule matching.
+
+   The match strings of the literal (non RegEx) rules in an expect context
+   are compiled into a single Aho-Corasick automaton the first time the
+   context is checked after its rules change.  Each output byte then makes
+   one state transition, and the states which complete one or more match
+   strings identify the matching rules directly rather than comparing each
+   rule against the buffer as every byte arrives.  Adding or removing rules
+   discards the automaton and the next check builds a new one, replaying
+   the buffered data to recover the current state.
+*/
+
+struct EXPECT_MATCHER {
+    uint32              states;                         /* count of automaton states */
+    int32               (*next)[256];                   /* state transitions */
+    int32               *rule;                          /* first rule whose match string ends at the state, -1 if none */
+    int32               *out;                           /* nearest suffix state ending a match string, -1 if none */
+    };
+
+static void _sim_exp_matcher_free (EXPECT *exp)
+{
+EXPECT_MATCHER *m = exp->matcher;
+
+if (m == NULL)
+    return;
+free (m->next);
+free (m->rule);
+free (m->out);
+free (m);
+exp->matcher = NULL;
+exp->matcher_state = 0;
+}
+
+static int32 _sim_exp_matcher_new_state (EXPECT_MATCHER *m)
+{
+int32 s = (int32)m->states++;
+int c;
+
+for (c = 0; c < 256; c++)
+    m->next[s][c] = -1;
+m->rule[s] = m->out[s] = -1;
+return s;
+}
+
+static t_stat _sim_exp_matcher_build (EXPECT *exp)
+{
+EXPECT_MATCHER *m;
+size_t i, j, off, max_states = 1;
+int32 *fail, *queue;
+uint32 head = 0, tail = 0;
+int32 s;
+int c;
+
+_sim_exp_matcher_free (exp);
+for (i=0; i<exp->size; i++)
+    if (!(exp->rules[i].switches & EXP_TYP_REGEX))
+        max_states += exp->rules[i].size;
+m = (EXPECT_MATCHER *)calloc (1, sizeof (*m));
+fail = (int32 *)calloc (max_states, sizeof (*fail));
+queue = (int32 *)calloc (max_states, sizeof (*queue));
+if (m != NULL) {
+    m->next = (int32 (*)[256])malloc (max_states * sizeof (*m->next));
+    m->rule = (int32 *)malloc (max_states * sizeof (*m->rule));
+    m->out = (int32 *)malloc (max_states * sizeof (*m->out));
+    }
+if ((m == NULL) || (fail == NULL) || (queue == NULL) ||
+    (m->next == NULL) || (m->rule == NULL) || (m->out == NULL)) {
+    if (m != NULL) {
+        free (m->next);
+        free (m->rule);
+        free (m->out);
+        free (m);
+        }
+    free (fail);
+    free (queue);
+    return SCPE_MEM;
+    }
+_sim_exp_matcher_new_state (m);                         /* root */
+for (i=0; i<exp->size; i++) {                           /* build the trie of match strings */
+    EXPTAB *ep = &exp->rules[i];
+
+    if (ep->switches & EXP_TYP_REGEX)
+        continue;
+    s = 0;
+    for (j=0; j<ep->size; j++) {
+        if (m->next[s][ep->match[j]] < 0)
+            m->next[s][ep->match[j]] = _sim_exp_matcher_new_state (m);
+        s = m->next[s][ep->match[j]];
+        }
+    if (m->rule[s] < 0)                                 /* earlier rules take precedence */
+        m->rule[s] = (int32)i;
+    }
+for (c = 0; c < 256; c++) {                             /* root transitions */
+    int32 t = m->next[0][c];
+
+    if (t < 0)
+        m->next[0][c] = 0;
+    else {
+        fail[t] = 0;
+        m->out[t] = (m->rule[0] >= 0) ? 0 : -1;
+        queue[tail++] = t;
+        }
+    }
+while (head < tail) {                                   /* complete the transitions breadth first */
+    s = queue[head++];
+    for (c = 0; c < 256; c++) {
+        int32 t = m->next[s][c];
+
+        if (t < 0)
+            m->next[s][c] = m->next[fail[s]][c];
+        else {
+            int32 f = m->next[fail[s]][c];
+
+            fail[t] = f;
+            m->out[t] = (m->rule[f] >= 0) ? f : m->out[f];
+            queue[tail++] = t;
+            }
+        }
+    }
+free (fail);
+free (queue);
+exp->matcher = m;
+exp->matcher_state = 0;
+if (exp->buf_data > 0) {                                /* replay the buffered data */
+    off = (exp->buf_ins >= exp->buf_data) ? exp->buf_ins - exp->buf_data : exp->buf_size - (exp->buf_data - exp->buf_ins);
+    for (i=0; i<exp->buf_data; i++) {
+        exp->matcher_state = (uint32)m->next[exp->matcher_state][exp->buf[off]];
+        if (++off == exp->buf_size)
+            off = 0;
+        }
+    }
+sim_debug (exp->dbit, exp->dptr, "Compiled literal match rules into %u states\n", m->states);
+return SCPE_OK;
+}
+
+/* Return the first literal rule matched by the data seen so far, exp->size if none */
+
+static size_t _sim_exp_matcher_rule (EXPECT *exp)
+{
+EXPECT_MATCHER *m = exp->matcher;
+int32 s = (int32)exp->matcher_state;
+size_t found = exp->size;
+
+if (m->rule[s] < 0)
+    s = m->out[s];
+while (s >= 0) {
+    size_t r = (size_t)m->rule[s];
+
+    if ((r < found) &&
+        (exp->buf_data >= exp->rules[r].size))          /* all of the match still buffered? */
+        found = r;
+    s = m->out[s];
+    }
+return found;
+}
+
+/* Reload the RegEx match data from the buffer and restart RegEx matching */
+
+static void _sim_exp_re_reset (EXPECT *exp)
+{
+size_t i;
+
+exp->re_buf_data = 0;
+if (exp->re_buf == NULL)
+    return;
+for (i=0; i<exp->buf_ins; i++)
+    if (exp->buf[i] != '\0')
+        exp->re_buf[exp->re_buf_data++] = exp->buf[i];
+exp->re_buf[exp->re_buf_data] = '\0';
+for (i=0; i<exp->size; i++)
+    exp->rules[i].re_start = 0;
+}
+
 /* Set expect */
 
 t_stat sim_set_expect (EXPECT *exp, CONST char *cptr)
@@ -13179,8 +14805,11 @@ if (NULL == ep)                                         /* not there? ok */
 free (ep->match);                                       /* deallocate match string */
 free (ep->match_pattern);                               /* deallocate the display format match string */
 free (ep->act);                                         /* deallocate action */
-if (ep->switches & EXP_TYP_REGEX)
+if (ep->switches & EXP_TYP_REGEX) {
+    sim_finish_re_match(ep);                            /* release match context */
     sim_release_regex(ep->regex);                       /* release compiled regex */
+    }
+_sim_exp_matcher_free (exp);                            /* rule numbers are changing */
 exp->size -= 1;                                         /* decrement count */
 for (i=ep-exp->rules; i<exp->size; i++)                 /* shuffle up remaining rules */
     exp->rules[i] = exp->rules[i+1];
@@ -13212,16 +14841,22 @@ for (i=0; i<exp->size; i++) {
     free (exp->rules[i].match);                         /* deallocate match string */
     free (exp->rules[i].match_pattern);                 /* deallocate display format match string */
     free (exp->rules[i].act);                           /* deallocate action */
-    if (exp->rules[i].switches & EXP_TYP_REGEX)
+    if (exp->rules[i].switches & EXP_TYP_REGEX) {
+        sim_finish_re_match(&exp->rules[i]);            /* release match context */
         sim_release_regex(exp->rules[i].regex);             /* release compiled regex */
+        }
     }
 free (exp->rules);
 exp->rules = NULL;
 exp->size = 0;
+_sim_exp_matcher_free (exp);
 free (exp->buf);
 exp->buf = NULL;
+free (exp->re_buf);
+exp->re_buf = NULL;
 exp->buf_size = 0;
 exp->buf_data = exp->buf_ins = 0;
+exp->re_buf_data = 0;
 return SCPE_OK;
 }
 
@@ -13295,6 +14930,7 @@ exp->rules = (EXPTAB *) realloc(exp->rules, sizeof (exp->rules[0])*(exp->size +
 ep = &exp->rules[exp->size];
 exp->size += 1;
 memset (ep, 0, sizeof(*ep));
+_sim_exp_matcher_free (exp);                            /* recompiled on the next check */
 ep->after = after;                                      /* set halt after value */
 ep->match_pattern = strcpy (pattern_buf, match);
 ep->cnt = cnt;                                          /* set proceed count */
@@ -13334,6 +14970,7 @@ for (i=0; i<exp->size; i++) {
     size_t compare_size = (exp->rules[i].switches & EXP_TYP_REGEX) ? MAX(10 * strlen(ep->match_pattern), 1024) : exp->rules[i].size;
     if (compare_size >= exp->buf_size) {
         exp->buf = (uint8 *)realloc (exp->buf, compare_size + 2); /* Extra byte to null terminate regex compares */
+        exp->re_buf = (uint8 *)realloc (exp->re_buf, compare_size + 2);
         exp->buf_size = compare_size + 1;
         }
     }
@@ -13416,46 +15053,36 @@ return SCPE_OK;
 
 t_stat sim_exp_check (EXPECT *exp, uint8 data)
 {
-size_t i;
+size_t i, lit;
 EXPTAB *ep = NULL;
 int regex_checks = 0;
-sim_regex_bufp_t tstr = NULL;
 
 if ((!exp) || (!exp->rules))                            /* Anything to check? */
     return SCPE_OK;
 
+if ((exp->matcher == NULL) &&                           /* Rules changed? */
+    (_sim_exp_matcher_build (exp) != SCPE_OK))          /* Compile them */
+    return SCPE_MEM;
+
 exp->buf[exp->buf_ins++] = data;                        /* Save new data */
 exp->buf[exp->buf_ins] = '\0';                          /* Nul terminate for RegEx match */
 if (exp->buf_data < exp->buf_size)
     ++exp->buf_data;                                    /* Record amount of data in buffer */
+if (data != '\0') {                                     /* RegEx rules match data without NULs */
+    exp->re_buf[exp->re_buf_data++] = data;
+    exp->re_buf[exp->re_buf_data] = '\0';
+    }
+exp->matcher_state = (uint32)exp->matcher->next[exp->matcher_state][data];
+lit = _sim_exp_matcher_rule (exp);                      /* First matching literal rule */
 
-for (i=0; i < exp->size; i++) {
+for (i=0; i < lit; i++) {                               /* Check any earlier RegEx rules */
     ep = &exp->rules[i];
     if (ep->switches & EXP_TYP_REGEX) {
 #if USE_REGEX
         int rc;
-        sim_regex_matchp_t cbuf = (sim_regex_matchp_t) exp->buf;
+        sim_regex_matchp_t cbuf = (sim_regex_matchp_t) exp->re_buf;
         static size_t sim_exp_match_sub_count = 0;
 
-        if (NULL != tstr)
-            cbuf = tstr;
-        else {
-            if (strlen ((const char *) exp->buf) != exp->buf_ins) {
-                /* If there are NUL characters in exp->buf, eliminate them by successive
-                * concatenation into tstr. */
-                size_t exp_off, tstr_off;
-
-                tstr = (sim_regex_bufp_t) calloc (exp->buf_ins + 1, sizeof(char));
-                tstr_off = 0;
-                for (exp_off=0; exp_off < exp->buf_ins; /* empty */) {
-                    size_t to_copy = strlen ((char *) &exp->buf[exp_off]);
-                    memcpy(&tstr[tstr_off], &exp->buf[exp_off], to_copy);
-                    tstr_off += to_copy;
-                    exp_off += to_copy + 1;
-                    }
-                cbuf = tstr;
-                }
-            }
         ++regex_checks;
         if (sim_deb && exp->dptr && (exp->dptr->dctrl & exp->dbit)) {
             char *estr = sim_encode_quoted_string (exp->buf, exp->buf_ins);
@@ -13466,7 +15093,7 @@ for (i=0; i < exp->size; i++) {
         rc = sim_execute_regex(exp, ep, cbuf);
         if (rc >= 0) {
             size_t j;
-            char *buf = (char *)malloc (1 + exp->buf_ins);
+            char *buf = (char *)malloc (1 + exp->re_buf_data);
 
             for (j=0; j < (size_t) rc; j++) {
                 char env_name[48];
@@ -13495,62 +15122,20 @@ for (i=0; i < exp->size; i++) {
                 setenv (env_name, "", 1);      /* Remove previous extra environment variables */
                 }
             sim_exp_match_sub_count = ep->re_nsub;
-            sim_finish_re_match(ep);
             free (buf);
             break;
             }
 #endif
         }
-    else {
-        if (exp->buf_data < ep->size)                           /* Too little data to match yet? */
-            continue;                                           /* Yes, Try next one. */
-        if (exp->buf_ins < ep->size) {                          /* Match might straddle end of buffer */
-            /*
-             * First compare the newly deposited data at the beginning
-             * of buffer with the end of the match string
-             */
-            if (exp->buf_ins > 0) {
-                if (sim_deb && exp->dptr && (exp->dptr->dctrl & exp->dbit)) {
-                    char *estr = sim_encode_quoted_string (exp->buf, exp->buf_ins);
-                    char *mstr = sim_encode_quoted_string (&ep->match[ep->size-exp->buf_ins], exp->buf_ins);
-
-                    sim_debug (exp->dbit, exp->dptr, "Checking String[0:%" SIZE_T_FMT "d]: %s\n", exp->buf_ins, estr);
-                    sim_debug (exp->dbit, exp->dptr, "Against Match Data: %s\n", mstr);
-                    free (estr);
-                    free (mstr);
-                    }
-                if (memcmp (exp->buf, &ep->match[ep->size-exp->buf_ins], exp->buf_ins)) /* Tail Match? */
-                    continue;                                   /* Nope, Try next one. */
-                }
-            if (sim_deb && exp->dptr && (exp->dptr->dctrl & exp->dbit)) {
-                char *estr = sim_encode_quoted_string (&exp->buf[exp->buf_size-(ep->size-exp->buf_ins)], ep->size-exp->buf_ins);
-                char *mstr = sim_encode_quoted_string (ep->match, ep->size-exp->buf_ins);
-
-                sim_debug (exp->dbit, exp->dptr, "Checking String[%" SIZE_T_FMT "d:%" SIZE_T_FMT "d]: %s\n",
-                           exp->buf_size - ep->size - exp->buf_ins, ep->size-exp->buf_ins, estr);
-                sim_debug (exp->dbit, exp->dptr, "Against Match Data: %s\n", mstr);
-                free (estr);
-                free (mstr);
-                }
-            if (memcmp (&exp->buf[exp->buf_size-(ep->size-exp->buf_ins)], ep->match, ep->size-exp->buf_ins)) /* Front Match? */
-                continue;                                       /* Nope, Try next one. */
-            break;
-            }
-        else {
-            if (sim_deb && exp->dptr && (exp->dptr->dctrl & exp->dbit)) {
-                char *estr = sim_encode_quoted_string (&exp->buf[exp->buf_ins-ep->size], ep->size);
-                char *mstr = sim_encode_quoted_string (ep->match, ep->size);
-
-                sim_debug (exp->dbit, exp->dptr, "Checking String[%" SIZE_T_FMT "u:%" SIZE_T_FMT "u]: %s\n",
-                          exp->buf_ins - ep->size, ep->size, estr);
-                sim_debug (exp->dbit, exp->dptr, "Against Match Data: %s\n", mstr);
-                free (estr);
-                free (mstr);
-                }
-            if (memcmp (&exp->buf[exp->buf_ins-ep->size], ep->match, ep->size)) /* Whole string match? */
-                continue;                                       /* Nope, Try next one. */
-            break;
-            }
+    }
+if (i < exp->size) {                                    /* Found? */
+    ep = &exp->rules[i];
+    if (!(ep->switches & EXP_TYP_REGEX) &&
+        sim_deb && exp->dptr && (exp->dptr->dctrl & exp->dbit)) {
+        char *estr = sim_encode_quoted_string (ep->match, ep->size);
+
+        sim_debug (exp->dbit, exp->dptr, "Matched Data: %s\n", estr);
+        free (estr);
         }
     }
 if (exp->buf_ins == exp->buf_size) {                    /* At end of match buffer? */
@@ -13563,11 +15148,13 @@ if (exp->buf_ins == exp->buf_size) {                    /* At end of match buffe
         memmove (exp->buf, &exp->buf[exp->buf_size/2], exp->buf_size-(exp->buf_size/2));
         exp->buf_ins -= exp->buf_size/2;
         exp->buf_data = exp->buf_ins;
+        _sim_exp_re_reset (exp);
         sim_debug (exp->dbit, exp->dptr, "Buffer Full - sliding the last %" SIZE_T_FMT "d bytes to start of buffer new insert at: %" SIZE_T_FMT "d\n",
                   exp->buf_size / 2, exp->buf_ins);
         }
     else {
         exp->buf_ins = 0;                               /* wrap around to beginning */
+        _sim_exp_re_reset (exp);
         sim_debug (exp->dbit, exp->dptr, "Buffer wrapping\n");
         }
     }
@@ -13603,8 +15190,9 @@ if (i != exp->size) {                                   /* Found? */
         }
     /* Matched data is no longer available for future matching */
     exp->buf_data = exp->buf_ins = 0;
+    exp->matcher_state = 0;
+    _sim_exp_re_reset (exp);
     }
-free (tstr);
 return SCPE_OK;
 }
 
@@ -13809,7 +15397,7 @@ static void _sim_debug_write_flush (const char *buf, size_t len, t_bool flush)
 {
 char *eol;
 
-if (sim_deb_switches & SWMASK ('F')) {              /* filtering disabled? */
+if (sim_deb_switches & (SWMASK ('F') | SWMASK ('Z'))) {/* filtering disabled or done by the decoder? */
     if (len > 0)
         _debug_fwrite (buf, len);                   /* output now. */
     return;                                         /* done */
@@ -13966,50 +15554,78 @@ while (dptr->debflags[offset].name && (offset < 32)) {
 return some_match ? some_match : debtab_nomatch;
 }
 
-/* Prints standard debug prefix unless previous call unterminated */
+/* Collect the time of day a debug prefix displays, if any */
 
-static const char *sim_debug_prefix (uint32 dbits, DEVICE* dptr, UNIT* uptr)
+static t_bool _sim_debug_prefix_time (struct timespec *time_now)
+{
+if (!(sim_deb_switches & (SWMASK ('T') | SWMASK ('R') | SWMASK ('A'))))
+    return FALSE;
+sim_rtcn_get_time(time_now, 0);
+if (sim_deb_switches & SWMASK ('R'))
+    sim_timespec_diff (time_now, time_now, &sim_deb_basetime);
+return TRUE;
+}
+
+/* Collect the PC value a debug prefix displays, if any */
+
+static t_bool _sim_debug_prefix_pc (t_value *val)
+{
+if (!(sim_deb_switches & SWMASK ('P')))
+    return FALSE;
+/* Some simulators expose the PC as a register, some don't expose it or expose a register
+   which is not a variable which is updated during instruction execution (i.e. only upon
+   exit of sim_instr()).  For the -P debug option to be effective, such a simulator should
+   provide a routine which returns the value of the current PC and set the sim_vm_pc_value
+   routine pointer to that routine.
+ */
+if (sim_vm_pc_value)
+    *val = (*sim_vm_pc_value)();
+else
+    *val = get_rval (sim_PC, 0);
+return TRUE;
+}
+
+/* Formats the standard debug prefix from previously collected values */
+
+static const char *_sim_debug_prefix_format (const struct timespec *time_now, double gtime, const t_value *pc,
+                                             t_bool main_thread, const char *dev_name, const char *debug_type)
 {
-const char* debug_type = _get_dbg_verb (dbits, dptr, uptr);
 char tim_t[32] = "";
 char tim_a[32] = "";
 char pc_s[MAX_WIDTH + 1] = "";
-struct timespec time_now;
 
-if (sim_deb_switches & (SWMASK ('T') | SWMASK ('R') | SWMASK ('A'))) {
-    sim_rtcn_get_time(&time_now, 0);
-    if (sim_deb_switches & SWMASK ('R'))
-        sim_timespec_diff (&time_now, &time_now, &sim_deb_basetime);
+if (time_now) {
     if (sim_deb_switches & SWMASK ('T')) {
-        time_t tnow = (time_t)time_now.tv_sec;
+        time_t tnow = (time_t)time_now->tv_sec;
         struct tm *now = localtime(&tnow);
 
-        sprintf(tim_t, "%02d:%02d:%02d.%03d ", now->tm_hour, now->tm_min, now->tm_sec, (int)(time_now.tv_nsec/1000000));
+        sprintf(tim_t, "%02d:%02d:%02d.%03d ", now->tm_hour, now->tm_min, now->tm_sec, (int)(time_now->tv_nsec/1000000));
         }
     if (sim_deb_switches & SWMASK ('A')) {
-        sprintf(tim_t, "%" LL_FMT "d.%03d ", (LL_TYPE)(time_now.tv_sec), (int)(time_now.tv_nsec/1000000));
+        sprintf(tim_t, "%" LL_FMT "d.%03d ", (LL_TYPE)(time_now->tv_sec), (int)(time_now->tv_nsec/1000000));
         }
     }
-if (sim_deb_switches & SWMASK ('P')) {
-    t_value val;
-
-    /* Some simulators expose the PC as a register, some don't expose it or expose a register
-       which is not a variable which is updated during instruction execution (i.e. only upon
-       exit of sim_instr()).  For the -P debug option to be effective, such a simulator should
-       provide a routine which returns the value of the current PC and set the sim_vm_pc_value
-       routine pointer to that routine.
-     */
-    if (sim_vm_pc_value)
-        val = (*sim_vm_pc_value)();
-    else
-        val = get_rval (sim_PC, 0);
+if (pc) {
     sprintf(pc_s, "-%s:", sim_PC->name);
-    sprint_val (&pc_s[strlen(pc_s)], val, sim_PC->radix, sim_PC->width, sim_PC->flags & REG_FMT);
+    sprint_val (&pc_s[strlen(pc_s)], *pc, sim_PC->radix, sim_PC->width, sim_PC->flags & REG_FMT);
     }
-sprintf(debug_line_prefix, "DBG(%s%s%.0f%s)%s> %s %s: ", tim_t, tim_a, sim_gtime(), pc_s, AIO_MAIN_THREAD ? "" : "+", dptr->name, debug_type);
+sprintf(debug_line_prefix, "DBG(%s%s%.0f%s)%s> %s %s: ", tim_t, tim_a, gtime, pc_s, main_thread ? "" : "+", dev_name, debug_type);
 return debug_line_prefix;
 }
 
+/* Prints standard debug prefix unless previous call unterminated */
+
+static const char *sim_debug_prefix (uint32 dbits, DEVICE* dptr, UNIT* uptr)
+{
+struct timespec time_now;
+t_value pc;
+t_bool have_time = _sim_debug_prefix_time (&time_now);
+t_bool have_pc = _sim_debug_prefix_pc (&pc);
+
+return _sim_debug_prefix_format (have_time ? &time_now : NULL, sim_gtime(), have_pc ? &pc : NULL,
+                                 AIO_MAIN_THREAD, dptr->name, _get_dbg_verb (dbits, dptr, uptr));
+}
+
 void fprint_fields (FILE *stream, t_value before, t_value after, BITFIELD* bitdefs)
 {
 int32 i, fields, offset;
@@ -14072,6 +15688,8 @@ if (sim_deb && dptr && (dptr->dctrl & dbits)) {
     if (terminate)
         fprintf(sim_deb, "\r\n");
     debug_unterm = terminate ? 0 : 1;                                   /* set unterm for next */
+    if (sim_deb_switches & SWMASK ('Z'))                                /* binary trace? */
+        _sim_debug_record_unterm ();                                    /*   tell the decoder */
     sim_oline = saved_oline;                                            /* restore original socket */
     }
 }
@@ -14249,6 +15867,46 @@ return stat | ((stat != SCPE_OK) ? SCPE_NOMESSAGE : 0);
    Callers should be calling sim_debug() which is a macro
    defined in scp.h which evaluates the action condition before
    incurring call overhead. */
+
+/* Output formatted debug text expanding newlines where they exist */
+
+static void _sim_debug_emit (const char *debug_prefix, const char *buf, int32 len)
+{
+int32 i, j;
+
+for (i = j = 0; i < len; ++i) {
+    if ('\n' == buf[i]) {
+        if (i >= j) {
+            if ((i != j) || (i == 0)) {
+                if (!debug_unterm)                      /* print prefix when required */
+                    _sim_debug_write (debug_prefix, strlen (debug_prefix));
+                _sim_debug_write (&buf[j], i-j);
+                _sim_debug_write ("\r\n", 2);
+                }
+            debug_unterm = 0;
+            }
+        j = i + 1;
+        }
+    else {
+        if (buf[i] == 0) {      /* Imbedded \0 character in formatted result? */
+            fprintf (stderr, "sim_debug() formatted result: '%s'\r\n"
+                             "            has an imbedded \\0 character.\r\n"
+                             "DON'T DO THAT!\r\n", buf);
+            abort();
+            }
+        }
+    }
+if (i > j) {
+    if (!debug_unterm)                              /* print prefix when required */
+        _sim_debug_write (debug_prefix, strlen (debug_prefix));
+    _sim_debug_write (&buf[j], i-j);
+    }
+
+/* Set unterminated flag for next time */
+
+debug_unterm = len ? (((buf[len-1]=='\n')) ? 0 : 1) : debug_unterm;
+}
+
 void _sim_vdebug (uint32 dbits, DEVICE* dptr, UNIT *uptr, const char* fmt, va_list arglist)
 {
 if (sim_deb && dptr && ((dptr->dctrl | (uptr ? uptr->dctrl : 0)) & dbits)) {
@@ -14256,9 +15914,14 @@ if (sim_deb && dptr && ((dptr->dctrl | (uptr ? uptr->dctrl : 0)) & dbits)) {
     char stackbuf[STACKBUFSIZE];
     int32 bufsize = sizeof(stackbuf);
     char *buf = stackbuf;
-    int32 i, j, len;
-    const char* debug_prefix = sim_debug_prefix(dbits, dptr, uptr);   /* prefix to print if required */
+    int32 len;
+    const char* debug_prefix;
 
+    if (sim_deb_switches & SWMASK ('Z')) {              /* binary trace? */
+        _sim_debug_record (dbits, dptr, uptr, fmt, arglist);
+        return;
+        }
+    debug_prefix = sim_debug_prefix(dbits, dptr, uptr); /* prefix to print if required */
     sim_oline = NULL;                                   /* avoid potential debug to active socket */
     buf[bufsize-1] = '\0';
 
@@ -14286,43 +15949,823 @@ if (sim_deb && dptr && ((dptr->dctrl | (uptr ? uptr->dctrl : 0)) & dbits)) {
         break;
         }
 
-/* Output the formatted data expanding newlines where they exist */
+    _sim_debug_emit (debug_prefix, buf, len);           /* output the formatted data */
+    if (buf != stackbuf)
+        free (buf);
+    sim_oline = saved_oline;                            /* restore original socket */
+    }
+}
+
+/* Binary debug trace
 
-    for (i = j = 0; i < len; ++i) {
-        if ('\n' == buf[i]) {
-            if (i >= j) {
-                if ((i != j) || (i == 0)) {
-                    if (!debug_unterm)                  /* print prefix when required */
-                        _sim_debug_write (debug_prefix, strlen (debug_prefix));
-                    _sim_debug_write (&buf[j], i-j);
-                    _sim_debug_write ("\r\n", 2);
-                    }
-                debug_unterm = 0;
-                }
-            j = i + 1;
+   When debug output is enabled with the -Z switch, sim_debug calls do not
+   format their text.  Instead, a record containing a format string id, the
+   values the debug prefix would display and the raw argument values is
+   written to the debug file.  Format strings are remembered in a small
+   per-thread cache, which holds a copy of each string's text along with the
+   argument types derived from it.  A cache entry is only used for a format
+   string with the same address and the same text, so a format built in a
+   buffer which is later reused for a different format gets a new entry.
+   The cache entry's address is the format's id.  The format's text is
+   written (as a definition of that id) ahead of the first record which uses
+   it, and again whenever the entry is reused for a different format.
+   Recording an event then costs little more than copying its arguments.
+
+   Formats whose output ends with a conversion, rather than with literal
+   text, are recorded as pre-formatted text, since whether such a message
+   terminates its line depends on its arguments.  Records are written to the debug
+   stream with a single fwrite, which keeps them intact and in order relative
+   to the other text written to the debug file.
+
+   Each record starts with a NUL byte (which never appears in debug text), a
+   record type and a 32 bit payload length.  Anything else in the file is
+   text which was written directly to the debug file and is reproduced as is.
+
+   SHOW DEBUG DECODE <file> renders such a file, producing exactly the output
+   the same debug session would have written in text mode.
+ */
+
+#define DEBUG_BIN_HEADER        'H'         /* header: platform and debug switches */
+#define DEBUG_BIN_FORMAT        'F'         /* format string definition */
+#define DEBUG_BIN_MESSAGE       'M'         /* debug message */
+#define DEBUG_BIN_UNTERM        'U'         /* unterminated line state */
+#define DEBUG_BIN_MAGIC         "SIMHDBGB"
+#define DEBUG_BIN_VERSION       1
+#define DEBUG_BIN_HDRSIZE       6           /* NUL, type and payload length */
+
+#define DEBUG_BIN_F_MAIN        0x01        /* message from the main thread */
+#define DEBUG_BIN_F_TIME        0x02        /* time of day present */
+#define DEBUG_BIN_F_PC          0x04        /* PC value present */
+
+#define DEBUG_BIN_CACHE_SIZE    256         /* format strings remembered per thread */
+#define DEBUG_BIN_MAX_ARGS      32          /* arguments per format string */
+#define DEBUG_BIN_TEXT          '!'         /* record pre-formatted text */
+
+static uint32 debug_bin_generation = 0;     /* incremented for each binary trace started */
+
+static AIO_TLS struct debug_bin_fmt {
+    const char  *fmt;
+    char        *text;                      /* copy of the format string */
+    size_t      size;                       /* text buffer size */
+    uint32      generation;
+    t_bool      unterm;                     /* output doesn't end with a newline */
+    char        types[DEBUG_BIN_MAX_ARGS + 1];
+    } debug_bin_fmts[DEBUG_BIN_CACHE_SIZE];
+
+typedef struct {
+    uint8       *buf;
+    size_t      size;
+    size_t      len;
+    uint8       stackbuf[STACKBUFSIZE];
+    } DEBUG_BIN_REC;
+
+static void _debug_bin_init (DEBUG_BIN_REC *rec, char type)
+{
+rec->buf = rec->stackbuf;
+rec->size = sizeof (rec->stackbuf);
+rec->buf[0] = 0;
+rec->buf[1] = (uint8)type;
+rec->len = DEBUG_BIN_HDRSIZE;
+}
+
+static void _debug_bin_put (DEBUG_BIN_REC *rec, const void *data, size_t len)
+{
+if (rec->len + len > rec->size) {
+    size_t size = 2 * (rec->len + len);
+    uint8 *buf = (uint8 *)malloc (size);
+
+    if (buf == NULL)
+        return;
+    memcpy (buf, rec->buf, rec->len);
+    if (rec->buf != rec->stackbuf)
+        free (rec->buf);
+    rec->buf = buf;
+    rec->size = size;
+    }
+memcpy (rec->buf + rec->len, data, len);
+rec->len += len;
+}
+
+static void _debug_bin_put_string (DEBUG_BIN_REC *rec, const char *str)
+{
+_debug_bin_put (rec, str, strlen (str) + 1);
+}
+
+static void _debug_bin_write (DEBUG_BIN_REC *rec)
+{
+uint32 payload = (uint32)(rec->len - DEBUG_BIN_HDRSIZE);
+
+memcpy (rec->buf + 2, &payload, sizeof (payload));
+_debug_fwrite_all ((char *)rec->buf, rec->len, sim_deb);
+if (rec->buf != rec->stackbuf)
+    free (rec->buf);
+}
+
+/* Parse the conversion specification following a '%'.  The argument
+   class of the conversion is returned in *type ('\0' for "%%",
+   DEBUG_BIN_TEXT for conversions which can't be recorded) along with the
+   number of '*' width/precision arguments which precede it.  The return
+   value points just past the conversion. */
+
+static const char *_sim_debug_fmt_conversion (const char *fmt, char *type, int *stars)
+{
+char size = 0;
+
+*stars = 0;
+while (*fmt && strchr ("-+ #0'", *fmt))             /* flags */
+    ++fmt;
+if (*fmt == '*') {                                  /* width */
+    ++*stars;
+    ++fmt;
+    }
+else
+    while (sim_isdigit (*fmt))
+        ++fmt;
+if (*fmt == '.') {                                  /* precision */
+    ++fmt;
+    if (*fmt == '*') {
+        ++*stars;
+        ++fmt;
+        }
+    else
+        while (sim_isdigit (*fmt))
+            ++fmt;
+    }
+switch (*fmt) {                                     /* length modifier */
+    case 'h':
+        fmt += (fmt[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        size = (fmt[1] == 'l') ? 'q' : 'l';
+        fmt += (fmt[1] == 'l') ? 2 : 1;
+        break;
+    case 'q':
+    case 'L':
+    case 'z':
+    case 't':
+    case 'j':
+        size = *fmt++;
+        break;
+    case 'I':
+        if ((fmt[1] == '6') && (fmt[2] == '4')) {
+            size = 'q';
+            fmt += 3;
             }
+        else if ((fmt[1] == '3') && (fmt[2] == '2'))
+            fmt += 3;
         else {
-            if (buf[i] == 0) {      /* Imbedded \0 character in formatted result? */
-                fprintf (stderr, "sim_debug() formatted result: '%s'\r\n"
-                                 "            has an imbedded \\0 character.\r\n"
-                                 "DON'T DO THAT!\r\n", buf);
-                abort();
+            size = 'z';
+            ++fmt;
+            }
+        break;
+    default:
+        break;
+    }
+switch (*fmt) {
+    case '%':
+        *type = '\0';
+        break;
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        *type = (size == 'L') ? 'q' : ((size == 0) ? 'i' : size);
+        break;
+    case 'c':
+        *type = (size == 0) ? 'i' : DEBUG_BIN_TEXT;
+        break;
+    case 's':
+        *type = (size == 0) ? 's' : DEBUG_BIN_TEXT;
+        break;
+    case 'p':
+    case 'n':
+        *type = 'p';
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        *type = (size == 'L') ? 'D' : 'd';
+        break;
+    default:
+        *type = DEBUG_BIN_TEXT;
+        break;
+    }
+if ((*type == 'j') || (*type == 't'))               /* not portably available */
+    *type = DEBUG_BIN_TEXT;
+return (*fmt) ? fmt + 1 : fmt;
+}
+
+/* Determine the argument types a format string consumes.  Formats which
+   can't be recorded, or whose output ends with a conversion, yield a
+   single DEBUG_BIN_TEXT type. */
+
+static void _sim_debug_fmt_types (const char *fmt, char *types)
+{
+size_t n = 0;
+char type;
+int stars;
+
+while ((fmt = strchr (fmt, '%'))) {
+    fmt = _sim_debug_fmt_conversion (fmt + 1, &type, &stars);
+    if ((type == DEBUG_BIN_TEXT) || (n + stars + 1 > DEBUG_BIN_MAX_ARGS) ||
+        (type && (*fmt == '\0'))) {
+        n = 0;
+        types[n++] = DEBUG_BIN_TEXT;
+        break;
+        }
+    while (stars-- > 0)
+        types[n++] = 'i';
+    if (type)
+        types[n++] = type;
+    }
+types[n] = '\0';
+}
+
+/* Sizes of the recorded data types, which the decoding host must match */
+
+static void _sim_debug_type_sizes (uint8 sizes[8])
+{
+sizes[0] = (uint8)sizeof (void *);
+sizes[1] = (uint8)sizeof (int);
+sizes[2] = (uint8)sizeof (long);
+sizes[3] = (uint8)sizeof (LL_TYPE);
+sizes[4] = (uint8)sizeof (size_t);
+sizes[5] = (uint8)sizeof (double);
+sizes[6] = (uint8)sizeof (long double);
+sizes[7] = (uint8)sizeof (t_value);
+}
+
+/* Start a binary trace in the current debug file */
+
+void sim_debug_binary_start (void)
+{
+DEBUG_BIN_REC rec;
+uint8 sizes[8];
+uint32 version = DEBUG_BIN_VERSION;
+uint32 endian = 0x01020304;
+int32 switches = sim_deb_switches;
+
+++debug_bin_generation;
+_sim_debug_type_sizes (sizes);
+_debug_bin_init (&rec, DEBUG_BIN_HEADER);
+_debug_bin_put (&rec, DEBUG_BIN_MAGIC, 8);
+_debug_bin_put (&rec, &version, sizeof (version));
+_debug_bin_put (&rec, &endian, sizeof (endian));
+_debug_bin_put (&rec, sizes, sizeof (sizes));
+_debug_bin_put (&rec, &switches, sizeof (switches));
+_debug_bin_put_string (&rec, sim_name);
+_debug_bin_write (&rec);
+}
+
+/* Record the unterminated line state after text written directly to the debug file */
+
+static void _sim_debug_record_unterm (void)
+{
+DEBUG_BIN_REC rec;
+uint8 unterm = (uint8)debug_unterm;
+
+_debug_bin_init (&rec, DEBUG_BIN_UNTERM);
+_debug_bin_put (&rec, &unterm, sizeof (unterm));
+_debug_bin_write (&rec);
+}
+
+static void _sim_debug_record (uint32 dbits, DEVICE* dptr, UNIT *uptr, const char* fmt, va_list arglist)
+{
+struct debug_bin_fmt *cache = &debug_bin_fmts[(((size_t)fmt) >> 2) % DEBUG_BIN_CACHE_SIZE];
+DEBUG_BIN_REC rec;
+t_uint64 id = (t_uint64)((size_t)cache);
+double gtime = sim_gtime ();
+struct timespec time_now;
+t_value pc;
+uint8 flags = AIO_MAIN_THREAD ? DEBUG_BIN_F_MAIN : 0;
+const char *types;
+
+if ((cache->fmt != fmt) || (cache->generation != debug_bin_generation) ||
+    (strcmp (cache->text, fmt) != 0)) {
+    size_t len = strlen (fmt);
+
+    if (len + 1 > cache->size) {
+        char *text = (char *)realloc (cache->text, len + 1);
+
+        if (text == NULL) {
+            cache->fmt = NULL;
+            return;
+            }
+        cache->text = text;
+        cache->size = len + 1;
+        }
+    strcpy (cache->text, fmt);
+    _sim_debug_fmt_types (fmt, cache->types);
+    cache->fmt = fmt;
+    cache->generation = debug_bin_generation;
+    cache->unterm = (len > 0) && (fmt[len - 1] != '\n');
+    if (cache->types[0] != DEBUG_BIN_TEXT) {        /* define the format string */
+        _debug_bin_init (&rec, DEBUG_BIN_FORMAT);
+        _debug_bin_put (&rec, &id, sizeof (id));
+        _debug_bin_put_string (&rec, fmt);
+        _debug_bin_write (&rec);
+        }
+    }
+types = cache->types;
+if (_sim_debug_prefix_time (&time_now))
+    flags |= DEBUG_BIN_F_TIME;
+if (_sim_debug_prefix_pc (&pc))
+    flags |= DEBUG_BIN_F_PC;
+_debug_bin_init (&rec, DEBUG_BIN_MESSAGE);
+if (*types == DEBUG_BIN_TEXT)
+    id = 0;                                         /* text follows */
+_debug_bin_put (&rec, &id, sizeof (id));
+_debug_bin_put (&rec, &gtime, sizeof (gtime));
+_debug_bin_put (&rec, &flags, sizeof (flags));
+if (flags & DEBUG_BIN_F_TIME) {
+    t_int64 sec = (t_int64)time_now.tv_sec;
+    int32 nsec = (int32)time_now.tv_nsec;
+
+    _debug_bin_put (&rec, &sec, sizeof (sec));
+    _debug_bin_put (&rec, &nsec, sizeof (nsec));
+    }
+if (flags & DEBUG_BIN_F_PC)
+    _debug_bin_put (&rec, &pc, sizeof (pc));
+_debug_bin_put_string (&rec, dptr->name);
+_debug_bin_put_string (&rec, _get_dbg_verb (dbits, dptr, uptr));
+if (*types == DEBUG_BIN_TEXT) {                     /* format now */
+    char buf[STACKBUFSIZE];
+    int len;
+
+#if defined(NO_vsnprintf)
+    len = vsprintf (buf, fmt, arglist);
+#else                                               /* !defined(NO_vsnprintf) */
+    len = vsnprintf (buf, sizeof (buf), fmt, arglist);
+#endif                                              /* NO_vsnprintf */
+    buf[sizeof (buf) - 1] = '\0';
+    _debug_bin_put_string (&rec, buf);
+    len = (int)strlen (buf);
+    if (len > 0)                                    /* as _sim_debug_emit */
+        debug_unterm = (buf[len - 1] != '\n');
+    }
+else {
+    for (; *types; ++types) {
+        switch (*types) {
+            case 'i': {
+                int v = va_arg (arglist, int);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 'l': {
+                long v = va_arg (arglist, long);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 'q': {
+                LL_TYPE v = va_arg (arglist, LL_TYPE);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 'z': {
+                size_t v = va_arg (arglist, size_t);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 'd': {
+                double v = va_arg (arglist, double);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 'D': {
+                long double v = va_arg (arglist, long double);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 'p': {
+                void *v = va_arg (arglist, void *);
+                _debug_bin_put (&rec, &v, sizeof (v));
+                }
+                break;
+            case 's': {
+                const char *v = va_arg (arglist, const char *);
+                uint32 len = v ? (uint32)strlen (v) : 0xFFFFFFFF;
+
+                _debug_bin_put (&rec, &len, sizeof (len));
+                if (v)
+                    _debug_bin_put (&rec, v, len);
+                }
+                break;
+            }
+        }
+    if (cache->text[0])                             /* output not empty? */
+        debug_unterm = cache->unterm;
+    }
+_debug_bin_write (&rec);
+}
+
+/* Binary trace decoding */
+
+typedef struct {
+    t_uint64    id;
+    char        *fmt;
+    } DEBUG_BIN_DEF;
+
+typedef struct {
+    const uint8 *data;
+    size_t      len;
+    size_t      offset;
+    t_bool      error;
+    } DEBUG_BIN_READER;
+
+static void _debug_bin_get (DEBUG_BIN_READER *rd, void *val, size_t len)
+{
+if (rd->error || (rd->offset + len > rd->len)) {
+    rd->error = TRUE;
+    memset (val, 0, len);
+    return;
+    }
+memcpy (val, rd->data + rd->offset, len);
+rd->offset += len;
+}
+
+static const char *_debug_bin_get_string (DEBUG_BIN_READER *rd)
+{
+const char *s = (const char *)rd->data + rd->offset;
+const char *nul = rd->error ? NULL : (const char *)memchr (s, 0, rd->len - rd->offset);
+
+if (nul == NULL) {
+    rd->error = TRUE;
+    return "";
+    }
+rd->offset += (nul - s) + 1;
+return s;
+}
+
+static void _debug_bin_append (char **out, size_t *size, size_t *len, const char *fmt, ...)
+{
+va_list arglist;
+int n;
+
+while (1) {
+    va_start (arglist, fmt);
+#if defined(NO_vsnprintf)
+    n = vsprintf (*out + *len, fmt, arglist);
+#else                                               /* !defined(NO_vsnprintf) */
+    n = vsnprintf (*out + *len, *size - *len, fmt, arglist);
+#endif                                              /* NO_vsnprintf */
+    va_end (arglist);
+    if ((n >= 0) && ((size_t)n < *size - *len))
+        break;
+    if ((n < 0) && (*size > 1024 * 1024))           /* not a buffer size problem? */
+        return;
+    *size = 2 * (*size + ((n > 0) ? n : 0));
+    *out = (char *)realloc (*out, *size);
+    }
+*len += n;
+}
+
+/* Render a message record's text into *out, returning its length */
+
+static size_t _debug_bin_format (DEBUG_BIN_READER *rd, const char *fmt, char **out, size_t *size)
+{
+size_t len = 0;
+char spec[64];
+int star[2];
+
+**out = '\0';
+while (*fmt && !rd->error) {
+    const char *pct = strchr (fmt, '%');
+    const char *end;
+    char type;
+    int stars, i;
+
+    if (pct == NULL)
+        pct = fmt + strlen (fmt);
+    if (pct != fmt)
+        _debug_bin_append (out, size, &len, "%.*s", (int)(pct - fmt), fmt);
+    if (*pct == '\0')
+        break;
+    end = _sim_debug_fmt_conversion (pct + 1, &type, &stars);
+    if ((size_t)(end - pct) >= sizeof (spec)) {
+        rd->error = TRUE;
+        break;
+        }
+    memcpy (spec, pct, end - pct);
+    spec[end - pct] = '\0';
+    fmt = end;
+    if (type == '\0') {
+        _debug_bin_append (out, size, &len, "%%");
+        continue;
+        }
+    for (i = 0; i < stars; i++)
+        _debug_bin_get (rd, &star[i], sizeof (star[i]));
+    if (rd->error)
+        break;
+#define DEBUG_BIN_ARG(_type)                                                    \
+    if (1) {                                                                    \
+        _type _v;                                                               \
+                                                                                \
+        _debug_bin_get (rd, &_v, sizeof (_v));                                  \
+        if (rd->error)                                                          \
+            break;                                                              \
+        if (stars == 0)                                                         \
+            _debug_bin_append (out, size, &len, spec, _v);                      \
+        else if (stars == 1)                                                    \
+            _debug_bin_append (out, size, &len, spec, star[0], _v);             \
+        else                                                                    \
+            _debug_bin_append (out, size, &len, spec, star[0], star[1], _v);    \
+        }                                                                       \
+    else (void)0
+    switch (type) {
+        case 'i':
+            DEBUG_BIN_ARG(int);
+            break;
+        case 'l':
+            DEBUG_BIN_ARG(long);
+            break;
+        case 'q':
+            DEBUG_BIN_ARG(LL_TYPE);
+            break;
+        case 'z':
+            DEBUG_BIN_ARG(size_t);
+            break;
+        case 'd':
+            DEBUG_BIN_ARG(double);
+            break;
+        case 'D':
+            DEBUG_BIN_ARG(long double);
+            break;
+        case 'p':
+            if (spec[strlen (spec) - 1] == 'n') {   /* %n produces no output */
+                void *v;
+
+                _debug_bin_get (rd, &v, sizeof (v));
                 }
+            else
+                DEBUG_BIN_ARG(void *);
+            break;
+        case 's':
+            if (1) {
+                uint32 slen;
+                char *str = NULL;
+
+                _debug_bin_get (rd, &slen, sizeof (slen));
+                if (rd->error)
+                    break;
+                if (slen != 0xFFFFFFFF) {           /* not a NULL pointer? */
+                    str = (char *)malloc (slen + 1);
+                    _debug_bin_get (rd, str, slen);
+                    str[slen] = '\0';
+                    }
+                if (!rd->error) {
+                    if (stars == 0)
+                        _debug_bin_append (out, size, &len, spec, str);
+                    else if (stars == 1)
+                        _debug_bin_append (out, size, &len, spec, star[0], str);
+                    else
+                        _debug_bin_append (out, size, &len, spec, star[0], star[1], str);
+                    }
+                free (str);
+                }
+            break;
+        default:
+            rd->error = TRUE;
+            break;
+        }
+#undef DEBUG_BIN_ARG
+    }
+return len;
+}
+
+/* Format string definitions, hashed by their recorded id */
+
+typedef struct {
+    DEBUG_BIN_DEF   *defs;
+    size_t          size;                   /* power of 2 */
+    size_t          count;
+    } DEBUG_BIN_DEFS;
+
+static DEBUG_BIN_DEF *_debug_bin_def_find (DEBUG_BIN_DEFS *d, t_uint64 id, t_bool add)
+{
+size_t i;
+
+if (add && (2 * (d->count + 1) > d->size)) {        /* grow when half full */
+    DEBUG_BIN_DEFS n;
+
+    n.size = d->size ? 2 * d->size : 256;
+    n.count = 0;
+    n.defs = (DEBUG_BIN_DEF *)calloc (n.size, sizeof (*n.defs));
+    if (n.defs == NULL)
+        return NULL;
+    for (i = 0; i < d->size; i++)
+        if (d->defs[i].fmt)
+            *_debug_bin_def_find (&n, d->defs[i].id, TRUE) = d->defs[i];
+    free (d->defs);
+    *d = n;
+    }
+if (d->size == 0)
+    return NULL;
+for (i = (size_t)((id >> 2) & (d->size - 1)); d->defs[i].fmt; i = (i + 1) & (d->size - 1))
+    if (d->defs[i].id == id)
+        return &d->defs[i];
+if (!add)
+    return NULL;
+d->defs[i].id = id;
+++d->count;
+return &d->defs[i];
+}
+
+static void _debug_bin_defs_free (DEBUG_BIN_DEFS *d)
+{
+size_t i;
+
+for (i = 0; i < d->size; i++)
+    free (d->defs[i].fmt);
+free (d->defs);
+memset (d, 0, sizeof (*d));
+}
+
+/* Decode a binary debug trace to the specified stream */
+
+t_stat sim_debug_decode (FILE *st, const char *filename)
+{
+FILE *f;
+FILE *saved_deb = sim_deb;
+char *saved_deb_buffer = sim_deb_buffer;
+int32 saved_deb_switches = sim_deb_switches;
+int32 saved_unterm = debug_unterm;
+DEBUG_BIN_DEFS defs;
+uint8 *payload = NULL;
+size_t payload_size = 0;
+size_t text_size = 256;
+char *text = (char *)malloc (text_size);
+t_bool have_header = FALSE;
+t_stat r = SCPE_OK;
+int c;
+
+f = sim_fopen (filename, "rb");
+if (f == NULL) {
+    free (text);
+    return sim_messagef (SCPE_OPENERR, "Can't open binary debug trace '%s': %s\n", filename, strerror (errno));
+    }
+if (sim_deb)
+    _sim_debug_write_flush ("", 0, TRUE);           /* flush pending live output */
+sim_deb = st;
+sim_deb_buffer = NULL;
+sim_deb_switches = 0;
+debug_unterm = 0;
+memset (&defs, 0, sizeof (defs));
+while ((r == SCPE_OK) && ((c = fgetc (f)) != EOF)) {
+    uint8 type;
+    uint32 len;
+    DEBUG_BIN_READER rd;
+
+    if (c != 0) {                                   /* text written directly */
+        char tbuf[256];
+        size_t tlen = 0;
+
+        if (!have_header) {
+            r = sim_messagef (SCPE_FMT, "'%s' is not a binary debug trace\n", filename);
+            break;
             }
+        do {                                        /* the rest of this text */
+            tbuf[tlen++] = (char)c;
+            } while ((tlen < sizeof (tbuf)) && ((c = fgetc (f)) != EOF) && (c != 0));
+        if (c == 0)
+            ungetc (c, f);
+        _sim_debug_write (tbuf, tlen);              /* filtered along with the messages */
+        continue;
         }
-    if (i > j) {
-        if (!debug_unterm)                          /* print prefix when required */
-            _sim_debug_write (debug_prefix, strlen (debug_prefix));
-        _sim_debug_write (&buf[j], i-j);
+    if ((fread (&type, 1, sizeof (type), f) != sizeof (type)) ||
+        (fread (&len, 1, sizeof (len), f) != sizeof (len))) {
+        r = sim_messagef (SCPE_FMT, "Truncated record in binary debug trace '%s'\n", filename);
+        break;
         }
+    if (len > payload_size) {
+        payload_size = len;
+        payload = (uint8 *)realloc (payload, payload_size);
+        }
+    if (fread (payload, 1, len, f) != len) {
+        r = sim_messagef (SCPE_FMT, "Truncated record in binary debug trace '%s'\n", filename);
+        break;
+        }
+    rd.data = payload;
+    rd.len = len;
+    rd.offset = 0;
+    rd.error = FALSE;
+    if ((!have_header) && (type != DEBUG_BIN_HEADER)) {
+        r = sim_messagef (SCPE_FMT, "'%s' is not a binary debug trace\n", filename);
+        break;
+        }
+    switch (type) {
+        case DEBUG_BIN_HEADER:
+            if (1) {
+                char magic[8];
+                uint32 version, endian;
+                uint8 sizes[8], rsizes[8];
+                int32 switches;
+                const char *name;
+
+                _debug_bin_get (&rd, magic, sizeof (magic));
+                _debug_bin_get (&rd, &version, sizeof (version));
+                _debug_bin_get (&rd, &endian, sizeof (endian));
+                _debug_bin_get (&rd, rsizes, sizeof (rsizes));
+                _debug_bin_get (&rd, &switches, sizeof (switches));
+                name = _debug_bin_get_string (&rd);
+                _sim_debug_type_sizes (sizes);
+                if (rd.error || (memcmp (magic, DEBUG_BIN_MAGIC, sizeof (magic)) != 0) || (version != DEBUG_BIN_VERSION))
+                    r = sim_messagef (SCPE_FMT, "'%s' is not a binary debug trace\n", filename);
+                else if ((endian != 0x01020304) || (memcmp (rsizes, sizes, sizeof (sizes)) != 0))
+                    r = sim_messagef (SCPE_FMT, "Binary debug trace '%s' was recorded on a different host platform\n", filename);
+                else if ((switches & SWMASK ('P')) && (strcmp (name, sim_name) != 0))
+                    r = sim_messagef (SCPE_FMT, "Binary debug trace '%s' was recorded by the %s simulator\n", filename, name);
+                sim_deb_switches = switches & ~SWMASK ('Z');
+                _debug_bin_defs_free (&defs);       /* format ids start over */
+                have_header = TRUE;
+                }
+            break;
+        case DEBUG_BIN_FORMAT:
+            if (1) {
+                t_uint64 id;
+                const char *fmt;
+                DEBUG_BIN_DEF *def;
 
-/* Set unterminated flag for next time */
+                _debug_bin_get (&rd, &id, sizeof (id));
+                fmt = _debug_bin_get_string (&rd);
+                if (rd.error || (id == 0))
+                    break;
+                def = _debug_bin_def_find (&defs, id, TRUE);
+                if (def == NULL) {
+                    r = SCPE_MEM;
+                    break;
+                    }
+                free (def->fmt);
+                def->fmt = strdup (fmt);
+                }
+            break;
+        case DEBUG_BIN_MESSAGE:
+            if (1) {
+                t_uint64 id;
+                double gtime;
+                uint8 flags;
+                struct timespec time_now;
+                t_value pc = 0;
+                const char *dev_name, *debug_type, *prefix;
+                size_t text_len = 0;
+
+                memset (&time_now, 0, sizeof (time_now));
+                _debug_bin_get (&rd, &id, sizeof (id));
+                _debug_bin_get (&rd, &gtime, sizeof (gtime));
+                _debug_bin_get (&rd, &flags, sizeof (flags));
+                if (flags & DEBUG_BIN_F_TIME) {
+                    t_int64 sec;
+                    int32 nsec;
+
+                    _debug_bin_get (&rd, &sec, sizeof (sec));
+                    _debug_bin_get (&rd, &nsec, sizeof (nsec));
+                    time_now.tv_sec = (time_t)sec;
+                    time_now.tv_nsec = nsec;
+                    }
+                if (flags & DEBUG_BIN_F_PC)
+                    _debug_bin_get (&rd, &pc, sizeof (pc));
+                dev_name = _debug_bin_get_string (&rd);
+                debug_type = _debug_bin_get_string (&rd);
+                if (rd.error)
+                    break;
+                if (id == 0)                        /* pre-formatted text */
+                    _debug_bin_append (&text, &text_size, &text_len, "%s", _debug_bin_get_string (&rd));
+                else {
+                    DEBUG_BIN_DEF *def = _debug_bin_def_find (&defs, id, FALSE);
 
-    debug_unterm = len ? (((buf[len-1]=='\n')) ? 0 : 1) : debug_unterm;
-    if (buf != stackbuf)
-        free (buf);
-    sim_oline = saved_oline;                            /* restore original socket */
+                    if (def == NULL) {
+                        rd.error = TRUE;
+                        break;
+                        }
+                    text_len = _debug_bin_format (&rd, def->fmt, &text, &text_size);
+                    }
+                if (rd.error)
+                    break;
+                prefix = _sim_debug_prefix_format ((flags & DEBUG_BIN_F_TIME) ? &time_now : NULL, gtime,
+                                                   (flags & DEBUG_BIN_F_PC) ? &pc : NULL,
+                                                   (flags & DEBUG_BIN_F_MAIN) != 0, dev_name, debug_type);
+                _sim_debug_emit (prefix, text, (int32)text_len);
+                }
+            break;
+        case DEBUG_BIN_UNTERM:
+            if (1) {
+                uint8 unterm;
+
+                _debug_bin_get (&rd, &unterm, sizeof (unterm));
+                debug_unterm = unterm;
+                }
+            break;
+        default:
+            rd.error = TRUE;
+            break;
+        }
+    if ((r == SCPE_OK) && rd.error)
+        r = sim_messagef (SCPE_FMT, "Invalid record in binary debug trace '%s'\n", filename);
     }
+_sim_debug_write_flush ("", 0, TRUE);
+fclose (f);
+_debug_bin_defs_free (&defs);
+free (payload);
+free (text);
+sim_deb = saved_deb;
+sim_deb_buffer = saved_deb_buffer;
+sim_deb_switches = saved_deb_switches;
+debug_unterm = saved_unterm;
+return r;
 }
 
 void _sim_debug_unit (uint32 dbits, UNIT *uptr, const char* fmt, ...)
@@ -16658,6 +19101,299 @@ sim_set_deb_switches (start_deb_switches);
 return r;
 }
 
+/* Event queue engine test: the same schedule must produce the same
+   event order and times with each engine, including when the engine
+   is changed while events are pending */
+
+#define QTEST_MAX 64
+
+static struct {
+    UNIT *uptr;
+    double time;
+    } qtest_fired[QTEST_MAX];
+static int32 qtest_count;
+
+static t_stat sim_scp_queue_svc (UNIT *uptr)
+{
+if (qtest_count < QTEST_MAX) {
+    qtest_fired[qtest_count].uptr = uptr;
+    qtest_fired[qtest_count].time = sim_gtime ();
+    }
+++qtest_count;
+if (uptr->u3 > 0) {                                 /* reschedule? */
+    --uptr->u3;
+    sim_activate (uptr, uptr->u4);
+    }
+return SCPE_OK;
+}
+
+static t_stat test_scp_queue_run (uint32 engine, uint32 switch_engine)
+{
+DEVICE *dptr = &sim_scp_dev;
+UNIT *units = dptr->units;
+uint32 i;
+int32 steps;
+
+while (sim_clock_queue != QUEUE_LIST_END)
+    sim_cancel (sim_clock_queue);
+sim_time = sim_rtime = 0;
+noqueue_time = sim_interval = 0;
+qtest_count = 0;
+_sim_queue_set_engine (engine);
+for (i = 0; i < dptr->numunits; i++) {
+    units[i].action = sim_scp_queue_svc;
+    units[i].u3 = units[i].u4 = 0;
+    }
+units[0].u3 = 2;                                    /* fires 3 times, 5 apart */
+units[0].u4 = 5;
+sim_activate (&units[0], 10);
+sim_activate (&units[1], 10);                       /* ties with unit 0 */
+sim_activate (&units[2], 3);
+sim_activate (&units[3], 0);
+sim_cancel (&units[2]);
+sim_activate (&units[2], 12);
+units[3].u3 = 1;                                    /* refires at unit 0's time */
+units[3].u4 = 10;
+sim_activate_abs (&units[1], 15);                   /* reschedule behind unit 0 */
+if (_sim_activate_queue_time (&units[2]) != 13)
+    return sim_messagef (SCPE_IERR, "%s queue time for %s: %d expected 13\n",
+                         sim_queue_engine_name (), sim_uname (&units[2]), _sim_activate_queue_time (&units[2]));
+if (switch_engine != engine)
+    _sim_queue_set_engine (switch_engine);
+for (steps = 0; (sim_clock_queue != QUEUE_LIST_END) && (steps < 1000); steps++) {
+    sim_interval -= 3;                              /* overshoot to exercise catchup */
+    if (sim_interval <= 0)
+        sim_process_event ();
+    }
+if (sim_clock_queue != QUEUE_LIST_END)
+    return sim_messagef (SCPE_IERR, "%s event queue failed to drain\n", sim_queue_engine_name ());
+return SCPE_OK;
+}
+
+static t_stat test_scp_event_queue_engines (void)
+{
+static const uint32 runs[][2] = {
+    {SIM_QUEUE_HEAP, SIM_QUEUE_HEAP},
+    {SIM_QUEUE_LIST, SIM_QUEUE_HEAP},
+    {SIM_QUEUE_HEAP, SIM_QUEUE_LIST}};
+uint32 saved_engine = sim_queue_engine;
+UNIT *expected[QTEST_MAX];
+double expected_time[QTEST_MAX];
+int32 expected_count, i;
+uint32 r;
+t_stat stat = SCPE_OK;
+
+if (sim_switches & SWMASK ('T'))
+    sim_messagef (SCPE_OK, "test_scp_event_queue_engines - starting\n");
+stat = test_scp_queue_run (SIM_QUEUE_LIST, SIM_QUEUE_LIST);
+expected_count = qtest_count;
+for (i = 0; (i < expected_count) && (i < QTEST_MAX); i++) {
+    expected[i] = qtest_fired[i].uptr;
+    expected_time[i] = qtest_fired[i].time;
+    }
+if ((stat == SCPE_OK) && (expected_count != 7))
+    stat = sim_messagef (SCPE_IERR, "LIST engine fired %d events, expected 7\n", expected_count);
+for (r = 0; (stat == SCPE_OK) && (r < sizeof (runs) / sizeof (runs[0])); r++) {
+    stat = test_scp_queue_run (runs[r][0], runs[r][1]);
+    if (stat != SCPE_OK)
+        break;
+    if (qtest_count != expected_count)
+        stat = sim_messagef (SCPE_IERR, "%s->%s engine fired %d events, expected %d\n",
+                             sim_queue_engine_names[runs[r][0]], sim_queue_engine_names[runs[r][1]],
+                             qtest_count, expected_count);
+    for (i = 0; (stat == SCPE_OK) && (i < expected_count); i++) {
+        if ((qtest_fired[i].uptr != expected[i]) ||
+            (qtest_fired[i].time != expected_time[i]))
+            stat = sim_messagef (SCPE_IERR, "%s->%s engine event %d: %s at %.0f, expected %s at %.0f\n",
+                                 sim_queue_engine_names[runs[r][0]], sim_queue_engine_names[runs[r][1]], i,
+                                 sim_uname (qtest_fired[i].uptr), qtest_fired[i].time,
+                                 sim_uname (expected[i]), expected_time[i]);
+        }
+    }
+_sim_queue_set_engine (saved_engine);
+if (sim_switches & SWMASK ('T'))
+    sim_messagef (SCPE_OK, "test_scp_event_queue_engines - done\n");
+return stat;
+}
+
+static t_stat test_scp_save_compression (void)
+{
+static const char *patterns[] = {"zeros", "words", "text", "noise"};
+uint8 in[SRBSIZ * sizeof (t_value)], out[sizeof (in)], exp[sizeof (in)];
+size_t clen, i;
+uint32 p, seed = 1;
+
+if (sim_switches & SWMASK ('T'))
+    sim_messagef (SCPE_OK, "test_scp_save_compression - starting\n");
+for (p = 0; p < sizeof (patterns) / sizeof (patterns[0]); p++) {
+    for (i = 0; i < sizeof (in); i++) {
+        seed = seed * 1103515245 + 12345;
+        switch (p) {
+            case 0:
+                in[i] = 0;
+                break;
+            case 1:
+                in[i] = (i & 3) ? 0 : (uint8)(i >> 6);
+                break;
+            case 2:
+                in[i] = (uint8)"The quick brown fox jumps over the lazy dog. "[(i + (i >> 9)) % 45];
+                break;
+            default:
+                in[i] = (uint8)(seed >> 16);
+                break;
+            }
+        }
+    clen = sim_lz_compress (in, sizeof (in), out, sizeof (in) - 1);
+    if (p == 3) {                                       /* noise doesn't compress */
+        if (clen != 0)
+            return sim_messagef (SCPE_IERR, "%s compressed to %d bytes\n", patterns[p], (int)clen);
+        continue;
+        }
+    if ((clen == 0) || (clen >= sizeof (in) / 4))
+        return sim_messagef (SCPE_IERR, "%s compressed to %d bytes\n", patterns[p], (int)clen);
+    if ((sim_lz_expand (out, clen, exp, sizeof (exp)) != sizeof (in)) ||
+        (memcmp (in, exp, sizeof (in)) != 0))
+        return sim_messagef (SCPE_IERR, "%s didn't expand to its original contents\n", patterns[p]);
+    if (sim_lz_expand (out, clen - 1, exp, sizeof (exp)) == sizeof (in))
+        return sim_messagef (SCPE_IERR, "truncated %s expanded to a full block\n", patterns[p]);
+    if (sim_lz_expand (out, clen, exp, sizeof (exp) - 1) != 0)
+        return sim_messagef (SCPE_IERR, "%s overran a short output buffer\n", patterns[p]);
+    }
+if (sim_switches & SWMASK ('T'))
+    sim_messagef (SCPE_OK, "test_scp_save_compression - done\n");
+return SCPE_OK;
+}
+
+/* Write the same debug messages in text mode and as a binary trace, and
+   check that decoding the binary trace reproduces the text exactly.  The
+   messages include formats whose output ends with an argument and a
+   format buffer which is reused for a different format. */
+
+static void test_scp_debug_messages (void)
+{
+static BITFIELD bits[] = {
+    BIT(LOW),
+    BITF(MID,3),
+    BIT(HIGH),
+    ENDBITS
+    };
+char fmt[32];
+char *dyn;
+
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "Literal message\n");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "%s", "Argument ends the line\n");
+sim_debug_bits_hdr (SCP_LOG_TESTING, &sim_scp_dev, "Bits", bits, 0x05, 0x13, 0);
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, " after bits%s", "\n");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "%s", "Argument doesn't end the line");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "%s", "");
+fmt[0] = '\0';                                      /* empty format */
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, fmt);
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, " value=%d%c", 42, '\n');
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "Partial %d ", 1);
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "%d%%", 100);
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "\n");
+strcpy (fmt, "Reused buffer %s\n");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, fmt, "string");
+strcpy (fmt, "Reused buffer %d\n");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, fmt, 12345);
+dyn = (char *)malloc (32);
+strcpy (dyn, "Freed format %s %d\n");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, dyn, "a", 1);
+free (dyn);
+dyn = (char *)malloc (32);
+strcpy (dyn, "Freed format %d %s\n");
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, dyn, 2, "b");
+free (dyn);
+_sim_debug_device (SCP_LOG_TESTING, &sim_scp_dev, "%08X %s %.*s|\n", 0xBEEF, "x", 3, "abcdef");
+}
+
+static t_stat test_scp_debug_capture (const char *filename, int32 switches)
+{
+FILE *saved_sim_deb = sim_deb;
+char *saved_deb_buffer = sim_deb_buffer;
+int32 saved_deb_switches = sim_deb_switches;
+int32 saved_unterm = debug_unterm;
+FILE *f = sim_fopen (filename, "wb");
+
+if (f == NULL)
+    return sim_messagef (SCPE_OPENERR, "Can't create %s: %s\n", filename, strerror (errno));
+sim_deb = f;
+sim_deb_buffer = NULL;
+sim_deb_switches = switches;
+debug_unterm = 0;
+if (switches & SWMASK ('Z'))
+    sim_debug_binary_start ();
+test_scp_debug_messages ();
+_sim_debug_write_flush ("", 0, TRUE);
+fclose (f);
+sim_deb = saved_sim_deb;
+sim_deb_buffer = saved_deb_buffer;
+sim_deb_switches = saved_deb_switches;
+debug_unterm = saved_unterm;
+return SCPE_OK;
+}
+
+static char *test_scp_debug_read (const char *filename, size_t *size)
+{
+FILE *f = sim_fopen (filename, "rb");
+char *buf;
+
+*size = 0;
+if (f == NULL)
+    return NULL;
+*size = (size_t)sim_fsize_ex (f);
+buf = (char *)malloc (*size + 1);
+if ((buf != NULL) && (fread (buf, 1, *size, f) != *size)) {
+    free (buf);
+    buf = NULL;
+    }
+fclose (f);
+return buf;
+}
+
+static t_stat test_scp_debug_binary (void)
+{
+const char *text_file = "TestDebug.txt";
+const char *bin_file = "TestDebug.bin";
+const char *decoded_file = "TestDebug.dec";
+int32 saved_unterm = debug_unterm;
+size_t text_size, decoded_size;
+char *text = NULL, *decoded = NULL;
+FILE *f;
+t_stat r;
+
+r = test_scp_debug_capture (text_file, 0);
+if (r == SCPE_OK)
+    r = test_scp_debug_capture (bin_file, SWMASK ('Z'));
+if ((r == SCPE_OK) && ((f = sim_fopen (decoded_file, "wb")))) {
+    r = sim_debug_decode (f, bin_file);
+    fclose (f);
+    }
+debug_unterm = saved_unterm;
+if (r == SCPE_OK) {
+    text = (char *)test_scp_debug_read (text_file, &text_size);
+    decoded = (char *)test_scp_debug_read (decoded_file, &decoded_size);
+    if ((text == NULL) || (decoded == NULL) || (text_size == 0))
+        r = sim_messagef (SCPE_IERR, "Binary debug trace test output missing\n");
+    else if ((text_size != decoded_size) || (memcmp (text, decoded, text_size) != 0)) {
+        size_t i;
+
+        for (i = 0; (i < text_size) && (i < decoded_size) && (text[i] == decoded[i]); i++)
+            ;
+        r = sim_messagef (SCPE_IERR, "Decoded binary debug trace differs from text output at offset %u\n", (unsigned)i);
+        }
+    }
+free (text);
+free (decoded);
+if (r == SCPE_OK) {
+    (void)remove (text_file);
+    (void)remove (bin_file);
+    (void)remove (decoded_file);
+    sim_printf ("Binary debug trace round trip successful.\n");
+    }
+return r;
+}
+
 static t_stat test_scp_debug_logging()
 {
 uint32 saved_scp_dev_dbits = sim_scp_dev.dctrl;
@@ -16685,6 +19421,151 @@ sim_scp_dev.dctrl = saved_scp_dev_dbits;
 
 sim_printf ("Log de-duplication successful.\n");
 
+return test_scp_debug_binary ();
+}
+
+/* Feed data to an expect context one byte at a time.  The rule whose
+   match pattern is expected (or none when expected is NULL) must match
+   on the last byte, and nothing may match before it. */
+
+static t_stat test_scp_expect_feed (EXPECT *exp, const char *data, size_t len, const char *expected)
+{
+size_t i;
+
+for (i = 0; i < len; i++) {
+    const char *matched;
+
+    setenv ("_EXPECT_MATCH_PATTERN", "", 1);
+    sim_exp_check (exp, (uint8)data[i]);
+    matched = getenv ("_EXPECT_MATCH_PATTERN");
+    if ((matched != NULL) && (*matched != '\0')) {
+        sim_cancel (&sim_expect_unit);
+        if ((i != len - 1) || (expected == NULL) || (strcmp (matched, expected) != 0))
+            return sim_messagef (SCPE_IERR, "Expect rule %s matched at byte %u, expected %s at byte %u\n",
+                                 matched, (unsigned)i, expected ? expected : "no match", (unsigned)(len - 1));
+        return SCPE_OK;
+        }
+    }
+if (expected != NULL)
+    return sim_messagef (SCPE_IERR, "Expect rule %s didn't match\n", expected);
+return SCPE_OK;
+}
+
+#define TEST_EXP_FEED(data, expected)                                       \
+    if (test_scp_expect_feed (&exp, data, sizeof (data) - 1, expected) != SCPE_OK) \
+        ++errors;                                                           \
+    else (void)0
+
+#define TEST_EXP_SET(match, switches)                                       \
+    if (sim_exp_set (&exp, match, 0, 0, switches, NULL) != SCPE_OK)         \
+        ++errors;                                                           \
+    else (void)0
+
+static t_stat test_scp_expect (void)
+{
+EXPECT exp;
+int errors = 0;
+
+sim_exp_init (&exp);
+exp.dptr = &sim_scp_dev;
+exp.dbit = SCP_LOG_TESTING;
+
+/* Overlapping literal rules: the earliest rule wins when several match */
+TEST_EXP_SET ("\"ABCD\"", EXP_TYP_PERSIST);
+TEST_EXP_SET ("\"BC\"", EXP_TYP_PERSIST);
+TEST_EXP_SET ("\"C\"", EXP_TYP_PERSIST);
+TEST_EXP_FEED ("xABC", "\"BC\"");
+TEST_EXP_FEED ("C", "\"C\"");
+TEST_EXP_SET ("\"YZ\"", EXP_TYP_PERSIST);
+TEST_EXP_SET ("\"XYZ\"", EXP_TYP_PERSIST);
+TEST_EXP_FEED ("XYZ", "\"YZ\"");                  /* YZ is the earlier rule */
+sim_exp_clr (&exp, "\"YZ\"");
+TEST_EXP_FEED ("XYZ", "\"XYZ\"");
+sim_exp_clrall (&exp);
+
+/* A one shot rule is removed once it matches */
+TEST_EXP_SET ("\"ONCE\"", 0);
+TEST_EXP_SET ("\"CE\"", EXP_TYP_PERSIST);
+TEST_EXP_FEED ("ONCE", "\"ONCE\"");
+TEST_EXP_FEED ("ONCE", "\"CE\"");
+sim_exp_clrall (&exp);
+
+/* A match which straddles the wrap of the literal match buffer */
+TEST_EXP_SET ("\"ABCDEFGH\"", EXP_TYP_PERSIST);
+TEST_EXP_FEED ("0123456ABCDEFGH", "\"ABCDEFGH\"");
+TEST_EXP_FEED ("ABCDEFG-ABCDEFG", NULL);
+
+/* Rules added and deleted while data is buffered */
+TEST_EXP_FEED ("012ABCD", NULL);                    /* wraps the buffer */
+TEST_EXP_SET ("\"CDEF\"", EXP_TYP_PERSIST);
+TEST_EXP_FEED ("EF", "\"CDEF\"");
+TEST_EXP_FEED ("ABCD", NULL);
+sim_exp_clr (&exp, "\"CDEF\"");
+TEST_EXP_FEED ("EFGH", "\"ABCDEFGH\"");
+TEST_EXP_FEED ("HEL", NULL);
+TEST_EXP_SET ("\"HELLO\"", EXP_TYP_PERSIST);
+TEST_EXP_SET ("\"LLO\"", EXP_TYP_PERSIST);
+TEST_EXP_FEED ("LO", "\"HELLO\"");
+TEST_EXP_FEED ("HEL", NULL);
+sim_exp_clr (&exp, "\"HELLO\"");
+TEST_EXP_FEED ("LO", "\"LLO\"");
+sim_exp_clrall (&exp);
+
+#if USE_REGEX
+if (1) {
+    static const char *groups[] = {"v=12.34\n", "12", "34"};
+    static const char data[] = "junk\0v=1\0" "2.\0" "3" "4\n";
+    char env_name[32];
+    char filler[1] = {'x'};
+    size_t i;
+
+    /* A RegEx with capture groups, fed one byte at a time with NULs in the data */
+    TEST_EXP_SET ("\"v=([0-9]+)\\.([0-9]+)\\n\"", EXP_TYP_REGEX|EXP_TYP_PERSIST);
+    TEST_EXP_FEED (data, "\"v=([0-9]+)\\.([0-9]+)\\n\"");
+    for (i = 0; i < sizeof (groups) / sizeof (groups[0]); i++) {
+        const char *value;
+
+        sprintf (env_name, "_EXPECT_MATCH_GROUP_%d", (int)i);
+        value = getenv (env_name);
+        if ((value == NULL) || (strcmp (value, groups[i]) != 0)) {
+            sim_printf ("%s is '%s', expected '%s'\n", env_name, value ? value : "", groups[i]);
+            ++errors;
+            }
+        }
+
+    /* A RegEx match which straddles the point where the buffer slides down */
+    for (i = 0; i < exp.buf_size - 3; i++)
+        if (test_scp_expect_feed (&exp, filler, 1, NULL) != SCPE_OK)
+            ++errors;
+    TEST_EXP_FEED ("v=5.6\n", "\"v=([0-9]+)\\.([0-9]+)\\n\"");
+
+    /* RegEx and literal rule precedence */
+    TEST_EXP_SET ("\"b+c\"", EXP_TYP_REGEX|EXP_TYP_PERSIST);
+    TEST_EXP_SET ("\"bc\"", EXP_TYP_PERSIST);
+    TEST_EXP_FEED ("abc", "\"b+c\"");
+    sim_exp_clr (&exp, "\"b+c\"");
+    TEST_EXP_SET ("\"b+c\"", EXP_TYP_REGEX|EXP_TYP_PERSIST);
+    TEST_EXP_FEED ("abc", "\"bc\"");
+
+    /* A RegEx rule deleted and added again while data is buffered */
+    TEST_EXP_FEED ("v=7", NULL);
+    sim_exp_clr (&exp, "\"v=([0-9]+)\\.([0-9]+)\\n\"");
+    TEST_EXP_SET ("\"v=([0-9]+)\\.([0-9]+)\\n\"", EXP_TYP_REGEX|EXP_TYP_PERSIST);
+    TEST_EXP_FEED (".8\n", "\"v=([0-9]+)\\.([0-9]+)\\n\"");
+    if ((getenv ("_EXPECT_MATCH_GROUP_1") == NULL) || (strcmp (getenv ("_EXPECT_MATCH_GROUP_1"), "7") != 0)) {
+        sim_printf ("_EXPECT_MATCH_GROUP_1 is '%s', expected '7'\n", getenv ("_EXPECT_MATCH_GROUP_1") ? getenv ("_EXPECT_MATCH_GROUP_1") : "");
+        ++errors;
+        }
+    TEST_EXP_FEED ("v=9", NULL);
+    sim_exp_clr (&exp, "\"v=([0-9]+)\\.([0-9]+)\\n\"");
+    TEST_EXP_FEED (".1\n", NULL);
+    sim_exp_clrall (&exp);
+    }
+#endif
+setenv ("_EXPECT_MATCH_PATTERN", "", 1);
+if (errors)
+    return sim_messagef (SCPE_IERR, "%d expect rule matching errors\n", errors);
+sim_printf ("Expect rule matching successful.\n");
 return SCPE_OK;
 }
 
@@ -16732,8 +19613,16 @@ if ((strcmp (gbuf, "ALL") == 0) || (strcmp (gbuf, "SCP") == 0)) {
         return sim_messagef (SCPE_IERR, "SCP argument parsing test failed\n");
     if (test_scp_event_sequencing () != SCPE_OK)
         return sim_messagef (SCPE_IERR, "SCP event sequencing test failed\n");
+    if (test_scp_event_queue_engines () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP event queue engine test failed\n");
+    if (test_scp_save_compression () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP save compression test failed\n");
     if (test_scp_debug_logging () != SCPE_OK)
         return sim_messagef (SCPE_IERR, "SCP debug logging test failed\n");
+    if (test_scp_expect () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP expect rule matching test failed\n");
+    if (vid_test () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "Video library test failed\n");
 }
 for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {
     t_stat tstat = SCPE_OK;
@@ -117,6 +117,8 @@ t_stat echo_cmd (int32 flag, CONST char *ptr);
 t_stat echof_cmd (int32 flag, CONST char *ptr);
 t_stat debug_cmd (int32 flag, CONST char *ptr);
 t_stat runlimit_cmd (int32 flag, CONST char *ptr);
+t_stat benchmark_cmd (int32 flag, CONST char *ptr);
+t_stat profile_cmd (int32 flag, CONST char *ptr);
 t_stat tar_cmd (int32 flag, CONST char *ptr);
 t_stat curl_cmd (int32 flag, CONST char *ptr);
 t_stat test_lib_cmd (int32 flag, CONST char *ptr);
@@ -152,6 +154,8 @@ t_stat sim_run_boot_prep (int32 flag);
 double sim_gtime (void);
 uint32 sim_grtime (void);
 int32 sim_qcount (void);
+UNIT **sim_clock_queue_snapshot (int32 *count);
+const char *sim_queue_engine_name (void);
 t_stat attach_unit (UNIT *uptr, CONST char *cptr);
 t_stat detach_unit (UNIT *uptr);
 t_stat assign_device (DEVICE *dptr, const char *cptr);
@@ -185,6 +189,9 @@ CONST char *get_range (DEVICE *dptr, CONST char *cptr, t_addr *lo, t_addr *hi,
 t_stat sim_set_environment (int32 flag, CONST char *cptr);
 t_stat sim_decode_quoted_string (const char *iptr, uint8 *optr, uint32 *osize);
 char *sim_encode_quoted_string (const uint8 *iptr, size_t size);
+size_t sim_lz_compress (const uint8 *in, size_t ilen, uint8 *out, size_t olen);
+size_t sim_lz_expand (const uint8 *in, size_t ilen, uint8 *out, size_t olen);
+t_uint64 sim_digest (const uint8 *p, size_t len);
 void fprint_buffer_string (FILE *st, const uint8 *buf, size_t size);
 t_value strtotv (CONST char *cptr, CONST char **endptr, uint32 radix);
 t_svalue strtotsv (CONST char *inptr, CONST char **endptr, uint32 radix);
@@ -257,6 +264,8 @@ void sim_debug_bits_hdr (uint32 dbits, DEVICE* dptr, const char *header,
     BITFIELD* bitdefs, uint32 before, uint32 after, int terminate);
 void sim_debug_bits (uint32 dbits, DEVICE* dptr, BITFIELD* bitdefs,
     uint32 before, uint32 after, int terminate);
+void sim_debug_binary_start (void);
+t_stat sim_debug_decode (FILE *st, const char *filename);
 #if defined (__DECC) && defined (__VMS) && (defined (__VAX) || (__DECC_VER < 60590001))
 #define CANT_USE_MACRO_VA_ARGS 1
 #endif
@@ -329,6 +338,7 @@ extern volatile t_bool stop_cpu;
 extern uint32 sim_brk_types;                            /* breakpoint info */
 extern uint32 sim_brk_dflt;
 extern uint32 sim_brk_summ;
+extern uint32 sim_brk_page_summ[];                      /* per page breakpoint types */
 extern uint32 sim_brk_match_type;
 extern t_addr sim_brk_match_addr;
 extern BRKTYPTAB *sim_brk_type_desc;                    /* type descriptions */
@@ -340,6 +350,30 @@ int sim_aio_update_queue (void);
 void sim_aio_activate (ACTIVATE_API caller, UNIT *uptr, int32 event_time);
 #endif
 
+/* Per page breakpoint summary.  Each entry is the bitwise OR of the types
+   of the breakpoints whose addresses hash to it, so a simulator can skip
+   sim_brk_test when SIM_BRK_PAGE is zero for an address. */
+
+#define SIM_BRK_PAGE_BITS   8                           /* log2 addresses per page */
+#define SIM_BRK_PAGE_SUMM   4096                        /* summary entries */
+#define SIM_BRK_PAGE_IDX(loc) ((uint32)((((t_addr)(loc)) >> SIM_BRK_PAGE_BITS) ^         \
+                                        (((t_addr)(loc)) >> (SIM_BRK_PAGE_BITS + 12))) &  \
+                               (SIM_BRK_PAGE_SUMM - 1))
+#define SIM_BRK_PAGE(loc, btyp) (sim_brk_page_summ[SIM_BRK_PAGE_IDX (loc)] & ((btyp) | BRK_TYP_DYN_ALL))
+
+/* Sampling profiler.  A simulator that supports the PROFILE command sets
+   sim_vm_prof_contexts and invokes SIM_PROF_SAMPLE once per instruction
+   with the instruction's PC and its context (an index into
+   sim_vm_prof_contexts). */
+
+extern int32 sim_prof_count;
+void sim_prof_sample (t_addr pc, uint32 ctx);
+#define SIM_PROF_SAMPLE(pc, ctx)                                        \
+    do {                                                                \
+        if ((sim_prof_count != 0) && (--sim_prof_count == 0))           \
+            sim_prof_sample ((t_addr)(pc), (uint32)(ctx));              \
+        } while (0)
+
 /* VM interface */
 
 extern char sim_name[64];
@@ -378,6 +412,7 @@ extern t_value (*sim_vm_pc_value) (void);
 extern t_bool (*sim_vm_is_subroutine_call) (t_addr **ret_addrs);
 extern void (*sim_vm_reg_update) (REG *rptr, uint32 idx, t_value prev_val, t_value new_val);
 extern const char **sim_clock_precalibrate_commands;
+extern const char **sim_vm_prof_contexts;               /* profiler context names */
 extern int32 sim_vm_initial_ips;                        /* base estimate of simulated instructions per second */
 extern const char *sim_vm_interval_units;               /* Simulator can change this - default "instructions" */
 extern const char *sim_vm_step_unit;                    /* Simulator can change this - default "instruction" */
@@ -2314,7 +2314,7 @@ sim_deb_switches = switches &
                     SWMASK ('T') | SWMASK ('A') |
                     SWMASK ('F') | SWMASK ('N') |
                     SWMASK ('B') | SWMASK ('E') |
-                    SWMASK ('D') );                 /* save debug switches */
+                    SWMASK ('D') | SWMASK ('Z') );  /* save debug switches */
 return old_deb_switches;
 }
 
@@ -2329,6 +2329,8 @@ size_t buffer_size = 0;
 
 if ((cptr == NULL) || (*cptr == 0))                     /* need arg */
     return SCPE_2FARG;
+if ((sim_switches & SWMASK ('B')) && (sim_switches & SWMASK ('Z')))
+    return sim_messagef (SCPE_ARG, "A binary debug trace can't be written to a memory buffer\n");
 if (sim_switches & SWMASK ('B')) {
     cptr = get_glyph_nc (cptr, gbuf, 0);                /* buffer size */
     buffer_size = (size_t)strtoul (gbuf, NULL, 10);
@@ -2338,12 +2340,20 @@ if (sim_switches & SWMASK ('B')) {
 cptr = get_glyph_nc (cptr, gbuf, 0);                    /* get file name */
 if (*cptr != 0)                                         /* now eol? */
     return SCPE_2MARG;
-r = sim_open_logfile (gbuf, FALSE, &sim_deb, &sim_deb_ref);
+r = sim_open_logfile (gbuf, (sim_switches & SWMASK ('Z')) != 0, &sim_deb, &sim_deb_ref);
 
 if (r != SCPE_OK)
     return r;
+if ((sim_switches & SWMASK ('Z')) &&
+    ((sim_deb == stdout) || (sim_deb == stderr) || (sim_deb == sim_log))) {
+    sim_close_logfile (&sim_deb_ref);
+    sim_deb = NULL;
+    return sim_messagef (SCPE_ARG, "A binary debug trace must be written to a file\n");
+    }
 
 sim_set_deb_switches (sim_switches);
+if (sim_deb_switches & SWMASK ('Z'))
+    sim_debug_binary_start ();                  /* header leads the file */
 
 if (sim_deb_switches & SWMASK ('R')) {
     struct tm loc_tm, gmt_tm;
@@ -2372,6 +2382,9 @@ if (sim_deb_switches & SWMASK ('E'))
 if (sim_deb_switches & SWMASK ('B'))
     sim_messagef (SCPE_OK, "   Debug messages will be written to a %u MB circular memory buffer\n",
                                 (unsigned int)buffer_size);
+if (sim_deb_switches & SWMASK ('Z')) {
+    sim_messagef (SCPE_OK, "   Debug messages will be recorded in binary form, use SHOW DEBUG DECODE to display them\n");
+    }
 time(&now);
 if (!sim_quiet) {
     fprintf (sim_deb, "Debug output to \"%s\" at %s", sim_logfile_name (sim_deb, sim_deb_ref), ctime(&now));
@@ -2429,8 +2442,19 @@ t_stat sim_show_debug (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST cha
 {
 int32 i;
 
-if (cptr && (*cptr != 0))
-    return SCPE_2MARG;
+if (cptr && (*cptr != 0)) {
+    char gbuf[CBUFSIZE];
+
+    cptr = get_glyph (cptr, gbuf, 0);
+    if (strcmp (gbuf, "DECODE") != 0)
+        return SCPE_2MARG;
+    cptr = get_glyph_nc (cptr, gbuf, 0);                /* get file name */
+    if (gbuf[0] == '\0')
+        return SCPE_2FARG;
+    if (*cptr != 0)
+        return SCPE_2MARG;
+    return sim_debug_decode (st, gbuf);
+    }
 if (sim_deb) {
     fprintf (st, "Debug output enabled to \"%s\"\n",
                  sim_logfile_name (sim_deb, sim_deb_ref));
@@ -2444,6 +2468,8 @@ if (sim_deb) {
         fprintf (st, "   Debug messages are not being filtered to summarize duplicate lines\n");
     if (sim_deb_switches & SWMASK ('E'))
         fprintf (st, "   Debug messages containing blob data in EBCDIC will display in readable form\n");
+    if (sim_deb_switches & SWMASK ('Z'))
+        fprintf (st, "   Debug messages are being recorded in binary form\n");
     for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {
         t_bool unit_debug = FALSE;
         uint32 unit;
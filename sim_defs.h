@@ -336,6 +336,21 @@ typedef uint32          t_addr;
 #define SIM_NOINLINE
 #endif
 
+/* Threaded instruction dispatch
+
+   If SIM_THREADED_DISPATCH is defined and the compiler supports labels as
+   values (GCC, Clang), SIM_THREADED is defined and a CPU may dispatch with
+   goto through a table of label addresses rather than through a switch.
+   SIM_OPLABEL marks a table target inside the switch; it expands to
+   nothing when the switch alone is used. */
+
+#if defined (SIM_THREADED_DISPATCH) && defined (__GNUC__)
+#define SIM_THREADED    1
+#define SIM_OPLABEL(l)  l:
+#else
+#define SIM_OPLABEL(l)
+#endif
+
 /* Packed structure support */
 
 #ifdef _MSC_VER
@@ -490,6 +505,7 @@ typedef struct BRKTAB BRKTAB;
 typedef struct BRKTYPTAB BRKTYPTAB;
 typedef struct EXPTAB EXPTAB;
 typedef struct EXPECT EXPECT;
+typedef struct EXPECT_MATCHER EXPECT_MATCHER;
 typedef struct SEND SEND;
 typedef struct DEBTAB DEBTAB;
 typedef struct FILEREF FILEREF;
@@ -615,6 +631,7 @@ struct UNIT {
     uint16              us9;                            /* device specific */
     uint16              us10;                           /* device specific */
     uint32              disk_type;                      /* Disk specific info */
+    uint32              disk_cache;                     /* Disk cache size (MB) */
     void                *tmxr;                          /* TMXR linkage */
     size_t              recsize;                        /* Tape specific info */
     t_addr              tape_eom;                       /* Tape specific info */
@@ -623,6 +640,11 @@ struct UNIT {
     char                *uname;                         /* Unit name */
     DEVICE              *dptr;                          /* DEVICE linkage (backpointer) */
     uint32              dctrl;                          /* debug control */
+    double              q_due;                          /* event queue due time (heap) */
+    t_uint64            q_seq;                          /* event queue insertion sequence (heap) */
+    int32               q_index;                        /* event queue heap index */
+    void                *mem_base;                      /* memory array (SAVE/RESTORE) */
+    uint32              mem_flags;                      /* memory array layout */
 #ifdef SIM_ASYNCH_IO
     void                (*a_check_completion)(UNIT *);
     t_bool              (*a_is_active)(UNIT *);
@@ -680,6 +702,8 @@ struct UNIT {
 #define UNIT_TM_POLL        0000002         /* TMXR Polling unit */
 #define UNIT_NO_FIO         0000004         /* fileref is NOT a FILE * */
 #define UNIT_DISK_CHK       0000010         /* disk data debug checking (sim_disk) */
+#define UNIT_DISK_MMAP      0000020         /* disk container memory mapped (sim_disk) */
+#define UNIT_DISK_SIMHX     0000040         /* disk format is SIMHX (sim_disk) */
 #define UNIT_TMR_UNIT       0000200         /* Unit registered as a calibrated timer */
 #define UNIT_TAPE_MRK       0000400         /* Tape Unit Tapemark */
 #define UNIT_TAPE_PNU       0001000         /* Tape Unit Position Not Updated */
@@ -692,6 +716,15 @@ struct UNIT {
 #define UNIT_S_TAPE_ANSI    4               /* Bits Reserved for ANSI Tape Type */
 #define UNIT_M_TAPE_ANSI    (((1 << UNIT_S_TAPE_ANSI) - 1) << UNIT_V_TAPE_ANSI)
 
+/* Unit memory array layout (mem_flags)
+
+   A memory-like unit may describe its memory array with mem_base so that
+   SAVE and RESTORE can move it in bulk rather than with one examine or
+   deposit call per word.  Element i of the array must hold the value
+   examine returns for address i * aincr, in SZ_D (dptr) bytes. */
+
+#define MEM_PACKED_LE       0000001         /* elements packed little endian in wider words */
+
 struct BITFIELD {
     const char      *name;                              /* field name */
     uint32          offset;                             /* starting bit */
@@ -888,6 +921,7 @@ struct EXPTAB {
     sim_regex_t         *regex;                         /* compiled regular expression */
     sim_re_capture_t    re_nsub;                        /* regular expression sub expression count */
     sim_re_context_t    re_ctx;                         /* regular expression match context */
+    size_t              re_start;                       /* regular expression match resume offset */
     char                *act;                           /* action string */
     };
 
@@ -902,6 +936,10 @@ struct EXPECT {
     size_t              buf_ins;                        /* buffer insertion point for the next output data */
     size_t              buf_size;                       /* buffer size */
     size_t              buf_data;                       /* count of data in buffer */
+    EXPECT_MATCHER      *matcher;                       /* compiled literal match rules */
+    uint32              matcher_state;                  /* literal matcher state */
+    uint8               *re_buf;                        /* buffer data without NULs for RegEx matching */
+    size_t              re_buf_data;                    /* count of data in re_buf */
     };
 
 /* Send Context */
@@ -50,8 +50,13 @@ Public routines:
    sim_disk_show_fmt         show disk format
    sim_disk_set_capac        set disk capacity
    sim_disk_show_capac       show disk capacity
+   sim_disk_set_cache        set disk cache size
+   sim_disk_show_cache       show disk cache size and statistics
+   sim_disk_set_access       set disk container access method
+   sim_disk_show_access      show disk container access method
    sim_disk_set_async        enable asynchronous operation
    sim_disk_clr_async        disable asynchronous operation
+   sim_disk_pending          count of outstanding asynchronous requests
    sim_disk_data_trace       debug support
    sim_disk_test             unit test routine
 
@@ -87,6 +92,16 @@ Internal routines:
 #include <pthread.h>
 #endif
 
+#if defined (__linux__) || defined (__APPLE__) || defined (__CYGWIN__) || defined (__FreeBSD__) || defined (__NetBSD__) || defined (__OpenBSD__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define HAVE_DISK_MMAP                      /* memory mapped container access available */
+#if !defined (__APPLE__) && !defined (__OpenBSD__)
+#include <fcntl.h>
+#define HAVE_DISK_FALLOCATE                 /* posix_fallocate available */
+#endif
+#endif
+
 /* Newly created SIMH (and possibly RAW) disk containers       */
 /* will have this data as the last 512 bytes of the container  */
 /* It will not be considered part of the data in the container */
@@ -114,6 +129,7 @@ struct simh_disk_footer {
 
 #if (defined (VMS) && !(defined (__ALPHA) || defined (__ia64)))
 #define DONT_DO_VHD_SUPPORT  /* VAX/VMS compilers don't have 64 bit integers */
+#define DONT_DO_SIMHX_SUPPORT
 #endif
 
 #if defined(_WIN32) || defined (__ALPHA) || defined (__ia64) || defined (VMS)
@@ -149,6 +165,18 @@ return value;
 }
 #endif
 
+#if defined SIM_ASYNCH_IO
+struct disk_aio_req {
+    int                 dop;                /* operation */
+    t_lba               lba;
+    uint8               *buf;
+    t_seccnt            *rsects;
+    t_seccnt            sects;
+    DISK_PCALLBACK      callback;
+    t_stat              io_status;
+    };
+#endif
+
 struct disk_context {
     t_offset            container_size;     /* Size of the data portion (of the pseudo disk) */
     t_offset            highwater;          /* Furthest written sector in the disk */
@@ -167,6 +195,9 @@ struct disk_context {
     uint32              write_count;        /* Number of write operations performed */
     struct simh_disk_footer
                         *footer;
+    struct disk_cache   *cache;             /* Optional read-ahead/write-back cache */
+    uint8               *map;               /* Memory mapped container data (ACCESS=MMAP) */
+    t_offset            map_size;           /* Bytes of the container which are mapped */
 #if defined _WIN32
     HANDLE              disk_handle;        /* OS specific Raw device handle */
 #endif
@@ -179,13 +210,15 @@ struct disk_context {
     pthread_cond_t      io_cond;
     pthread_cond_t      io_done;
     pthread_cond_t      startup_cond;
-    int                 io_dop;
-    uint8               *buf;
-    t_seccnt            *rsects;
-    t_seccnt            sects;
-    t_lba               lba;
-    DISK_PCALLBACK      callback;
-    t_stat              io_status;
+    struct disk_aio_req *ioq;               /* request ring */
+    uint32              ioq_size;           /* request ring capacity */
+    uint32              ioq_submitted;      /* requests submitted */
+    uint32              ioq_started;        /* requests picked up by the I/O thread */
+    uint32              ioq_completed;      /* requests completed by the I/O thread */
+    uint32              ioq_dispatched;     /* completion callbacks delivered */
+    t_lba               ra_line;            /* first line of deferred cache read ahead */
+    uint32              ra_lines;           /* lines of deferred read ahead (0 = none) */
+    t_bool              ra_busy;            /* I/O thread is reading ahead */
 #endif
     };
 
@@ -198,27 +231,8 @@ struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;   \
 if ((!callback) || !ctx->asynch_io)
 
 #define AIO_CALL(op, _lba, _buf, _rsects, _sects,  _callback)   \
-    if (ctx->asynch_io) {                                       \
-        struct disk_context *ctx =                              \
-                      (struct disk_context *)uptr->disk_ctx;    \
-                                                                \
-        pthread_mutex_lock (&ctx->io_lock);                     \
-                                                                \
-        sim_debug_unit (ctx->dbit, uptr,                        \
-      "sim_disk AIO_CALL(op=%d, unit=%d, lba=0x%X, sects=%d)\n",\
-                op, (int)(uptr - ctx->dptr->units), _lba, _sects);\
-                                                                \
-        if (ctx->callback)                                      \
-            abort(); /* horrible mistake, stop */               \
-        ctx->io_dop = op;                                       \
-        ctx->lba = _lba;                                        \
-        ctx->buf = _buf;                                        \
-        ctx->sects = _sects;                                    \
-        ctx->rsects = _rsects;                                  \
-        ctx->callback = _callback;                              \
-        pthread_cond_signal (&ctx->io_cond);                    \
-        pthread_mutex_unlock (&ctx->io_lock);                   \
-        }                                                       \
+    if (ctx->asynch_io)                                         \
+        _disk_aio_submit (uptr, op, _lba, _buf, _rsects, _sects, _callback);\
     else                                                        \
         if (_callback)                                          \
             (_callback) (uptr, r);
@@ -229,11 +243,71 @@ if ((!callback) || !ctx->asynch_io)
 #define DOP_WSEC  2             /* sim_disk_wrsect_a */
 #define DOP_IAVL  3             /* sim_disk_isavailable_a */
 
+#define DISK_AIO_QMIN   4       /* initial request ring size */
+#define DISK_AIO_SLOT(ctx, seq) (&(ctx)->ioq[(seq) % (ctx)->ioq_size])
+
+/* Queue a request for the unit's I/O thread.
+
+   Any number of requests may be outstanding against a unit.  They are
+   performed in submission order by the unit's I/O thread, and their
+   completion callbacks are delivered in that same order.  The request
+   ring grows as needed, so a controller which keeps several commands
+   in flight is never refused.
+
+   Requests against a single unit are not run concurrently since the
+   SimH and VHD formats are accessed via stdio, which doesn't have an
+   atomic seek+(read|write) operation.  Each unit has its own I/O thread,
+   so requests to different units proceed in parallel. */
+static void _disk_aio_submit (UNIT *uptr, int dop, t_lba lba, uint8 *buf, t_seccnt *rsects, t_seccnt sects, DISK_PCALLBACK callback)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_aio_req *req;
+uint32 depth;
+
+pthread_mutex_lock (&ctx->io_lock);
+sim_debug_unit (ctx->dbit, uptr, "sim_disk AIO_CALL(op=%d, unit=%d, lba=0x%X, sects=%d, queued=%u)\n",
+                dop, (int)(uptr - ctx->dptr->units), lba, sects, ctx->ioq_submitted - ctx->ioq_dispatched);
+depth = ctx->ioq_submitted - ctx->ioq_dispatched;
+if (depth == ctx->ioq_size) {                       /* ring full? */
+    uint32 size = ctx->ioq_size ? 2 * ctx->ioq_size : DISK_AIO_QMIN;
+    struct disk_aio_req *ioq = (struct disk_aio_req *)calloc (size, sizeof (*ioq));
+    uint32 seq;
+
+    if (ioq == NULL)
+        abort ();                                   /* no way to report this, stop */
+    for (seq = ctx->ioq_dispatched; seq != ctx->ioq_submitted; seq++)
+        ioq[seq % size] = *DISK_AIO_SLOT (ctx, seq);
+    free (ctx->ioq);
+    ctx->ioq = ioq;
+    ctx->ioq_size = size;
+    }
+req = DISK_AIO_SLOT (ctx, ctx->ioq_submitted);
+req->dop = dop;
+req->lba = lba;
+req->buf = buf;
+req->sects = sects;
+req->rsects = rsects;
+req->callback = callback;
+req->io_status = SCPE_OK;
+++ctx->ioq_submitted;
+pthread_cond_signal (&ctx->io_cond);
+pthread_mutex_unlock (&ctx->io_lock);
+}
+
+static void _sim_disk_cache_read_ahead (UNIT *uptr, t_lba line, uint32 n);
+
+/* The unit's I/O thread.  Once it has worked through the request ring it
+   performs any cache read ahead the last read asked for, so that read
+   ahead is never part of the transfer the simulator is waiting for. */
 static void *
 _disk_io(void *arg)
 {
 UNIT* volatile uptr = (UNIT*)arg;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_aio_req req;
+t_lba ra_line;
+uint32 ra_lines;
+t_stat r;
 
 /* Boost Priority for this I/O thread vs the CPU instruction execution
    thread which in general won't be readily yielding the processor when
@@ -244,24 +318,45 @@ sim_debug_unit (ctx->dbit, uptr, "_disk_io(unit=%d) starting\n", (int)(uptr - ct
 
 pthread_mutex_lock (&ctx->io_lock);
 pthread_cond_signal (&ctx->startup_cond);   /* Signal we're ready to go */
-while (ctx->asynch_io) {
-    pthread_cond_wait (&ctx->io_cond, &ctx->io_lock);
-    if (ctx->io_dop == DOP_DONE)
-        break;
+while (1) {
+    while (ctx->asynch_io && (ctx->ioq_started == ctx->ioq_submitted) && (ctx->ra_lines == 0))
+        pthread_cond_wait (&ctx->io_cond, &ctx->io_lock);
+    if (ctx->ioq_started == ctx->ioq_submitted) {
+        if (!ctx->asynch_io) {
+            ctx->ra_lines = 0;                  /* read ahead isn't worth waiting for */
+            break;                              /* shutting down and drained */
+            }
+        ra_line = ctx->ra_line;                 /* idle, read ahead */
+        ra_lines = ctx->ra_lines;
+        ctx->ra_lines = 0;
+        ctx->ra_busy = TRUE;
+        pthread_mutex_unlock (&ctx->io_lock);
+        _sim_disk_cache_read_ahead (uptr, ra_line, ra_lines);
+        pthread_mutex_lock (&ctx->io_lock);
+        ctx->ra_busy = FALSE;
+        pthread_cond_broadcast (&ctx->io_done);
+        continue;
+        }
+    req = *DISK_AIO_SLOT (ctx, ctx->ioq_started);/* ring may grow while we work */
+    ++ctx->ioq_started;
     pthread_mutex_unlock (&ctx->io_lock);
-    switch (ctx->io_dop) {
+    switch (req.dop) {
         case DOP_RSEC:
-            ctx->io_status = sim_disk_rdsect (uptr, ctx->lba, ctx->buf, ctx->rsects, ctx->sects);
+            r = sim_disk_rdsect (uptr, req.lba, req.buf, req.rsects, req.sects);
             break;
         case DOP_WSEC:
-            ctx->io_status = sim_disk_wrsect (uptr, ctx->lba, ctx->buf, ctx->rsects, ctx->sects);
+            r = sim_disk_wrsect (uptr, req.lba, req.buf, req.rsects, req.sects);
             break;
         case DOP_IAVL:
-            ctx->io_status = sim_disk_isavailable (uptr);
+            r = sim_disk_isavailable (uptr);
+            break;
+        default:
+            r = SCPE_IERR;
             break;
         }
     pthread_mutex_lock (&ctx->io_lock);
-    ctx->io_dop = DOP_DONE;
+    DISK_AIO_SLOT (ctx, ctx->ioq_completed)->io_status = r;
+    ++ctx->ioq_completed;
     pthread_cond_signal (&ctx->io_done);
     sim_activate (uptr, ctx->asynch_io_latency);
     }
@@ -278,25 +373,35 @@ return NULL;
    routine is to put the unit in proper condition to digest what may have
    occurred in the asynchronous thread.
 
-   Since disk processing only handles a single I/O at a time to a
-   particular disk device (due to using stdio for the SimH Disk format
-   and stdio doesn't have an atomic seek+(read|write) operation),
-   we have the opportunity to possibly detect improper attempts to
-   issue multiple concurrent I/O requests. */
+   Every request which has completed is handed to its callback, oldest
+   first.  A callback may submit further requests.  The lock isn't held
+   while a callback runs, and it isn't needed at all once the I/O thread
+   has been shut down (which drains all outstanding requests). */
 static void _disk_completion_dispatch (UNIT *uptr)
 {
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-DISK_PCALLBACK callback = ctx->callback;
-
-sim_debug_unit (ctx->dbit, uptr, "_disk_completion_dispatch(unit=%d, dop=%d, callback=%p)\n", (int)(uptr - ctx->dptr->units), ctx->io_dop, (void *)(ctx->callback));
-
-if (ctx->io_dop != DOP_DONE)
-    abort();                                            /* horribly wrong, stop */
+struct disk_aio_req req;
+t_bool locked;
 
-if (ctx->callback && ctx->io_dop == DOP_DONE) {
-    ctx->callback = NULL;
-    callback (uptr, ctx->io_status);
+if (!ctx)
+    return;
+locked = (ctx->asynch_io != 0);
+if (locked)
+    pthread_mutex_lock (&ctx->io_lock);
+while (ctx->ioq_dispatched != ctx->ioq_completed) {
+    req = *DISK_AIO_SLOT (ctx, ctx->ioq_dispatched);
+    ++ctx->ioq_dispatched;
+    if (locked)
+        pthread_mutex_unlock (&ctx->io_lock);
+    sim_debug_unit (ctx->dbit, uptr, "_disk_completion_dispatch(unit=%d, dop=%d, callback=%p)\n", (int)(uptr - ctx->dptr->units), req.dop, (void *)(req.callback));
+    if (req.callback)
+        req.callback (uptr, req.io_status);
+    locked = (ctx->asynch_io != 0);
+    if (locked)
+        pthread_mutex_lock (&ctx->io_lock);
     }
+if (locked)
+    pthread_mutex_unlock (&ctx->io_lock);
 }
 
 static t_bool _disk_is_active (UNIT *uptr)
@@ -304,8 +409,8 @@ static t_bool _disk_is_active (UNIT *uptr)
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
 if (ctx) {
-    sim_debug_unit (ctx->dbit, uptr, "_disk_is_active(unit=%d, dop=%d)\n", (int)(uptr - ctx->dptr->units), ctx->io_dop);
-    return (ctx->io_dop != DOP_DONE);
+    sim_debug_unit (ctx->dbit, uptr, "_disk_is_active(unit=%d, pending=%u)\n", (int)(uptr - ctx->dptr->units), ctx->ioq_submitted - ctx->ioq_completed);
+    return (ctx->ioq_completed != ctx->ioq_submitted);
     }
 return FALSE;
 }
@@ -315,10 +420,10 @@ static t_bool _disk_cancel (UNIT *uptr)
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
 if (ctx) {
-    sim_debug_unit (ctx->dbit, uptr, "_disk_cancel(unit=%d, dop=%d)\n", (int)(uptr - ctx->dptr->units), ctx->io_dop);
+    sim_debug_unit (ctx->dbit, uptr, "_disk_cancel(unit=%d, pending=%u)\n", (int)(uptr - ctx->dptr->units), ctx->ioq_submitted - ctx->ioq_completed);
     if (ctx->asynch_io) {
         pthread_mutex_lock (&ctx->io_lock);
-        while (ctx->io_dop != DOP_DONE)
+        while (ctx->ioq_completed != ctx->ioq_submitted)
             pthread_cond_wait (&ctx->io_done, &ctx->io_lock);
         pthread_mutex_unlock (&ctx->io_lock);
         }
@@ -347,6 +452,20 @@ static t_stat sim_vhd_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *
 static t_stat sim_vhd_disk_clearerr (UNIT *uptr);
 static t_stat sim_vhd_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_element_size);
 static const char *sim_vhd_disk_get_dtype (FILE *f, uint32 *SectorSize, uint32 *xfer_element_size, char sim_name[64], time_t *creation_time);
+static t_stat sim_simhx_disk_implemented (void);
+static t_bool sim_simhx_disk_is_container (const char *szSIMHXPath);
+static FILE *sim_simhx_disk_open (const char *szSIMHXPath, const char *DesiredAccess);
+static FILE *sim_simhx_disk_create (const char *szSIMHXPath, t_offset desiredsize);
+static FILE *sim_simhx_disk_snapshot (FILE *f, const char *szSnapshotPath);
+static int sim_simhx_disk_close (FILE *f);
+static void sim_simhx_disk_flush (FILE *f);
+static t_offset sim_simhx_disk_size (FILE *f);
+static t_stat sim_simhx_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects);
+static t_stat sim_simhx_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects);
+static t_stat sim_simhx_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_element_size, const char *dname);
+static void sim_simhx_disk_get_footer (FILE *f, struct simh_disk_footer *footer);
+static void sim_simhx_disk_info (FILE *f);
+static t_stat sim_simhx_store_reclaim (const char *szStorePath);
 static t_stat sim_os_disk_implemented_raw (void);
 static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode);
 static int sim_os_disk_close_raw (FILE *f);
@@ -375,6 +494,7 @@ static struct sim_disk_fmt fmts[] = {
     { "SIMH",        0, DKUF_F_STD,  NULL},
     { "RAW",         0, DKUF_F_RAW,  sim_os_disk_implemented_raw},
     { "VHD",         0, DKUF_F_VHD,  sim_vhd_disk_implemented},
+    { "SIMHX",       0, DKUF_F_SIMHX, sim_simhx_disk_implemented},
     { NULL,          0, 0,           NULL}
     };
 
@@ -392,8 +512,19 @@ for (f = 0; fmts[f].name; f++) {
     if (fmts[f].name && (MATCH_CMD (cptr, fmts[f].name) == 0)) {
         if ((fmts[f].impl_fnc) && (fmts[f].impl_fnc() != SCPE_OK))
             return SCPE_NOFNC;
-        uptr->flags = (uptr->flags & ~DKUF_FMT) |
-            (fmts[f].fmtval << DKUF_V_FMT) | fmts[f].uflags;
+        /* SIMHX doesn't fit in the unit flags' format field, whose width
+           is part of every simulator's unit flag layout and hence of their
+           SAVE files.  It is kept in the dynamic flags, with the format
+           field left at AUTO, which also detects SIMHX containers. */
+        if (fmts[f].fmtval == DKUF_F_SIMHX) {
+            uptr->flags = (uptr->flags & ~DKUF_FMT) | fmts[f].uflags;
+            uptr->dynflags |= UNIT_DISK_SIMHX;
+            }
+        else {
+            uptr->flags = (uptr->flags & ~DKUF_FMT) |
+                (fmts[f].fmtval << DKUF_V_FMT) | fmts[f].uflags;
+            uptr->dynflags &= ~UNIT_DISK_SIMHX;
+            }
         return SCPE_OK;
         }
     }
@@ -477,6 +608,9 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
     case DKUF_F_VHD:                                    /* VHD format */
         is_available = TRUE;
         break;
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        is_available = TRUE;
+        break;
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
         if (sim_os_disk_isavailable_raw (uptr->fileref)) {
             if (ctx->media_removed) {
@@ -588,6 +722,8 @@ pthread_attr_t attr;
 
 sim_debug_unit (ctx->dbit, uptr, "sim_disk_set_async(unit=%d)\n", (int)(uptr - ctx->dptr->units));
 
+if (ctx->asynch_io)                                     /* I/O thread already running? */
+    return SCPE_OK;
 ctx->asynch_io = sim_asynch_enabled;
 ctx->asynch_io_latency = latency;
 if (ctx->asynch_io) {
@@ -628,7 +764,7 @@ sim_debug_unit (ctx->dbit, uptr, "sim_disk_clr_async(unit=%d)\n", (int)(uptr - c
 if (ctx->asynch_io) {
     pthread_mutex_lock (&ctx->io_lock);
     ctx->asynch_io = 0;
-    pthread_cond_signal (&ctx->io_cond);
+    pthread_cond_broadcast (&ctx->io_cond);
     pthread_mutex_unlock (&ctx->io_lock);
     pthread_join (ctx->io_thread, NULL);
     pthread_mutex_destroy (&ctx->io_lock);
@@ -639,5842 +775,8147 @@ return SCPE_OK;
 #endif
 }
 
-/* Read Sectors */
+/* Number of asynchronous requests whose completion callback hasn't been
+   delivered yet.  From within a completion callback, this counts only the
+   requests queued behind the one being reported. */
 
-static t_stat _sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+uint32 sim_disk_pending (UNIT *uptr)
 {
-t_offset da;
-uint32 err, tbc;
-size_t i;
+#if !defined(SIM_ASYNCH_IO)
+return 0;
+#else
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint32 pending;
 
-sim_debug_unit (ctx->dbit, uptr, "_sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+if (!ctx)
+    return 0;
+if (!ctx->asynch_io)                            /* I/O thread drained and gone? */
+    return ctx->ioq_submitted - ctx->ioq_dispatched;
+pthread_mutex_lock (&ctx->io_lock);
+pending = ctx->ioq_submitted - ctx->ioq_dispatched;
+pthread_mutex_unlock (&ctx->io_lock);
+return pending;
+#endif
+}
 
-da = ((t_offset)lba) * ctx->sector_size;
-tbc = sects * ctx->sector_size;
-if (sectsread)
-    *sectsread = 0;
-while (tbc) {
-    size_t sectbytes;
+/* Disk cache
+
+   An optional per-unit cache of the most recently used runs of sectors
+   (lines) of a disk.  Lines hold data in the simulator's byte order, so
+   a hit never touches the container.  A miss reads the missing line
+   together with any uncached lines the rest of the request covers, and
+   once a sequential stream of reads is recognized, the lines which
+   follow it, with a single container read.  When the unit operates
+   asynchronously, a read only fetches the lines it needs, and the read
+   ahead is left to the unit's I/O thread once it has no requests to
+   work on, after the read's completion has been posted.  Cache access
+   from any other thread first waits for that read ahead to finish.
+   Writes are held in the cache until their line is evicted or the unit
+   is flushed (when the simulator stops, on SAVE and on detach).  Lines
+   which can't be written stay in the cache, and detach fails while any
+   remain.  Lines which extend beyond the end of the disk are never
+   cached.
+*/
 
-    clearerr (uptr->fileref);
-    err = sim_fseeko (uptr->fileref, da, SEEK_SET);          /* set pos */
-    if (err)
-        return SCPE_IOERR;
-    i = sim_fread (buf, 1, tbc, uptr->fileref);
-    if (i < tbc)                 /* fill */
-        memset (&buf[i], 0, tbc-i);
-    if ((i == 0) &&             /* Reading at or past EOF? */
-        feof (uptr->fileref))
-        i = tbc;                /* return 0's which have already been filled in buffer */
-    sectbytes = (i / ctx->sector_size) * ctx->sector_size;
-    if (i > sectbytes)
-        sectbytes += ctx->sector_size;
-    if (sectsread)
-        *sectsread += sectbytes / ctx->sector_size;
-    err = ferror (uptr->fileref);
-    if (err)
-        return SCPE_IOERR;
-    tbc -= sectbytes;
-    if ((tbc == 0) || (i == 0))
-        return SCPE_OK;
-    da += sectbytes;
-    buf += sectbytes;
-    }
-return SCPE_OK;
-}
+#define DK_CACHE_LINE_SIZE      65536           /* bytes in a cache line */
+#define DK_CACHE_READ_AHEAD     8               /* lines read ahead of a sequential stream */
+#define DK_CACHE_MAX_IO_LINES   32              /* most lines moved in one container transfer */
+#define DK_CACHE_MAX_MB         4096            /* largest cache size */
+
+struct disk_cache_line {
+    struct disk_cache_line  *hnext;             /* hash chain */
+    struct disk_cache_line  *prev;              /* more recently used line */
+    struct disk_cache_line  *next;              /* less recently used line */
+    t_lba                   line;               /* line number (lba / line_sects) */
+    t_bool                  dirty;              /* not yet written to the container */
+    uint8                   *data;
+    };
 
-t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+struct disk_cache {
+    uint32                  line_sects;         /* sectors per line */
+    uint32                  line_size;          /* bytes per line */
+    uint32                  max_lines;          /* capacity in lines */
+    uint32                  lines;              /* lines allocated */
+    t_lba                   limit;              /* lines wholly within the disk */
+    uint32                  hash_mask;
+    struct disk_cache_line  **hash;
+    struct disk_cache_line  *mru;               /* most recently used line */
+    struct disk_cache_line  *lru;               /* least recently used line */
+    t_lba                   next_lba;           /* lba following the previous read */
+    uint32                  sequential;         /* count of consecutive sequential reads */
+    uint32                  io_lines;           /* capacity of io_buf in lines */
+    uint8                   *io_buf;            /* multi-line container transfer buffer */
+    t_uint64                hits;               /* line lookups satisfied by the cache */
+    t_uint64                misses;             /* line lookups which needed the container */
+    t_uint64                read_ahead;         /* lines read ahead of a request */
+    t_uint64                write_backs;        /* dirty lines written to the container */
+    };
+
+static t_stat _sim_disk_read (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects);
+static t_stat _sim_disk_write (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects);
+
+static struct disk_cache_line *_sim_disk_cache_find (struct disk_cache *cache, t_lba line)
 {
-t_stat r;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-uint32 f = DK_GET_FMT (uptr);
-t_seccnt sread = 0;
+struct disk_cache_line *lp;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+for (lp = cache->hash[line & cache->hash_mask]; lp != NULL; lp = lp->hnext)
+    if (lp->line == line)
+        break;
+return lp;
+}
 
-ctx->read_count++;                                      /* record read operation */
-if ((sects == 1) &&                                     /* Single sector reads */
-    (lba >= (uptr->capac*ctx->capac_factor)/(ctx->sector_size/((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)))) {/* beyond the end of the disk */
-    memset (buf, '\0', ctx->sector_size);               /* are bad block management efforts - zero buffer */
-    if (sectsread)
-        *sectsread = 1;
-    return SCPE_OK;                                     /* return success */
-    }
+static void _sim_disk_cache_unlink (struct disk_cache *cache, struct disk_cache_line *lp)
+{
+if (lp->prev)
+    lp->prev->next = lp->next;
+else
+    cache->mru = lp->next;
+if (lp->next)
+    lp->next->prev = lp->prev;
+else
+    cache->lru = lp->prev;
+}
 
-if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Aligned & whole sector transfers */
-    ((0 == ((lba*ctx->sector_size) & (ctx->storage_sector_size - 1))) &&
-     (0 == ((sects*ctx->sector_size) & (ctx->storage_sector_size - 1)))) ||
-    (f == DKUF_F_STD) || (f == DKUF_F_VHD)) {                       /* or SIMH or VHD formats */
-    switch (f) {                                        /* case on format */
-        case DKUF_F_STD:                                /* SIMH format */
-            r = _sim_disk_rdsect (uptr, lba, buf, &sread, sects);
-            break;
-        case DKUF_F_VHD:                                /* VHD format */
-            r = sim_vhd_disk_rdsect (uptr, lba, buf, &sread, sects);
-            break;
-        case DKUF_F_RAW:                                /* Raw Physical Disk Access */
-            r = sim_os_disk_rdsect (uptr, lba, buf, &sread, sects);
-            break;
-        default:
-            return SCPE_NOFNC;
-        }
-    if (sectsread)
-        *sectsread = sread;
-    sim_buf_swap_data (buf, ctx->xfer_element_size, (sread * ctx->sector_size) / ctx->xfer_element_size);
-    return r;
-    }
-else { /* Unaligned and/or partial sector transfers in RAW mode */
-    size_t tbufsize = sects * ctx->sector_size + 2 * ctx->storage_sector_size;
-    uint8 *tbuf = (uint8*) malloc (tbufsize);
-    t_offset ssaddr = (lba * (t_offset)ctx->sector_size) & ~(t_offset)(ctx->storage_sector_size -1);
-    uint32 soffset = (uint32)((lba * (t_offset)ctx->sector_size) - ssaddr);
-    uint32 bytesread;
+static void _sim_disk_cache_link (struct disk_cache *cache, struct disk_cache_line *lp)
+{
+lp->prev = NULL;
+lp->next = cache->mru;
+if (cache->mru)
+    cache->mru->prev = lp;
+else
+    cache->lru = lp;
+cache->mru = lp;
+}
 
-    if (sectsread)
-        *sectsread = 0;
-    if (tbuf == NULL)
-        return SCPE_MEM;
-    r = sim_os_disk_read (uptr, ssaddr, tbuf, &bytesread, tbufsize & ~(ctx->storage_sector_size - 1));
-    sim_buf_swap_data (tbuf + soffset, ctx->xfer_element_size, (bytesread - soffset) / ctx->xfer_element_size);
-    memcpy (buf, tbuf + soffset, sects * ctx->sector_size);
-    if (sectsread) {
-        *sectsread = (bytesread - soffset) / ctx->sector_size;
-        if (*sectsread > sects)
-            *sectsread = sects;
-        }
-    free (tbuf);
-    return r;
-    }
+static void _sim_disk_cache_touch (struct disk_cache *cache, struct disk_cache_line *lp)
+{
+if (cache->mru == lp)
+    return;
+_sim_disk_cache_unlink (cache, lp);
+_sim_disk_cache_link (cache, lp);
 }
 
-t_stat sim_disk_rdsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, DISK_PCALLBACK callback)
+static t_stat _sim_disk_cache_write_back (UNIT *uptr, struct disk_cache_line *lp)
 {
-t_stat r = SCPE_OK;
-AIO_CALLSETUP
-    r = sim_disk_rdsect (uptr, lba, buf, sectsread, sects);
-AIO_CALL(DOP_RSEC, lba, buf, sectsread, sects, callback);
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx->cache;
+t_seccnt written;
+t_stat r;
+
+if (!lp->dirty)
+    return SCPE_OK;
+r = _sim_disk_write (uptr, lp->line * cache->line_sects, lp->data, &written, cache->line_sects);
+if ((r == SCPE_OK) && (written != cache->line_sects))
+    r = SCPE_IOERR;
+if (r == SCPE_OK) {
+    lp->dirty = FALSE;
+    ++cache->write_backs;
+    }
 return r;
 }
 
-/* Write Sectors */
+/* Get a line to hold the (uncached) line number, evicting the least
+   recently used line once the cache is full */
 
-static t_stat _sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+static t_stat _sim_disk_cache_alloc (UNIT *uptr, t_lba line, struct disk_cache_line **plp)
 {
-t_offset da;
-uint32 err, tbc;
-size_t i;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx->cache;
+struct disk_cache_line *lp = NULL;
+struct disk_cache_line **hp;
+t_stat r;
 
-sim_debug_unit (ctx->dbit, uptr, "_sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
-
-da = ((t_offset)lba) * ctx->sector_size;
-tbc = sects * ctx->sector_size;
-if (sectswritten)
-    *sectswritten = 0;
-err = sim_fseeko (uptr->fileref, da, SEEK_SET);          /* set pos */
-if (err)
-    return SCPE_IOERR;
-i = sim_fwrite (buf, ctx->xfer_element_size, tbc/ctx->xfer_element_size, uptr->fileref);
-if (sectswritten)
-    *sectswritten += (t_seccnt)((i * ctx->xfer_element_size + ctx->sector_size - 1)/ctx->sector_size);
-err = ferror (uptr->fileref);
-if (err)
-    return SCPE_IOERR;
+*plp = NULL;
+if (cache->lines < cache->max_lines) {
+    lp = (struct disk_cache_line *)calloc (1, sizeof (*lp));
+    if (lp != NULL) {
+        lp->data = (uint8 *)malloc (cache->line_size);
+        if (lp->data == NULL) {
+            free (lp);
+            lp = NULL;
+            }
+        }
+    if (lp != NULL)
+        ++cache->lines;
+    }
+if (lp == NULL) {
+    lp = cache->lru;
+    if (lp == NULL)
+        return SCPE_MEM;
+    r = _sim_disk_cache_write_back (uptr, lp);
+    if (r != SCPE_OK)
+        return r;
+    _sim_disk_cache_unlink (cache, lp);
+    for (hp = &cache->hash[lp->line & cache->hash_mask]; *hp != lp; hp = &(*hp)->hnext)
+        ;
+    *hp = lp->hnext;
+    }
+lp->line = line;
+lp->dirty = FALSE;
+lp->hnext = cache->hash[line & cache->hash_mask];
+cache->hash[line & cache->hash_mask] = lp;
+_sim_disk_cache_link (cache, lp);
+*plp = lp;
 return SCPE_OK;
 }
 
-t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+/* Read an uncached line, along with up to need-1+ahead uncached lines
+   which follow it, from the container into the cache */
+
+static t_stat _sim_disk_cache_fill (UNIT *uptr, t_lba line, uint32 need, uint32 ahead, struct disk_cache_line **plp)
 {
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-uint32 f = DK_GET_FMT (uptr);
+struct disk_cache *cache = ctx->cache;
+struct disk_cache_line *lp = NULL;
+uint32 want = need + ahead;
+uint32 i, n;
+t_seccnt sread;
 t_stat r;
-uint8 *tbuf = NULL;
-t_seccnt written = 0;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+*plp = NULL;
+if (want > cache->io_lines)
+    want = cache->io_lines;
+for (n = 1; (n < want) && (line + n < cache->limit) && (_sim_disk_cache_find (cache, line + n) == NULL); n++)
+    ;
+r = _sim_disk_read (uptr, line * cache->line_sects, cache->io_buf, &sread, n * cache->line_sects);
+if (r != SCPE_OK)
+    return r;
+if (sread < n * cache->line_sects)
+    n = sread / cache->line_sects;
+if (n == 0)
+    return SCPE_IOERR;
+if (n > need)
+    cache->read_ahead += n - need;
+for (i = n; i-- > 0; ) {                        /* insert the requested line last, as the most recently used */
+    r = _sim_disk_cache_alloc (uptr, line + i, &lp);
+    if (r != SCPE_OK)
+        return r;
+    memcpy (lp->data, cache->io_buf + (size_t)i * cache->line_size, cache->line_size);
+    }
+*plp = lp;
+return SCPE_OK;
+}
 
-if (sectswritten)
-    *sectswritten = 0;
-ctx->write_count++;                                     /* record write operation */
-if (uptr->dynflags & UNIT_DISK_CHK) {
-    DEVICE *dptr = find_dev_from_unit (uptr);
-    uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
-    t_lba total_sectors = (t_lba)((uptr->capac*capac_factor)/(ctx->sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1)));
-    t_lba sect;
+#if defined (SIM_ASYNCH_IO)
+/* TRUE when running on the unit's I/O thread */
 
-    for (sect = 0; sect < sects; sect++) {
-        t_lba offset;
-        t_bool sect_error = FALSE;
+static t_bool _sim_disk_on_io_thread (struct disk_context *ctx)
+{
+return ctx->asynch_io && pthread_equal (pthread_self (), ctx->io_thread);
+}
+#endif
 
-        for (offset = 0; offset < ctx->sector_size; offset += sizeof(uint32)) {
-            if (*((uint32 *)&buf[sect*ctx->sector_size + offset]) != (uint32)(lba + sect)) {
-                sect_error = TRUE;
-                break;
-                }
-            }
-        if (sect_error) {
-            uint32 save_dctrl = dptr->dctrl;
-            FILE *save_sim_deb = sim_deb;
+/* Wait for any read ahead on the unit's I/O thread to finish before the
+   cache is used from another thread, and drop any which hasn't started */
 
-            sim_printf ("\n%s: Write Address Verification Error on lbn %d(0x%X) of %d(0x%X).\n", sim_uname (uptr), (int)(lba+sect), (int)(lba+sect), (int)total_sectors, (int)total_sectors);
-            dptr->dctrl = 0xFFFFFFFF;
-            sim_deb = save_sim_deb ? save_sim_deb : stdout;
-            sim_disk_data_trace (uptr, buf+sect*ctx->sector_size, lba+sect, ctx->sector_size,    "Found", TRUE, 1);
-            dptr->dctrl = save_dctrl;
-            sim_deb = save_sim_deb;
-            }
+static void _sim_disk_cache_quiesce (UNIT *uptr)
+{
+#if defined (SIM_ASYNCH_IO)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (!ctx->asynch_io || _sim_disk_on_io_thread (ctx))
+    return;
+pthread_mutex_lock (&ctx->io_lock);
+ctx->ra_lines = 0;
+while (ctx->ra_busy)
+    pthread_cond_wait (&ctx->io_done, &ctx->io_lock);
+pthread_mutex_unlock (&ctx->io_lock);
+#endif
+}
+
+#if defined (SIM_ASYNCH_IO)
+/* Read the uncached lines among the n lines starting at line into the
+   cache.  This is deferred read ahead, done by the unit's I/O thread,
+   and its errors are left for a later read of those lines to report. */
+
+static void _sim_disk_cache_read_ahead (UNIT *uptr, t_lba line, uint32 n)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx->cache;
+struct disk_cache_line *lp;
+
+if (cache == NULL)
+    return;
+for ( ; (n > 0) && (line < cache->limit) && (_sim_disk_cache_find (cache, line) != NULL); line++, n--)
+    ;
+if ((n > 0) && (line < cache->limit))
+    (void)_sim_disk_cache_fill (uptr, line, 0, n, &lp);
+}
+#endif
+
+static t_stat _sim_disk_cache_read (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx->cache;
+t_seccnt done = 0;
+t_stat r = SCPE_OK;
+uint32 ahead;
+t_bool deferred = FALSE;
+
+_sim_disk_cache_quiesce (uptr);
+#if defined (SIM_ASYNCH_IO)
+deferred = _sim_disk_on_io_thread (ctx);
+#endif
+if (lba == cache->next_lba)
+    ++cache->sequential;
+else
+    cache->sequential = 0;
+cache->next_lba = lba + sects;
+ahead = ((cache->sequential >= 2) && !deferred) ? DK_CACHE_READ_AHEAD : 0;
+while (done < sects) {
+    t_lba line = (lba + done) / cache->line_sects;
+    uint32 offset = (lba + done) % cache->line_sects;
+    t_seccnt count = cache->line_sects - offset;
+    struct disk_cache_line *lp;
+
+    if (count > sects - done)
+        count = sects - done;
+    if (line >= cache->limit) {                 /* beyond the cached part of the disk */
+        t_seccnt sread = 0;
+
+        r = _sim_disk_read (uptr, lba + done, buf + (size_t)done * ctx->sector_size, &sread, sects - done);
+        done += sread;
+        break;
+        }
+    lp = _sim_disk_cache_find (cache, line);
+    if (lp != NULL) {
+        ++cache->hits;
+        _sim_disk_cache_touch (cache, lp);
+        }
+    else {
+        ++cache->misses;
+        r = _sim_disk_cache_fill (uptr, line, (offset + (sects - done) + cache->line_sects - 1) / cache->line_sects,
+                                  ahead, &lp);
+        if (r != SCPE_OK)
+            break;
         }
+    memcpy (buf + (size_t)done * ctx->sector_size, lp->data + (size_t)offset * ctx->sector_size, (size_t)count * ctx->sector_size);
+    done += count;
     }
-switch (f) {                                            /* case on format */
-    case DKUF_F_STD:                                    /* SIMH format */
-        r = _sim_disk_wrsect (uptr, lba, buf, &written, sects);
-        break;
-    case DKUF_F_VHD:                                    /* VHD format */
-        if (!sim_end && (ctx->xfer_element_size != sizeof (char))) {
-            tbuf = (uint8*) malloc (sects * ctx->sector_size);
-            if (NULL == tbuf)
-                return SCPE_MEM;
-            sim_buf_copy_swapped (tbuf, buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
-            buf = tbuf;
-            }
-        r = sim_vhd_disk_wrsect  (uptr, lba, buf, &written, sects);
-        break;
-    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
-        break;                                          /* handle below */
-    default:
-        return SCPE_NOFNC;
+if (sectsread)
+    *sectsread = done;
+#if defined (SIM_ASYNCH_IO)
+if (deferred && (r == SCPE_OK) && (cache->sequential >= 2)) {
+    t_lba line = (lba + sects + cache->line_sects - 1) / cache->line_sects;
+    t_lba last = line + DK_CACHE_READ_AHEAD;
+
+    for ( ; (line < last) && (line < cache->limit) && (_sim_disk_cache_find (cache, line) != NULL); line++)
+        ;
+    if ((line < last) && (line < cache->limit)) {   /* have the I/O thread read ahead */
+        pthread_mutex_lock (&ctx->io_lock);
+        ctx->ra_line = line;
+        ctx->ra_lines = (uint32)(last - line);
+        pthread_mutex_unlock (&ctx->io_lock);
+        }
     }
-if (f == DKUF_F_RAW) {
-    if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Aligned & whole sector transfers */
-        ((0 == ((lba*ctx->sector_size) & (ctx->storage_sector_size - 1))) &&
-         (0 == ((sects*ctx->sector_size) & (ctx->storage_sector_size - 1))))) {
+#endif
+return r;
+}
 
-        if (!sim_end && (ctx->xfer_element_size != sizeof (char))) {
-            tbuf = (uint8*) malloc (sects * ctx->sector_size);
-            if (NULL == tbuf)
-                return SCPE_MEM;
-            sim_buf_copy_swapped (tbuf, buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
-            buf = tbuf;
-            }
+static t_stat _sim_disk_cache_write (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx->cache;
+t_seccnt done = 0;
+t_stat r = SCPE_OK;
 
-        r = sim_os_disk_wrsect (uptr, lba, buf, &written, sects);
+_sim_disk_cache_quiesce (uptr);
+if (uptr->flags & UNIT_RO)                      /* nothing to hold for a read only unit */
+    return _sim_disk_write (uptr, lba, buf, sectswritten, sects);
+while (done < sects) {
+    t_lba line = (lba + done) / cache->line_sects;
+    uint32 offset = (lba + done) % cache->line_sects;
+    t_seccnt count = cache->line_sects - offset;
+    struct disk_cache_line *lp;
+
+    if (count > sects - done)
+        count = sects - done;
+    if (line >= cache->limit) {                 /* beyond the cached part of the disk */
+        t_seccnt written = 0;
+
+        r = _sim_disk_write (uptr, lba + done, buf + (size_t)done * ctx->sector_size, &written, sects - done);
+        done += written;
+        break;
         }
-    else { /* Unaligned and/or partial sector transfers in RAW mode */
-        size_t tbufsize = sects * ctx->sector_size + 2 * ctx->storage_sector_size;
-        t_offset ssaddr = (lba * (t_offset)ctx->sector_size) & ~(t_offset)(ctx->storage_sector_size -1);
-        t_offset sladdr = ((lba + sects) * (t_offset)ctx->sector_size) & ~(t_offset)(ctx->storage_sector_size -1);
-        uint32 soffset = (uint32)((lba * (t_offset)ctx->sector_size) - ssaddr);
-        uint32 byteswritten;
-
-        tbuf = (uint8*) malloc (tbufsize);
-        if (tbuf == NULL)
-            return SCPE_MEM;
-        /* Partial Sector writes require a read-modify-write sequence for the partial sectors */
-        if (soffset)
-            sim_os_disk_read (uptr, ssaddr, tbuf, NULL, ctx->storage_sector_size);
-        sim_os_disk_read (uptr, sladdr, tbuf + (size_t)(sladdr - ssaddr), NULL, ctx->storage_sector_size);
-        sim_buf_copy_swapped (tbuf + soffset,
-                              buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
-        r = sim_os_disk_write (uptr, ssaddr, tbuf, &byteswritten, (soffset + (sects * ctx->sector_size) + ctx->storage_sector_size - 1) & ~(ctx->storage_sector_size - 1));
-        written = byteswritten / ctx->sector_size;
-        if (written > sects)
-            written = sects;
+    lp = _sim_disk_cache_find (cache, line);
+    if (lp != NULL) {
+        ++cache->hits;
+        _sim_disk_cache_touch (cache, lp);
         }
+    else {
+        ++cache->misses;
+        if (count == cache->line_sects)         /* whole line replaced? */
+            r = _sim_disk_cache_alloc (uptr, line, &lp);
+        else
+            r = _sim_disk_cache_fill (uptr, line, 1, 0, &lp);
+        if (r != SCPE_OK)
+            break;
+        }
+    memcpy (lp->data + (size_t)offset * ctx->sector_size, buf + (size_t)done * ctx->sector_size, (size_t)count * ctx->sector_size);
+    lp->dirty = TRUE;
+    done += count;
     }
-free (tbuf);
 if (sectswritten)
-    *sectswritten = written;
-if (written > 0) {
-    t_offset da = ((t_offset)lba) * ctx->sector_size;
-    t_offset end_write = da + (written * ctx->sector_size);
-
-    if (ctx->highwater < end_write)
-        ctx->highwater = end_write;
-    }
+    *sectswritten = done;
 return r;
 }
 
-t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback)
+static int _sim_disk_cache_line_cmp (const void *pa, const void *pb)
 {
-t_stat r = SCPE_OK;
-AIO_CALLSETUP
-    r =  sim_disk_wrsect (uptr, lba, buf, sectswritten, sects);
-AIO_CALL(DOP_WSEC, lba, buf, sectswritten, sects, callback);
+t_lba a = (*(struct disk_cache_line * const *)pa)->line;
+t_lba b = (*(struct disk_cache_line * const *)pb)->line;
+
+return (a < b) ? -1 : (a > b);
+}
+
+/* Write every dirty line to the container, in ascending order and
+   combining adjacent lines into single transfers */
+
+static t_stat _sim_disk_cache_flush (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx ? ctx->cache : NULL;
+struct disk_cache_line **dirty;
+struct disk_cache_line *lp;
+uint32 i, j, k, n = 0;
+t_seccnt written;
+t_stat r = SCPE_OK, rw;
+
+if (cache == NULL)
+    return SCPE_OK;
+for (lp = cache->mru; lp != NULL; lp = lp->next)
+    if (lp->dirty)
+        ++n;
+if (n == 0)
+    return SCPE_OK;
+dirty = (struct disk_cache_line **)malloc (n * sizeof (*dirty));
+if (dirty == NULL) {                            /* write them one at a time */
+    for (lp = cache->lru; lp != NULL; lp = lp->prev) {
+        rw = _sim_disk_cache_write_back (uptr, lp);
+        if (r == SCPE_OK)
+            r = rw;
+        }
+    return r;
+    }
+for (n = 0, lp = cache->mru; lp != NULL; lp = lp->next)
+    if (lp->dirty)
+        dirty[n++] = lp;
+qsort (dirty, n, sizeof (*dirty), _sim_disk_cache_line_cmp);
+for (i = 0; i < n; i = j) {
+    for (j = i + 1; (j < n) && (j - i < cache->io_lines) && (dirty[j]->line == dirty[j - 1]->line + 1); j++)
+        ;
+    for (k = i; k < j; k++)
+        memcpy (cache->io_buf + (size_t)(k - i) * cache->line_size, dirty[k]->data, cache->line_size);
+    rw = _sim_disk_write (uptr, dirty[i]->line * cache->line_sects, cache->io_buf, &written, (j - i) * cache->line_sects);
+    if ((rw == SCPE_OK) && (written != (j - i) * cache->line_sects))
+        rw = SCPE_IOERR;
+    if (rw == SCPE_OK) {
+        for (k = i; k < j; k++)
+            dirty[k]->dirty = FALSE;
+        cache->write_backs += j - i;
+        }
+    else
+        if (r == SCPE_OK)
+            r = rw;
+    }
+free (dirty);
 return r;
 }
 
-t_stat sim_disk_unload (UNIT *uptr)
+/* Release the cache (after flushing it) */
+
+static void _sim_disk_cache_free (UNIT *uptr)
 {
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *cache = ctx ? ctx->cache : NULL;
+struct disk_cache_line *lp;
 
-switch (DK_GET_FMT (uptr)) {                            /* case on format */
-    case DKUF_F_STD:                                    /* Simh */
-    case DKUF_F_VHD:                                    /* VHD format */
-        ctx->media_removed = 1;
-        return sim_disk_detach (uptr);
-    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
-        ctx->media_removed = 1;
-        return sim_os_disk_unload_raw (uptr->fileref);  /* remove/eject disk */
-        break;
-    default:
-        return SCPE_NOFNC;
+if (cache == NULL)
+    return;
+while ((lp = cache->mru) != NULL) {
+    cache->mru = lp->next;
+    free (lp->data);
+    free (lp);
     }
+free (cache->hash);
+free (cache->io_buf);
+free (cache);
+ctx->cache = NULL;
 }
 
-t_stat sim_disk_erase (UNIT *uptr)
+/* Flush and discard any current cache and set up the one the unit's
+   cache size asks for */
+
+static t_stat _sim_disk_cache_setup (UNIT *uptr)
 {
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-uint8 *buf;
-t_lba lba;
-
-if (uptr->flags & UNIT_ATT)
-    return SCPE_UNATT;
+struct disk_cache *cache;
+t_lba total_sectors;
+uint32 hash_size;
+t_stat r;
 
-buf = (uint8 *)calloc (1, ctx->storage_sector_size);
-if (buf == NULL)
+r = _sim_disk_cache_flush (uptr);
+if (r != SCPE_OK)                               /* keep unwritten data */
+    return sim_messagef (r, "%s: Error writing cached data: %s\n", sim_uname (uptr), sim_error_text (r));
+_sim_disk_cache_free (uptr);
+if ((uptr->disk_cache == 0) ||                  /* no cache wanted */
+    (uptr->flags & UNIT_BUFABLE))               /* or the whole disk is buffered in memory */
+    return r;
+cache = (struct disk_cache *)calloc (1, sizeof (*cache));
+if (cache == NULL)
     return SCPE_MEM;
-for (lba = 0; lba < ctx->container_size / ctx->sector_size; lba++)
-    sim_disk_wrsect (uptr, lba, buf, NULL, 1);          /* write sector */
-free (buf);
-return SCPE_OK;
+cache->line_sects = DK_CACHE_LINE_SIZE / ctx->sector_size;
+if (cache->line_sects == 0)
+    cache->line_sects = 1;
+cache->line_size = cache->line_sects * ctx->sector_size;
+cache->max_lines = (uint32)((((t_uint64)uptr->disk_cache) << 20) / cache->line_size);
+if (cache->max_lines < 4)
+    cache->max_lines = 4;
+total_sectors = (t_lba)((uptr->capac*ctx->capac_factor)/(ctx->sector_size/((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+cache->limit = total_sectors / cache->line_sects;
+cache->io_lines = cache->max_lines / 4;
+if (cache->io_lines > DK_CACHE_MAX_IO_LINES)
+    cache->io_lines = DK_CACHE_MAX_IO_LINES;
+for (hash_size = 1; hash_size < cache->max_lines; hash_size <<= 1)
+    ;
+cache->hash_mask = hash_size - 1;
+cache->hash = (struct disk_cache_line **)calloc (hash_size, sizeof (*cache->hash));
+cache->io_buf = (uint8 *)malloc ((size_t)cache->io_lines * cache->line_size);
+if ((cache->hash == NULL) || (cache->io_buf == NULL)) {
+    free (cache->hash);
+    free (cache->io_buf);
+    free (cache);
+    return SCPE_MEM;
+    }
+ctx->cache = cache;
+return r;
 }
 
-/*
-   This routine is called when the simulator stops and any time
-   the asynch mode is changed (enabled or disabled)
-*/
-static void _sim_disk_io_flush (UNIT *uptr)
+/* Set disk cache size */
+
+t_stat sim_disk_set_cache (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
 {
-uint32 f = DK_GET_FMT (uptr);
+uint32 mb;
+t_stat r;
+
+if ((cptr == NULL) || (*cptr == 0))
+    return SCPE_ARG;
+mb = (uint32) get_uint (cptr, 10, DK_CACHE_MAX_MB, &r);
+if (r != SCPE_OK)
+    return SCPE_ARG;
+uptr->disk_cache = mb;
+if (uptr->flags & UNIT_ATT) {                   /* attached?  then resize now */
+#if defined (SIM_ASYNCH_IO)
+    struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+    int asynch_io = ctx->asynch_io;
 
+    sim_disk_clr_async (uptr);                  /* quiesce the I/O thread */
+#endif
+    r = _sim_disk_cache_setup (uptr);
 #if defined (SIM_ASYNCH_IO)
+    if (asynch_io)
+        sim_disk_set_async (uptr, ctx->asynch_io_latency);
+#endif
+    }
+return r;
+}
+
+/* Show disk cache size and statistics */
+
+t_stat sim_disk_show_cache (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-sim_disk_clr_async (uptr);
-if (sim_asynch_enabled)
-    sim_disk_set_async (uptr, ctx->asynch_io_latency);
+if (uptr->disk_cache == 0) {
+    fprintf (st, "no cache");
+    return SCPE_OK;
+    }
+fprintf (st, "cache=%uMB", uptr->disk_cache);
+if ((uptr->flags & UNIT_ATT) && ctx && ctx->cache) {
+    fprintf (st, ", %s hits", sim_fmt_numeric ((double)ctx->cache->hits));
+    fprintf (st, ", %s misses", sim_fmt_numeric ((double)ctx->cache->misses));
+    }
+return SCPE_OK;
+}
+
+/* Memory mapped container access (ACCESS=MMAP)
+
+   The data portion of a SIMH format or RAW container can be mapped into
+   memory, making sector transfers within it a memcpy rather than a seek
+   and a system call.  A writable SIMH container first has storage
+   allocated for the whole disk, extending it if it is shorter.  A store
+   into a hole of a sparse file would otherwise need the host to find
+   space at that moment, and a full host disk would then raise SIGBUS
+   rather than an I/O error.  If the space can't be allocated, or the host
+   can't allocate it ahead of time, the container isn't mapped.
+   Transfers outside the mapping, every other container format and hosts
+   or devices which can't be mapped use the normal path.
+   Flushing schedules the mapped data to be written, and detach waits
+   for it.
+*/
+
+static void _sim_disk_map (UNIT *uptr)
+{
+#if defined (HAVE_DISK_MMAP)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_offset data_size = ((t_offset)((uptr->capac*ctx->capac_factor)/(ctx->sector_size/((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)))) * ctx->sector_size;
+t_offset map_size;
+int fd;
+void *map;
+
+if ((ctx->map != NULL) ||                               /* already mapped */
+    ((uptr->dynflags & UNIT_DISK_MMAP) == 0))           /* or not wanted */
+    return;
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* SIMH format */
+        fflush (uptr->fileref);                         /* nothing may be left buffered */
+        fd = fileno (uptr->fileref);
+        map_size = sim_fsize_ex (uptr->fileref);
+        if ((uptr->flags & UNIT_RO) == 0) {             /* writable? */
+#if defined (HAVE_DISK_FALLOCATE)
+            int err = posix_fallocate (fd, 0, (off_t)data_size);
+
+            if (err != 0) {
+                if (map_size < data_size)               /* undo any extension */
+                    (void)ftruncate (fd, (off_t)map_size);
+                sim_debug_unit (ctx->dbit, uptr, "_sim_disk_map(unit=%d) posix_fallocate failed: %s\n", (int)(uptr - ctx->dptr->units), strerror (err));
+                return;
+                }
+            if (map_size < data_size)
+                map_size = data_size;
+#else
+            return;                                     /* can't reserve space */
 #endif
-switch (f) {                                            /* case on format */
-    case DKUF_F_STD:                                    /* Simh */
-        fflush (uptr->fileref);
-        break;
-    case DKUF_F_VHD:                                    /* Virtual Disk */
-        sim_vhd_disk_flush (uptr->fileref);
+            }
         break;
-    case DKUF_F_RAW:                                    /* Physical */
-        sim_os_disk_flush_raw (uptr->fileref);
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+        fd = (int)((long)uptr->fileref);
+        map_size = sim_os_disk_size_raw (uptr->fileref);
         break;
-        }
+    default:
+        return;
+    }
+if (map_size > data_size)
+    map_size = data_size;
+map_size -= map_size % ctx->sector_size;
+if ((map_size <= 0) ||
+    ((t_offset)((size_t)map_size) != map_size))         /* too large for this host's address space */
+    return;
+map = mmap (NULL, (size_t)map_size, (uptr->flags & UNIT_RO) ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+if (map == MAP_FAILED) {
+    sim_debug_unit (ctx->dbit, uptr, "_sim_disk_map(unit=%d) mmap failed: %s\n", (int)(uptr - ctx->dptr->units), strerror (errno));
+    return;
+    }
+ctx->map = (uint8 *)map;
+ctx->map_size = map_size;
+#endif
 }
 
-static t_stat _err_return (UNIT *uptr, t_stat stat)
+static void _sim_disk_map_flush (UNIT *uptr, t_bool wait)
 {
-free (uptr->filename);
-uptr->filename = NULL;
-free (uptr->disk_ctx);
-uptr->disk_ctx = NULL;
-return stat;
+#if defined (HAVE_DISK_MMAP)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if ((ctx->map != NULL) && ((uptr->flags & UNIT_RO) == 0))
+    msync (ctx->map, (size_t)ctx->map_size, wait ? MS_SYNC : MS_ASYNC);
+#endif
 }
 
-static t_stat _sim_disk_rdsect_interleave (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, uint16 sectpertrack, uint16 interleave, uint16 skew, uint16 offset)
+static void _sim_disk_unmap (UNIT *uptr)
 {
+#if defined (HAVE_DISK_MMAP)
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-t_lba sectno = lba, psa;
-t_stat status;
 
-if (sectsread)
-    *sectsread = 0;
+if (ctx->map == NULL)
+    return;
+_sim_disk_map_flush (uptr, TRUE);
+munmap (ctx->map, (size_t)ctx->map_size);
+ctx->map = NULL;
+ctx->map_size = 0;
+if (DK_GET_FMT (uptr) == DKUF_F_STD)
+    fflush (uptr->fileref);                             /* discard any stale buffered input */
+#endif
+}
 
-do {
-    uint16 i, track, sector;
+/* TRUE if a transfer lies wholly within the mapped part of the container */
 
-    /*
-     * Map an LBA address into a physical sector address
-     */
-    track = sectno / sectpertrack;
-    i = (sectno % sectpertrack) * interleave;
-    if (i >= sectpertrack)
-        i++;
-    sector = (i + (track * skew)) % sectpertrack;
+static t_bool _sim_disk_is_mapped (struct disk_context *ctx, t_lba lba, t_seccnt sects)
+{
+return (ctx->map != NULL) &&
+       ((((t_offset)lba) + sects) * ctx->sector_size <= ctx->map_size);
+}
 
-    psa = sector + (track * sectpertrack) + offset;
+/* Set disk container access method */
 
-    status = sim_disk_rdsect(uptr, psa, buf, NULL, 1);
-    sects--;
-    buf += ctx->sector_size;
-    sectno++;
-    if (sectsread)
-        *sectsread += 1;
-    } while ((sects != 0) && (status == SCPE_OK));
+t_stat sim_disk_set_access (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+char gbuf[CBUFSIZE];
 
-return status;
+if ((cptr == NULL) || (*cptr == 0))
+    return SCPE_ARG;
+get_glyph (cptr, gbuf, 0);
+if (strcmp (gbuf, "MMAP") == 0)
+    uptr->dynflags |= UNIT_DISK_MMAP;
+else {
+    if (strcmp (gbuf, "STDIO") != 0)
+        return sim_messagef (SCPE_ARG, "Unknown disk access method: %s\n", gbuf);
+    uptr->dynflags &= ~UNIT_DISK_MMAP;
+    }
+if (uptr->flags & UNIT_ATT) {                           /* attached?  then switch now */
+#if defined (SIM_ASYNCH_IO)
+    struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+    int asynch_io = ctx->asynch_io;
+
+    sim_disk_clr_async (uptr);                          /* quiesce the I/O thread */
+#endif
+    if (uptr->dynflags & UNIT_DISK_MMAP)
+        _sim_disk_map (uptr);
+    else
+        _sim_disk_unmap (uptr);
+#if defined (SIM_ASYNCH_IO)
+    if (asynch_io)
+        sim_disk_set_async (uptr, ctx->asynch_io_latency);
+#endif
+    }
+return SCPE_OK;
 }
 
-/*
- * Version of sim_disk_rdsect() specifically for filesystem detection of DEC
- * file systems. The routine handles regular DEC disks (physsectsz == 0) and
- * RX01/RX02 disks (physsectsz == 128 or == 256) which ignore track 0,
- * interleave physical sectors 2:1 for the remaining tracks and have a skew
- * 6 sectors at the end of a track.
- */
-#define RX0xNSECT               26                      /* 26 sectors/track */
-#define RX0xINTER               2                       /* 2 sector interleave */
-#define RX0xISKEW               6                       /* 6 sectors interleave per track */
+/* Show disk container access method */
 
-static t_stat _DEC_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, uint32 physsectsz)
+t_stat sim_disk_show_access (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
 {
-if (physsectsz == 0)            /* Use device natural sector size */
-    return sim_disk_rdsect(uptr, lba, buf, sectsread, sects);
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-return _sim_disk_rdsect_interleave(uptr, lba, buf, sectsread, sects, RX0xNSECT, RX0xINTER, RX0xISKEW, RX0xNSECT);
+if ((uptr->flags & UNIT_ATT) && ctx)                    /* attached?  show what's in use */
+    fprintf (st, "%s access", (ctx->map != NULL) ? "MMAP" : "STDIO");
+else
+    fprintf (st, "%s access", (uptr->dynflags & UNIT_DISK_MMAP) ? "MMAP" : "STDIO");
+return SCPE_OK;
 }
 
-#pragma pack(push,1)
-typedef struct _ODS1_HomeBlock
-    {
-    uint16  hm1_w_ibmapsize;
-    uint32  hm1_l_ibmaplbn;
-    uint16  hm1_w_maxfiles;
-    uint16  hm1_w_cluster;
-    uint16  hm1_w_devtype;
-    uint16  hm1_w_structlev;
-#define HM1_C_LEVEL1    0401
-#define HM1_C_LEVEL2    0402
-    uint8   hm1_t_volname[12];
-    uint8   hm1_b_fill_1[4];
-    uint16  hm1_w_volowner;
-    uint16  hm1_w_protect;
-    uint16  hm1_w_volchar;
-    uint16  hm1_w_fileprot;
-    uint8   hm1_b_fill_2[6];
-    uint8   hm1_b_window;
-    uint8   hm1_b_extend;
-    uint8   hm1_b_lru_lim;
-    uint8   hm1_b_fill_3[11];
-    uint16  hm1_w_checksum1;
-    uint8   hm1_t_credate[14];
-    uint8   hm1_b_fill_4[382];
-    uint32  hm1_l_serialnum;
-    uint8   hm1_b_fill_5[12];
-    uint8   hm1_t_volname2[12];
-    uint8   hm1_t_ownername[12];
-    uint8   hm1_t_format[12];
-    uint8   hm1_t_fill_6[2];
-    uint16  hm1_w_checksum2;
-    } ODS1_HomeBlock;
+/* Read Sectors */
 
-    typedef struct _ODS2_HomeBlock
-    {
-    uint32 hm2_l_homelbn;
-    uint32 hm2_l_alhomelbn;
-    uint32 hm2_l_altidxlbn;
-    uint8  hm2_b_strucver;
-    uint8  hm2_b_struclev;
-    uint16 hm2_w_cluster;
-    uint16 hm2_w_homevbn;
-    uint16 hm2_w_alhomevbn;
-    uint16 hm2_w_altidxvbn;
-    uint16 hm2_w_ibmapvbn;
-    uint32 hm2_l_ibmaplbn;
-    uint32 hm2_l_maxfiles;
-    uint16 hm2_w_ibmapsize;
-    uint16 hm2_w_resfiles;
-    uint16 hm2_w_devtype;
-    uint16 hm2_w_rvn;
-    uint16 hm2_w_setcount;
-    uint16 hm2_w_volchar;
-    uint32 hm2_l_volowner;
-    uint32 hm2_l_reserved;
-    uint16 hm2_w_protect;
-    uint16 hm2_w_fileprot;
-    uint16 hm2_w_reserved;
-    uint16 hm2_w_checksum1;
-    uint32 hm2_q_credate[2];
-    uint8  hm2_b_window;
-    uint8  hm2_b_lru_lim;
-    uint16 hm2_w_extend;
-    uint32 hm2_q_retainmin[2];
-    uint32 hm2_q_retainmax[2];
-    uint32 hm2_q_revdate[2];
-    uint8  hm2_r_min_class[20];
-    uint8  hm2_r_max_class[20];
-    uint8  hm2_r_reserved[320];
-    uint32 hm2_l_serialnum;
-    uint8  hm2_t_strucname[12];
-    uint8  hm2_t_volname[12];
-    uint8  hm2_t_ownername[12];
-    uint8  hm2_t_format[12];
-    uint16 hm2_w_reserved2;
-    uint16 hm2_w_checksum2;
-    } ODS2_HomeBlock;
+static t_stat _sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+t_offset da;
+uint32 err, tbc;
+size_t i;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-typedef struct _ODS1_FileHeader
-    {
-    uint8   fh1_b_idoffset;
-    uint8   fh1_b_mpoffset;
-    uint16  fh1_w_fid_num;
-    uint16  fh1_w_fid_seq;
-    uint16  fh1_w_struclev;
-    uint16  fh1_w_fileowner;
-    uint16  fh1_w_fileprot;
-    uint16  fh1_w_filechar;
-    uint16  fh1_w_recattr;
-    uint8   fh1_b_fill_1[494];
-    uint16  fh1_w_checksum;
-    } ODS1_FileHeader;
+sim_debug_unit (ctx->dbit, uptr, "_sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
 
-typedef struct _ODS2_FileHeader
-    {
-    uint8  fh2_b_idoffset;
-    uint8  fh2_b_mpoffset;
-    uint8  fh2_b_acoffset;
-    uint8  fh2_b_rsoffset;
-    uint16 fh2_w_seg_num;
-    uint16 fh2_w_structlev;
-    uint16 fh2_w_fid[3];
-    uint16 fh2_w_ext_fid[3];
-    uint16 fh2_w_recattr[16];
-    uint32 fh2_l_filechar;
-    uint16 fh2_w_remaining[228];
-    } ODS2_FileHeader;
+da = ((t_offset)lba) * ctx->sector_size;
+tbc = sects * ctx->sector_size;
+if (sectsread)
+    *sectsread = 0;
+while (tbc) {
+    size_t sectbytes;
 
-typedef union _ODS2_Retreval
-    {
-        struct
-            {
-            unsigned fm2___fill   : 14;       /* type specific data               */
-            unsigned fm2_v_format : 2;        /* format type code                 */
-            } fm2_r_word0_bits;
-        struct
-            {
-            unsigned fm2_v_exact    : 1;      /* exact placement specified        */
-            unsigned fm2_v_oncyl    : 1;      /* on cylinder allocation desired   */
-            unsigned fm2___fill     : 10;
-            unsigned fm2_v_lbn      : 1;      /* use LBN of next map pointer      */
-            unsigned fm2_v_rvn      : 1;      /* place on specified RVN           */
-            unsigned fm2_v_format0  : 2;
-            } fm2_r_map_bits0;
-        struct
-            {
-            unsigned fm2_b_count1   : 8;      /* low byte described below         */
-            unsigned fm2_v_highlbn1 : 6;      /* high order LBN                   */
-            unsigned fm2_v_format1  : 2;
-            unsigned fm2_w_lowlbn1  : 16;     /* low order LBN                    */
-            } fm2_r_map_bits1;
-        struct
-            {
-            struct
-                {
-                unsigned fm2_v_count2   : 14; /* count field                      */
-                unsigned fm2_v_format2  : 2;
-                unsigned fm2_l_lowlbn2  : 16; /* low order LBN                    */
-                } fm2_r_map2_long0;
-            uint16 fm2_l_highlbn2;            /* high order LBN                   */
-            } fm2_r_map_bits2;
-        struct
-            {
-            struct
-                {
-                unsigned fm2_v_highcount3 : 14; /* low order count field          */
-                unsigned fm2_v_format3  : 2;
-                unsigned fm2_w_lowcount3 : 16;  /* high order count field         */
-                } fm2_r_map3_long0;
-            uint32 fm2_l_lbn3;
-            } fm2_r_map_bits3;
-    } ODS2_Retreval;
+    clearerr (uptr->fileref);
+    err = sim_fseeko (uptr->fileref, da, SEEK_SET);          /* set pos */
+    if (err)
+        return SCPE_IOERR;
+    i = sim_fread (buf, 1, tbc, uptr->fileref);
+    if (i < tbc)                 /* fill */
+        memset (&buf[i], 0, tbc-i);
+    if ((i == 0) &&             /* Reading at or past EOF? */
+        feof (uptr->fileref))
+        i = tbc;                /* return 0's which have already been filled in buffer */
+    sectbytes = (i / ctx->sector_size) * ctx->sector_size;
+    if (i > sectbytes)
+        sectbytes += ctx->sector_size;
+    if (sectsread)
+        *sectsread += sectbytes / ctx->sector_size;
+    err = ferror (uptr->fileref);
+    if (err)
+        return SCPE_IOERR;
+    tbc -= sectbytes;
+    if ((tbc == 0) || (i == 0))
+        return SCPE_OK;
+    da += sectbytes;
+    buf += sectbytes;
+    }
+return SCPE_OK;
+}
 
-typedef struct _ODS1_Retreval
-    {
-    uint8   fm1_b_ex_segnum;
-    uint8   fm1_b_ex_rvn;
-    uint16  fm1_w_ex_filnum;
-    uint16  fm1_w_ex_filseq;
-    uint8   fm1_b_countsize;
-    uint8   fm1_b_lbnsize;
-    uint8   fm1_b_inuse;
-    uint8   fm1_b_avail;
-    union {
-        struct {
-            uint8 fm1_b_highlbn;
-            uint8 fm1_b_count;
-            uint16 fm1_w_lowlbn;
-            } fm1_s_fm1def1;
-        struct {
-            uint8 fm1_b_highlbn;
-            uint8 fm1_b_count;
-            uint16 fm1_w_lowlbn;
-            } fm1_s_fm1def2;
-        } fm1_pointers[4];
-    } ODS1_Retreval;
+t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-typedef struct _ODS1_StorageControlBlock
-    {
-    uint8  scb_b_unused[3];
-    uint8  scb_b_bitmapblks;
-    struct _bitmapblk {
-        uint16 scb_w_freeblks;
-        uint16 scb_w_freeptr;
-        } scb_r_blocks[1];
-    } ODS1_SCB;
-
-
-typedef struct _ODS2_StorageControlBlock
-    {
-    uint8  scb_b_strucver;   /* 1 */
-    uint8  scb_b_struclev;   /* 2 */
-    uint16 scb_w_cluster;
-    uint32 scb_l_volsize;
-    uint32 scb_l_blksize;
-    uint32 scb_l_sectors;
-    uint32 scb_l_tracks;
-    uint32 scb_l_cylinder;
-    uint32 scb_l_status;
-    uint32 scb_l_status2;
-    uint16 scb_w_writecnt;
-    uint8  scb_t_volockname[12];
-    uint32 scb_q_mounttime[2];
-    uint16 scb_w_backrev;
-    uint32 scb_q_genernum[2];
-    uint8  scb_b_reserved[446];
-    uint16 scb_w_checksum;
-    } ODS2_SCB;
-#pragma pack(pop)
-
-static uint16
-ODSChecksum (void *Buffer, uint16 WordCount)
-    {
-    int i;
-    uint16 CheckSum = 0;
-    uint16 *Buf = (uint16 *)Buffer;
+sim_debug_unit (ctx->dbit, uptr, "sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
 
-    for (i=0; i<WordCount; i++)
-        CheckSum += Buf[i];
-    return CheckSum;
+ctx->read_count++;                                      /* record read operation */
+if ((sects == 1) &&                                     /* Single sector reads */
+    (lba >= (uptr->capac*ctx->capac_factor)/(ctx->sector_size/((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)))) {/* beyond the end of the disk */
+    memset (buf, '\0', ctx->sector_size);               /* are bad block management efforts - zero buffer */
+    if (sectsread)
+        *sectsread = 1;
+    return SCPE_OK;                                     /* return success */
     }
+if (ctx->cache)
+    return _sim_disk_cache_read (uptr, lba, buf, sectsread, sects);
+return _sim_disk_read (uptr, lba, buf, sectsread, sects);
+}
 
+/* Read sectors from the container, in whatever format it has */
 
-static t_offset get_ods2_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+static t_stat _sim_disk_read (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
 {
-DEVICE *dptr;
-t_addr saved_capac;
+t_stat r;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-t_offset temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
-ODS2_HomeBlock Home;
-ODS2_FileHeader Header;
-ODS2_Retreval *Retr;
-ODS2_SCB Scb;
-uint16 CheckSum1, CheckSum2;
-uint32 ScbLbn = 0;
-t_offset ret_val = (t_offset)-1;
-t_seccnt sects_read;
+uint32 f = DK_GET_FMT (uptr);
+t_seccnt sread = 0;
 
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return ret_val;
-saved_capac = uptr->capac;
-uptr->capac = (t_addr)temp_capac;
-if ((_DEC_rdsect (uptr, 512 / ctx->sector_size, (uint8 *)&Home, &sects_read, sizeof (Home) / ctx->sector_size, physsectsz)) ||
-    (sects_read != (sizeof (Home) / ctx->sector_size)))
-    goto Return_Cleanup;
-CheckSum1 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm2_w_checksum1)-((char *)&Home.hm2_l_homelbn))/2));
-CheckSum2 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm2_w_checksum2)-((char *)&Home.hm2_l_homelbn))/2));
-if ((Home.hm2_l_homelbn == 0) ||
-    (Home.hm2_l_alhomelbn == 0) ||
-    (Home.hm2_l_altidxlbn == 0) ||
-    ((Home.hm2_b_struclev != 2) && (Home.hm2_b_struclev != 5)) ||
-    (Home.hm2_b_strucver == 0) ||
-    (Home.hm2_w_cluster == 0) ||
-    (Home.hm2_w_homevbn == 0) ||
-    (Home.hm2_w_alhomevbn == 0) ||
-    (Home.hm2_w_ibmapvbn == 0) ||
-    (Home.hm2_l_ibmaplbn == 0) ||
-    (Home.hm2_w_resfiles >= Home.hm2_l_maxfiles) ||
-    (Home.hm2_w_ibmapsize == 0) ||
-    (Home.hm2_w_resfiles < 5) ||
-    (Home.hm2_w_checksum1 != CheckSum1) ||
-    (Home.hm2_w_checksum2 != CheckSum2))
-    goto Return_Cleanup;
-if ((_DEC_rdsect (uptr, (Home.hm2_l_ibmaplbn+Home.hm2_w_ibmapsize+1) * (512 / ctx->sector_size),
-                  (uint8 *)&Header, &sects_read, sizeof (Header) / ctx->sector_size, physsectsz)) ||
-    (sects_read != (sizeof (Header) / ctx->sector_size)))
-    goto Return_Cleanup;
-CheckSum1 = ODSChecksum (&Header, 255);
-if (CheckSum1 != *(((uint16 *)&Header)+255)) /* Verify Checksum on BITMAP.SYS file header */
-    goto Return_Cleanup;
-Retr = (ODS2_Retreval *)(((uint16*)(&Header))+Header.fh2_b_mpoffset);
-/* The BitMap File has a single extent, which may be preceded by a placement descriptor */
-if (Retr->fm2_r_word0_bits.fm2_v_format == 0)
-    Retr = (ODS2_Retreval *)(((uint16 *)Retr)+1); /* skip placement descriptor */
-switch (Retr->fm2_r_word0_bits.fm2_v_format)
-    {
-    case 1:
-        ScbLbn = (Retr->fm2_r_map_bits1.fm2_v_highlbn1<<16)+Retr->fm2_r_map_bits1.fm2_w_lowlbn1;
-        break;
-    case 2:
-        ScbLbn = (Retr->fm2_r_map_bits2.fm2_l_highlbn2<<16)+Retr->fm2_r_map_bits2.fm2_r_map2_long0.fm2_l_lowlbn2;
-        break;
-    case 3:
-        ScbLbn = Retr->fm2_r_map_bits3.fm2_l_lbn3;
-        break;
+if (_sim_disk_is_mapped (ctx, lba, sects)) {            /* Memory mapped? */
+    memcpy (buf, ctx->map + ((size_t)lba) * ctx->sector_size, ((size_t)sects) * ctx->sector_size);
+    if (sectsread)
+        *sectsread = sects;
+    sim_buf_swap_data (buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
+    return SCPE_OK;
     }
-Retr = (ODS2_Retreval *)(((uint16 *)Retr)+Retr->fm2_r_word0_bits.fm2_v_format+1);
-if ((_DEC_rdsect (uptr, ScbLbn * (512 / ctx->sector_size), (uint8 *)&Scb, &sects_read, sizeof (Scb) / ctx->sector_size, physsectsz)) ||
-    (sects_read != (sizeof (Scb) / ctx->sector_size)))
-    goto Return_Cleanup;
-CheckSum1 = ODSChecksum (&Scb, 255);
-if (CheckSum1 != *(((uint16 *)&Scb)+255)) /* Verify Checksum on Storage Control Block */
-    goto Return_Cleanup;
-if ((Scb.scb_w_cluster != Home.hm2_w_cluster) ||
-    (Scb.scb_b_strucver != Home.hm2_b_strucver) ||
-    (Scb.scb_b_struclev != Home.hm2_b_struclev))
-    goto Return_Cleanup;
-sim_messagef (SCPE_OK, "%s: '%s' Contains ODS%d File system\n", sim_uname (uptr), uptr->filename, Home.hm2_b_struclev);
-sim_messagef (SCPE_OK, "%s: Volume Name: %12.12s Format: %12.12s Sectors In Volume: %u\n",
-                                   sim_uname (uptr), Home.hm2_t_volname, Home.hm2_t_format, Scb.scb_l_volsize);
-ret_val = ((t_offset)Scb.scb_l_volsize) * 512;
+if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Aligned & whole sector transfers */
+    ((0 == ((lba*ctx->sector_size) & (ctx->storage_sector_size - 1))) &&
+     (0 == ((sects*ctx->sector_size) & (ctx->storage_sector_size - 1)))) ||
+    (f == DKUF_F_STD) || (f == DKUF_F_VHD) || (f == DKUF_F_SIMHX)) { /* or SIMH, VHD or SIMHX formats */
+    switch (f) {                                        /* case on format */
+        case DKUF_F_STD:                                /* SIMH format */
+            r = _sim_disk_rdsect (uptr, lba, buf, &sread, sects);
+            break;
+        case DKUF_F_VHD:                                /* VHD format */
+            r = sim_vhd_disk_rdsect (uptr, lba, buf, &sread, sects);
+            break;
+        case DKUF_F_SIMHX:                              /* SIMHX format */
+            r = sim_simhx_disk_rdsect (uptr, lba, buf, &sread, sects);
+            break;
+        case DKUF_F_RAW:                                /* Raw Physical Disk Access */
+            r = sim_os_disk_rdsect (uptr, lba, buf, &sread, sects);
+            break;
+        default:
+            return SCPE_NOFNC;
+        }
+    if (sectsread)
+        *sectsread = sread;
+    sim_buf_swap_data (buf, ctx->xfer_element_size, (sread * ctx->sector_size) / ctx->xfer_element_size);
+    return r;
+    }
+else { /* Unaligned and/or partial sector transfers in RAW mode */
+    size_t tbufsize = sects * ctx->sector_size + 2 * ctx->storage_sector_size;
+    uint8 *tbuf = (uint8*) malloc (tbufsize);
+    t_offset ssaddr = (lba * (t_offset)ctx->sector_size) & ~(t_offset)(ctx->storage_sector_size -1);
+    uint32 soffset = (uint32)((lba * (t_offset)ctx->sector_size) - ssaddr);
+    uint32 bytesread;
 
-Return_Cleanup:
-uptr->capac = saved_capac;
-if (readonly)
-    *readonly = sim_disk_wrp (uptr);
-return ret_val;
+    if (sectsread)
+        *sectsread = 0;
+    if (tbuf == NULL)
+        return SCPE_MEM;
+    r = sim_os_disk_read (uptr, ssaddr, tbuf, &bytesread, tbufsize & ~(ctx->storage_sector_size - 1));
+    sim_buf_swap_data (tbuf + soffset, ctx->xfer_element_size, (bytesread - soffset) / ctx->xfer_element_size);
+    memcpy (buf, tbuf + soffset, sects * ctx->sector_size);
+    if (sectsread) {
+        *sectsread = (bytesread - soffset) / ctx->sector_size;
+        if (*sectsread > sects)
+            *sectsread = sects;
+        }
+    free (tbuf);
+    return r;
+    }
 }
 
-static t_offset get_ods1_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+t_stat sim_disk_rdsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, DISK_PCALLBACK callback)
 {
-DEVICE *dptr;
-t_addr saved_capac;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
-ODS1_HomeBlock Home;
-ODS1_FileHeader Header;
-ODS1_Retreval *Retr;
-uint8 scb_buf[512];
-ODS1_SCB *Scb = (ODS1_SCB *)scb_buf;
-uint16 CheckSum1, CheckSum2;
-uint32 ScbLbn;
-t_offset ret_val = (t_offset)-1;
-t_seccnt sects_read;
-
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return ret_val;
-saved_capac = uptr->capac;
-uptr->capac = temp_capac;
-if ((_DEC_rdsect (uptr, 512 / ctx->sector_size, (uint8 *)&Home, &sects_read, sizeof (Home) / ctx->sector_size, physsectsz)) ||
-    (sects_read != (sizeof (Home) / ctx->sector_size)))
-    goto Return_Cleanup;
-CheckSum1 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm1_w_checksum1)-((char *)&Home.hm1_w_ibmapsize))/2));
-CheckSum2 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm1_w_checksum2)-((char *)&Home.hm1_w_ibmapsize))/2));
-if ((Home.hm1_w_ibmapsize == 0) ||
-    (Home.hm1_l_ibmaplbn == 0) ||
-    (Home.hm1_w_maxfiles == 0) ||
-    (Home.hm1_w_cluster != 1) ||
-    ((Home.hm1_w_structlev != HM1_C_LEVEL1) && (Home.hm1_w_structlev != HM1_C_LEVEL2)) ||
-    (Home.hm1_l_ibmaplbn == 0) ||
-    (Home.hm1_w_checksum1 != CheckSum1) ||
-    (Home.hm1_w_checksum2 != CheckSum2))
-    goto Return_Cleanup;
-if ((_DEC_rdsect (uptr, (((Home.hm1_l_ibmaplbn << 16) + ((Home.hm1_l_ibmaplbn >> 16) & 0xFFFF)) + Home.hm1_w_ibmapsize + 1) * (512 / ctx->sector_size),
-                  (uint8 *)&Header, &sects_read, sizeof (Header) / ctx->sector_size, physsectsz)) ||
-    (sects_read != (sizeof (Header) / ctx->sector_size)))
-    goto Return_Cleanup;
-CheckSum1 = ODSChecksum (&Header, 255);
-if (CheckSum1 != *(((uint16 *)&Header)+255)) /* Verify Checksum on BITMAP.SYS file header */
-    goto Return_Cleanup;
-
-Retr = (ODS1_Retreval *)(((uint16*)(&Header))+Header.fh1_b_mpoffset);
-ScbLbn = (Retr->fm1_pointers[0].fm1_s_fm1def1.fm1_b_highlbn<<16)+Retr->fm1_pointers[0].fm1_s_fm1def1.fm1_w_lowlbn;
-if ((_DEC_rdsect (uptr, ScbLbn * (512 / ctx->sector_size), (uint8 *)Scb, &sects_read, 512 / ctx->sector_size, physsectsz)) ||
-    (sects_read != (512 / ctx->sector_size)))
-    goto Return_Cleanup;
-if (Scb->scb_b_bitmapblks < 127)
-    ret_val = (((t_offset)Scb->scb_r_blocks[Scb->scb_b_bitmapblks].scb_w_freeblks << 16) + Scb->scb_r_blocks[Scb->scb_b_bitmapblks].scb_w_freeptr) * 512;
-else
-    ret_val = (((t_offset)Scb->scb_r_blocks[0].scb_w_freeblks << 16) + Scb->scb_r_blocks[0].scb_w_freeptr) * 512;
-sim_messagef (SCPE_OK, "%s: '%s' Contains an ODS1 File system\n", sim_uname (uptr), uptr->filename);
-sim_messagef (SCPE_OK, "%s: Volume Name: %12.12s Format: %12.12s Sectors In Volume: %u\n",
-                                sim_uname (uptr), Home.hm1_t_volname, Home.hm1_t_format, (uint32)(ret_val / 512));
-Return_Cleanup:
-uptr->capac = saved_capac;
-if (readonly)
-    *readonly = sim_disk_wrp (uptr);
-return ret_val;
+t_stat r = SCPE_OK;
+AIO_CALLSETUP
+    r = sim_disk_rdsect (uptr, lba, buf, sectsread, sects);
+AIO_CALL(DOP_RSEC, lba, buf, sectsread, sects, callback);
+return r;
 }
 
-typedef struct ultrix_disklabel {
-    uint32  pt_magic;       /* magic no. indicating part. info exits */
-    uint32  pt_valid;       /* set by driver if pt is current */
-    struct  pt_info {
-        uint32  pi_nblocks; /* no. of sectors */
-        uint32  pi_blkoff;  /* block offset for start */
-        } pt_part[8];
-    } ultrix_disklabel;
-
-#define PT_MAGIC        0x032957        /* Partition magic number */
-#define PT_VALID        1               /* Indicates if struct is valid */
+/* Write Sectors */
 
-static t_offset get_ultrix_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+static t_stat _sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
 {
-DEVICE *dptr;
-t_addr saved_capac;
+t_offset da;
+uint32 err, tbc;
+size_t i;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
-uint8 sector_buf[512];
-ultrix_disklabel *Label = (ultrix_disklabel *)(sector_buf + sizeof (sector_buf) - sizeof (ultrix_disklabel));
-t_offset ret_val = (t_offset)-1;
-int i;
-uint32 max_lbn = 0, max_lbn_partnum = 0;
-t_seccnt sects_read;
 
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return ret_val;
-saved_capac = uptr->capac;
-uptr->capac = temp_capac;
-if ((_DEC_rdsect (uptr, 31 * (512 / ctx->sector_size), sector_buf, &sects_read, 512 / ctx->sector_size, physsectsz)) ||
-    (sects_read != (512 / ctx->sector_size)))
-    goto Return_Cleanup;
+sim_debug_unit (ctx->dbit, uptr, "_sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
 
-if ((Label->pt_magic != PT_MAGIC) ||
-    (Label->pt_valid != PT_VALID))
-    goto Return_Cleanup;
+da = ((t_offset)lba) * ctx->sector_size;
+tbc = sects * ctx->sector_size;
+if (sectswritten)
+    *sectswritten = 0;
+err = sim_fseeko (uptr->fileref, da, SEEK_SET);          /* set pos */
+if (err)
+    return SCPE_IOERR;
+i = sim_fwrite (buf, ctx->xfer_element_size, tbc/ctx->xfer_element_size, uptr->fileref);
+if (sectswritten)
+    *sectswritten += (t_seccnt)((i * ctx->xfer_element_size + ctx->sector_size - 1)/ctx->sector_size);
+err = ferror (uptr->fileref);
+if (err)
+    return SCPE_IOERR;
+return SCPE_OK;
+}
 
-for (i = 0; i < 8; i++) {
-    uint32 end_lbn = Label->pt_part[i].pi_blkoff + Label->pt_part[i].pi_nblocks;
-    if (end_lbn > max_lbn) {
-        max_lbn = end_lbn;
-        max_lbn_partnum = i;
-        }
-    }
-sim_messagef (SCPE_OK, "%s: '%s' Contains Ultrix partitions\n", sim_uname (uptr), uptr->filename);
-sim_messagef (SCPE_OK, "Partition with highest sector: %c, Sectors On Disk: %u\n", 'a' + max_lbn_partnum, max_lbn);
-ret_val = ((t_offset)max_lbn) * 512;
+t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_stat r;
+t_seccnt written = 0;
 
-Return_Cleanup:
-uptr->capac = saved_capac;
-if (readonly)
-    *readonly = sim_disk_wrp (uptr);
-return ret_val;
-}
+sim_debug_unit (ctx->dbit, uptr, "sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
 
+if (sectswritten)
+    *sectswritten = 0;
+ctx->write_count++;                                     /* record write operation */
+if (uptr->dynflags & UNIT_DISK_CHK) {
+    DEVICE *dptr = find_dev_from_unit (uptr);
+    uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
+    t_lba total_sectors = (t_lba)((uptr->capac*capac_factor)/(ctx->sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1)));
+    t_lba sect;
 
-/* ISO 9660 Volume Recognizer - Structure Info gathered from: https://wiki.osdev.org/ISO_9660 */
+    for (sect = 0; sect < sects; sect++) {
+        t_lba offset;
+        t_bool sect_error = FALSE;
 
-typedef struct ISO_9660_Volume_Descriptor {
-    uint8   Type;                       // Volume Descriptor type code (0, 1, 2, 3 and 255)
-    uint8   Identifier[5];              // Always 'CD001'.
-    uint8   Version;                    // Volume Descriptor Version (0x01).
-    uint8   Data[2041];                 // Depends on the volume descriptor type.
-    } ISO_9660_Volume_Descriptor;
+        for (offset = 0; offset < ctx->sector_size; offset += sizeof(uint32)) {
+            if (*((uint32 *)&buf[sect*ctx->sector_size + offset]) != (uint32)(lba + sect)) {
+                sect_error = TRUE;
+                break;
+                }
+            }
+        if (sect_error) {
+            uint32 save_dctrl = dptr->dctrl;
+            FILE *save_sim_deb = sim_deb;
 
-typedef struct ISO_9660_Primary_Volume_Descriptor {
-    uint8   Type;                       // Always 0x01 for a Primary Volume Descriptor.
-    uint8   Identifier[5];              // Always 'CD001'.
-    uint8   Version;                    // Always 0x01.
-    uint8   Unused;                     // Always 0x00.
-    uint8   SystemIdentifier[32];       // The name of the system that can act upon sectors 0x00-0x0F for the volume.
-    uint8   VolumeIdentifier[32];       // Identification of this volume.
-    uint8   UnusedField[8];             // All zeros.
-    uint32  VolumeSpaceSize[2];         // Number of Logical Blocks in which the volume is recorded
-    uint8   UnusedField2[32];           // All zeroes.
-    uint16  VolumeSetSize[2];           // The size of the set in this logical volume (number of disks).
-    uint16  VolumeSequenceNumber[2];    // The number of this disk in the Volume Set.
-    uint16  LogicalBlockSize[2];        // The size in bytes of a logical block. NB: This means that a logical block on a CD could be something other than 2 KiB!
-    uint32  PathTableSize[2];           // The size in bytes of the path table.
-    uint32  LocationTypeLPathTable;     // LBA location of the path table. The path table pointed to contains only little-endian values.
-    uint32  LocationOptTypeLPathTable;  // LBA location of the optional path table. The path table pointed to contains only little-endian values. Zero means that no optional path table exists.
-    uint32  LocationTypeMPathTable;     // LBA location of the path table. The path table pointed to contains only big-endian values.
-    uint32  LocationOptTypeMPathTable;  // LBA location of the optional path table. The path table pointed to contains only big-endian values. Zero means that no optional path table exists.
-    uint8   DirectoryEntryRootDirectory[34];// Note that this is not an LBA address, it is the actual Directory Record, which contains a single byte Directory Identifier (0x00), hence the fixed 34 byte size.
-    uint8   VolumeSetIdentifier[128];   // Identifier of the volume set of which this volume is a member.
-    uint8   PublisherIdentifier[128];   // The volume publisher. For extended publisher information, the first byte should be 0x5F, followed by the filename of a file in the root directory. If not specified, all bytes should be 0x20.
-    uint8   DataPreparerIdentifier[128];// The identifier of the person(s) who prepared the data for this volume. For extended preparation information, the first byte should be 0x5F, followed by the filename of a file in the root directory. If not specified, all bytes should be 0x20.
-    uint8   ApplicationIdentifier[128]; // Identifies how the data are recorded on this volume. For extended information, the first byte should be 0x5F, followed by the filename of a file in the root directory. If not specified, all bytes should be 0x20.
-    uint8   CopyrightFileIdentifier[37];// Filename of a file in the root directory that contains copyright information for this volume set. If not specified, all bytes should be 0x20.
-    uint8   AbstractFileIdentifier[37]; // Filename of a file in the root directory that contains abstract information for this volume set. If not specified, all bytes should be 0x20.
-    uint8   BibliographicFileIdentifier[37];// Filename of a file in the root directory that contains bibliographic information for this volume set. If not specified, all bytes should be 0x20.
-    uint8   VolumeCreationDateTime[17]; // The date and time of when the volume was created.
-    uint8   VolumeModificationDateTime[17];// The date and time of when the volume was modified.
-    uint8   VolumeExpirationDateTime[17];// The date and time after which this volume is considered to be obsolete. If not specified, then the volume is never considered to be obsolete.
-    uint8   VolumeEffectiveDateTime[17];// The date and time after which the volume may be used. If not specified, the volume may be used immediately.
-    uint8   FileStructureVersion;       // The directory records and path table version (always 0x01).
-    uint8   Unused2;                    // Always 0x00.
-    uint8   ApplicationUsed[512];       // Contents not defined by ISO 9660.
-    uint8   Reserved[653];              // Reserved by ISO.
-    } ISO_9660_Primary_Volume_Descriptor;
+            sim_printf ("\n%s: Write Address Verification Error on lbn %d(0x%X) of %d(0x%X).\n", sim_uname (uptr), (int)(lba+sect), (int)(lba+sect), (int)total_sectors, (int)total_sectors);
+            dptr->dctrl = 0xFFFFFFFF;
+            sim_deb = save_sim_deb ? save_sim_deb : stdout;
+            sim_disk_data_trace (uptr, buf+sect*ctx->sector_size, lba+sect, ctx->sector_size,    "Found", TRUE, 1);
+            dptr->dctrl = save_dctrl;
+            sim_deb = save_sim_deb;
+            }
+        }
+    }
+if (ctx->cache)
+    r = _sim_disk_cache_write (uptr, lba, buf, &written, sects);
+else
+    r = _sim_disk_write (uptr, lba, buf, &written, sects);
+if (sectswritten)
+    *sectswritten = written;
+if (written > 0) {
+    t_offset da = ((t_offset)lba) * ctx->sector_size;
+    t_offset end_write = da + (written * ctx->sector_size);
 
-static t_offset get_iso9660_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+    if (ctx->highwater < end_write)
+        ctx->highwater = end_write;
+    }
+return r;
+}
+
+/* Write sectors to the container, in whatever format it has */
+
+static t_stat _sim_disk_write (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
 {
-DEVICE *dptr;
-t_addr saved_capac;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
-uint8 sector_buf[2048];
-ISO_9660_Volume_Descriptor *Desc = (ISO_9660_Volume_Descriptor *)sector_buf;
-uint8 primary_buf[2048];
-ISO_9660_Primary_Volume_Descriptor *Primary = NULL;
-t_lba sectfactor = sizeof (*Desc) / ctx->sector_size;
-t_offset ret_val = (t_offset)-1;
-t_offset cur_pos = 32768;           /* Beyond the boot area of an ISO 9660 image */
-t_seccnt sectsread;
-int read_count = 0;
-
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return ret_val;
-saved_capac = uptr->capac;
-uptr->capac = temp_capac;
+uint32 f = DK_GET_FMT (uptr);
+t_stat r;
+uint8 *tbuf = NULL;
+t_seccnt written = 0;
 
-while (sim_disk_rdsect(uptr, (t_lba)(sectfactor * cur_pos / sizeof (*Desc)), (uint8 *)Desc, &sectsread, sectfactor) == DKSE_OK) {
-    if ((sectsread != sectfactor)               ||
-        (Desc->Version != 1)                    ||
-        (0 != memcmp (Desc->Identifier, "CD001", sizeof (Desc->Identifier))))
+if (_sim_disk_is_mapped (ctx, lba, sects)) {            /* Memory mapped? */
+    sim_buf_copy_swapped (ctx->map + ((size_t)lba) * ctx->sector_size, buf,
+                          ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
+    if (sectswritten)
+        *sectswritten = sects;
+    return SCPE_OK;
+    }
+switch (f) {                                            /* case on format */
+    case DKUF_F_STD:                                    /* SIMH format */
+        r = _sim_disk_wrsect (uptr, lba, buf, &written, sects);
         break;
-    if (Desc->Type == 1) {  /* Primary Volume Descriptor */
-        Primary = (ISO_9660_Primary_Volume_Descriptor *)primary_buf;
-        *Primary = *(ISO_9660_Primary_Volume_Descriptor *)Desc;
-        }
-    cur_pos += sizeof (*Desc);
-    ++read_count;
-    if ((Desc->Type == 255) ||
-        (read_count >= 32)) {
-        ret_val = ctx->container_size;
-        sim_messagef (SCPE_OK, "%s: '%s' Contains an ISO 9660 filesystem\n", sim_uname (uptr), uptr->filename);
-        if (Primary) {
-            char VolId[sizeof (Primary->VolumeIdentifier) + 1];
-
-            memcpy (VolId, Primary->VolumeIdentifier, sizeof (Primary->VolumeIdentifier));
-            VolId[sizeof (Primary->VolumeIdentifier)] = '\0';
-            sim_messagef (SCPE_OK, "%s: Volume Identifier: %s   Containing %u %u Byte Sectors\n", sim_uname (uptr), sim_trim_endspc (VolId), (uint32)(ctx->container_size / Primary->LogicalBlockSize[1 - sim_end]), (uint32)Primary->LogicalBlockSize[1 - sim_end]);
+    case DKUF_F_VHD:                                    /* VHD format */
+        if (!sim_end && (ctx->xfer_element_size != sizeof (char))) {
+            tbuf = (uint8*) malloc (sects * ctx->sector_size);
+            if (NULL == tbuf)
+                return SCPE_MEM;
+            sim_buf_copy_swapped (tbuf, buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
+            buf = tbuf;
+            }
+        r = sim_vhd_disk_wrsect  (uptr, lba, buf, &written, sects);
+        break;
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        if (!sim_end && (ctx->xfer_element_size != sizeof (char))) {
+            tbuf = (uint8*) malloc (sects * ctx->sector_size);
+            if (NULL == tbuf)
+                return SCPE_MEM;
+            sim_buf_copy_swapped (tbuf, buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
+            buf = tbuf;
             }
+        r = sim_simhx_disk_wrsect (uptr, lba, buf, &written, sects);
         break;
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+        break;                                          /* handle below */
+    default:
+        return SCPE_NOFNC;
+    }
+if (f == DKUF_F_RAW) {
+    if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Aligned & whole sector transfers */
+        ((0 == ((lba*ctx->sector_size) & (ctx->storage_sector_size - 1))) &&
+         (0 == ((sects*ctx->sector_size) & (ctx->storage_sector_size - 1))))) {
+
+        if (!sim_end && (ctx->xfer_element_size != sizeof (char))) {
+            tbuf = (uint8*) malloc (sects * ctx->sector_size);
+            if (NULL == tbuf)
+                return SCPE_MEM;
+            sim_buf_copy_swapped (tbuf, buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
+            buf = tbuf;
+            }
+
+        r = sim_os_disk_wrsect (uptr, lba, buf, &written, sects);
+        }
+    else { /* Unaligned and/or partial sector transfers in RAW mode */
+        size_t tbufsize = sects * ctx->sector_size + 2 * ctx->storage_sector_size;
+        t_offset ssaddr = (lba * (t_offset)ctx->sector_size) & ~(t_offset)(ctx->storage_sector_size -1);
+        t_offset sladdr = ((lba + sects) * (t_offset)ctx->sector_size) & ~(t_offset)(ctx->storage_sector_size -1);
+        uint32 soffset = (uint32)((lba * (t_offset)ctx->sector_size) - ssaddr);
+        uint32 byteswritten;
+
+        tbuf = (uint8*) malloc (tbufsize);
+        if (tbuf == NULL)
+            return SCPE_MEM;
+        /* Partial Sector writes require a read-modify-write sequence for the partial sectors */
+        if (soffset)
+            sim_os_disk_read (uptr, ssaddr, tbuf, NULL, ctx->storage_sector_size);
+        sim_os_disk_read (uptr, sladdr, tbuf + (size_t)(sladdr - ssaddr), NULL, ctx->storage_sector_size);
+        sim_buf_copy_swapped (tbuf + soffset,
+                              buf, ctx->xfer_element_size, (sects * ctx->sector_size) / ctx->xfer_element_size);
+        r = sim_os_disk_write (uptr, ssaddr, tbuf, &byteswritten, (soffset + (sects * ctx->sector_size) + ctx->storage_sector_size - 1) & ~(ctx->storage_sector_size - 1));
+        written = byteswritten / ctx->sector_size;
+        if (written > sects)
+            written = sects;
         }
     }
-uptr->capac = saved_capac;
-if (readonly)
-    *readonly = sim_disk_wrp (uptr) || (ret_val != (t_offset)-1);
-return ret_val;
+free (tbuf);
+if (sectswritten)
+    *sectswritten = written;
+return r;
 }
 
-#pragma pack(push,1)
-/*
- * The first logical block of device cluster 1 is either:
- *      1. MFD label entry (RSTS versions through 7.x)
- *      2. Disk Pack label (RSTS version 8.0 and later)
- */
-typedef struct _RSTS_MFDLABEL {
-    uint16  ml_ulnk;
-    uint16  ml_mbm1;
-    uint16  ml_reserved1;
-    uint16  ml_reserved2;
-    uint16  ml_pcs;
-    uint16  ml_pstat;
-    uint16  ml_packid[2];
-    } RSTS_MFDLABEL;
-
-typedef struct _RSTS_PACKLABEL {
-    uint16  pk_mb01;
-    uint16  pk_mbm1;
-    uint16  pk_mdcn;
-    uint16  pk_plvl;
-#define PK_LVL0         0000
-#define PK_LVL11        0401
-#define PK_LVL12        0402
-    uint16  pk_ppcs;
-    uint16  pk_pstat;
-#define PK_UC_NEW       0020000
-    uint16  pk_packid[2];
-    uint16  pk_tapgvn[2];
-    uint16  pk_bckdat;
-    uint16  pk_bcktim;
-    } RSTS_PACKLABEL;
+t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback)
+{
+t_stat r = SCPE_OK;
+AIO_CALLSETUP
+    r =  sim_disk_wrsect (uptr, lba, buf, sectswritten, sects);
+AIO_CALL(DOP_WSEC, lba, buf, sectswritten, sects, callback);
+return r;
+}
 
-typedef union _RSTS_ROOT {
-    RSTS_MFDLABEL  rt_mfd;
-    RSTS_PACKLABEL rt_pack;
-    uint8          rt_block[512];
-    } RSTS_ROOT;
+t_stat sim_disk_unload (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-typedef struct _RSTS_MFDBLOCKETTE {
-    uint16  mb_ulnk;
-    uint16  mb_mbm1;
-    uint16  mb_reserved1;
-    uint16  mb_reserved2;
-    uint16  mb_reserved3;
-    uint16  mb_malnk;
-    uint16  mb_lppn;
-    uint16  mb_lid;
-#define MB_ID           0051064
-    } RSTS_MFDBLOCKETTE;
-#define IS_VALID_RSTS_MFD(b) \
-     ((((b)->mb_ulnk == 0) || ((b)->mb_ulnk == 1)) &&                         \
-      ((b)->mb_mbm1 == 0177777) &&                                            \
-      ((b)->mb_reserved1 == 0) &&                                             \
-      ((b)->mb_reserved2 == 0) &&                                             \
-      ((b)->mb_reserved3 == 0) &&                                             \
-      ((b)->mb_lppn == 0177777) &&                                            \
-      ((b)->mb_lid == MB_ID))
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* Simh */
+    case DKUF_F_VHD:                                    /* VHD format */
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        ctx->media_removed = 1;
+        return sim_disk_detach (uptr);
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+        ctx->media_removed = 1;
+        return sim_os_disk_unload_raw (uptr->fileref);  /* remove/eject disk */
+        break;
+    default:
+        return SCPE_NOFNC;
+    }
+}
 
-typedef struct _RSTS_GFDBLOCKETTE {
-    uint16  gb_ulnk;
-    uint16  gb_mbm1;
-    uint16  gb_reserved1;
-    uint16  gb_reserved2;
-    uint16  gb_reserved3;
-    uint16  gb_reserved4;
-    uint16  gb_lppn;
-    uint16  gb_lid;
-#define GB_ID           0026264
-    } RSTS_GFDBLOCKETTE;
-#define IS_VALID_RSTS_GFD(b, g) \
-     ((((b)->gb_ulnk == 0) || ((b)->gb_ulnk == 1)) &&                         \
-      ((b)->gb_mbm1 == 0177777) &&                                            \
-      ((b)->gb_reserved1 == 0) &&                                             \
-      ((b)->gb_reserved2 == 0) &&                                             \
-      ((b)->gb_reserved3 == 0) &&                                             \
-      ((b)->gb_reserved4 == 0) &&                                             \
-      ((b)->gb_lppn == (((g) << 8) | 0377)) &&                                \
-      ((b)->gb_lid == GB_ID))
+t_stat sim_disk_erase (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint8 *buf;
+t_lba lba;
 
-typedef struct _RSTS_UFDBLOCKETTE {
-    uint16  ub_ulnk;
-    uint16  ub_mbm1;
-    uint16  ub_reserved1;
-    uint16  ub_reserved2;
-    uint16  ub_reserved3;
-    uint16  ub_reserved4;
-    uint16  ub_lppn;
-    uint16  ub_lid;
-#define UB_ID           0102064
-    } RSTS_UFDBLOCKETTE;
-#define IS_VALID_RSTS_UFD(b, g, u) \
-     (((b)->ub_mbm1 == 0177777) &&                                            \
-      ((b)->ub_reserved1 == 0) &&                                             \
-      ((b)->ub_reserved2 == 0) &&                                             \
-      ((b)->ub_reserved3 == 0) &&                                             \
-      ((b)->ub_reserved4 == 0) &&                                             \
-      ((b)->ub_lppn == (((g) << 8) | (u))) &&                                 \
-      ((b)->ub_lid == UB_ID))
+if (uptr->flags & UNIT_ATT)
+    return SCPE_UNATT;
 
-typedef struct _RSTS_UNAME {
-    uint16  un_ulnk;
-    uint16  un_unam;
-    uint16  un_reserved1;
-    uint16  un_reserved2;
-    uint16  un_ustat;
-    uint16  un_uacnt;
-    uint16  un_uaa;
-    uint16  un_uar;
-    } RSTS_UNAME;
+buf = (uint8 *)calloc (1, ctx->storage_sector_size);
+if (buf == NULL)
+    return SCPE_MEM;
+for (lba = 0; lba < ctx->container_size / ctx->sector_size; lba++)
+    sim_disk_wrsect (uptr, lba, buf, NULL, 1);          /* write sector */
+free (buf);
+return SCPE_OK;
+}
 
-typedef struct _RSTS_FNAME {
-    uint16  fn_ulnk;
-    uint16  fn_unam[3];
-    uint16  fn_ustat;
-    uint16  fn_uacnt;
-    uint16  fn_uaa;
-    uint16  fn_uar;
-    } RSTS_FNAME;
+/*
+   This routine is called when the simulator stops and any time
+   the asynch mode is changed (enabled or disabled)
+*/
+static void _sim_disk_io_flush (UNIT *uptr)
+{
+uint32 f = DK_GET_FMT (uptr);
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-typedef struct _RSTS_ACNT {
-    uint16  ac_ulnk;
-    uint16  ac_udla;
-    uint16  ac_usiz;
-    uint16  ac_udc;
-    uint16  ac_utc;
-    uint16  ac_urts[2];
-    uint16  ac_uclus;
-    } RSTS_ACNT;
+#if defined (SIM_ASYNCH_IO)
+sim_disk_clr_async (uptr);
+#endif
+if (ctx->cache) {
+    t_stat r = _sim_disk_cache_flush (uptr);
 
-typedef struct _RSTS_RETR {
-    uint16  rt_ulnk;
-    uint16  rt_uent[7];
-#define RT_ENTRIES      7
-    } RSTS_RETR;
+    if (r != SCPE_OK)
+        sim_printf ("%s: Error writing cached data: %s\n", sim_uname (uptr), sim_error_text (r));
+    }
+_sim_disk_map_flush (uptr, FALSE);
+#if defined (SIM_ASYNCH_IO)
+if (sim_asynch_enabled)
+    sim_disk_set_async (uptr, ctx->asynch_io_latency);
+#endif
+switch (f) {                                            /* case on format */
+    case DKUF_F_STD:                                    /* Simh */
+        fflush (uptr->fileref);
+        break;
+    case DKUF_F_VHD:                                    /* Virtual Disk */
+        sim_vhd_disk_flush (uptr->fileref);
+        break;
+    case DKUF_F_SIMHX:                                  /* Deduplicating Container */
+        sim_simhx_disk_flush (uptr->fileref);
+        break;
+    case DKUF_F_RAW:                                    /* Physical */
+        sim_os_disk_flush_raw (uptr->fileref);
+        break;
+        }
+}
 
-typedef struct _RSTS_DCMAP {
-    uint16  dc_clus;
-#define DC_MASK         0077777
-    uint16  dc_map[7];
-    }  RSTS_DCMAP;
+static t_stat _err_return (UNIT *uptr, t_stat stat)
+{
+free (uptr->filename);
+uptr->filename = NULL;
+free (uptr->disk_ctx);
+uptr->disk_ctx = NULL;
+return stat;
+}
 
-/*
- * Directory link definitions
- */
-#define DL_USE          0000001
-#define DL_BAD          0000002
-#define DL_CHE          0000004
-#define DL_CLN          0000010
-#define DL_ENO          0000760
-#define DL_CLO          0007000
-#define DL_BLO          0170000
+static t_stat _sim_disk_rdsect_interleave (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, uint16 sectpertrack, uint16 interleave, uint16 skew, uint16 offset)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_lba sectno = lba, psa;
+t_stat status;
 
-#define DLSH_ENO         4
-#define DLSH_CLO         9
-#define DLSH_BLO        12
+if (sectsread)
+    *sectsread = 0;
 
-#define BLOCKETTE_SZ    (8 * sizeof(uint16))
-#define MAP_OFFSET      (31 * BLOCKETTE_SZ)
+do {
+    uint16 i, track, sector;
 
-#define SATT0           0073374
-#define SATT1           0076400
-#define SATT2           0075273
+    /*
+     * Map an LBA address into a physical sector address
+     */
+    track = sectno / sectpertrack;
+    i = (sectno % sectpertrack) * interleave;
+    if (i >= sectpertrack)
+        i++;
+    sector = (i + (track * skew)) % sectpertrack;
 
-#pragma pack(pop)
+    psa = sector + (track * sectpertrack) + offset;
 
-typedef struct _rstsContext {
-    UNIT        *uptr;
-    int         dcshift;
-    int         pcs;
-    char        packid[8];
-    t_seccnt    sects;
-    RSTS_DCMAP  map;
-} rstsContext;
+    status = sim_disk_rdsect(uptr, psa, buf, NULL, 1);
+    sects--;
+    buf += ctx->sector_size;
+    sectno++;
+    if (sectsread)
+        *sectsread += 1;
+    } while ((sects != 0) && (status == SCPE_OK));
 
-static char rad50[] = " ABCDEFGHIJKLMNOPQRSTUVWXYZ$.%0123456789";
-
-static void r50Asc(uint16 val, char *buf)
-{
-buf[2] = rad50[val % 050];
-val /= 050;
-buf[1] = rad50[val % 050];
-buf[0] = rad50[val / 050];
+return status;
 }
 
-static t_stat rstsValidateClusterSize(uint16 size, uint16 minSize)
-{
-int i;
-
 /*
- * Check that the cluster size is a power of 2 and greater than or equal
- * to some location dependent value.
+ * Version of sim_disk_rdsect() specifically for filesystem detection of DEC
+ * file systems. The routine handles regular DEC disks (physsectsz == 0) and
+ * RX01/RX02 disks (physsectsz == 128 or == 256) which ignore track 0,
+ * interleave physical sectors 2:1 for the remaining tracks and have a skew
+ * 6 sectors at the end of a track.
  */
-if (size >= minSize)
-    for (i = 0; i < 16; i++)
-        if (size == (1 << i))
-            return SCPE_OK;
-
-return SCPE_IOERR;
-}
+#define RX0xNSECT               26                      /* 26 sectors/track */
+#define RX0xINTER               2                       /* 2 sector interleave */
+#define RX0xISKEW               6                       /* 6 sectors interleave per track */
 
-static t_stat rstsReadBlock(rstsContext *context, uint16 cluster, uint16 block, void *buf)
+static t_stat _DEC_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, uint32 physsectsz)
 {
-t_lba blk = (cluster << context->dcshift) + block;
-t_seccnt sects_read;
-
-if ((sim_disk_rdsect(context->uptr, blk * context->sects, (uint8 *)buf, &sects_read, context->sects) == SCPE_OK) &&
-    (sects_read == context->sects))
-    return SCPE_OK;
+if (physsectsz == 0)            /* Use device natural sector size */
+    return sim_disk_rdsect(uptr, lba, buf, sectsread, sects);
 
-return SCPE_IOERR;
+return _sim_disk_rdsect_interleave(uptr, lba, buf, sectsread, sects, RX0xNSECT, RX0xINTER, RX0xISKEW, RX0xNSECT);
 }
 
-static t_stat rstsReadBlockette(rstsContext *context, uint16 link, void *buf)
-{
-uint16 block = (link & DL_BLO) >> DLSH_BLO;
-uint16 dcn = (link & DL_CLO) >> DLSH_CLO;
-uint16 blockette = (link & DL_ENO) >> DLSH_ENO;
-uint8 temp[512];
-
-if ((dcn != 7) && (blockette != 31) &&
-    (block <= (context->map.dc_clus & DC_MASK))) {
-    if (rstsReadBlock(context, context->map.dc_map[dcn], block, temp) == SCPE_OK) {
-        memcpy(buf, &temp[blockette * BLOCKETTE_SZ], BLOCKETTE_SZ);
-        return SCPE_OK;
-        }
-    }
-return SCPE_IOERR;
-}
+#pragma pack(push,1)
+typedef struct _ODS1_HomeBlock
+    {
+    uint16  hm1_w_ibmapsize;
+    uint32  hm1_l_ibmaplbn;
+    uint16  hm1_w_maxfiles;
+    uint16  hm1_w_cluster;
+    uint16  hm1_w_devtype;
+    uint16  hm1_w_structlev;
+#define HM1_C_LEVEL1    0401
+#define HM1_C_LEVEL2    0402
+    uint8   hm1_t_volname[12];
+    uint8   hm1_b_fill_1[4];
+    uint16  hm1_w_volowner;
+    uint16  hm1_w_protect;
+    uint16  hm1_w_volchar;
+    uint16  hm1_w_fileprot;
+    uint8   hm1_b_fill_2[6];
+    uint8   hm1_b_window;
+    uint8   hm1_b_extend;
+    uint8   hm1_b_lru_lim;
+    uint8   hm1_b_fill_3[11];
+    uint16  hm1_w_checksum1;
+    uint8   hm1_t_credate[14];
+    uint8   hm1_b_fill_4[382];
+    uint32  hm1_l_serialnum;
+    uint8   hm1_b_fill_5[12];
+    uint8   hm1_t_volname2[12];
+    uint8   hm1_t_ownername[12];
+    uint8   hm1_t_format[12];
+    uint8   hm1_t_fill_6[2];
+    uint16  hm1_w_checksum2;
+    } ODS1_HomeBlock;
 
-static t_stat rstsFind01UFD(rstsContext *context, uint16 *ufd, uint16 *level)
-{
-uint16 dcs = 1 << context->dcshift;
-RSTS_ROOT root;
-uint16 buf[256];
+    typedef struct _ODS2_HomeBlock
+    {
+    uint32 hm2_l_homelbn;
+    uint32 hm2_l_alhomelbn;
+    uint32 hm2_l_altidxlbn;
+    uint8  hm2_b_strucver;
+    uint8  hm2_b_struclev;
+    uint16 hm2_w_cluster;
+    uint16 hm2_w_homevbn;
+    uint16 hm2_w_alhomevbn;
+    uint16 hm2_w_altidxvbn;
+    uint16 hm2_w_ibmapvbn;
+    uint32 hm2_l_ibmaplbn;
+    uint32 hm2_l_maxfiles;
+    uint16 hm2_w_ibmapsize;
+    uint16 hm2_w_resfiles;
+    uint16 hm2_w_devtype;
+    uint16 hm2_w_rvn;
+    uint16 hm2_w_setcount;
+    uint16 hm2_w_volchar;
+    uint32 hm2_l_volowner;
+    uint32 hm2_l_reserved;
+    uint16 hm2_w_protect;
+    uint16 hm2_w_fileprot;
+    uint16 hm2_w_reserved;
+    uint16 hm2_w_checksum1;
+    uint32 hm2_q_credate[2];
+    uint8  hm2_b_window;
+    uint8  hm2_b_lru_lim;
+    uint16 hm2_w_extend;
+    uint32 hm2_q_retainmin[2];
+    uint32 hm2_q_retainmax[2];
+    uint32 hm2_q_revdate[2];
+    uint8  hm2_r_min_class[20];
+    uint8  hm2_r_max_class[20];
+    uint8  hm2_r_reserved[320];
+    uint32 hm2_l_serialnum;
+    uint8  hm2_t_strucname[12];
+    uint8  hm2_t_volname[12];
+    uint8  hm2_t_ownername[12];
+    uint8  hm2_t_format[12];
+    uint16 hm2_w_reserved2;
+    uint16 hm2_w_checksum2;
+    } ODS2_HomeBlock;
 
-if (rstsReadBlock(context, 1, 0, &root) == SCPE_OK) {
-    /*
-     * First validate fields which are common to both the MFD label and
-     * Pack label - we'll use Pack label offsets here.
-     */
-    if ((root.rt_pack.pk_mbm1 == 0177777) &&
-        (rstsValidateClusterSize(root.rt_pack.pk_ppcs, dcs) == SCPE_OK)) {
-        char ch, *tmp = &context->packid[1];
-        uint16 mfd, gfd;
+typedef struct _ODS1_FileHeader
+    {
+    uint8   fh1_b_idoffset;
+    uint8   fh1_b_mpoffset;
+    uint16  fh1_w_fid_num;
+    uint16  fh1_w_fid_seq;
+    uint16  fh1_w_struclev;
+    uint16  fh1_w_fileowner;
+    uint16  fh1_w_fileprot;
+    uint16  fh1_w_filechar;
+    uint16  fh1_w_recattr;
+    uint8   fh1_b_fill_1[494];
+    uint16  fh1_w_checksum;
+    } ODS1_FileHeader;
 
-        context->pcs = root.rt_pack.pk_ppcs;
+typedef struct _ODS2_FileHeader
+    {
+    uint8  fh2_b_idoffset;
+    uint8  fh2_b_mpoffset;
+    uint8  fh2_b_acoffset;
+    uint8  fh2_b_rsoffset;
+    uint16 fh2_w_seg_num;
+    uint16 fh2_w_structlev;
+    uint16 fh2_w_fid[3];
+    uint16 fh2_w_ext_fid[3];
+    uint16 fh2_w_recattr[16];
+    uint32 fh2_l_filechar;
+    uint16 fh2_w_remaining[228];
+    } ODS2_FileHeader;
 
-        r50Asc(root.rt_pack.pk_packid[0], &context->packid[0]);
-        r50Asc(root.rt_pack.pk_packid[1], &context->packid[3]);
-        context->packid[6] = '\0';
+typedef union _ODS2_Retreval
+    {
+        struct
+            {
+            unsigned fm2___fill   : 14;       /* type specific data               */
+            unsigned fm2_v_format : 2;        /* format type code                 */
+            } fm2_r_word0_bits;
+        struct
+            {
+            unsigned fm2_v_exact    : 1;      /* exact placement specified        */
+            unsigned fm2_v_oncyl    : 1;      /* on cylinder allocation desired   */
+            unsigned fm2___fill     : 10;
+            unsigned fm2_v_lbn      : 1;      /* use LBN of next map pointer      */
+            unsigned fm2_v_rvn      : 1;      /* place on specified RVN           */
+            unsigned fm2_v_format0  : 2;
+            } fm2_r_map_bits0;
+        struct
+            {
+            unsigned fm2_b_count1   : 8;      /* low byte described below         */
+            unsigned fm2_v_highlbn1 : 6;      /* high order LBN                   */
+            unsigned fm2_v_format1  : 2;
+            unsigned fm2_w_lowlbn1  : 16;     /* low order LBN                    */
+            } fm2_r_map_bits1;
+        struct
+            {
+            struct
+                {
+                unsigned fm2_v_count2   : 14; /* count field                      */
+                unsigned fm2_v_format2  : 2;
+                unsigned fm2_l_lowlbn2  : 16; /* low order LBN                    */
+                } fm2_r_map2_long0;
+            uint16 fm2_l_highlbn2;            /* high order LBN                   */
+            } fm2_r_map_bits2;
+        struct
+            {
+            struct
+                {
+                unsigned fm2_v_highcount3 : 14; /* low order count field          */
+                unsigned fm2_v_format3  : 2;
+                unsigned fm2_w_lowcount3 : 16;  /* high order count field         */
+                } fm2_r_map3_long0;
+            uint32 fm2_l_lbn3;
+            } fm2_r_map_bits3;
+    } ODS2_Retreval;
 
-        /*
-         * The Pack ID must consist of 1 - 6 alphanumeric characters
-         * padded at the end with spaces.
-         */
-        if (!isalnum(context->packid[0]))
-            return SCPE_IOERR;
+typedef struct _ODS1_Retreval
+    {
+    uint8   fm1_b_ex_segnum;
+    uint8   fm1_b_ex_rvn;
+    uint16  fm1_w_ex_filnum;
+    uint16  fm1_w_ex_filseq;
+    uint8   fm1_b_countsize;
+    uint8   fm1_b_lbnsize;
+    uint8   fm1_b_inuse;
+    uint8   fm1_b_avail;
+    union {
+        struct {
+            uint8 fm1_b_highlbn;
+            uint8 fm1_b_count;
+            uint16 fm1_w_lowlbn;
+            } fm1_s_fm1def1;
+        struct {
+            uint8 fm1_b_highlbn;
+            uint8 fm1_b_count;
+            uint16 fm1_w_lowlbn;
+            } fm1_s_fm1def2;
+        } fm1_pointers[4];
+    } ODS1_Retreval;
 
-        while ((ch = *tmp++) != 0) {
-            if (!isalnum(ch)) {
-                if (ch != ' ')
-                    return SCPE_IOERR;
-
-                while (*tmp)
-                    if (*tmp++ != ' ')
-                        return SCPE_IOERR;
-                break;
-                }
-            }
-
-        /*
-         * Determine the pack revision level and, therefore, the path to
-         * [0,1]satt.sys which will allow us to determine the size of the
-         * pack used by RSTS.
-         */
-        if ((root.rt_pack.pk_pstat & PK_UC_NEW) == 0) {
-            uint16 link = root.rt_mfd.ml_ulnk;
-            RSTS_UNAME uname;
-
-            /*
-             * Old format used by RSTS up through V07.x
-             */
-            if (dcs > 16)
-                return SCPE_IOERR;
-
-            *level = PK_LVL0;
-
-            memcpy(&context->map, &root.rt_block[MAP_OFFSET], BLOCKETTE_SZ);
-
-            /*
-             * Scan the MFD name entries looking for [0,1]. Note there will
-             * always be at least 1 entry.
-             */
-            do {
-                if (rstsReadBlockette(context, link, &uname) != SCPE_OK)
-                    break;
-
-                if (uname.un_unam == ((0 << 8) | 1)) {
-                    *ufd = uname.un_uar;
-                    return SCPE_OK;
-                    }
-                } while ((link = uname.un_ulnk) != 0);
-            }
-        else {
-            /*
-             * New format used by RSTS V08 and later
-             */
-            switch (root.rt_pack.pk_plvl) {
-                case PK_LVL11:
-                    if (dcs > 16)
-                        return SCPE_IOERR;
-                    break;
+typedef struct _ODS1_StorageControlBlock
+    {
+    uint8  scb_b_unused[3];
+    uint8  scb_b_bitmapblks;
+    struct _bitmapblk {
+        uint16 scb_w_freeblks;
+        uint16 scb_w_freeptr;
+        } scb_r_blocks[1];
+    } ODS1_SCB;
 
-                case PK_LVL12:
-                    if (dcs > 64)
-                        return SCPE_IOERR;
-                    break;
 
-                default:
-                    return SCPE_IOERR;
-                }
-            *level = root.rt_pack.pk_plvl;
+typedef struct _ODS2_StorageControlBlock
+    {
+    uint8  scb_b_strucver;   /* 1 */
+    uint8  scb_b_struclev;   /* 2 */
+    uint16 scb_w_cluster;
+    uint32 scb_l_volsize;
+    uint32 scb_l_blksize;
+    uint32 scb_l_sectors;
+    uint32 scb_l_tracks;
+    uint32 scb_l_cylinder;
+    uint32 scb_l_status;
+    uint32 scb_l_status2;
+    uint16 scb_w_writecnt;
+    uint8  scb_t_volockname[12];
+    uint32 scb_q_mounttime[2];
+    uint16 scb_w_backrev;
+    uint32 scb_q_genernum[2];
+    uint8  scb_b_reserved[446];
+    uint16 scb_w_checksum;
+    } ODS2_SCB;
+#pragma pack(pop)
 
-            mfd = root.rt_pack.pk_mdcn;
+static uint16
+ODSChecksum (void *Buffer, uint16 WordCount)
+    {
+    int i;
+    uint16 CheckSum = 0;
+    uint16 *Buf = (uint16 *)Buffer;
 
-            if (rstsReadBlock(context, mfd, 0, buf) == SCPE_OK) {
-                if (IS_VALID_RSTS_MFD((RSTS_MFDBLOCKETTE *)buf)) {
-                    if (rstsReadBlock(context, mfd, 1, buf) == SCPE_OK)
-                        if ((gfd = buf[0]) != 0)
-                            if (rstsReadBlock(context, gfd, 0, buf) == SCPE_OK)
-                                if (IS_VALID_RSTS_GFD((RSTS_GFDBLOCKETTE *)buf, 0)) {
-                                    if (rstsReadBlock(context, gfd, 1, buf) == SCPE_OK)
-                                        if ((*ufd = buf[1]) != 0)
-                                            return SCPE_OK;
-                                    }
-                    }
-                }
-            }
-        }
+    for (i=0; i<WordCount; i++)
+        CheckSum += Buf[i];
+    return CheckSum;
     }
-return SCPE_IOERR;
-}
-
-static t_stat rstsLoadAndScanSATT(rstsContext *context, uint16 uaa, uint16 uar, t_offset *result)
-{
-uint8 bitmap[8192];
-int i, j;
-RSTS_ACNT acnt;
-RSTS_RETR retr;
-
-if (uar != 0) {
-    if (rstsReadBlockette(context, uaa, &acnt) == SCPE_OK) {
-        uint16 blocks = acnt.ac_usiz;
-        uint16 offset = 0;
 
-        if ((rstsValidateClusterSize(acnt.ac_uclus, context->pcs) != SCPE_OK) ||
-            (blocks > 16))
-            return SCPE_IOERR;
-
-        memset(bitmap, 0xFF, sizeof(bitmap));
-
-        if (blocks != 0) {
-            do {
-                int i, j;
-                uint16 fcl;
-
-                if (rstsReadBlockette(context, uar, &retr) != SCPE_OK)
-                    return SCPE_IOERR;
-
-                for (i = 0; i < RT_ENTRIES; i++) {
-                    if ((fcl = retr.rt_uent[i]) == 0)
-                        goto scanBitmap;
-
-                    for (j = 0; j < acnt.ac_uclus; j++) {
-                        if ((blocks == 0) || (offset >= sizeof(bitmap)))
-                            goto scanBitmap;
-
-                        if (rstsReadBlock(context, fcl, j, &bitmap[offset]) != SCPE_OK)
-                            return SCPE_IOERR;
-
-                        offset += 512;
-                        blocks--;
-                        }
-                    }
-                } while ((uar = retr.rt_ulnk) != 0);
-
-        scanBitmap:
-            for (i = sizeof(bitmap) - 1; i != 0; i--)
-                if (bitmap[i] != 0xFF) {
-                    blocks = i * 8;
-                    for (j = 7; j >= 0; j--)
-                        if ((bitmap[i] & (1 << j)) == 0) {
-                            blocks += j + 1;
-                            goto scanDone;
-                            }
-                    }
-        scanDone:
-            *result = (t_offset)(blocks + 1) * context->pcs;
-            return SCPE_OK;
-            }
-        }
-    }
-return SCPE_IOERR;
-}
 
-static t_offset get_rsts_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+static t_offset get_ods2_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
 {
 DEVICE *dptr;
 t_addr saved_capac;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
-uint8 buf[512];
+t_offset temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
+ODS2_HomeBlock Home;
+ODS2_FileHeader Header;
+ODS2_Retreval *Retr;
+ODS2_SCB Scb;
+uint16 CheckSum1, CheckSum2;
+uint32 ScbLbn = 0;
 t_offset ret_val = (t_offset)-1;
-rstsContext context;
+t_seccnt sects_read;
 
 if ((dptr = find_dev_from_unit (uptr)) == NULL)
     return ret_val;
-
 saved_capac = uptr->capac;
-uptr->capac = temp_capac;
-
-context.uptr = uptr;
-context.sects = 512 / ctx->sector_size;
+uptr->capac = (t_addr)temp_capac;
+if ((_DEC_rdsect (uptr, 512 / ctx->sector_size, (uint8 *)&Home, &sects_read, sizeof (Home) / ctx->sector_size, physsectsz)) ||
+    (sects_read != (sizeof (Home) / ctx->sector_size)))
+    goto Return_Cleanup;
+CheckSum1 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm2_w_checksum1)-((char *)&Home.hm2_l_homelbn))/2));
+CheckSum2 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm2_w_checksum2)-((char *)&Home.hm2_l_homelbn))/2));
+if ((Home.hm2_l_homelbn == 0) ||
+    (Home.hm2_l_alhomelbn == 0) ||
+    (Home.hm2_l_altidxlbn == 0) ||
+    ((Home.hm2_b_struclev != 2) && (Home.hm2_b_struclev != 5)) ||
+    (Home.hm2_b_strucver == 0) ||
+    (Home.hm2_w_cluster == 0) ||
+    (Home.hm2_w_homevbn == 0) ||
+    (Home.hm2_w_alhomevbn == 0) ||
+    (Home.hm2_w_ibmapvbn == 0) ||
+    (Home.hm2_l_ibmaplbn == 0) ||
+    (Home.hm2_w_resfiles >= Home.hm2_l_maxfiles) ||
+    (Home.hm2_w_ibmapsize == 0) ||
+    (Home.hm2_w_resfiles < 5) ||
+    (Home.hm2_w_checksum1 != CheckSum1) ||
+    (Home.hm2_w_checksum2 != CheckSum2))
+    goto Return_Cleanup;
+if ((_DEC_rdsect (uptr, (Home.hm2_l_ibmaplbn+Home.hm2_w_ibmapsize+1) * (512 / ctx->sector_size),
+                  (uint8 *)&Header, &sects_read, sizeof (Header) / ctx->sector_size, physsectsz)) ||
+    (sects_read != (sizeof (Header) / ctx->sector_size)))
+    goto Return_Cleanup;
+CheckSum1 = ODSChecksum (&Header, 255);
+if (CheckSum1 != *(((uint16 *)&Header)+255)) /* Verify Checksum on BITMAP.SYS file header */
+    goto Return_Cleanup;
+Retr = (ODS2_Retreval *)(((uint16*)(&Header))+Header.fh2_b_mpoffset);
+/* The BitMap File has a single extent, which may be preceded by a placement descriptor */
+if (Retr->fm2_r_word0_bits.fm2_v_format == 0)
+    Retr = (ODS2_Retreval *)(((uint16 *)Retr)+1); /* skip placement descriptor */
+switch (Retr->fm2_r_word0_bits.fm2_v_format)
+    {
+    case 1:
+        ScbLbn = (Retr->fm2_r_map_bits1.fm2_v_highlbn1<<16)+Retr->fm2_r_map_bits1.fm2_w_lowlbn1;
+        break;
+    case 2:
+        ScbLbn = (Retr->fm2_r_map_bits2.fm2_l_highlbn2<<16)+Retr->fm2_r_map_bits2.fm2_r_map2_long0.fm2_l_lowlbn2;
+        break;
+    case 3:
+        ScbLbn = Retr->fm2_r_map_bits3.fm2_l_lbn3;
+        break;
+    }
+Retr = (ODS2_Retreval *)(((uint16 *)Retr)+Retr->fm2_r_word0_bits.fm2_v_format+1);
+if ((_DEC_rdsect (uptr, ScbLbn * (512 / ctx->sector_size), (uint8 *)&Scb, &sects_read, sizeof (Scb) / ctx->sector_size, physsectsz)) ||
+    (sects_read != (sizeof (Scb) / ctx->sector_size)))
+    goto Return_Cleanup;
+CheckSum1 = ODSChecksum (&Scb, 255);
+if (CheckSum1 != *(((uint16 *)&Scb)+255)) /* Verify Checksum on Storage Control Block */
+    goto Return_Cleanup;
+if ((Scb.scb_w_cluster != Home.hm2_w_cluster) ||
+    (Scb.scb_b_strucver != Home.hm2_b_strucver) ||
+    (Scb.scb_b_struclev != Home.hm2_b_struclev))
+    goto Return_Cleanup;
+sim_messagef (SCPE_OK, "%s: '%s' Contains ODS%d File system\n", sim_uname (uptr), uptr->filename, Home.hm2_b_struclev);
+sim_messagef (SCPE_OK, "%s: Volume Name: %12.12s Format: %12.12s Sectors In Volume: %u\n",
+                                   sim_uname (uptr), Home.hm2_t_volname, Home.hm2_t_format, Scb.scb_l_volsize);
+ret_val = ((t_offset)Scb.scb_l_volsize) * 512;
 
-/*
- * Check all possible device cluster sizes
- */
-for (context.dcshift = 0; context.dcshift < 8; context.dcshift++) {
-    uint16 ufd, level;
-
-    /*
-     * We need to find [0,1]SATT.SYS to compute the actual size of the disk.
-     * First find the DCN of the [0,1] UFD.
-     */
-    if (rstsFind01UFD(&context, &ufd, &level) == SCPE_OK) {
-        if (rstsReadBlock(&context, ufd, 0, buf) == SCPE_OK) {
-            if (IS_VALID_RSTS_UFD((RSTS_UFDBLOCKETTE *)buf, 0, 1)) {
-                uint16 link = ((RSTS_UFDBLOCKETTE *)buf)->ub_ulnk;
-                RSTS_FNAME fname;
-
-                memcpy(&context.map, &buf[MAP_OFFSET], BLOCKETTE_SZ);
-
-                /*
-                 * Scan the UFD looking for SATT.SYS - the allocation bitmap
-                 */
-                do {
-                    if (rstsReadBlockette(&context, link, &fname) != SCPE_OK)
-                        break;
-
-                    if ((fname.fn_unam[0] == SATT0) &&
-                        (fname.fn_unam[1] == SATT1) &&
-                        (fname.fn_unam[2] == SATT2)) {
-                        if (rstsLoadAndScanSATT(&context, fname.fn_uaa, fname.fn_uar, &ret_val) == SCPE_OK) {
-                            const char *fmt = "???";
-
-                            ret_val *= 512;
-
-                            switch (level) {
-                                case PK_LVL0:
-                                    fmt = "0.0";
-                                    break;
-
-                                case PK_LVL11:
-                                    fmt = "1.1";
-                                    break;
-
-                                case PK_LVL12:
-                                    fmt = "1.2";
-                                    break;
-                                }
-
-                            sim_messagef(SCPE_OK, "%s: '%s' Contains a RSTS File system\n", sim_uname (uptr), uptr->filename);
-                            sim_messagef(SCPE_OK, "%s: Pack ID: %6.6s Revision Level: %3s Pack Clustersize: %d\n",
-                                                                  sim_uname (uptr), context.packid, fmt, context.pcs);
-                            sim_messagef(SCPE_OK, "%s: Last Unallocated Sector In File System: %u\n", sim_uname (uptr), (uint32)((ret_val / 512) - 1));
-                            goto cleanup_done;
-                            }
-                        }
-                    } while ((link = fname.fn_ulnk) != 0);
-                }
-            }
-        }
-    }
-cleanup_done:
+Return_Cleanup:
 uptr->capac = saved_capac;
 if (readonly)
     *readonly = sim_disk_wrp (uptr);
 return ret_val;
 }
 
-#pragma pack(push,1)
-typedef struct _RT11_HomeBlock {
-    uint8   hb_b_bbtable[130];
-    uint8   hb_b_unused1[2];
-    uint8   hb_b_initrestore[38];
-    uint8   hb_b_bup[18];
-    uint8   hb_b_unused2[260];
-    uint16  hb_w_reserved1;
-    uint16  hb_w_reserved2;
-    uint8   hb_b_unused3[14];
-    uint16  hb_w_clustersize;
-    uint16  hb_w_firstdir;
-    uint16  hb_w_sysver;
-#define HB_C_SYSVER_V3A 36521
-#define HB_C_SYSVER_V04 36434
-#define HB_C_SYSVER_V05 36435
-    uint8   hb_b_volid[12];
-    uint8   hb_b_owner[12];
-    uint8   hb_b_sysid[12];
-#define HB_C_SYSID      "DECRT11A    "
-#define HB_C_VMSSYSID   "DECVMSEXCHNG"
-    uint8   hb_b_unused4[2];
-    uint16  hb_w_checksum;
-    } RT11_HomeBlock;
-
-typedef struct _RT11_DirHeader {
-    uint16  dh_w_count;
-    uint16  dh_w_next;
-    uint16  dh_w_highest;
-#define DH_C_MAXSEG     31
-    uint16  dh_w_extra;
-    uint16  dh_w_start;
-    } RT11_DirHeader;
-
-typedef struct _RT11_DirEntry {
-    uint16  de_w_status;
-#define DE_C_PRE        0000020
-#define DE_C_TENT       0000400
-#define DE_C_EMPTY      0001000
-#define DE_C_PERM       0002000
-#define DE_C_EOS        0004000
-#define DE_C_READ       0040000
-#define DE_C_PROT       0100000
-    uint16  de_w_fname1;
-    uint16  de_w_fname2;
-    uint16  de_w_ftype;
-    uint16  de_w_length;
-    uint16  de_w_jobchannel;
-    uint16  de_w_creationdate;
-    } RT11_DirEntry;
-#pragma pack(pop)
-
-#define RT11_MAXPARTITIONS      256             /* Max partitions supported */
-#define RT11_HOME                 1             /* Home block # */
-
-#define RT11_NOPART             0
-#define RT11_SINGLEPART         1
-#define RT11_MULTIPART          2
-
-static int rt11_get_partition_type(RT11_HomeBlock *home, int part)
+static t_offset get_ods1_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
 {
-if (strncmp((char *)&home->hb_b_sysid, HB_C_SYSID, strlen(HB_C_SYSID)) == 0) {
-    uint16 type = home->hb_w_sysver;
+DEVICE *dptr;
+t_addr saved_capac;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
+ODS1_HomeBlock Home;
+ODS1_FileHeader Header;
+ODS1_Retreval *Retr;
+uint8 scb_buf[512];
+ODS1_SCB *Scb = (ODS1_SCB *)scb_buf;
+uint16 CheckSum1, CheckSum2;
+uint32 ScbLbn;
+t_offset ret_val = (t_offset)-1;
+t_seccnt sects_read;
 
-    if (part == 0) {
-        if ((type == HB_C_SYSVER_V3A) || (type == HB_C_SYSVER_V04))
-            return RT11_SINGLEPART;
-        }
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
+    return ret_val;
+saved_capac = uptr->capac;
+uptr->capac = temp_capac;
+if ((_DEC_rdsect (uptr, 512 / ctx->sector_size, (uint8 *)&Home, &sects_read, sizeof (Home) / ctx->sector_size, physsectsz)) ||
+    (sects_read != (sizeof (Home) / ctx->sector_size)))
+    goto Return_Cleanup;
+CheckSum1 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm1_w_checksum1)-((char *)&Home.hm1_w_ibmapsize))/2));
+CheckSum2 = ODSChecksum (&Home, (uint16)((((char *)&Home.hm1_w_checksum2)-((char *)&Home.hm1_w_ibmapsize))/2));
+if ((Home.hm1_w_ibmapsize == 0) ||
+    (Home.hm1_l_ibmaplbn == 0) ||
+    (Home.hm1_w_maxfiles == 0) ||
+    (Home.hm1_w_cluster != 1) ||
+    ((Home.hm1_w_structlev != HM1_C_LEVEL1) && (Home.hm1_w_structlev != HM1_C_LEVEL2)) ||
+    (Home.hm1_l_ibmaplbn == 0) ||
+    (Home.hm1_w_checksum1 != CheckSum1) ||
+    (Home.hm1_w_checksum2 != CheckSum2))
+    goto Return_Cleanup;
+if ((_DEC_rdsect (uptr, (((Home.hm1_l_ibmaplbn << 16) + ((Home.hm1_l_ibmaplbn >> 16) & 0xFFFF)) + Home.hm1_w_ibmapsize + 1) * (512 / ctx->sector_size),
+                  (uint8 *)&Header, &sects_read, sizeof (Header) / ctx->sector_size, physsectsz)) ||
+    (sects_read != (sizeof (Header) / ctx->sector_size)))
+    goto Return_Cleanup;
+CheckSum1 = ODSChecksum (&Header, 255);
+if (CheckSum1 != *(((uint16 *)&Header)+255)) /* Verify Checksum on BITMAP.SYS file header */
+    goto Return_Cleanup;
 
-    if (type == HB_C_SYSVER_V05)
-        return RT11_MULTIPART;
-    }
+Retr = (ODS1_Retreval *)(((uint16*)(&Header))+Header.fh1_b_mpoffset);
+ScbLbn = (Retr->fm1_pointers[0].fm1_s_fm1def1.fm1_b_highlbn<<16)+Retr->fm1_pointers[0].fm1_s_fm1def1.fm1_w_lowlbn;
+if ((_DEC_rdsect (uptr, ScbLbn * (512 / ctx->sector_size), (uint8 *)Scb, &sects_read, 512 / ctx->sector_size, physsectsz)) ||
+    (sects_read != (512 / ctx->sector_size)))
+    goto Return_Cleanup;
+if (Scb->scb_b_bitmapblks < 127)
+    ret_val = (((t_offset)Scb->scb_r_blocks[Scb->scb_b_bitmapblks].scb_w_freeblks << 16) + Scb->scb_r_blocks[Scb->scb_b_bitmapblks].scb_w_freeptr) * 512;
+else
+    ret_val = (((t_offset)Scb->scb_r_blocks[0].scb_w_freeblks << 16) + Scb->scb_r_blocks[0].scb_w_freeptr) * 512;
+sim_messagef (SCPE_OK, "%s: '%s' Contains an ODS1 File system\n", sim_uname (uptr), uptr->filename);
+sim_messagef (SCPE_OK, "%s: Volume Name: %12.12s Format: %12.12s Sectors In Volume: %u\n",
+                                sim_uname (uptr), Home.hm1_t_volname, Home.hm1_t_format, (uint32)(ret_val / 512));
+Return_Cleanup:
+uptr->capac = saved_capac;
+if (readonly)
+    *readonly = sim_disk_wrp (uptr);
+return ret_val;
+}
 
-if (strncmp((char *)&home->hb_b_sysid, HB_C_VMSSYSID, strlen(HB_C_VMSSYSID)) == 0)
-    return RT11_SINGLEPART;
+typedef struct ultrix_disklabel {
+    uint32  pt_magic;       /* magic no. indicating part. info exits */
+    uint32  pt_valid;       /* set by driver if pt is current */
+    struct  pt_info {
+        uint32  pi_nblocks; /* no. of sectors */
+        uint32  pi_blkoff;  /* block offset for start */
+        } pt_part[8];
+    } ultrix_disklabel;
 
-return RT11_NOPART;
-}
+#define PT_MAGIC        0x032957        /* Partition magic number */
+#define PT_VALID        1               /* Indicates if struct is valid */
 
-static t_offset get_rt11_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+static t_offset get_ultrix_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
 {
 DEVICE *dptr;
 t_addr saved_capac;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
-uint8 sector_buf[1024];
-RT11_HomeBlock Home;
-t_seccnt sects_read;
-RT11_DirHeader *dir_hdr = (RT11_DirHeader *)sector_buf;
-int partitions = 0;
-int part;
-uint32 base;
-uint32 dir_sec;
-uint16 dir_seg;
-uint16 version = 0;
+uint8 sector_buf[512];
+ultrix_disklabel *Label = (ultrix_disklabel *)(sector_buf + sizeof (sector_buf) - sizeof (ultrix_disklabel));
 t_offset ret_val = (t_offset)-1;
+int i;
+uint32 max_lbn = 0, max_lbn_partnum = 0;
+t_seccnt sects_read;
 
 if ((dptr = find_dev_from_unit (uptr)) == NULL)
-     return ret_val;
+    return ret_val;
 saved_capac = uptr->capac;
 uptr->capac = temp_capac;
+if ((_DEC_rdsect (uptr, 31 * (512 / ctx->sector_size), sector_buf, &sects_read, 512 / ctx->sector_size, physsectsz)) ||
+    (sects_read != (512 / ctx->sector_size)))
+    goto Return_Cleanup;
 
-for (part = 0; part < RT11_MAXPARTITIONS; part++) {
-    uint16 seg_highest = 0;
-    int type;
+if ((Label->pt_magic != PT_MAGIC) ||
+    (Label->pt_valid != PT_VALID))
+    goto Return_Cleanup;
 
-    /*
-     * RX01/RX02 media can only have a single partition
-     */
-    if ((part != 0) && (physsectsz != 0))
-      break;
+for (i = 0; i < 8; i++) {
+    uint32 end_lbn = Label->pt_part[i].pi_blkoff + Label->pt_part[i].pi_nblocks;
+    if (end_lbn > max_lbn) {
+        max_lbn = end_lbn;
+        max_lbn_partnum = i;
+        }
+    }
+sim_messagef (SCPE_OK, "%s: '%s' Contains Ultrix partitions\n", sim_uname (uptr), uptr->filename);
+sim_messagef (SCPE_OK, "Partition with highest sector: %c, Sectors On Disk: %u\n", 'a' + max_lbn_partnum, max_lbn);
+ret_val = ((t_offset)max_lbn) * 512;
 
-    base = part << 16;
+Return_Cleanup:
+uptr->capac = saved_capac;
+if (readonly)
+    *readonly = sim_disk_wrp (uptr);
+return ret_val;
+}
 
-    if (_DEC_rdsect(uptr, (base + RT11_HOME) * (512 / ctx->sector_size), (uint8 *)&Home, &sects_read, 512 / ctx->sector_size, physsectsz) ||
-        (sects_read != (512 / ctx->sector_size)))
-        goto Return_Cleanup;
 
-    type = rt11_get_partition_type(&Home, part);
+/* ISO 9660 Volume Recognizer - Structure Info gathered from: https://wiki.osdev.org/ISO_9660 */
 
-    if (type != RT11_NOPART) {
-        uint16 highest = 0;
-        uint8 seg_seen[DH_C_MAXSEG + 1];
-
-        memset(seg_seen, 0, sizeof(seg_seen));
-
-        partitions++;
-
-        dir_seg = 1;
-        do {
-            int offset = sizeof(RT11_DirHeader);
-            int dir_size = sizeof(RT11_DirEntry);
-            uint16 cur_blk;
-
-            if (seg_seen[dir_seg]++ != 0)
-                goto Next_Partition;
-
-            dir_sec = Home.hb_w_firstdir + ((dir_seg - 1) * 2);
-
-            if ((_DEC_rdsect(uptr, (base + dir_sec) * (512 / ctx->sector_size), sector_buf, &sects_read, 1024 / ctx->sector_size, physsectsz)) ||
-                (sects_read != (1024 / ctx->sector_size)))
-                goto Return_Cleanup;
-
-            if (dir_seg == 1) {
-                seg_highest = dir_hdr->dh_w_highest;
-                if (seg_highest > DH_C_MAXSEG)
-                    goto Next_Partition;
-                }
-            dir_size += dir_hdr->dh_w_extra;
-            cur_blk = dir_hdr->dh_w_start;
-
-            while ((1024 - offset) >= dir_size) {
-                RT11_DirEntry *dir_entry = (RT11_DirEntry *)&sector_buf[offset];
-
-                if (dir_entry->de_w_status & DE_C_EOS)
-                    break;
-
-                /*
-                 * Within each directory segment the bas address should never
-                 * decrease.
-                 */
-                if (((cur_blk + dir_entry->de_w_length) & 0xFFFF) < cur_blk)
-                    goto Next_Partition;
+typedef struct ISO_9660_Volume_Descriptor {
+    uint8   Type;                       // Volume Descriptor type code (0, 1, 2, 3 and 255)
+    uint8   Identifier[5];              // Always 'CD001'.
+    uint8   Version;                    // Volume Descriptor Version (0x01).
+    uint8   Data[2041];                 // Depends on the volume descriptor type.
+    } ISO_9660_Volume_Descriptor;
 
-                cur_blk += dir_entry->de_w_length;
-                offset += dir_size;
-                }
-            if (cur_blk > highest)
-                highest = cur_blk;
-            dir_seg = dir_hdr->dh_w_next;
+typedef struct ISO_9660_Primary_Volume_Descriptor {
+    uint8   Type;                       // Always 0x01 for a Primary Volume Descriptor.
+    uint8   Identifier[5];              // Always 'CD001'.
+    uint8   Version;                    // Always 0x01.
+    uint8   Unused;                     // Always 0x00.
+    uint8   SystemIdentifier[32];       // The name of the system that can act upon sectors 0x00-0x0F for the volume.
+    uint8   VolumeIdentifier[32];       // Identification of this volume.
+    uint8   UnusedField[8];             // All zeros.
+    uint32  VolumeSpaceSize[2];         // Number of Logical Blocks in which the volume is recorded
+    uint8   UnusedField2[32];           // All zeroes.
+    uint16  VolumeSetSize[2];           // The size of the set in this logical volume (number of disks).
+    uint16  VolumeSequenceNumber[2];    // The number of this disk in the Volume Set.
+    uint16  LogicalBlockSize[2];        // The size in bytes of a logical block. NB: This means that a logical block on a CD could be something other than 2 KiB!
+    uint32  PathTableSize[2];           // The size in bytes of the path table.
+    uint32  LocationTypeLPathTable;     // LBA location of the path table. The path table pointed to contains only little-endian values.
+    uint32  LocationOptTypeLPathTable;  // LBA location of the optional path table. The path table pointed to contains only little-endian values. Zero means that no optional path table exists.
+    uint32  LocationTypeMPathTable;     // LBA location of the path table. The path table pointed to contains only big-endian values.
+    uint32  LocationOptTypeMPathTable;  // LBA location of the optional path table. The path table pointed to contains only big-endian values. Zero means that no optional path table exists.
+    uint8   DirectoryEntryRootDirectory[34];// Note that this is not an LBA address, it is the actual Directory Record, which contains a single byte Directory Identifier (0x00), hence the fixed 34 byte size.
+    uint8   VolumeSetIdentifier[128];   // Identifier of the volume set of which this volume is a member.
+    uint8   PublisherIdentifier[128];   // The volume publisher. For extended publisher information, the first byte should be 0x5F, followed by the filename of a file in the root directory. If not specified, all bytes should be 0x20.
+    uint8   DataPreparerIdentifier[128];// The identifier of the person(s) who prepared the data for this volume. For extended preparation information, the first byte should be 0x5F, followed by the filename of a file in the root directory. If not specified, all bytes should be 0x20.
+    uint8   ApplicationIdentifier[128]; // Identifies how the data are recorded on this volume. For extended information, the first byte should be 0x5F, followed by the filename of a file in the root directory. If not specified, all bytes should be 0x20.
+    uint8   CopyrightFileIdentifier[37];// Filename of a file in the root directory that contains copyright information for this volume set. If not specified, all bytes should be 0x20.
+    uint8   AbstractFileIdentifier[37]; // Filename of a file in the root directory that contains abstract information for this volume set. If not specified, all bytes should be 0x20.
+    uint8   BibliographicFileIdentifier[37];// Filename of a file in the root directory that contains bibliographic information for this volume set. If not specified, all bytes should be 0x20.
+    uint8   VolumeCreationDateTime[17]; // The date and time of when the volume was created.
+    uint8   VolumeModificationDateTime[17];// The date and time of when the volume was modified.
+    uint8   VolumeExpirationDateTime[17];// The date and time after which this volume is considered to be obsolete. If not specified, then the volume is never considered to be obsolete.
+    uint8   VolumeEffectiveDateTime[17];// The date and time after which the volume may be used. If not specified, the volume may be used immediately.
+    uint8   FileStructureVersion;       // The directory records and path table version (always 0x01).
+    uint8   Unused2;                    // Always 0x00.
+    uint8   ApplicationUsed[512];       // Contents not defined by ISO 9660.
+    uint8   Reserved[653];              // Reserved by ISO.
+    } ISO_9660_Primary_Volume_Descriptor;
 
-            if (dir_seg > seg_highest)
-                goto Next_Partition;
-            } while (dir_seg != 0);
+static t_offset get_iso9660_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+{
+DEVICE *dptr;
+t_addr saved_capac;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
+uint8 sector_buf[2048];
+ISO_9660_Volume_Descriptor *Desc = (ISO_9660_Volume_Descriptor *)sector_buf;
+uint8 primary_buf[2048];
+ISO_9660_Primary_Volume_Descriptor *Primary = NULL;
+t_lba sectfactor = sizeof (*Desc) / ctx->sector_size;
+t_offset ret_val = (t_offset)-1;
+t_offset cur_pos = 32768;           /* Beyond the boot area of an ISO 9660 image */
+t_seccnt sectsread;
+int read_count = 0;
 
-        ret_val = (t_offset)((base + highest) * (t_offset)512);
-        version = Home.hb_w_sysver;
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
+    return ret_val;
+saved_capac = uptr->capac;
+uptr->capac = temp_capac;
 
-        if (type == RT11_SINGLEPART)
-          break;
+while (sim_disk_rdsect(uptr, (t_lba)(sectfactor * cur_pos / sizeof (*Desc)), (uint8 *)Desc, &sectsread, sectfactor) == DKSE_OK) {
+    if ((sectsread != sectfactor)               ||
+        (Desc->Version != 1)                    ||
+        (0 != memcmp (Desc->Identifier, "CD001", sizeof (Desc->Identifier))))
+        break;
+    if (Desc->Type == 1) {  /* Primary Volume Descriptor */
+        Primary = (ISO_9660_Primary_Volume_Descriptor *)primary_buf;
+        *Primary = *(ISO_9660_Primary_Volume_Descriptor *)Desc;
         }
-Next_Partition:
-    ;
-    }
-
-Return_Cleanup:
-if (partitions) {
-    const char *parttype;
-
-    switch (version) {
-        case HB_C_SYSVER_V3A:
-            parttype = "V3A";
-            break;
-
-        case HB_C_SYSVER_V04:
-            parttype = "V04";
-            break;
-
-        case HB_C_SYSVER_V05:
-            parttype = "V05";
-            break;
+    cur_pos += sizeof (*Desc);
+    ++read_count;
+    if ((Desc->Type == 255) ||
+        (read_count >= 32)) {
+        ret_val = ctx->container_size;
+        sim_messagef (SCPE_OK, "%s: '%s' Contains an ISO 9660 filesystem\n", sim_uname (uptr), uptr->filename);
+        if (Primary) {
+            char VolId[sizeof (Primary->VolumeIdentifier) + 1];
 
-        default:
-            parttype = "???";
-            break;
+            memcpy (VolId, Primary->VolumeIdentifier, sizeof (Primary->VolumeIdentifier));
+            VolId[sizeof (Primary->VolumeIdentifier)] = '\0';
+            sim_messagef (SCPE_OK, "%s: Volume Identifier: %s   Containing %u %u Byte Sectors\n", sim_uname (uptr), sim_trim_endspc (VolId), (uint32)(ctx->container_size / Primary->LogicalBlockSize[1 - sim_end]), (uint32)Primary->LogicalBlockSize[1 - sim_end]);
+            }
+        break;
         }
-    sim_messagef (SCPE_OK, "%s: '%s' Contains RT11 partitions\n", sim_uname (uptr), uptr->filename);
-    sim_messagef (SCPE_OK, "%d valid partition%s, Type: %s, Sectors On Disk: %u\n", partitions, partitions == 1 ? "" : "s", parttype, (uint32)(ret_val / 512));
     }
 uptr->capac = saved_capac;
 if (readonly)
-    *readonly = sim_disk_wrp (uptr);
+    *readonly = sim_disk_wrp (uptr) || (ret_val != (t_offset)-1);
 return ret_val;
 }
 
-t_offset pseudo_filesystem_size = 0;        /* Dummy file system check return used during testing */
-
-typedef t_offset (*FILESYSTEM_CHECK)(UNIT *uptr, uint32, t_bool *);
-
-static t_offset get_filesystem_size (UNIT *uptr, t_bool *readonly)
-{
-static FILESYSTEM_CHECK checks[] = {
-    &get_ods2_filesystem_size,
-    &get_ods1_filesystem_size,
-    &get_ultrix_filesystem_size,
-    &get_iso9660_filesystem_size,
-    &get_rsts_filesystem_size,
-    &get_rt11_filesystem_size,          /* This should be the last entry
-                                           in the table to reduce the
-                                           possibility of matching an RT-11
-                                           container file stored in another
-                                           filesystem */
-    NULL
-    };
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-uint32 saved_sector_size = ctx->sector_size;
-t_offset ret_val = (t_offset)-1;
-int i;
-
-if (pseudo_filesystem_size != 0) {      /* Dummy file system size mechanism? */
-    sim_messagef (SCPE_OK, "%s: '%s' Pseudo File System containing %u %d byte sectors\n", sim_uname (uptr), uptr->filename, (uint32)(pseudo_filesystem_size / ctx->sector_size), ctx->sector_size);
-    return pseudo_filesystem_size;
-    }
-
-for (i = 0; checks[i] != NULL; i++)
-    if ((ret_val = checks[i] (uptr, 0, readonly)) != (t_offset)-1) {
-        /* ISO files that haven't already been determined to be ISO 9660
-         * which contain a known file system are also marked read-only
-         * now.  This fits early DEC distribution CDs that were created
-         * before ISO 9660 was standardized and operating support was added.
-         */
-        if ((readonly != NULL)          &&
-            (*readonly == FALSE)        &&
-            (NULL != match_ext (uptr->filename, "ISO")))
-            *readonly = TRUE;
-        return ret_val;
-        }
+#pragma pack(push,1)
 /*
- * The only known interleaved disk devices have either 256 byte
- * or 128 byte sector sizes.  If additional interleaved file
- * system scenarios with different sector sizes come up they
- * should be added here.
+ * The first logical block of device cluster 1 is either:
+ *      1. MFD label entry (RSTS versions through 7.x)
+ *      2. Disk Pack label (RSTS version 8.0 and later)
  */
+typedef struct _RSTS_MFDLABEL {
+    uint16  ml_ulnk;
+    uint16  ml_mbm1;
+    uint16  ml_reserved1;
+    uint16  ml_reserved2;
+    uint16  ml_pcs;
+    uint16  ml_pstat;
+    uint16  ml_packid[2];
+    } RSTS_MFDLABEL;
 
-for (i = 0; checks[i] != NULL; i++) {
-    ctx->sector_size = 256;
-    if ((ret_val = checks[i] (uptr, ctx->sector_size, readonly)) != (t_offset)-1)
-        break;
-    ctx->sector_size = 128;
-    if ((ret_val = checks[i] (uptr, ctx->sector_size, readonly)) != (t_offset)-1)
-        break;
-    }
-if ((ret_val != (t_offset)-1) && (ctx->sector_size != saved_sector_size ))
-    sim_messagef (SCPE_OK, "%s: with an unexpected sector size of %u bytes instead of %u bytes\n",
-                           sim_uname (uptr), ctx->sector_size, saved_sector_size);
-ctx->sector_size = saved_sector_size;
-return ret_val;
-}
-
-static t_stat store_disk_footer (UNIT *uptr, const char *dtype);
+typedef struct _RSTS_PACKLABEL {
+    uint16  pk_mb01;
+    uint16  pk_mbm1;
+    uint16  pk_mdcn;
+    uint16  pk_plvl;
+#define PK_LVL0         0000
+#define PK_LVL11        0401
+#define PK_LVL12        0402
+    uint16  pk_ppcs;
+    uint16  pk_pstat;
+#define PK_UC_NEW       0020000
+    uint16  pk_packid[2];
+    uint16  pk_tapgvn[2];
+    uint16  pk_bckdat;
+    uint16  pk_bcktim;
+    } RSTS_PACKLABEL;
 
-static t_stat get_disk_footer (UNIT *uptr)
-{
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-struct simh_disk_footer *f = (struct simh_disk_footer *)calloc (1, sizeof (*f));
-t_offset container_size;
-t_offset sim_fsize_ex (FILE *fptr);
-uint32 bytesread;
-
-if (f == NULL)
-    return SCPE_MEM;
-sim_debug_unit (ctx->dbit, uptr, "get_disk_footer(%s)\n", sim_uname (uptr));
-switch (DK_GET_FMT (uptr)) {                            /* case on format */
-    case DKUF_F_STD:                                    /* SIMH format */
-        container_size = sim_fsize_ex (uptr->fileref);
-        if ((container_size != (t_offset)-1) && (container_size > (t_offset)sizeof (*f)) &&
-            (sim_fseeko (uptr->fileref, container_size - sizeof (*f), SEEK_SET) == 0) &&
-            (sizeof (*f) == sim_fread (f, 1, sizeof (*f), uptr->fileref)))
-            break;
-        free (f);
-        f = NULL;
-        break;
-    case DKUF_F_RAW:                                    /* RAW format */
-        container_size = sim_os_disk_size_raw (uptr->fileref);
-        if ((container_size != (t_offset)-1) && (container_size > (t_offset)sizeof (*f)) &&
-            (sim_os_disk_read (uptr, container_size - sizeof (*f), (uint8 *)f, &bytesread, sizeof (*f)) == SCPE_OK) &&
-            (bytesread == sizeof (*f)))
-            break;
-        free (f);
-        f = NULL;
-        break;
-    case DKUF_F_VHD:                                    /* VHD format */
-        if (1) {
-            time_t creation_time;
-
-            /* Construct a pseudo simh disk footer*/
-            memcpy (f->Signature, "simh", 4);
-            f->FooterVersion = FOOTER_VERSION;
-            memset (f->DriveType, 0, sizeof (f->DriveType));
-            strlcpy ((char *)f->DriveType, sim_vhd_disk_get_dtype (uptr->fileref, &f->SectorSize, &f->TransferElementSize, (char *)f->CreatingSimulator, &creation_time), sizeof (f->DriveType));
-            f->SectorSize = NtoHl (f->SectorSize);
-            f->TransferElementSize = NtoHl (f->TransferElementSize);
-            if ((f->SectorSize == 0) || (NtoHl (f->SectorSize) == 0x00020000)) {  /* Old or mangled format VHD footer */
-                sim_vhd_disk_set_dtype (uptr->fileref, (char *)f->DriveType, ctx->sector_size, ctx->xfer_element_size);
-                sim_vhd_disk_get_dtype (uptr->fileref, &f->SectorSize, &f->TransferElementSize, (char *)f->CreatingSimulator, NULL);
-                f->SectorSize = NtoHl (f->SectorSize);
-                f->TransferElementSize = NtoHl (f->TransferElementSize);
-                }
-            memset (f->CreationTime, 0, sizeof (f->CreationTime));
-            strlcpy ((char*)f->CreationTime, ctime (&creation_time), sizeof (f->CreationTime));
-            container_size = sim_vhd_disk_size (uptr->fileref);
-            if ((f->SectorSize != 0) && (NtoHl (f->SectorSize) <= 65536)) /* Range check for Coverity sake */
-                f->SectorCount = NtoHl ((uint32)(container_size / NtoHl (f->SectorSize)));
-            container_size += sizeof (*f);      /* Adjust since it is removed below */
-            f->AccessFormat = DKUF_F_VHD;
-            f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
-            }
-        break;
-    default:
-        free (f);
-        return SCPE_IERR;
-    }
-if (f) {
-    if (f->Checksum != NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)))) {
-        sim_debug_unit (ctx->dbit, uptr, "No footer found on %s format container: %s\n", sim_disk_fmt (uptr), uptr->filename);
-        free (f);
-        f = NULL;
-        }
-    else {
-        /* We've got a valid footer, but it may need to be corrected */
-        if ((NtoHl (f->TransferElementSize) == 1) &&
-            (0 == memcmp (f->DriveType, "RZ", 2))) {
-            f->TransferElementSize = NtoHl (2);
-            f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
-            store_disk_footer (uptr, (char *)f->DriveType);
-            }
-        free (ctx->footer);
-        ctx->footer = f;
-        ctx->highwater = (((t_offset)NtoHl (f->Highwater[0])) << 32) | ((t_offset)NtoHl (f->Highwater[1]));
-        container_size -= sizeof (*f);
-        sim_debug_unit (ctx->dbit, uptr, "Footer: %s - %s\n"
-            "   Simulator:           %s\n"
-            "   DriveType:           %s\n"
-            "   SectorSize:          %u\n"
-            "   SectorCount:         %u\n"
-            "   TransferElementSize: %u\n"
-            "   FooterVersion:       %u\n"
-            "   AccessFormat:        %u\n"
-            "   CreationTime:        %s",
-            sim_uname (uptr), uptr->filename,
-            f->CreatingSimulator, f->DriveType, NtoHl(f->SectorSize), NtoHl (f->SectorCount),
-            NtoHl (f->TransferElementSize), f->FooterVersion, f->AccessFormat, f->CreationTime);
-        if (f->DeviceName[0] != '\0')
-            sim_debug_unit (ctx->dbit, uptr,
-                "   DeviceName:          %s\n", (char *)f->DeviceName);
-        sim_debug_unit (ctx->dbit, uptr,
-            "   HighwaterSector:     %u\n", (uint32)(ctx->highwater/ctx->sector_size));
-        }
-    }
-sim_debug_unit (ctx->dbit, uptr, "Container Size: %u sectors %u bytes each\n", (uint32)(container_size/ctx->sector_size), ctx->sector_size);
-ctx->container_size = container_size;
-return SCPE_OK;
-}
+typedef union _RSTS_ROOT {
+    RSTS_MFDLABEL  rt_mfd;
+    RSTS_PACKLABEL rt_pack;
+    uint8          rt_block[512];
+    } RSTS_ROOT;
 
-static t_stat store_disk_footer (UNIT *uptr, const char *dtype)
-{
-DEVICE *dptr;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-struct stat statb;
-struct simh_disk_footer *f;
-time_t now = time (NULL);
-t_offset total_sectors;
-t_offset highwater;
+typedef struct _RSTS_MFDBLOCKETTE {
+    uint16  mb_ulnk;
+    uint16  mb_mbm1;
+    uint16  mb_reserved1;
+    uint16  mb_reserved2;
+    uint16  mb_reserved3;
+    uint16  mb_malnk;
+    uint16  mb_lppn;
+    uint16  mb_lid;
+#define MB_ID           0051064
+    } RSTS_MFDBLOCKETTE;
+#define IS_VALID_RSTS_MFD(b) \
+     ((((b)->mb_ulnk == 0) || ((b)->mb_ulnk == 1)) &&                         \
+      ((b)->mb_mbm1 == 0177777) &&                                            \
+      ((b)->mb_reserved1 == 0) &&                                             \
+      ((b)->mb_reserved2 == 0) &&                                             \
+      ((b)->mb_reserved3 == 0) &&                                             \
+      ((b)->mb_lppn == 0177777) &&                                            \
+      ((b)->mb_lid == MB_ID))
 
-return SCPE_OK;
+typedef struct _RSTS_GFDBLOCKETTE {
+    uint16  gb_ulnk;
+    uint16  gb_mbm1;
+    uint16  gb_reserved1;
+    uint16  gb_reserved2;
+    uint16  gb_reserved3;
+    uint16  gb_reserved4;
+    uint16  gb_lppn;
+    uint16  gb_lid;
+#define GB_ID           0026264
+    } RSTS_GFDBLOCKETTE;
+#define IS_VALID_RSTS_GFD(b, g) \
+     ((((b)->gb_ulnk == 0) || ((b)->gb_ulnk == 1)) &&                         \
+      ((b)->gb_mbm1 == 0177777) &&                                            \
+      ((b)->gb_reserved1 == 0) &&                                             \
+      ((b)->gb_reserved2 == 0) &&                                             \
+      ((b)->gb_reserved3 == 0) &&                                             \
+      ((b)->gb_reserved4 == 0) &&                                             \
+      ((b)->gb_lppn == (((g) << 8) | 0377)) &&                                \
+      ((b)->gb_lid == GB_ID))
 
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return SCPE_NOATT;
-if (uptr->flags & UNIT_RO)
-    return SCPE_RO;
-if (sim_stat (uptr->filename, &statb))
-    memset (&statb, 0, sizeof (statb));
-f = (struct simh_disk_footer *)calloc (1, sizeof (*f));
-f->AccessFormat = DK_GET_FMT (uptr);
-total_sectors = (((t_offset)uptr->capac) * ctx->capac_factor * ((dptr->flags & DEV_SECTORS) ? 512 : 1)) / ctx->sector_size;
-memcpy (f->Signature, "simh", 4);
-f->FooterVersion = FOOTER_VERSION;
-memset (f->CreatingSimulator, 0, sizeof (f->CreatingSimulator));
-strlcpy ((char *)f->CreatingSimulator, sim_name, sizeof (f->CreatingSimulator));
-memset (f->DriveType, 0, sizeof (f->DriveType));
-strlcpy ((char *)f->DriveType, dtype, sizeof (f->DriveType));
-f->SectorSize = NtoHl (ctx->sector_size);
-f->SectorCount = NtoHl ((uint32)total_sectors);
-f->TransferElementSize = NtoHl (ctx->xfer_element_size);
-memset (f->CreationTime, 0, sizeof (f->CreationTime));
-strlcpy ((char*)f->CreationTime, ctime (&now), sizeof (f->CreationTime));
-memset (f->DeviceName, 0, sizeof (f->DeviceName));
-strlcpy ((char*)f->DeviceName, dptr->name, sizeof (f->DeviceName));
-highwater = sim_fsize_name_ex (uptr->filename);
-/* Align Initial Highwater to a sector boundary */
-highwater = ((highwater + ctx->sector_size - 1) / ctx->sector_size) * ctx->sector_size;
-f->Highwater[0] = NtoHl ((uint32)(highwater >> 32));
-f->Highwater[1] = NtoHl ((uint32)(highwater & 0xFFFFFFFF));
-f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
-free (ctx->footer);
-ctx->footer = f;
-switch (f->AccessFormat) {
-    case DKUF_F_STD:                                    /* SIMH format */
-        if (sim_fseeko ((FILE *)uptr->fileref, total_sectors * ctx->sector_size, SEEK_SET) == 0) {
-            sim_fwrite (f, sizeof (*f), 1, (FILE *)uptr->fileref);
-            fclose ((FILE *)uptr->fileref);
-            sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
-            uptr->fileref = sim_fopen (uptr->filename, "rb+");
-            }
-        break;
-    case DKUF_F_VHD:                                    /* VHD format */
-        break;
-    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
-        sim_os_disk_write (uptr, total_sectors * ctx->sector_size, (uint8 *)f, NULL, sizeof (*f));
-        sim_os_disk_close_raw (uptr->fileref);
-        sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
-        uptr->fileref = sim_os_disk_open_raw (uptr->filename, "rb+");
-        break;
-    default:
-        break;
-    }
-return SCPE_OK;
-}
+typedef struct _RSTS_UFDBLOCKETTE {
+    uint16  ub_ulnk;
+    uint16  ub_mbm1;
+    uint16  ub_reserved1;
+    uint16  ub_reserved2;
+    uint16  ub_reserved3;
+    uint16  ub_reserved4;
+    uint16  ub_lppn;
+    uint16  ub_lid;
+#define UB_ID           0102064
+    } RSTS_UFDBLOCKETTE;
+#define IS_VALID_RSTS_UFD(b, g, u) \
+     (((b)->ub_mbm1 == 0177777) &&                                            \
+      ((b)->ub_reserved1 == 0) &&                                             \
+      ((b)->ub_reserved2 == 0) &&                                             \
+      ((b)->ub_reserved3 == 0) &&                                             \
+      ((b)->ub_reserved4 == 0) &&                                             \
+      ((b)->ub_lppn == (((g) << 8) | (u))) &&                                 \
+      ((b)->ub_lid == UB_ID))
 
-static t_stat update_disk_footer (UNIT *uptr)
-{
-DEVICE *dptr;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-struct stat statb;
-struct simh_disk_footer *f;
-t_offset total_sectors;
-t_offset highwater;
-t_offset footer_highwater;
+typedef struct _RSTS_UNAME {
+    uint16  un_ulnk;
+    uint16  un_unam;
+    uint16  un_reserved1;
+    uint16  un_reserved2;
+    uint16  un_ustat;
+    uint16  un_uacnt;
+    uint16  un_uaa;
+    uint16  un_uar;
+    } RSTS_UNAME;
 
-return SCPE_OK;
+typedef struct _RSTS_FNAME {
+    uint16  fn_ulnk;
+    uint16  fn_unam[3];
+    uint16  fn_ustat;
+    uint16  fn_uacnt;
+    uint16  fn_uaa;
+    uint16  fn_uar;
+    } RSTS_FNAME;
 
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return SCPE_NOATT;
-if (uptr->flags & UNIT_RO)
-    return SCPE_RO;
-if (ctx == NULL)
-    return SCPE_IERR;
-f = ctx->footer;
-if (f == NULL)
-    return SCPE_IERR;
+typedef struct _RSTS_ACNT {
+    uint16  ac_ulnk;
+    uint16  ac_udla;
+    uint16  ac_usiz;
+    uint16  ac_udc;
+    uint16  ac_utc;
+    uint16  ac_urts[2];
+    uint16  ac_uclus;
+    } RSTS_ACNT;
 
-footer_highwater = (((t_offset)NtoHl (f->Highwater[0])) << 32) | ((t_offset)NtoHl (f->Highwater[1]));
-if (ctx->highwater <= footer_highwater)
-    return SCPE_OK;
+typedef struct _RSTS_RETR {
+    uint16  rt_ulnk;
+    uint16  rt_uent[7];
+#define RT_ENTRIES      7
+    } RSTS_RETR;
 
-if (sim_stat (uptr->filename, &statb))
-    memset (&statb, 0, sizeof (statb));
-total_sectors = (((t_offset)uptr->capac) * ctx->capac_factor * ((dptr->flags & DEV_SECTORS) ? 512 : 1)) / ctx->sector_size;
-highwater = ctx->highwater;
-f->Highwater[0] = NtoHl ((uint32)(highwater >> 32));
-f->Highwater[1] = NtoHl ((uint32)(highwater & 0xFFFFFFFF));
-f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
-switch (f->AccessFormat) {
-    case DKUF_F_STD:                                    /* SIMH format */
-        if (sim_fseeko ((FILE *)uptr->fileref, total_sectors * ctx->sector_size, SEEK_SET) == 0) {
-            sim_fwrite (f, sizeof (*f), 1, (FILE *)uptr->fileref);
-            fclose ((FILE *)uptr->fileref);
-            sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
-            uptr->fileref = sim_fopen (uptr->filename, "rb+");
-            }
-        break;
-    case DKUF_F_VHD:                                    /* VHD format */
-        break;
-    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
-        sim_os_disk_write (uptr, total_sectors * ctx->sector_size, (uint8 *)f, NULL, sizeof (*f));
-        sim_os_disk_close_raw (uptr->fileref);
-        sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
-        uptr->fileref = sim_os_disk_open_raw (uptr->filename, "rb+");
-        break;
-    default:
-        break;
-    }
-return SCPE_OK;
-}
+typedef struct _RSTS_DCMAP {
+    uint16  dc_clus;
+#define DC_MASK         0077777
+    uint16  dc_map[7];
+    }  RSTS_DCMAP;
 
-t_stat sim_disk_attach (UNIT *uptr, const char *cptr, size_t sector_size, size_t xfer_element_size, t_bool dontchangecapac,
-                        uint32 dbit, const char *dtype, uint32 pdp11tracksize, int completion_delay)
+/*
+ * Directory link definitions
+ */
+#define DL_USE          0000001
+#define DL_BAD          0000002
+#define DL_CHE          0000004
+#define DL_CLN          0000010
+#define DL_ENO          0000760
+#define DL_CLO          0007000
+#define DL_BLO          0170000
+
+#define DLSH_ENO         4
+#define DLSH_CLO         9
+#define DLSH_BLO        12
+
+#define BLOCKETTE_SZ    (8 * sizeof(uint16))
+#define MAP_OFFSET      (31 * BLOCKETTE_SZ)
+
+#define SATT0           0073374
+#define SATT1           0076400
+#define SATT2           0075273
+
+#pragma pack(pop)
+
+typedef struct _rstsContext {
+    UNIT        *uptr;
+    int         dcshift;
+    int         pcs;
+    char        packid[8];
+    t_seccnt    sects;
+    RSTS_DCMAP  map;
+} rstsContext;
+
+static char rad50[] = " ABCDEFGHIJKLMNOPQRSTUVWXYZ$.%0123456789";
+
+static void r50Asc(uint16 val, char *buf)
 {
-return sim_disk_attach_ex (uptr, cptr, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay, NULL);
+buf[2] = rad50[val % 050];
+val /= 050;
+buf[1] = rad50[val % 050];
+buf[0] = rad50[val / 050];
 }
 
-t_stat sim_disk_attach_ex (UNIT *uptr, const char *cptr, size_t sector_size, size_t xfer_element_size, t_bool dontchangecapac,
-                           uint32 dbit, const char *dtype, uint32 pdp11tracksize, int completion_delay, const char **drivetypes)
+static t_stat rstsValidateClusterSize(uint16 size, uint16 minSize)
 {
-return sim_disk_attach_ex2 (uptr, cptr, sector_size, xfer_element_size, dontchangecapac,
-                            dbit, dtype, pdp11tracksize, completion_delay, drivetypes, 0);
+int i;
+
+/*
+ * Check that the cluster size is a power of 2 and greater than or equal
+ * to some location dependent value.
+ */
+if (size >= minSize)
+    for (i = 0; i < 16; i++)
+        if (size == (1 << i))
+            return SCPE_OK;
+
+return SCPE_IOERR;
 }
 
-t_stat sim_disk_attach_ex2 (UNIT *uptr, const char *cptr, size_t sector_size, size_t xfer_element_size, t_bool dontchangecapac,
-                            uint32 dbit, const char *dtype, uint32 pdp11tracksize, int completion_delay, const char **drivetypes,
-                            size_t reserved_sectors)
+static t_stat rstsReadBlock(rstsContext *context, uint16 cluster, uint16 block, void *buf)
 {
-struct disk_context *ctx;
-DEVICE *dptr;
-char tbuf[4*CBUFSIZE];
-FILE *(*open_function)(const char *filename, const char *mode) = sim_fopen;
-FILE *(*create_function)(const char *filename, t_offset desiredsize) = NULL;
-t_stat (*storage_function)(FILE *file, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom) = NULL;
-t_bool created = FALSE, copied = FALSE, autosized = FALSE;
-t_bool auto_format = FALSE;
-t_offset container_size, filesystem_size, current_unit_size;
-size_t tmp_size = 1;
+t_lba blk = (cluster << context->dcshift) + block;
+t_seccnt sects_read;
 
-if (sim_disk_no_autosize) {
-    dontchangecapac = TRUE;
-    drivetypes = NULL;
-    }
-if (uptr->flags & UNIT_DIS)                             /* disabled? */
-    return SCPE_UDIS;
-if (!(uptr->flags & UNIT_ATTABLE))                      /* not attachable? */
-    return SCPE_NOATT;
-if ((dptr = find_dev_from_unit (uptr)) == NULL)
-    return SCPE_NOATT;
-switch (xfer_element_size) {
-    default:
-        return sim_messagef (SCPE_ARG, "Unsupported transfer element size: %u\n", (uint32)xfer_element_size);
-    case 1: case 2: case 4: case 8:
-        break;
-    }
-if ((sector_size % xfer_element_size) != 0)
-    return sim_messagef (SCPE_ARG, "Invalid sector size: %u - must be a multiple of the transfer element size %u\n", (uint32)sector_size, (uint32)xfer_element_size);
-if (sim_switches & SWMASK ('F')) {                      /* format spec? */
-    char gbuf[CBUFSIZE];
-    cptr = get_glyph (cptr, gbuf, 0);                   /* get spec */
-    if (*cptr == 0)                                     /* must be more */
-        return SCPE_2FARG;
-    if ((sim_disk_set_fmt (uptr, 0, gbuf, NULL) != SCPE_OK) ||
-        (DK_GET_FMT (uptr) == DKUF_F_AUTO))
-        return sim_messagef (SCPE_ARG, "Invalid Override Disk Format: %s\n", gbuf);
-    sim_switches = sim_switches & ~(SWMASK ('F'));      /* Record Format specifier already processed */
-    auto_format = TRUE;
-    }
-if (sim_switches & SWMASK ('D')) {                      /* create difference disk? */
-    char gbuf[CBUFSIZE];
-    FILE *vhd;
+if ((sim_disk_rdsect(context->uptr, blk * context->sects, (uint8 *)buf, &sects_read, context->sects) == SCPE_OK) &&
+    (sects_read == context->sects))
+    return SCPE_OK;
 
-    sim_switches = sim_switches & ~(SWMASK ('D'));
-    cptr = get_glyph_nc (cptr, gbuf, 0);                /* get spec */
-    if (*cptr == 0)                                     /* must be more */
-        return SCPE_2FARG;
-    vhd = sim_vhd_disk_create_diff (gbuf, cptr);
-    if (vhd) {
-        sim_vhd_disk_close (vhd);
-        return sim_disk_attach (uptr, gbuf, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay);
+return SCPE_IOERR;
+}
+
+static t_stat rstsReadBlockette(rstsContext *context, uint16 link, void *buf)
+{
+uint16 block = (link & DL_BLO) >> DLSH_BLO;
+uint16 dcn = (link & DL_CLO) >> DLSH_CLO;
+uint16 blockette = (link & DL_ENO) >> DLSH_ENO;
+uint8 temp[512];
+
+if ((dcn != 7) && (blockette != 31) &&
+    (block <= (context->map.dc_clus & DC_MASK))) {
+    if (rstsReadBlock(context, context->map.dc_map[dcn], block, temp) == SCPE_OK) {
+        memcpy(buf, &temp[blockette * BLOCKETTE_SZ], BLOCKETTE_SZ);
+        return SCPE_OK;
         }
-    return sim_messagef (SCPE_ARG, "Unable to create differencing VHD: %s\n", gbuf);
     }
-if (sim_switches & SWMASK ('C')) {                      /* create new disk container & copy contents? */
-    char gbuf[CBUFSIZE];
-    const char *dest_fmt = ((DK_GET_FMT (uptr) == DKUF_F_AUTO) || (DK_GET_FMT (uptr) == DKUF_F_VHD)) ? "VHD" : "SIMH";
-    FILE *dest;
-    int saved_sim_switches = sim_switches;
-    int32 saved_sim_quiet = sim_quiet;
-    t_addr target_capac = uptr->capac;
-    t_addr source_capac;
-    uint32 capac_factor;
-    t_stat r;
+return SCPE_IOERR;
+}
 
-    sim_switches = sim_switches & ~(SWMASK ('C'));
-    cptr = get_glyph_nc (cptr, gbuf, 0);                /* get spec */
-    if (*cptr == 0)                                     /* must be more */
-        return SCPE_2FARG;
-    sim_switches |= SWMASK ('R') | SWMASK ('E');
-    sim_quiet = TRUE;
-    /* First open the source of the copy operation */
-    r = sim_disk_attach_ex (uptr, cptr, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay, NULL);
-    sim_quiet = saved_sim_quiet;
-    if (r != SCPE_OK) {
-        sim_switches = saved_sim_switches;
-        return sim_messagef (r, "%s: Cannot open copy source: %s - %s\n", sim_uname (uptr), cptr, sim_error_text (r));
-        }
-    source_capac = uptr->capac;
-    sim_messagef (SCPE_OK, "%s: Creating new %s '%s' disk container copied from '%s'\n", sim_uname (uptr), dest_fmt, gbuf, cptr);
-    capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
-    uptr->capac = target_capac;
-    if (strcmp ("VHD", dest_fmt) == 0)
-        dest = sim_vhd_disk_create (gbuf, ((t_offset)uptr->capac)*capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1));
-    else
-        dest = sim_fopen (gbuf, "wb+");
-    if (!dest) {
-        sim_disk_detach (uptr);
-        return sim_messagef (r, "%s: Cannot create %s disk container '%s'\n", sim_uname (uptr), dest_fmt, gbuf);
-        }
-    else {
-        uint8 *copy_buf = (uint8*) malloc (1024*1024);
-        t_lba lba;
-        t_seccnt sectors_per_buffer = (t_seccnt)((1024*1024)/sector_size);
-        t_lba total_sectors = (t_lba)((target_capac*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1)));
-        t_seccnt sects = sectors_per_buffer;
-        t_seccnt sects_read;
+static t_stat rstsFind01UFD(rstsContext *context, uint16 *ufd, uint16 *level)
+{
+uint16 dcs = 1 << context->dcshift;
+RSTS_ROOT root;
+uint16 buf[256];
 
-        if (!copy_buf) {
-            if (strcmp ("VHD", dest_fmt) == 0)
-                sim_vhd_disk_close (dest);
-            else
-                fclose (dest);
-            (void)remove (gbuf);
-            sim_disk_detach (uptr);
-            return SCPE_MEM;
-            }
-        sim_messagef (SCPE_OK, "Copying %u sectors each %u bytes in size\n", (uint32)total_sectors, (uint32)sector_size);
-        if (source_capac > target_capac) {
-            sim_messagef (SCPE_OK, "The source container is %u sectors larger than the destination disk container\n",
-                        (t_lba)(((source_capac - target_capac)*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1))));
-            sim_messagef (SCPE_OK, "these additional sectors will be unavailable on the target drive\n");
-            }
-        for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects_read) {
-            uptr->capac = source_capac;
-            sects = sectors_per_buffer;
-            if (lba + sects > total_sectors)
-                sects = total_sectors - lba;
-            r = sim_disk_rdsect (uptr, lba, copy_buf, &sects_read, sects);
-            if ((r == SCPE_OK) && (sects_read > 0)) {
-                uint32 saved_unit_flags = uptr->flags;
-                FILE *save_unit_fileref = uptr->fileref;
-                t_seccnt sects_written;
+if (rstsReadBlock(context, 1, 0, &root) == SCPE_OK) {
+    /*
+     * First validate fields which are common to both the MFD label and
+     * Pack label - we'll use Pack label offsets here.
+     */
+    if ((root.rt_pack.pk_mbm1 == 0177777) &&
+        (rstsValidateClusterSize(root.rt_pack.pk_ppcs, dcs) == SCPE_OK)) {
+        char ch, *tmp = &context->packid[1];
+        uint16 mfd, gfd;
 
-                sim_disk_set_fmt (uptr, 0, dest_fmt, NULL);
-                uptr->fileref = dest;
-                uptr->capac = target_capac;
-                r = sim_disk_wrsect (uptr, lba, copy_buf, &sects_written, sects_read);
-                uptr->fileref = save_unit_fileref;
-                uptr->flags = saved_unit_flags;
-                if (sects_read != sects_written)
-                    r = SCPE_IOERR;
-                sim_messagef (SCPE_OK, "%s: Copied %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)(lba + sects_read), (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
+        context->pcs = root.rt_pack.pk_ppcs;
+
+        r50Asc(root.rt_pack.pk_packid[0], &context->packid[0]);
+        r50Asc(root.rt_pack.pk_packid[1], &context->packid[3]);
+        context->packid[6] = '\0';
+
+        /*
+         * The Pack ID must consist of 1 - 6 alphanumeric characters
+         * padded at the end with spaces.
+         */
+        if (!isalnum(context->packid[0]))
+            return SCPE_IOERR;
+
+        while ((ch = *tmp++) != 0) {
+            if (!isalnum(ch)) {
+                if (ch != ' ')
+                    return SCPE_IOERR;
+
+                while (*tmp)
+                    if (*tmp++ != ' ')
+                        return SCPE_IOERR;
+                break;
                 }
             }
-        if (r == SCPE_OK)
-            sim_messagef (SCPE_OK, "\n%s: Copied %u sectors. Done.\n", sim_uname (uptr), (uint32)total_sectors);
-        else
-            sim_messagef (r, "\n%s: Error copying: %s.\n", sim_uname (uptr), sim_error_text (r));
-        if ((r == SCPE_OK) && (sim_switches & SWMASK ('V'))) {
-            uint8 *verify_buf = (uint8*) malloc (1024*1024);
-            t_seccnt sects_read, verify_read;
 
-            if (!verify_buf) {
-                if (strcmp ("VHD", dest_fmt) == 0)
-                    sim_vhd_disk_close (dest);
-                else
-                    fclose (dest);
-                (void)remove (gbuf);
-                free (copy_buf);
-                sim_disk_detach (uptr);
-                return SCPE_MEM;
-                }
-            for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects_read) {
-                sim_messagef (SCPE_OK, "%s: Verified %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)lba, (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
-                uptr->capac = source_capac;
-                sects = sectors_per_buffer;
-                if (lba + sects > total_sectors)
-                    sects = total_sectors - lba;
-                r = sim_disk_rdsect (uptr, lba, copy_buf, &sects_read, sects);
-                if (r == SCPE_OK) {
-                    uint32 saved_unit_flags = uptr->flags;
-                    FILE *save_unit_fileref = uptr->fileref;
+        /*
+         * Determine the pack revision level and, therefore, the path to
+         * [0,1]satt.sys which will allow us to determine the size of the
+         * pack used by RSTS.
+         */
+        if ((root.rt_pack.pk_pstat & PK_UC_NEW) == 0) {
+            uint16 link = root.rt_mfd.ml_ulnk;
+            RSTS_UNAME uname;
 
-                    sim_disk_set_fmt (uptr, 0, dest_fmt, NULL);
-                    uptr->fileref = dest;
-                    uptr->capac = target_capac;
-                    r = sim_disk_rdsect (uptr, lba, verify_buf, &verify_read, sects_read);
-                    uptr->fileref = save_unit_fileref;
-                    uptr->flags = saved_unit_flags;
-                    if (r == SCPE_OK) {
-                        if ((sects_read != verify_read) ||
-                            (0 != memcmp (copy_buf, verify_buf, verify_read*sector_size)))
-                            r = SCPE_IOERR;
-                        }
+            /*
+             * Old format used by RSTS up through V07.x
+             */
+            if (dcs > 16)
+                return SCPE_IOERR;
+
+            *level = PK_LVL0;
+
+            memcpy(&context->map, &root.rt_block[MAP_OFFSET], BLOCKETTE_SZ);
+
+            /*
+             * Scan the MFD name entries looking for [0,1]. Note there will
+             * always be at least 1 entry.
+             */
+            do {
+                if (rstsReadBlockette(context, link, &uname) != SCPE_OK)
+                    break;
+
+                if (uname.un_unam == ((0 << 8) | 1)) {
+                    *ufd = uname.un_uar;
+                    return SCPE_OK;
                     }
-                if (r != SCPE_OK)
+                } while ((link = uname.un_ulnk) != 0);
+            }
+        else {
+            /*
+             * New format used by RSTS V08 and later
+             */
+            switch (root.rt_pack.pk_plvl) {
+                case PK_LVL11:
+                    if (dcs > 16)
+                        return SCPE_IOERR;
+                    break;
+
+                case PK_LVL12:
+                    if (dcs > 64)
+                        return SCPE_IOERR;
                     break;
+
+                default:
+                    return SCPE_IOERR;
                 }
-            if (!sim_quiet) {
-                if (r == SCPE_OK)
-                    sim_messagef (r, "\n%s: Verified %u sectors. Done.\n", sim_uname (uptr), (uint32)total_sectors);
-                else {
-                    t_lba i;
-                    uint32 save_dctrl = dptr->dctrl;
-                    FILE *save_sim_deb = sim_deb;
+            *level = root.rt_pack.pk_plvl;
 
-                    for (i = 0; i < sects_read; ++i)
-                        if (0 != memcmp (copy_buf+i*sector_size, verify_buf+i*sector_size, sector_size))
-                            break;
-                    sim_printf ("\n%s: Verification Error on lbn %d.\n", sim_uname (uptr), lba+i);
-                    dptr->dctrl = 0xFFFFFFFF;
-                    sim_deb = stdout;
-                    sim_disk_data_trace (uptr,   copy_buf+i*sector_size, lba+i, sector_size, "Expected", TRUE, 1);
-                    sim_disk_data_trace (uptr, verify_buf+i*sector_size, lba+i, sector_size,    "Found", TRUE, 1);
-                    dptr->dctrl = save_dctrl;
-                    sim_deb = save_sim_deb;
+            mfd = root.rt_pack.pk_mdcn;
+
+            if (rstsReadBlock(context, mfd, 0, buf) == SCPE_OK) {
+                if (IS_VALID_RSTS_MFD((RSTS_MFDBLOCKETTE *)buf)) {
+                    if (rstsReadBlock(context, mfd, 1, buf) == SCPE_OK)
+                        if ((gfd = buf[0]) != 0)
+                            if (rstsReadBlock(context, gfd, 0, buf) == SCPE_OK)
+                                if (IS_VALID_RSTS_GFD((RSTS_GFDBLOCKETTE *)buf, 0)) {
+                                    if (rstsReadBlock(context, gfd, 1, buf) == SCPE_OK)
+                                        if ((*ufd = buf[1]) != 0)
+                                            return SCPE_OK;
+                                    }
                     }
                 }
-            free (verify_buf);
-            }
-        free (copy_buf);
-        if (strcmp ("VHD", dest_fmt) == 0)
-            sim_vhd_disk_close (dest);
-        else
-            fclose (dest);
-        sim_disk_detach (uptr);
-        if (r == SCPE_OK) {
-            created = TRUE;
-            copied = TRUE;
-            strlcpy (tbuf, gbuf, sizeof(tbuf)-1);
-            cptr = tbuf;
-            sim_disk_set_fmt (uptr, 0, dest_fmt, NULL);
-            sim_switches = saved_sim_switches;
             }
-        else
-            return r;
-        /* fall through and open/return the newly created & copied disk container */
         }
     }
-else
-    if (sim_switches & SWMASK ('M')) {                 /* merge difference disk? */
-        char gbuf[CBUFSIZE], *Parent = NULL;
-        FILE *vhd;
+return SCPE_IOERR;
+}
 
-        sim_switches = sim_switches & ~(SWMASK ('M'));
-        get_glyph_nc (cptr, gbuf, 0);                  /* get spec */
-        vhd = sim_vhd_disk_merge (gbuf, &Parent);
-        if (vhd) {
-            t_stat r;
+static t_stat rstsLoadAndScanSATT(rstsContext *context, uint16 uaa, uint16 uar, t_offset *result)
+{
+uint8 bitmap[8192];
+int i, j;
+RSTS_ACNT acnt;
+RSTS_RETR retr;
 
-            sim_vhd_disk_close (vhd);
-            r = sim_disk_attach (uptr, Parent, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay);
-            free (Parent);
-            return r;
+if (uar != 0) {
+    if (rstsReadBlockette(context, uaa, &acnt) == SCPE_OK) {
+        uint16 blocks = acnt.ac_usiz;
+        uint16 offset = 0;
+
+        if ((rstsValidateClusterSize(acnt.ac_uclus, context->pcs) != SCPE_OK) ||
+            (blocks > 16))
+            return SCPE_IOERR;
+
+        memset(bitmap, 0xFF, sizeof(bitmap));
+
+        if (blocks != 0) {
+            do {
+                int i, j;
+                uint16 fcl;
+
+                if (rstsReadBlockette(context, uar, &retr) != SCPE_OK)
+                    return SCPE_IOERR;
+
+                for (i = 0; i < RT_ENTRIES; i++) {
+                    if ((fcl = retr.rt_uent[i]) == 0)
+                        goto scanBitmap;
+
+                    for (j = 0; j < acnt.ac_uclus; j++) {
+                        if ((blocks == 0) || (offset >= sizeof(bitmap)))
+                            goto scanBitmap;
+
+                        if (rstsReadBlock(context, fcl, j, &bitmap[offset]) != SCPE_OK)
+                            return SCPE_IOERR;
+
+                        offset += 512;
+                        blocks--;
+                        }
+                    }
+                } while ((uar = retr.rt_ulnk) != 0);
+
+        scanBitmap:
+            for (i = sizeof(bitmap) - 1; i != 0; i--)
+                if (bitmap[i] != 0xFF) {
+                    blocks = i * 8;
+                    for (j = 7; j >= 0; j--)
+                        if ((bitmap[i] & (1 << j)) == 0) {
+                            blocks += j + 1;
+                            goto scanDone;
+                            }
+                    }
+        scanDone:
+            *result = (t_offset)(blocks + 1) * context->pcs;
+            return SCPE_OK;
             }
-        return SCPE_ARG;
         }
+    }
+return SCPE_IOERR;
+}
 
-switch (DK_GET_FMT (uptr)) {                            /* case on format */
-    case DKUF_F_AUTO:                                   /* SIMH format */
-        auto_format = TRUE;
-        if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD */
-            sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
-            sim_vhd_disk_close (uptr->fileref);         /* close vhd file*/
-            uptr->fileref = NULL;
-            open_function = sim_vhd_disk_open;
-            break;
-            }
-        while (tmp_size < sector_size)
-            tmp_size <<= 1;
-        if (tmp_size ==  sector_size) {                     /* Power of 2 sector size can do RAW */
-            if (NULL != (uptr->fileref = sim_os_disk_open_raw (cptr, "rb"))) {
-                sim_disk_set_fmt (uptr, 0, "RAW", NULL);    /* set file format to RAW */
-                sim_os_disk_close_raw (uptr->fileref);      /* close raw file*/
-                open_function = sim_os_disk_open_raw;
-                storage_function = sim_os_disk_info_raw;
-                uptr->fileref = NULL;
-                break;
-                }
-            }
-        sim_disk_set_fmt (uptr, 0, "SIMH", NULL);       /* set file format to SIMH */
-        open_function = sim_fopen;
-        break;
-    case DKUF_F_STD:                                    /* SIMH format */
-        if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD first */
-            sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
-            sim_vhd_disk_close (uptr->fileref);         /* close vhd file*/
-            uptr->fileref = NULL;
-            open_function = sim_vhd_disk_open;
-            auto_format = TRUE;
-            break;
-            }
-        open_function = sim_fopen;
-        break;
-    case DKUF_F_VHD:                                    /* VHD format */
-        open_function = sim_vhd_disk_open;
-        create_function = sim_vhd_disk_create;
-        storage_function = sim_os_disk_info_raw;
-        break;
-    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
-        if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD first */
-            sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
-            sim_vhd_disk_close (uptr->fileref);         /* close vhd file*/
-            uptr->fileref = NULL;
-            open_function = sim_vhd_disk_open;
-            auto_format = TRUE;
-            break;
-            }
-        open_function = sim_os_disk_open_raw;
-        storage_function = sim_os_disk_info_raw;
-        break;
-    default:
-        return SCPE_IERR;
-    }
-uptr->filename = (char *) calloc (CBUFSIZE, sizeof (char));/* alloc name buf */
-uptr->disk_ctx = ctx = (struct disk_context *)calloc(1, sizeof(struct disk_context));
-if ((uptr->filename == NULL) || (uptr->disk_ctx == NULL))
-    return _err_return (uptr, SCPE_MEM);
-strlcpy (uptr->filename, cptr, CBUFSIZE);               /* save name */
-ctx->sector_size = (uint32)sector_size;                 /* save sector_size */
-ctx->capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* save capacity units (quadword: 8, word: 2, byte: 1) */
-ctx->xfer_element_size = (uint32)xfer_element_size;     /* save xfer_element_size */
-ctx->dptr = dptr;                                       /* save DEVICE pointer */
-ctx->dbit = dbit;                                       /* save debug bit */
-ctx->media_removed = 0;                                 /* default present */
-sim_debug_unit (ctx->dbit, uptr, "sim_disk_attach(unit=%d,filename='%s')\n", (int)(uptr - ctx->dptr->units), uptr->filename);
-ctx->auto_format = auto_format;                         /* save that we auto selected format */
-ctx->storage_sector_size = (uint32)sector_size;         /* Default */
-if ((sim_switches & SWMASK ('R')) ||                    /* read only? */
-    ((uptr->flags & UNIT_RO) != 0)) {
-    if (((uptr->flags & UNIT_ROABLE) == 0) &&           /* allowed? */
-        ((uptr->flags & UNIT_RO) == 0))
-        return sim_messagef (_err_return (uptr, SCPE_NORO), "%s: Read Only operation not allowed\n", /* no, error */
-                                                        sim_uname (uptr));
-    uptr->fileref = open_function (cptr, "rb");         /* open rd only */
-    if (uptr->fileref == NULL)                          /* open fail? */
-        return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Can't open '%s': %s\n", /* yes, error */
-                                            sim_uname (uptr), cptr, strerror (errno));
-    uptr->flags = uptr->flags | UNIT_RO;                /* set rd only */
-    sim_messagef (SCPE_OK, "%s: Unit is read only\n", sim_uname (uptr));
-    }
-else {                                                  /* normal */
-    uptr->fileref = open_function (cptr, "rb+");        /* open r/w */
-    if (uptr->fileref == NULL) {                        /* open fail? */
-        if ((errno == EROFS) || (errno == EACCES)) {    /* read only? */
-            if ((uptr->flags & UNIT_ROABLE) == 0)       /* allowed? */
-                return sim_messagef (_err_return (uptr, SCPE_NORO), "%s: Read Only operation not allowed\n", /* no, error */
-                                                                sim_uname (uptr));
-            uptr->fileref = open_function (cptr, "rb"); /* open rd only */
-            if (uptr->fileref == NULL)                  /* open fail? */
-                return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Can't open '%s': %s\n", /* yes, error */
-                                                    sim_uname (uptr), cptr, strerror (errno));
-            uptr->flags = uptr->flags | UNIT_RO;        /* set rd only */
-            sim_messagef (SCPE_OK, "%s: Unit is read only\n", sim_uname (uptr));
-            }
-        else {                                          /* other error? */
-            if ((sim_switches & SWMASK ('E')) ||        /* must exist? */
-                (errno != ENOENT))                      /* or must not re-create? */
-                return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Cannot open '%s' - %s\n",
-                                     sim_uname (uptr), cptr, strerror (errno));
-            if (create_function)
-                uptr->fileref = create_function (cptr, ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1));/* create new file */
-            else
-                uptr->fileref = open_function (cptr, "wb+");/* open new file */
-            if (uptr->fileref == NULL)                  /* open fail? */
-                return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Cannot create '%s' - %s\n",
-                                     sim_uname (uptr), cptr, strerror (errno));
-            sim_messagef (SCPE_OK, "%s: Creating new file: %s\n", sim_uname (uptr), cptr);
-            created = TRUE;
-            }
-        }                                               /* end if null */
-    }                                                   /* end else */
-(void)get_disk_footer (uptr);
-if ((DK_GET_FMT (uptr) == DKUF_F_VHD) || (ctx->footer)) {
-    uint32 container_sector_size = 0, container_xfer_element_size = 0, container_sectors = 0;
-    char created_name[64];
-    const char *container_dtype = ctx->footer ? (char *)ctx->footer->DriveType : sim_vhd_disk_get_dtype (uptr->fileref, &container_sector_size, &container_xfer_element_size, created_name, NULL);
+static t_offset get_rsts_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+{
+DEVICE *dptr;
+t_addr saved_capac;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
+uint8 buf[512];
+t_offset ret_val = (t_offset)-1;
+rstsContext context;
 
-    if (ctx->footer) {
-        container_sector_size = NtoHl (ctx->footer->SectorSize);
-        container_sectors = NtoHl (ctx->footer->SectorCount);
-        xfer_element_size = NtoHl (ctx->footer->TransferElementSize);
-        strlcpy (created_name, (char *)ctx->footer->CreatingSimulator, sizeof (created_name));
-        }
-    if ((DK_GET_FMT (uptr) == DKUF_F_VHD) && created && dtype) {
-        sim_vhd_disk_set_dtype (uptr->fileref, dtype, ctx->sector_size, ctx->xfer_element_size);
-        (void)get_disk_footer (uptr);
-        container_dtype = (char *)ctx->footer->DriveType;
-        }
-    if (dtype) {
-        char cmd[32];
-        t_stat r = SCPE_OK;
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
+    return ret_val;
 
-        if ((strcmp (container_dtype, dtype) == 0) ||
-            (((container_sector_size == 0) || (container_sector_size == ctx->sector_size)) &&
-             ((container_xfer_element_size == 0) || (container_xfer_element_size == ctx->xfer_element_size)))) {
-            if (strcmp (container_dtype, dtype) != 0) {
-                if ((drivetypes != NULL) || (!dontchangecapac)) { /* Autosize allowed */
-                    snprintf (cmd, sizeof (cmd), "%s %s", sim_uname (uptr), container_dtype);
-                    r = set_cmd (0, cmd);
-                    if (r != SCPE_OK)
-                        r = sim_messagef (SCPE_INCOMPDSK, "%s: Cannot set to drive type %s\n", sim_uname (uptr), container_dtype);
-                    }
-                current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
-                if (ctx->container_size > current_unit_size) {
-                    if ((uptr->flags & UNIT_RO) != 0)                   /* Not Opening read only? */
-                        r = sim_messagef (SCPE_OK, "%s: Read Only access to inconsistent drive type allowed\n", sim_uname (uptr));
-                    else
-                        r = sim_messagef (SCPE_INCOMPDSK, "%s: '%s' can only be attached Read Only\n", sim_uname (uptr), cptr);
-                    }
-                }
-            else { /* Type already matches, Need to confirm compatibility */
-                t_addr saved_capac = uptr->capac;
-                t_lba current_unit_sectors = (t_lba)((dptr->flags & DEV_SECTORS) ? uptr->capac : (uptr->capac*ctx->capac_factor)/ctx->sector_size);
+saved_capac = uptr->capac;
+uptr->capac = temp_capac;
 
-                if ((container_sector_size != 0) && (sector_size != container_sector_size))
-                    r = sim_messagef (SCPE_OPENERR, "%s: Incompatible Container Sector Size %d\n", sim_uname (uptr), container_sector_size);
-                else {
-                    if (dontchangecapac &&
-                        ((((t_lba)(ctx->container_size/sector_size) > current_unit_sectors)) ||
-                         ((container_sectors != 0) && (container_sectors != current_unit_sectors)))) {
-                         r = sim_messagef (SCPE_OK, "%s: Container has %u sectors, drive has: %u sectors\n", sim_uname (uptr), container_sectors, current_unit_sectors);
-                         if (container_sectors != 0)
-                             r = sim_messagef (SCPE_INCOMPDSK, "%s: %s container created by the %s simulator is incompatible with the %s device on the %s simulator\n", sim_uname (uptr), container_dtype, created_name, uptr->dptr->name, sim_name);
-                         else
-                             r = sim_messagef (SCPE_INCOMPDSK, "%s: disk container %s is incompatible with the %s device\n", sim_uname (uptr), uptr->filename, uptr->dptr->name);
-                         if ((uptr->flags & UNIT_RO) != 0)
-                             r = sim_messagef (SCPE_OK, "%s: Read Only access to incompatible %s container '%s' allowed\n", sim_uname (uptr), container_dtype, uptr->filename);
-                         if (container_sectors < current_unit_sectors) {
-                             r = sim_messagef (SCPE_BARE_STATUS (r), "%s: Since the container is smaller than the drive, this might be useful:\n", sim_uname (uptr));
-                             r = sim_messagef (SCPE_BARE_STATUS (r), "%s:   sim> ATTACH %s -C New-%s %s\n", sim_uname (uptr), sim_uname (uptr), uptr->filename, uptr->filename);
-                             }
-                        }
-                    }
-                if (r == SCPE_OK) {
-                    int32 saved_show_message = sim_show_message;
+context.uptr = uptr;
+context.sects = 512 / ctx->sector_size;
 
-                    snprintf (cmd, sizeof (cmd), "%s %s", sim_uname (uptr), container_dtype);
-                    set_cmd (0, "NOMESSAGE");
-                    set_cmd (0, cmd);
-                    sim_show_message = saved_show_message;
-                    }
-                }
-            if (r == SCPE_OK)
-                autosized = TRUE;
-            }
-        else
-            r = sim_messagef (SCPE_INCOMPDSK, "%s: %s container created by the %s simulator is incompatible with the %s device on the %s simulator\n", sim_uname (uptr), container_dtype, created_name, uptr->dptr->name, sim_name);
-        if (r != SCPE_OK) {
-            uptr->flags |= UNIT_ATT;
-            sim_disk_detach (uptr);                         /* report error now */
-            sprintf (cmd, "%s%d %s", dptr->name, (int)(uptr-dptr->units), dtype);/* restore original dtype */
-            set_cmd (0, cmd);
-            return r;
-            }
-        }
-    }
-uptr->flags |= UNIT_ATT;
-uptr->pos = 0;
+/*
+ * Check all possible device cluster sizes
+ */
+for (context.dcshift = 0; context.dcshift < 8; context.dcshift++) {
+    uint16 ufd, level;
 
-/* Get Device attributes if they are available */
-if (storage_function)
-    storage_function (uptr->fileref, &ctx->storage_sector_size, &ctx->removable, &ctx->is_cdrom);
+    /*
+     * We need to find [0,1]SATT.SYS to compute the actual size of the disk.
+     * First find the DCN of the [0,1] UFD.
+     */
+    if (rstsFind01UFD(&context, &ufd, &level) == SCPE_OK) {
+        if (rstsReadBlock(&context, ufd, 0, buf) == SCPE_OK) {
+            if (IS_VALID_RSTS_UFD((RSTS_UFDBLOCKETTE *)buf, 0, 1)) {
+                uint16 link = ((RSTS_UFDBLOCKETTE *)buf)->ub_ulnk;
+                RSTS_FNAME fname;
 
-if ((created) && (!copied)) {
-    t_stat r = SCPE_OK;
-    uint8 *secbuf = (uint8 *)calloc (128, ctx->sector_size);     /* alloc temp sector buf */
+                memcpy(&context.map, &buf[MAP_OFFSET], BLOCKETTE_SZ);
 
-    /*
-       On a newly created disk, we write zeros to the whole disk.
-       This serves 3 purposes:
-         1) it avoids strange allocation delays writing newly allocated
-            storage at the end of the disk during simulator operation
-         2) it allocates storage for the whole disk at creation time to
-            avoid strange failures which may happen during simulator execution
-            if the containing disk is full
-         3) it leaves a Simh Format disk at the intended size so it may
-            subsequently be autosized with the correct size.
-    */
-    if (secbuf == NULL)
-        r = SCPE_MEM;
-    if (r == SCPE_OK) { /* Write all blocks */
-        t_lba lba;
-        t_lba total_lbas = (t_lba)((((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1))/ctx->sector_size);
+                /*
+                 * Scan the UFD looking for SATT.SYS - the allocation bitmap
+                 */
+                do {
+                    if (rstsReadBlockette(&context, link, &fname) != SCPE_OK)
+                        break;
 
-        for (lba = 0; (r == SCPE_OK) && (lba < total_lbas); lba += 128) {
-            t_seccnt sectors = ((lba + 128) <= total_lbas) ? 128 : total_lbas - lba;
+                    if ((fname.fn_unam[0] == SATT0) &&
+                        (fname.fn_unam[1] == SATT1) &&
+                        (fname.fn_unam[2] == SATT2)) {
+                        if (rstsLoadAndScanSATT(&context, fname.fn_uaa, fname.fn_uar, &ret_val) == SCPE_OK) {
+                            const char *fmt = "???";
 
-            r = sim_disk_wrsect (uptr, lba, secbuf, NULL, sectors);
-            }
-        }
-    free (secbuf);
-    if (r != SCPE_OK) {
-        sim_disk_detach (uptr);                         /* report error now */
-        (void)remove (cptr);                            /* remove the created file */
-        return SCPE_OPENERR;
-        }
-    if (sim_switches & SWMASK ('I')) {                  /* Initialize To Sector Address */
-        size_t init_buf_size = 1024*1024;
-        uint8 *init_buf = (uint8*) malloc (init_buf_size);
-        t_lba lba, sect;
-        uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
-        t_seccnt sectors_per_buffer = (t_seccnt)((init_buf_size)/sector_size);
-        t_lba total_sectors = (t_lba)((uptr->capac*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1)));
-        t_seccnt sects = sectors_per_buffer;
+                            ret_val *= 512;
 
-        if (!init_buf) {
-            sim_disk_detach (uptr);                         /* report error now */
-            (void)remove (cptr);
-            return SCPE_MEM;
-            }
-        sim_messagef (SCPE_OK, "Initializing %u sectors each %u bytes in size with the sector address\n", (uint32)total_sectors, (uint32)sector_size);
-        for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects) {
-            t_seccnt sects_written;
+                            switch (level) {
+                                case PK_LVL0:
+                                    fmt = "0.0";
+                                    break;
 
-            sects = sectors_per_buffer;
-            if (lba + sects > total_sectors)
-                sects = total_sectors - lba;
-            for (sect = 0; sect < sects; sect++) {
-                t_lba offset;
-                for (offset = 0; offset < sector_size; offset += sizeof(uint32))
-                    *((uint32 *)&init_buf[sect*sector_size + offset]) = (uint32)(lba + sect);
-                }
-            r = sim_disk_wrsect (uptr, lba, init_buf, &sects_written, sects);
-            if ((r != SCPE_OK) || (sects != sects_written)) {
-                free (init_buf);
-                sim_disk_detach (uptr);                         /* report error now */
-                (void)remove (cptr);                            /* remove the created file */
-                return sim_messagef (SCPE_OPENERR, "Error initializing each sector with its address: %s\n",
-                                                   (r == SCPE_OK) ? sim_error_text (r) : "sectors written not what was requested");
+                                case PK_LVL11:
+                                    fmt = "1.1";
+                                    break;
+
+                                case PK_LVL12:
+                                    fmt = "1.2";
+                                    break;
+                                }
+
+                            sim_messagef(SCPE_OK, "%s: '%s' Contains a RSTS File system\n", sim_uname (uptr), uptr->filename);
+                            sim_messagef(SCPE_OK, "%s: Pack ID: %6.6s Revision Level: %3s Pack Clustersize: %d\n",
+                                                                  sim_uname (uptr), context.packid, fmt, context.pcs);
+                            sim_messagef(SCPE_OK, "%s: Last Unallocated Sector In File System: %u\n", sim_uname (uptr), (uint32)((ret_val / 512) - 1));
+                            goto cleanup_done;
+                            }
+                        }
+                    } while ((link = fname.fn_ulnk) != 0);
                 }
-            sim_messagef (SCPE_OK, "%s: Initialized To Sector Address %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)(lba + sects_written), (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
             }
-        sim_messagef (SCPE_OK, "%s: Initialized To Sector Address %u sectors.  100%% complete.       \n", sim_uname (uptr), (uint32)total_sectors);
-        free (init_buf);
         }
-    if (pdp11tracksize)
-        sim_disk_pdp11_bad_block (uptr, pdp11tracksize, sector_size/sizeof(uint16));
     }
-if (sim_switches & SWMASK ('K')) {
-    t_stat r = SCPE_OK;
-    t_lba lba, sect;
-    uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (word: 2, byte: 1) */
-    t_seccnt sectors_per_buffer = (t_seccnt)((1024*1024)/sector_size);
-    t_lba total_sectors = (t_lba)((uptr->capac*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
-    t_seccnt sects = sectors_per_buffer;
-    t_seccnt sects_verify;
-    uint8 *verify_buf = (uint8*) malloc (1024*1024);
+cleanup_done:
+uptr->capac = saved_capac;
+if (readonly)
+    *readonly = sim_disk_wrp (uptr);
+return ret_val;
+}
 
-    if (!verify_buf) {
-        sim_disk_detach (uptr);                         /* report error now */
-        return SCPE_MEM;
-        }
-    for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects_verify) {
-        sects = sectors_per_buffer;
-        if (lba + sects > total_sectors)
-            sects = total_sectors - lba;
-        r = sim_disk_rdsect (uptr, lba, verify_buf, &sects_verify, sects);
-        if (r == SCPE_OK) {
-            if (sects != sects_verify)
-                sim_printf ("\n%s: Verification Error when reading lbn %d(0x%X) of %d(0x%X) Requested %u sectors, read %u sectors.\n",
-                            sim_uname (uptr), (int)lba, (int)lba, (int)total_sectors, (int)total_sectors, sects, sects_verify);
-            for (sect = 0; sect < sects_verify; sect++) {
-                t_lba offset;
-                t_bool sect_error = FALSE;
+#pragma pack(push,1)
+typedef struct _RT11_HomeBlock {
+    uint8   hb_b_bbtable[130];
+    uint8   hb_b_unused1[2];
+    uint8   hb_b_initrestore[38];
+    uint8   hb_b_bup[18];
+    uint8   hb_b_unused2[260];
+    uint16  hb_w_reserved1;
+    uint16  hb_w_reserved2;
+    uint8   hb_b_unused3[14];
+    uint16  hb_w_clustersize;
+    uint16  hb_w_firstdir;
+    uint16  hb_w_sysver;
+#define HB_C_SYSVER_V3A 36521
+#define HB_C_SYSVER_V04 36434
+#define HB_C_SYSVER_V05 36435
+    uint8   hb_b_volid[12];
+    uint8   hb_b_owner[12];
+    uint8   hb_b_sysid[12];
+#define HB_C_SYSID      "DECRT11A    "
+#define HB_C_VMSSYSID   "DECVMSEXCHNG"
+    uint8   hb_b_unused4[2];
+    uint16  hb_w_checksum;
+    } RT11_HomeBlock;
 
-                for (offset = 0; offset < sector_size; offset += sizeof(uint32)) {
-                    if (*((uint32 *)&verify_buf[sect*sector_size + offset]) != (uint32)(lba + sect)) {
-                        sect_error = TRUE;
-                        break;
-                        }
-                    }
-                if (sect_error) {
-                    uint32 save_dctrl = dptr->dctrl;
-                    FILE *save_sim_deb = sim_deb;
+typedef struct _RT11_DirHeader {
+    uint16  dh_w_count;
+    uint16  dh_w_next;
+    uint16  dh_w_highest;
+#define DH_C_MAXSEG     31
+    uint16  dh_w_extra;
+    uint16  dh_w_start;
+    } RT11_DirHeader;
 
-                    sim_printf ("\n%s: Verification Error on lbn %d(0x%X) of %d(0x%X).\n", sim_uname (uptr), (int)(lba+sect), (int)(lba+sect), (int)total_sectors, (int)total_sectors);
-                    dptr->dctrl = 0xFFFFFFFF;
-                    sim_deb = stdout;
-                    sim_disk_data_trace (uptr, verify_buf+sect*sector_size, lba+sect, sector_size,    "Found", TRUE, 1);
-                    dptr->dctrl = save_dctrl;
-                    sim_deb = save_sim_deb;
-                    }
-                }
-            }
-        sim_messagef (SCPE_OK, "%s: Verified containing Sector Address %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)lba, (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
+typedef struct _RT11_DirEntry {
+    uint16  de_w_status;
+#define DE_C_PRE        0000020
+#define DE_C_TENT       0000400
+#define DE_C_EMPTY      0001000
+#define DE_C_PERM       0002000
+#define DE_C_EOS        0004000
+#define DE_C_READ       0040000
+#define DE_C_PROT       0100000
+    uint16  de_w_fname1;
+    uint16  de_w_fname2;
+    uint16  de_w_ftype;
+    uint16  de_w_length;
+    uint16  de_w_jobchannel;
+    uint16  de_w_creationdate;
+    } RT11_DirEntry;
+#pragma pack(pop)
+
+#define RT11_MAXPARTITIONS      256             /* Max partitions supported */
+#define RT11_HOME                 1             /* Home block # */
+
+#define RT11_NOPART             0
+#define RT11_SINGLEPART         1
+#define RT11_MULTIPART          2
+
+static int rt11_get_partition_type(RT11_HomeBlock *home, int part)
+{
+if (strncmp((char *)&home->hb_b_sysid, HB_C_SYSID, strlen(HB_C_SYSID)) == 0) {
+    uint16 type = home->hb_w_sysver;
+
+    if (part == 0) {
+        if ((type == HB_C_SYSVER_V3A) || (type == HB_C_SYSVER_V04))
+            return RT11_SINGLEPART;
         }
-    sim_messagef (SCPE_OK, "%s: Verified containing Sector Address %u sectors.  100%% complete.         \n", sim_uname (uptr), (uint32)lba);
-    free (verify_buf);
-    uptr->dynflags |= UNIT_DISK_CHK;
-    }
 
-if (get_disk_footer (uptr) != SCPE_OK) {
-    sim_disk_detach (uptr);
-    return SCPE_OPENERR;
+    if (type == HB_C_SYSVER_V05)
+        return RT11_MULTIPART;
     }
-filesystem_size = get_filesystem_size (uptr, NULL);
-if (filesystem_size != (t_offset)-1)
-    filesystem_size += reserved_sectors * sector_size;
-container_size = sim_disk_size (uptr);
-if ((filesystem_size == (t_offset)-1) &&
-    (ctx->footer != NULL))                      /* The presence of metadata means we already */
-    filesystem_size = ctx->container_size;      /* know the interesting disk size */
-current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
-if (container_size && (container_size != (t_offset)-1)) {
-    if (dontchangecapac) {  /* autosize by changing drive type */
-        t_addr saved_capac = uptr->capac;
 
-        if (drivetypes != NULL) {
-            if (filesystem_size != (t_offset)-1) {  /* File System found? */
-                /* Walk through all potential drive types until we find one the right size */
-                while (*drivetypes != NULL) {
-                    char cmd[CBUFSIZE];
-                    t_stat st;
+if (strncmp((char *)&home->hb_b_sysid, HB_C_VMSSYSID, strlen(HB_C_VMSSYSID)) == 0)
+    return RT11_SINGLEPART;
 
-                    uptr->flags &= ~UNIT_ATT;   /* temporarily mark as un-attached */
-                    sprintf (cmd, "%s %s", sim_uname (uptr), *drivetypes);
-                    st = set_cmd (0, cmd);
-                    uptr->flags |= UNIT_ATT;    /* restore attached indicator */
-                    if (st == SCPE_OK)
-                        current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
-                    if (current_unit_size >= filesystem_size)
-                        break;
-                    ++drivetypes;
-                    }
-            if (filesystem_size > current_unit_size) {
-                t_stat r = SCPE_FSSIZE;
-                char *capac1;
+return RT11_NOPART;
+}
 
-                uptr->capac = (t_addr)(filesystem_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
-                capac1 = strdup (sprint_capac (dptr, uptr));
-                uptr->capac = saved_capac;
-                r = sim_messagef (r, "%s: The file system on the disk %s is larger than simulated device (%s > %s)\n",
-                                    sim_uname (uptr), cptr, capac1, sprint_capac (dptr, uptr));
-                free (capac1);
-                sim_disk_detach (uptr);
-                return r;
-                }
-            else
-                autosized = TRUE;
-            }
-            else {
-                if (!created && (ctx->footer == NULL)) {
-                    sim_messagef (SCPE_OK, "%s: Amount of data in use in disk container '%s' cannot be determined, skipping autosizing\n", sim_uname (uptr), cptr);
-                    if (container_size > current_unit_size) {
-                        t_stat r = SCPE_FSSIZE;
-                        char *capac1;
+static t_offset get_rt11_filesystem_size (UNIT *uptr, uint32 physsectsz, t_bool *readonly)
+{
+DEVICE *dptr;
+t_addr saved_capac;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_addr temp_capac = (sim_toffset_64 ? (t_addr)0xFFFFFFFFu : (t_addr)0x7FFFFFFFu);  /* Make sure we can access the largest sector */
+uint8 sector_buf[1024];
+RT11_HomeBlock Home;
+t_seccnt sects_read;
+RT11_DirHeader *dir_hdr = (RT11_DirHeader *)sector_buf;
+int partitions = 0;
+int part;
+uint32 base;
+uint32 dir_sec;
+uint16 dir_seg;
+uint16 version = 0;
+t_offset ret_val = (t_offset)-1;
 
-                        uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
-                        capac1 = strdup (sprint_capac (dptr, uptr));
-                        uptr->capac = saved_capac;
-                        r = sim_messagef (r, "%s: The disk container '%s' is larger than simulated device (%s > %s)\n",
-                                            sim_uname (uptr), cptr, capac1, sprint_capac (dptr, uptr));
-                        free (capac1);
-                        sim_disk_detach (uptr);
-                        return r;
-                        }
-                    }
-                }
-            }
-        if (filesystem_size != (t_offset)-1) {
-            if (filesystem_size > current_unit_size) {
-                t_stat r = SCPE_FSSIZE;
-                char *capac1;
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
+     return ret_val;
+saved_capac = uptr->capac;
+uptr->capac = temp_capac;
 
-                uptr->capac = (t_addr)(filesystem_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
-                capac1 = strdup (sprint_capac (dptr, uptr));
-                uptr->capac = saved_capac;
-                r = sim_messagef (r, "%s: The file system on the %s disk container is larger than simulated device (%s > %s)\n",
-                                    sim_uname (uptr), cptr, capac1, sprint_capac (dptr, uptr));
-                free (capac1);
-                sim_disk_detach (uptr);
-                return r;
-                }
-            if (filesystem_size == current_unit_size)
-                autosized = TRUE;
-            }
-        if ((container_size != current_unit_size)) {
-            if (container_size < current_unit_size) {
-                if (DKUF_F_VHD == DK_GET_FMT (uptr)){
-                    t_stat r = SCPE_INCOMPDSK;
-                    const char *container_dtype = ctx->footer ? (const char *)ctx->footer->DriveType : "";
-                    char *capac1;
+for (part = 0; part < RT11_MAXPARTITIONS; part++) {
+    uint16 seg_highest = 0;
+    int type;
 
-                    uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
-                    capac1 = strdup (sprint_capac (dptr, uptr));
-                    uptr->capac = saved_capac;
-                    r = sim_messagef (r, "%s: non expandable %s%sdisk container '%s' is smaller than simulated device (%s < %s)\n",
-                                        sim_uname (uptr), container_dtype, (*container_dtype != '\0') ? " " : "", cptr, capac1, sprint_capac (dptr, uptr));
-                    free (capac1);
-                    sim_disk_detach (uptr);
-                    return r;
-                    }
-                }
-            else { /* (container_size > current_unit_size) */
-                if (0 == (uptr->flags & UNIT_RO)) {
-                    t_stat r = SCPE_OK;
-                    int32 saved_switches = sim_switches;
-                    const char *container_dtype;
-                    char *capac1;
+    /*
+     * RX01/RX02 media can only have a single partition
+     */
+    if ((part != 0) && (physsectsz != 0))
+      break;
 
-                    uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
-                    capac1 = strdup (sprint_capac (dptr, uptr));
-                    uptr->capac = saved_capac;
-                    sim_disk_detach (uptr);
-                    sim_switches = SWMASK ('R');
-                    r = sim_disk_attach_ex (uptr, cptr, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay, NULL);
-                    container_dtype = ctx->footer ? (const char *)ctx->footer->DriveType : "";
-                    sim_switches = saved_switches;
-                    if (r == SCPE_OK)
-                        r = sim_messagef (SCPE_OK, "%s: %s%sdisk container '%s' is larger than simulated device (%s > %s) Read Only Forced\n",
-                                sim_uname (uptr), container_dtype, (*container_dtype != '\0') ? " " : "", cptr,
-                                capac1, sprint_capac (dptr, uptr));
-                    free (capac1);
-                    return r;
-                    }
-                }
-            }
-        }
-    else {          /* Autosize by changing capacity */
-        if (filesystem_size != (t_offset)-1) {              /* Known file system data size AND */
-            if (filesystem_size >= container_size) {        /*    Data size >= container size? */
-                container_size = filesystem_size +          /*       Use file system data size */
-                             (pdp11tracksize * sector_size);/*       plus any bad block data beyond the file system */
-                autosized = TRUE;
-                }
-            }
-        else {                                              /* Unrecognized file system */
-            if (container_size < current_unit_size)         /*     Use MAX of container or current device size */
-                if ((DKUF_F_VHD != DK_GET_FMT (uptr)) &&    /*     when size can be expanded */
-                    (0 == (uptr->flags & UNIT_RO))) {
-                    container_size = current_unit_size;     /*     Use MAX of container or current device size */
-                    autosized = TRUE;
-                    }
-            }
-        uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1)));  /* update current size */
-        }
-    }
+    base = part << 16;
 
-if ((uptr->flags & UNIT_RO) == 0) {
-    t_bool readonly;
-    int32 saved_quiet = sim_quiet;
+    if (_DEC_rdsect(uptr, (base + RT11_HOME) * (512 / ctx->sector_size), (uint8 *)&Home, &sects_read, 512 / ctx->sector_size, physsectsz) ||
+        (sects_read != (512 / ctx->sector_size)))
+        goto Return_Cleanup;
 
-    sim_quiet = 1;
-    get_filesystem_size (uptr, &readonly);
-    if (readonly) {
-        sim_disk_detach (uptr);
-        sim_switches |= SWMASK ('R');
-        sim_disk_attach_ex2 (uptr, cptr, sector_size, xfer_element_size, dontchangecapac,
-                            dbit, dtype, pdp11tracksize, completion_delay, drivetypes,
-                            reserved_sectors);
+    type = rt11_get_partition_type(&Home, part);
 
-        }
-    sim_quiet = saved_quiet;
-    }
-if (dtype && (created || (autosized && (ctx->footer == NULL))))
-    store_disk_footer (uptr, dtype);
+    if (type != RT11_NOPART) {
+        uint16 highest = 0;
+        uint8 seg_seen[DH_C_MAXSEG + 1];
 
-#if defined (SIM_ASYNCH_IO)
-sim_disk_set_async (uptr, completion_delay);
-#endif
-uptr->io_flush = _sim_disk_io_flush;
+        memset(seg_seen, 0, sizeof(seg_seen));
 
-if (uptr->flags & UNIT_BUFABLE) {                       /* buffer in memory? */
-    t_seccnt sectsread;
-    t_stat r = SCPE_OK;
+        partitions++;
 
-    if (uptr->flags & UNIT_MUSTBUF) {                   /* dyn alloc? */
-        uptr->filebuf = calloc ((size_t)(ctx->container_size / ctx->xfer_element_size),
-                                    ctx->xfer_element_size);       /* allocate */
-        uptr->filebuf2 = calloc ((size_t)(ctx->container_size / ctx->xfer_element_size),
-                                    ctx->xfer_element_size);       /* allocate copy */
-        if ((uptr->filebuf == NULL) ||                  /* either failed? */
-            (uptr->filebuf2 == NULL)) {
-            sim_disk_detach (uptr);
-            return SCPE_MEM;                            /* memory allocation error */
-            }
-        }
-    sim_messagef (SCPE_OK, "%s: buffering file in memory\n", sim_uname (uptr));
-    r = sim_disk_rdsect (uptr, 0, (uint8 *)uptr->filebuf, &sectsread, (t_seccnt)(ctx->container_size / ctx->sector_size));
-    if (r != SCPE_OK)
-        return sim_disk_detach (uptr);
-    uptr->hwmark = (sectsread * ctx->sector_size) / ctx->xfer_element_size;
-    memcpy (uptr->filebuf2, uptr->filebuf, (size_t)ctx->container_size);/* save initial contents */
-    uptr->flags |= UNIT_BUF;                            /* mark as buffered */
-    }
+        dir_seg = 1;
+        do {
+            int offset = sizeof(RT11_DirHeader);
+            int dir_size = sizeof(RT11_DirEntry);
+            uint16 cur_blk;
 
-return SCPE_OK;
-}
+            if (seg_seen[dir_seg]++ != 0)
+                goto Next_Partition;
 
-t_stat sim_disk_detach (UNIT *uptr)
-{
-struct disk_context *ctx;
-int (*close_function)(FILE *f);
-FILE *fileref;
-t_bool auto_format;
+            dir_sec = Home.hb_w_firstdir + ((dir_seg - 1) * 2);
 
-if (uptr == NULL)
-    return SCPE_IERR;
-if (!(uptr->flags & UNIT_ATT))
-    return SCPE_UNATT;
+            if ((_DEC_rdsect(uptr, (base + dir_sec) * (512 / ctx->sector_size), sector_buf, &sects_read, 1024 / ctx->sector_size, physsectsz)) ||
+                (sects_read != (1024 / ctx->sector_size)))
+                goto Return_Cleanup;
 
-ctx = (struct disk_context *)uptr->disk_ctx;
-fileref = uptr->fileref;
+            if (dir_seg == 1) {
+                seg_highest = dir_hdr->dh_w_highest;
+                if (seg_highest > DH_C_MAXSEG)
+                    goto Next_Partition;
+                }
+            dir_size += dir_hdr->dh_w_extra;
+            cur_blk = dir_hdr->dh_w_start;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_disk_detach(unit=%d,filename='%s')\n", (int)(uptr - ctx->dptr->units), uptr->filename);
+            while ((1024 - offset) >= dir_size) {
+                RT11_DirEntry *dir_entry = (RT11_DirEntry *)&sector_buf[offset];
 
-switch (DK_GET_FMT (uptr)) {                            /* case on format */
-    case DKUF_F_STD:                                    /* Simh */
-        close_function = fclose;
-        break;
-    case DKUF_F_VHD:                                    /* Virtual Disk */
-        close_function = sim_vhd_disk_close;
-        break;
-    case DKUF_F_RAW:                                    /* Physical */
-        close_function = sim_os_disk_close_raw;
-        break;
-    default:
-        return SCPE_IERR;
-        }
-if (!(uptr->flags & UNIT_ATTABLE))                      /* attachable? */
-    return SCPE_NOATT;
-if (!(uptr->flags & UNIT_ATT))                          /* attached? */
-    return SCPE_OK;
-if (NULL == find_dev_from_unit (uptr))
-    return SCPE_OK;
+                if (dir_entry->de_w_status & DE_C_EOS)
+                    break;
 
-if ((uptr->flags & UNIT_BUF) && (uptr->filebuf)) {
-    uint32 cap = (uptr->hwmark + uptr->dptr->aincr - 1) / uptr->dptr->aincr;
+                /*
+                 * Within each directory segment the bas address should never
+                 * decrease.
+                 */
+                if (((cur_blk + dir_entry->de_w_length) & 0xFFFF) < cur_blk)
+                    goto Next_Partition;
 
-    if (((uptr->flags & UNIT_RO) == 0) &&
-        (memcmp (uptr->filebuf, uptr->filebuf2, (size_t)ctx->container_size) != 0)) {
-        sim_messagef (SCPE_OK, "%s: writing buffer to file: %s\n", sim_uname (uptr), uptr->filename);
-        sim_disk_wrsect (uptr, 0, (uint8 *)uptr->filebuf, NULL, (cap + ctx->sector_size - 1) / ctx->sector_size);
-        }
-    if (uptr->flags & UNIT_MUSTBUF) {                   /* dyn alloc? */
-        free (uptr->filebuf);                           /* free buffers */
-        uptr->filebuf = NULL;
-        free (uptr->filebuf2);
-        uptr->filebuf2 = NULL;
+                cur_blk += dir_entry->de_w_length;
+                offset += dir_size;
+                }
+            if (cur_blk > highest)
+                highest = cur_blk;
+            dir_seg = dir_hdr->dh_w_next;
+
+            if (dir_seg > seg_highest)
+                goto Next_Partition;
+            } while (dir_seg != 0);
+
+        ret_val = (t_offset)((base + highest) * (t_offset)512);
+        version = Home.hb_w_sysver;
+
+        if (type == RT11_SINGLEPART)
+          break;
         }
-    uptr->flags = uptr->flags & ~UNIT_BUF;
+Next_Partition:
+    ;
     }
 
-update_disk_footer (uptr);                              /* Update meta data if highwater has changed */
+Return_Cleanup:
+if (partitions) {
+    const char *parttype;
 
-auto_format = ctx->auto_format;
+    switch (version) {
+        case HB_C_SYSVER_V3A:
+            parttype = "V3A";
+            break;
 
-if (uptr->io_flush)
-    uptr->io_flush (uptr);                              /* flush buffered data */
+        case HB_C_SYSVER_V04:
+            parttype = "V04";
+            break;
 
-sim_disk_clr_async (uptr);
+        case HB_C_SYSVER_V05:
+            parttype = "V05";
+            break;
 
-uptr->flags &= ~(UNIT_ATT | UNIT_RO);
-uptr->dynflags &= ~(UNIT_NO_FIO | UNIT_DISK_CHK);
-free (uptr->filename);
-uptr->filename = NULL;
-uptr->fileref = NULL;
-free (ctx->footer);
-free (uptr->disk_ctx);
-uptr->disk_ctx = NULL;
-uptr->io_flush = NULL;
-if (auto_format)
-    sim_disk_set_fmt (uptr, 0, "AUTO", NULL);           /* restore file format */
-
-if (close_function (fileref) == EOF)
-    return SCPE_IOERR;
-return SCPE_OK;
+        default:
+            parttype = "???";
+            break;
+        }
+    sim_messagef (SCPE_OK, "%s: '%s' Contains RT11 partitions\n", sim_uname (uptr), uptr->filename);
+    sim_messagef (SCPE_OK, "%d valid partition%s, Type: %s, Sectors On Disk: %u\n", partitions, partitions == 1 ? "" : "s", parttype, (uint32)(ret_val / 512));
+    }
+uptr->capac = saved_capac;
+if (readonly)
+    *readonly = sim_disk_wrp (uptr);
+return ret_val;
 }
 
-t_stat sim_disk_attach_help(FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, const char *cptr)
+t_offset pseudo_filesystem_size = 0;        /* Dummy file system check return used during testing */
+
+typedef t_offset (*FILESYSTEM_CHECK)(UNIT *uptr, uint32, t_bool *);
+
+static t_offset get_filesystem_size (UNIT *uptr, t_bool *readonly)
 {
-static struct example_fields {
-    const char *dname;
-    const char *dtype;
-    const char *dsize;
-    const char *dtype2;
-    const char *dsize2;
-    const char *dtype3;
-    const char *dsize3;
-    const char *dtype4;
-    const char *dsize4;
-    } ex_data[] = {
-        {"RQ", "RD54", "159MB", "RX50", "409KB", "RA81", "456MB", "RA92", "1505MB"},
-        {"RP", "RM03",  "33MW", "RM03",  "33MW", "RP07", "258MW", "RM03",  "15MW"},
-        {"RP", "RM03",  "39MW", "RM03",  "39MW", "RP07", "110MW", "RM03",  "15MW"},
+static FILESYSTEM_CHECK checks[] = {
+    &get_ods2_filesystem_size,
+    &get_ods1_filesystem_size,
+    &get_ultrix_filesystem_size,
+    &get_iso9660_filesystem_size,
+    &get_rsts_filesystem_size,
+    &get_rt11_filesystem_size,          /* This should be the last entry
+                                           in the table to reduce the
+                                           possibility of matching an RT-11
+                                           container file stored in another
+                                           filesystem */
+    NULL
     };
-struct example_fields *ex = &ex_data[0];
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint32 saved_sector_size = ctx->sector_size;
+t_offset ret_val = (t_offset)-1;
+int i;
 
-if (strcmp (dptr->name, "RP") == 0)
-    ex = &ex_data[1];
-if (strstr (sim_name, "-10")) {
-    ex = &ex_data[2];
-    if (strstr (sim_name, "PDP") == NULL)
-        ex->dname = "RPA";
+if (pseudo_filesystem_size != 0) {      /* Dummy file system size mechanism? */
+    sim_messagef (SCPE_OK, "%s: '%s' Pseudo File System containing %u %d byte sectors\n", sim_uname (uptr), uptr->filename, (uint32)(pseudo_filesystem_size / ctx->sector_size), ctx->sector_size);
+    return pseudo_filesystem_size;
     }
 
-fprintf (st, "%s Disk Attach Help\n\n", dptr->name);
+for (i = 0; checks[i] != NULL; i++)
+    if ((ret_val = checks[i] (uptr, 0, readonly)) != (t_offset)-1) {
+        /* ISO files that haven't already been determined to be ISO 9660
+         * which contain a known file system are also marked read-only
+         * now.  This fits early DEC distribution CDs that were created
+         * before ISO 9660 was standardized and operating support was added.
+         */
+        if ((readonly != NULL)          &&
+            (*readonly == FALSE)        &&
+            (NULL != match_ext (uptr->filename, "ISO")))
+            *readonly = TRUE;
+        return ret_val;
+        }
+/*
+ * The only known interleaved disk devices have either 256 byte
+ * or 128 byte sector sizes.  If additional interleaved file
+ * system scenarios with different sector sizes come up they
+ * should be added here.
+ */
 
-fprintf (st, "Disk container files can be one of several different types:\n\n");
-if (strstr (sim_name, "-10") == NULL) {
-    fprintf (st, "    SIMH   A disk is an unstructured binary file of the size appropriate\n");
-    fprintf (st, "           for the disk drive being simulated accessed by C runtime APIs\n");
-    fprintf (st, "    VHD    Virtual Disk format which is described in the \"Microsoft\n");
-    fprintf (st, "           Virtual Hard Disk (VHD) Image Format Specification\".  The\n");
-    fprintf (st, "           VHD implementation includes support for 1) Fixed (Preallocated)\n");
-    fprintf (st, "           disks, 2) Dynamically Expanding disks, and 3) Differencing disks.\n");
-    fprintf (st, "    RAW    platform specific access to physical disk or CDROM drives\n\n");
-    }
-else {
-    fprintf (st, "    SIMH   A disk is an unstructured binary file of 64bit integers\n"
-                 "           access by C runtime APIs\n");
-    fprintf (st, "    VHD    A disk is an unstructured binary file of 64bit integers\n"
-                 "           contained in a VHD container\n");
-    fprintf (st, "    RAW    A disk is an unstructured binary file of 64bit integers\n"
-                 "           accessed by direct read/write APIs\n");
-    fprintf (st, "    DBD9   Compatible with KLH10 is a packed big endian word\n");
-    fprintf (st, "    DLD9   Compatible with KLH10 is a packed little endian word\n\n");
+for (i = 0; checks[i] != NULL; i++) {
+    ctx->sector_size = 256;
+    if ((ret_val = checks[i] (uptr, ctx->sector_size, readonly)) != (t_offset)-1)
+        break;
+    ctx->sector_size = 128;
+    if ((ret_val = checks[i] (uptr, ctx->sector_size, readonly)) != (t_offset)-1)
+        break;
     }
-fprintf (st, "Virtual (VHD) Disk  support conforms to the \"Virtual Hard Disk Image Format\n");
-fprintf (st, "Specification\", Version 1.0 October 11, 2006.\n");
-fprintf (st, "Dynamically expanding disks never change their \"Virtual Size\", but they don't\n");
-fprintf (st, "consume disk space on the containing storage until the virtual sectors in the\n");
-fprintf (st, "disk are actually written to (i.e. a 2GB Dynamic disk container file with only\n");
-fprintf (st, "30MB of data will initially be about 30MB in size and this size will grow up to\n");
-fprintf (st, "2GB as different sectors are written to.  The VHD format contains metadata\n");
-fprintf (st, "which describes the drive size and the simh device type in use when the VHD\n");
-fprintf (st, "was created.  This metadata is therefore available whenever that VHD is\n");
-fprintf (st, "attached to an emulated disk device in the future so the device type and\n");
-fprintf (st, "size can be automatically be configured.\n\n");
+if ((ret_val != (t_offset)-1) && (ctx->sector_size != saved_sector_size ))
+    sim_messagef (SCPE_OK, "%s: with an unexpected sector size of %u bytes instead of %u bytes\n",
+                           sim_uname (uptr), ctx->sector_size, saved_sector_size);
+ctx->sector_size = saved_sector_size;
+return ret_val;
+}
 
-if (dptr->numunits > 1) {
-    uint32 i, attachable_count = 0, out_count = 0, skip_count;
+static t_stat store_disk_footer (UNIT *uptr, const char *dtype);
 
-    for (i=0; i < dptr->numunits; ++i)
-        if ((dptr->units[i].flags & UNIT_ATTABLE) &&
-            !(dptr->units[i].flags & UNIT_DIS))
-            ++attachable_count;
-    for (i=0; (i < dptr->numunits) && (out_count < 2); ++i)
-        if ((dptr->units[i].flags & UNIT_ATTABLE) &&
-            !(dptr->units[i].flags & UNIT_DIS)) {
-            fprintf (st, "  sim> ATTACH {switches} %s%d diskfile\n", dptr->name, i);
-            ++out_count;
+/* Metadata footers are read when present, but aren't currently added to
+   or updated in containers */
+
+static const t_bool disk_footers_written = FALSE;
+
+static t_stat get_disk_footer (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct simh_disk_footer *f = (struct simh_disk_footer *)calloc (1, sizeof (*f));
+t_offset container_size;
+t_offset sim_fsize_ex (FILE *fptr);
+uint32 bytesread;
+
+if (f == NULL)
+    return SCPE_MEM;
+sim_debug_unit (ctx->dbit, uptr, "get_disk_footer(%s)\n", sim_uname (uptr));
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* SIMH format */
+        container_size = sim_fsize_ex (uptr->fileref);
+        if ((container_size != (t_offset)-1) && (container_size > (t_offset)sizeof (*f)) &&
+            (sim_fseeko (uptr->fileref, container_size - sizeof (*f), SEEK_SET) == 0) &&
+            (sizeof (*f) == sim_fread (f, 1, sizeof (*f), uptr->fileref)))
+            break;
+        free (f);
+        f = NULL;
+        break;
+    case DKUF_F_RAW:                                    /* RAW format */
+        container_size = sim_os_disk_size_raw (uptr->fileref);
+        if ((container_size != (t_offset)-1) && (container_size > (t_offset)sizeof (*f)) &&
+            (sim_os_disk_read (uptr, container_size - sizeof (*f), (uint8 *)f, &bytesread, sizeof (*f)) == SCPE_OK) &&
+            (bytesread == sizeof (*f)))
+            break;
+        free (f);
+        f = NULL;
+        break;
+    case DKUF_F_VHD:                                    /* VHD format */
+        if (1) {
+            time_t creation_time;
+
+            /* Construct a pseudo simh disk footer*/
+            memcpy (f->Signature, "simh", 4);
+            f->FooterVersion = FOOTER_VERSION;
+            memset (f->DriveType, 0, sizeof (f->DriveType));
+            strlcpy ((char *)f->DriveType, sim_vhd_disk_get_dtype (uptr->fileref, &f->SectorSize, &f->TransferElementSize, (char *)f->CreatingSimulator, &creation_time), sizeof (f->DriveType));
+            f->SectorSize = NtoHl (f->SectorSize);
+            f->TransferElementSize = NtoHl (f->TransferElementSize);
+            if ((f->SectorSize == 0) || (NtoHl (f->SectorSize) == 0x00020000)) {  /* Old or mangled format VHD footer */
+                sim_vhd_disk_set_dtype (uptr->fileref, (char *)f->DriveType, ctx->sector_size, ctx->xfer_element_size);
+                sim_vhd_disk_get_dtype (uptr->fileref, &f->SectorSize, &f->TransferElementSize, (char *)f->CreatingSimulator, NULL);
+                f->SectorSize = NtoHl (f->SectorSize);
+                f->TransferElementSize = NtoHl (f->TransferElementSize);
+                }
+            memset (f->CreationTime, 0, sizeof (f->CreationTime));
+            strlcpy ((char*)f->CreationTime, ctime (&creation_time), sizeof (f->CreationTime));
+            container_size = sim_vhd_disk_size (uptr->fileref);
+            if ((f->SectorSize != 0) && (NtoHl (f->SectorSize) <= 65536)) /* Range check for Coverity sake */
+                f->SectorCount = NtoHl ((uint32)(container_size / NtoHl (f->SectorSize)));
+            container_size += sizeof (*f);      /* Adjust since it is removed below */
+            f->AccessFormat = DKUF_F_VHD;
+            f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
             }
-    if (attachable_count > 4) {
-        fprintf (st, "       .\n");
-        fprintf (st, "       .\n");
-        fprintf (st, "       .\n");
-        }
-    skip_count = attachable_count - 2;
-    for (i=0; i < dptr->numunits; ++i)
-        if ((dptr->units[i].flags & UNIT_ATTABLE) &&
-            !(dptr->units[i].flags & UNIT_DIS)) {
-            if (skip_count == 0)
-                fprintf (st, "  sim> ATTACH {switches} %s%d diskfile\n", dptr->name, i);
-            else
-                --skip_count;
+        break;
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        container_size = sim_simhx_disk_size (uptr->fileref);
+        /* Construct a pseudo simh disk footer once a drive type has been recorded */
+        sim_simhx_disk_get_footer (uptr->fileref, f);
+        if (f->DriveType[0] == '\0') {
+            free (f);
+            f = NULL;
+            break;
             }
+        memcpy (f->Signature, "simh", 4);
+        f->FooterVersion = FOOTER_VERSION;
+        if ((f->SectorSize != 0) && (NtoHl (f->SectorSize) <= 65536)) /* Range check for Coverity sake */
+            f->SectorCount = NtoHl ((uint32)(container_size / NtoHl (f->SectorSize)));
+        container_size += sizeof (*f);          /* Adjust since it is removed below */
+        f->AccessFormat = DKUF_F_SIMHX;
+        f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
+        break;
+    default:
+        free (f);
+        return SCPE_IERR;
     }
-else
-    fprintf (st, "  sim> ATTACH {switches} %s diskfile\n", dptr->name);
-fprintf (st, "\n%s attach command switches\n", dptr->name);
-fprintf (st, "    -R          Attach Read Only.\n");
-fprintf (st, "    -E          Must Exist (if not specified an attempt to create the indicated\n");
-fprintf (st, "                disk container will be attempted).\n");
-fprintf (st, "    -F          Open the indicated disk container in a specific format (default\n");
-fprintf (st, "                is to autodetect VHD defaulting to RAW if the indicated\n");
-fprintf (st, "                container is not a VHD).\n");
-fprintf (st, "    -I          Initialize newly created disk so that each sector contains its\n");
-fprintf (st, "                sector address\n");
-fprintf (st, "    -K          Verify that the disk contents contain the sector address in each\n");
-fprintf (st, "                sector.  Whole disk checked at attach time and each sector is\n");
-fprintf (st, "                checked when written.\n");
-fprintf (st, "    -C          Create a disk container and copy its contents from another disk\n");
-fprintf (st, "                (simh, VHD, or RAW format).  The current (or specified with -F)\n");
-fprintf (st, "                container format will be the format of the created container.\n");
-fprintf (st, "                AUTO or VHD will create a VHD container, SIMH will create a.\n");
-fprintf (st, "                SIMH container. Add a -V switch to verify a copy operation.\n");
-fprintf (st, "                Note: A copy will be performed between dissimilar sized\n");
-fprintf (st, "                containers.  Copying from a larger container to a smaller\n");
-fprintf (st, "                one will produce a truncated result.\n");
-fprintf (st, "    -V          Perform a verification pass to confirm successful data copy\n");
-fprintf (st, "                operation.\n");
-fprintf (st, "    -X          When creating a VHD, create a fixed sized VHD (vs a Dynamically\n");
-fprintf (st, "                expanding one).\n");
-fprintf (st, "    -D          Create a Differencing VHD (relative to an already existing VHD\n");
-fprintf (st, "                disk)\n");
-fprintf (st, "    -M          Merge a Differencing VHD into its parent VHD disk\n");
-fprintf (st, "    -O          Override consistency checks when attaching differencing disks\n");
-fprintf (st, "                which have unexpected parent disk GUID or timestamps\n\n");
-fprintf (st, "    -U          Fix inconsistencies which are overridden by the -O switch\n");
-if (strstr (sim_name, "-10") == NULL) {
-    fprintf (st, "    -Y          Answer Yes to prompt to overwrite last track (on disk create)\n");
-    fprintf (st, "    -N          Answer No to prompt to overwrite last track (on disk create)\n");
+if (f) {
+    if (f->Checksum != NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)))) {
+        sim_debug_unit (ctx->dbit, uptr, "No footer found on %s format container: %s\n", sim_disk_fmt (uptr), uptr->filename);
+        free (f);
+        f = NULL;
+        }
+    else {
+        /* We've got a valid footer, but it may need to be corrected */
+        if ((NtoHl (f->TransferElementSize) == 1) &&
+            (0 == memcmp (f->DriveType, "RZ", 2))) {
+            f->TransferElementSize = NtoHl (2);
+            f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
+            store_disk_footer (uptr, (char *)f->DriveType);
+            }
+        free (ctx->footer);
+        ctx->footer = f;
+        ctx->highwater = (((t_offset)NtoHl (f->Highwater[0])) << 32) | ((t_offset)NtoHl (f->Highwater[1]));
+        container_size -= sizeof (*f);
+        sim_debug_unit (ctx->dbit, uptr, "Footer: %s - %s\n"
+            "   Simulator:           %s\n"
+            "   DriveType:           %s\n"
+            "   SectorSize:          %u\n"
+            "   SectorCount:         %u\n"
+            "   TransferElementSize: %u\n"
+            "   FooterVersion:       %u\n"
+            "   AccessFormat:        %u\n"
+            "   CreationTime:        %s",
+            sim_uname (uptr), uptr->filename,
+            f->CreatingSimulator, f->DriveType, NtoHl(f->SectorSize), NtoHl (f->SectorCount),
+            NtoHl (f->TransferElementSize), f->FooterVersion, f->AccessFormat, f->CreationTime);
+        if (f->DeviceName[0] != '\0')
+            sim_debug_unit (ctx->dbit, uptr,
+                "   DeviceName:          %s\n", (char *)f->DeviceName);
+        sim_debug_unit (ctx->dbit, uptr,
+            "   HighwaterSector:     %u\n", (uint32)(ctx->highwater/ctx->sector_size));
+        }
     }
-fprintf (st, "Examples:\n");
-fprintf (st, "  sim> show %s\n", ex->dname);
-fprintf (st, "    %s, address=20001468-2000146B*, no vector, 4 units\n", ex->dname);
-fprintf (st, "    %s0, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize, ex->dtype);
-fprintf (st, "    %s1, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize, ex->dtype);
-fprintf (st, "    %s2, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize, ex->dtype);
-fprintf (st, "    %s3, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize2, ex->dtype2);
-fprintf (st, "  sim> # attach an existing VHD and determine its size and type automatically\n");
-fprintf (st, "  sim> attach %s0 %s.vhd\n", ex->dname, ex->dtype3);
-fprintf (st, "  sim> show %s0\n", ex->dname);
-fprintf (st, "  %s0, %s, attached to %s.vhd, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize3, ex->dtype3, ex->dtype3);
-fprintf (st, "  sim> # create a new %s drive type VHD\n", ex->dtype4);
-fprintf (st, "  sim> set %s2 %s\n", ex->dname, ex->dtype4);
-fprintf (st, "  sim> attach %s2 -f vhd %s.vhd\n", ex->dname, ex->dtype4);
-fprintf (st, "  %s2: creating new file\n", ex->dname);
-fprintf (st, "  sim> show %s2\n", ex->dname);
-fprintf (st, "  %s2, %s, attached to %s.vhd, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize4, ex->dtype4, ex->dtype4);
-fprintf (st, "  sim> # examine the size consumed by the %s VHD file\n", ex->dsize4);
-fprintf (st, "  sim> dir %s.vhd\n", ex->dtype4);
-fprintf (st, "   Directory of H:\\Data\n\n");
-fprintf (st, "  04/14/2011  12:57 PM             5,120 %s.vhd\n", ex->dtype4);
-fprintf (st, "                 1 File(s)          5,120 bytes\n");
-fprintf (st, "  sim> # create a differencing vhd (%s-1-Diff.vhd) with %s.vhd as parent\n", ex->dtype4, ex->dtype4);
-fprintf (st, "  sim> attach %s3 -d %s-1-Diff.vhd %s.vhd\n", ex->dname, ex->dtype4, ex->dtype4);
-fprintf (st, "  sim> # create a VHD (%s-1.vhd) which is a copy of an existing disk\n", ex->dtype4);
-fprintf (st, "  sim> attach %s3 -c %s-1.vhd %s.vhd\n", ex->dname, ex->dtype4, ex->dtype4);
-fprintf (st, "  %s3: creating new virtual disk '%s-1.vhd'\n", ex->dname, ex->dtype4);
-fprintf (st, "  %s3: Copied %s.  99%% complete.\n", ex->dname, ex->dsize4);
-fprintf (st, "  %s3: Copied %s. Done.\n", ex->dname, ex->dsize4);
-fprintf (st, "  sim> show %s3\n", ex->dname);
-fprintf (st, "  %s3, %s, attached to %s-1.vhd, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize4, ex->dtype4, ex->dtype4);
-fprintf (st, "  sim> dir %s*\n", ex->dtype4);
-fprintf (st, "   Directory of H:\\Data\n\n");
-fprintf (st, "  04/14/2011  01:12 PM             5,120 %s-1.vhd\n", ex->dtype4);
-fprintf (st, "  04/14/2011  12:58 PM             5,120 %s.vhd\n", ex->dtype4);
-fprintf (st, "                 2 File(s)         10,240 bytes\n");
-fprintf (st, "  sim> show %s2\n", ex->dname);
-fprintf (st, "  %s2, %s, not attached, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize4, ex->dtype4);
-fprintf (st, "  sim> set %s2 %s\n", ex->dname, ex->dtype3);
-fprintf (st, "  sim> set %s2 noauto\n", ex->dname);
-fprintf (st, "  sim> show %s2\n", ex->dname);
-fprintf (st, "  %s2, %s, not attached, write enabled, %s, noautosize, VHD format\n", ex->dname, ex->dsize3, ex->dtype3);
-fprintf (st, "  sim> set %s2 format=simh\n", ex->dname);
-fprintf (st, "  sim> show %s2\n", ex->dname);
-fprintf (st, "  %s2, %s, not attached, write enabled, %s, noautosize, SIMH format\n", ex->dname, ex->dsize3, ex->dtype3);
-fprintf (st, "  sim> # create a VHD from an existing SIMH format disk\n");
-fprintf (st, "  sim> attach %s2 -c %s-Copy.vhd XYZZY.dsk\n", ex->dname, ex->dtype3);
-fprintf (st, "  %s2: creating new virtual disk '%s-Copy.vhd'\n", ex->dname, ex->dtype3);
-fprintf (st, "  %s2: Copied %s.  99%% complete.\n", ex->dname, ex->dsize3);
-fprintf (st, "  %s2: Copied %s. Done.\n", ex->dname, ex->dsize3);
-fprintf (st, "  sim> show %s2\n", ex->dname);
-fprintf (st, "  %s2, %s, attached to %s-Copy.vhd, write enabled, %s, noautosize, VHD format\n", ex->dname, ex->dsize3, ex->dtype3, ex->dtype3);
+sim_debug_unit (ctx->dbit, uptr, "Container Size: %u sectors %u bytes each\n", (uint32)(container_size/ctx->sector_size), ctx->sector_size);
+ctx->container_size = container_size;
 return SCPE_OK;
 }
 
-t_bool sim_disk_vhd_support (void)
-{
-return SCPE_OK == sim_vhd_disk_implemented ();
-}
-
-t_bool sim_disk_raw_support (void)
-{
-return SCPE_OK == sim_os_disk_implemented_raw ();
-}
-
-t_stat sim_disk_reset (UNIT *uptr)
+static t_stat store_disk_footer (UNIT *uptr, const char *dtype)
 {
+DEVICE *dptr;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct stat statb;
+struct simh_disk_footer *f;
+time_t now = time (NULL);
+t_offset total_sectors;
+t_offset highwater;
 
-if (!(uptr->flags & UNIT_ATT))                          /* attached? */
+if (!disk_footers_written)
     return SCPE_OK;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_disk_reset(unit=%d)\n", (int)(uptr - ctx->dptr->units));
-
-_sim_disk_io_flush(uptr);
-AIO_VALIDATE(uptr);
-AIO_UPDATE_QUEUE;
-return SCPE_OK;
-}
-
-t_stat sim_disk_perror (UNIT *uptr, const char *msg)
-{
-int saved_errno = errno;
-
-if (!(uptr->flags & UNIT_ATTABLE))                      /* not attachable? */
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
     return SCPE_NOATT;
-switch (DK_GET_FMT (uptr)) {                            /* case on format */
+if (uptr->flags & UNIT_RO)
+    return SCPE_RO;
+if (sim_stat (uptr->filename, &statb))
+    memset (&statb, 0, sizeof (statb));
+f = (struct simh_disk_footer *)calloc (1, sizeof (*f));
+f->AccessFormat = DK_GET_FMT (uptr);
+total_sectors = (((t_offset)uptr->capac) * ctx->capac_factor * ((dptr->flags & DEV_SECTORS) ? 512 : 1)) / ctx->sector_size;
+memcpy (f->Signature, "simh", 4);
+f->FooterVersion = FOOTER_VERSION;
+memset (f->CreatingSimulator, 0, sizeof (f->CreatingSimulator));
+strlcpy ((char *)f->CreatingSimulator, sim_name, sizeof (f->CreatingSimulator));
+memset (f->DriveType, 0, sizeof (f->DriveType));
+strlcpy ((char *)f->DriveType, dtype, sizeof (f->DriveType));
+f->SectorSize = NtoHl (ctx->sector_size);
+f->SectorCount = NtoHl ((uint32)total_sectors);
+f->TransferElementSize = NtoHl (ctx->xfer_element_size);
+memset (f->CreationTime, 0, sizeof (f->CreationTime));
+strlcpy ((char*)f->CreationTime, ctime (&now), sizeof (f->CreationTime));
+memset (f->DeviceName, 0, sizeof (f->DeviceName));
+strlcpy ((char*)f->DeviceName, dptr->name, sizeof (f->DeviceName));
+highwater = sim_fsize_name_ex (uptr->filename);
+/* Align Initial Highwater to a sector boundary */
+highwater = ((highwater + ctx->sector_size - 1) / ctx->sector_size) * ctx->sector_size;
+f->Highwater[0] = NtoHl ((uint32)(highwater >> 32));
+f->Highwater[1] = NtoHl ((uint32)(highwater & 0xFFFFFFFF));
+f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
+free (ctx->footer);
+ctx->footer = f;
+switch (f->AccessFormat) {
     case DKUF_F_STD:                                    /* SIMH format */
+        if (sim_fseeko ((FILE *)uptr->fileref, total_sectors * ctx->sector_size, SEEK_SET) == 0) {
+            sim_fwrite (f, sizeof (*f), 1, (FILE *)uptr->fileref);
+            fclose ((FILE *)uptr->fileref);
+            sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
+            uptr->fileref = sim_fopen (uptr->filename, "rb+");
+            }
+        break;
     case DKUF_F_VHD:                                    /* VHD format */
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        break;
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
-#if defined(_WIN32)
-        saved_errno = GetLastError ();
-#endif
-        perror (msg);
-        sim_printf ("%s %s: %s\n", sim_uname(uptr), msg, sim_get_os_error_text (saved_errno));
+        sim_os_disk_write (uptr, total_sectors * ctx->sector_size, (uint8 *)f, NULL, sizeof (*f));
+        sim_os_disk_close_raw (uptr->fileref);
+        sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
+        uptr->fileref = sim_os_disk_open_raw (uptr->filename, "rb+");
         break;
     default:
-        ;
+        break;
     }
 return SCPE_OK;
 }
 
-t_stat sim_disk_clearerr (UNIT *uptr)
+static t_stat update_disk_footer (UNIT *uptr)
 {
-if (!(uptr->flags & UNIT_ATTABLE))                      /* not attachable? */
+DEVICE *dptr;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct stat statb;
+struct simh_disk_footer *f;
+t_offset total_sectors;
+t_offset highwater;
+t_offset footer_highwater;
+
+if (!disk_footers_written)
+    return SCPE_OK;
+
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
     return SCPE_NOATT;
-switch (DK_GET_FMT (uptr)) {                            /* case on format */
+if (uptr->flags & UNIT_RO)
+    return SCPE_RO;
+if (ctx == NULL)
+    return SCPE_IERR;
+f = ctx->footer;
+if (f == NULL)
+    return SCPE_IERR;
+
+footer_highwater = (((t_offset)NtoHl (f->Highwater[0])) << 32) | ((t_offset)NtoHl (f->Highwater[1]));
+if (ctx->highwater <= footer_highwater)
+    return SCPE_OK;
+
+if (sim_stat (uptr->filename, &statb))
+    memset (&statb, 0, sizeof (statb));
+total_sectors = (((t_offset)uptr->capac) * ctx->capac_factor * ((dptr->flags & DEV_SECTORS) ? 512 : 1)) / ctx->sector_size;
+highwater = ctx->highwater;
+f->Highwater[0] = NtoHl ((uint32)(highwater >> 32));
+f->Highwater[1] = NtoHl ((uint32)(highwater & 0xFFFFFFFF));
+f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
+switch (f->AccessFormat) {
     case DKUF_F_STD:                                    /* SIMH format */
-        clearerr (uptr->fileref);
+        if (sim_fseeko ((FILE *)uptr->fileref, total_sectors * ctx->sector_size, SEEK_SET) == 0) {
+            sim_fwrite (f, sizeof (*f), 1, (FILE *)uptr->fileref);
+            fclose ((FILE *)uptr->fileref);
+            sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
+            uptr->fileref = sim_fopen (uptr->filename, "rb+");
+            }
         break;
     case DKUF_F_VHD:                                    /* VHD format */
-        sim_vhd_disk_clearerr (uptr);
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        break;
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+        sim_os_disk_write (uptr, total_sectors * ctx->sector_size, (uint8 *)f, NULL, sizeof (*f));
+        sim_os_disk_close_raw (uptr->fileref);
+        sim_set_file_times (uptr->filename, statb.st_atime, statb.st_mtime);
+        uptr->fileref = sim_os_disk_open_raw (uptr->filename, "rb+");
         break;
     default:
-        ;
+        break;
     }
 return SCPE_OK;
 }
 
+t_stat sim_disk_attach (UNIT *uptr, const char *cptr, size_t sector_size, size_t xfer_element_size, t_bool dontchangecapac,
+                        uint32 dbit, const char *dtype, uint32 pdp11tracksize, int completion_delay)
+{
+return sim_disk_attach_ex (uptr, cptr, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay, NULL);
+}
 
-/* Factory bad block table creation routine
+t_stat sim_disk_attach_ex (UNIT *uptr, const char *cptr, size_t sector_size, size_t xfer_element_size, t_bool dontchangecapac,
+                           uint32 dbit, const char *dtype, uint32 pdp11tracksize, int completion_delay, const char **drivetypes)
+{
+return sim_disk_attach_ex2 (uptr, cptr, sector_size, xfer_element_size, dontchangecapac,
+                            dbit, dtype, pdp11tracksize, completion_delay, drivetypes, 0);
+}
 
-   This routine writes a DEC standard 144 compliant bad block table on the
-   last track of the specified unit as described in:
-      EL-00144_B_DEC_STD_144_Disk_Standard_for_Recording_and_Handling_Bad_Sectors_Nov76.pdf
-   The bad block table consists of 10 repetitions of the same table,
-   formatted as follows:
+t_stat sim_disk_attach_ex2 (UNIT *uptr, const char *cptr, size_t sector_size, size_t xfer_element_size, t_bool dontchangecapac,
+                            uint32 dbit, const char *dtype, uint32 pdp11tracksize, int completion_delay, const char **drivetypes,
+                            size_t reserved_sectors)
+{
+struct disk_context *ctx;
+DEVICE *dptr;
+char tbuf[4*CBUFSIZE];
+FILE *(*open_function)(const char *filename, const char *mode) = sim_fopen;
+FILE *(*create_function)(const char *filename, t_offset desiredsize) = NULL;
+t_stat (*storage_function)(FILE *file, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom) = NULL;
+t_bool created = FALSE, copied = FALSE, autosized = FALSE;
+t_bool auto_format = FALSE;
+t_offset container_size, filesystem_size, current_unit_size;
+size_t tmp_size = 1;
 
-        words 0-1       pack id number
-        words 2-3       cylinder/sector/surface specifications
-         :
-        words n-n+1     end of table (-1,-1)
-
-   Inputs:
-        uptr    =       pointer to unit
-        sec     =       number of sectors per surface
-        wds     =       number of words per sector
-   Outputs:
-        sta     =       status code
-*/
-
-t_stat sim_disk_pdp11_bad_block (UNIT *uptr, int32 sec, int32 wds)
-{
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-int32 i;
-t_addr da;
-uint16 *buf;
-DEVICE *dptr;
-char *namebuf, *c;
-uint32 packid;
-t_stat stat = SCPE_OK;
-
-if ((sec < 2) || (wds < 16))
-    return SCPE_ARG;
-if ((uptr->flags & UNIT_ATT) == 0)
-    return SCPE_UNATT;
+if (sim_disk_no_autosize) {
+    dontchangecapac = TRUE;
+    drivetypes = NULL;
+    }
+if (uptr->flags & UNIT_DIS)                             /* disabled? */
+    return SCPE_UDIS;
+if (!(uptr->flags & UNIT_ATTABLE))                      /* not attachable? */
+    return SCPE_NOATT;
 if ((dptr = find_dev_from_unit (uptr)) == NULL)
     return SCPE_NOATT;
-if (uptr->flags & UNIT_RO)
-    return SCPE_RO;
-if (!get_yn ("Overwrite last track? [N]", FALSE))
-    return SCPE_OK;
-if ((buf = (uint16 *) malloc (wds * sizeof (uint16))) == NULL)
-    return SCPE_MEM;
-namebuf = uptr->filename;
-if ((c = strrchr (namebuf, '/')))
-    namebuf = c+1;
-if ((c = strrchr (namebuf, '\\')))
-    namebuf = c+1;
-if ((c = strrchr (namebuf, ']')))
-    namebuf = c+1;
-packid = eth_crc32(0, namebuf, strlen (namebuf));
-buf[0] = (uint16)packid;
-buf[1] = (uint16)(packid >> 16) & 0x7FFF;   /* Make sure MSB is clear */
-buf[2] = buf[3] = 0;
-for (i = 4; i < wds; i++)
-    buf[i] = 0177777u;
-da = (uptr->capac*((dptr->flags & DEV_SECTORS) ? 512 : 1)) - (sec * wds);
-for (i = 0; (stat == SCPE_OK) && (i < sec) && (i < 10); i++, da += wds)
-    if (ctx)
-        stat = sim_disk_wrsect (uptr, (t_lba)(da/wds), (uint8 *)buf, NULL, 1);
+switch (xfer_element_size) {
+    default:
+        return sim_messagef (SCPE_ARG, "Unsupported transfer element size: %u\n", (uint32)xfer_element_size);
+    case 1: case 2: case 4: case 8:
+        break;
+    }
+if ((sector_size % xfer_element_size) != 0)
+    return sim_messagef (SCPE_ARG, "Invalid sector size: %u - must be a multiple of the transfer element size %u\n", (uint32)sector_size, (uint32)xfer_element_size);
+if (sim_switches & SWMASK ('F')) {                      /* format spec? */
+    char gbuf[CBUFSIZE];
+    cptr = get_glyph (cptr, gbuf, 0);                   /* get spec */
+    if (*cptr == 0)                                     /* must be more */
+        return SCPE_2FARG;
+    if ((sim_disk_set_fmt (uptr, 0, gbuf, NULL) != SCPE_OK) ||
+        (DK_GET_FMT (uptr) == DKUF_F_AUTO))
+        return sim_messagef (SCPE_ARG, "Invalid Override Disk Format: %s\n", gbuf);
+    sim_switches = sim_switches & ~(SWMASK ('F'));      /* Record Format specifier already processed */
+    auto_format = TRUE;
+    }
+if (sim_switches & SWMASK ('D')) {                      /* create difference disk? */
+    char gbuf[CBUFSIZE];
+    FILE *vhd;
+
+    sim_switches = sim_switches & ~(SWMASK ('D'));
+    cptr = get_glyph_nc (cptr, gbuf, 0);                /* get spec */
+    if (*cptr == 0)                                     /* must be more */
+        return SCPE_2FARG;
+    vhd = sim_vhd_disk_create_diff (gbuf, cptr);
+    if (vhd) {
+        sim_vhd_disk_close (vhd);
+        return sim_disk_attach (uptr, gbuf, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay);
+        }
+    return sim_messagef (SCPE_ARG, "Unable to create differencing VHD: %s\n", gbuf);
+    }
+if (sim_switches & SWMASK ('C')) {                      /* create new disk container & copy contents? */
+    char gbuf[CBUFSIZE];
+    const char *dest_fmt = ((DK_GET_FMT (uptr) == DKUF_F_AUTO) || (DK_GET_FMT (uptr) == DKUF_F_VHD)) ? "VHD" :
+                           (DK_GET_FMT (uptr) == DKUF_F_SIMHX) ? "SIMHX" : "SIMH";
+    FILE *dest;
+    int (*dest_close)(FILE *f) = fclose;
+    int saved_sim_switches = sim_switches;
+    int32 saved_sim_quiet = sim_quiet;
+    t_addr target_capac = uptr->capac;
+    t_addr source_capac;
+    uint32 capac_factor;
+    t_stat r;
+
+    sim_switches = sim_switches & ~(SWMASK ('C'));
+    cptr = get_glyph_nc (cptr, gbuf, 0);                /* get spec */
+    if (*cptr == 0)                                     /* must be more */
+        return SCPE_2FARG;
+    sim_switches |= SWMASK ('R') | SWMASK ('E');
+    sim_quiet = TRUE;
+    /* First open the source of the copy operation */
+    r = sim_disk_attach_ex (uptr, cptr, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay, NULL);
+    sim_quiet = saved_sim_quiet;
+    if (r != SCPE_OK) {
+        sim_switches = saved_sim_switches;
+        return sim_messagef (r, "%s: Cannot open copy source: %s - %s\n", sim_uname (uptr), cptr, sim_error_text (r));
+        }
+    _sim_disk_cache_free (uptr);                        /* the copy switches containers under the unit */
+    _sim_disk_unmap (uptr);
+    source_capac = uptr->capac;
+    sim_messagef (SCPE_OK, "%s: Creating new %s '%s' disk container copied from '%s'\n", sim_uname (uptr), dest_fmt, gbuf, cptr);
+    capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
+    uptr->capac = target_capac;
+    if (strcmp ("VHD", dest_fmt) == 0) {
+        dest = sim_vhd_disk_create (gbuf, ((t_offset)uptr->capac)*capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1));
+        dest_close = sim_vhd_disk_close;
+        }
     else {
-        if (sim_fseek (uptr->fileref, da, SEEK_SET)) {
-            stat = SCPE_IOERR;
-            break;
+        if (strcmp ("SIMHX", dest_fmt) == 0) {
+            dest = sim_simhx_disk_create (gbuf, ((t_offset)uptr->capac)*capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1));
+            dest_close = sim_simhx_disk_close;
             }
-        if ((size_t)wds != sim_fwrite (buf, sizeof (uint16), wds, uptr->fileref))
-            stat = SCPE_IOERR;
+        else
+            dest = sim_fopen (gbuf, "wb+");
         }
-free (buf);
-return stat;
-}
-
-void sim_disk_data_trace(UNIT *uptr, const uint8 *data, size_t lba, size_t len, const char* txt, int detail, uint32 reason)
-{
-DEVICE *dptr = find_dev_from_unit (uptr);
+    if (!dest) {
+        sim_disk_detach (uptr);
+        return sim_messagef (r, "%s: Cannot create %s disk container '%s'\n", sim_uname (uptr), dest_fmt, gbuf);
+        }
+    else {
+        uint8 *copy_buf = (uint8*) malloc (1024*1024);
+        t_lba lba;
+        t_seccnt sectors_per_buffer = (t_seccnt)((1024*1024)/sector_size);
+        t_lba total_sectors = (t_lba)((target_capac*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1)));
+        t_seccnt sects = sectors_per_buffer;
+        t_seccnt sects_read;
 
-if (sim_deb && ((uptr->dctrl | dptr->dctrl) & reason)) {
-    char pos[32];
+        if (!copy_buf) {
+            dest_close (dest);
+            (void)remove (gbuf);
+            sim_disk_detach (uptr);
+            return SCPE_MEM;
+            }
+        sim_messagef (SCPE_OK, "Copying %u sectors each %u bytes in size\n", (uint32)total_sectors, (uint32)sector_size);
+        if (source_capac > target_capac) {
+            sim_messagef (SCPE_OK, "The source container is %u sectors larger than the destination disk container\n",
+                        (t_lba)(((source_capac - target_capac)*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1))));
+            sim_messagef (SCPE_OK, "these additional sectors will be unavailable on the target drive\n");
+            }
+        for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects_read) {
+            uptr->capac = source_capac;
+            sects = sectors_per_buffer;
+            if (lba + sects > total_sectors)
+                sects = total_sectors - lba;
+            r = sim_disk_rdsect (uptr, lba, copy_buf, &sects_read, sects);
+            if ((r == SCPE_OK) && (sects_read > 0)) {
+                uint32 saved_unit_flags = uptr->flags;
+                FILE *save_unit_fileref = uptr->fileref;
+                t_seccnt sects_written;
 
-    sprintf (pos, "lbn: %08X ", (unsigned int)lba);
-    sim_data_trace(dptr, uptr, (detail ? data : NULL), pos, len, txt, reason);
-    }
-}
+                sim_disk_set_fmt (uptr, 0, dest_fmt, NULL);
+                uptr->fileref = dest;
+                uptr->capac = target_capac;
+                r = sim_disk_wrsect (uptr, lba, copy_buf, &sects_written, sects_read);
+                uptr->fileref = save_unit_fileref;
+                uptr->flags = saved_unit_flags;
+                if (sects_read != sects_written)
+                    r = SCPE_IOERR;
+                sim_messagef (SCPE_OK, "%s: Copied %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)(lba + sects_read), (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
+                }
+            }
+        if (r == SCPE_OK)
+            sim_messagef (SCPE_OK, "\n%s: Copied %u sectors. Done.\n", sim_uname (uptr), (uint32)total_sectors);
+        else
+            sim_messagef (r, "\n%s: Error copying: %s.\n", sim_uname (uptr), sim_error_text (r));
+        if ((r == SCPE_OK) && (sim_switches & SWMASK ('V'))) {
+            uint8 *verify_buf = (uint8*) malloc (1024*1024);
+            t_seccnt sects_read, verify_read;
 
-/* OS Specific RAW Disk I/O support */
+            if (!verify_buf) {
+                dest_close (dest);
+                (void)remove (gbuf);
+                free (copy_buf);
+                sim_disk_detach (uptr);
+                return SCPE_MEM;
+                }
+            for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects_read) {
+                sim_messagef (SCPE_OK, "%s: Verified %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)lba, (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
+                uptr->capac = source_capac;
+                sects = sectors_per_buffer;
+                if (lba + sects > total_sectors)
+                    sects = total_sectors - lba;
+                r = sim_disk_rdsect (uptr, lba, copy_buf, &sects_read, sects);
+                if (r == SCPE_OK) {
+                    uint32 saved_unit_flags = uptr->flags;
+                    FILE *save_unit_fileref = uptr->fileref;
 
-#if defined _WIN32
+                    sim_disk_set_fmt (uptr, 0, dest_fmt, NULL);
+                    uptr->fileref = dest;
+                    uptr->capac = target_capac;
+                    r = sim_disk_rdsect (uptr, lba, verify_buf, &verify_read, sects_read);
+                    uptr->fileref = save_unit_fileref;
+                    uptr->flags = saved_unit_flags;
+                    if (r == SCPE_OK) {
+                        if ((sects_read != verify_read) ||
+                            (0 != memcmp (copy_buf, verify_buf, verify_read*sector_size)))
+                            r = SCPE_IOERR;
+                        }
+                    }
+                if (r != SCPE_OK)
+                    break;
+                }
+            if (!sim_quiet) {
+                if (r == SCPE_OK)
+                    sim_messagef (r, "\n%s: Verified %u sectors. Done.\n", sim_uname (uptr), (uint32)total_sectors);
+                else {
+                    t_lba i;
+                    uint32 save_dctrl = dptr->dctrl;
+                    FILE *save_sim_deb = sim_deb;
 
-static void _set_errno_from_status (DWORD dwStatus)
-{
-switch (dwStatus) {
-    case ERROR_FILE_NOT_FOUND:    case ERROR_PATH_NOT_FOUND:
-    case ERROR_INVALID_DRIVE:     case ERROR_NO_MORE_FILES:
-    case ERROR_BAD_NET_NAME:      case ERROR_BAD_NETPATH:
-    case ERROR_BAD_PATHNAME:      case ERROR_FILENAME_EXCED_RANGE:
-        errno = ENOENT;
-        return;
-    case ERROR_INVALID_ACCESS:    case ERROR_INVALID_DATA:
-    case ERROR_INVALID_FUNCTION:  case ERROR_INVALID_PARAMETER:
-    case ERROR_NEGATIVE_SEEK:
-        errno = EINVAL;
-        return;
-    case ERROR_ARENA_TRASHED:     case ERROR_NOT_ENOUGH_MEMORY:
-    case ERROR_INVALID_BLOCK:     case ERROR_NOT_ENOUGH_QUOTA:
-        errno = ENOMEM;
-        return;
-    case ERROR_TOO_MANY_OPEN_FILES:
-        errno = EMFILE;
-        return;
-    case ERROR_ACCESS_DENIED:     case ERROR_CURRENT_DIRECTORY:
-    case ERROR_LOCK_VIOLATION:    case ERROR_NETWORK_ACCESS_DENIED:
-    case ERROR_CANNOT_MAKE:       case ERROR_FAIL_I24:
-    case ERROR_DRIVE_LOCKED:      case ERROR_SEEK_ON_DEVICE:
-    case ERROR_NOT_LOCKED:        case ERROR_LOCK_FAILED:
-        errno = EACCES;
-        return;
-    case ERROR_ALREADY_EXISTS:    case ERROR_FILE_EXISTS:
-        errno = EEXIST;
-        return;
-    case ERROR_INVALID_HANDLE:    case ERROR_INVALID_TARGET_HANDLE:
-    case ERROR_DIRECT_ACCESS_HANDLE:
-        errno = EBADF;
-        return;
-    case ERROR_DIR_NOT_EMPTY:
-        errno = ENOTEMPTY;
-        return;
-    case ERROR_BAD_ENVIRONMENT:
-        errno = E2BIG;
-        return;
-    case ERROR_BAD_FORMAT:
-        errno = ENOEXEC;
-        return;
-    case ERROR_NOT_SAME_DEVICE:
-        errno = EXDEV;
-        return;
-    case ERROR_BROKEN_PIPE:
-        errno = EPIPE;
-        return;
-    case ERROR_DISK_FULL:
-        errno = ENOSPC;
-        return;
-    case ERROR_WAIT_NO_CHILDREN:  case ERROR_CHILD_NOT_COMPLETE:
-        errno = ECHILD;
-        return;
-    case ERROR_NO_PROC_SLOTS:     case ERROR_MAX_THRDS_REACHED:
-    case ERROR_NESTING_NOT_ALLOWED:
-        errno = EAGAIN;
-        return;
-    }
-if ((dwStatus >= ERROR_WRITE_PROTECT) && (dwStatus <= ERROR_SHARING_BUFFER_EXCEEDED)) {
-    errno = EACCES;
-    return;
-    }
-if ((dwStatus >= ERROR_INVALID_STARTING_CODESEG) && (dwStatus <= ERROR_INFLOOP_IN_RELOC_CHAIN)) {
-    errno = ENOEXEC;
-    return;
-    }
-errno = EINVAL;
-}
-#if defined(__GNUC__) && defined(HAVE_NTDDDISK_H)
-#include <ddk/ntddstor.h>
-#include <ddk/ntdddisk.h>
-#else
-#include <winioctl.h>
-#endif
-
-#if defined(__cplusplus)
-extern "C" {
-#endif
-WINBASEAPI BOOL WINAPI GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
-#if defined(__cplusplus)
-    }
-#endif
-
-struct _device_type {
-    int32 Type;
-    const char *desc;
-    } DeviceTypes[] = {
-        {FILE_DEVICE_8042_PORT,             "8042_PORT"},
-        {FILE_DEVICE_ACPI,                  "ACPI"},
-        {FILE_DEVICE_BATTERY,               "BATTERY"},
-        {FILE_DEVICE_BEEP,                  "BEEP"},
-#ifdef FILE_DEVICE_BLUETOOTH
-        {FILE_DEVICE_BLUETOOTH,             "BLUETOOTH"},
-#endif
-        {FILE_DEVICE_BUS_EXTENDER,          "BUS_EXTENDER"},
-        {FILE_DEVICE_CD_ROM,                "CD_ROM"},
-        {FILE_DEVICE_CD_ROM_FILE_SYSTEM,    "CD_ROM_FILE_SYSTEM"},
-        {FILE_DEVICE_CHANGER,               "CHANGER"},
-        {FILE_DEVICE_CONTROLLER,            "CONTROLLER"},
-#ifdef FILE_DEVICE_CRYPT_PROVIDER
-        {FILE_DEVICE_CRYPT_PROVIDER,        "CRYPT_PROVIDER"},
-#endif
-        {FILE_DEVICE_DATALINK,              "DATALINK"},
-        {FILE_DEVICE_DFS,                   "DFS"},
-        {FILE_DEVICE_DFS_FILE_SYSTEM,       "DFS_FILE_SYSTEM"},
-        {FILE_DEVICE_DFS_VOLUME,            "DFS_VOLUME"},
-        {FILE_DEVICE_DISK,                  "DISK"},
-        {FILE_DEVICE_DISK_FILE_SYSTEM,      "DISK_FILE_SYSTEM"},
-        {FILE_DEVICE_DVD,                   "DVD"},
-        {FILE_DEVICE_FILE_SYSTEM,           "FILE_SYSTEM"},
-#ifdef FILE_DEVICE_FIPS
-        {FILE_DEVICE_FIPS,                  "FIPS"},
-#endif
-        {FILE_DEVICE_FULLSCREEN_VIDEO,      "FULLSCREEN_VIDEO"},
-#ifdef FILE_DEVICE_INFINIBAND
-        {FILE_DEVICE_INFINIBAND,            "INFINIBAND"},
-#endif
-        {FILE_DEVICE_INPORT_PORT,           "INPORT_PORT"},
-        {FILE_DEVICE_KEYBOARD,              "KEYBOARD"},
-        {FILE_DEVICE_KS,                    "KS"},
-        {FILE_DEVICE_KSEC,                  "KSEC"},
-        {FILE_DEVICE_MAILSLOT,              "MAILSLOT"},
-        {FILE_DEVICE_MASS_STORAGE,          "MASS_STORAGE"},
-        {FILE_DEVICE_MIDI_IN,               "MIDI_IN"},
-        {FILE_DEVICE_MIDI_OUT,              "MIDI_OUT"},
-        {FILE_DEVICE_MODEM,                 "MODEM"},
-        {FILE_DEVICE_MOUSE,                 "MOUSE"},
-        {FILE_DEVICE_MULTI_UNC_PROVIDER,    "MULTI_UNC_PROVIDER"},
-        {FILE_DEVICE_NAMED_PIPE,            "NAMED_PIPE"},
-        {FILE_DEVICE_NETWORK,               "NETWORK"},
-        {FILE_DEVICE_NETWORK_BROWSER,       "NETWORK_BROWSER"},
-        {FILE_DEVICE_NETWORK_FILE_SYSTEM,   "NETWORK_FILE_SYSTEM"},
-        {FILE_DEVICE_NETWORK_REDIRECTOR,    "NETWORK_REDIRECTOR"},
-        {FILE_DEVICE_NULL,                  "NULL"},
-        {FILE_DEVICE_PARALLEL_PORT,         "PARALLEL_PORT"},
-        {FILE_DEVICE_PHYSICAL_NETCARD,      "PHYSICAL_NETCARD"},
-        {FILE_DEVICE_PRINTER,               "PRINTER"},
-        {FILE_DEVICE_SCANNER,               "SCANNER"},
-        {FILE_DEVICE_SCREEN,                "SCREEN"},
-        {FILE_DEVICE_SERENUM,               "SERENUM"},
-        {FILE_DEVICE_SERIAL_MOUSE_PORT,     "SERIAL_MOUSE_PORT"},
-        {FILE_DEVICE_SERIAL_PORT,           "SERIAL_PORT"},
-        {FILE_DEVICE_SMARTCARD,             "SMARTCARD"},
-        {FILE_DEVICE_SMB,                   "SMB"},
-        {FILE_DEVICE_SOUND,                 "SOUND"},
-        {FILE_DEVICE_STREAMS,               "STREAMS"},
-        {FILE_DEVICE_TAPE,                  "TAPE"},
-        {FILE_DEVICE_TAPE_FILE_SYSTEM,      "TAPE_FILE_SYSTEM"},
-        {FILE_DEVICE_TERMSRV,               "TERMSRV"},
-        {FILE_DEVICE_TRANSPORT,             "TRANSPORT"},
-        {FILE_DEVICE_UNKNOWN,               "UNKNOWN"},
-        {FILE_DEVICE_VDM,                   "VDM"},
-        {FILE_DEVICE_VIDEO,                 "VIDEO"},
-        {FILE_DEVICE_VIRTUAL_DISK,          "VIRTUAL_DISK"},
-#ifdef FILE_DEVICE_VMBUS
-        {FILE_DEVICE_VMBUS,                 "VMBUS"},
-#endif
-        {FILE_DEVICE_WAVE_IN,               "WAVE_IN"},
-        {FILE_DEVICE_WAVE_OUT,              "WAVE_OUT"},
-#ifdef FILE_DEVICE_WPD
-        {FILE_DEVICE_WPD,                   "WPD"},
-#endif
-        {0,                                 NULL}};
-
-static const char *_device_type_name (int DeviceType)
-{
-int i;
-
-for (i=0; DeviceTypes[i].desc; i++)
-    if (DeviceTypes[i].Type == DeviceType)
-        return DeviceTypes[i].desc;
-return "Unknown";
-}
-
-static t_stat sim_os_disk_implemented_raw (void)
-{
-return sim_toffset_64 ? SCPE_OK : SCPE_NOFNC;
-}
-
-static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode)
-{
-HANDLE Handle;
-DWORD DesiredAccess = 0;
-uint32 is_cdrom;
-char *tmpname = (char *)malloc (2 + strlen (rawdevicename));
-
-if (tmpname == NULL)
-    return NULL;
-if (strchr (openmode, 'r'))
-    DesiredAccess |= GENERIC_READ;
-if (strchr (openmode, 'w') || strchr (openmode, '+'))
-    DesiredAccess |= GENERIC_WRITE;
-/* SCP Command Line parsing replaces \\ with \ presuming this is an
-   escape sequence.  This only affects RAW device names and UNC paths.
-   We handle the RAW device name case here by prepending paths beginning
-   with \.\ with an extra \. */
-if ((!memcmp ("\\.\\", rawdevicename, 3)) ||
-    (!memcmp ("/./", rawdevicename, 3))) {
-    *tmpname = '\\';
-    strcpy (tmpname + 1, rawdevicename);
-    }
-else
-    strcpy (tmpname, rawdevicename);
-Handle = CreateFileA (tmpname, DesiredAccess, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS|FILE_FLAG_WRITE_THROUGH, NULL);
-free (tmpname);
-if (Handle != INVALID_HANDLE_VALUE) {
-    if ((sim_os_disk_info_raw ((FILE *)Handle, NULL, NULL, &is_cdrom)) ||
-        ((DesiredAccess & GENERIC_WRITE) && is_cdrom)) {
-        CloseHandle (Handle);
-        errno = EACCES;
-        return NULL;
+                    for (i = 0; i < sects_read; ++i)
+                        if (0 != memcmp (copy_buf+i*sector_size, verify_buf+i*sector_size, sector_size))
+                            break;
+                    sim_printf ("\n%s: Verification Error on lbn %d.\n", sim_uname (uptr), lba+i);
+                    dptr->dctrl = 0xFFFFFFFF;
+                    sim_deb = stdout;
+                    sim_disk_data_trace (uptr,   copy_buf+i*sector_size, lba+i, sector_size, "Expected", TRUE, 1);
+                    sim_disk_data_trace (uptr, verify_buf+i*sector_size, lba+i, sector_size,    "Found", TRUE, 1);
+                    dptr->dctrl = save_dctrl;
+                    sim_deb = save_sim_deb;
+                    }
+                }
+            free (verify_buf);
+            }
+        free (copy_buf);
+        dest_close (dest);
+        sim_disk_detach (uptr);
+        if (r == SCPE_OK) {
+            created = TRUE;
+            copied = TRUE;
+            strlcpy (tbuf, gbuf, sizeof(tbuf)-1);
+            cptr = tbuf;
+            sim_disk_set_fmt (uptr, 0, dest_fmt, NULL);
+            sim_switches = saved_sim_switches;
+            }
+        else
+            return r;
+        /* fall through and open/return the newly created & copied disk container */
         }
-    return (FILE *)Handle;
-    }
-_set_errno_from_status (GetLastError ());
-return NULL;
-}
-
-static int sim_os_disk_close_raw (FILE *f)
-{
-if (!CloseHandle ((HANDLE)f)) {
-    _set_errno_from_status (GetLastError ());
-    return EOF;
     }
-return 0;
-}
+else
+    if (sim_switches & SWMASK ('M')) {                 /* merge difference disk? */
+        char gbuf[CBUFSIZE], *Parent = NULL;
+        FILE *vhd;
 
-static void sim_os_disk_flush_raw (FILE *f)
-{
-FlushFileBuffers ((HANDLE)f);
-}
+        sim_switches = sim_switches & ~(SWMASK ('M'));
+        get_glyph_nc (cptr, gbuf, 0);                  /* get spec */
+        vhd = sim_vhd_disk_merge (gbuf, &Parent);
+        if (vhd) {
+            t_stat r;
 
-static t_offset sim_os_disk_size_raw (FILE *Disk)
-{
-DWORD IoctlReturnSize;
-LARGE_INTEGER Size;
+            sim_vhd_disk_close (vhd);
+            r = sim_disk_attach (uptr, Parent, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay);
+            free (Parent);
+            return r;
+            }
+        return SCPE_ARG;
+        }
 
-if (GetFileSizeEx((HANDLE)Disk, &Size))
-    return (t_offset)(Size.QuadPart);
-#ifdef IOCTL_STORAGE_READ_CAPACITY
-if (1) {
-    STORAGE_READ_CAPACITY S;
-
-    ZeroMemory (&S, sizeof (S));
-    S.Version = sizeof (STORAGE_READ_CAPACITY);
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_STORAGE_READ_CAPACITY,      /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &S,                      /* output buffer */
-                         (DWORD) sizeof(S),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        return (t_offset)(S.DiskLength.QuadPart);
-    }
-#endif
-#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY_EX
-if (1) {
-    DISK_GEOMETRY_EX G;
-
-    ZeroMemory (&G, sizeof (G));
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &G,                      /* output buffer */
-                         (DWORD) sizeof(G),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        return (t_offset)(G.DiskSize.QuadPart);
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_AUTO:                                   /* SIMH format */
+        auto_format = TRUE;
+        if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD */
+            sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
+            sim_vhd_disk_close (uptr->fileref);         /* close vhd file*/
+            uptr->fileref = NULL;
+            open_function = sim_vhd_disk_open;
+            break;
+            }
+        if (sim_simhx_disk_is_container (cptr)) {       /* Try SIMHX */
+            sim_disk_set_fmt (uptr, 0, "SIMHX", NULL);  /* set file format to SIMHX */
+            open_function = sim_simhx_disk_open;
+            break;
+            }
+        while (tmp_size < sector_size)
+            tmp_size <<= 1;
+        if (tmp_size ==  sector_size) {                     /* Power of 2 sector size can do RAW */
+            if (NULL != (uptr->fileref = sim_os_disk_open_raw (cptr, "rb"))) {
+                sim_disk_set_fmt (uptr, 0, "RAW", NULL);    /* set file format to RAW */
+                sim_os_disk_close_raw (uptr->fileref);      /* close raw file*/
+                open_function = sim_os_disk_open_raw;
+                storage_function = sim_os_disk_info_raw;
+                uptr->fileref = NULL;
+                break;
+                }
+            }
+        sim_disk_set_fmt (uptr, 0, "SIMH", NULL);       /* set file format to SIMH */
+        open_function = sim_fopen;
+        break;
+    case DKUF_F_STD:                                    /* SIMH format */
+        if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD first */
+            sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
+            sim_vhd_disk_close (uptr->fileref);         /* close vhd file*/
+            uptr->fileref = NULL;
+            open_function = sim_vhd_disk_open;
+            auto_format = TRUE;
+            break;
+            }
+        if (sim_simhx_disk_is_container (cptr)) {       /* Then SIMHX */
+            sim_disk_set_fmt (uptr, 0, "SIMHX", NULL);  /* set file format to SIMHX */
+            open_function = sim_simhx_disk_open;
+            auto_format = TRUE;
+            break;
+            }
+        open_function = sim_fopen;
+        break;
+    case DKUF_F_VHD:                                    /* VHD format */
+        open_function = sim_vhd_disk_open;
+        create_function = sim_vhd_disk_create;
+        storage_function = sim_os_disk_info_raw;
+        break;
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+        open_function = sim_simhx_disk_open;
+        create_function = sim_simhx_disk_create;
+        break;
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+        if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD first */
+            sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
+            sim_vhd_disk_close (uptr->fileref);         /* close vhd file*/
+            uptr->fileref = NULL;
+            open_function = sim_vhd_disk_open;
+            auto_format = TRUE;
+            break;
+            }
+        open_function = sim_os_disk_open_raw;
+        storage_function = sim_os_disk_info_raw;
+        break;
+    default:
+        return SCPE_IERR;
     }
-#endif
-#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY
-if (1) {
-    DISK_GEOMETRY G;
-
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_DISK_GET_DRIVE_GEOMETRY,    /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &G,                      /* output buffer */
-                         (DWORD) sizeof(G),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        return (t_offset)(G.Cylinders.QuadPart*G.TracksPerCylinder*G.SectorsPerTrack*G.BytesPerSector);
+uptr->filename = (char *) calloc (CBUFSIZE, sizeof (char));/* alloc name buf */
+uptr->disk_ctx = ctx = (struct disk_context *)calloc(1, sizeof(struct disk_context));
+if ((uptr->filename == NULL) || (uptr->disk_ctx == NULL))
+    return _err_return (uptr, SCPE_MEM);
+strlcpy (uptr->filename, cptr, CBUFSIZE);               /* save name */
+ctx->sector_size = (uint32)sector_size;                 /* save sector_size */
+ctx->capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* save capacity units (quadword: 8, word: 2, byte: 1) */
+ctx->xfer_element_size = (uint32)xfer_element_size;     /* save xfer_element_size */
+ctx->dptr = dptr;                                       /* save DEVICE pointer */
+ctx->dbit = dbit;                                       /* save debug bit */
+ctx->media_removed = 0;                                 /* default present */
+sim_debug_unit (ctx->dbit, uptr, "sim_disk_attach(unit=%d,filename='%s')\n", (int)(uptr - ctx->dptr->units), uptr->filename);
+ctx->auto_format = auto_format;                         /* save that we auto selected format */
+ctx->storage_sector_size = (uint32)sector_size;         /* Default */
+if ((sim_switches & SWMASK ('R')) ||                    /* read only? */
+    ((uptr->flags & UNIT_RO) != 0)) {
+    if (((uptr->flags & UNIT_ROABLE) == 0) &&           /* allowed? */
+        ((uptr->flags & UNIT_RO) == 0))
+        return sim_messagef (_err_return (uptr, SCPE_NORO), "%s: Read Only operation not allowed\n", /* no, error */
+                                                        sim_uname (uptr));
+    uptr->fileref = open_function (cptr, "rb");         /* open rd only */
+    if (uptr->fileref == NULL)                          /* open fail? */
+        return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Can't open '%s': %s\n", /* yes, error */
+                                            sim_uname (uptr), cptr, strerror (errno));
+    uptr->flags = uptr->flags | UNIT_RO;                /* set rd only */
+    sim_messagef (SCPE_OK, "%s: Unit is read only\n", sim_uname (uptr));
     }
-#endif
-_set_errno_from_status (GetLastError ());
-return (t_offset)-1;
-}
-
-static t_stat sim_os_disk_unload_raw (FILE *Disk)
-{
-#ifdef IOCTL_STORAGE_EJECT_MEDIA
-DWORD BytesReturned;
-uint32 Removable = FALSE;
+else {                                                  /* normal */
+    uptr->fileref = open_function (cptr, "rb+");        /* open r/w */
+    if (uptr->fileref == NULL) {                        /* open fail? */
+        if ((errno == EROFS) || (errno == EACCES)) {    /* read only? */
+            if ((uptr->flags & UNIT_ROABLE) == 0)       /* allowed? */
+                return sim_messagef (_err_return (uptr, SCPE_NORO), "%s: Read Only operation not allowed\n", /* no, error */
+                                                                sim_uname (uptr));
+            uptr->fileref = open_function (cptr, "rb"); /* open rd only */
+            if (uptr->fileref == NULL)                  /* open fail? */
+                return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Can't open '%s': %s\n", /* yes, error */
+                                                    sim_uname (uptr), cptr, strerror (errno));
+            uptr->flags = uptr->flags | UNIT_RO;        /* set rd only */
+            sim_messagef (SCPE_OK, "%s: Unit is read only\n", sim_uname (uptr));
+            }
+        else {                                          /* other error? */
+            if ((sim_switches & SWMASK ('E')) ||        /* must exist? */
+                (errno != ENOENT))                      /* or must not re-create? */
+                return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Cannot open '%s' - %s\n",
+                                     sim_uname (uptr), cptr, strerror (errno));
+            if (create_function)
+                uptr->fileref = create_function (cptr, ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1));/* create new file */
+            else
+                uptr->fileref = open_function (cptr, "wb+");/* open new file */
+            if (uptr->fileref == NULL)                  /* open fail? */
+                return sim_messagef (_err_return (uptr, SCPE_OPENERR), "%s: Cannot create '%s' - %s\n",
+                                     sim_uname (uptr), cptr, strerror (errno));
+            sim_messagef (SCPE_OK, "%s: Creating new file: %s\n", sim_uname (uptr), cptr);
+            created = TRUE;
+            }
+        }                                               /* end if null */
+    }                                                   /* end else */
+if ((DK_GET_FMT (uptr) == DKUF_F_SIMHX) && created && dtype)
+    sim_simhx_disk_set_dtype (uptr->fileref, dtype, ctx->sector_size, ctx->xfer_element_size, dptr->name);
+(void)get_disk_footer (uptr);
+if ((DK_GET_FMT (uptr) == DKUF_F_VHD) || (ctx->footer)) {
+    uint32 container_sector_size = 0, container_xfer_element_size = 0, container_sectors = 0;
+    char created_name[64];
+    const char *container_dtype = ctx->footer ? (char *)ctx->footer->DriveType : sim_vhd_disk_get_dtype (uptr->fileref, &container_sector_size, &container_xfer_element_size, created_name, NULL);
 
-sim_os_disk_info_raw (Disk, NULL, &Removable, NULL);
-if (Removable) {
-    if (!DeviceIoControl((HANDLE)Disk,                  /* handle to disk */
-                         IOCTL_STORAGE_EJECT_MEDIA,     /* dwIoControlCode */
-                         NULL,                          /* lpInBuffer */
-                         0,                             /* nInBufferSize */
-                         NULL,                          /* lpOutBuffer */
-                         0,                             /* nOutBufferSize */
-                         (LPDWORD) &BytesReturned,      /* number of bytes returned */
-                         (LPOVERLAPPED) NULL)) {        /* OVERLAPPED structure */
-        _set_errno_from_status (GetLastError ());
-        return SCPE_IOERR;
+    if (ctx->footer) {
+        container_sector_size = NtoHl (ctx->footer->SectorSize);
+        container_sectors = NtoHl (ctx->footer->SectorCount);
+        xfer_element_size = NtoHl (ctx->footer->TransferElementSize);
+        strlcpy (created_name, (char *)ctx->footer->CreatingSimulator, sizeof (created_name));
         }
-    }
-return SCPE_OK;
-#else
-return SCPE_NOFNC;
-#endif
-}
-
-static t_bool sim_os_disk_isavailable_raw (FILE *Disk)
-{
-#ifdef IOCTL_STORAGE_EJECT_MEDIA
-DWORD BytesReturned;
-uint32 Removable = FALSE;
-
-sim_os_disk_info_raw (Disk, NULL, &Removable, NULL);
-if (Removable) {
-    if (!DeviceIoControl((HANDLE)Disk,                  /* handle to disk */
-                         IOCTL_STORAGE_CHECK_VERIFY,    /* dwIoControlCode */
-                         NULL,                          /* lpInBuffer */
-                         0,                             /* nInBufferSize */
-                         NULL,                          /* lpOutBuffer */
-                         0,                             /* nOutBufferSize */
-                         (LPDWORD) &BytesReturned,      /* number of bytes returned */
-                         (LPOVERLAPPED) NULL)) {        /* OVERLAPPED structure */
-        _set_errno_from_status (GetLastError ());
-        return FALSE;
+    if ((DK_GET_FMT (uptr) == DKUF_F_VHD) && created && dtype) {
+        sim_vhd_disk_set_dtype (uptr->fileref, dtype, ctx->sector_size, ctx->xfer_element_size);
+        (void)get_disk_footer (uptr);
+        container_dtype = (char *)ctx->footer->DriveType;
         }
-    }
-#endif
-return TRUE;
-}
+    if (dtype) {
+        char cmd[32];
+        t_stat r = SCPE_OK;
 
-static t_stat sim_os_disk_info_raw (FILE *Disk, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom)
-{
-DWORD IoctlReturnSize;
-STORAGE_DEVICE_NUMBER Device;
+        if ((strcmp (container_dtype, dtype) == 0) ||
+            (((container_sector_size == 0) || (container_sector_size == ctx->sector_size)) &&
+             ((container_xfer_element_size == 0) || (container_xfer_element_size == ctx->xfer_element_size)))) {
+            if (strcmp (container_dtype, dtype) != 0) {
+                if ((drivetypes != NULL) || (!dontchangecapac)) { /* Autosize allowed */
+                    snprintf (cmd, sizeof (cmd), "%s %s", sim_uname (uptr), container_dtype);
+                    r = set_cmd (0, cmd);
+                    if (r != SCPE_OK)
+                        r = sim_messagef (SCPE_INCOMPDSK, "%s: Cannot set to drive type %s\n", sim_uname (uptr), container_dtype);
+                    }
+                current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
+                if (ctx->container_size > current_unit_size) {
+                    if ((uptr->flags & UNIT_RO) != 0)                   /* Not Opening read only? */
+                        r = sim_messagef (SCPE_OK, "%s: Read Only access to inconsistent drive type allowed\n", sim_uname (uptr));
+                    else
+                        r = sim_messagef (SCPE_INCOMPDSK, "%s: '%s' can only be attached Read Only\n", sim_uname (uptr), cptr);
+                    }
+                }
+            else { /* Type already matches, Need to confirm compatibility */
+                t_addr saved_capac = uptr->capac;
+                t_lba current_unit_sectors = (t_lba)((dptr->flags & DEV_SECTORS) ? uptr->capac : (uptr->capac*ctx->capac_factor)/ctx->sector_size);
 
-ZeroMemory (&Device, sizeof (Device));
-DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                IOCTL_STORAGE_GET_DEVICE_NUMBER,  /* dwIoControlCode */
-                NULL,                             /* lpInBuffer */
-                0,                                /* nInBufferSize */
-                (LPVOID) &Device,                 /* output buffer */
-                (DWORD) sizeof(Device),           /* size of output buffer */
-                (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                (LPOVERLAPPED) NULL);             /* OVERLAPPED structure */
-
-if (sector_size)
-    *sector_size = 512;
-if (removable)
-    *removable = 0;
-if (is_cdrom)
-    *is_cdrom = (Device.DeviceType == FILE_DEVICE_CD_ROM) || (Device.DeviceType == FILE_DEVICE_DVD);
-#ifdef IOCTL_STORAGE_READ_CAPACITY
-if (1) {
-    STORAGE_READ_CAPACITY S;
-
-    ZeroMemory (&S, sizeof (S));
-    S.Version = sizeof (STORAGE_READ_CAPACITY);
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_STORAGE_READ_CAPACITY,      /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &S,                      /* output buffer */
-                         (DWORD) sizeof(S),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        if (sector_size)
-            *sector_size = S.BlockLength;
-    }
-#endif
-#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY_EX
-if (1) {
-    DISK_GEOMETRY_EX G;
+                if ((container_sector_size != 0) && (sector_size != container_sector_size))
+                    r = sim_messagef (SCPE_OPENERR, "%s: Incompatible Container Sector Size %d\n", sim_uname (uptr), container_sector_size);
+                else {
+                    if (dontchangecapac &&
+                        ((((t_lba)(ctx->container_size/sector_size) > current_unit_sectors)) ||
+                         ((container_sectors != 0) && (container_sectors != current_unit_sectors)))) {
+                         r = sim_messagef (SCPE_OK, "%s: Container has %u sectors, drive has: %u sectors\n", sim_uname (uptr), container_sectors, current_unit_sectors);
+                         if (container_sectors != 0)
+                             r = sim_messagef (SCPE_INCOMPDSK, "%s: %s container created by the %s simulator is incompatible with the %s device on the %s simulator\n", sim_uname (uptr), container_dtype, created_name, uptr->dptr->name, sim_name);
+                         else
+                             r = sim_messagef (SCPE_INCOMPDSK, "%s: disk container %s is incompatible with the %s device\n", sim_uname (uptr), uptr->filename, uptr->dptr->name);
+                         if ((uptr->flags & UNIT_RO) != 0)
+                             r = sim_messagef (SCPE_OK, "%s: Read Only access to incompatible %s container '%s' allowed\n", sim_uname (uptr), container_dtype, uptr->filename);
+                         if (container_sectors < current_unit_sectors) {
+                             r = sim_messagef (SCPE_BARE_STATUS (r), "%s: Since the container is smaller than the drive, this might be useful:\n", sim_uname (uptr));
+                             r = sim_messagef (SCPE_BARE_STATUS (r), "%s:   sim> ATTACH %s -C New-%s %s\n", sim_uname (uptr), sim_uname (uptr), uptr->filename, uptr->filename);
+                             }
+                        }
+                    }
+                if (r == SCPE_OK) {
+                    int32 saved_show_message = sim_show_message;
 
-    ZeroMemory (&G, sizeof (G));
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &G,                      /* output buffer */
-                         (DWORD) sizeof(G),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        if (sector_size)
-            *sector_size = G.Geometry.BytesPerSector;
+                    snprintf (cmd, sizeof (cmd), "%s %s", sim_uname (uptr), container_dtype);
+                    set_cmd (0, "NOMESSAGE");
+                    set_cmd (0, cmd);
+                    sim_show_message = saved_show_message;
+                    }
+                }
+            if (r == SCPE_OK)
+                autosized = TRUE;
+            }
+        else
+            r = sim_messagef (SCPE_INCOMPDSK, "%s: %s container created by the %s simulator is incompatible with the %s device on the %s simulator\n", sim_uname (uptr), container_dtype, created_name, uptr->dptr->name, sim_name);
+        if (r != SCPE_OK) {
+            uptr->flags |= UNIT_ATT;
+            sim_disk_detach (uptr);                         /* report error now */
+            sprintf (cmd, "%s%d %s", dptr->name, (int)(uptr-dptr->units), dtype);/* restore original dtype */
+            set_cmd (0, cmd);
+            return r;
+            }
+        }
     }
-#endif
-#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY
-if (1) {
-    DISK_GEOMETRY G;
+uptr->flags |= UNIT_ATT;
+uptr->pos = 0;
 
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_DISK_GET_DRIVE_GEOMETRY,    /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &G,                      /* output buffer */
-                         (DWORD) sizeof(G),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        if (sector_size)
-            *sector_size = G.BytesPerSector;
-    }
-#endif
-#ifdef IOCTL_STORAGE_GET_HOTPLUG_INFO
-if (1) {
-    STORAGE_HOTPLUG_INFO H;
+/* Get Device attributes if they are available */
+if (storage_function)
+    storage_function (uptr->fileref, &ctx->storage_sector_size, &ctx->removable, &ctx->is_cdrom);
 
-    ZeroMemory (&H, sizeof (H));
-    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
-                         IOCTL_STORAGE_GET_HOTPLUG_INFO,   /* dwIoControlCode */
-                         NULL,                             /* lpInBuffer */
-                         0,                                /* nInBufferSize */
-                         (LPVOID) &H,                      /* output buffer */
-                         (DWORD) sizeof(H),                /* size of output buffer */
-                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
-                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
-        if (removable)
-            *removable = H.MediaRemovable;
-    }
-#endif
-return SCPE_OK;
-}
+if ((created) && (!copied)) {
+    t_stat r = SCPE_OK;
+    uint8 *secbuf = (uint8 *)calloc (128, ctx->sector_size);     /* alloc temp sector buf */
 
-static t_stat sim_os_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
-{
-OVERLAPPED pos;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-long long addr = ((long long)lba) * ctx->sector_size;
-DWORD bytestoread = sects * ctx->sector_size;
+    /*
+       On a newly created disk, we write zeros to the whole disk.
+       This serves 3 purposes:
+         1) it avoids strange allocation delays writing newly allocated
+            storage at the end of the disk during simulator operation
+         2) it allocates storage for the whole disk at creation time to
+            avoid strange failures which may happen during simulator execution
+            if the containing disk is full
+         3) it leaves a Simh Format disk at the intended size so it may
+            subsequently be autosized with the correct size.
+    */
+    if (secbuf == NULL)
+        r = SCPE_MEM;
+    if (r == SCPE_OK) { /* Write all blocks */
+        t_lba lba;
+        t_lba total_lbas = (t_lba)((((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1))/ctx->sector_size);
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
-if (sectsread)
-    *sectsread = 0;
-memset (&pos, 0, sizeof (pos));
-while (bytestoread) {
-    DWORD bytesread;
-    DWORD sectorbytes;
+        for (lba = 0; (r == SCPE_OK) && (lba < total_lbas); lba += 128) {
+            t_seccnt sectors = ((lba + 128) <= total_lbas) ? 128 : total_lbas - lba;
 
-    pos.Offset = (DWORD)addr;
-    pos.OffsetHigh = (DWORD)(addr >> 32);
-    if (!ReadFile ((HANDLE)(uptr->fileref), buf, bytestoread, &bytesread, &pos)) {
-        if (ERROR_HANDLE_EOF == GetLastError ()) {  /* Return 0's for reads past EOF */
-            memset (buf, 0, bytestoread);
-            if (sectsread)
-                *sectsread += bytestoread / ctx->sector_size;
-            return SCPE_OK;
+            r = sim_disk_wrsect (uptr, lba, secbuf, NULL, sectors);
             }
-        _set_errno_from_status (GetLastError ());
-        return SCPE_IOERR;
         }
-    sectorbytes = (bytesread / ctx->sector_size) * ctx->sector_size;
-    if (bytesread > sectorbytes) {
-        memset (buf + bytesread, 0, bytestoread - bytesread);
-        sectorbytes += ctx->sector_size;
+    free (secbuf);
+    if (r != SCPE_OK) {
+        sim_disk_detach (uptr);                         /* report error now */
+        (void)remove (cptr);                            /* remove the created file */
+        return SCPE_OPENERR;
         }
-    if (sectsread)
-        *sectsread += sectorbytes / ctx->sector_size;
-    bytestoread -= sectorbytes;
-    buf +=  sectorbytes;
-    addr += sectorbytes;
-    }
-return SCPE_OK;
-}
-
-static t_stat sim_os_disk_read (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *bytesread, uint32 bytes)
-{
-OVERLAPPED pos;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+    if (sim_switches & SWMASK ('I')) {                  /* Initialize To Sector Address */
+        size_t init_buf_size = 1024*1024;
+        uint8 *init_buf = (uint8*) malloc (init_buf_size);
+        t_lba lba, sect;
+        uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
+        t_seccnt sectors_per_buffer = (t_seccnt)((init_buf_size)/sector_size);
+        t_lba total_sectors = (t_lba)((uptr->capac*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? 512 : 1)));
+        t_seccnt sects = sectors_per_buffer;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_read(unit=%d, addr=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+        if (!init_buf) {
+            sim_disk_detach (uptr);                         /* report error now */
+            (void)remove (cptr);
+            return SCPE_MEM;
+            }
+        sim_messagef (SCPE_OK, "Initializing %u sectors each %u bytes in size with the sector address\n", (uint32)total_sectors, (uint32)sector_size);
+        for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects) {
+            t_seccnt sects_written;
 
-memset (&pos, 0, sizeof (pos));
-pos.Offset = (DWORD)addr;
-pos.OffsetHigh = (DWORD)(addr >> 32);
-if (ReadFile ((HANDLE)(uptr->fileref), buf, (DWORD)bytes, (LPDWORD)bytesread, &pos))
-    return SCPE_OK;
-if (ERROR_HANDLE_EOF == GetLastError ()) {  /* Return 0's for reads past EOF */
-    memset (buf, 0, bytes);
-    if (bytesread)
-        *bytesread = bytes;
-    return SCPE_OK;
+            sects = sectors_per_buffer;
+            if (lba + sects > total_sectors)
+                sects = total_sectors - lba;
+            for (sect = 0; sect < sects; sect++) {
+                t_lba offset;
+                for (offset = 0; offset < sector_size; offset += sizeof(uint32))
+                    *((uint32 *)&init_buf[sect*sector_size + offset]) = (uint32)(lba + sect);
+                }
+            r = sim_disk_wrsect (uptr, lba, init_buf, &sects_written, sects);
+            if ((r != SCPE_OK) || (sects != sects_written)) {
+                free (init_buf);
+                sim_disk_detach (uptr);                         /* report error now */
+                (void)remove (cptr);                            /* remove the created file */
+                return sim_messagef (SCPE_OPENERR, "Error initializing each sector with its address: %s\n",
+                                                   (r == SCPE_OK) ? sim_error_text (r) : "sectors written not what was requested");
+                }
+            sim_messagef (SCPE_OK, "%s: Initialized To Sector Address %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)(lba + sects_written), (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
+            }
+        sim_messagef (SCPE_OK, "%s: Initialized To Sector Address %u sectors.  100%% complete.       \n", sim_uname (uptr), (uint32)total_sectors);
+        free (init_buf);
+        }
+    if (pdp11tracksize)
+        sim_disk_pdp11_bad_block (uptr, pdp11tracksize, sector_size/sizeof(uint16));
     }
-_set_errno_from_status (GetLastError ());
-return SCPE_IOERR;
-}
+if (sim_switches & SWMASK ('K')) {
+    t_stat r = SCPE_OK;
+    t_lba lba, sect;
+    uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (word: 2, byte: 1) */
+    t_seccnt sectors_per_buffer = (t_seccnt)((1024*1024)/sector_size);
+    t_lba total_sectors = (t_lba)((uptr->capac*capac_factor)/(sector_size/((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+    t_seccnt sects = sectors_per_buffer;
+    t_seccnt sects_verify;
+    uint8 *verify_buf = (uint8*) malloc (1024*1024);
 
-static t_stat sim_os_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
-{
-OVERLAPPED pos;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-long long addr;
-DWORD byteswritten;
-DWORD bytestowrite = sects * ctx->sector_size;
-
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+    if (!verify_buf) {
+        sim_disk_detach (uptr);                         /* report error now */
+        return SCPE_MEM;
+        }
+    for (lba = 0; (lba < total_sectors) && (r == SCPE_OK); lba += sects_verify) {
+        sects = sectors_per_buffer;
+        if (lba + sects > total_sectors)
+            sects = total_sectors - lba;
+        r = sim_disk_rdsect (uptr, lba, verify_buf, &sects_verify, sects);
+        if (r == SCPE_OK) {
+            if (sects != sects_verify)
+                sim_printf ("\n%s: Verification Error when reading lbn %d(0x%X) of %d(0x%X) Requested %u sectors, read %u sectors.\n",
+                            sim_uname (uptr), (int)lba, (int)lba, (int)total_sectors, (int)total_sectors, sects, sects_verify);
+            for (sect = 0; sect < sects_verify; sect++) {
+                t_lba offset;
+                t_bool sect_error = FALSE;
 
-if (sectswritten)
-    *sectswritten = 0;
-addr = ((long long)lba) * ctx->sector_size;
-memset (&pos, 0, sizeof (pos));
-while (bytestowrite) {
-    DWORD sectorbytes;
+                for (offset = 0; offset < sector_size; offset += sizeof(uint32)) {
+                    if (*((uint32 *)&verify_buf[sect*sector_size + offset]) != (uint32)(lba + sect)) {
+                        sect_error = TRUE;
+                        break;
+                        }
+                    }
+                if (sect_error) {
+                    uint32 save_dctrl = dptr->dctrl;
+                    FILE *save_sim_deb = sim_deb;
 
-    pos.Offset = (DWORD)addr;
-    pos.OffsetHigh = (DWORD)(addr >> 32);
-    if (!WriteFile ((HANDLE)(uptr->fileref), buf, bytestowrite, &byteswritten, &pos)) {
-        _set_errno_from_status (GetLastError ());
-        return SCPE_IOERR;
+                    sim_printf ("\n%s: Verification Error on lbn %d(0x%X) of %d(0x%X).\n", sim_uname (uptr), (int)(lba+sect), (int)(lba+sect), (int)total_sectors, (int)total_sectors);
+                    dptr->dctrl = 0xFFFFFFFF;
+                    sim_deb = stdout;
+                    sim_disk_data_trace (uptr, verify_buf+sect*sector_size, lba+sect, sector_size,    "Found", TRUE, 1);
+                    dptr->dctrl = save_dctrl;
+                    sim_deb = save_sim_deb;
+                    }
+                }
+            }
+        sim_messagef (SCPE_OK, "%s: Verified containing Sector Address %u/%u sectors.  %d%% complete.\r", sim_uname (uptr), (uint32)lba, (uint32)total_sectors, (int)((((float)lba)*100)/total_sectors));
         }
-    if (sectswritten)
-        *sectswritten += byteswritten / ctx->sector_size;
-    sectorbytes = (byteswritten / ctx->sector_size) * ctx->sector_size;
-    bytestowrite -= sectorbytes;
-    if (bytestowrite == 0)
-        break;
-    buf += sectorbytes;
-    addr += sectorbytes;
+    sim_messagef (SCPE_OK, "%s: Verified containing Sector Address %u sectors.  100%% complete.         \n", sim_uname (uptr), (uint32)lba);
+    free (verify_buf);
+    uptr->dynflags |= UNIT_DISK_CHK;
     }
-return SCPE_OK;
-}
 
-static t_stat sim_os_disk_write (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *byteswritten, uint32 bytes)
-{
-OVERLAPPED pos;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+if (get_disk_footer (uptr) != SCPE_OK) {
+    sim_disk_detach (uptr);
+    return SCPE_OPENERR;
+    }
+filesystem_size = get_filesystem_size (uptr, NULL);
+if (filesystem_size != (t_offset)-1)
+    filesystem_size += reserved_sectors * sector_size;
+container_size = sim_disk_size (uptr);
+if ((filesystem_size == (t_offset)-1) &&
+    (ctx->footer != NULL))                      /* The presence of metadata means we already */
+    filesystem_size = ctx->container_size;      /* know the interesting disk size */
+current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
+if (container_size && (container_size != (t_offset)-1)) {
+    if (dontchangecapac) {  /* autosize by changing drive type */
+        t_addr saved_capac = uptr->capac;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_write(unit=%d, lba=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+        if (drivetypes != NULL) {
+            if (filesystem_size != (t_offset)-1) {  /* File System found? */
+                /* Walk through all potential drive types until we find one the right size */
+                while (*drivetypes != NULL) {
+                    char cmd[CBUFSIZE];
+                    t_stat st;
 
-memset (&pos, 0, sizeof (pos));
-pos.Offset = (DWORD)addr;
-pos.OffsetHigh = (DWORD)(addr >> 32);
-if (WriteFile ((HANDLE)(uptr->fileref), buf, bytes, (LPDWORD)byteswritten, &pos))
-    return SCPE_OK;
-_set_errno_from_status (GetLastError ());
-return SCPE_IOERR;
-}
+                    uptr->flags &= ~UNIT_ATT;   /* temporarily mark as un-attached */
+                    sprintf (cmd, "%s %s", sim_uname (uptr), *drivetypes);
+                    st = set_cmd (0, cmd);
+                    uptr->flags |= UNIT_ATT;    /* restore attached indicator */
+                    if (st == SCPE_OK)
+                        current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
+                    if (current_unit_size >= filesystem_size)
+                        break;
+                    ++drivetypes;
+                    }
+            if (filesystem_size > current_unit_size) {
+                t_stat r = SCPE_FSSIZE;
+                char *capac1;
 
-#elif defined (__linux) || defined (__linux__) || defined (__APPLE__)|| defined (__sun) || defined (__sun__) || defined (__hpux) || defined (_AIX)
+                uptr->capac = (t_addr)(filesystem_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+                capac1 = strdup (sprint_capac (dptr, uptr));
+                uptr->capac = saved_capac;
+                r = sim_messagef (r, "%s: The file system on the disk %s is larger than simulated device (%s > %s)\n",
+                                    sim_uname (uptr), cptr, capac1, sprint_capac (dptr, uptr));
+                free (capac1);
+                sim_disk_detach (uptr);
+                return r;
+                }
+            else
+                autosized = TRUE;
+            }
+            else {
+                if (!created && (ctx->footer == NULL)) {
+                    sim_messagef (SCPE_OK, "%s: Amount of data in use in disk container '%s' cannot be determined, skipping autosizing\n", sim_uname (uptr), cptr);
+                    if (container_size > current_unit_size) {
+                        t_stat r = SCPE_FSSIZE;
+                        char *capac1;
 
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-#if defined(HAVE_SYS_IOCTL)
-#include <sys/ioctl.h>
-#endif
-#if defined(HAVE_LINUX_CDROM)
-#include <linux/cdrom.h>
-#endif
+                        uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+                        capac1 = strdup (sprint_capac (dptr, uptr));
+                        uptr->capac = saved_capac;
+                        r = sim_messagef (r, "%s: The disk container '%s' is larger than simulated device (%s > %s)\n",
+                                            sim_uname (uptr), cptr, capac1, sprint_capac (dptr, uptr));
+                        free (capac1);
+                        sim_disk_detach (uptr);
+                        return r;
+                        }
+                    }
+                }
+            }
+        if (filesystem_size != (t_offset)-1) {
+            if (filesystem_size > current_unit_size) {
+                t_stat r = SCPE_FSSIZE;
+                char *capac1;
 
-static t_stat sim_os_disk_implemented_raw (void)
-{
-return sim_toffset_64 ? SCPE_OK : SCPE_NOFNC;
-}
+                uptr->capac = (t_addr)(filesystem_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+                capac1 = strdup (sprint_capac (dptr, uptr));
+                uptr->capac = saved_capac;
+                r = sim_messagef (r, "%s: The file system on the %s disk container is larger than simulated device (%s > %s)\n",
+                                    sim_uname (uptr), cptr, capac1, sprint_capac (dptr, uptr));
+                free (capac1);
+                sim_disk_detach (uptr);
+                return r;
+                }
+            if (filesystem_size == current_unit_size)
+                autosized = TRUE;
+            }
+        if ((container_size != current_unit_size)) {
+            if (container_size < current_unit_size) {
+                if ((DKUF_F_VHD == DK_GET_FMT (uptr)) ||
+                    (DKUF_F_SIMHX == DK_GET_FMT (uptr))) {
+                    t_stat r = SCPE_INCOMPDSK;
+                    const char *container_dtype = ctx->footer ? (const char *)ctx->footer->DriveType : "";
+                    char *capac1;
 
-static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode)
-{
-int mode = 0;
-int fd;
+                    uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+                    capac1 = strdup (sprint_capac (dptr, uptr));
+                    uptr->capac = saved_capac;
+                    r = sim_messagef (r, "%s: non expandable %s%sdisk container '%s' is smaller than simulated device (%s < %s)\n",
+                                        sim_uname (uptr), container_dtype, (*container_dtype != '\0') ? " " : "", cptr, capac1, sprint_capac (dptr, uptr));
+                    free (capac1);
+                    sim_disk_detach (uptr);
+                    return r;
+                    }
+                }
+            else { /* (container_size > current_unit_size) */
+                if (0 == (uptr->flags & UNIT_RO)) {
+                    t_stat r = SCPE_OK;
+                    int32 saved_switches = sim_switches;
+                    const char *container_dtype;
+                    char *capac1;
 
-if (strchr (openmode, 'r') && (strchr (openmode, '+') || strchr (openmode, 'w')))
-    mode = O_RDWR;
-else
-    if (strchr (openmode, 'r'))
-        mode = O_RDONLY;
-#ifdef O_LARGEFILE
-mode |= O_LARGEFILE;
-#endif
-#ifdef O_DSYNC
-mode |= O_DSYNC;
-#endif
-fd = open (rawdevicename, mode, 0);
-if (fd < 0)
-    return (FILE *)NULL;
-return (FILE *)((long)fd);
-}
+                    uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)));
+                    capac1 = strdup (sprint_capac (dptr, uptr));
+                    uptr->capac = saved_capac;
+                    sim_disk_detach (uptr);
+                    sim_switches = SWMASK ('R');
+                    r = sim_disk_attach_ex (uptr, cptr, sector_size, xfer_element_size, dontchangecapac, dbit, dtype, pdp11tracksize, completion_delay, NULL);
+                    container_dtype = ctx->footer ? (const char *)ctx->footer->DriveType : "";
+                    sim_switches = saved_switches;
+                    if (r == SCPE_OK)
+                        r = sim_messagef (SCPE_OK, "%s: %s%sdisk container '%s' is larger than simulated device (%s > %s) Read Only Forced\n",
+                                sim_uname (uptr), container_dtype, (*container_dtype != '\0') ? " " : "", cptr,
+                                capac1, sprint_capac (dptr, uptr));
+                    free (capac1);
+                    return r;
+                    }
+                }
+            }
+        }
+    else {          /* Autosize by changing capacity */
+        if (filesystem_size != (t_offset)-1) {              /* Known file system data size AND */
+            if (filesystem_size >= container_size) {        /*    Data size >= container size? */
+                container_size = filesystem_size +          /*       Use file system data size */
+                             (pdp11tracksize * sector_size);/*       plus any bad block data beyond the file system */
+                autosized = TRUE;
+                }
+            }
+        else {                                              /* Unrecognized file system */
+            if (container_size < current_unit_size)         /*     Use MAX of container or current device size */
+                if ((DKUF_F_VHD != DK_GET_FMT (uptr)) &&    /*     when size can be expanded */
+                    (DKUF_F_SIMHX != DK_GET_FMT (uptr)) &&
+                    (0 == (uptr->flags & UNIT_RO))) {
+                    container_size = current_unit_size;     /*     Use MAX of container or current device size */
+                    autosized = TRUE;
+                    }
+            }
+        uptr->capac = (t_addr)(container_size/(ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1)));  /* update current size */
+        }
+    }
 
-static int sim_os_disk_close_raw (FILE *f)
-{
-return close ((int)((long)f));
-}
-
-static void sim_os_disk_flush_raw (FILE *f)
-{
-fsync ((int)((long)f));
-}
+if ((uptr->flags & UNIT_RO) == 0) {
+    t_bool readonly = FALSE;
+    int32 saved_quiet = sim_quiet;
 
-static t_offset sim_os_disk_size_raw (FILE *f)
-{
-t_offset pos, size;
+    sim_quiet = 1;
+    get_filesystem_size (uptr, &readonly);
+    if (readonly) {                                     /* reattach read only */
+        t_stat r;
 
-pos = (t_offset)lseek ((int)((long)f), (off_t)0, SEEK_CUR);
-size = (t_offset)lseek ((int)((long)f), (off_t)0, SEEK_END);
-if (pos != (t_offset)-1)
-    (void)lseek ((int)((long)f), (off_t)pos, SEEK_SET);
-return size;
-}
+        sim_disk_detach (uptr);                         /* ctx is gone now */
+        sim_switches |= SWMASK ('R');
+        r = sim_disk_attach_ex2 (uptr, cptr, sector_size, xfer_element_size, dontchangecapac,
+                                 dbit, dtype, pdp11tracksize, completion_delay, drivetypes,
+                                 reserved_sectors);
+        sim_quiet = saved_quiet;
+        return r;
+        }
+    sim_quiet = saved_quiet;
+    }
+if (dtype && (created || (autosized && (ctx->footer == NULL))))
+    store_disk_footer (uptr, dtype);
 
-static t_stat sim_os_disk_unload_raw (FILE *f)
-{
-#if defined(CDROM_GET_CAPABILITY) && defined(CDROMEJECT) && defined(CDROMEJECT_SW)
-if (ioctl ((int)((long)f), CDROM_GET_CAPABILITY, NULL) < 0)
-    return SCPE_OK;
-if (ioctl((int)((long)f), CDROM_LOCKDOOR, 0) < 0)
-    return SCPE_IOERR;
-if (ioctl((int)((long)f), CDROMEJECT) < 0)
-    return SCPE_IOERR;
+_sim_disk_map (uptr);                                   /* memory map if wanted */
+if (uptr->disk_cache)                                   /* cache wanted? */
+    _sim_disk_cache_setup (uptr);
+#if defined (SIM_ASYNCH_IO)
+sim_disk_set_async (uptr, completion_delay);
 #endif
-return SCPE_OK;
-}
+uptr->io_flush = _sim_disk_io_flush;
 
-static t_bool sim_os_disk_isavailable_raw (FILE *Disk)
-{
-#if defined(CDROMSTART) && defined(CDROM_GET_CAPABILITY)
-if (ioctl ((int)((long)Disk), CDROM_GET_CAPABILITY, NULL) < 0)
-    return TRUE;
-switch (ioctl((int)((long)Disk), CDROM_DRIVE_STATUS, CDSL_NONE)) {
-    case CDS_NO_INFO:
-    case CDS_NO_DISC:
-    case CDS_TRAY_OPEN:
-    case CDS_DRIVE_NOT_READY:
-    default: /* error */
-        return FALSE;
-    case CDS_DISC_OK:
-        return TRUE;
+if (uptr->flags & UNIT_BUFABLE) {                       /* buffer in memory? */
+    t_seccnt sectsread;
+    t_stat r = SCPE_OK;
+
+    if (uptr->flags & UNIT_MUSTBUF) {                   /* dyn alloc? */
+        uptr->filebuf = calloc ((size_t)(ctx->container_size / ctx->xfer_element_size),
+                                    ctx->xfer_element_size);       /* allocate */
+        uptr->filebuf2 = calloc ((size_t)(ctx->container_size / ctx->xfer_element_size),
+                                    ctx->xfer_element_size);       /* allocate copy */
+        if ((uptr->filebuf == NULL) ||                  /* either failed? */
+            (uptr->filebuf2 == NULL)) {
+            sim_disk_detach (uptr);
+            return SCPE_MEM;                            /* memory allocation error */
+            }
+        }
+    sim_messagef (SCPE_OK, "%s: buffering file in memory\n", sim_uname (uptr));
+    r = sim_disk_rdsect (uptr, 0, (uint8 *)uptr->filebuf, &sectsread, (t_seccnt)(ctx->container_size / ctx->sector_size));
+    if (r != SCPE_OK)
+        return sim_disk_detach (uptr);
+    uptr->hwmark = (sectsread * ctx->sector_size) / ctx->xfer_element_size;
+    memcpy (uptr->filebuf2, uptr->filebuf, (size_t)ctx->container_size);/* save initial contents */
+    uptr->flags |= UNIT_BUF;                            /* mark as buffered */
     }
-#endif
-return TRUE;
+
+return SCPE_OK;
 }
 
-static t_stat sim_os_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+t_stat sim_disk_detach (UNIT *uptr)
 {
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-off_t addr = ((off_t)lba) * ctx->sector_size;
-ssize_t bytesread;
-size_t bytestoread = sects * ctx->sector_size;
+struct disk_context *ctx;
+int (*close_function)(FILE *f);
+FILE *fileref;
+t_bool auto_format;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+if (uptr == NULL)
+    return SCPE_IERR;
+if (!(uptr->flags & UNIT_ATT))
+    return SCPE_UNATT;
 
-if (sectsread)
-    *sectsread = 0;
-while (bytestoread) {
-    size_t sectorbytes;
+ctx = (struct disk_context *)uptr->disk_ctx;
+fileref = uptr->fileref;
 
-    bytesread = pread((int)((long)uptr->fileref), buf, bytestoread, addr);
-    if (bytesread < 0) {
-        return SCPE_IOERR;
+sim_debug_unit (ctx->dbit, uptr, "sim_disk_detach(unit=%d,filename='%s')\n", (int)(uptr - ctx->dptr->units), uptr->filename);
+
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* Simh */
+        close_function = fclose;
+        break;
+    case DKUF_F_VHD:                                    /* Virtual Disk */
+        close_function = sim_vhd_disk_close;
+        break;
+    case DKUF_F_SIMHX:                                  /* Deduplicating Container */
+        close_function = sim_simhx_disk_close;
+        break;
+    case DKUF_F_RAW:                                    /* Physical */
+        close_function = sim_os_disk_close_raw;
+        break;
+    default:
+        return SCPE_IERR;
         }
-    if ((size_t)bytesread < bytestoread) {/* read zeros at/past EOF */
-        memset (buf + bytesread, 0, bytestoread - bytesread);
-        bytesread = bytestoread;
+if (!(uptr->flags & UNIT_ATTABLE))                      /* attachable? */
+    return SCPE_NOATT;
+if (!(uptr->flags & UNIT_ATT))                          /* attached? */
+    return SCPE_OK;
+if (NULL == find_dev_from_unit (uptr))
+    return SCPE_OK;
+
+if (ctx->cache) {                                       /* write back cached data */
+    t_stat r;
+
+#if defined (SIM_ASYNCH_IO)
+    int asynch_io = ctx->asynch_io;
+
+    sim_disk_clr_async (uptr);
+#endif
+    r = _sim_disk_cache_flush (uptr);
+    if ((r != SCPE_OK) &&                               /* failed and */
+        !(sim_switches & SIM_SW_SHUT)) {                /* not shutting down? */
+#if defined (SIM_ASYNCH_IO)
+        if (asynch_io)
+            sim_disk_set_async (uptr, ctx->asynch_io_latency);
+#endif
+        return sim_messagef (r, "%s: Error writing cached data, still attached: %s\n", sim_uname (uptr), sim_error_text (r));
         }
-    sectorbytes = (bytesread / ctx->sector_size) * ctx->sector_size;
-    if ((size_t)bytesread > sectorbytes)
-        sectorbytes += ctx->sector_size;
-    if (sectsread)
-        *sectsread += sectorbytes / ctx->sector_size;
-    bytestoread -= sectorbytes;
-    buf += sectorbytes;
-    addr += sectorbytes;
     }
-return SCPE_OK;
-}
-
-static t_stat sim_os_disk_read (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *rbytesread, uint32 bytes)
-{
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-ssize_t bytesread;
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_read(unit=%d, addr=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+if ((uptr->flags & UNIT_BUF) && (uptr->filebuf)) {
+    uint32 cap = (uptr->hwmark + uptr->dptr->aincr - 1) / uptr->dptr->aincr;
 
-bytesread = pread((int)((long)uptr->fileref), buf, bytes, (off_t)addr);
-if (bytesread < 0) {
-    if (rbytesread)
-        *rbytesread = 0;
-    return SCPE_IOERR;
+    if (((uptr->flags & UNIT_RO) == 0) &&
+        (memcmp (uptr->filebuf, uptr->filebuf2, (size_t)ctx->container_size) != 0)) {
+        sim_messagef (SCPE_OK, "%s: writing buffer to file: %s\n", sim_uname (uptr), uptr->filename);
+        sim_disk_wrsect (uptr, 0, (uint8 *)uptr->filebuf, NULL, (cap + ctx->sector_size - 1) / ctx->sector_size);
+        }
+    if (uptr->flags & UNIT_MUSTBUF) {                   /* dyn alloc? */
+        free (uptr->filebuf);                           /* free buffers */
+        uptr->filebuf = NULL;
+        free (uptr->filebuf2);
+        uptr->filebuf2 = NULL;
+        }
+    uptr->flags = uptr->flags & ~UNIT_BUF;
     }
-if (rbytesread)
-    *rbytesread = bytesread;
-return SCPE_OK;
-}
 
-static t_stat sim_os_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
-{
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-off_t addr = ((off_t)lba) * ctx->sector_size;
-ssize_t byteswritten;
-size_t bytestowrite = sects * ctx->sector_size;
+update_disk_footer (uptr);                              /* Update meta data if highwater has changed */
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+auto_format = ctx->auto_format;
 
-if (sectswritten)
-    *sectswritten = 0;
-while (bytestowrite) {
-    size_t sectorbytes;
+if (uptr->io_flush)
+    uptr->io_flush (uptr);                              /* flush buffered data */
 
-    byteswritten = pwrite((int)((long)uptr->fileref), buf, bytestowrite, addr);
-    if (byteswritten < 0) {
-        return SCPE_IOERR;
-        }
-    if (sectswritten)
-        *sectswritten += byteswritten / ctx->sector_size;
-    sectorbytes = (byteswritten / ctx->sector_size) * ctx->sector_size;
-    bytestowrite -= sectorbytes;
-    if (bytestowrite == 0)
-        break;
-    buf += sectorbytes;
-    addr += sectorbytes;
-    }
+sim_disk_clr_async (uptr);
+_sim_disk_unmap (uptr);
+
+uptr->flags &= ~(UNIT_ATT | UNIT_RO);
+uptr->dynflags &= ~(UNIT_NO_FIO | UNIT_DISK_CHK);
+free (uptr->filename);
+uptr->filename = NULL;
+uptr->fileref = NULL;
+free (ctx->footer);
+_sim_disk_cache_free (uptr);
+#if defined (SIM_ASYNCH_IO)
+free (ctx->ioq);
+#endif
+free (uptr->disk_ctx);
+uptr->disk_ctx = NULL;
+uptr->io_flush = NULL;
+if (auto_format)
+    sim_disk_set_fmt (uptr, 0, "AUTO", NULL);           /* restore file format */
+
+if (close_function (fileref) == EOF)
+    return SCPE_IOERR;
 return SCPE_OK;
 }
 
-static t_stat sim_os_disk_write (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *rbyteswritten, uint32 bytes)
+t_stat sim_disk_attach_help(FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, const char *cptr)
 {
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
-ssize_t byteswritten;
+static struct example_fields {
+    const char *dname;
+    const char *dtype;
+    const char *dsize;
+    const char *dtype2;
+    const char *dsize2;
+    const char *dtype3;
+    const char *dsize3;
+    const char *dtype4;
+    const char *dsize4;
+    } ex_data[] = {
+        {"RQ", "RD54", "159MB", "RX50", "409KB", "RA81", "456MB", "RA92", "1505MB"},
+        {"RP", "RM03",  "33MW", "RM03",  "33MW", "RP07", "258MW", "RM03",  "15MW"},
+        {"RP", "RM03",  "39MW", "RM03",  "39MW", "RP07", "110MW", "RM03",  "15MW"},
+    };
+struct example_fields *ex = &ex_data[0];
 
-sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_write(unit=%d, addr=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+if (strcmp (dptr->name, "RP") == 0)
+    ex = &ex_data[1];
+if (strstr (sim_name, "-10")) {
+    ex = &ex_data[2];
+    if (strstr (sim_name, "PDP") == NULL)
+        ex->dname = "RPA";
+    }
+
+fprintf (st, "%s Disk Attach Help\n\n", dptr->name);
+
+fprintf (st, "Disk container files can be one of several different types:\n\n");
+if (strstr (sim_name, "-10") == NULL) {
+    fprintf (st, "    SIMH   A disk is an unstructured binary file of the size appropriate\n");
+    fprintf (st, "           for the disk drive being simulated accessed by C runtime APIs\n");
+    fprintf (st, "    VHD    Virtual Disk format which is described in the \"Microsoft\n");
+    fprintf (st, "           Virtual Hard Disk (VHD) Image Format Specification\".  The\n");
+    fprintf (st, "           VHD implementation includes support for 1) Fixed (Preallocated)\n");
+    fprintf (st, "           disks, 2) Dynamically Expanding disks, and 3) Differencing disks.\n");
+    fprintf (st, "    SIMHX  Deduplicating container whose data blocks are kept in a store\n");
+    fprintf (st, "           (simhx.store) shared by all SIMHX disks in the same directory\n");
+    fprintf (st, "    RAW    platform specific access to physical disk or CDROM drives\n\n");
+    }
+else {
+    fprintf (st, "    SIMH   A disk is an unstructured binary file of 64bit integers\n"
+                 "           access by C runtime APIs\n");
+    fprintf (st, "    VHD    A disk is an unstructured binary file of 64bit integers\n"
+                 "           contained in a VHD container\n");
+    fprintf (st, "    RAW    A disk is an unstructured binary file of 64bit integers\n"
+                 "           accessed by direct read/write APIs\n");
+    fprintf (st, "    DBD9   Compatible with KLH10 is a packed big endian word\n");
+    fprintf (st, "    DLD9   Compatible with KLH10 is a packed little endian word\n\n");
+    }
+fprintf (st, "Virtual (VHD) Disk  support conforms to the \"Virtual Hard Disk Image Format\n");
+fprintf (st, "Specification\", Version 1.0 October 11, 2006.\n");
+fprintf (st, "Dynamically expanding disks never change their \"Virtual Size\", but they don't\n");
+fprintf (st, "consume disk space on the containing storage until the virtual sectors in the\n");
+fprintf (st, "disk are actually written to (i.e. a 2GB Dynamic disk container file with only\n");
+fprintf (st, "30MB of data will initially be about 30MB in size and this size will grow up to\n");
+fprintf (st, "2GB as different sectors are written to.  The VHD format contains metadata\n");
+fprintf (st, "which describes the drive size and the simh device type in use when the VHD\n");
+fprintf (st, "was created.  This metadata is therefore available whenever that VHD is\n");
+fprintf (st, "attached to an emulated disk device in the future so the device type and\n");
+fprintf (st, "size can be automatically be configured.\n\n");
+if (strstr (sim_name, "-10") == NULL) {
+    fprintf (st, "SIMHX disk containers only hold a map of 4KB disk blocks.  The block data\n");
+    fprintf (st, "is kept, LZ compressed where that helps, in a store in the container's\n");
+    fprintf (st, "directory, and identical blocks are only stored once no matter how many\n");
+    fprintf (st, "disks (or places on a disk) contain them.  Disks copied with ATTACH -C\n");
+    fprintf (st, "to a SIMHX container, and snapshots taken with DISKSNAPSHOT, only consume\n");
+    fprintf (st, "store space as they diverge from their source.  A store may only be used\n");
+    fprintf (st, "by one simulator at a time.  SIMHX containers can't be copied with host\n");
+    fprintf (st, "tools, since the store only counted the original's use of its blocks.\n");
+    fprintf (st, "Deleting a container doesn't release the blocks which only it used until\n");
+    fprintf (st, "the DISKRECLAIM command is run on the store.\n\n");
+    }
+
+if (dptr->numunits > 1) {
+    uint32 i, attachable_count = 0, out_count = 0, skip_count;
+
+    for (i=0; i < dptr->numunits; ++i)
+        if ((dptr->units[i].flags & UNIT_ATTABLE) &&
+            !(dptr->units[i].flags & UNIT_DIS))
+            ++attachable_count;
+    for (i=0; (i < dptr->numunits) && (out_count < 2); ++i)
+        if ((dptr->units[i].flags & UNIT_ATTABLE) &&
+            !(dptr->units[i].flags & UNIT_DIS)) {
+            fprintf (st, "  sim> ATTACH {switches} %s%d diskfile\n", dptr->name, i);
+            ++out_count;
+            }
+    if (attachable_count > 4) {
+        fprintf (st, "       .\n");
+        fprintf (st, "       .\n");
+        fprintf (st, "       .\n");
+        }
+    skip_count = attachable_count - 2;
+    for (i=0; i < dptr->numunits; ++i)
+        if ((dptr->units[i].flags & UNIT_ATTABLE) &&
+            !(dptr->units[i].flags & UNIT_DIS)) {
+            if (skip_count == 0)
+                fprintf (st, "  sim> ATTACH {switches} %s%d diskfile\n", dptr->name, i);
+            else
+                --skip_count;
+            }
+    }
+else
+    fprintf (st, "  sim> ATTACH {switches} %s diskfile\n", dptr->name);
+fprintf (st, "\n%s attach command switches\n", dptr->name);
+fprintf (st, "    -R          Attach Read Only.\n");
+fprintf (st, "    -E          Must Exist (if not specified an attempt to create the indicated\n");
+fprintf (st, "                disk container will be attempted).\n");
+fprintf (st, "    -F          Open the indicated disk container in a specific format (default\n");
+fprintf (st, "                is to autodetect VHD defaulting to RAW if the indicated\n");
+fprintf (st, "                container is not a VHD).\n");
+fprintf (st, "    -I          Initialize newly created disk so that each sector contains its\n");
+fprintf (st, "                sector address\n");
+fprintf (st, "    -K          Verify that the disk contents contain the sector address in each\n");
+fprintf (st, "                sector.  Whole disk checked at attach time and each sector is\n");
+fprintf (st, "                checked when written.\n");
+fprintf (st, "    -C          Create a disk container and copy its contents from another disk\n");
+fprintf (st, "                (simh, VHD, or RAW format).  The current (or specified with -F)\n");
+fprintf (st, "                container format will be the format of the created container.\n");
+fprintf (st, "                AUTO or VHD will create a VHD container, SIMH will create a.\n");
+fprintf (st, "                SIMH container and SIMHX will create a SIMHX container. Add a\n");
+fprintf (st, "                -V switch to verify a copy operation.\n");
+fprintf (st, "                Note: A copy will be performed between dissimilar sized\n");
+fprintf (st, "                containers.  Copying from a larger container to a smaller\n");
+fprintf (st, "                one will produce a truncated result.\n");
+fprintf (st, "    -V          Perform a verification pass to confirm successful data copy\n");
+fprintf (st, "                operation.\n");
+fprintf (st, "    -X          When creating a VHD, create a fixed sized VHD (vs a Dynamically\n");
+fprintf (st, "                expanding one).\n");
+fprintf (st, "    -D          Create a Differencing VHD (relative to an already existing VHD\n");
+fprintf (st, "                disk)\n");
+fprintf (st, "    -M          Merge a Differencing VHD into its parent VHD disk\n");
+fprintf (st, "    -O          Override consistency checks when attaching differencing disks\n");
+fprintf (st, "                which have unexpected parent disk GUID or timestamps\n\n");
+fprintf (st, "    -U          Fix inconsistencies which are overridden by the -O switch\n");
+if (strstr (sim_name, "-10") == NULL) {
+    fprintf (st, "    -Y          Answer Yes to prompt to overwrite last track (on disk create)\n");
+    fprintf (st, "    -N          Answer No to prompt to overwrite last track (on disk create)\n");
+    }
+fprintf (st, "Examples:\n");
+fprintf (st, "  sim> show %s\n", ex->dname);
+fprintf (st, "    %s, address=20001468-2000146B*, no vector, 4 units\n", ex->dname);
+fprintf (st, "    %s0, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize, ex->dtype);
+fprintf (st, "    %s1, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize, ex->dtype);
+fprintf (st, "    %s2, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize, ex->dtype);
+fprintf (st, "    %s3, %s, not attached, write enabled, %s, autosize, AUTO detect format\n", ex->dname, ex->dsize2, ex->dtype2);
+fprintf (st, "  sim> # attach an existing VHD and determine its size and type automatically\n");
+fprintf (st, "  sim> attach %s0 %s.vhd\n", ex->dname, ex->dtype3);
+fprintf (st, "  sim> show %s0\n", ex->dname);
+fprintf (st, "  %s0, %s, attached to %s.vhd, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize3, ex->dtype3, ex->dtype3);
+fprintf (st, "  sim> # create a new %s drive type VHD\n", ex->dtype4);
+fprintf (st, "  sim> set %s2 %s\n", ex->dname, ex->dtype4);
+fprintf (st, "  sim> attach %s2 -f vhd %s.vhd\n", ex->dname, ex->dtype4);
+fprintf (st, "  %s2: creating new file\n", ex->dname);
+fprintf (st, "  sim> show %s2\n", ex->dname);
+fprintf (st, "  %s2, %s, attached to %s.vhd, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize4, ex->dtype4, ex->dtype4);
+fprintf (st, "  sim> # examine the size consumed by the %s VHD file\n", ex->dsize4);
+fprintf (st, "  sim> dir %s.vhd\n", ex->dtype4);
+fprintf (st, "   Directory of H:\\Data\n\n");
+fprintf (st, "  04/14/2011  12:57 PM             5,120 %s.vhd\n", ex->dtype4);
+fprintf (st, "                 1 File(s)          5,120 bytes\n");
+fprintf (st, "  sim> # create a differencing vhd (%s-1-Diff.vhd) with %s.vhd as parent\n", ex->dtype4, ex->dtype4);
+fprintf (st, "  sim> attach %s3 -d %s-1-Diff.vhd %s.vhd\n", ex->dname, ex->dtype4, ex->dtype4);
+fprintf (st, "  sim> # create a VHD (%s-1.vhd) which is a copy of an existing disk\n", ex->dtype4);
+fprintf (st, "  sim> attach %s3 -c %s-1.vhd %s.vhd\n", ex->dname, ex->dtype4, ex->dtype4);
+fprintf (st, "  %s3: creating new virtual disk '%s-1.vhd'\n", ex->dname, ex->dtype4);
+fprintf (st, "  %s3: Copied %s.  99%% complete.\n", ex->dname, ex->dsize4);
+fprintf (st, "  %s3: Copied %s. Done.\n", ex->dname, ex->dsize4);
+fprintf (st, "  sim> show %s3\n", ex->dname);
+fprintf (st, "  %s3, %s, attached to %s-1.vhd, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize4, ex->dtype4, ex->dtype4);
+fprintf (st, "  sim> dir %s*\n", ex->dtype4);
+fprintf (st, "   Directory of H:\\Data\n\n");
+fprintf (st, "  04/14/2011  01:12 PM             5,120 %s-1.vhd\n", ex->dtype4);
+fprintf (st, "  04/14/2011  12:58 PM             5,120 %s.vhd\n", ex->dtype4);
+fprintf (st, "                 2 File(s)         10,240 bytes\n");
+fprintf (st, "  sim> show %s2\n", ex->dname);
+fprintf (st, "  %s2, %s, not attached, write enabled, %s, autosize, VHD format\n", ex->dname, ex->dsize4, ex->dtype4);
+fprintf (st, "  sim> set %s2 %s\n", ex->dname, ex->dtype3);
+fprintf (st, "  sim> set %s2 noauto\n", ex->dname);
+fprintf (st, "  sim> show %s2\n", ex->dname);
+fprintf (st, "  %s2, %s, not attached, write enabled, %s, noautosize, VHD format\n", ex->dname, ex->dsize3, ex->dtype3);
+fprintf (st, "  sim> set %s2 format=simh\n", ex->dname);
+fprintf (st, "  sim> show %s2\n", ex->dname);
+fprintf (st, "  %s2, %s, not attached, write enabled, %s, noautosize, SIMH format\n", ex->dname, ex->dsize3, ex->dtype3);
+fprintf (st, "  sim> # create a VHD from an existing SIMH format disk\n");
+fprintf (st, "  sim> attach %s2 -c %s-Copy.vhd XYZZY.dsk\n", ex->dname, ex->dtype3);
+fprintf (st, "  %s2: creating new virtual disk '%s-Copy.vhd'\n", ex->dname, ex->dtype3);
+fprintf (st, "  %s2: Copied %s.  99%% complete.\n", ex->dname, ex->dsize3);
+fprintf (st, "  %s2: Copied %s. Done.\n", ex->dname, ex->dsize3);
+fprintf (st, "  sim> show %s2\n", ex->dname);
+fprintf (st, "  %s2, %s, attached to %s-Copy.vhd, write enabled, %s, noautosize, VHD format\n", ex->dname, ex->dsize3, ex->dtype3, ex->dtype3);
+return SCPE_OK;
+}
+
+t_bool sim_disk_vhd_support (void)
+{
+return SCPE_OK == sim_vhd_disk_implemented ();
+}
+
+t_bool sim_disk_raw_support (void)
+{
+return SCPE_OK == sim_os_disk_implemented_raw ();
+}
+
+t_stat sim_disk_reset (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (!(uptr->flags & UNIT_ATT))                          /* attached? */
+    return SCPE_OK;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_disk_reset(unit=%d)\n", (int)(uptr - ctx->dptr->units));
+
+_sim_disk_io_flush(uptr);
+AIO_VALIDATE(uptr);
+AIO_UPDATE_QUEUE;
+return SCPE_OK;
+}
+
+t_stat sim_disk_perror (UNIT *uptr, const char *msg)
+{
+int saved_errno = errno;
+
+if (!(uptr->flags & UNIT_ATTABLE))                      /* not attachable? */
+    return SCPE_NOATT;
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* SIMH format */
+    case DKUF_F_VHD:                                    /* VHD format */
+    case DKUF_F_SIMHX:                                  /* SIMHX format */
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+#if defined(_WIN32)
+        saved_errno = GetLastError ();
+#endif
+        perror (msg);
+        sim_printf ("%s %s: %s\n", sim_uname(uptr), msg, sim_get_os_error_text (saved_errno));
+        break;
+    default:
+        ;
+    }
+return SCPE_OK;
+}
+
+t_stat sim_disk_clearerr (UNIT *uptr)
+{
+if (!(uptr->flags & UNIT_ATTABLE))                      /* not attachable? */
+    return SCPE_NOATT;
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* SIMH format */
+        clearerr (uptr->fileref);
+        break;
+    case DKUF_F_VHD:                                    /* VHD format */
+        sim_vhd_disk_clearerr (uptr);
+        break;
+    default:
+        ;
+    }
+return SCPE_OK;
+}
+
+
+/* Factory bad block table creation routine
+
+   This routine writes a DEC standard 144 compliant bad block table on the
+   last track of the specified unit as described in:
+      EL-00144_B_DEC_STD_144_Disk_Standard_for_Recording_and_Handling_Bad_Sectors_Nov76.pdf
+   The bad block table consists of 10 repetitions of the same table,
+   formatted as follows:
+
+        words 0-1       pack id number
+        words 2-3       cylinder/sector/surface specifications
+         :
+        words n-n+1     end of table (-1,-1)
+
+   Inputs:
+        uptr    =       pointer to unit
+        sec     =       number of sectors per surface
+        wds     =       number of words per sector
+   Outputs:
+        sta     =       status code
+*/
+
+t_stat sim_disk_pdp11_bad_block (UNIT *uptr, int32 sec, int32 wds)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+int32 i;
+t_addr da;
+uint16 *buf;
+DEVICE *dptr;
+char *namebuf, *c;
+uint32 packid;
+t_stat stat = SCPE_OK;
+
+if ((sec < 2) || (wds < 16))
+    return SCPE_ARG;
+if ((uptr->flags & UNIT_ATT) == 0)
+    return SCPE_UNATT;
+if ((dptr = find_dev_from_unit (uptr)) == NULL)
+    return SCPE_NOATT;
+if (uptr->flags & UNIT_RO)
+    return SCPE_RO;
+if (!get_yn ("Overwrite last track? [N]", FALSE))
+    return SCPE_OK;
+if ((buf = (uint16 *) malloc (wds * sizeof (uint16))) == NULL)
+    return SCPE_MEM;
+namebuf = uptr->filename;
+if ((c = strrchr (namebuf, '/')))
+    namebuf = c+1;
+if ((c = strrchr (namebuf, '\\')))
+    namebuf = c+1;
+if ((c = strrchr (namebuf, ']')))
+    namebuf = c+1;
+packid = eth_crc32(0, namebuf, strlen (namebuf));
+buf[0] = (uint16)packid;
+buf[1] = (uint16)(packid >> 16) & 0x7FFF;   /* Make sure MSB is clear */
+buf[2] = buf[3] = 0;
+for (i = 4; i < wds; i++)
+    buf[i] = 0177777u;
+da = (uptr->capac*((dptr->flags & DEV_SECTORS) ? 512 : 1)) - (sec * wds);
+for (i = 0; (stat == SCPE_OK) && (i < sec) && (i < 10); i++, da += wds)
+    if (ctx)
+        stat = sim_disk_wrsect (uptr, (t_lba)(da/wds), (uint8 *)buf, NULL, 1);
+    else {
+        if (sim_fseek (uptr->fileref, da, SEEK_SET)) {
+            stat = SCPE_IOERR;
+            break;
+            }
+        if ((size_t)wds != sim_fwrite (buf, sizeof (uint16), wds, uptr->fileref))
+            stat = SCPE_IOERR;
+        }
+free (buf);
+return stat;
+}
+
+void sim_disk_data_trace(UNIT *uptr, const uint8 *data, size_t lba, size_t len, const char* txt, int detail, uint32 reason)
+{
+DEVICE *dptr = find_dev_from_unit (uptr);
+
+if (sim_deb && ((uptr->dctrl | dptr->dctrl) & reason)) {
+    char pos[32];
+
+    sprintf (pos, "lbn: %08X ", (unsigned int)lba);
+    sim_data_trace(dptr, uptr, (detail ? data : NULL), pos, len, txt, reason);
+    }
+}
+
+/* OS Specific RAW Disk I/O support */
+
+#if defined _WIN32
+
+static void _set_errno_from_status (DWORD dwStatus)
+{
+switch (dwStatus) {
+    case ERROR_FILE_NOT_FOUND:    case ERROR_PATH_NOT_FOUND:
+    case ERROR_INVALID_DRIVE:     case ERROR_NO_MORE_FILES:
+    case ERROR_BAD_NET_NAME:      case ERROR_BAD_NETPATH:
+    case ERROR_BAD_PATHNAME:      case ERROR_FILENAME_EXCED_RANGE:
+        errno = ENOENT;
+        return;
+    case ERROR_INVALID_ACCESS:    case ERROR_INVALID_DATA:
+    case ERROR_INVALID_FUNCTION:  case ERROR_INVALID_PARAMETER:
+    case ERROR_NEGATIVE_SEEK:
+        errno = EINVAL;
+        return;
+    case ERROR_ARENA_TRASHED:     case ERROR_NOT_ENOUGH_MEMORY:
+    case ERROR_INVALID_BLOCK:     case ERROR_NOT_ENOUGH_QUOTA:
+        errno = ENOMEM;
+        return;
+    case ERROR_TOO_MANY_OPEN_FILES:
+        errno = EMFILE;
+        return;
+    case ERROR_ACCESS_DENIED:     case ERROR_CURRENT_DIRECTORY:
+    case ERROR_LOCK_VIOLATION:    case ERROR_NETWORK_ACCESS_DENIED:
+    case ERROR_CANNOT_MAKE:       case ERROR_FAIL_I24:
+    case ERROR_DRIVE_LOCKED:      case ERROR_SEEK_ON_DEVICE:
+    case ERROR_NOT_LOCKED:        case ERROR_LOCK_FAILED:
+        errno = EACCES;
+        return;
+    case ERROR_ALREADY_EXISTS:    case ERROR_FILE_EXISTS:
+        errno = EEXIST;
+        return;
+    case ERROR_INVALID_HANDLE:    case ERROR_INVALID_TARGET_HANDLE:
+    case ERROR_DIRECT_ACCESS_HANDLE:
+        errno = EBADF;
+        return;
+    case ERROR_DIR_NOT_EMPTY:
+        errno = ENOTEMPTY;
+        return;
+    case ERROR_BAD_ENVIRONMENT:
+        errno = E2BIG;
+        return;
+    case ERROR_BAD_FORMAT:
+        errno = ENOEXEC;
+        return;
+    case ERROR_NOT_SAME_DEVICE:
+        errno = EXDEV;
+        return;
+    case ERROR_BROKEN_PIPE:
+        errno = EPIPE;
+        return;
+    case ERROR_DISK_FULL:
+        errno = ENOSPC;
+        return;
+    case ERROR_WAIT_NO_CHILDREN:  case ERROR_CHILD_NOT_COMPLETE:
+        errno = ECHILD;
+        return;
+    case ERROR_NO_PROC_SLOTS:     case ERROR_MAX_THRDS_REACHED:
+    case ERROR_NESTING_NOT_ALLOWED:
+        errno = EAGAIN;
+        return;
+    }
+if ((dwStatus >= ERROR_WRITE_PROTECT) && (dwStatus <= ERROR_SHARING_BUFFER_EXCEEDED)) {
+    errno = EACCES;
+    return;
+    }
+if ((dwStatus >= ERROR_INVALID_STARTING_CODESEG) && (dwStatus <= ERROR_INFLOOP_IN_RELOC_CHAIN)) {
+    errno = ENOEXEC;
+    return;
+    }
+errno = EINVAL;
+}
+#if defined(__GNUC__) && defined(HAVE_NTDDDISK_H)
+#include <ddk/ntddstor.h>
+#include <ddk/ntdddisk.h>
+#else
+#include <winioctl.h>
+#endif
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+WINBASEAPI BOOL WINAPI GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+#if defined(__cplusplus)
+    }
+#endif
+
+struct _device_type {
+    int32 Type;
+    const char *desc;
+    } DeviceTypes[] = {
+        {FILE_DEVICE_8042_PORT,             "8042_PORT"},
+        {FILE_DEVICE_ACPI,                  "ACPI"},
+        {FILE_DEVICE_BATTERY,               "BATTERY"},
+        {FILE_DEVICE_BEEP,                  "BEEP"},
+#ifdef FILE_DEVICE_BLUETOOTH
+        {FILE_DEVICE_BLUETOOTH,             "BLUETOOTH"},
+#endif
+        {FILE_DEVICE_BUS_EXTENDER,          "BUS_EXTENDER"},
+        {FILE_DEVICE_CD_ROM,                "CD_ROM"},
+        {FILE_DEVICE_CD_ROM_FILE_SYSTEM,    "CD_ROM_FILE_SYSTEM"},
+        {FILE_DEVICE_CHANGER,               "CHANGER"},
+        {FILE_DEVICE_CONTROLLER,            "CONTROLLER"},
+#ifdef FILE_DEVICE_CRYPT_PROVIDER
+        {FILE_DEVICE_CRYPT_PROVIDER,        "CRYPT_PROVIDER"},
+#endif
+        {FILE_DEVICE_DATALINK,              "DATALINK"},
+        {FILE_DEVICE_DFS,                   "DFS"},
+        {FILE_DEVICE_DFS_FILE_SYSTEM,       "DFS_FILE_SYSTEM"},
+        {FILE_DEVICE_DFS_VOLUME,            "DFS_VOLUME"},
+        {FILE_DEVICE_DISK,                  "DISK"},
+        {FILE_DEVICE_DISK_FILE_SYSTEM,      "DISK_FILE_SYSTEM"},
+        {FILE_DEVICE_DVD,                   "DVD"},
+        {FILE_DEVICE_FILE_SYSTEM,           "FILE_SYSTEM"},
+#ifdef FILE_DEVICE_FIPS
+        {FILE_DEVICE_FIPS,                  "FIPS"},
+#endif
+        {FILE_DEVICE_FULLSCREEN_VIDEO,      "FULLSCREEN_VIDEO"},
+#ifdef FILE_DEVICE_INFINIBAND
+        {FILE_DEVICE_INFINIBAND,            "INFINIBAND"},
+#endif
+        {FILE_DEVICE_INPORT_PORT,           "INPORT_PORT"},
+        {FILE_DEVICE_KEYBOARD,              "KEYBOARD"},
+        {FILE_DEVICE_KS,                    "KS"},
+        {FILE_DEVICE_KSEC,                  "KSEC"},
+        {FILE_DEVICE_MAILSLOT,              "MAILSLOT"},
+        {FILE_DEVICE_MASS_STORAGE,          "MASS_STORAGE"},
+        {FILE_DEVICE_MIDI_IN,               "MIDI_IN"},
+        {FILE_DEVICE_MIDI_OUT,              "MIDI_OUT"},
+        {FILE_DEVICE_MODEM,                 "MODEM"},
+        {FILE_DEVICE_MOUSE,                 "MOUSE"},
+        {FILE_DEVICE_MULTI_UNC_PROVIDER,    "MULTI_UNC_PROVIDER"},
+        {FILE_DEVICE_NAMED_PIPE,            "NAMED_PIPE"},
+        {FILE_DEVICE_NETWORK,               "NETWORK"},
+        {FILE_DEVICE_NETWORK_BROWSER,       "NETWORK_BROWSER"},
+        {FILE_DEVICE_NETWORK_FILE_SYSTEM,   "NETWORK_FILE_SYSTEM"},
+        {FILE_DEVICE_NETWORK_REDIRECTOR,    "NETWORK_REDIRECTOR"},
+        {FILE_DEVICE_NULL,                  "NULL"},
+        {FILE_DEVICE_PARALLEL_PORT,         "PARALLEL_PORT"},
+        {FILE_DEVICE_PHYSICAL_NETCARD,      "PHYSICAL_NETCARD"},
+        {FILE_DEVICE_PRINTER,               "PRINTER"},
+        {FILE_DEVICE_SCANNER,               "SCANNER"},
+        {FILE_DEVICE_SCREEN,                "SCREEN"},
+        {FILE_DEVICE_SERENUM,               "SERENUM"},
+        {FILE_DEVICE_SERIAL_MOUSE_PORT,     "SERIAL_MOUSE_PORT"},
+        {FILE_DEVICE_SERIAL_PORT,           "SERIAL_PORT"},
+        {FILE_DEVICE_SMARTCARD,             "SMARTCARD"},
+        {FILE_DEVICE_SMB,                   "SMB"},
+        {FILE_DEVICE_SOUND,                 "SOUND"},
+        {FILE_DEVICE_STREAMS,               "STREAMS"},
+        {FILE_DEVICE_TAPE,                  "TAPE"},
+        {FILE_DEVICE_TAPE_FILE_SYSTEM,      "TAPE_FILE_SYSTEM"},
+        {FILE_DEVICE_TERMSRV,               "TERMSRV"},
+        {FILE_DEVICE_TRANSPORT,             "TRANSPORT"},
+        {FILE_DEVICE_UNKNOWN,               "UNKNOWN"},
+        {FILE_DEVICE_VDM,                   "VDM"},
+        {FILE_DEVICE_VIDEO,                 "VIDEO"},
+        {FILE_DEVICE_VIRTUAL_DISK,          "VIRTUAL_DISK"},
+#ifdef FILE_DEVICE_VMBUS
+        {FILE_DEVICE_VMBUS,                 "VMBUS"},
+#endif
+        {FILE_DEVICE_WAVE_IN,               "WAVE_IN"},
+        {FILE_DEVICE_WAVE_OUT,              "WAVE_OUT"},
+#ifdef FILE_DEVICE_WPD
+        {FILE_DEVICE_WPD,                   "WPD"},
+#endif
+        {0,                                 NULL}};
+
+static const char *_device_type_name (int DeviceType)
+{
+int i;
+
+for (i=0; DeviceTypes[i].desc; i++)
+    if (DeviceTypes[i].Type == DeviceType)
+        return DeviceTypes[i].desc;
+return "Unknown";
+}
+
+static t_stat sim_os_disk_implemented_raw (void)
+{
+return sim_toffset_64 ? SCPE_OK : SCPE_NOFNC;
+}
+
+static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode)
+{
+HANDLE Handle;
+DWORD DesiredAccess = 0;
+uint32 is_cdrom;
+char *tmpname = (char *)malloc (2 + strlen (rawdevicename));
+
+if (tmpname == NULL)
+    return NULL;
+if (strchr (openmode, 'r'))
+    DesiredAccess |= GENERIC_READ;
+if (strchr (openmode, 'w') || strchr (openmode, '+'))
+    DesiredAccess |= GENERIC_WRITE;
+/* SCP Command Line parsing replaces \\ with \ presuming this is an
+   escape sequence.  This only affects RAW device names and UNC paths.
+   We handle the RAW device name case here by prepending paths beginning
+   with \.\ with an extra \. */
+if ((!memcmp ("\\.\\", rawdevicename, 3)) ||
+    (!memcmp ("/./", rawdevicename, 3))) {
+    *tmpname = '\\';
+    strcpy (tmpname + 1, rawdevicename);
+    }
+else
+    strcpy (tmpname, rawdevicename);
+Handle = CreateFileA (tmpname, DesiredAccess, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS|FILE_FLAG_WRITE_THROUGH, NULL);
+free (tmpname);
+if (Handle != INVALID_HANDLE_VALUE) {
+    if ((sim_os_disk_info_raw ((FILE *)Handle, NULL, NULL, &is_cdrom)) ||
+        ((DesiredAccess & GENERIC_WRITE) && is_cdrom)) {
+        CloseHandle (Handle);
+        errno = EACCES;
+        return NULL;
+        }
+    return (FILE *)Handle;
+    }
+_set_errno_from_status (GetLastError ());
+return NULL;
+}
+
+static int sim_os_disk_close_raw (FILE *f)
+{
+if (!CloseHandle ((HANDLE)f)) {
+    _set_errno_from_status (GetLastError ());
+    return EOF;
+    }
+return 0;
+}
+
+static void sim_os_disk_flush_raw (FILE *f)
+{
+FlushFileBuffers ((HANDLE)f);
+}
+
+static t_offset sim_os_disk_size_raw (FILE *Disk)
+{
+DWORD IoctlReturnSize;
+LARGE_INTEGER Size;
+
+if (GetFileSizeEx((HANDLE)Disk, &Size))
+    return (t_offset)(Size.QuadPart);
+#ifdef IOCTL_STORAGE_READ_CAPACITY
+if (1) {
+    STORAGE_READ_CAPACITY S;
+
+    ZeroMemory (&S, sizeof (S));
+    S.Version = sizeof (STORAGE_READ_CAPACITY);
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_STORAGE_READ_CAPACITY,      /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &S,                      /* output buffer */
+                         (DWORD) sizeof(S),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        return (t_offset)(S.DiskLength.QuadPart);
+    }
+#endif
+#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY_EX
+if (1) {
+    DISK_GEOMETRY_EX G;
+
+    ZeroMemory (&G, sizeof (G));
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &G,                      /* output buffer */
+                         (DWORD) sizeof(G),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        return (t_offset)(G.DiskSize.QuadPart);
+    }
+#endif
+#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY
+if (1) {
+    DISK_GEOMETRY G;
+
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_DISK_GET_DRIVE_GEOMETRY,    /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &G,                      /* output buffer */
+                         (DWORD) sizeof(G),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        return (t_offset)(G.Cylinders.QuadPart*G.TracksPerCylinder*G.SectorsPerTrack*G.BytesPerSector);
+    }
+#endif
+_set_errno_from_status (GetLastError ());
+return (t_offset)-1;
+}
+
+static t_stat sim_os_disk_unload_raw (FILE *Disk)
+{
+#ifdef IOCTL_STORAGE_EJECT_MEDIA
+DWORD BytesReturned;
+uint32 Removable = FALSE;
+
+sim_os_disk_info_raw (Disk, NULL, &Removable, NULL);
+if (Removable) {
+    if (!DeviceIoControl((HANDLE)Disk,                  /* handle to disk */
+                         IOCTL_STORAGE_EJECT_MEDIA,     /* dwIoControlCode */
+                         NULL,                          /* lpInBuffer */
+                         0,                             /* nInBufferSize */
+                         NULL,                          /* lpOutBuffer */
+                         0,                             /* nOutBufferSize */
+                         (LPDWORD) &BytesReturned,      /* number of bytes returned */
+                         (LPOVERLAPPED) NULL)) {        /* OVERLAPPED structure */
+        _set_errno_from_status (GetLastError ());
+        return SCPE_IOERR;
+        }
+    }
+return SCPE_OK;
+#else
+return SCPE_NOFNC;
+#endif
+}
+
+static t_bool sim_os_disk_isavailable_raw (FILE *Disk)
+{
+#ifdef IOCTL_STORAGE_EJECT_MEDIA
+DWORD BytesReturned;
+uint32 Removable = FALSE;
+
+sim_os_disk_info_raw (Disk, NULL, &Removable, NULL);
+if (Removable) {
+    if (!DeviceIoControl((HANDLE)Disk,                  /* handle to disk */
+                         IOCTL_STORAGE_CHECK_VERIFY,    /* dwIoControlCode */
+                         NULL,                          /* lpInBuffer */
+                         0,                             /* nInBufferSize */
+                         NULL,                          /* lpOutBuffer */
+                         0,                             /* nOutBufferSize */
+                         (LPDWORD) &BytesReturned,      /* number of bytes returned */
+                         (LPOVERLAPPED) NULL)) {        /* OVERLAPPED structure */
+        _set_errno_from_status (GetLastError ());
+        return FALSE;
+        }
+    }
+#endif
+return TRUE;
+}
+
+static t_stat sim_os_disk_info_raw (FILE *Disk, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom)
+{
+DWORD IoctlReturnSize;
+STORAGE_DEVICE_NUMBER Device;
+
+ZeroMemory (&Device, sizeof (Device));
+DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                IOCTL_STORAGE_GET_DEVICE_NUMBER,  /* dwIoControlCode */
+                NULL,                             /* lpInBuffer */
+                0,                                /* nInBufferSize */
+                (LPVOID) &Device,                 /* output buffer */
+                (DWORD) sizeof(Device),           /* size of output buffer */
+                (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                (LPOVERLAPPED) NULL);             /* OVERLAPPED structure */
+
+if (sector_size)
+    *sector_size = 512;
+if (removable)
+    *removable = 0;
+if (is_cdrom)
+    *is_cdrom = (Device.DeviceType == FILE_DEVICE_CD_ROM) || (Device.DeviceType == FILE_DEVICE_DVD);
+#ifdef IOCTL_STORAGE_READ_CAPACITY
+if (1) {
+    STORAGE_READ_CAPACITY S;
+
+    ZeroMemory (&S, sizeof (S));
+    S.Version = sizeof (STORAGE_READ_CAPACITY);
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_STORAGE_READ_CAPACITY,      /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &S,                      /* output buffer */
+                         (DWORD) sizeof(S),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        if (sector_size)
+            *sector_size = S.BlockLength;
+    }
+#endif
+#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY_EX
+if (1) {
+    DISK_GEOMETRY_EX G;
+
+    ZeroMemory (&G, sizeof (G));
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &G,                      /* output buffer */
+                         (DWORD) sizeof(G),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        if (sector_size)
+            *sector_size = G.Geometry.BytesPerSector;
+    }
+#endif
+#ifdef IOCTL_DISK_GET_DRIVE_GEOMETRY
+if (1) {
+    DISK_GEOMETRY G;
+
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_DISK_GET_DRIVE_GEOMETRY,    /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &G,                      /* output buffer */
+                         (DWORD) sizeof(G),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        if (sector_size)
+            *sector_size = G.BytesPerSector;
+    }
+#endif
+#ifdef IOCTL_STORAGE_GET_HOTPLUG_INFO
+if (1) {
+    STORAGE_HOTPLUG_INFO H;
+
+    ZeroMemory (&H, sizeof (H));
+    if (DeviceIoControl((HANDLE)Disk,                      /* handle to volume */
+                         IOCTL_STORAGE_GET_HOTPLUG_INFO,   /* dwIoControlCode */
+                         NULL,                             /* lpInBuffer */
+                         0,                                /* nInBufferSize */
+                         (LPVOID) &H,                      /* output buffer */
+                         (DWORD) sizeof(H),                /* size of output buffer */
+                         (LPDWORD) &IoctlReturnSize,       /* number of bytes returned */
+                         (LPOVERLAPPED) NULL))             /* OVERLAPPED structure */
+        if (removable)
+            *removable = H.MediaRemovable;
+    }
+#endif
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+OVERLAPPED pos;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+long long addr = ((long long)lba) * ctx->sector_size;
+DWORD bytestoread = sects * ctx->sector_size;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+if (sectsread)
+    *sectsread = 0;
+memset (&pos, 0, sizeof (pos));
+while (bytestoread) {
+    DWORD bytesread;
+    DWORD sectorbytes;
+
+    pos.Offset = (DWORD)addr;
+    pos.OffsetHigh = (DWORD)(addr >> 32);
+    if (!ReadFile ((HANDLE)(uptr->fileref), buf, bytestoread, &bytesread, &pos)) {
+        if (ERROR_HANDLE_EOF == GetLastError ()) {  /* Return 0's for reads past EOF */
+            memset (buf, 0, bytestoread);
+            if (sectsread)
+                *sectsread += bytestoread / ctx->sector_size;
+            return SCPE_OK;
+            }
+        _set_errno_from_status (GetLastError ());
+        return SCPE_IOERR;
+        }
+    sectorbytes = (bytesread / ctx->sector_size) * ctx->sector_size;
+    if (bytesread > sectorbytes) {
+        memset (buf + bytesread, 0, bytestoread - bytesread);
+        sectorbytes += ctx->sector_size;
+        }
+    if (sectsread)
+        *sectsread += sectorbytes / ctx->sector_size;
+    bytestoread -= sectorbytes;
+    buf +=  sectorbytes;
+    addr += sectorbytes;
+    }
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_read (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *bytesread, uint32 bytes)
+{
+OVERLAPPED pos;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_read(unit=%d, addr=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+
+memset (&pos, 0, sizeof (pos));
+pos.Offset = (DWORD)addr;
+pos.OffsetHigh = (DWORD)(addr >> 32);
+if (ReadFile ((HANDLE)(uptr->fileref), buf, (DWORD)bytes, (LPDWORD)bytesread, &pos))
+    return SCPE_OK;
+if (ERROR_HANDLE_EOF == GetLastError ()) {  /* Return 0's for reads past EOF */
+    memset (buf, 0, bytes);
+    if (bytesread)
+        *bytesread = bytes;
+    return SCPE_OK;
+    }
+_set_errno_from_status (GetLastError ());
+return SCPE_IOERR;
+}
+
+static t_stat sim_os_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+OVERLAPPED pos;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+long long addr;
+DWORD byteswritten;
+DWORD bytestowrite = sects * ctx->sector_size;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+
+if (sectswritten)
+    *sectswritten = 0;
+addr = ((long long)lba) * ctx->sector_size;
+memset (&pos, 0, sizeof (pos));
+while (bytestowrite) {
+    DWORD sectorbytes;
+
+    pos.Offset = (DWORD)addr;
+    pos.OffsetHigh = (DWORD)(addr >> 32);
+    if (!WriteFile ((HANDLE)(uptr->fileref), buf, bytestowrite, &byteswritten, &pos)) {
+        _set_errno_from_status (GetLastError ());
+        return SCPE_IOERR;
+        }
+    if (sectswritten)
+        *sectswritten += byteswritten / ctx->sector_size;
+    sectorbytes = (byteswritten / ctx->sector_size) * ctx->sector_size;
+    bytestowrite -= sectorbytes;
+    if (bytestowrite == 0)
+        break;
+    buf += sectorbytes;
+    addr += sectorbytes;
+    }
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_write (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *byteswritten, uint32 bytes)
+{
+OVERLAPPED pos;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_write(unit=%d, lba=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+
+memset (&pos, 0, sizeof (pos));
+pos.Offset = (DWORD)addr;
+pos.OffsetHigh = (DWORD)(addr >> 32);
+if (WriteFile ((HANDLE)(uptr->fileref), buf, bytes, (LPDWORD)byteswritten, &pos))
+    return SCPE_OK;
+_set_errno_from_status (GetLastError ());
+return SCPE_IOERR;
+}
+
+#elif defined (__linux) || defined (__linux__) || defined (__APPLE__)|| defined (__sun) || defined (__sun__) || defined (__hpux) || defined (_AIX)
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(HAVE_SYS_IOCTL)
+#include <sys/ioctl.h>
+#endif
+#if defined(HAVE_LINUX_CDROM)
+#include <linux/cdrom.h>
+#endif
+
+static t_stat sim_os_disk_implemented_raw (void)
+{
+return sim_toffset_64 ? SCPE_OK : SCPE_NOFNC;
+}
+
+static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode)
+{
+int mode = 0;
+int fd;
+
+if (strchr (openmode, 'r') && (strchr (openmode, '+') || strchr (openmode, 'w')))
+    mode = O_RDWR;
+else
+    if (strchr (openmode, 'r'))
+        mode = O_RDONLY;
+#ifdef O_LARGEFILE
+mode |= O_LARGEFILE;
+#endif
+#ifdef O_DSYNC
+mode |= O_DSYNC;
+#endif
+fd = open (rawdevicename, mode, 0);
+if (fd < 0)
+    return (FILE *)NULL;
+return (FILE *)((long)fd);
+}
+
+static int sim_os_disk_close_raw (FILE *f)
+{
+return close ((int)((long)f));
+}
+
+static void sim_os_disk_flush_raw (FILE *f)
+{
+fsync ((int)((long)f));
+}
+
+static t_offset sim_os_disk_size_raw (FILE *f)
+{
+t_offset pos, size;
+
+pos = (t_offset)lseek ((int)((long)f), (off_t)0, SEEK_CUR);
+size = (t_offset)lseek ((int)((long)f), (off_t)0, SEEK_END);
+if (pos != (t_offset)-1)
+    (void)lseek ((int)((long)f), (off_t)pos, SEEK_SET);
+return size;
+}
+
+static t_stat sim_os_disk_unload_raw (FILE *f)
+{
+#if defined(CDROM_GET_CAPABILITY) && defined(CDROMEJECT) && defined(CDROMEJECT_SW)
+if (ioctl ((int)((long)f), CDROM_GET_CAPABILITY, NULL) < 0)
+    return SCPE_OK;
+if (ioctl((int)((long)f), CDROM_LOCKDOOR, 0) < 0)
+    return SCPE_IOERR;
+if (ioctl((int)((long)f), CDROMEJECT) < 0)
+    return SCPE_IOERR;
+#endif
+return SCPE_OK;
+}
+
+static t_bool sim_os_disk_isavailable_raw (FILE *Disk)
+{
+#if defined(CDROMSTART) && defined(CDROM_GET_CAPABILITY)
+if (ioctl ((int)((long)Disk), CDROM_GET_CAPABILITY, NULL) < 0)
+    return TRUE;
+switch (ioctl((int)((long)Disk), CDROM_DRIVE_STATUS, CDSL_NONE)) {
+    case CDS_NO_INFO:
+    case CDS_NO_DISC:
+    case CDS_TRAY_OPEN:
+    case CDS_DRIVE_NOT_READY:
+    default: /* error */
+        return FALSE;
+    case CDS_DISC_OK:
+        return TRUE;
+    }
+#endif
+return TRUE;
+}
+
+static t_stat sim_os_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+off_t addr = ((off_t)lba) * ctx->sector_size;
+ssize_t bytesread;
+size_t bytestoread = sects * ctx->sector_size;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+
+if (sectsread)
+    *sectsread = 0;
+while (bytestoread) {
+    size_t sectorbytes;
+
+    bytesread = pread((int)((long)uptr->fileref), buf, bytestoread, addr);
+    if (bytesread < 0) {
+        return SCPE_IOERR;
+        }
+    if ((size_t)bytesread < bytestoread) {/* read zeros at/past EOF */
+        memset (buf + bytesread, 0, bytestoread - bytesread);
+        bytesread = bytestoread;
+        }
+    sectorbytes = (bytesread / ctx->sector_size) * ctx->sector_size;
+    if ((size_t)bytesread > sectorbytes)
+        sectorbytes += ctx->sector_size;
+    if (sectsread)
+        *sectsread += sectorbytes / ctx->sector_size;
+    bytestoread -= sectorbytes;
+    buf += sectorbytes;
+    addr += sectorbytes;
+    }
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_read (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *rbytesread, uint32 bytes)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+ssize_t bytesread;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_read(unit=%d, addr=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+
+bytesread = pread((int)((long)uptr->fileref), buf, bytes, (off_t)addr);
+if (bytesread < 0) {
+    if (rbytesread)
+        *rbytesread = 0;
+    return SCPE_IOERR;
+    }
+if (rbytesread)
+    *rbytesread = bytesread;
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+off_t addr = ((off_t)lba) * ctx->sector_size;
+ssize_t byteswritten;
+size_t bytestowrite = sects * ctx->sector_size;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
+
+if (sectswritten)
+    *sectswritten = 0;
+while (bytestowrite) {
+    size_t sectorbytes;
+
+    byteswritten = pwrite((int)((long)uptr->fileref), buf, bytestowrite, addr);
+    if (byteswritten < 0) {
+        return SCPE_IOERR;
+        }
+    if (sectswritten)
+        *sectswritten += byteswritten / ctx->sector_size;
+    sectorbytes = (byteswritten / ctx->sector_size) * ctx->sector_size;
+    bytestowrite -= sectorbytes;
+    if (bytestowrite == 0)
+        break;
+    buf += sectorbytes;
+    addr += sectorbytes;
+    }
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_write (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *rbyteswritten, uint32 bytes)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+ssize_t byteswritten;
+
+sim_debug_unit (ctx->dbit, uptr, "sim_os_disk_write(unit=%d, addr=0x%X, bytes=%u)\n", (int)(uptr - ctx->dptr->units), (uint32)addr, bytes);
+
+if (rbyteswritten)
+    *rbyteswritten = 0;
+byteswritten = pwrite((int)((long)uptr->fileref), buf, bytes, (off_t)addr);
+if (byteswritten < 0)
+    return SCPE_IOERR;
+if (rbyteswritten)
+    *rbyteswritten = byteswritten;
+return SCPE_OK;
+}
+
+static t_stat sim_os_disk_info_raw (FILE *f, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom)
+{
+if (sector_size) {
+#if defined(BLKSSZGET)
+    if (ioctl ((int)((long)f), BLKSSZGET, sector_size) < 0)
+#endif
+        *sector_size = 512;
+    }
+if (removable)
+    *removable = 0;
+if (is_cdrom) {
+#if defined(CDROM_GET_CAPABILITY)
+    int cd_cap = ioctl ((int)((long)f), CDROM_GET_CAPABILITY, NULL);
+
+    if (cd_cap < 0)
+        *is_cdrom = 0;
+    else {
+        *is_cdrom = 1;
+        if (removable)
+            *removable = 1;
+        if (sector_size)
+            *sector_size = 2048;
+        }
+#else
+    *is_cdrom = 0;
+#endif
+    }
+return SCPE_OK;
+}
+
+#else
+/*============================================================================*/
+/*                        Non-implemented versions                            */
+/*============================================================================*/
+
+static t_stat sim_os_disk_implemented_raw (void)
+{
+return SCPE_NOFNC;
+}
+
+static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode)
+{
+return NULL;
+}
+
+static int sim_os_disk_close_raw (FILE *f)
+{
+return EOF;
+}
+
+static void sim_os_disk_flush_raw (FILE *f)
+{
+}
+
+static t_offset sim_os_disk_size_raw (FILE *f)
+{
+return (t_offset)-1;
+}
+
+static t_stat sim_os_disk_unload_raw (FILE *f)
+{
+return SCPE_NOFNC;
+}
+
+static t_bool sim_os_disk_isavailable_raw (FILE *Disk)
+{
+return FALSE;
+}
+
+static t_stat sim_os_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+*sectsread = 0;
+return SCPE_NOFNC;
+}
+
+static t_stat sim_os_disk_read (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *bytesread, uint32 bytes)
+{
+*bytesread = 0;
+return SCPE_NOFNC;
+}
+
+static t_stat sim_os_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+*sectswritten = 0;
+return SCPE_NOFNC;
+}
+
+static t_stat sim_os_disk_write (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *byteswritten, uint32 bytes)
+{
+*byteswritten = 0;
+return SCPE_NOFNC;
+}
+
+static t_stat sim_os_disk_info_raw (FILE *f, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom)
+{
+*sector_size = *removable = *is_cdrom = 0;
+return SCPE_NOFNC;
+}
+
+#endif
+
+/* OS Independent Disk Virtual Disk (VHD) I/O support */
+
+#if (defined (VMS) && !(defined (__ALPHA) || defined (__ia64)))
+#define DONT_DO_VHD_SUPPORT  /* VAX/VMS compilers don't have 64 bit integers */
+#endif
+
+#if defined (DONT_DO_VHD_SUPPORT)
+
+/*============================================================================*/
+/*                        Non-implemented version                             */
+/*   This is only for hody systems which don't have 64 bit integer types      */
+/*============================================================================*/
+
+static t_stat sim_vhd_disk_implemented (void)
+{
+return SCPE_NOFNC;
+}
+
+static FILE *sim_vhd_disk_open (const char *vhdfilename, const char *openmode)
+{
+return NULL;
+}
+
+static FILE *sim_vhd_disk_merge (const char *szVHDPath, char **ParentVHD)
+{
+return NULL;
+}
+
+static FILE *sim_vhd_disk_create (const char *szVHDPath, t_offset desiredsize)
+{
+return NULL;
+}
+
+static FILE *sim_vhd_disk_create_diff (const char *szVHDPath, const char *szParentVHDPath)
+{
+return NULL;
+}
+
+static int sim_vhd_disk_close (FILE *f)
+{
+return -1;
+}
+
+static void sim_vhd_disk_flush (FILE *f)
+{
+}
+
+static t_offset sim_vhd_disk_size (FILE *f)
+{
+return (t_offset)-1;
+}
+
+static t_stat sim_vhd_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+*sectsread = 0;
+return SCPE_IOERR;
+}
+
+static t_stat sim_vhd_disk_clearerr (UNIT *uptr)
+{
+return SCPE_IOERR;
+}
+
+static t_stat sim_vhd_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+*sectswritten = 0;
+return SCPE_IOERR;
+}
+
+static t_stat sim_vhd_disk_set_dtype (FILE *f, const char *dtype)
+{
+return SCPE_NOFNC;
+}
+
+static const char *sim_vhd_disk_get_dtype (FILE *f, uint32 *SectorSize, uint32 *xfer_element_size, char sim_name[64], time_t *creation_time)
+{
+*SectorSize = *xfer_element_size = 0;
+return NULL;
+}
+
+#else
+
+/*++
+    This code follows the details specified in the "Virtual Hard Disk Image
+    Format Specification", Version 1.0 October 11, 2006.  This format
+    specification is available for anyone to implement under the
+    "Microsoft Open Specification Promise" described at:
+        http://www.microsoft.com/interop/osp/default.mspx.
+--*/
+
+typedef t_uint64    uint64;
+typedef t_int64     int64;
+
+typedef struct _VHD_Footer {
+    /*
+    Cookies are used to uniquely identify the original creator of the hard disk
+    image. The values are case-sensitive.  Microsoft uses the "conectix" string
+    to identify this file as a hard disk image created by Microsoft Virtual
+    Server, Virtual PC, and predecessor products. The cookie is stored as an
+    eight-character ASCII string with the "c" in the first byte, the "o" in
+    the second byte, and so on.
+    */
+    char Cookie[8];
+    /*
+    This is a bit field used to indicate specific feature support. The following
+    table displays the list of features.
+    Any fields not listed are reserved.
+
+    Feature Value:
+       No features enabled     0x00000000
+       Temporary               0x00000001
+       Reserved                0x00000002
+
+       No features enabled.
+              The hard disk image has no special features enabled in it.
+       Temporary.
+              This bit is set if the current disk is a temporary disk. A
+              temporary disk designation indicates to an application that
+              this disk is a candidate for deletion on shutdown.
+       Reserved.
+              This bit must always be set to 1.
+       All other bits are also reserved and should be set to 0.
+    */
+    uint32 Features;
+    /*
+    This field is divided into a major/minor version and matches the version of
+    the specification used in creating the file. The most-significant two bytes
+    are for the major version. The least-significant two bytes are the minor
+    version.  This must match the file format specification. For the current
+    specification, this field must be initialized to 0x00010000.
+    The major version will be incremented only when the file format is modified
+    in such a way that it is no longer compatible with older versions of the
+    file format.
+    */
+    uint32 FileFormatVersion;
+    /*
+    This field holds the absolute byte offset, from the beginning of the file,
+    to the next structure. This field is used for dynamic disks and differencing
+    disks, but not fixed disks. For fixed disks, this field should be set to
+    0xFFFFFFFF.
+    */
+    uint64 DataOffset;
+    /*
+    This field stores the creation time of a hard disk image. This is the number
+    of seconds since January 1, 2000 12:00:00 AM in UTC/GMT.
+    */
+    uint32 TimeStamp;
+    /*
+    This field is used to document which application created the hard disk. The
+    field is a left-justified text field. It uses a single-byte character set.
+    If the hard disk is created by Microsoft Virtual PC, "vpc " is written in
+    this field. If the hard disk image is created by Microsoft Virtual Server,
+    then "vs  " is written in this field.
+    Other applications should use their own unique identifiers.
+    */
+    char CreatorApplication[4];
+    /*
+    This field holds the major/minor version of the application that created
+    the hard disk image.  Virtual Server 2004 sets this value to 0x00010000 and
+    Virtual PC 2004 sets this to 0x00050000.
+    */
+    uint32 CreatorVersion;
+    /*
+    This field stores the type of host operating system this disk image is
+    created on.
+       Host OS type    Value
+       Windows         0x5769326B (Wi2k)
+       Macintosh       0x4D616320 (Mac )
+    */
+    uint8 CreatorHostOS[4];
+    /*
+    This field stores the size of the hard disk in bytes, from the perspective
+    of the virtual machine, at creation time. This field is for informational
+    purposes.
+    */
+    uint64 OriginalSize;
+    /*
+    This field stores the current size of the hard disk, in bytes, from the
+    perspective of the virtual machine.
+    This value is same as the original size when the hard disk is created.
+    This value can change depending on whether the hard disk is expanded.
+    */
+    uint64 CurrentSize;
+    /*
+    This field stores the cylinder, heads, and sectors per track value for the
+    hard disk.
+       Disk Geometry field          Size (bytes)
+       Cylinder                     2
+       Heads                        1
+       Sectors per track/cylinder   1
+
+    When a hard disk is configured as an ATA hard disk, the CHS values (that is,
+    Cylinder, Heads, Sectors per track) are used by the ATA controller to
+    determine the size of the disk. When the user creates a hard disk of a
+    certain size, the size of the hard disk image in the virtual machine is
+    smaller than that created by the user. This is because CHS value calculated
+    from the hard disk size is rounded down. The pseudo-code for the algorithm
+    used to determine the CHS values can be found in the appendix of this
+    document.
+    */
+    uint32 DiskGeometry;
+    /*
+       Disk Type field              Value
+       None                         0
+       Reserved (deprecated)        1
+       Fixed hard disk              2
+       Dynamic hard disk            3
+       Differencing hard disk       4
+       Reserved (deprecated)        5
+       Reserved (deprecated)        6
+    */
+    uint32 DiskType;
+    /*
+    This field holds a basic checksum of the hard disk footer. It is just a
+    one's complement of the sum of all the bytes in the footer without the
+    checksum field.
+    If the checksum verification fails, the Virtual PC and Virtual Server
+    products will instead use the header. If the checksum in the header also
+    fails, the file should be assumed to be corrupt. The pseudo-code for the
+    algorithm used to determine the checksum can be found in the appendix of
+    this document.
+    */
+    uint32 Checksum;
+    /*
+    Every hard disk has a unique ID stored in the hard disk. This is used to
+    identify the hard disk. This is a 128-bit universally unique identifier
+    (UUID). This field is used to associate a parent hard disk image with its
+    differencing hard disk image(s).
+    */
+    uint8 UniqueID[16];
+    /*
+    This field holds a one-byte flag that describes whether the system is in
+    saved state. If the hard disk is in the saved state the value is set to 1.
+    Operations such as compaction and expansion cannot be performed on a hard
+    disk in a saved state.
+    */
+    uint8 SavedState;
+    /*
+    This field contains zeroes. It is 427 bytes in size.
+    */
+    uint8 Reserved1[11];
+    /*
+    This field is an extension to the VHD spec and includes a simh drive type
+    name as a nul terminated string.
+    */
+    uint8 DriveType[16];
+    uint32 DriveSectorSize;
+    uint32 DriveTransferElementSize;
+    uint8 CreatingSimulator[64];
+    /*
+    This field contains zeroes. It is 328 bytes in size.
+    */
+    uint8 Reserved[328];
+    } VHD_Footer;
+
+/*
+For dynamic and differencing disk images, the "Data Offset" field within
+the image footer points to a secondary structure that provides additional
+information about the disk image. The dynamic disk header should appear on
+a sector (512-byte) boundary.
+*/
+typedef struct _VHD_DynamicDiskHeader {
+    /*
+    This field holds the value "cxsparse". This field identifies the header.
+    */
+    char Cookie[8];
+    /*
+    This field contains the absolute byte offset to the next structure in the
+    hard disk image. It is currently unused by existing formats and should be
+    set to 0xFFFFFFFF.
+    */
+    uint64 DataOffset;
+    /*
+    This field stores the absolute byte offset of the Block Allocation Table
+    (BAT) in the file.
+    */
+    uint64 TableOffset;
+    /*
+    This field stores the version of the dynamic disk header. The field is
+    divided into Major/Minor version. The least-significant two bytes represent
+    the minor version, and the most-significant two bytes represent the major
+    version. This must match with the file format specification. For this
+    specification, this field must be initialized to 0x00010000.
+    The major version will be incremented only when the header format is
+    modified in such a way that it is no longer compatible with older versions
+    of the product.
+    */
+    uint32 HeaderVersion;
+    /*
+    This field holds the maximum entries present in the BAT. This should be
+    equal to the number of blocks in the disk (that is, the disk size divided
+    by the block size).
+    */
+    uint32 MaxTableEntries;
+    /*
+    A block is a unit of expansion for dynamic and differencing hard disks. It
+    is stored in bytes. This size does not include the size of the block bitmap.
+    It is only the size of the data section of the block. The sectors per block
+    must always be a power of two. The default value is 0x00200000 (indicating a
+    block size of 2 MB).
+    */
+    uint32 BlockSize;
+    /*
+    This field holds a basic checksum of the dynamic header. It is a one's
+    complement of the sum of all the bytes in the header without the checksum
+    field.
+    If the checksum verification fails the file should be assumed to be corrupt.
+    */
+    uint32 Checksum;
+    /*
+    This field is used for differencing hard disks. A differencing hard disk
+    stores a 128-bit UUID of the parent hard disk. For more information, see
+    "Creating Differencing Hard Disk Images" later in this paper.
+    */
+    uint8 ParentUniqueID[16];
+    /*
+    This field stores the modification time stamp of the parent hard disk. This
+    is the number of seconds since January 1, 2000 12:00:00 AM in UTC/GMT.
+    */
+    uint32 ParentTimeStamp;
+    /*
+    This field should be set to zero.
+    */
+    uint32 Reserved0;
+    /*
+    This field contains a Unicode string (UTF-16) of the parent hard disk
+    filename.
+    */
+    char ParentUnicodeName[512];
+    /*
+    These entries store an absolute byte offset in the file where the parent
+    locator for a differencing hard disk is stored. This field is used only for
+    differencing disks and should be set to zero for dynamic disks.
+    */
+    struct VHD_ParentLocator {
+        /*
+        The platform code describes which platform-specific format is used for the
+        file locator. For Windows, a file locator is stored as a path (for example.
+        "c:\disksimages\ParentDisk.vhd"). On a Macintosh system, the file locator
+        is a binary large object (blob) that contains an "alias." The parent locator
+        table is used to support moving hard disk images across platforms.
+        Some current platform codes include the following:
+           Platform Code        Description
+           None (0x0)
+           Wi2r (0x57693272)    [deprecated]
+           Wi2k (0x5769326B)    [deprecated]
+           W2ru (0x57327275)    Unicode pathname (UTF-16) on Windows relative to the differencing disk pathname.
+           W2ku (0x57326B75)    Absolute Unicode (UTF-16) pathname on Windows.
+           Mac (0x4D616320)     (Mac OS alias stored as a blob)
+           MacX(0x4D616358)     A file URL with UTF-8 encoding conforming to RFC 2396.
+        */
+        uint8 PlatformCode[4];
+        /*
+        This field stores the number of 512-byte sectors needed to store the parent
+        hard disk locator.
+        */
+        uint32 PlatformDataSpace;
+        /*
+        This field stores the actual length of the parent hard disk locator in bytes.
+        */
+        uint32 PlatformDataLength;
+        /*
+        This field must be set to zero.
+        */
+        uint32 Reserved;
+        /*
+        This field stores the absolute file offset in bytes where the platform
+        specific file locator data is stored.
+        */
+        uint64 PlatformDataOffset;
+        /*
+        This field stores the absolute file offset in bytes where the platform
+        specific file locator data is stored.
+        */
+        } ParentLocatorEntries[8];
+    /*
+    This must be initialized to zeroes.
+    */
+    char Reserved[256];
+    } VHD_DynamicDiskHeader;
 
-if (rbyteswritten)
-    *rbyteswritten = 0;
-byteswritten = pwrite((int)((long)uptr->fileref), buf, bytes, (off_t)addr);
-if (byteswritten < 0)
-    return SCPE_IOERR;
-if (rbyteswritten)
-    *rbyteswritten = byteswritten;
-return SCPE_OK;
-}
+#define VHD_BAT_FREE_ENTRY (0xFFFFFFFF)
+#define VHD_DATA_BLOCK_ALIGNMENT ((uint64)4096)    /* Optimum when underlying storage has 4k sectors */
 
-static t_stat sim_os_disk_info_raw (FILE *f, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom)
-{
-if (sector_size) {
-#if defined(BLKSSZGET)
-    if (ioctl ((int)((long)f), BLKSSZGET, sector_size) < 0)
-#endif
-        *sector_size = 512;
-    }
-if (removable)
-    *removable = 0;
-if (is_cdrom) {
-#if defined(CDROM_GET_CAPABILITY)
-    int cd_cap = ioctl ((int)((long)f), CDROM_GET_CAPABILITY, NULL);
+#define VHD_DT_Fixed                 2  /* Fixed hard disk */
+#define VHD_DT_Dynamic               3  /* Dynamic hard disk */
+#define VHD_DT_Differencing          4  /* Differencing hard disk */
 
-    if (cd_cap < 0)
-        *is_cdrom = 0;
-    else {
-        *is_cdrom = 1;
-        if (removable)
-            *removable = 1;
-        if (sector_size)
-            *sector_size = 2048;
-        }
-#else
-    *is_cdrom = 0;
-#endif
-    }
-return SCPE_OK;
-}
+#define VHD_Internal_SectorSize     512
 
-#else
-/*============================================================================*/
-/*                        Non-implemented versions                            */
-/*============================================================================*/
+typedef struct VHD_IOData *VHDHANDLE;
 
-static t_stat sim_os_disk_implemented_raw (void)
+static t_stat ReadFilePosition(FILE *File, void *buf, size_t bufsize, uint32 *bytesread, uint64 position)
 {
-return SCPE_NOFNC;
-}
+uint32 err = sim_fseeko (File, (t_offset)position, SEEK_SET);
+size_t i;
 
-static FILE *sim_os_disk_open_raw (const char *rawdevicename, const char *openmode)
-{
-return NULL;
+if (bytesread)
+    *bytesread = 0;
+if (!err) {
+    i = fread (buf, 1, bufsize, File);
+    if (bytesread)
+        *bytesread = (uint32)i;
+    err = ferror (File);
+    }
+return (err ? SCPE_IOERR : SCPE_OK);
 }
 
-static int sim_os_disk_close_raw (FILE *f)
+static t_stat WriteFilePosition(FILE *File, void *buf, size_t bufsize, uint32 *byteswritten, uint64 position)
 {
-return EOF;
-}
+uint32 err = sim_fseeko (File, (t_offset)position, SEEK_SET);
+size_t i;
 
-static void sim_os_disk_flush_raw (FILE *f)
-{
+if (byteswritten)
+    *byteswritten = 0;
+if (!err) {
+    i = fwrite (buf, 1, bufsize, File);
+    if (byteswritten)
+        *byteswritten = (uint32)i;
+    err = ferror (File);
+    }
+return (err ? SCPE_IOERR : SCPE_OK);
 }
 
-static t_offset sim_os_disk_size_raw (FILE *f)
+static uint32
+CalculateVhdFooterChecksum(void *data,
+                           size_t size)
 {
-return (t_offset)-1;
-}
+uint32 sum = 0;
+uint8 *c = (uint8 *)data;
 
-static t_stat sim_os_disk_unload_raw (FILE *f)
-{
-return SCPE_NOFNC;
+while (size--)
+    sum += *c++;
+return ~sum;
 }
 
-static t_bool sim_os_disk_isavailable_raw (FILE *Disk)
+#if defined(_WIN32) || defined (__ALPHA) || defined (__ia64) || defined (VMS)
+#ifndef __BYTE_ORDER__
+#define __BYTE_ORDER__ __ORDER_LITTLE_ENDIAN__
+#endif
+#endif
+#ifndef __BYTE_ORDER__
+#define __BYTE_ORDER__ UNKNOWN
+#endif
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static uint64
+NtoHll(uint64 value)
 {
-return FALSE;
+uint8 *l = (uint8 *)&value;
+uint64 highresult = (uint64)l[3] | ((uint64)l[2]<<8) | ((uint64)l[1]<<16) | ((uint64)l[0]<<24);
+uint32 lowresult = (uint64)l[7] | ((uint64)l[6]<<8) | ((uint64)l[5]<<16) | ((uint64)l[4]<<24);
+return (highresult << 32) | lowresult;
 }
-
-static t_stat sim_os_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+#elif  __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static uint64
+NtoHll(uint64 value)
 {
-*sectsread = 0;
-return SCPE_NOFNC;
+return value;
 }
-
-static t_stat sim_os_disk_read (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *bytesread, uint32 bytes)
+#else
+static uint32
+NtoHl(uint32 value)
 {
-*bytesread = 0;
-return SCPE_NOFNC;
-}
+uint8 *l = (uint8 *)&value;
 
-static t_stat sim_os_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
-{
-*sectswritten = 0;
-return SCPE_NOFNC;
+if (sim_end)
+    return l[3] | (l[2]<<8) | (l[1]<<16) | (l[0]<<24);
+return value;
 }
 
-static t_stat sim_os_disk_write (UNIT *uptr, t_offset addr, uint8 *buf, uint32 *byteswritten, uint32 bytes)
+static uint64
+NtoHll(uint64 value)
 {
-*byteswritten = 0;
-return SCPE_NOFNC;
-}
+uint8 *l = (uint8 *)&value;
 
-static t_stat sim_os_disk_info_raw (FILE *f, uint32 *sector_size, uint32 *removable, uint32 *is_cdrom)
-{
-*sector_size = *removable = *is_cdrom = 0;
-return SCPE_NOFNC;
+if (sim_end) {
+    uint64 highresult = l[3] | (l[2]<<8) | (l[1]<<16) | (l[0]<<24);
+    uint32 lowresult = l[7] | (l[6]<<8) | (l[5]<<16) | (l[4]<<24);
+    return (highresult << 32) | lowresult;
+    }
+return value;
 }
-
 #endif
 
-/* OS Independent Disk Virtual Disk (VHD) I/O support */
-
-#if (defined (VMS) && !(defined (__ALPHA) || defined (__ia64)))
-#define DONT_DO_VHD_SUPPORT  /* VAX/VMS compilers don't have 64 bit integers */
-#endif
+static
+int
+GetVHDFooter(const char *szVHDPath,
+             VHD_Footer *sFooter,
+             VHD_DynamicDiskHeader *sDynamic,
+             uint32 **aBAT,
+             uint32 *ModifiedTimeStamp,
+             char *szParentVHDPath,
+             size_t ParentVHDPathSize)
+{
+FILE *File = NULL;
+uint64 position;
+uint32 sum, saved_sum;
+int Return = 0;
+VHD_Footer sHeader;
+struct stat statb;
 
-#if defined (DONT_DO_VHD_SUPPORT)
+memset(sFooter, '\0', sizeof(*sFooter));
+if (sDynamic)
+    memset(sDynamic, '\0', sizeof(*sDynamic));
+if (aBAT)
+    *aBAT = NULL;
+File = sim_fopen (szVHDPath, "rb");
+if (!File) {
+    Return = errno;
+    goto Return_Cleanup;
+    }
+if (ModifiedTimeStamp) {
+    if (fstat (fileno (File), &statb)) {
+        Return = errno;
+        goto Return_Cleanup;
+        }
+    else
+        *ModifiedTimeStamp = NtoHl ((uint32)(statb.st_mtime-946684800));
+    }
+position = sim_fsize_ex (File);
+if (((int64)position) == -1) {
+    Return = errno;
+    goto Return_Cleanup;
+    }
+position -= sizeof(*sFooter);
+if (ReadFilePosition(File,
+                     sFooter,
+                     sizeof(*sFooter),
+                     NULL,
+                     position)) {
+    Return = errno;
+    goto Return_Cleanup;
+    }
+saved_sum = NtoHl(sFooter->Checksum);
+sFooter->Checksum = 0;
+sum = CalculateVhdFooterChecksum(sFooter, sizeof(*sFooter));
+sFooter->Checksum = NtoHl(saved_sum);
+if ((sum != saved_sum) || (memcmp("conectix", sFooter->Cookie, sizeof(sFooter->Cookie)))) {
+    Return = EINVAL;                                    /* File Corrupt */
+    goto Return_Cleanup;
+    }
+if (ReadFilePosition(File,
+                     &sHeader,
+                     sizeof(sHeader),
+                     NULL,
+                     (uint64)0)) {
+    Return = errno;
+    goto Return_Cleanup;
+    }
+if ((NtoHl(sFooter->DiskType) != VHD_DT_Dynamic) &&
+    (NtoHl(sFooter->DiskType) != VHD_DT_Differencing) &&
+    (NtoHl(sFooter->DiskType) != VHD_DT_Fixed)) {
+    Return = EINVAL;                                    /* File Corrupt */
+    goto Return_Cleanup;
+    }
+if (((NtoHl(sFooter->DiskType) == VHD_DT_Dynamic) ||
+     (NtoHl(sFooter->DiskType) == VHD_DT_Differencing)) &&
+     memcmp(sFooter, &sHeader, sizeof(sHeader))) {
+    Return = EINVAL;                                    /* File Corrupt */
+    goto Return_Cleanup;
+    }
+if ((sDynamic) &&
+    ((NtoHl(sFooter->DiskType) == VHD_DT_Dynamic) ||
+     (NtoHl(sFooter->DiskType) == VHD_DT_Differencing))) {
+    if (ReadFilePosition(File,
+                         sDynamic,
+                         sizeof (*sDynamic),
+                         NULL,
+                         NtoHll (sFooter->DataOffset))) {
+        Return = errno;
+        goto Return_Cleanup;
+        }
+    saved_sum = NtoHl (sDynamic->Checksum);
+    sDynamic->Checksum = 0;
+    sum = CalculateVhdFooterChecksum (sDynamic, sizeof(*sDynamic));
+    sDynamic->Checksum = NtoHl (saved_sum);
+    if ((sum != saved_sum) || (memcmp ("cxsparse", sDynamic->Cookie, sizeof (sDynamic->Cookie)))) {
+        Return = errno;
+        goto Return_Cleanup;
+        }
+    if (aBAT) {
+        *aBAT = (uint32*) calloc(1, VHD_Internal_SectorSize * ((sizeof(**aBAT) * NtoHl(sDynamic->MaxTableEntries) + VHD_Internal_SectorSize - 1) / VHD_Internal_SectorSize));
+        if (ReadFilePosition(File,
+                             *aBAT,
+                             sizeof (**aBAT) * NtoHl(sDynamic->MaxTableEntries),
+                             NULL,
+                             NtoHll (sDynamic->TableOffset))) {
+            Return = EINVAL;                            /* File Corrupt */
+            goto Return_Cleanup;
+            }
+        }
+    if (szParentVHDPath && ParentVHDPathSize) {
+        VHD_Footer sParentFooter;
 
-/*============================================================================*/
-/*                        Non-implemented version                             */
-/*   This is only for hody systems which don't have 64 bit integer types      */
-/*============================================================================*/
+        memset (szParentVHDPath, '\0', ParentVHDPathSize);
+        if (NtoHl (sFooter->DiskType) == VHD_DT_Differencing) {
+            size_t i, j;
 
-static t_stat sim_vhd_disk_implemented (void)
-{
-return SCPE_NOFNC;
-}
+            for (j=0; j<8; ++j) {
+                uint8 *Pdata;
+                uint32 PdataSize;
+                char ParentName[512];
+                char CheckPath[512];
+                uint32 ParentModificationTime;
 
-static FILE *sim_vhd_disk_open (const char *vhdfilename, const char *openmode)
-{
-return NULL;
-}
+                if ('\0' == sDynamic->ParentLocatorEntries[j].PlatformCode[0])
+                    continue;
+                memset (ParentName, '\0', sizeof(ParentName));
+                memset (CheckPath, '\0', sizeof(CheckPath));
+                PdataSize = NtoHl(sDynamic->ParentLocatorEntries[j].PlatformDataSpace);
+                Pdata = (uint8*) calloc (1, PdataSize+2);
+                if (!Pdata)
+                    continue;
+                if (ReadFilePosition(File,
+                                     Pdata,
+                                     PdataSize,
+                                     NULL,
+                                     NtoHll (sDynamic->ParentLocatorEntries[j].PlatformDataOffset))) {
+                    free (Pdata);
+                    continue;
+                    }
+                for (i=0; i<NtoHl(sDynamic->ParentLocatorEntries[j].PlatformDataLength); i+=2)
+                    if ((Pdata[i] == '\0') && (Pdata[i+1] == '\0')) {
+                        ParentName[i/2] = '\0';
+                        break;
+                        }
+                    else
+                        ParentName[i/2] = Pdata[i] ? Pdata[i] : Pdata[i+1];
+                free (Pdata);
+                memset (CheckPath, 0, sizeof (CheckPath));
+                if (0 == memcmp (sDynamic->ParentLocatorEntries[j].PlatformCode, "W2ku", 4))
+                    strlcpy (CheckPath, ParentName, sizeof (CheckPath));
+                else
+                    if (0 == memcmp (sDynamic->ParentLocatorEntries[j].PlatformCode, "W2ru", 4)) {
+                        const char *c;
 
-static FILE *sim_vhd_disk_merge (const char *szVHDPath, char **ParentVHD)
-{
-return NULL;
-}
+                        if ((c = strrchr (szVHDPath, '\\'))) {
+                            memcpy (CheckPath, szVHDPath, c-szVHDPath+1);
+                            strlcat (CheckPath, ParentName, sizeof (CheckPath));
+                            }
+                        }
+                VhdPathToHostPath (CheckPath, CheckPath, sizeof (CheckPath));
+                if (0 == GetVHDFooter(CheckPath,
+                                      &sParentFooter,
+                                      NULL,
+                                      NULL,
+                                      &ParentModificationTime,
+                                      NULL,
+                                      0)) {
+                    if ((0 == memcmp (sDynamic->ParentUniqueID, sParentFooter.UniqueID, sizeof (sParentFooter.UniqueID))) &&
+                        ((sDynamic->ParentTimeStamp == ParentModificationTime) ||
+                         ((NtoHl(sDynamic->ParentTimeStamp)-NtoHl(ParentModificationTime)) == 3600) ||
+                         (sim_switches & SWMASK ('O')))) {
+                         memset (szParentVHDPath, 0, ParentVHDPathSize);
+                         strlcpy (szParentVHDPath, CheckPath, ParentVHDPathSize);
+                        }
+                    else {
+                        if (0 != memcmp (sDynamic->ParentUniqueID, sParentFooter.UniqueID, sizeof (sParentFooter.UniqueID)))
+                            sim_printf ("Error Invalid Parent VHD '%s' for Differencing VHD: %s\n", CheckPath, szVHDPath);
+                        else
+                            sim_printf ("Error Parent VHD '%s' has been modified since Differencing VHD: %s was created\n", CheckPath, szVHDPath);
+                        Return = EINVAL;                /* File Corrupt/Invalid */
+                        }
+                    break;
+                    }
+                else {
+                    struct stat statb;
 
-static FILE *sim_vhd_disk_create (const char *szVHDPath, t_offset desiredsize)
-{
-return NULL;
+                    if (0 == stat (CheckPath, &statb)) {
+                        sim_printf ("Parent VHD '%s' corrupt for Differencing VHD: %s\n", CheckPath, szVHDPath);
+                        Return = EBADF;                /* File Corrupt/Invalid */
+                        break;
+                        }
+                    }
+                }
+            if (!*szParentVHDPath) {
+                if (Return != EINVAL)                   /* File Not Corrupt? */
+                    sim_printf ("Missing Parent VHD for Differencing VHD: %s\n", szVHDPath);
+                Return = EBADF;
+                }
+            }
+        }
+    }
+Return_Cleanup:
+if (File)
+    fclose(File);
+if (aBAT && (0 != Return)) {
+    free (*aBAT);
+    *aBAT = NULL;
+    }
+return errno = Return;
 }
 
-static FILE *sim_vhd_disk_create_diff (const char *szVHDPath, const char *szParentVHDPath)
-{
-return NULL;
-}
+struct VHD_IOData {
+    VHD_Footer Footer;
+    VHD_DynamicDiskHeader Dynamic;
+    uint32 *BAT;
+    FILE *File;
+    char ParentVHDPath[512];
+    struct VHD_IOData *Parent;
+    };
 
-static int sim_vhd_disk_close (FILE *f)
+static t_stat sim_vhd_disk_implemented (void)
 {
-return -1;
+return SCPE_OK;
 }
 
-static void sim_vhd_disk_flush (FILE *f)
+static t_stat sim_vhd_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_element_size)
 {
-}
+VHDHANDLE hVHD  = (VHDHANDLE)f;
+int Status = 0;
 
-static t_offset sim_vhd_disk_size (FILE *f)
-{
-return (t_offset)-1;
-}
+memset (hVHD->Footer.DriveType, '\0', sizeof hVHD->Footer.DriveType);
+memcpy (hVHD->Footer.DriveType, dtype, ((1+strlen (dtype)) < sizeof (hVHD->Footer.DriveType)) ? (1+strlen (dtype)) : sizeof (hVHD->Footer.DriveType));
+hVHD->Footer.DriveSectorSize = NtoHl (SectorSize);
+hVHD->Footer.DriveTransferElementSize = NtoHl (xfer_element_size);
+hVHD->Footer.CreatingSimulator[sizeof (hVHD->Footer.CreatingSimulator) - 1] = '\0';  /* Force NUL termination */
+memset (hVHD->Footer.CreatingSimulator, 0, sizeof (hVHD->Footer.CreatingSimulator));
+strlcpy ((char *)hVHD->Footer.CreatingSimulator, sim_name, sizeof (hVHD->Footer.CreatingSimulator));
+hVHD->Footer.Checksum = 0;
+hVHD->Footer.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Footer, sizeof(hVHD->Footer)));
 
-static t_stat sim_vhd_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
-{
-*sectsread = 0;
-return SCPE_IOERR;
-}
+if (NtoHl (hVHD->Footer.DiskType) == VHD_DT_Fixed) {
+    if (WriteFilePosition(hVHD->File,
+                          &hVHD->Footer,
+                          sizeof(hVHD->Footer),
+                          NULL,
+                          NtoHll (hVHD->Footer.CurrentSize)))
+        Status = errno;
+    goto Cleanup_Return;
+    }
+else {
+    uint64 position;
 
-static t_stat sim_vhd_disk_clearerr (UNIT *uptr)
-{
-return SCPE_IOERR;
+    position = sim_fsize_ex (hVHD->File);
+    if (((int64)position) == -1) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+    position -= sizeof(hVHD->Footer);
+    /* Update both copies on a dynamic disk */
+    if (WriteFilePosition(hVHD->File,
+                          &hVHD->Footer,
+                          sizeof(hVHD->Footer),
+                          NULL,
+                          (uint64)0)) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+    if (WriteFilePosition(hVHD->File,
+                          &hVHD->Footer,
+                          sizeof(hVHD->Footer),
+                          NULL,
+                          position)) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+    }
+Cleanup_Return:
+if (Status)
+    return SCPE_IOERR;
+return SCPE_OK;
 }
 
-static t_stat sim_vhd_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+static const char *sim_vhd_disk_get_dtype (FILE *f, uint32 *SectorSize, uint32 *xfer_element_size, char sim_name[64], time_t *creation_time)
 {
-*sectswritten = 0;
-return SCPE_IOERR;
-}
+VHDHANDLE hVHD  = (VHDHANDLE)f;
 
-static t_stat sim_vhd_disk_set_dtype (FILE *f, const char *dtype)
-{
-return SCPE_NOFNC;
+if (SectorSize)
+    *SectorSize = NtoHl (hVHD->Footer.DriveSectorSize);
+if (xfer_element_size)
+    *xfer_element_size = NtoHl (hVHD->Footer.DriveTransferElementSize);
+if (sim_name)
+    memcpy (sim_name, hVHD->Footer.CreatingSimulator, 64);
+if (creation_time)
+    *creation_time = (time_t)NtoHl (hVHD->Footer.TimeStamp) + 946684800;
+return (char *)(&hVHD->Footer.DriveType[0]);
 }
 
-static const char *sim_vhd_disk_get_dtype (FILE *f, uint32 *SectorSize, uint32 *xfer_element_size, char sim_name[64], time_t *creation_time)
-{
-*SectorSize = *xfer_element_size = 0;
-return NULL;
-}
+static FILE *sim_vhd_disk_open (const char *szVHDPath, const char *DesiredAccess)
+    {
+    VHDHANDLE hVHD = (VHDHANDLE) calloc (1, sizeof(*hVHD));
+    int NeedUpdate = FALSE;
+    int Status;
 
-#else
+    if (!hVHD)
+        return (FILE *)hVHD;
+    Status = GetVHDFooter (szVHDPath,
+                           &hVHD->Footer,
+                           &hVHD->Dynamic,
+                           &hVHD->BAT,
+                           NULL,
+                           hVHD->ParentVHDPath,
+                           sizeof (hVHD->ParentVHDPath));
+    if (Status)
+        goto Cleanup_Return;
+    if (NtoHl (hVHD->Footer.DiskType) == VHD_DT_Differencing) {
+        uint32 ParentModifiedTimeStamp;
+        VHD_Footer ParentFooter;
+        VHD_DynamicDiskHeader ParentDynamic;
 
-/*++
-    This code follows the details specified in the "Virtual Hard Disk Image
-    Format Specification", Version 1.0 October 11, 2006.  This format
-    specification is available for anyone to implement under the
-    "Microsoft Open Specification Promise" described at:
-        http://www.microsoft.com/interop/osp/default.mspx.
---*/
+        hVHD->Parent = (VHDHANDLE)sim_vhd_disk_open (hVHD->ParentVHDPath, "rb");
+        if (!hVHD->Parent) {
+            Status = errno;
+            goto Cleanup_Return;
+            }
+        Status = GetVHDFooter (hVHD->ParentVHDPath,
+                               &ParentFooter,
+                               &ParentDynamic,
+                               NULL,
+                               &ParentModifiedTimeStamp,
+                               NULL,
+                               0);
+        if (Status)
+            goto Cleanup_Return;
+        if ((0 != memcmp (hVHD->Dynamic.ParentUniqueID, ParentFooter.UniqueID, sizeof (ParentFooter.UniqueID))) ||
+            (ParentModifiedTimeStamp != hVHD->Dynamic.ParentTimeStamp)) {
+            if (sim_switches & SWMASK ('O')) {                      /* OVERRIDE consistency checks? */
+                if ((sim_switches & SWMASK ('U')) &&                /* FIX (UPDATE) consistency checks AND */
+                    (strchr (DesiredAccess, '+'))) {                /* open for write/update? */
+                    memcpy (hVHD->Dynamic.ParentUniqueID, ParentFooter.UniqueID, sizeof (ParentFooter.UniqueID));
+                    hVHD->Dynamic.ParentTimeStamp = ParentModifiedTimeStamp;
+                    hVHD->Dynamic.Checksum = 0;
+                    hVHD->Dynamic.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Dynamic, sizeof(hVHD->Dynamic)));
+                    NeedUpdate = TRUE;
+                    }
+                }
+            else {
+                Status = EBADF;
+                goto Cleanup_Return;
+                }
+            }
+        }
+    if (hVHD->Footer.SavedState) {
+        Status = EAGAIN;                                /* Busy */
+        goto Cleanup_Return;
+        }
+    hVHD->File = sim_fopen (szVHDPath, DesiredAccess);
+    if (!hVHD->File) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+Cleanup_Return:
+    if (Status) {
+        sim_vhd_disk_close ((FILE *)hVHD);
+        hVHD = NULL;
+        }
+    else {
+        if (NeedUpdate) {                               /* Update Differencing Disk Header? */
+            if (WriteFilePosition(hVHD->File,
+                                  &hVHD->Dynamic,
+                                  sizeof (hVHD->Dynamic),
+                                  NULL,
+                                  NtoHll (hVHD->Footer.DataOffset))) {
+                sim_vhd_disk_close ((FILE *)hVHD);
+                hVHD = NULL;
+                }
+            }
+        }
+    errno = Status;
+    return (FILE *)hVHD;
+    }
 
-typedef t_uint64    uint64;
-typedef t_int64     int64;
+static t_stat
+WriteVirtualDiskSectors(VHDHANDLE hVHD,
+                        uint8 *buf,
+                        t_seccnt sects,
+                        t_seccnt *sectswritten,
+                        uint32 SectorSize,
+                        t_lba lba);
 
-typedef struct _VHD_Footer {
-    /*
-    Cookies are used to uniquely identify the original creator of the hard disk
-    image. The values are case-sensitive.  Microsoft uses the "conectix" string
-    to identify this file as a hard disk image created by Microsoft Virtual
-    Server, Virtual PC, and predecessor products. The cookie is stored as an
-    eight-character ASCII string with the "c" in the first byte, the "o" in
-    the second byte, and so on.
-    */
-    char Cookie[8];
-    /*
-    This is a bit field used to indicate specific feature support. The following
-    table displays the list of features.
-    Any fields not listed are reserved.
+static FILE *sim_vhd_disk_merge (const char *szVHDPath, char **ParentVHD)
+    {
+    VHDHANDLE hVHD = (VHDHANDLE) calloc (1, sizeof(*hVHD));
+    VHDHANDLE Parent = NULL;
+    int Status;
+    uint32 SectorSize, SectorsPerBlock, BlockSize, BlockNumber, BitMapBytes, BitMapSectors, BlocksToMerge, NeededBlock;
+    uint64 BlockOffset;
+    uint32 BytesRead;
+    t_seccnt SectorsWritten;
+    void *BlockData = NULL;
 
-    Feature Value:
-       No features enabled     0x00000000
-       Temporary               0x00000001
-       Reserved                0x00000002
+    if (!hVHD)
+        return (FILE *)hVHD;
+    if (0 != (Status = GetVHDFooter (szVHDPath,
+                                     &hVHD->Footer,
+                                     &hVHD->Dynamic,
+                                     &hVHD->BAT,
+                                     NULL,
+                                     hVHD->ParentVHDPath,
+                                     sizeof (hVHD->ParentVHDPath))))
+        goto Cleanup_Return;
+    if (NtoHl (hVHD->Footer.DiskType) != VHD_DT_Differencing) {
+        Status = EINVAL;
+        goto Cleanup_Return;
+        }
+    if (hVHD->Footer.SavedState) {
+        Status = EAGAIN;                                /* Busy */
+        goto Cleanup_Return;
+        }
+    SectorSize = 512;
+    BlockSize = NtoHl (hVHD->Dynamic.BlockSize);
+    BlockData = malloc (BlockSize*SectorSize);
+    if (NULL == BlockData) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+    Parent = (VHDHANDLE)sim_vhd_disk_open (hVHD->ParentVHDPath, "rb+");
+    if (!Parent) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+    hVHD->File = sim_fopen (szVHDPath, "rb");
+    if (!hVHD->File) {
+        Status = errno;
+        goto Cleanup_Return;
+        }
+    SectorsPerBlock = NtoHl (hVHD->Dynamic.BlockSize)/SectorSize;
+    BitMapBytes = (7+(NtoHl (hVHD->Dynamic.BlockSize)/SectorSize))/8;
+    BitMapSectors = (BitMapBytes+SectorSize-1)/SectorSize;
+    for (BlockNumber=BlocksToMerge=0; BlockNumber< NtoHl (hVHD->Dynamic.MaxTableEntries); ++BlockNumber) {
+        if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY)
+            continue;
+        ++BlocksToMerge;
+        }
+    sim_messagef (SCPE_OK, "Merging %s\ninto %s\n", szVHDPath, hVHD->ParentVHDPath);
+    for (BlockNumber=NeededBlock=0; BlockNumber < NtoHl (hVHD->Dynamic.MaxTableEntries); ++BlockNumber) {
+        uint32 BlockSectors = SectorsPerBlock;
 
-       No features enabled.
-              The hard disk image has no special features enabled in it.
-       Temporary.
-              This bit is set if the current disk is a temporary disk. A
-              temporary disk designation indicates to an application that
-              this disk is a candidate for deletion on shutdown.
-       Reserved.
-              This bit must always be set to 1.
-       All other bits are also reserved and should be set to 0.
-    */
-    uint32 Features;
-    /*
-    This field is divided into a major/minor version and matches the version of
-    the specification used in creating the file. The most-significant two bytes
-    are for the major version. The least-significant two bytes are the minor
-    version.  This must match the file format specification. For the current
-    specification, this field must be initialized to 0x00010000.
-    The major version will be incremented only when the file format is modified
-    in such a way that it is no longer compatible with older versions of the
-    file format.
-    */
-    uint32 FileFormatVersion;
-    /*
-    This field holds the absolute byte offset, from the beginning of the file,
-    to the next structure. This field is used for dynamic disks and differencing
-    disks, but not fixed disks. For fixed disks, this field should be set to
-    0xFFFFFFFF.
-    */
-    uint64 DataOffset;
-    /*
-    This field stores the creation time of a hard disk image. This is the number
-    of seconds since January 1, 2000 12:00:00 AM in UTC/GMT.
-    */
-    uint32 TimeStamp;
-    /*
-    This field is used to document which application created the hard disk. The
-    field is a left-justified text field. It uses a single-byte character set.
-    If the hard disk is created by Microsoft Virtual PC, "vpc " is written in
-    this field. If the hard disk image is created by Microsoft Virtual Server,
-    then "vs  " is written in this field.
-    Other applications should use their own unique identifiers.
-    */
-    char CreatorApplication[4];
-    /*
-    This field holds the major/minor version of the application that created
-    the hard disk image.  Virtual Server 2004 sets this value to 0x00010000 and
-    Virtual PC 2004 sets this to 0x00050000.
-    */
-    uint32 CreatorVersion;
-    /*
-    This field stores the type of host operating system this disk image is
-    created on.
-       Host OS type    Value
-       Windows         0x5769326B (Wi2k)
-       Macintosh       0x4D616320 (Mac )
-    */
-    uint8 CreatorHostOS[4];
-    /*
-    This field stores the size of the hard disk in bytes, from the perspective
-    of the virtual machine, at creation time. This field is for informational
-    purposes.
-    */
-    uint64 OriginalSize;
-    /*
-    This field stores the current size of the hard disk, in bytes, from the
-    perspective of the virtual machine.
-    This value is same as the original size when the hard disk is created.
-    This value can change depending on whether the hard disk is expanded.
-    */
-    uint64 CurrentSize;
-    /*
-    This field stores the cylinder, heads, and sectors per track value for the
-    hard disk.
-       Disk Geometry field          Size (bytes)
-       Cylinder                     2
-       Heads                        1
-       Sectors per track/cylinder   1
+        if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY)
+            continue;
+        ++NeededBlock;
+        BlockOffset = SectorSize*((uint64)(NtoHl (hVHD->BAT[BlockNumber]) + BitMapSectors));
+        if (((uint64)BlockNumber*SectorsPerBlock + BlockSectors) > ((uint64)NtoHll (hVHD->Footer.CurrentSize))/SectorSize)
+            BlockSectors = (uint32)(((uint64)NtoHll (hVHD->Footer.CurrentSize))/SectorSize - (BlockNumber*SectorsPerBlock));
+        if (ReadFilePosition(hVHD->File,
+                             BlockData,
+                             SectorSize*BlockSectors,
+                             &BytesRead,
+                             BlockOffset))
+            break;
+        if (WriteVirtualDiskSectors (Parent,
+                                     (uint8*)BlockData,
+                                     BlockSectors,
+                                     &SectorsWritten,
+                                     SectorSize,
+                                     SectorsPerBlock*BlockNumber))
+            break;
+        sim_messagef (SCPE_OK, "Merged %dMB.  %d%% complete.\r", (int)((((float)NeededBlock)*SectorsPerBlock)*SectorSize/1000000), (int)((((float)NeededBlock)*100)/BlocksToMerge));
+        hVHD->BAT[BlockNumber] = VHD_BAT_FREE_ENTRY;
+        }
+    if (BlockNumber < NtoHl (hVHD->Dynamic.MaxTableEntries)) {
+        Status = errno;
+        }
+    else {
+        Status = 0;
+        sim_messagef (SCPE_OK, "Merged %dMB.  100%% complete.\n", (int)((((float)NeededBlock)*SectorsPerBlock)*SectorSize/1000000));
+        fclose (hVHD->File);
+        hVHD->File = NULL;
+        (void)remove (szVHDPath);
+        *ParentVHD = (char*) malloc (strlen (hVHD->ParentVHDPath)+1);
+        strcpy (*ParentVHD, hVHD->ParentVHDPath);
+        }
+Cleanup_Return:
+    free (BlockData);
+    if (hVHD->File)
+        fclose (hVHD->File);
+    if (Status) {
+        free (hVHD->BAT);
+        free (hVHD);
+        hVHD = NULL;
+        sim_vhd_disk_close ((FILE *)Parent);
+        }
+    else {
+        free (hVHD->BAT);
+        free (hVHD);
+        hVHD = Parent;
+        }
+    errno = Status;
+    return (FILE *)hVHD;
+    }
 
-    When a hard disk is configured as an ATA hard disk, the CHS values (that is,
-    Cylinder, Heads, Sectors per track) are used by the ATA controller to
-    determine the size of the disk. When the user creates a hard disk of a
-    certain size, the size of the hard disk image in the virtual machine is
-    smaller than that created by the user. This is because CHS value calculated
-    from the hard disk size is rounded down. The pseudo-code for the algorithm
-    used to determine the CHS values can be found in the appendix of this
-    document.
-    */
-    uint32 DiskGeometry;
-    /*
-       Disk Type field              Value
-       None                         0
-       Reserved (deprecated)        1
-       Fixed hard disk              2
-       Dynamic hard disk            3
-       Differencing hard disk       4
-       Reserved (deprecated)        5
-       Reserved (deprecated)        6
-    */
-    uint32 DiskType;
-    /*
-    This field holds a basic checksum of the hard disk footer. It is just a
-    one's complement of the sum of all the bytes in the footer without the
-    checksum field.
-    If the checksum verification fails, the Virtual PC and Virtual Server
-    products will instead use the header. If the checksum in the header also
-    fails, the file should be assumed to be corrupt. The pseudo-code for the
-    algorithm used to determine the checksum can be found in the appendix of
-    this document.
-    */
-    uint32 Checksum;
-    /*
-    Every hard disk has a unique ID stored in the hard disk. This is used to
-    identify the hard disk. This is a 128-bit universally unique identifier
-    (UUID). This field is used to associate a parent hard disk image with its
-    differencing hard disk image(s).
-    */
-    uint8 UniqueID[16];
-    /*
-    This field holds a one-byte flag that describes whether the system is in
-    saved state. If the hard disk is in the saved state the value is set to 1.
-    Operations such as compaction and expansion cannot be performed on a hard
-    disk in a saved state.
-    */
-    uint8 SavedState;
-    /*
-    This field contains zeroes. It is 427 bytes in size.
-    */
-    uint8 Reserved1[11];
-    /*
-    This field is an extension to the VHD spec and includes a simh drive type
-    name as a nul terminated string.
-    */
-    uint8 DriveType[16];
-    uint32 DriveSectorSize;
-    uint32 DriveTransferElementSize;
-    uint8 CreatingSimulator[64];
-    /*
-    This field contains zeroes. It is 328 bytes in size.
-    */
-    uint8 Reserved[328];
-    } VHD_Footer;
+static int sim_vhd_disk_close (FILE *f)
+{
+VHDHANDLE hVHD = (VHDHANDLE)f;
 
-/*
-For dynamic and differencing disk images, the "Data Offset" field within
-the image footer points to a secondary structure that provides additional
-information about the disk image. The dynamic disk header should appear on
-a sector (512-byte) boundary.
-*/
-typedef struct _VHD_DynamicDiskHeader {
-    /*
-    This field holds the value "cxsparse". This field identifies the header.
-    */
-    char Cookie[8];
-    /*
-    This field contains the absolute byte offset to the next structure in the
-    hard disk image. It is currently unused by existing formats and should be
-    set to 0xFFFFFFFF.
-    */
-    uint64 DataOffset;
-    /*
-    This field stores the absolute byte offset of the Block Allocation Table
-    (BAT) in the file.
-    */
-    uint64 TableOffset;
-    /*
-    This field stores the version of the dynamic disk header. The field is
-    divided into Major/Minor version. The least-significant two bytes represent
-    the minor version, and the most-significant two bytes represent the major
-    version. This must match with the file format specification. For this
-    specification, this field must be initialized to 0x00010000.
-    The major version will be incremented only when the header format is
-    modified in such a way that it is no longer compatible with older versions
-    of the product.
-    */
-    uint32 HeaderVersion;
-    /*
-    This field holds the maximum entries present in the BAT. This should be
-    equal to the number of blocks in the disk (that is, the disk size divided
-    by the block size).
-    */
-    uint32 MaxTableEntries;
-    /*
-    A block is a unit of expansion for dynamic and differencing hard disks. It
-    is stored in bytes. This size does not include the size of the block bitmap.
-    It is only the size of the data section of the block. The sectors per block
-    must always be a power of two. The default value is 0x00200000 (indicating a
-    block size of 2 MB).
-    */
-    uint32 BlockSize;
-    /*
-    This field holds a basic checksum of the dynamic header. It is a one's
-    complement of the sum of all the bytes in the header without the checksum
-    field.
-    If the checksum verification fails the file should be assumed to be corrupt.
-    */
-    uint32 Checksum;
-    /*
-    This field is used for differencing hard disks. A differencing hard disk
-    stores a 128-bit UUID of the parent hard disk. For more information, see
-    "Creating Differencing Hard Disk Images" later in this paper.
-    */
-    uint8 ParentUniqueID[16];
-    /*
-    This field stores the modification time stamp of the parent hard disk. This
-    is the number of seconds since January 1, 2000 12:00:00 AM in UTC/GMT.
-    */
-    uint32 ParentTimeStamp;
-    /*
-    This field should be set to zero.
-    */
-    uint32 Reserved0;
-    /*
-    This field contains a Unicode string (UTF-16) of the parent hard disk
-    filename.
-    */
-    char ParentUnicodeName[512];
-    /*
-    These entries store an absolute byte offset in the file where the parent
-    locator for a differencing hard disk is stored. This field is used only for
-    differencing disks and should be set to zero for dynamic disks.
-    */
-    struct VHD_ParentLocator {
-        /*
-        The platform code describes which platform-specific format is used for the
-        file locator. For Windows, a file locator is stored as a path (for example.
-        "c:\disksimages\ParentDisk.vhd"). On a Macintosh system, the file locator
-        is a binary large object (blob) that contains an "alias." The parent locator
-        table is used to support moving hard disk images across platforms.
-        Some current platform codes include the following:
-           Platform Code        Description
-           None (0x0)
-           Wi2r (0x57693272)    [deprecated]
-           Wi2k (0x5769326B)    [deprecated]
-           W2ru (0x57327275)    Unicode pathname (UTF-16) on Windows relative to the differencing disk pathname.
-           W2ku (0x57326B75)    Absolute Unicode (UTF-16) pathname on Windows.
-           Mac (0x4D616320)     (Mac OS alias stored as a blob)
-           MacX(0x4D616358)     A file URL with UTF-8 encoding conforming to RFC 2396.
-        */
-        uint8 PlatformCode[4];
-        /*
-        This field stores the number of 512-byte sectors needed to store the parent
-        hard disk locator.
-        */
-        uint32 PlatformDataSpace;
-        /*
-        This field stores the actual length of the parent hard disk locator in bytes.
-        */
-        uint32 PlatformDataLength;
-        /*
-        This field must be set to zero.
-        */
-        uint32 Reserved;
-        /*
-        This field stores the absolute file offset in bytes where the platform
-        specific file locator data is stored.
-        */
-        uint64 PlatformDataOffset;
-        /*
-        This field stores the absolute file offset in bytes where the platform
-        specific file locator data is stored.
-        */
-        } ParentLocatorEntries[8];
-    /*
-    This must be initialized to zeroes.
-    */
-    char Reserved[256];
-    } VHD_DynamicDiskHeader;
+if (NULL != hVHD) {
+    if (hVHD->Parent)
+        sim_vhd_disk_close ((FILE *)hVHD->Parent);
+    free (hVHD->BAT);
+    if (hVHD->File) {
+        fflush (hVHD->File);
+        fclose (hVHD->File);
+        }
+    free (hVHD);
+    return 0;
+    }
+return -1;
+}
 
-#define VHD_BAT_FREE_ENTRY (0xFFFFFFFF)
-#define VHD_DATA_BLOCK_ALIGNMENT ((uint64)4096)    /* Optimum when underlying storage has 4k sectors */
+static void sim_vhd_disk_flush (FILE *f)
+{
+VHDHANDLE hVHD = (VHDHANDLE)f;
 
-#define VHD_DT_Fixed                 2  /* Fixed hard disk */
-#define VHD_DT_Dynamic               3  /* Dynamic hard disk */
-#define VHD_DT_Differencing          4  /* Differencing hard disk */
+if ((NULL != hVHD) && (hVHD->File))
+    fflush (hVHD->File);
+}
 
-#define VHD_Internal_SectorSize     512
+static t_offset sim_vhd_disk_size (FILE *f)
+{
+VHDHANDLE hVHD = (VHDHANDLE)f;
 
-typedef struct VHD_IOData *VHDHANDLE;
+return (t_offset)(NtoHll (hVHD->Footer.CurrentSize));
+}
 
-static t_stat ReadFilePosition(FILE *File, void *buf, size_t bufsize, uint32 *bytesread, uint64 position)
+
+#include <stdlib.h>
+#include <time.h>
+static void
+_rand_uuid_gen (void *uuidaddr)
 {
-uint32 err = sim_fseeko (File, (t_offset)position, SEEK_SET);
-size_t i;
+int i;
+uint8 *b = (uint8 *)uuidaddr;
+uint32 timenow = (uint32)time (NULL);
 
-if (bytesread)
-    *bytesread = 0;
-if (!err) {
-    i = fread (buf, 1, bufsize, File);
-    if (bytesread)
-        *bytesread = (uint32)i;
-    err = ferror (File);
+memcpy (uuidaddr, &timenow, sizeof (timenow));
+srand ((unsigned)timenow);
+for (i=4; i<16; i++) {
+    b[i] = (uint8)rand();
     }
-return (err ? SCPE_IOERR : SCPE_OK);
 }
 
-static t_stat WriteFilePosition(FILE *File, void *buf, size_t bufsize, uint32 *byteswritten, uint64 position)
+#if defined (_WIN32)
+static void
+uuid_gen (void *uuidaddr)
 {
-uint32 err = sim_fseeko (File, (t_offset)position, SEEK_SET);
-size_t i;
+static
+RPC_STATUS
+(RPC_ENTRY *UuidCreate_c) (void *);
 
-if (byteswritten)
-    *byteswritten = 0;
-if (!err) {
-    i = fwrite (buf, 1, bufsize, File);
-    if (byteswritten)
-        *byteswritten = (uint32)i;
-    err = ferror (File);
+if (!UuidCreate_c) {
+    HINSTANCE hDll;
+    hDll = LoadLibraryA("rpcrt4.dll");
+    UuidCreate_c = (RPC_STATUS (RPC_ENTRY *) (void *))GetProcAddress(hDll, "UuidCreate");
     }
-return (err ? SCPE_IOERR : SCPE_OK);
+if (UuidCreate_c)
+    UuidCreate_c(uuidaddr);
+else
+    _rand_uuid_gen (uuidaddr);
 }
+#elif defined (SIM_HAVE_DLOPEN)
+#include <dlfcn.h>
 
-static uint32
-CalculateVhdFooterChecksum(void *data,
-                           size_t size)
+static void
+uuid_gen (void *uuidaddr)
 {
-uint32 sum = 0;
-uint8 *c = (uint8 *)data;
+void (*uuid_generate_c) (void *) = NULL;
+void *handle;
 
-while (size--)
-    sum += *c++;
-return ~sum;
+#define S__STR_QUOTE(tok) #tok
+#define S__STR(tok) S__STR_QUOTE(tok)
+    handle = dlopen("libuuid." S__STR(SIM_HAVE_DLOPEN), RTLD_NOW|RTLD_GLOBAL);
+    if (handle)
+        uuid_generate_c = (void (*)(void *))((size_t)dlsym(handle, "uuid_generate"));
+    if (uuid_generate_c)
+        uuid_generate_c(uuidaddr);
+    else
+        _rand_uuid_gen (uuidaddr);
+    if (handle)
+        dlclose(handle);
+}
+#else
+static void
+uuid_gen (void *uuidaddr)
+{
+_rand_uuid_gen (uuidaddr);
 }
-
-#if defined(_WIN32) || defined (__ALPHA) || defined (__ia64) || defined (VMS)
-#ifndef __BYTE_ORDER__
-#define __BYTE_ORDER__ __ORDER_LITTLE_ENDIAN__
-#endif
-#endif
-#ifndef __BYTE_ORDER__
-#define __BYTE_ORDER__ UNKNOWN
 #endif
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-static uint64
-NtoHll(uint64 value)
+
+static VHDHANDLE
+sim_CreateVirtualDisk(const char *szVHDPath,
+                      uint32 SizeInSectors,
+                      uint32 BlockSize,
+                      t_bool bFixedVHD)
 {
-uint8 *l = (uint8 *)&value;
-uint64 highresult = (uint64)l[3] | ((uint64)l[2]<<8) | ((uint64)l[1]<<16) | ((uint64)l[0]<<24);
-uint32 lowresult = (uint64)l[7] | ((uint64)l[6]<<8) | ((uint64)l[5]<<16) | ((uint64)l[4]<<24);
-return (highresult << 32) | lowresult;
+VHD_Footer Footer;
+VHD_DynamicDiskHeader Dynamic;
+uint32 *BAT = NULL;
+time_t now;
+uint32 i;
+FILE *File = NULL;
+uint32 Status = 0;
+uint32 BytesPerSector = 512;
+uint64 SizeInBytes = ((uint64)SizeInSectors) * BytesPerSector;
+uint64 TableOffset;
+uint32 MaxTableEntries;
+VHDHANDLE hVHD = NULL;
+
+if (SizeInBytes > ((uint64)(1024 * 1024 * 1024)) * 2040) {
+    Status = EFBIG;
+    goto Cleanup_Return;
+    }
+File = sim_fopen (szVHDPath, "rb");
+if (File) {
+    fclose (File);
+    File = NULL;
+    Status = EEXIST;
+    goto Cleanup_Return;
+    }
+File = sim_fopen (szVHDPath, "wb");
+if (!File) {
+    Status = errno;
+    goto Cleanup_Return;
+    }
+
+memset (&Footer, 0, sizeof(Footer));
+memcpy (Footer.Cookie, "conectix", 8);
+Footer.Features = NtoHl (0x00000002);;
+Footer.FileFormatVersion = NtoHl (0x00010000);;
+Footer.DataOffset = NtoHll (bFixedVHD ? ((long long)-1) : (long long)(sizeof(Footer)));
+time (&now);
+Footer.TimeStamp = NtoHl ((uint32)(now - 946684800));
+memcpy (Footer.CreatorApplication, "simh", 4);
+Footer.CreatorVersion = NtoHl (0x00040000);
+memcpy (Footer.CreatorHostOS, "Wi2k", 4);
+Footer.OriginalSize = NtoHll (SizeInBytes);
+Footer.CurrentSize = NtoHll (SizeInBytes);
+uuid_gen (Footer.UniqueID);
+Footer.DiskType = NtoHl (bFixedVHD ? VHD_DT_Fixed : VHD_DT_Dynamic);
+Footer.DiskGeometry = NtoHl (0xFFFF10FF);
+if (1) { /* CHS Calculation */
+    uint32 totalSectors = (uint32)(SizeInBytes/BytesPerSector);/* Total data sectors present in the disk image */
+    uint32 cylinders;                                          /* Number of cylinders present on the disk */
+    uint32 heads;                                              /* Number of heads present on the disk */
+    uint32 sectorsPerTrack;                                    /* Sectors per track on the disk */
+    uint32 cylinderTimesHeads;                                 /* Cylinders x heads */
+
+    if (totalSectors > 65535 * 16 * 255)
+        totalSectors = 65535 * 16 * 255;
+
+    if (totalSectors >= 65535 * 16 * 63) {
+        sectorsPerTrack = 255;
+        heads = 16;
+        cylinderTimesHeads = totalSectors / sectorsPerTrack;
+        }
+    else {
+        sectorsPerTrack = 17;
+        cylinderTimesHeads = totalSectors / sectorsPerTrack;
+
+        heads = (cylinderTimesHeads + 1023) / 1024;
+
+        if (heads < 4)
+            heads = 4;
+        if (cylinderTimesHeads >= (heads * 1024) || heads > 16)
+            {
+            sectorsPerTrack = 31;
+            heads = 16;
+            cylinderTimesHeads = totalSectors / sectorsPerTrack;
+            }
+        if (cylinderTimesHeads >= (heads * 1024))
+            {
+            sectorsPerTrack = 63;
+            heads = 16;
+            cylinderTimesHeads = totalSectors / sectorsPerTrack;
+            }
+        }
+    cylinders = (totalSectors + sectorsPerTrack * heads - 1) / (sectorsPerTrack * heads);
+    Footer.DiskGeometry = NtoHl ((cylinders<<16)|(heads<<8)|sectorsPerTrack);
+    }
+Footer.Checksum = NtoHl (CalculateVhdFooterChecksum(&Footer, sizeof(Footer)));
+
+if (bFixedVHD) {
+    if (WriteFilePosition(File,
+                          &Footer,
+                          sizeof(Footer),
+                          NULL,
+                          SizeInBytes))
+        Status = errno;
+    goto Cleanup_Return;
+    }
+
+/* Dynamic Disk */
+memset (&Dynamic, 0, sizeof(Dynamic));
+memcpy (Dynamic.Cookie, "cxsparse", 8);
+Dynamic.DataOffset = NtoHll ((uint64)0xFFFFFFFFFFFFFFFFLL);
+TableOffset = NtoHll(Footer.DataOffset)+sizeof(Dynamic);
+Dynamic.TableOffset = NtoHll (TableOffset);
+Dynamic.HeaderVersion = NtoHl (0x00010000);
+if (0 == BlockSize)
+    BlockSize = 2*1024*1024;
+Dynamic.BlockSize = NtoHl (BlockSize);
+MaxTableEntries = (uint32)((SizeInBytes+BlockSize-1)/BlockSize);
+Dynamic.MaxTableEntries = NtoHl (MaxTableEntries);
+Dynamic.Checksum = NtoHl (CalculateVhdFooterChecksum(&Dynamic, sizeof(Dynamic)));
+BAT = (uint32*) malloc (BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector));
+memset (BAT, 0, BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector));
+for (i=0; i<MaxTableEntries; ++i)
+    BAT[i] = VHD_BAT_FREE_ENTRY;
+
+if (WriteFilePosition(File,
+                      &Footer,
+                      sizeof(Footer),
+                      NULL,
+                      0)) {
+    Status = errno;
+    goto Cleanup_Return;
+    }
+if (WriteFilePosition(File,
+                      &Dynamic,
+                      sizeof(Dynamic),
+                      NULL,
+                      NtoHll(Footer.DataOffset))) {
+    Status = errno;
+    goto Cleanup_Return;
+    }
+if (WriteFilePosition(File,
+                      BAT,
+                      BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector),
+                      NULL,
+                      NtoHll(Dynamic.TableOffset))) {
+    Status = errno;
+    goto Cleanup_Return;
+    }
+if (WriteFilePosition(File,
+                      &Footer,
+                      sizeof(Footer),
+                      NULL,
+                      NtoHll(Dynamic.TableOffset)+BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector))) {
+    Status = errno;
+    goto Cleanup_Return;
+    }
+
+Cleanup_Return:
+free (BAT);
+if (File)
+    fclose (File);
+if (Status) {
+    if (Status != EEXIST)
+        (void)remove (szVHDPath);
+    }
+else {
+    hVHD = (VHDHANDLE)sim_vhd_disk_open (szVHDPath, "rb+");
+    if (!hVHD)
+        Status = errno;
+    }
+errno = Status;
+return hVHD;
 }
-#elif  __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-static uint64
-NtoHll(uint64 value)
+
+#if defined(__CYGWIN__) || defined(VMS) || defined(__APPLE__) || defined(__linux) || defined(__linux__) || defined(__unix__)
+#include <unistd.h>
+#endif
+static void
+ExpandToFullPath (const char *szFileSpec,
+                  char *szFullFileSpecBuffer,
+                  size_t BufferSize)
 {
-return value;
-}
+char *c;
+#ifdef _WIN32
+for (c = strchr (szFullFileSpecBuffer, '/'); c; c = strchr (szFullFileSpecBuffer, '/'))
+    *c = '\\';
+GetFullPathNameA (szFileSpec, (DWORD)BufferSize, szFullFileSpecBuffer, NULL);
+for (c = strchr (szFullFileSpecBuffer, '\\'); c; c = strchr (szFullFileSpecBuffer, '\\'))
+    *c = '/';
 #else
-static uint32
-NtoHl(uint32 value)
-{
-uint8 *l = (uint8 *)&value;
+char buffer[PATH_MAX];
+char *wd = getcwd(buffer, PATH_MAX);
 
-if (sim_end)
-    return l[3] | (l[2]<<8) | (l[1]<<16) | (l[0]<<24);
-return value;
+if ((szFileSpec[0] != '/') || (strchr (szFileSpec, ':')))
+    snprintf (szFullFileSpecBuffer, BufferSize, "%s/%s", wd, szFileSpec);
+else
+    strlcpy (szFullFileSpecBuffer, szFileSpec, BufferSize);
+if ((c = strstr (szFullFileSpecBuffer, "]/")))
+    memmove (c+1, c+2, strlen(c+2)+1);
+memset (szFullFileSpecBuffer + strlen (szFullFileSpecBuffer), 0, BufferSize - strlen (szFullFileSpecBuffer));
+#endif
 }
 
-static uint64
-NtoHll(uint64 value)
+static char *
+HostPathToVhdPath (const char *szHostPath,
+                   char *szVhdPath,
+                   size_t VhdPathSize)
 {
-uint8 *l = (uint8 *)&value;
+char *c, *d;
 
-if (sim_end) {
-    uint64 highresult = l[3] | (l[2]<<8) | (l[1]<<16) | (l[0]<<24);
-    uint32 lowresult = l[7] | (l[6]<<8) | (l[5]<<16) | (l[4]<<24);
-    return (highresult << 32) | lowresult;
+memset (szVhdPath, 0, VhdPathSize);
+strlcpy (szVhdPath, szHostPath, VhdPathSize-1);
+if ((szVhdPath[1] == ':') && islower(szVhdPath[0]))
+    szVhdPath[0] = toupper(szVhdPath[0]);
+szVhdPath[VhdPathSize-1] = '\0';
+if ((c = strrchr (szVhdPath, ']'))) {
+    *c = '\0';
+    if (!(d = strchr (szVhdPath, '[')))
+        return d;
+    *d = '/';
+    while ((d = strchr (d, '.')))
+        *d = '/';
+    *c = '/';
     }
-return value;
+while ((c = strchr (szVhdPath, '/')))
+    *c = '\\';
+for (c = strstr (szVhdPath, "\\.\\"); c; c = strstr (szVhdPath, "\\.\\"))
+    memmove (c, c+2, strlen(c+2)+1);
+for (c = strstr (szVhdPath, "\\\\"); c; c = strstr (szVhdPath, "\\\\"))
+    memmove (c, c+1, strlen(c+1)+1);
+while ((c = strstr (szVhdPath, "\\..\\"))) {
+    *c = '\0';
+    d = strrchr (szVhdPath, '\\');
+    if (d)
+        memmove (d, c+3, strlen(c+3)+1);
+    else
+        return d;
+    }
+memset (szVhdPath + strlen (szVhdPath), 0, VhdPathSize - strlen (szVhdPath));
+return szVhdPath;
 }
+
+static char *
+VhdPathToHostPath (const char *szVhdPath,
+                   char *szHostPath,
+                   size_t HostPathSize)
+{
+char *c;
+char *d = szHostPath;
+
+memmove (szHostPath, szVhdPath, HostPathSize);
+szHostPath[HostPathSize-1] = '\0';
+#if defined(VMS)
+c = strchr (szHostPath, ':');
+if (*(c+1) != '\\')
+    return NULL;
+*(c+1) = '[';
+d = strrchr (c+2, '\\');
+if (d) {
+    *d = ']';
+    while ((d = strrchr (c+2, '\\')))
+        *d = '.';
+    }
+else
+    return NULL;
+#else
+while ((c = strchr (d, '\\')))
+    *c = '/';
 #endif
+memset (szHostPath + strlen (szHostPath), 0, HostPathSize - strlen (szHostPath));
+return szHostPath;
+}
 
-static
-int
-GetVHDFooter(const char *szVHDPath,
-             VHD_Footer *sFooter,
-             VHD_DynamicDiskHeader *sDynamic,
-             uint32 **aBAT,
-             uint32 *ModifiedTimeStamp,
-             char *szParentVHDPath,
-             size_t ParentVHDPathSize)
+static VHDHANDLE
+CreateDifferencingVirtualDisk(const char *szVHDPath,
+                              const char *szParentVHDPath)
 {
-FILE *File = NULL;
-uint64 position;
-uint32 sum, saved_sum;
-int Return = 0;
-VHD_Footer sHeader;
-struct stat statb;
+uint32 BytesPerSector = 512;
+VHDHANDLE hVHD = NULL;
+VHD_Footer ParentFooter;
+VHD_DynamicDiskHeader ParentDynamic;
+uint32 ParentTimeStamp;
+uint32 Status = 0;
+char *RelativeParentVHDPath = NULL;
+char *FullParentVHDPath = NULL;
+char *RelativeParentVHDPathUnicode = NULL;
+char *FullParentVHDPathUnicode = NULL;
+char *FullVHDPath = NULL;
+char *TempPath = NULL;
+size_t i, RelativeMatch, UpDirectories, LocatorsWritten = 0;
+int64 LocatorPosition;
 
-memset(sFooter, '\0', sizeof(*sFooter));
-if (sDynamic)
-    memset(sDynamic, '\0', sizeof(*sDynamic));
-if (aBAT)
-    *aBAT = NULL;
-File = sim_fopen (szVHDPath, "rb");
-if (!File) {
-    Return = errno;
-    goto Return_Cleanup;
+if ((Status = GetVHDFooter (szParentVHDPath,
+                            &ParentFooter,
+                            &ParentDynamic,
+                            NULL,
+                            &ParentTimeStamp,
+                            NULL,
+                            0)))
+    goto Cleanup_Return;
+hVHD = sim_CreateVirtualDisk (szVHDPath,
+                              (uint32)(NtoHll(ParentFooter.CurrentSize)/BytesPerSector),
+                              NtoHl(ParentDynamic.BlockSize),
+                              FALSE);
+if (!hVHD) {
+    Status = errno;
+    goto Cleanup_Return;
     }
-if (ModifiedTimeStamp) {
-    if (fstat (fileno (File), &statb)) {
-        Return = errno;
-        goto Return_Cleanup;
+LocatorPosition = ((sizeof (hVHD->Footer) + BytesPerSector - 1)/BytesPerSector + (sizeof (hVHD->Dynamic) + BytesPerSector - 1)/BytesPerSector)*BytesPerSector;
+hVHD->Dynamic.Checksum = 0;
+RelativeParentVHDPath = (char*) calloc (1, BytesPerSector+2);
+FullParentVHDPath = (char*) calloc (1, BytesPerSector+2);
+RelativeParentVHDPathUnicode = (char*) calloc (1, BytesPerSector+2);
+FullParentVHDPathUnicode = (char*) calloc (1, BytesPerSector+2);
+FullVHDPath = (char*) calloc (1, BytesPerSector+2);
+TempPath = (char*) calloc (1, BytesPerSector+2);
+ExpandToFullPath (szParentVHDPath, TempPath, BytesPerSector);
+HostPathToVhdPath (TempPath, FullParentVHDPath, BytesPerSector);
+for (i=0; i < strlen (FullParentVHDPath); i++)
+    hVHD->Dynamic.ParentUnicodeName[i*2+1] = FullParentVHDPath[i];  /* Big Endian Unicode */
+for (i=0; i < strlen (FullParentVHDPath); i++)
+    FullParentVHDPathUnicode[i*2] = FullParentVHDPath[i];           /* Little Endian Unicode */
+ExpandToFullPath (szVHDPath, TempPath, BytesPerSector);
+HostPathToVhdPath (TempPath, FullVHDPath, BytesPerSector);
+for (i=0, RelativeMatch=UpDirectories=0; i<strlen(FullVHDPath); i++)
+    if (FullVHDPath[i] == '\\') {
+        if (memcmp (FullVHDPath, FullParentVHDPath, i+1))
+            ++UpDirectories;
+        else
+            RelativeMatch = i;
         }
+if (RelativeMatch) {
+    char UpDir[4] = "..\\";
+
+    UpDir[2] = FullParentVHDPath[RelativeMatch];
+    if (UpDirectories)
+        for (i=0; i<UpDirectories; i++)
+            strcpy (RelativeParentVHDPath+strlen (RelativeParentVHDPath), UpDir);
     else
-        *ModifiedTimeStamp = NtoHl ((uint32)(statb.st_mtime-946684800));
-    }
-position = sim_fsize_ex (File);
-if (((int64)position) == -1) {
-    Return = errno;
-    goto Return_Cleanup;
+        strcpy (RelativeParentVHDPath+strlen (RelativeParentVHDPath), UpDir+1);
+    strcpy (RelativeParentVHDPath+strlen (RelativeParentVHDPath), &FullParentVHDPath[RelativeMatch+1]);
     }
-position -= sizeof(*sFooter);
-if (ReadFilePosition(File,
-                     sFooter,
-                     sizeof(*sFooter),
-                     NULL,
-                     position)) {
-    Return = errno;
-    goto Return_Cleanup;
+for (i=0; i < strlen(RelativeParentVHDPath); i++)
+    RelativeParentVHDPathUnicode[i*2] = RelativeParentVHDPath[i];
+hVHD->Dynamic.ParentTimeStamp = ParentTimeStamp;
+memcpy (hVHD->Dynamic.ParentUniqueID, ParentFooter.UniqueID, sizeof (hVHD->Dynamic.ParentUniqueID));
+/* There are two potential parent locators on current vhds */
+memcpy (hVHD->Dynamic.ParentLocatorEntries[0].PlatformCode, "W2ku", 4);
+hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataSpace = NtoHl (BytesPerSector);
+hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataLength = NtoHl ((uint32)(2*strlen(FullParentVHDPath)));
+hVHD->Dynamic.ParentLocatorEntries[0].Reserved = 0;
+hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataOffset = NtoHll (LocatorPosition+LocatorsWritten*BytesPerSector);
+++LocatorsWritten;
+if (RelativeMatch) {
+    memcpy (hVHD->Dynamic.ParentLocatorEntries[1].PlatformCode, "W2ru", 4);
+    hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataSpace = NtoHl (BytesPerSector);
+    hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataLength = NtoHl ((uint32)(2*strlen(RelativeParentVHDPath)));
+    hVHD->Dynamic.ParentLocatorEntries[1].Reserved = 0;
+    hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataOffset = NtoHll (LocatorPosition+LocatorsWritten*BytesPerSector);
+    ++LocatorsWritten;
     }
-saved_sum = NtoHl(sFooter->Checksum);
-sFooter->Checksum = 0;
-sum = CalculateVhdFooterChecksum(sFooter, sizeof(*sFooter));
-sFooter->Checksum = NtoHl(saved_sum);
-if ((sum != saved_sum) || (memcmp("conectix", sFooter->Cookie, sizeof(sFooter->Cookie)))) {
-    Return = EINVAL;                                    /* File Corrupt */
-    goto Return_Cleanup;
+hVHD->Dynamic.TableOffset = NtoHll (((LocatorPosition+LocatorsWritten*BytesPerSector + VHD_DATA_BLOCK_ALIGNMENT - 1)/VHD_DATA_BLOCK_ALIGNMENT)*VHD_DATA_BLOCK_ALIGNMENT);
+hVHD->Dynamic.Checksum = 0;
+hVHD->Dynamic.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Dynamic, sizeof(hVHD->Dynamic)));
+hVHD->Footer.Checksum = 0;
+hVHD->Footer.DiskType = NtoHl (VHD_DT_Differencing);
+memcpy (hVHD->Footer.DriveType, ParentFooter.DriveType, sizeof (hVHD->Footer.DriveType));
+hVHD->Footer.DriveSectorSize = ParentFooter.DriveSectorSize;
+hVHD->Footer.DriveTransferElementSize = ParentFooter.DriveTransferElementSize;
+hVHD->Footer.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Footer, sizeof(hVHD->Footer)));
+
+if (WriteFilePosition (hVHD->File,
+                       &hVHD->Footer,
+                       sizeof (hVHD->Footer),
+                       NULL,
+                       0)) {
+    Status = errno;
+    goto Cleanup_Return;
     }
-if (ReadFilePosition(File,
-                     &sHeader,
-                     sizeof(sHeader),
-                     NULL,
-                     (uint64)0)) {
-    Return = errno;
-    goto Return_Cleanup;
+if (WriteFilePosition (hVHD->File,
+                       &hVHD->Dynamic,
+                       sizeof (hVHD->Dynamic),
+                       NULL,
+                       NtoHll (hVHD->Footer.DataOffset))) {
+    Status = errno;
+    goto Cleanup_Return;
     }
-if ((NtoHl(sFooter->DiskType) != VHD_DT_Dynamic) &&
-    (NtoHl(sFooter->DiskType) != VHD_DT_Differencing) &&
-    (NtoHl(sFooter->DiskType) != VHD_DT_Fixed)) {
-    Return = EINVAL;                                    /* File Corrupt */
-    goto Return_Cleanup;
+if (WriteFilePosition (hVHD->File,
+                       hVHD->BAT,
+                       BytesPerSector*((NtoHl (hVHD->Dynamic.MaxTableEntries)*sizeof(*hVHD->BAT)+BytesPerSector-1)/BytesPerSector),
+                       NULL,
+                       NtoHll (hVHD->Dynamic.TableOffset))) {
+    Status = errno;
+    goto Cleanup_Return;
     }
-if (((NtoHl(sFooter->DiskType) == VHD_DT_Dynamic) ||
-     (NtoHl(sFooter->DiskType) == VHD_DT_Differencing)) &&
-     memcmp(sFooter, &sHeader, sizeof(sHeader))) {
-    Return = EINVAL;                                    /* File Corrupt */
-    goto Return_Cleanup;
+if (WriteFilePosition (hVHD->File,
+                       &hVHD->Footer,
+                       sizeof (hVHD->Footer),
+                       NULL,
+                       NtoHll (hVHD->Dynamic.TableOffset)+BytesPerSector*((NtoHl (hVHD->Dynamic.MaxTableEntries)*sizeof(*hVHD->BAT)+BytesPerSector-1)/BytesPerSector))) {
+    Status = errno;
+    goto Cleanup_Return;
     }
-if ((sDynamic) &&
-    ((NtoHl(sFooter->DiskType) == VHD_DT_Dynamic) ||
-     (NtoHl(sFooter->DiskType) == VHD_DT_Differencing))) {
-    if (ReadFilePosition(File,
-                         sDynamic,
-                         sizeof (*sDynamic),
-                         NULL,
-                         NtoHll (sFooter->DataOffset))) {
-        Return = errno;
-        goto Return_Cleanup;
-        }
-    saved_sum = NtoHl (sDynamic->Checksum);
-    sDynamic->Checksum = 0;
-    sum = CalculateVhdFooterChecksum (sDynamic, sizeof(*sDynamic));
-    sDynamic->Checksum = NtoHl (saved_sum);
-    if ((sum != saved_sum) || (memcmp ("cxsparse", sDynamic->Cookie, sizeof (sDynamic->Cookie)))) {
-        Return = errno;
-        goto Return_Cleanup;
+if (hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataLength)
+    if (WriteFilePosition (hVHD->File,
+                           FullParentVHDPathUnicode,
+                           BytesPerSector,
+                           NULL,
+                           NtoHll (hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataOffset))) {
+        Status = errno;
+        goto Cleanup_Return;
         }
-    if (aBAT) {
-        *aBAT = (uint32*) calloc(1, VHD_Internal_SectorSize * ((sizeof(**aBAT) * NtoHl(sDynamic->MaxTableEntries) + VHD_Internal_SectorSize - 1) / VHD_Internal_SectorSize));
-        if (ReadFilePosition(File,
-                             *aBAT,
-                             sizeof (**aBAT) * NtoHl(sDynamic->MaxTableEntries),
-                             NULL,
-                             NtoHll (sDynamic->TableOffset))) {
-            Return = EINVAL;                            /* File Corrupt */
-            goto Return_Cleanup;
-            }
+if (hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataLength)
+    if (WriteFilePosition (hVHD->File,
+                           RelativeParentVHDPathUnicode,
+                           BytesPerSector,
+                           NULL,
+                           NtoHll (hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataOffset))) {
+        Status = errno;
+        goto Cleanup_Return;
         }
-    if (szParentVHDPath && ParentVHDPathSize) {
-        VHD_Footer sParentFooter;
 
-        memset (szParentVHDPath, '\0', ParentVHDPathSize);
-        if (NtoHl (sFooter->DiskType) == VHD_DT_Differencing) {
-            size_t i, j;
+Cleanup_Return:
+free (RelativeParentVHDPath);
+free (FullParentVHDPath);
+free (RelativeParentVHDPathUnicode);
+free (FullParentVHDPathUnicode);
+free (FullVHDPath);
+free (TempPath);
+sim_vhd_disk_close ((FILE *)hVHD);
+hVHD = NULL;
+if (Status) {
+    if ((EEXIST != Status) && (ENOENT != Status))
+        (void)remove (szVHDPath);
+    }
+else {
+    hVHD = (VHDHANDLE)sim_vhd_disk_open (szVHDPath, "rb+");
+    if (!hVHD)
+        Status = errno;
+    }
+errno = Status;
+return hVHD;
+}
 
-            for (j=0; j<8; ++j) {
-                uint8 *Pdata;
-                uint32 PdataSize;
-                char ParentName[512];
-                char CheckPath[512];
-                uint32 ParentModificationTime;
+static FILE *sim_vhd_disk_create (const char *szVHDPath, t_offset desiredsize)
+{
+return (FILE *)sim_CreateVirtualDisk (szVHDPath, (uint32)(desiredsize/512), 0, (sim_switches & SWMASK ('X')));
+}
 
-                if ('\0' == sDynamic->ParentLocatorEntries[j].PlatformCode[0])
-                    continue;
-                memset (ParentName, '\0', sizeof(ParentName));
-                memset (CheckPath, '\0', sizeof(CheckPath));
-                PdataSize = NtoHl(sDynamic->ParentLocatorEntries[j].PlatformDataSpace);
-                Pdata = (uint8*) calloc (1, PdataSize+2);
-                if (!Pdata)
-                    continue;
-                if (ReadFilePosition(File,
-                                     Pdata,
-                                     PdataSize,
-                                     NULL,
-                                     NtoHll (sDynamic->ParentLocatorEntries[j].PlatformDataOffset))) {
-                    free (Pdata);
-                    continue;
-                    }
-                for (i=0; i<NtoHl(sDynamic->ParentLocatorEntries[j].PlatformDataLength); i+=2)
-                    if ((Pdata[i] == '\0') && (Pdata[i+1] == '\0')) {
-                        ParentName[i/2] = '\0';
-                        break;
-                        }
-                    else
-                        ParentName[i/2] = Pdata[i] ? Pdata[i] : Pdata[i+1];
-                free (Pdata);
-                memset (CheckPath, 0, sizeof (CheckPath));
-                if (0 == memcmp (sDynamic->ParentLocatorEntries[j].PlatformCode, "W2ku", 4))
-                    strlcpy (CheckPath, ParentName, sizeof (CheckPath));
-                else
-                    if (0 == memcmp (sDynamic->ParentLocatorEntries[j].PlatformCode, "W2ru", 4)) {
-                        const char *c;
+static FILE *sim_vhd_disk_create_diff (const char *szVHDPath, const char *szParentVHDPath)
+{
+return (FILE *)CreateDifferencingVirtualDisk (szVHDPath, szParentVHDPath);
+}
 
-                        if ((c = strrchr (szVHDPath, '\\'))) {
-                            memcpy (CheckPath, szVHDPath, c-szVHDPath+1);
-                            strlcat (CheckPath, ParentName, sizeof (CheckPath));
-                            }
-                        }
-                VhdPathToHostPath (CheckPath, CheckPath, sizeof (CheckPath));
-                if (0 == GetVHDFooter(CheckPath,
-                                      &sParentFooter,
-                                      NULL,
-                                      NULL,
-                                      &ParentModificationTime,
-                                      NULL,
-                                      0)) {
-                    if ((0 == memcmp (sDynamic->ParentUniqueID, sParentFooter.UniqueID, sizeof (sParentFooter.UniqueID))) &&
-                        ((sDynamic->ParentTimeStamp == ParentModificationTime) ||
-                         ((NtoHl(sDynamic->ParentTimeStamp)-NtoHl(ParentModificationTime)) == 3600) ||
-                         (sim_switches & SWMASK ('O')))) {
-                         memset (szParentVHDPath, 0, ParentVHDPathSize);
-                         strlcpy (szParentVHDPath, CheckPath, ParentVHDPathSize);
-                        }
-                    else {
-                        if (0 != memcmp (sDynamic->ParentUniqueID, sParentFooter.UniqueID, sizeof (sParentFooter.UniqueID)))
-                            sim_printf ("Error Invalid Parent VHD '%s' for Differencing VHD: %s\n", CheckPath, szVHDPath);
-                        else
-                            sim_printf ("Error Parent VHD '%s' has been modified since Differencing VHD: %s was created\n", CheckPath, szVHDPath);
-                        Return = EINVAL;                /* File Corrupt/Invalid */
-                        }
-                    break;
-                    }
-                else {
-                    struct stat statb;
+static t_stat
+ReadVirtualDisk(VHDHANDLE hVHD,
+                uint8 *buf,
+                uint32 BytesToRead,
+                uint32 *BytesRead,
+                uint64 Offset)
+{
+uint32 TotalBytesRead = 0;
+uint32 BitMapBytes;
+uint32 BitMapSectors;
+uint32 DynamicBlockSize;
+t_stat r = SCPE_OK;
 
-                    if (0 == stat (CheckPath, &statb)) {
-                        sim_printf ("Parent VHD '%s' corrupt for Differencing VHD: %s\n", CheckPath, szVHDPath);
-                        Return = EBADF;                /* File Corrupt/Invalid */
-                        break;
-                        }
-                    }
-                }
-            if (!*szParentVHDPath) {
-                if (Return != EINVAL)                   /* File Not Corrupt? */
-                    sim_printf ("Missing Parent VHD for Differencing VHD: %s\n", szVHDPath);
-                Return = EBADF;
-                }
+if (BytesRead)
+    *BytesRead = 0;
+if (!hVHD || (hVHD->File == NULL)) {
+    errno = EBADF;
+    return SCPE_IOERR;
+    }
+if (BytesToRead == 0)
+    return SCPE_OK;
+if (Offset >= (uint64)NtoHll (hVHD->Footer.CurrentSize)) {
+    errno = ERANGE;
+    return SCPE_IOERR;
+    }
+if (NtoHl (hVHD->Footer.DiskType) == VHD_DT_Fixed) {
+    if (ReadFilePosition(hVHD->File,
+                         buf,
+                         BytesToRead,
+                         BytesRead,
+                         Offset))
+        r = SCPE_IOERR;
+    return r;
+    }
+/* We are now dealing with a Dynamically expanding or differencing disk */
+DynamicBlockSize = NtoHl (hVHD->Dynamic.BlockSize);
+if ((DynamicBlockSize == 0) ||
+    ((DynamicBlockSize & (DynamicBlockSize - 1)) != 0)) {
+    errno = ERANGE;
+    return SCPE_IOERR;
+    }
+BitMapBytes = (7+(DynamicBlockSize / VHD_Internal_SectorSize))/8;
+BitMapSectors = (BitMapBytes+VHD_Internal_SectorSize-1)/VHD_Internal_SectorSize;
+while (BytesToRead && (r == SCPE_OK)) {
+    uint32 BlockNumber = (uint32)(Offset / DynamicBlockSize);
+    uint32 BytesInRead = BytesToRead;
+    uint32 BytesThisRead = 0;
+
+    if (BlockNumber != (Offset + BytesToRead) / DynamicBlockSize)
+        BytesInRead = (uint32)(((BlockNumber + 1) * DynamicBlockSize) - Offset);
+    if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
+        if (!hVHD->Parent) {
+            memset (buf, 0, BytesInRead);
+            BytesThisRead = BytesInRead;
+            }
+        else {
+            if (ReadVirtualDisk(hVHD->Parent,
+                                buf,
+                                BytesInRead,
+                                &BytesThisRead,
+                                Offset))
+                r = SCPE_IOERR;
             }
         }
+    else {
+        uint64 BlockOffset = VHD_Internal_SectorSize * ((uint64)(NtoHl (hVHD->BAT[BlockNumber]) + BitMapSectors)) + (Offset % DynamicBlockSize);
+
+        if (ReadFilePosition(hVHD->File,
+                             buf,
+                             BytesInRead,
+                             &BytesThisRead,
+                             BlockOffset))
+            r = SCPE_IOERR;
+        }
+    BytesToRead -= BytesThisRead;
+    buf = (uint8 *)(((char *)buf) + BytesThisRead);
+    Offset += BytesThisRead;
+    TotalBytesRead += BytesThisRead;
     }
-Return_Cleanup:
-if (File)
-    fclose(File);
-if (aBAT && (0 != Return)) {
-    free (*aBAT);
-    *aBAT = NULL;
-    }
-return errno = Return;
+if (BytesRead)
+    *BytesRead = TotalBytesRead;
+return SCPE_OK;
 }
 
-struct VHD_IOData {
-    VHD_Footer Footer;
-    VHD_DynamicDiskHeader Dynamic;
-    uint32 *BAT;
-    FILE *File;
-    char ParentVHDPath[512];
-    struct VHD_IOData *Parent;
-    };
-
-static t_stat sim_vhd_disk_implemented (void)
+static t_stat
+ReadVirtualDiskSectors(VHDHANDLE hVHD,
+                       uint8 *buf,
+                       t_seccnt sects,
+                       t_seccnt *sectsread,
+                       uint32 SectorSize,
+                       t_lba lba)
 {
-return SCPE_OK;
+uint32 BytesRead;
+t_stat r = ReadVirtualDisk(hVHD,
+                           buf,
+                           sects * SectorSize,
+                           &BytesRead,
+                           SectorSize * (uint64)lba);
+if (sectsread)
+    *sectsread = BytesRead / SectorSize;
+return r;
 }
 
-static t_stat sim_vhd_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_element_size)
+static t_stat sim_vhd_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
 {
-VHDHANDLE hVHD  = (VHDHANDLE)f;
-int Status = 0;
+VHDHANDLE hVHD = (VHDHANDLE)uptr->fileref;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-memset (hVHD->Footer.DriveType, '\0', sizeof hVHD->Footer.DriveType);
-memcpy (hVHD->Footer.DriveType, dtype, ((1+strlen (dtype)) < sizeof (hVHD->Footer.DriveType)) ? (1+strlen (dtype)) : sizeof (hVHD->Footer.DriveType));
-hVHD->Footer.DriveSectorSize = NtoHl (SectorSize);
-hVHD->Footer.DriveTransferElementSize = NtoHl (xfer_element_size);
-hVHD->Footer.CreatingSimulator[sizeof (hVHD->Footer.CreatingSimulator) - 1] = '\0';  /* Force NUL termination */
-memset (hVHD->Footer.CreatingSimulator, 0, sizeof (hVHD->Footer.CreatingSimulator));
-strlcpy ((char *)hVHD->Footer.CreatingSimulator, sim_name, sizeof (hVHD->Footer.CreatingSimulator));
-hVHD->Footer.Checksum = 0;
-hVHD->Footer.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Footer, sizeof(hVHD->Footer)));
+return ReadVirtualDiskSectors(hVHD, buf, sects, sectsread, ctx->sector_size, lba);
+}
 
-if (NtoHl (hVHD->Footer.DiskType) == VHD_DT_Fixed) {
-    if (WriteFilePosition(hVHD->File,
-                          &hVHD->Footer,
-                          sizeof(hVHD->Footer),
-                          NULL,
-                          NtoHll (hVHD->Footer.CurrentSize)))
-        Status = errno;
-    goto Cleanup_Return;
-    }
-else {
-    uint64 position;
+static t_stat sim_vhd_disk_clearerr (UNIT *uptr)
+{
+VHDHANDLE hVHD = (VHDHANDLE)uptr->fileref;
 
-    position = sim_fsize_ex (hVHD->File);
-    if (((int64)position) == -1) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-    position -= sizeof(hVHD->Footer);
-    /* Update both copies on a dynamic disk */
-    if (WriteFilePosition(hVHD->File,
-                          &hVHD->Footer,
-                          sizeof(hVHD->Footer),
-                          NULL,
-                          (uint64)0)) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-    if (WriteFilePosition(hVHD->File,
-                          &hVHD->Footer,
-                          sizeof(hVHD->Footer),
-                          NULL,
-                          position)) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-    }
-Cleanup_Return:
-if (Status)
-    return SCPE_IOERR;
+clearerr (hVHD->File);
 return SCPE_OK;
 }
 
-static const char *sim_vhd_disk_get_dtype (FILE *f, uint32 *SectorSize, uint32 *xfer_element_size, char sim_name[64], time_t *creation_time)
+static t_bool
+BufferIsZeros(void *Buffer, size_t BufferSize)
 {
-VHDHANDLE hVHD  = (VHDHANDLE)f;
+size_t i;
+char *c = (char *)Buffer;
 
-if (SectorSize)
-    *SectorSize = NtoHl (hVHD->Footer.DriveSectorSize);
-if (xfer_element_size)
-    *xfer_element_size = NtoHl (hVHD->Footer.DriveTransferElementSize);
-if (sim_name)
-    memcpy (sim_name, hVHD->Footer.CreatingSimulator, 64);
-if (creation_time)
-    *creation_time = (time_t)NtoHl (hVHD->Footer.TimeStamp) + 946684800;
-return (char *)(&hVHD->Footer.DriveType[0]);
+for (i=0; i<BufferSize; ++i)
+    if (c[i])
+        return FALSE;
+return TRUE;
 }
 
-static FILE *sim_vhd_disk_open (const char *szVHDPath, const char *DesiredAccess)
-    {
-    VHDHANDLE hVHD = (VHDHANDLE) calloc (1, sizeof(*hVHD));
-    int NeedUpdate = FALSE;
-    int Status;
+static t_stat
+WriteVirtualDisk(VHDHANDLE hVHD,
+                 uint8 *buf,
+                 uint32 BytesToWrite,
+                 uint32 *BytesWritten,
+                 uint64 Offset)
+{
+uint32 TotalBytesWritten = 0;
+uint32 BitMapBytes;
+uint32 BitMapSectors;
+uint32 DynamicBlockSize;
+t_stat r = SCPE_OK;
 
-    if (!hVHD)
-        return (FILE *)hVHD;
-    Status = GetVHDFooter (szVHDPath,
-                           &hVHD->Footer,
-                           &hVHD->Dynamic,
-                           &hVHD->BAT,
-                           NULL,
-                           hVHD->ParentVHDPath,
-                           sizeof (hVHD->ParentVHDPath));
-    if (Status)
-        goto Cleanup_Return;
-    if (NtoHl (hVHD->Footer.DiskType) == VHD_DT_Differencing) {
-        uint32 ParentModifiedTimeStamp;
-        VHD_Footer ParentFooter;
-        VHD_DynamicDiskHeader ParentDynamic;
+if (BytesWritten)
+    *BytesWritten = 0;
+if (!hVHD || !hVHD->File) {
+    errno = EBADF;
+    return SCPE_IOERR;
+    }
+if (BytesToWrite == 0)
+    return SCPE_OK;
+if (Offset >= (uint64)NtoHll(hVHD->Footer.CurrentSize)) {
+    errno = ERANGE;
+    return SCPE_IOERR;
+    }
+if (NtoHl(hVHD->Footer.DiskType) == VHD_DT_Fixed) {
+    if (WriteFilePosition(hVHD->File,
+                          buf,
+                          BytesToWrite,
+                          BytesWritten,
+                          Offset))
+        r = SCPE_IOERR;
+    return r;
+    }
+/* We are now dealing with a Dynamically expanding or differencing disk */
+DynamicBlockSize = NtoHl (hVHD->Dynamic.BlockSize);
+if ((DynamicBlockSize == 0) ||
+    ((DynamicBlockSize & (DynamicBlockSize - 1)) != 0)) {
+    errno = ERANGE;
+    return SCPE_IOERR;
+    }
+BitMapBytes = (7 + (DynamicBlockSize / VHD_Internal_SectorSize)) / 8;
+BitMapSectors = (BitMapBytes + VHD_Internal_SectorSize - 1) / VHD_Internal_SectorSize;
+while (BytesToWrite && (r == SCPE_OK)) {
+    uint32 BlockNumber = (uint32)(Offset / DynamicBlockSize);
+    uint32 BytesInWrite = BytesToWrite;
+    uint32 BytesThisWrite = 0;
 
-        hVHD->Parent = (VHDHANDLE)sim_vhd_disk_open (hVHD->ParentVHDPath, "rb");
-        if (!hVHD->Parent) {
-            Status = errno;
-            goto Cleanup_Return;
+    if (BlockNumber >= NtoHl(hVHD->Dynamic.MaxTableEntries)) {
+        return SCPE_EOF;
+        }
+    if (BlockNumber != (Offset + BytesToWrite) / DynamicBlockSize)
+        BytesInWrite = (uint32)(((BlockNumber + 1) * DynamicBlockSize) - Offset);
+    if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
+        uint8 *BitMap = NULL;
+        uint32 BitMapBufferSize = VHD_DATA_BLOCK_ALIGNMENT;
+        uint8 *BitMapBuffer = NULL;
+        void *BlockData = NULL;
+        uint8 *BATUpdateBufferAddress;
+        uint32 BATUpdateBufferSize;
+        uint64 BATUpdateStorageAddress;
+        uint64 BlockOffset;
+
+        if (!hVHD->Parent && BufferIsZeros(buf, BytesInWrite)) {
+            BytesThisWrite = BytesInWrite;
+            goto IO_Done;
             }
-        Status = GetVHDFooter (hVHD->ParentVHDPath,
-                               &ParentFooter,
-                               &ParentDynamic,
-                               NULL,
-                               &ParentModifiedTimeStamp,
-                               NULL,
-                               0);
-        if (Status)
-            goto Cleanup_Return;
-        if ((0 != memcmp (hVHD->Dynamic.ParentUniqueID, ParentFooter.UniqueID, sizeof (ParentFooter.UniqueID))) ||
-            (ParentModifiedTimeStamp != hVHD->Dynamic.ParentTimeStamp)) {
-            if (sim_switches & SWMASK ('O')) {                      /* OVERRIDE consistency checks? */
-                if ((sim_switches & SWMASK ('U')) &&                /* FIX (UPDATE) consistency checks AND */
-                    (strchr (DesiredAccess, '+'))) {                /* open for write/update? */
-                    memcpy (hVHD->Dynamic.ParentUniqueID, ParentFooter.UniqueID, sizeof (ParentFooter.UniqueID));
-                    hVHD->Dynamic.ParentTimeStamp = ParentModifiedTimeStamp;
-                    hVHD->Dynamic.Checksum = 0;
-                    hVHD->Dynamic.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Dynamic, sizeof(hVHD->Dynamic)));
-                    NeedUpdate = TRUE;
-                    }
-                }
-            else {
-                Status = EBADF;
-                goto Cleanup_Return;
+        /* Need to allocate a new Data Block. */
+        BlockOffset = sim_fsize_ex (hVHD->File);
+        if (((int64)BlockOffset) == -1)
+            return SCPE_IOERR;
+        if ((BitMapSectors * VHD_Internal_SectorSize) > BitMapBufferSize)
+            BitMapBufferSize = BitMapSectors * VHD_Internal_SectorSize;
+        BitMapBuffer = (uint8 *)calloc(1, BitMapBufferSize + DynamicBlockSize);
+        if (BitMapBufferSize > BitMapSectors * VHD_Internal_SectorSize)
+            BitMap = BitMapBuffer + BitMapBufferSize - BitMapBytes;
+        else
+            BitMap = BitMapBuffer;
+        memset(BitMap, 0xFF, BitMapBytes);
+        BlockOffset -= sizeof(hVHD->Footer);
+        if (0 == (BlockOffset & (VHD_DATA_BLOCK_ALIGNMENT-1)))
+            {  // Already aligned, so use padded BitMapBuffer
+            if (WriteFilePosition(hVHD->File,
+                                  BitMapBuffer,
+                                  BitMapBufferSize + DynamicBlockSize,
+                                  NULL,
+                                  BlockOffset)) {
+                free (BitMapBuffer);
+                return SCPE_IOERR;
                 }
+            BlockOffset += BitMapBufferSize;
             }
-        }
-    if (hVHD->Footer.SavedState) {
-        Status = EAGAIN;                                /* Busy */
-        goto Cleanup_Return;
-        }
-    hVHD->File = sim_fopen (szVHDPath, DesiredAccess);
-    if (!hVHD->File) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-Cleanup_Return:
-    if (Status) {
-        sim_vhd_disk_close ((FILE *)hVHD);
-        hVHD = NULL;
-        }
-    else {
-        if (NeedUpdate) {                               /* Update Differencing Disk Header? */
+        else
+            {
+            // align the data portion of the block to the desired alignment
+            // compute the address of the data portion of the block
+            BlockOffset += BitMapSectors * VHD_Internal_SectorSize;
+            // round up this address to the desired alignment
+            BlockOffset += VHD_DATA_BLOCK_ALIGNMENT-1;
+            BlockOffset &= ~(VHD_DATA_BLOCK_ALIGNMENT - 1);
+            BlockOffset -= BitMapSectors * VHD_Internal_SectorSize;
             if (WriteFilePosition(hVHD->File,
-                                  &hVHD->Dynamic,
-                                  sizeof (hVHD->Dynamic),
+                                  BitMap,
+                                  (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize,
                                   NULL,
-                                  NtoHll (hVHD->Footer.DataOffset))) {
-                sim_vhd_disk_close ((FILE *)hVHD);
-                hVHD = NULL;
+                                  BlockOffset)) {
+                free (BitMapBuffer);
+                return SCPE_IOERR;
                 }
+            BlockOffset += BitMapSectors * VHD_Internal_SectorSize;
             }
-        }
-    errno = Status;
-    return (FILE *)hVHD;
-    }
-
-static t_stat
-WriteVirtualDiskSectors(VHDHANDLE hVHD,
-                        uint8 *buf,
-                        t_seccnt sects,
-                        t_seccnt *sectswritten,
-                        uint32 SectorSize,
-                        t_lba lba);
-
-static FILE *sim_vhd_disk_merge (const char *szVHDPath, char **ParentVHD)
-    {
-    VHDHANDLE hVHD = (VHDHANDLE) calloc (1, sizeof(*hVHD));
-    VHDHANDLE Parent = NULL;
-    int Status;
-    uint32 SectorSize, SectorsPerBlock, BlockSize, BlockNumber, BitMapBytes, BitMapSectors, BlocksToMerge, NeededBlock;
-    uint64 BlockOffset;
-    uint32 BytesRead;
-    t_seccnt SectorsWritten;
-    void *BlockData = NULL;
-
-    if (!hVHD)
-        return (FILE *)hVHD;
-    if (0 != (Status = GetVHDFooter (szVHDPath,
-                                     &hVHD->Footer,
-                                     &hVHD->Dynamic,
-                                     &hVHD->BAT,
-                                     NULL,
-                                     hVHD->ParentVHDPath,
-                                     sizeof (hVHD->ParentVHDPath))))
-        goto Cleanup_Return;
-    if (NtoHl (hVHD->Footer.DiskType) != VHD_DT_Differencing) {
-        Status = EINVAL;
-        goto Cleanup_Return;
-        }
-    if (hVHD->Footer.SavedState) {
-        Status = EAGAIN;                                /* Busy */
-        goto Cleanup_Return;
-        }
-    SectorSize = 512;
-    BlockSize = NtoHl (hVHD->Dynamic.BlockSize);
-    BlockData = malloc (BlockSize*SectorSize);
-    if (NULL == BlockData) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-    Parent = (VHDHANDLE)sim_vhd_disk_open (hVHD->ParentVHDPath, "rb+");
-    if (!Parent) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-    hVHD->File = sim_fopen (szVHDPath, "rb");
-    if (!hVHD->File) {
-        Status = errno;
-        goto Cleanup_Return;
-        }
-    SectorsPerBlock = NtoHl (hVHD->Dynamic.BlockSize)/SectorSize;
-    BitMapBytes = (7+(NtoHl (hVHD->Dynamic.BlockSize)/SectorSize))/8;
-    BitMapSectors = (BitMapBytes+SectorSize-1)/SectorSize;
-    for (BlockNumber=BlocksToMerge=0; BlockNumber< NtoHl (hVHD->Dynamic.MaxTableEntries); ++BlockNumber) {
-        if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY)
-            continue;
-        ++BlocksToMerge;
-        }
-    sim_messagef (SCPE_OK, "Merging %s\ninto %s\n", szVHDPath, hVHD->ParentVHDPath);
-    for (BlockNumber=NeededBlock=0; BlockNumber < NtoHl (hVHD->Dynamic.MaxTableEntries); ++BlockNumber) {
-        uint32 BlockSectors = SectorsPerBlock;
+        free(BitMapBuffer);
+        BitMapBuffer = BitMap = NULL;
+        /* the BAT block address is the beginning of the block bitmap */
+        BlockOffset -= BitMapSectors * VHD_Internal_SectorSize;
+        hVHD->BAT[BlockNumber] = NtoHl((uint32)(BlockOffset / VHD_Internal_SectorSize));
+        BlockOffset += (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize;
+        if (WriteFilePosition(hVHD->File,
+                              &hVHD->Footer,
+                              sizeof(hVHD->Footer),
+                              NULL,
+                              BlockOffset))
+            goto Fatal_IO_Error;
+        /* Since a large VHD can have a pretty large BAT, and we've only changed one longword bat entry
+           in the current BAT, we write just the aligned sector which contains the updated BAT entry */
+        BATUpdateBufferAddress = (uint8 *)hVHD->BAT - (size_t)NtoHll(hVHD->Dynamic.TableOffset) +
+            (size_t)((((size_t)&hVHD->BAT[BlockNumber]) - (size_t)hVHD->BAT + (size_t)NtoHll(hVHD->Dynamic.TableOffset)) & ~(VHD_DATA_BLOCK_ALIGNMENT-1));
+        /* If the starting of the BAT isn't on a VHD_DATA_BLOCK_ALIGNMENT boundary and we've just updated
+           a BAT entry early in the array, the buffer computed address might be before the start of the
+           BAT table.  If so, only write the BAT data needed */
+        if (BATUpdateBufferAddress < (uint8 *)hVHD->BAT) {
+            BATUpdateBufferAddress = (uint8 *)hVHD->BAT;
+            BATUpdateBufferSize = (uint32)((((size_t)&hVHD->BAT[BlockNumber]) - (size_t)hVHD->BAT) + 512) & ~511;
+            BATUpdateStorageAddress = NtoHll(hVHD->Dynamic.TableOffset);
+            }
+        else {
+            BATUpdateBufferSize = VHD_DATA_BLOCK_ALIGNMENT;
+            BATUpdateStorageAddress = NtoHll(hVHD->Dynamic.TableOffset) + BATUpdateBufferAddress - ((uint8 *)hVHD->BAT);
+            }
+        /* If the total BAT is smaller than one VHD_DATA_BLOCK_ALIGNMENT, then be sure to only write out the BAT data */
+        if ((size_t)(BATUpdateBufferAddress - (uint8 *)hVHD->BAT + BATUpdateBufferSize) > VHD_Internal_SectorSize * ((sizeof(*hVHD->BAT)*NtoHl(hVHD->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1)/VHD_Internal_SectorSize))
+            BATUpdateBufferSize = (uint32)(VHD_Internal_SectorSize * ((sizeof(*hVHD->BAT) * NtoHl(hVHD->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1)/VHD_Internal_SectorSize) - (BATUpdateBufferAddress - ((uint8 *)hVHD->BAT)));
+        if (WriteFilePosition(hVHD->File,
+                              BATUpdateBufferAddress,
+                              BATUpdateBufferSize,
+                              NULL,
+                              BATUpdateStorageAddress))
+            goto Fatal_IO_Error;
+        if (hVHD->Parent)
+            { /* Need to populate data block contents from parent VHD */
+            BlockData = malloc (NtoHl (hVHD->Dynamic.BlockSize));
 
-        if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY)
-            continue;
-        ++NeededBlock;
-        BlockOffset = SectorSize*((uint64)(NtoHl (hVHD->BAT[BlockNumber]) + BitMapSectors));
-        if (((uint64)BlockNumber*SectorsPerBlock + BlockSectors) > ((uint64)NtoHll (hVHD->Footer.CurrentSize))/SectorSize)
-            BlockSectors = (uint32)(((uint64)NtoHll (hVHD->Footer.CurrentSize))/SectorSize - (BlockNumber*SectorsPerBlock));
-        if (ReadFilePosition(hVHD->File,
-                             BlockData,
-                             SectorSize*BlockSectors,
-                             &BytesRead,
-                             BlockOffset))
-            break;
-        if (WriteVirtualDiskSectors (Parent,
-                                     (uint8*)BlockData,
-                                     BlockSectors,
-                                     &SectorsWritten,
-                                     SectorSize,
-                                     SectorsPerBlock*BlockNumber))
-            break;
-        sim_messagef (SCPE_OK, "Merged %dMB.  %d%% complete.\r", (int)((((float)NeededBlock)*SectorsPerBlock)*SectorSize/1000000), (int)((((float)NeededBlock)*100)/BlocksToMerge));
-        hVHD->BAT[BlockNumber] = VHD_BAT_FREE_ENTRY;
-        }
-    if (BlockNumber < NtoHl (hVHD->Dynamic.MaxTableEntries)) {
-        Status = errno;
-        }
-    else {
-        Status = 0;
-        sim_messagef (SCPE_OK, "Merged %dMB.  100%% complete.\n", (int)((((float)NeededBlock)*SectorsPerBlock)*SectorSize/1000000));
-        fclose (hVHD->File);
-        hVHD->File = NULL;
-        (void)remove (szVHDPath);
-        *ParentVHD = (char*) malloc (strlen (hVHD->ParentVHDPath)+1);
-        strcpy (*ParentVHD, hVHD->ParentVHDPath);
-        }
-Cleanup_Return:
-    free (BlockData);
-    if (hVHD->File)
-        fclose (hVHD->File);
-    if (Status) {
-        free (hVHD->BAT);
-        free (hVHD);
-        hVHD = NULL;
-        sim_vhd_disk_close ((FILE *)Parent);
+            if (ReadVirtualDisk(hVHD->Parent,
+                                (uint8*) BlockData,
+                                NtoHl (hVHD->Dynamic.BlockSize),
+                                NULL,
+                                (Offset / NtoHl (hVHD->Dynamic.BlockSize)) * NtoHl (hVHD->Dynamic.BlockSize)))
+                goto Fatal_IO_Error;
+            if (WriteVirtualDisk(hVHD,
+                                 (uint8*) BlockData,
+                                 NtoHl (hVHD->Dynamic.BlockSize),
+                                 NULL,
+                                 (Offset / NtoHl (hVHD->Dynamic.BlockSize)) * NtoHl (hVHD->Dynamic.BlockSize)))
+                goto Fatal_IO_Error;
+            free(BlockData);
+            }
+        continue;
+Fatal_IO_Error:
+        free (BitMap);
+        free (BlockData);
+        r = SCPE_IOERR;
         }
     else {
-        free (hVHD->BAT);
-        free (hVHD);
-        hVHD = Parent;
-        }
-    errno = Status;
-    return (FILE *)hVHD;
-    }
-
-static int sim_vhd_disk_close (FILE *f)
-{
-VHDHANDLE hVHD = (VHDHANDLE)f;
+        uint64 BlockOffset = VHD_Internal_SectorSize * ((uint64)(NtoHl(hVHD->BAT[BlockNumber]) + BitMapSectors)) + (Offset % DynamicBlockSize);
 
-if (NULL != hVHD) {
-    if (hVHD->Parent)
-        sim_vhd_disk_close ((FILE *)hVHD->Parent);
-    free (hVHD->BAT);
-    if (hVHD->File) {
-        fflush (hVHD->File);
-        fclose (hVHD->File);
+        if (WriteFilePosition(hVHD->File,
+                              buf,
+                              BytesInWrite,
+                              &BytesThisWrite,
+                              BlockOffset))
+            r = SCPE_IOERR;
         }
-    free (hVHD);
-    return 0;
+IO_Done:
+    BytesToWrite -= BytesThisWrite;
+    buf = (uint8 *)(((char *)buf) + BytesThisWrite);
+    Offset += BytesThisWrite;
+    TotalBytesWritten += BytesThisWrite;
     }
-return -1;
+if (BytesWritten)
+    *BytesWritten = TotalBytesWritten;
+return r;
 }
 
-static void sim_vhd_disk_flush (FILE *f)
+static t_stat
+WriteVirtualDiskSectors(VHDHANDLE hVHD,
+                        uint8 *buf,
+                        t_seccnt sects,
+                        t_seccnt *sectswritten,
+                        uint32 SectorSize,
+                        t_lba lba)
 {
-VHDHANDLE hVHD = (VHDHANDLE)f;
+uint32 BytesWritten;
+t_stat r = WriteVirtualDisk(hVHD,
+                            buf,
+                            sects * SectorSize,
+                            &BytesWritten,
+                            SectorSize * (uint64)lba);
 
-if ((NULL != hVHD) && (hVHD->File))
-    fflush (hVHD->File);
+if (sectswritten)
+    *sectswritten = BytesWritten / SectorSize;
+return r;
 }
 
-static t_offset sim_vhd_disk_size (FILE *f)
+static t_stat sim_vhd_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
 {
-VHDHANDLE hVHD = (VHDHANDLE)f;
+VHDHANDLE hVHD = (VHDHANDLE)uptr->fileref;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
-return (t_offset)(NtoHll (hVHD->Footer.CurrentSize));
+return WriteVirtualDiskSectors(hVHD, buf, sects, sectswritten, ctx->sector_size, lba);
 }
+#endif
 
+/* SIMHX Deduplicating Disk Container support
+
+   A SIMHX container holds no disk data of its own.  It has a header
+   and a block map which names, for each 4KB block of the disk, a block
+   in a store shared by all of the SIMHX containers in one directory.
+   The store is the file simhx.store and its index simhx.store.index.
+
+   Store blocks are found by their contents.  Writing a block whose
+   data is already in the store just adds a reference to the existing
+   copy, so disks which were cloned from one another (ATTACH -C) only
+   use store space for the blocks in which they differ.  Blocks of
+   zeros are never stored.  A block is stored LZ compressed when that
+   saves at least one 512 byte allocation unit.
+
+   Since a store block is never rewritten while anything refers to it,
+   a snapshot of an attached disk (DISKSNAPSHOT) is just a new container
+   with a copy of the block map.
+
+   The whole block map and store index are kept in memory, so locating
+   the data for a sector takes no I/O.  Reference counts are always
+   raised before a new reference is written and dropped after an old
+   one is removed, so an interrupted update can only leave unreferenced
+   blocks in the store.
+
+   A store may be used by only one simulator process at a time.  The
+   store's data file is locked while it is open, and a container whose
+   store is locked by another process can't be attached.
+
+   Each container has a random id in its header which is registered in
+   the store's index, by an entry flagged SIMHX_F_CONTAINER whose store
+   unit holds the id and the container's file name.  A container whose
+   id isn't registered, or which is a copy of a container which still
+   exists, can't be opened: the blocks it refers to were only counted
+   for the original.  A container which was renamed has its new name
+   recorded when it is opened.
+
+   Deleting a container leaves the references it held, so the blocks
+   only it used are never reused.  DISKRECLAIM recounts every reference
+   from the containers found in the store's directory, forgets the ids
+   of containers which no longer exist, and releases the blocks which
+   are no longer referenced (including any left by an interrupted
+   update).
+*/
 
-#include <stdlib.h>
-#include <time.h>
-static void
-_rand_uuid_gen (void *uuidaddr)
-{
-int i;
-uint8 *b = (uint8 *)uuidaddr;
-uint32 timenow = (uint32)time (NULL);
+#if defined (DONT_DO_SIMHX_SUPPORT)
 
-memcpy (uuidaddr, &timenow, sizeof (timenow));
-srand ((unsigned)timenow);
-for (i=4; i<16; i++) {
-    b[i] = (uint8)rand();
-    }
+static t_stat sim_simhx_disk_implemented (void)
+{
+return SCPE_NOFNC;
 }
 
-#if defined (_WIN32)
-static void
-uuid_gen (void *uuidaddr)
+static t_bool sim_simhx_disk_is_container (const char *szSIMHXPath)
 {
-static
-RPC_STATUS
-(RPC_ENTRY *UuidCreate_c) (void *);
-
-if (!UuidCreate_c) {
-    HINSTANCE hDll;
-    hDll = LoadLibraryA("rpcrt4.dll");
-    UuidCreate_c = (RPC_STATUS (RPC_ENTRY *) (void *))GetProcAddress(hDll, "UuidCreate");
-    }
-if (UuidCreate_c)
-    UuidCreate_c(uuidaddr);
-else
-    _rand_uuid_gen (uuidaddr);
+return FALSE;
 }
-#elif defined (SIM_HAVE_DLOPEN)
-#include <dlfcn.h>
 
-static void
-uuid_gen (void *uuidaddr)
+static FILE *sim_simhx_disk_open (const char *szSIMHXPath, const char *DesiredAccess)
 {
-void (*uuid_generate_c) (void *) = NULL;
-void *handle;
-
-#define S__STR_QUOTE(tok) #tok
-#define S__STR(tok) S__STR_QUOTE(tok)
-    handle = dlopen("libuuid." S__STR(SIM_HAVE_DLOPEN), RTLD_NOW|RTLD_GLOBAL);
-    if (handle)
-        uuid_generate_c = (void (*)(void *))((size_t)dlsym(handle, "uuid_generate"));
-    if (uuid_generate_c)
-        uuid_generate_c(uuidaddr);
-    else
-        _rand_uuid_gen (uuidaddr);
-    if (handle)
-        dlclose(handle);
+return NULL;
 }
-#else
-static void
-uuid_gen (void *uuidaddr)
+
+static FILE *sim_simhx_disk_create (const char *szSIMHXPath, t_offset desiredsize)
 {
-_rand_uuid_gen (uuidaddr);
+return NULL;
 }
-#endif
 
-static VHDHANDLE
-sim_CreateVirtualDisk(const char *szVHDPath,
-                      uint32 SizeInSectors,
-                      uint32 BlockSize,
-                      t_bool bFixedVHD)
+static FILE *sim_simhx_disk_snapshot (FILE *f, const char *szSnapshotPath)
 {
-VHD_Footer Footer;
-VHD_DynamicDiskHeader Dynamic;
-uint32 *BAT = NULL;
-time_t now;
-uint32 i;
-FILE *File = NULL;
-uint32 Status = 0;
-uint32 BytesPerSector = 512;
-uint64 SizeInBytes = ((uint64)SizeInSectors) * BytesPerSector;
-uint64 TableOffset;
-uint32 MaxTableEntries;
-VHDHANDLE hVHD = NULL;
-
-if (SizeInBytes > ((uint64)(1024 * 1024 * 1024)) * 2040) {
-    Status = EFBIG;
-    goto Cleanup_Return;
-    }
-File = sim_fopen (szVHDPath, "rb");
-if (File) {
-    fclose (File);
-    File = NULL;
-    Status = EEXIST;
-    goto Cleanup_Return;
-    }
-File = sim_fopen (szVHDPath, "wb");
-if (!File) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-
-memset (&Footer, 0, sizeof(Footer));
-memcpy (Footer.Cookie, "conectix", 8);
-Footer.Features = NtoHl (0x00000002);;
-Footer.FileFormatVersion = NtoHl (0x00010000);;
-Footer.DataOffset = NtoHll (bFixedVHD ? ((long long)-1) : (long long)(sizeof(Footer)));
-time (&now);
-Footer.TimeStamp = NtoHl ((uint32)(now - 946684800));
-memcpy (Footer.CreatorApplication, "simh", 4);
-Footer.CreatorVersion = NtoHl (0x00040000);
-memcpy (Footer.CreatorHostOS, "Wi2k", 4);
-Footer.OriginalSize = NtoHll (SizeInBytes);
-Footer.CurrentSize = NtoHll (SizeInBytes);
-uuid_gen (Footer.UniqueID);
-Footer.DiskType = NtoHl (bFixedVHD ? VHD_DT_Fixed : VHD_DT_Dynamic);
-Footer.DiskGeometry = NtoHl (0xFFFF10FF);
-if (1) { /* CHS Calculation */
-    uint32 totalSectors = (uint32)(SizeInBytes/BytesPerSector);/* Total data sectors present in the disk image */
-    uint32 cylinders;                                          /* Number of cylinders present on the disk */
-    uint32 heads;                                              /* Number of heads present on the disk */
-    uint32 sectorsPerTrack;                                    /* Sectors per track on the disk */
-    uint32 cylinderTimesHeads;                                 /* Cylinders x heads */
-
-    if (totalSectors > 65535 * 16 * 255)
-        totalSectors = 65535 * 16 * 255;
-
-    if (totalSectors >= 65535 * 16 * 63) {
-        sectorsPerTrack = 255;
-        heads = 16;
-        cylinderTimesHeads = totalSectors / sectorsPerTrack;
-        }
-    else {
-        sectorsPerTrack = 17;
-        cylinderTimesHeads = totalSectors / sectorsPerTrack;
-
-        heads = (cylinderTimesHeads + 1023) / 1024;
-
-        if (heads < 4)
-            heads = 4;
-        if (cylinderTimesHeads >= (heads * 1024) || heads > 16)
-            {
-            sectorsPerTrack = 31;
-            heads = 16;
-            cylinderTimesHeads = totalSectors / sectorsPerTrack;
-            }
-        if (cylinderTimesHeads >= (heads * 1024))
-            {
-            sectorsPerTrack = 63;
-            heads = 16;
-            cylinderTimesHeads = totalSectors / sectorsPerTrack;
-            }
-        }
-    cylinders = (totalSectors + sectorsPerTrack * heads - 1) / (sectorsPerTrack * heads);
-    Footer.DiskGeometry = NtoHl ((cylinders<<16)|(heads<<8)|sectorsPerTrack);
-    }
-Footer.Checksum = NtoHl (CalculateVhdFooterChecksum(&Footer, sizeof(Footer)));
-
-if (bFixedVHD) {
-    if (WriteFilePosition(File,
-                          &Footer,
-                          sizeof(Footer),
-                          NULL,
-                          SizeInBytes))
-        Status = errno;
-    goto Cleanup_Return;
-    }
-
-/* Dynamic Disk */
-memset (&Dynamic, 0, sizeof(Dynamic));
-memcpy (Dynamic.Cookie, "cxsparse", 8);
-Dynamic.DataOffset = NtoHll ((uint64)0xFFFFFFFFFFFFFFFFLL);
-TableOffset = NtoHll(Footer.DataOffset)+sizeof(Dynamic);
-Dynamic.TableOffset = NtoHll (TableOffset);
-Dynamic.HeaderVersion = NtoHl (0x00010000);
-if (0 == BlockSize)
-    BlockSize = 2*1024*1024;
-Dynamic.BlockSize = NtoHl (BlockSize);
-MaxTableEntries = (uint32)((SizeInBytes+BlockSize-1)/BlockSize);
-Dynamic.MaxTableEntries = NtoHl (MaxTableEntries);
-Dynamic.Checksum = NtoHl (CalculateVhdFooterChecksum(&Dynamic, sizeof(Dynamic)));
-BAT = (uint32*) malloc (BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector));
-memset (BAT, 0, BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector));
-for (i=0; i<MaxTableEntries; ++i)
-    BAT[i] = VHD_BAT_FREE_ENTRY;
+return NULL;
+}
 
-if (WriteFilePosition(File,
-                      &Footer,
-                      sizeof(Footer),
-                      NULL,
-                      0)) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-if (WriteFilePosition(File,
-                      &Dynamic,
-                      sizeof(Dynamic),
-                      NULL,
-                      NtoHll(Footer.DataOffset))) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-if (WriteFilePosition(File,
-                      BAT,
-                      BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector),
-                      NULL,
-                      NtoHll(Dynamic.TableOffset))) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-if (WriteFilePosition(File,
-                      &Footer,
-                      sizeof(Footer),
-                      NULL,
-                      NtoHll(Dynamic.TableOffset)+BytesPerSector*((MaxTableEntries*sizeof(*BAT)+BytesPerSector-1)/BytesPerSector))) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
+static int sim_simhx_disk_close (FILE *f)
+{
+return -1;
+}
 
-Cleanup_Return:
-free (BAT);
-if (File)
-    fclose (File);
-if (Status) {
-    if (Status != EEXIST)
-        (void)remove (szVHDPath);
-    }
-else {
-    hVHD = (VHDHANDLE)sim_vhd_disk_open (szVHDPath, "rb+");
-    if (!hVHD)
-        Status = errno;
-    }
-errno = Status;
-return hVHD;
+static void sim_simhx_disk_flush (FILE *f)
+{
 }
 
-#if defined(__CYGWIN__) || defined(VMS) || defined(__APPLE__) || defined(__linux) || defined(__linux__) || defined(__unix__)
-#include <unistd.h>
-#endif
-static void
-ExpandToFullPath (const char *szFileSpec,
-                  char *szFullFileSpecBuffer,
-                  size_t BufferSize)
+static t_offset sim_simhx_disk_size (FILE *f)
 {
-char *c;
-#ifdef _WIN32
-for (c = strchr (szFullFileSpecBuffer, '/'); c; c = strchr (szFullFileSpecBuffer, '/'))
-    *c = '\\';
-GetFullPathNameA (szFileSpec, (DWORD)BufferSize, szFullFileSpecBuffer, NULL);
-for (c = strchr (szFullFileSpecBuffer, '\\'); c; c = strchr (szFullFileSpecBuffer, '\\'))
-    *c = '/';
-#else
-char buffer[PATH_MAX];
-char *wd = getcwd(buffer, PATH_MAX);
+return (t_offset)-1;
+}
 
-if ((szFileSpec[0] != '/') || (strchr (szFileSpec, ':')))
-    snprintf (szFullFileSpecBuffer, BufferSize, "%s/%s", wd, szFileSpec);
-else
-    strlcpy (szFullFileSpecBuffer, szFileSpec, BufferSize);
-if ((c = strstr (szFullFileSpecBuffer, "]/")))
-    memmove (c+1, c+2, strlen(c+2)+1);
-memset (szFullFileSpecBuffer + strlen (szFullFileSpecBuffer), 0, BufferSize - strlen (szFullFileSpecBuffer));
-#endif
+static t_stat sim_simhx_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+return SCPE_IOERR;
 }
 
-static char *
-HostPathToVhdPath (const char *szHostPath,
-                   char *szVhdPath,
-                   size_t VhdPathSize)
+static t_stat sim_simhx_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
 {
-char *c, *d;
+return SCPE_IOERR;
+}
 
-memset (szVhdPath, 0, VhdPathSize);
-strlcpy (szVhdPath, szHostPath, VhdPathSize-1);
-if ((szVhdPath[1] == ':') && islower(szVhdPath[0]))
-    szVhdPath[0] = toupper(szVhdPath[0]);
-szVhdPath[VhdPathSize-1] = '\0';
-if ((c = strrchr (szVhdPath, ']'))) {
-    *c = '\0';
-    if (!(d = strchr (szVhdPath, '[')))
-        return d;
-    *d = '/';
-    while ((d = strchr (d, '.')))
-        *d = '/';
-    *c = '/';
-    }
-while ((c = strchr (szVhdPath, '/')))
-    *c = '\\';
-for (c = strstr (szVhdPath, "\\.\\"); c; c = strstr (szVhdPath, "\\.\\"))
-    memmove (c, c+2, strlen(c+2)+1);
-for (c = strstr (szVhdPath, "\\\\"); c; c = strstr (szVhdPath, "\\\\"))
-    memmove (c, c+1, strlen(c+1)+1);
-while ((c = strstr (szVhdPath, "\\..\\"))) {
-    *c = '\0';
-    d = strrchr (szVhdPath, '\\');
-    if (d)
-        memmove (d, c+3, strlen(c+3)+1);
-    else
-        return d;
-    }
-memset (szVhdPath + strlen (szVhdPath), 0, VhdPathSize - strlen (szVhdPath));
-return szVhdPath;
+static t_stat sim_simhx_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_element_size, const char *dname)
+{
+return SCPE_NOFNC;
 }
 
-static char *
-VhdPathToHostPath (const char *szVhdPath,
-                   char *szHostPath,
-                   size_t HostPathSize)
+static void sim_simhx_disk_get_footer (FILE *f, struct simh_disk_footer *footer)
 {
-char *c;
-char *d = szHostPath;
+}
+
+static void sim_simhx_disk_info (FILE *f)
+{
+}
+
+static t_stat sim_simhx_store_reclaim (const char *szStorePath)
+{
+return sim_messagef (SCPE_NOFNC, "SIMHX disk containers are not supported\n");
+}
 
-memmove (szHostPath, szVhdPath, HostPathSize);
-szHostPath[HostPathSize-1] = '\0';
-#if defined(VMS)
-c = strchr (szHostPath, ':');
-if (*(c+1) != '\\')
-    return NULL;
-*(c+1) = '[';
-d = strrchr (c+2, '\\');
-if (d) {
-    *d = ']';
-    while ((d = strrchr (c+2, '\\')))
-        *d = '.';
-    }
-else
-    return NULL;
 #else
-while ((c = strchr (d, '\\')))
-    *c = '/';
+#if defined (_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
 #endif
-memset (szHostPath + strlen (szHostPath), 0, HostPathSize - strlen (szHostPath));
-return szHostPath;
+
+#define SIMHX_BLOCK_SIZE    4096                /* disk bytes per block map entry */
+#define SIMHX_UNIT_SIZE     512                 /* store allocation unit */
+#define SIMHX_MAX_UNITS     (SIMHX_BLOCK_SIZE / SIMHX_UNIT_SIZE)
+#define SIMHX_HEADER_SIZE   512                 /* size of every file header */
+#define SIMHX_STORE_NAME    "simhx.store"
+#define SIMHX_INDEX_SUFFIX  ".index"
+#define SIMHX_VERSION       1
+#define SIMHX_F_LZ          1                   /* store block is compressed */
+#define SIMHX_F_CONTAINER   2                   /* index entry registers a container */
+
+struct simhx_header {                           /* start of a SIMHX container */
+    uint8       Signature[8];                   /* "SIMHXDSK" */
+    uint32      Version;
+    uint32      BlockSize;
+    uint32      DiskSize[2];                    /* bytes in the disk, high, low */
+    uint32      BlockCount;                     /* entries in the block map */
+    uint32      SectorSize;
+    uint32      TransferElementSize;
+    uint8       CreatingSimulator[64];
+    uint8       DriveType[16];
+    uint8       DeviceName[16];
+    uint8       CreationTime[28];               /* Result of ctime() */
+    uint8       StoreName[256];                 /* relative to the container's directory */
+    uint8       ContainerId[16];                /* registered in the store's index */
+    uint8       Reserved[76];
+    uint32      Checksum;                       /* CRC32 of the prior 508 bytes */
+    };
+
+struct simhx_container_record {                 /* store unit of a registered container */
+    uint8       ContainerId[16];
+    uint8       Name[256];                      /* file name, in the store's directory */
+    uint8       Reserved[236];
+    uint32      Checksum;                       /* CRC32 of the prior 508 bytes */
+    };
+
+struct simhx_store_header {                     /* start of the store data and index files */
+    uint8       Signature[8];                   /* "SIMHXSTO" or "SIMHXIDX" */
+    uint32      Version;
+    uint32      BlockSize;
+    uint32      UnitSize;
+    uint8       Reserved[488];
+    uint32      Checksum;                       /* CRC32 of the prior 508 bytes */
+    };
+
+struct simhx_index_entry {                      /* one per store block in the index file */
+    uint32      Digest[2];                      /* sim_digest of the block */
+    uint32      Offset[2];                      /* allocation units into the data file */
+    uint32      RefCount;                       /* block map entries referring to it */
+    uint32      Length;                         /* bytes stored */
+    uint32      Units;                          /* allocation units reserved */
+    uint32      Flags;
+    };
+
+typedef struct SIMHX_ENTRY {
+    t_uint64    digest;
+    t_uint64    offset;
+    uint32      refcount;
+    uint32      length;
+    uint32      units;
+    uint32      flags;
+    uint32      next;                           /* hash chain or free list link (slot + 1) */
+    } SIMHX_ENTRY;
+
+typedef struct SIMHX_STORE {
+    struct SIMHX_STORE *next;                   /* open stores */
+    char        *path;                          /* full path of the data file */
+    int         users;                          /* containers using the store */
+    FILE        *data;
+    FILE        *index;
+    SIMHX_ENTRY *entries;
+    uint32      count;                          /* index entries */
+    uint32      size;                           /* index entries allocated */
+    uint32      *hash;                          /* digest hash buckets (slot + 1) */
+    uint32      hash_mask;
+    uint32      free[SIMHX_MAX_UNITS + 1];      /* unreferenced slots by size (slot + 1) */
+    t_uint64    end;                            /* allocation units in the data file */
+    uint8       buf[SIMHX_BLOCK_SIZE];          /* block I/O buffer */
+    uint8       cbuf[SIMHX_BLOCK_SIZE];         /* compression buffer */
+#if defined (SIM_ASYNCH_IO)
+    pthread_mutex_t lock;
+#endif
+    } SIMHX_STORE;
+
+typedef struct SIMHX_DISK {
+    FILE        *File;
+    SIMHX_STORE *Store;
+    struct simhx_header Header;
+    t_offset    DiskSize;
+    uint32      BlockCount;
+    uint32      *Map;                           /* store slot + 1 for each block, 0 is zeros */
+    uint32      Registration;                   /* store slot + 1 of its container record */
+    uint8       Block[SIMHX_BLOCK_SIZE];        /* partial block write buffer */
+    } SIMHX_DISK;
+
+typedef SIMHX_DISK *SIMHXHANDLE;
+
+static SIMHX_STORE *simhx_stores = NULL;
+#if defined (SIM_ASYNCH_IO)
+static pthread_mutex_t simhx_stores_lock = PTHREAD_MUTEX_INITIALIZER;
+#define SIMHX_LOCK(s)   pthread_mutex_lock (&(s)->lock)
+#define SIMHX_UNLOCK(s) pthread_mutex_unlock (&(s)->lock)
+#else
+#define SIMHX_LOCK(s)
+#define SIMHX_UNLOCK(s)
+#endif
+
+static t_stat sim_simhx_disk_implemented (void)
+{
+return SCPE_OK;
 }
 
-static VHDHANDLE
-CreateDifferencingVirtualDisk(const char *szVHDPath,
-                              const char *szParentVHDPath)
+static t_stat _simhx_read (FILE *f, t_offset pos, void *buf, size_t size)
 {
-uint32 BytesPerSector = 512;
-VHDHANDLE hVHD = NULL;
-VHD_Footer ParentFooter;
-VHD_DynamicDiskHeader ParentDynamic;
-uint32 ParentTimeStamp;
-uint32 Status = 0;
-char *RelativeParentVHDPath = NULL;
-char *FullParentVHDPath = NULL;
-char *RelativeParentVHDPathUnicode = NULL;
-char *FullParentVHDPathUnicode = NULL;
-char *FullVHDPath = NULL;
-char *TempPath = NULL;
-size_t i, RelativeMatch, UpDirectories, LocatorsWritten = 0;
-int64 LocatorPosition;
+if ((sim_fseeko (f, pos, SEEK_SET) != 0) ||
+    (fread (buf, 1, size, f) != size))
+    return SCPE_IOERR;
+return SCPE_OK;
+}
 
-if ((Status = GetVHDFooter (szParentVHDPath,
-                            &ParentFooter,
-                            &ParentDynamic,
-                            NULL,
-                            &ParentTimeStamp,
-                            NULL,
-                            0)))
-    goto Cleanup_Return;
-hVHD = sim_CreateVirtualDisk (szVHDPath,
-                              (uint32)(NtoHll(ParentFooter.CurrentSize)/BytesPerSector),
-                              NtoHl(ParentDynamic.BlockSize),
-                              FALSE);
-if (!hVHD) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-LocatorPosition = ((sizeof (hVHD->Footer) + BytesPerSector - 1)/BytesPerSector + (sizeof (hVHD->Dynamic) + BytesPerSector - 1)/BytesPerSector)*BytesPerSector;
-hVHD->Dynamic.Checksum = 0;
-RelativeParentVHDPath = (char*) calloc (1, BytesPerSector+2);
-FullParentVHDPath = (char*) calloc (1, BytesPerSector+2);
-RelativeParentVHDPathUnicode = (char*) calloc (1, BytesPerSector+2);
-FullParentVHDPathUnicode = (char*) calloc (1, BytesPerSector+2);
-FullVHDPath = (char*) calloc (1, BytesPerSector+2);
-TempPath = (char*) calloc (1, BytesPerSector+2);
-ExpandToFullPath (szParentVHDPath, TempPath, BytesPerSector);
-HostPathToVhdPath (TempPath, FullParentVHDPath, BytesPerSector);
-for (i=0; i < strlen (FullParentVHDPath); i++)
-    hVHD->Dynamic.ParentUnicodeName[i*2+1] = FullParentVHDPath[i];  /* Big Endian Unicode */
-for (i=0; i < strlen (FullParentVHDPath); i++)
-    FullParentVHDPathUnicode[i*2] = FullParentVHDPath[i];           /* Little Endian Unicode */
-ExpandToFullPath (szVHDPath, TempPath, BytesPerSector);
-HostPathToVhdPath (TempPath, FullVHDPath, BytesPerSector);
-for (i=0, RelativeMatch=UpDirectories=0; i<strlen(FullVHDPath); i++)
-    if (FullVHDPath[i] == '\\') {
-        if (memcmp (FullVHDPath, FullParentVHDPath, i+1))
-            ++UpDirectories;
-        else
-            RelativeMatch = i;
-        }
-if (RelativeMatch) {
-    char UpDir[4] = "..\\";
+static t_stat _simhx_write (FILE *f, t_offset pos, const void *buf, size_t size)
+{
+if ((sim_fseeko (f, pos, SEEK_SET) != 0) ||
+    (fwrite (buf, 1, size, f) != size))
+    return SCPE_IOERR;
+return SCPE_OK;
+}
 
-    UpDir[2] = FullParentVHDPath[RelativeMatch];
-    if (UpDirectories)
-        for (i=0; i<UpDirectories; i++)
-            strcpy (RelativeParentVHDPath+strlen (RelativeParentVHDPath), UpDir);
-    else
-        strcpy (RelativeParentVHDPath+strlen (RelativeParentVHDPath), UpDir+1);
-    strcpy (RelativeParentVHDPath+strlen (RelativeParentVHDPath), &FullParentVHDPath[RelativeMatch+1]);
-    }
-for (i=0; i < strlen(RelativeParentVHDPath); i++)
-    RelativeParentVHDPathUnicode[i*2] = RelativeParentVHDPath[i];
-hVHD->Dynamic.ParentTimeStamp = ParentTimeStamp;
-memcpy (hVHD->Dynamic.ParentUniqueID, ParentFooter.UniqueID, sizeof (hVHD->Dynamic.ParentUniqueID));
-/* There are two potential parent locators on current vhds */
-memcpy (hVHD->Dynamic.ParentLocatorEntries[0].PlatformCode, "W2ku", 4);
-hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataSpace = NtoHl (BytesPerSector);
-hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataLength = NtoHl ((uint32)(2*strlen(FullParentVHDPath)));
-hVHD->Dynamic.ParentLocatorEntries[0].Reserved = 0;
-hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataOffset = NtoHll (LocatorPosition+LocatorsWritten*BytesPerSector);
-++LocatorsWritten;
-if (RelativeMatch) {
-    memcpy (hVHD->Dynamic.ParentLocatorEntries[1].PlatformCode, "W2ru", 4);
-    hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataSpace = NtoHl (BytesPerSector);
-    hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataLength = NtoHl ((uint32)(2*strlen(RelativeParentVHDPath)));
-    hVHD->Dynamic.ParentLocatorEntries[1].Reserved = 0;
-    hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataOffset = NtoHll (LocatorPosition+LocatorsWritten*BytesPerSector);
-    ++LocatorsWritten;
-    }
-hVHD->Dynamic.TableOffset = NtoHll (((LocatorPosition+LocatorsWritten*BytesPerSector + VHD_DATA_BLOCK_ALIGNMENT - 1)/VHD_DATA_BLOCK_ALIGNMENT)*VHD_DATA_BLOCK_ALIGNMENT);
-hVHD->Dynamic.Checksum = 0;
-hVHD->Dynamic.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Dynamic, sizeof(hVHD->Dynamic)));
-hVHD->Footer.Checksum = 0;
-hVHD->Footer.DiskType = NtoHl (VHD_DT_Differencing);
-memcpy (hVHD->Footer.DriveType, ParentFooter.DriveType, sizeof (hVHD->Footer.DriveType));
-hVHD->Footer.DriveSectorSize = ParentFooter.DriveSectorSize;
-hVHD->Footer.DriveTransferElementSize = ParentFooter.DriveTransferElementSize;
-hVHD->Footer.Checksum = NtoHl (CalculateVhdFooterChecksum (&hVHD->Footer, sizeof(hVHD->Footer)));
+static t_bool _simhx_is_zero (const uint8 *buf)
+{
+const uint32 *w = (const uint32 *)buf;
+size_t i;
 
-if (WriteFilePosition (hVHD->File,
-                       &hVHD->Footer,
-                       sizeof (hVHD->Footer),
-                       NULL,
-                       0)) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-if (WriteFilePosition (hVHD->File,
-                       &hVHD->Dynamic,
-                       sizeof (hVHD->Dynamic),
-                       NULL,
-                       NtoHll (hVHD->Footer.DataOffset))) {
-    Status = errno;
-    goto Cleanup_Return;
-    }
-if (WriteFilePosition (hVHD->File,
-                       hVHD->BAT,
-                       BytesPerSector*((NtoHl (hVHD->Dynamic.MaxTableEntries)*sizeof(*hVHD->BAT)+BytesPerSector-1)/BytesPerSector),
-                       NULL,
-                       NtoHll (hVHD->Dynamic.TableOffset))) {
-    Status = errno;
-    goto Cleanup_Return;
+for (i = 0; i < SIMHX_BLOCK_SIZE / sizeof (*w); i++)
+    if (w[i] != 0)
+        return FALSE;
+return TRUE;
+}
+
+/* Lock a store's data file against use by other processes */
+
+static t_bool _simhx_lock (FILE *f)
+{
+#if defined (_WIN32)
+OVERLAPPED ov;
+
+memset (&ov, 0, sizeof (ov));
+ov.OffsetHigh = 0x7FFFFFFF;                     /* a byte past any data, so reads aren't blocked */
+return LockFileEx ((HANDLE)_get_osfhandle (_fileno (f)), LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &ov);
+#elif defined (F_SETLK)
+struct flock fl;
+
+memset (&fl, 0, sizeof (fl));
+fl.l_type = F_WRLCK;
+fl.l_whence = SEEK_SET;                         /* start and length 0 is the whole file */
+return (fcntl (fileno (f), F_SETLK, &fl) == 0);
+#else
+return TRUE;
+#endif
+}
+
+static t_stat _simhx_store_header (FILE *f, const char *signature, t_bool create)
+{
+struct simhx_store_header h;
+
+if (create) {
+    memset (&h, 0, sizeof (h));
+    memcpy (h.Signature, signature, sizeof (h.Signature));
+    h.Version = NtoHl (SIMHX_VERSION);
+    h.BlockSize = NtoHl (SIMHX_BLOCK_SIZE);
+    h.UnitSize = NtoHl (SIMHX_UNIT_SIZE);
+    h.Checksum = NtoHl (eth_crc32 (0, &h, sizeof (h) - sizeof (h.Checksum)));
+    return _simhx_write (f, 0, &h, sizeof (h));
     }
-if (WriteFilePosition (hVHD->File,
-                       &hVHD->Footer,
-                       sizeof (hVHD->Footer),
-                       NULL,
-                       NtoHll (hVHD->Dynamic.TableOffset)+BytesPerSector*((NtoHl (hVHD->Dynamic.MaxTableEntries)*sizeof(*hVHD->BAT)+BytesPerSector-1)/BytesPerSector))) {
-    Status = errno;
-    goto Cleanup_Return;
+if ((_simhx_read (f, 0, &h, sizeof (h)) != SCPE_OK) ||
+    (memcmp (h.Signature, signature, sizeof (h.Signature)) != 0) ||
+    (h.Checksum != NtoHl (eth_crc32 (0, &h, sizeof (h) - sizeof (h.Checksum)))) ||
+    (NtoHl (h.Version) != SIMHX_VERSION) ||
+    (NtoHl (h.BlockSize) != SIMHX_BLOCK_SIZE) ||
+    (NtoHl (h.UnitSize) != SIMHX_UNIT_SIZE))
+    return SCPE_OPENERR;
+return SCPE_OK;
+}
+
+static t_stat _simhx_write_entry (SIMHX_STORE *s, uint32 slot)
+{
+SIMHX_ENTRY *e = &s->entries[slot];
+struct simhx_index_entry ie;
+
+ie.Digest[0] = NtoHl ((uint32)(e->digest >> 32));
+ie.Digest[1] = NtoHl ((uint32)e->digest);
+ie.Offset[0] = NtoHl ((uint32)(e->offset >> 32));
+ie.Offset[1] = NtoHl ((uint32)e->offset);
+ie.RefCount = NtoHl (e->refcount);
+ie.Length = NtoHl (e->length);
+ie.Units = NtoHl (e->units);
+ie.Flags = NtoHl (e->flags);
+return _simhx_write (s->index, SIMHX_HEADER_SIZE + (t_offset)slot * sizeof (ie), &ie, sizeof (ie));
+}
+
+static t_stat _simhx_write_index (SIMHX_STORE *s)
+{
+uint32 slot;
+
+if (sim_fseeko (s->index, SIMHX_HEADER_SIZE, SEEK_SET) != 0)
+    return SCPE_IOERR;
+for (slot = 0; slot < s->count; slot++) {
+    SIMHX_ENTRY *e = &s->entries[slot];
+    struct simhx_index_entry ie;
+
+    ie.Digest[0] = NtoHl ((uint32)(e->digest >> 32));
+    ie.Digest[1] = NtoHl ((uint32)e->digest);
+    ie.Offset[0] = NtoHl ((uint32)(e->offset >> 32));
+    ie.Offset[1] = NtoHl ((uint32)e->offset);
+    ie.RefCount = NtoHl (e->refcount);
+    ie.Length = NtoHl (e->length);
+    ie.Units = NtoHl (e->units);
+    ie.Flags = NtoHl (e->flags);
+    if (fwrite (&ie, sizeof (ie), 1, s->index) != 1)
+        return SCPE_IOERR;
     }
-if (hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataLength)
-    if (WriteFilePosition (hVHD->File,
-                           FullParentVHDPathUnicode,
-                           BytesPerSector,
-                           NULL,
-                           NtoHll (hVHD->Dynamic.ParentLocatorEntries[0].PlatformDataOffset))) {
-        Status = errno;
-        goto Cleanup_Return;
+return (fflush (s->index) == 0) ? SCPE_OK : SCPE_IOERR;
+}
+
+/* Link a referenced slot into its digest hash chain, growing the
+   bucket array to keep chains short */
+
+static t_stat _simhx_hash_insert (SIMHX_STORE *s, uint32 slot)
+{
+uint32 h;
+
+if (s->count > s->hash_mask) {
+    uint32 size = 2 * (s->hash_mask + 1);
+    uint32 *hash = (uint32 *)calloc (size, sizeof (*hash));
+    uint32 i;
+
+    if (hash == NULL)
+        return SCPE_MEM;
+    free (s->hash);
+    s->hash = hash;
+    s->hash_mask = size - 1;
+    for (i = 0; i < s->count; i++) {
+        if ((i == slot) || (s->entries[i].refcount == 0) ||
+            (s->entries[i].flags & SIMHX_F_CONTAINER))
+            continue;
+        h = (uint32)s->entries[i].digest & s->hash_mask;
+        s->entries[i].next = s->hash[h];
+        s->hash[h] = i + 1;
         }
-if (hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataLength)
-    if (WriteFilePosition (hVHD->File,
-                           RelativeParentVHDPathUnicode,
-                           BytesPerSector,
-                           NULL,
-                           NtoHll (hVHD->Dynamic.ParentLocatorEntries[1].PlatformDataOffset))) {
-        Status = errno;
-        goto Cleanup_Return;
+    }
+h = (uint32)s->entries[slot].digest & s->hash_mask;
+s->entries[slot].next = s->hash[h];
+s->hash[h] = slot + 1;
+return SCPE_OK;
+}
+
+static void _simhx_hash_remove (SIMHX_STORE *s, uint32 slot)
+{
+uint32 *link = &s->hash[(uint32)s->entries[slot].digest & s->hash_mask];
+
+while (*link != 0) {
+    if (*link == slot + 1) {
+        *link = s->entries[slot].next;
+        break;
         }
+    link = &s->entries[*link - 1].next;
+    }
+s->entries[slot].next = 0;
+}
 
-Cleanup_Return:
-free (RelativeParentVHDPath);
-free (FullParentVHDPath);
-free (RelativeParentVHDPathUnicode);
-free (FullParentVHDPathUnicode);
-free (FullVHDPath);
-free (TempPath);
-sim_vhd_disk_close ((FILE *)hVHD);
-hVHD = NULL;
-if (Status) {
-    if ((EEXIST != Status) && (ENOENT != Status))
-        (void)remove (szVHDPath);
+/* Find a slot for an entry of the given size, reusing a released one
+   if there is one */
+
+static t_stat _simhx_alloc_slot (SIMHX_STORE *s, uint32 units, uint32 *slot)
+{
+if (s->free[units] != 0) {                      /* reuse a released entry of this size */
+    *slot = s->free[units] - 1;
+    s->free[units] = s->entries[*slot].next;
+    return SCPE_OK;
     }
-else {
-    hVHD = (VHDHANDLE)sim_vhd_disk_open (szVHDPath, "rb+");
-    if (!hVHD)
-        Status = errno;
+if (s->count == s->size) {                      /* append a new one */
+    uint32 size = s->size ? 2 * s->size : 1024;
+    SIMHX_ENTRY *entries = (SIMHX_ENTRY *)realloc (s->entries, size * sizeof (*entries));
+
+    if (entries == NULL)
+        return SCPE_MEM;
+    s->entries = entries;
+    s->size = size;
     }
-errno = Status;
-return hVHD;
+*slot = s->count++;
+s->entries[*slot].offset = s->end;
+s->entries[*slot].units = units;
+s->end += units;
+return SCPE_OK;
 }
 
-static FILE *sim_vhd_disk_create (const char *szVHDPath, t_offset desiredsize)
+static void _simhx_free_slot (SIMHX_STORE *s, uint32 slot)
 {
-return (FILE *)sim_CreateVirtualDisk (szVHDPath, (uint32)(desiredsize/512), 0, (sim_switches & SWMASK ('X')));
+SIMHX_ENTRY *e = &s->entries[slot];
+
+e->refcount = 0;
+e->flags = 0;
+e->next = s->free[e->units];
+s->free[e->units] = slot + 1;
 }
 
-static FILE *sim_vhd_disk_create_diff (const char *szVHDPath, const char *szParentVHDPath)
+static t_stat _simhx_read_block (SIMHX_STORE *s, uint32 slot, uint8 *buf)
 {
-return (FILE *)CreateDifferencingVirtualDisk (szVHDPath, szParentVHDPath);
+SIMHX_ENTRY *e = &s->entries[slot];
+t_offset pos = SIMHX_HEADER_SIZE + (t_offset)e->offset * SIMHX_UNIT_SIZE;
+
+if (!(e->flags & SIMHX_F_LZ))
+    return _simhx_read (s->data, pos, buf, SIMHX_BLOCK_SIZE);
+if ((_simhx_read (s->data, pos, s->cbuf, e->length) != SCPE_OK) ||
+    (sim_lz_expand (s->cbuf, e->length, buf, SIMHX_BLOCK_SIZE) != SIMHX_BLOCK_SIZE))
+    return SCPE_IOERR;
+return SCPE_OK;
 }
 
-static t_stat
-ReadVirtualDisk(VHDHANDLE hVHD,
-                uint8 *buf,
-                uint32 BytesToRead,
-                uint32 *BytesRead,
-                uint64 Offset)
+/* Add a reference to a block with the given contents, storing it if it
+   isn't already present.  The slot + 1 is returned in *ref (0 for a
+   block of zeros, which is never stored). */
+
+static t_stat _simhx_store_put (SIMHX_STORE *s, const uint8 *buf, uint32 *ref)
 {
-uint32 TotalBytesRead = 0;
-uint32 BitMapBytes;
-uint32 BitMapSectors;
-uint32 DynamicBlockSize;
-t_stat r = SCPE_OK;
+t_uint64 digest;
+const uint8 *data = buf;
+SIMHX_ENTRY *e;
+uint32 slot, length, units, flags = 0;
+t_stat r;
 
-if (BytesRead)
-    *BytesRead = 0;
-if (!hVHD || (hVHD->File == NULL)) {
-    errno = EBADF;
-    return SCPE_IOERR;
-    }
-if (BytesToRead == 0)
+*ref = 0;
+if (_simhx_is_zero (buf))
     return SCPE_OK;
-if (Offset >= (uint64)NtoHll (hVHD->Footer.CurrentSize)) {
-    errno = ERANGE;
-    return SCPE_IOERR;
+digest = sim_digest (buf, SIMHX_BLOCK_SIZE);
+for (slot = s->hash[(uint32)digest & s->hash_mask]; slot != 0; slot = e->next) {
+    e = &s->entries[slot - 1];
+    if ((e->digest != digest) ||
+        (_simhx_read_block (s, slot - 1, s->buf) != SCPE_OK) ||
+        (memcmp (s->buf, buf, SIMHX_BLOCK_SIZE) != 0))
+        continue;
+    ++e->refcount;
+    *ref = slot;
+    return _simhx_write_entry (s, slot - 1);
     }
-if (NtoHl (hVHD->Footer.DiskType) == VHD_DT_Fixed) {
-    if (ReadFilePosition(hVHD->File,
-                         buf,
-                         BytesToRead,
-                         BytesRead,
-                         Offset))
-        r = SCPE_IOERR;
+length = (uint32)sim_lz_compress (buf, SIMHX_BLOCK_SIZE, s->cbuf, SIMHX_BLOCK_SIZE - SIMHX_UNIT_SIZE);
+if (length != 0) {
+    data = s->cbuf;
+    flags = SIMHX_F_LZ;
+    }
+else
+    length = SIMHX_BLOCK_SIZE;
+units = (length + SIMHX_UNIT_SIZE - 1) / SIMHX_UNIT_SIZE;
+r = _simhx_alloc_slot (s, units, &slot);
+if (r != SCPE_OK)
     return r;
+e = &s->entries[slot];
+if (data != s->cbuf) {
+    r = _simhx_write (s->data, SIMHX_HEADER_SIZE + (t_offset)e->offset * SIMHX_UNIT_SIZE, data, length);
     }
-/* We are now dealing with a Dynamically expanding or differencing disk */
-DynamicBlockSize = NtoHl (hVHD->Dynamic.BlockSize);
-if ((DynamicBlockSize == 0) ||
-    ((DynamicBlockSize & (DynamicBlockSize - 1)) != 0)) {
-    errno = ERANGE;
+else {
+    memset (s->cbuf + length, 0, units * SIMHX_UNIT_SIZE - length);
+    r = _simhx_write (s->data, SIMHX_HEADER_SIZE + (t_offset)e->offset * SIMHX_UNIT_SIZE, data, units * SIMHX_UNIT_SIZE);
+    }
+e->digest = digest;
+e->refcount = 1;
+e->length = length;
+e->flags = flags;
+if (r == SCPE_OK)
+    r = _simhx_write_entry (s, slot);
+if (r != SCPE_OK) {                             /* leave the slot free */
+    _simhx_free_slot (s, slot);
+    return r;
+    }
+*ref = slot + 1;
+return _simhx_hash_insert (s, slot);
+}
+
+static t_stat _simhx_store_release (SIMHX_STORE *s, uint32 ref)
+{
+SIMHX_ENTRY *e;
+
+if ((ref == 0) || (ref > s->count))
+    return SCPE_OK;
+e = &s->entries[ref - 1];
+if (e->refcount == 0)
+    return SCPE_OK;
+if (--e->refcount == 0) {
+    _simhx_hash_remove (s, ref - 1);
+    _simhx_free_slot (s, ref - 1);
+    }
+return _simhx_write_entry (s, ref - 1);
+}
+
+/* Container registration */
+
+static t_uint64 _simhx_id_digest (const uint8 *id)
+{
+t_uint64 digest = 0;
+int i;
+
+for (i = 0; i < 8; i++)
+    digest = (digest << 8) | id[i];
+return digest;
+}
+
+static t_stat _simhx_read_record (SIMHX_STORE *s, uint32 slot, struct simhx_container_record *rec)
+{
+if ((_simhx_read (s->data, SIMHX_HEADER_SIZE + (t_offset)s->entries[slot].offset * SIMHX_UNIT_SIZE, rec, sizeof (*rec)) != SCPE_OK) ||
+    (rec->Checksum != NtoHl (eth_crc32 (0, rec, sizeof (*rec) - sizeof (rec->Checksum)))))
     return SCPE_IOERR;
+rec->Name[sizeof (rec->Name) - 1] = '\0';
+return SCPE_OK;
+}
+
+static t_stat _simhx_write_record (SIMHX_STORE *s, uint32 slot, const uint8 *id, const char *name)
+{
+struct simhx_container_record rec;
+
+memset (&rec, 0, sizeof (rec));
+memcpy (rec.ContainerId, id, sizeof (rec.ContainerId));
+strlcpy ((char *)rec.Name, name, sizeof (rec.Name));
+rec.Checksum = NtoHl (eth_crc32 (0, &rec, sizeof (rec) - sizeof (rec.Checksum)));
+return _simhx_write (s->data, SIMHX_HEADER_SIZE + (t_offset)s->entries[slot].offset * SIMHX_UNIT_SIZE, &rec, sizeof (rec));
+}
+
+/* Return the slot + 1 of the record registering a container id, or 0 */
+
+static uint32 _simhx_find_record (SIMHX_STORE *s, const uint8 *id, struct simhx_container_record *rec)
+{
+t_uint64 digest = _simhx_id_digest (id);
+uint32 slot;
+
+for (slot = 0; slot < s->count; slot++) {
+    SIMHX_ENTRY *e = &s->entries[slot];
+
+    if ((e->refcount != 0) && (e->flags & SIMHX_F_CONTAINER) && (e->digest == digest) &&
+        (_simhx_read_record (s, slot, rec) == SCPE_OK) &&
+        (memcmp (rec->ContainerId, id, sizeof (rec->ContainerId)) == 0))
+        return slot + 1;
     }
-BitMapBytes = (7+(DynamicBlockSize / VHD_Internal_SectorSize))/8;
-BitMapSectors = (BitMapBytes+VHD_Internal_SectorSize-1)/VHD_Internal_SectorSize;
-while (BytesToRead && (r == SCPE_OK)) {
-    uint32 BlockNumber = (uint32)(Offset / DynamicBlockSize);
-    uint32 BytesInRead = BytesToRead;
-    uint32 BytesThisRead = 0;
+return 0;
+}
 
-    if (BlockNumber != (Offset + BytesToRead) / DynamicBlockSize)
-        BytesInRead = (uint32)(((BlockNumber + 1) * DynamicBlockSize) - Offset);
-    if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
-        if (!hVHD->Parent) {
-            memset (buf, 0, BytesInRead);
-            BytesThisRead = BytesInRead;
+/* Give a new container an id which isn't already in use and register it */
+
+static t_stat _simhx_register (SIMHX_DISK *hx, const char *szSIMHXPath)
+{
+SIMHX_STORE *s = hx->Store;
+struct simhx_container_record rec;
+char *name = sim_filepath_parts (szSIMHXPath, "nx");
+uint32 slot;
+int i;
+t_stat r;
+
+if (name == NULL)
+    return SCPE_MEM;
+uuid_gen (hx->Header.ContainerId);
+while (_simhx_find_record (s, hx->Header.ContainerId, &rec) != 0)   /* ids without libuuid can repeat */
+    for (i = sizeof (hx->Header.ContainerId) - 1; (i >= 0) && (++hx->Header.ContainerId[i] == 0); i--)
+        ;
+r = _simhx_alloc_slot (s, 1, &slot);
+if (r == SCPE_OK) {
+    SIMHX_ENTRY *e = &s->entries[slot];
+
+    e->digest = _simhx_id_digest (hx->Header.ContainerId);
+    e->refcount = 1;
+    e->length = sizeof (rec);
+    e->flags = SIMHX_F_CONTAINER;
+    r = _simhx_write_record (s, slot, hx->Header.ContainerId, name);
+    if (r == SCPE_OK)
+        r = _simhx_write_entry (s, slot);
+    if (r == SCPE_OK)
+        hx->Registration = slot + 1;
+    else
+        _simhx_free_slot (s, slot);
+    }
+free (name);
+return r;
+}
+
+static void _simhx_unregister (SIMHX_DISK *hx)
+{
+if (hx->Registration == 0)
+    return;
+_simhx_free_slot (hx->Store, hx->Registration - 1);
+(void)_simhx_write_entry (hx->Store, hx->Registration - 1);
+hx->Registration = 0;
+}
+
+/* Read a container's header, returning FALSE if it isn't a container */
+
+static t_bool _simhx_read_header (FILE *f, struct simhx_header *h)
+{
+return ((_simhx_read (f, 0, h, sizeof (*h)) == SCPE_OK) &&
+        (memcmp (h->Signature, "SIMHXDSK", sizeof (h->Signature)) == 0) &&
+        (h->Checksum == NtoHl (eth_crc32 (0, h, sizeof (*h) - sizeof (h->Checksum)))) &&
+        (NtoHl (h->Version) == SIMHX_VERSION) &&
+        (NtoHl (h->BlockSize) == SIMHX_BLOCK_SIZE));
+}
+
+/* TRUE if a file is a container with the given id */
+
+static t_bool _simhx_has_id (const char *path, const uint8 *id)
+{
+FILE *f = sim_fopen (path, "rb");
+struct simhx_header h;
+t_bool same;
+
+if (f == NULL)
+    return FALSE;
+same = _simhx_read_header (f, &h) && (memcmp (h.ContainerId, id, sizeof (h.ContainerId)) == 0);
+fclose (f);
+return same;
+}
+
+/* TRUE if two names refer to the same file */
+
+static t_bool _simhx_same_file (const char *path1, const char *path2)
+{
+struct stat stat1, stat2;
+
+if ((sim_stat (path1, &stat1) != 0) || (sim_stat (path2, &stat2) != 0))
+    return FALSE;
+if (stat1.st_ino != 0)
+    return (stat1.st_dev == stat2.st_dev) && (stat1.st_ino == stat2.st_ino);
+return (strcasecmp (path1, path2) == 0);        /* no inode numbers (Windows) */
+}
+
+/* Make sure that an opened container is the one whose references its
+   store counted.  A container which has been renamed (or copied, with
+   the original then deleted) has its new name recorded. */
+
+static t_stat _simhx_check_registration (SIMHX_DISK *hx, const char *szSIMHXPath)
+{
+SIMHX_STORE *s = hx->Store;
+struct simhx_container_record rec;
+char *name = sim_filepath_parts (szSIMHXPath, "nx");
+char *dir = sim_filepath_parts (s->path, "p");
+char *path = NULL;
+t_stat r = SCPE_OK;
+
+if ((name == NULL) || (dir == NULL) ||
+    (NULL == (path = (char *)malloc (strlen (dir) + sizeof (rec.Name))))) {
+    free (name);
+    free (dir);
+    return SCPE_MEM;
+    }
+SIMHX_LOCK (s);
+hx->Registration = _simhx_find_record (s, hx->Header.ContainerId, &rec);
+if (hx->Registration == 0) {
+    sim_printf ("SIMHX container '%s' is not registered in its store, it may be a copy of a deleted container\n", szSIMHXPath);
+    r = SCPE_OPENERR;
+    }
+else {
+    sprintf (path, "%s%s", dir, (char *)rec.Name);
+    if (!_simhx_same_file (path, szSIMHXPath)) {
+        if (_simhx_has_id (path, hx->Header.ContainerId)) {
+            sim_printf ("SIMHX container '%s' is a copy of '%s', use ATTACH -C or DISKSNAPSHOT to copy SIMHX disks\n", szSIMHXPath, path);
+            r = SCPE_OPENERR;
             }
-        else {
-            if (ReadVirtualDisk(hVHD->Parent,
-                                buf,
-                                BytesInRead,
-                                &BytesThisRead,
-                                Offset))
-                r = SCPE_IOERR;
+        else
+            r = _simhx_write_record (s, hx->Registration - 1, hx->Header.ContainerId, name);
+        }
+    }
+SIMHX_UNLOCK (s);
+free (path);
+free (dir);
+free (name);
+return r;
+}
+
+static void _simhx_store_free (SIMHX_STORE *s)
+{
+if (s->data)
+    fclose (s->data);
+if (s->index)
+    fclose (s->index);
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_destroy (&s->lock);
+#endif
+free (s->entries);
+free (s->hash);
+free (s->path);
+free (s);
+}
+
+/* Find or open the store used by a container.  All containers naming
+   the same store file share one in memory copy of its index. */
+
+static SIMHX_STORE *_simhx_store_open (const char *szSIMHXPath, const char *StoreName, t_bool create)
+{
+char *dir = sim_filepath_parts (szSIMHXPath, "p");
+char *path, *name = NULL;
+char ipath[PATH_MAX + 1];
+SIMHX_STORE *s = NULL;
+t_offset size;
+uint32 slot;
+
+if (dir == NULL)
+    return NULL;
+path = (char *)malloc (strlen (dir) + strlen (StoreName) + 1);
+if (path != NULL) {
+    sprintf (path, "%s%s", dir, StoreName);
+    name = sim_filepath_parts (path, "f");
+    }
+free (dir);
+free (path);
+if (name == NULL)
+    return NULL;
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_lock (&simhx_stores_lock);
+#endif
+for (s = simhx_stores; s != NULL; s = s->next)
+    if (strcmp (s->path, name) == 0)
+        break;
+if (s != NULL) {
+    ++s->users;
+    free (name);
+    goto Done;
+    }
+s = (SIMHX_STORE *)calloc (1, sizeof (*s));
+if (s == NULL) {
+    free (name);
+    goto Done;
+    }
+s->path = name;
+s->users = 1;
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_init (&s->lock, NULL);
+#endif
+snprintf (ipath, sizeof (ipath), "%s%s", name, SIMHX_INDEX_SUFFIX);
+s->data = sim_fopen (name, "rb+");
+s->index = sim_fopen (ipath, "rb+");
+if ((s->data == NULL) && (s->index == NULL) && create && (errno == ENOENT)) {
+    s->data = sim_fopen (name, "wb+");
+    s->index = sim_fopen (ipath, "wb+");
+    if ((s->data == NULL) || (s->index == NULL) || !_simhx_lock (s->data) ||
+        (_simhx_store_header (s->data, "SIMHXSTO", TRUE) != SCPE_OK) ||
+        (_simhx_store_header (s->index, "SIMHXIDX", TRUE) != SCPE_OK)) {
+        _simhx_store_free (s);
+        (void)remove (name);
+        (void)remove (ipath);
+        s = NULL;
+        goto Done;
+        }
+    }
+if ((s->data != NULL) && !_simhx_lock (s->data)) {
+    sim_printf ("SIMHX store '%s' is in use by another simulator\n", name);
+    _simhx_store_free (s);
+    s = NULL;
+    goto Done;
+    }
+if ((s->data == NULL) || (s->index == NULL) ||
+    (_simhx_store_header (s->data, "SIMHXSTO", FALSE) != SCPE_OK) ||
+    (_simhx_store_header (s->index, "SIMHXIDX", FALSE) != SCPE_OK)) {
+    _simhx_store_free (s);
+    s = NULL;
+    goto Done;
+    }
+size = sim_fsize_ex (s->data);
+s->end = (size > SIMHX_HEADER_SIZE) ? (t_uint64)((size - SIMHX_HEADER_SIZE + SIMHX_UNIT_SIZE - 1) / SIMHX_UNIT_SIZE) : 0;
+size = sim_fsize_ex (s->index);
+s->count = (size > SIMHX_HEADER_SIZE) ? (uint32)((size - SIMHX_HEADER_SIZE) / sizeof (struct simhx_index_entry)) : 0;
+s->size = s->count + 1024;
+s->entries = (SIMHX_ENTRY *)calloc (s->size, sizeof (*s->entries));
+for (s->hash_mask = 1023; s->hash_mask < s->count; s->hash_mask = 2 * s->hash_mask + 1);
+s->hash = (uint32 *)calloc (s->hash_mask + 1, sizeof (*s->hash));
+if ((s->entries == NULL) || (s->hash == NULL) ||
+    (sim_fseeko (s->index, SIMHX_HEADER_SIZE, SEEK_SET) != 0)) {
+    _simhx_store_free (s);
+    s = NULL;
+    goto Done;
+    }
+for (slot = 0; slot < s->count; slot++) {
+    SIMHX_ENTRY *e = &s->entries[slot];
+    struct simhx_index_entry ie;
+
+    if (fread (&ie, sizeof (ie), 1, s->index) != 1)
+        break;
+    e->digest = ((t_uint64)NtoHl (ie.Digest[0]) << 32) | NtoHl (ie.Digest[1]);
+    e->offset = ((t_uint64)NtoHl (ie.Offset[0]) << 32) | NtoHl (ie.Offset[1]);
+    e->refcount = NtoHl (ie.RefCount);
+    e->length = NtoHl (ie.Length);
+    e->units = NtoHl (ie.Units);
+    e->flags = NtoHl (ie.Flags);
+    if ((e->units == 0) || (e->units > SIMHX_MAX_UNITS) ||
+        (e->length > e->units * SIMHX_UNIT_SIZE) ||
+        (e->offset + e->units > s->end))
+        break;
+    if (e->refcount == 0) {
+        e->next = s->free[e->units];
+        s->free[e->units] = slot + 1;
+        }
+    else {
+        uint32 h = (uint32)e->digest & s->hash_mask;
+
+        e->next = s->hash[h];
+        s->hash[h] = slot + 1;
+        }
+    }
+if (slot != s->count) {
+    sim_printf ("SIMHX store index '%s' is damaged at entry %u\n", ipath, slot);
+    _simhx_store_free (s);
+    s = NULL;
+    goto Done;
+    }
+s->next = simhx_stores;
+simhx_stores = s;
+Done:
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_unlock (&simhx_stores_lock);
+#endif
+return s;
+}
+
+static void _simhx_store_close (SIMHX_STORE *s)
+{
+SIMHX_STORE **link;
+
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_lock (&simhx_stores_lock);
+#endif
+if (--s->users == 0) {
+    for (link = &simhx_stores; *link != NULL; link = &(*link)->next)
+        if (*link == s) {
+            *link = s->next;
+            break;
             }
-        }
-    else {
-        uint64 BlockOffset = VHD_Internal_SectorSize * ((uint64)(NtoHl (hVHD->BAT[BlockNumber]) + BitMapSectors)) + (Offset % DynamicBlockSize);
+    _simhx_store_free (s);
+    }
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_unlock (&simhx_stores_lock);
+#endif
+}
 
-        if (ReadFilePosition(hVHD->File,
-                             buf,
-                             BytesInRead,
-                             &BytesThisRead,
-                             BlockOffset))
-            r = SCPE_IOERR;
-        }
-    BytesToRead -= BytesThisRead;
-    buf = (uint8 *)(((char *)buf) + BytesThisRead);
-    Offset += BytesThisRead;
-    TotalBytesRead += BytesThisRead;
+static t_stat _simhx_write_header (SIMHX_DISK *hx)
+{
+hx->Header.Checksum = NtoHl (eth_crc32 (0, &hx->Header, sizeof (hx->Header) - sizeof (hx->Header.Checksum)));
+return _simhx_write (hx->File, 0, &hx->Header, sizeof (hx->Header));
+}
+
+static t_stat _simhx_write_map (SIMHX_DISK *hx, uint32 first, uint32 count)
+{
+uint32 i;
+
+if (sim_fseeko (hx->File, SIMHX_HEADER_SIZE + (t_offset)first * sizeof (*hx->Map), SEEK_SET) != 0)
+    return SCPE_IOERR;
+for (i = first; i < first + count; i++) {
+    uint32 ref = NtoHl (hx->Map[i]);
+
+    if (fwrite (&ref, sizeof (ref), 1, hx->File) != 1)
+        return SCPE_IOERR;
     }
-if (BytesRead)
-    *BytesRead = TotalBytesRead;
 return SCPE_OK;
 }
 
-static t_stat
-ReadVirtualDiskSectors(VHDHANDLE hVHD,
-                       uint8 *buf,
-                       t_seccnt sects,
-                       t_seccnt *sectsread,
-                       uint32 SectorSize,
-                       t_lba lba)
+static void _simhx_disk_free (SIMHX_DISK *hx)
 {
-uint32 BytesRead;
-t_stat r = ReadVirtualDisk(hVHD,
-                           buf,
-                           sects * SectorSize,
-                           &BytesRead,
-                           SectorSize * (uint64)lba);
-if (sectsread)
-    *sectsread = BytesRead / SectorSize;
-return r;
+if (hx->File)
+    fclose (hx->File);
+if (hx->Store)
+    _simhx_store_close (hx->Store);
+free (hx->Map);
+free (hx);
 }
 
-static t_stat sim_vhd_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+/* TRUE if a file has a SIMHX container header, whether or not it can
+   be opened */
+
+static t_bool sim_simhx_disk_is_container (const char *szSIMHXPath)
 {
-VHDHANDLE hVHD = (VHDHANDLE)uptr->fileref;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+FILE *f = sim_fopen (szSIMHXPath, "rb");
+struct simhx_header h;
+t_bool is_container;
 
-return ReadVirtualDiskSectors(hVHD, buf, sects, sectsread, ctx->sector_size, lba);
+if (f == NULL)
+    return FALSE;
+is_container = _simhx_read_header (f, &h);
+fclose (f);
+return is_container;
 }
 
-static t_stat sim_vhd_disk_clearerr (UNIT *uptr)
+static FILE *sim_simhx_disk_open (const char *szSIMHXPath, const char *DesiredAccess)
 {
-VHDHANDLE hVHD = (VHDHANDLE)uptr->fileref;
+SIMHX_DISK *hx = (SIMHX_DISK *)calloc (1, sizeof (*hx));
+int saved_errno;
+uint32 i;
 
-clearerr (hVHD->File);
-return SCPE_OK;
+if (hx == NULL)
+    return NULL;
+if (*DesiredAccess == 'w') {            /* containers are only made by sim_simhx_disk_create */
+    free (hx);
+    errno = EINVAL;
+    return NULL;
+    }
+hx->File = sim_fopen (szSIMHXPath, DesiredAccess);
+if (hx->File == NULL) {
+    saved_errno = errno;
+    free (hx);
+    errno = saved_errno;
+    return NULL;
+    }
+if (!_simhx_read_header (hx->File, &hx->Header)) {
+    _simhx_disk_free (hx);
+    errno = EINVAL;
+    return NULL;
+    }
+hx->DiskSize = (((t_offset)NtoHl (hx->Header.DiskSize[0])) << 32) | NtoHl (hx->Header.DiskSize[1]);
+hx->BlockCount = NtoHl (hx->Header.BlockCount);
+hx->Header.StoreName[sizeof (hx->Header.StoreName) - 1] = '\0';
+hx->Map = (uint32 *)calloc (hx->BlockCount + 1, sizeof (*hx->Map));
+if ((hx->Map == NULL) ||
+    (hx->BlockCount < (hx->DiskSize + SIMHX_BLOCK_SIZE - 1) / SIMHX_BLOCK_SIZE) ||
+    (_simhx_read (hx->File, SIMHX_HEADER_SIZE, hx->Map, hx->BlockCount * sizeof (*hx->Map)) != SCPE_OK)) {
+    _simhx_disk_free (hx);
+    errno = EINVAL;
+    return NULL;
+    }
+hx->Store = _simhx_store_open (szSIMHXPath, (char *)hx->Header.StoreName, FALSE);
+if (hx->Store == NULL) {
+    sim_printf ("Can't open the SIMHX store '%s' of '%s'\n", (char *)hx->Header.StoreName, szSIMHXPath);
+    _simhx_disk_free (hx);
+    errno = EBUSY;                      /* not ENOENT: the container itself exists */
+    return NULL;
+    }
+for (i = 0; i < hx->BlockCount; i++) {
+    hx->Map[i] = NtoHl (hx->Map[i]);
+    if ((hx->Map[i] > hx->Store->count) ||
+        ((hx->Map[i] != 0) && (hx->Store->entries[hx->Map[i] - 1].flags & SIMHX_F_CONTAINER))) {
+        sim_printf ("SIMHX container '%s' refers to block %u which is not in its store\n", szSIMHXPath, hx->Map[i] - 1);
+        _simhx_disk_free (hx);
+        errno = EINVAL;
+        return NULL;
+        }
+    }
+if (_simhx_check_registration (hx, szSIMHXPath) != SCPE_OK) {
+    _simhx_disk_free (hx);
+    errno = EINVAL;                     /* not EACCES: a read only retry fails the same way */
+    return NULL;
+    }
+return (FILE *)hx;
 }
 
-static t_bool
-BufferIsZeros(void *Buffer, size_t BufferSize)
+static t_stat _simhx_disk_init (SIMHX_DISK *hx, t_offset desiredsize, const char *StoreName, const char *szSIMHXPath)
 {
-size_t i;
-char *c = (char *)Buffer;
+time_t now = time (NULL);
+t_stat r;
 
-for (i=0; i<BufferSize; ++i)
-    if (c[i])
-        return FALSE;
-return TRUE;
+memcpy (hx->Header.Signature, "SIMHXDSK", sizeof (hx->Header.Signature));
+hx->Header.Version = NtoHl (SIMHX_VERSION);
+hx->Header.BlockSize = NtoHl (SIMHX_BLOCK_SIZE);
+hx->Header.DiskSize[0] = NtoHl ((uint32)(desiredsize >> 32));
+hx->Header.DiskSize[1] = NtoHl ((uint32)(desiredsize & 0xFFFFFFFF));
+hx->Header.BlockCount = NtoHl (hx->BlockCount);
+memset (hx->Header.CreationTime, 0, sizeof (hx->Header.CreationTime));
+strlcpy ((char *)hx->Header.CreationTime, ctime (&now), sizeof (hx->Header.CreationTime));
+memset (hx->Header.StoreName, 0, sizeof (hx->Header.StoreName));
+strlcpy ((char *)hx->Header.StoreName, StoreName, sizeof (hx->Header.StoreName));
+SIMHX_LOCK (hx->Store);
+r = _simhx_register (hx, szSIMHXPath);
+if ((r == SCPE_OK) &&
+    ((_simhx_write_header (hx) != SCPE_OK) ||
+     (_simhx_write_map (hx, 0, hx->BlockCount) != SCPE_OK) ||
+     (fflush (hx->File) != 0))) {
+    _simhx_unregister (hx);
+    r = SCPE_IOERR;
+    }
+SIMHX_UNLOCK (hx->Store);
+return r;
 }
 
-static t_stat
-WriteVirtualDisk(VHDHANDLE hVHD,
-                 uint8 *buf,
-                 uint32 BytesToWrite,
-                 uint32 *BytesWritten,
-                 uint64 Offset)
+static FILE *sim_simhx_disk_create (const char *szSIMHXPath, t_offset desiredsize)
 {
-uint32 TotalBytesWritten = 0;
-uint32 BitMapBytes;
-uint32 BitMapSectors;
-uint32 DynamicBlockSize;
-t_stat r = SCPE_OK;
+SIMHX_DISK *hx;
 
-if (BytesWritten)
-    *BytesWritten = 0;
-if (!hVHD || !hVHD->File) {
-    errno = EBADF;
-    return SCPE_IOERR;
+if (desiredsize <= 0)
+    return NULL;
+hx = (SIMHX_DISK *)calloc (1, sizeof (*hx));
+if (hx == NULL)
+    return NULL;
+hx->DiskSize = desiredsize;
+hx->BlockCount = (uint32)((desiredsize + SIMHX_BLOCK_SIZE - 1) / SIMHX_BLOCK_SIZE);
+hx->Map = (uint32 *)calloc (hx->BlockCount + 1, sizeof (*hx->Map));
+hx->File = sim_fopen (szSIMHXPath, "wb+");
+if ((hx->Map == NULL) || (hx->File == NULL)) {
+    _simhx_disk_free (hx);
+    return NULL;
     }
-if (BytesToWrite == 0)
-    return SCPE_OK;
-if (Offset >= (uint64)NtoHll(hVHD->Footer.CurrentSize)) {
-    errno = ERANGE;
-    return SCPE_IOERR;
+hx->Store = _simhx_store_open (szSIMHXPath, SIMHX_STORE_NAME, TRUE);
+if ((hx->Store == NULL) ||
+    (_simhx_disk_init (hx, desiredsize, SIMHX_STORE_NAME, szSIMHXPath) != SCPE_OK)) {
+    _simhx_disk_free (hx);
+    (void)remove (szSIMHXPath);
+    return NULL;
     }
-if (NtoHl(hVHD->Footer.DiskType) == VHD_DT_Fixed) {
-    if (WriteFilePosition(hVHD->File,
-                          buf,
-                          BytesToWrite,
-                          BytesWritten,
-                          Offset))
-        r = SCPE_IOERR;
-    return r;
+return (FILE *)hx;
+}
+
+/* Create a new container which refers to the same store blocks as an
+   open one.  The new container must be in the same directory, since
+   the store is named relative to the container. */
+
+static FILE *sim_simhx_disk_snapshot (FILE *f, const char *szSnapshotPath)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
+SIMHX_STORE *s = hx->Store;
+SIMHX_DISK *snap;
+char *dir1, *dir2;
+t_bool same_dir;
+uint32 i;
+t_stat r;
+
+dir1 = sim_filepath_parts (szSnapshotPath, "p");
+dir2 = sim_filepath_parts (s->path, "p");
+same_dir = (dir1 != NULL) && (dir2 != NULL) && (strcmp (dir1, dir2) == 0);
+free (dir1);
+free (dir2);
+if (!same_dir) {
+    sim_printf ("A SIMHX snapshot must be in the same directory as its store: %s\n", s->path);
+    return NULL;
     }
-/* We are now dealing with a Dynamically expanding or differencing disk */
-DynamicBlockSize = NtoHl (hVHD->Dynamic.BlockSize);
-if ((DynamicBlockSize == 0) ||
-    ((DynamicBlockSize & (DynamicBlockSize - 1)) != 0)) {
-    errno = ERANGE;
-    return SCPE_IOERR;
+snap = (SIMHX_DISK *)calloc (1, sizeof (*snap));
+if (snap == NULL)
+    return NULL;
+snap->Map = (uint32 *)malloc ((hx->BlockCount + 1) * sizeof (*snap->Map));
+snap->File = sim_fopen (szSnapshotPath, "wb+");
+if ((snap->Map == NULL) || (snap->File == NULL)) {
+    _simhx_disk_free (snap);
+    return NULL;
     }
-BitMapBytes = (7 + (DynamicBlockSize / VHD_Internal_SectorSize)) / 8;
-BitMapSectors = (BitMapBytes + VHD_Internal_SectorSize - 1) / VHD_Internal_SectorSize;
-while (BytesToWrite && (r == SCPE_OK)) {
-    uint32 BlockNumber = (uint32)(Offset / DynamicBlockSize);
-    uint32 BytesInWrite = BytesToWrite;
-    uint32 BytesThisWrite = 0;
+snap->Store = _simhx_store_open (szSnapshotPath, (char *)hx->Header.StoreName, FALSE);
+if (snap->Store != s) {
+    _simhx_disk_free (snap);
+    (void)remove (szSnapshotPath);
+    return NULL;
+    }
+snap->DiskSize = hx->DiskSize;
+snap->BlockCount = hx->BlockCount;
+snap->Header = hx->Header;
+SIMHX_LOCK (s);
+memcpy (snap->Map, hx->Map, hx->BlockCount * sizeof (*snap->Map));
+for (i = 0; i < snap->BlockCount; i++)          /* references first */
+    if (snap->Map[i] != 0)
+        ++s->entries[snap->Map[i] - 1].refcount;
+r = _simhx_write_index (s);
+SIMHX_UNLOCK (s);
+if (r == SCPE_OK)
+    r = _simhx_disk_init (snap, snap->DiskSize, (char *)hx->Header.StoreName, szSnapshotPath);
+if (r != SCPE_OK) {                             /* unreferenced blocks are left in the store */
+    _simhx_disk_free (snap);
+    (void)remove (szSnapshotPath);
+    return NULL;
+    }
+return (FILE *)snap;
+}
 
-    if (BlockNumber >= NtoHl(hVHD->Dynamic.MaxTableEntries)) {
-        return SCPE_EOF;
-        }
-    if (BlockNumber != (Offset + BytesToWrite) / DynamicBlockSize)
-        BytesInWrite = (uint32)(((BlockNumber + 1) * DynamicBlockSize) - Offset);
-    if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
-        uint8 *BitMap = NULL;
-        uint32 BitMapBufferSize = VHD_DATA_BLOCK_ALIGNMENT;
-        uint8 *BitMapBuffer = NULL;
-        void *BlockData = NULL;
-        uint8 *BATUpdateBufferAddress;
-        uint32 BATUpdateBufferSize;
-        uint64 BATUpdateStorageAddress;
-        uint64 BlockOffset;
+static int sim_simhx_disk_close (FILE *f)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
+int r = 0;
 
-        if (!hVHD->Parent && BufferIsZeros(buf, BytesInWrite)) {
-            BytesThisWrite = BytesInWrite;
-            goto IO_Done;
-            }
-        /* Need to allocate a new Data Block. */
-        BlockOffset = sim_fsize_ex (hVHD->File);
-        if (((int64)BlockOffset) == -1)
-            return SCPE_IOERR;
-        if ((BitMapSectors * VHD_Internal_SectorSize) > BitMapBufferSize)
-            BitMapBufferSize = BitMapSectors * VHD_Internal_SectorSize;
-        BitMapBuffer = (uint8 *)calloc(1, BitMapBufferSize + DynamicBlockSize);
-        if (BitMapBufferSize > BitMapSectors * VHD_Internal_SectorSize)
-            BitMap = BitMapBuffer + BitMapBufferSize - BitMapBytes;
-        else
-            BitMap = BitMapBuffer;
-        memset(BitMap, 0xFF, BitMapBytes);
-        BlockOffset -= sizeof(hVHD->Footer);
-        if (0 == (BlockOffset & (VHD_DATA_BLOCK_ALIGNMENT-1)))
-            {  // Already aligned, so use padded BitMapBuffer
-            if (WriteFilePosition(hVHD->File,
-                                  BitMapBuffer,
-                                  BitMapBufferSize + DynamicBlockSize,
-                                  NULL,
-                                  BlockOffset)) {
-                free (BitMapBuffer);
-                return SCPE_IOERR;
-                }
-            BlockOffset += BitMapBufferSize;
-            }
-        else
-            {
-            // align the data portion of the block to the desired alignment
-            // compute the address of the data portion of the block
-            BlockOffset += BitMapSectors * VHD_Internal_SectorSize;
-            // round up this address to the desired alignment
-            BlockOffset += VHD_DATA_BLOCK_ALIGNMENT-1;
-            BlockOffset &= ~(VHD_DATA_BLOCK_ALIGNMENT - 1);
-            BlockOffset -= BitMapSectors * VHD_Internal_SectorSize;
-            if (WriteFilePosition(hVHD->File,
-                                  BitMap,
-                                  (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize,
-                                  NULL,
-                                  BlockOffset)) {
-                free (BitMapBuffer);
-                return SCPE_IOERR;
-                }
-            BlockOffset += BitMapSectors * VHD_Internal_SectorSize;
-            }
-        free(BitMapBuffer);
-        BitMapBuffer = BitMap = NULL;
-        /* the BAT block address is the beginning of the block bitmap */
-        BlockOffset -= BitMapSectors * VHD_Internal_SectorSize;
-        hVHD->BAT[BlockNumber] = NtoHl((uint32)(BlockOffset / VHD_Internal_SectorSize));
-        BlockOffset += (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize;
-        if (WriteFilePosition(hVHD->File,
-                              &hVHD->Footer,
-                              sizeof(hVHD->Footer),
-                              NULL,
-                              BlockOffset))
-            goto Fatal_IO_Error;
-        /* Since a large VHD can have a pretty large BAT, and we've only changed one longword bat entry
-           in the current BAT, we write just the aligned sector which contains the updated BAT entry */
-        BATUpdateBufferAddress = (uint8 *)hVHD->BAT - (size_t)NtoHll(hVHD->Dynamic.TableOffset) +
-            (size_t)((((size_t)&hVHD->BAT[BlockNumber]) - (size_t)hVHD->BAT + (size_t)NtoHll(hVHD->Dynamic.TableOffset)) & ~(VHD_DATA_BLOCK_ALIGNMENT-1));
-        /* If the starting of the BAT isn't on a VHD_DATA_BLOCK_ALIGNMENT boundary and we've just updated
-           a BAT entry early in the array, the buffer computed address might be before the start of the
-           BAT table.  If so, only write the BAT data needed */
-        if (BATUpdateBufferAddress < (uint8 *)hVHD->BAT) {
-            BATUpdateBufferAddress = (uint8 *)hVHD->BAT;
-            BATUpdateBufferSize = (uint32)((((size_t)&hVHD->BAT[BlockNumber]) - (size_t)hVHD->BAT) + 512) & ~511;
-            BATUpdateStorageAddress = NtoHll(hVHD->Dynamic.TableOffset);
-            }
+if (hx == NULL)
+    return EOF;
+if ((fflush (hx->File) != 0) ||
+    (fflush (hx->Store->data) != 0) ||
+    (fflush (hx->Store->index) != 0))
+    r = EOF;
+_simhx_disk_free (hx);
+return r;
+}
+
+static void sim_simhx_disk_flush (FILE *f)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
+
+if (hx == NULL)
+    return;
+SIMHX_LOCK (hx->Store);
+fflush (hx->File);
+fflush (hx->Store->data);
+fflush (hx->Store->index);
+SIMHX_UNLOCK (hx->Store);
+}
+
+static t_offset sim_simhx_disk_size (FILE *f)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
+
+return hx ? hx->DiskSize : (t_offset)-1;
+}
+
+static t_stat sim_simhx_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)uptr->fileref;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+SIMHX_STORE *s = hx->Store;
+t_offset pos = (t_offset)lba * ctx->sector_size;
+t_offset end = pos + (t_offset)sects * ctx->sector_size;
+t_stat r = SCPE_OK;
+
+if (sectsread)
+    *sectsread = 0;
+if (end > hx->DiskSize)
+    end = hx->DiskSize;
+SIMHX_LOCK (s);
+while ((pos < end) && (r == SCPE_OK)) {
+    uint32 blk = (uint32)(pos / SIMHX_BLOCK_SIZE);
+    uint32 offset = (uint32)(pos % SIMHX_BLOCK_SIZE);
+    uint32 bytes = SIMHX_BLOCK_SIZE - offset;
+
+    if ((t_offset)bytes > end - pos)
+        bytes = (uint32)(end - pos);
+    if (hx->Map[blk] == 0)
+        memset (buf, 0, bytes);
+    else {
+        if (bytes == SIMHX_BLOCK_SIZE)
+            r = _simhx_read_block (s, hx->Map[blk] - 1, buf);
         else {
-            BATUpdateBufferSize = VHD_DATA_BLOCK_ALIGNMENT;
-            BATUpdateStorageAddress = NtoHll(hVHD->Dynamic.TableOffset) + BATUpdateBufferAddress - ((uint8 *)hVHD->BAT);
+            r = _simhx_read_block (s, hx->Map[blk] - 1, s->buf);
+            memcpy (buf, s->buf + offset, bytes);
             }
-        /* If the total BAT is smaller than one VHD_DATA_BLOCK_ALIGNMENT, then be sure to only write out the BAT data */
-        if ((size_t)(BATUpdateBufferAddress - (uint8 *)hVHD->BAT + BATUpdateBufferSize) > VHD_Internal_SectorSize * ((sizeof(*hVHD->BAT)*NtoHl(hVHD->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1)/VHD_Internal_SectorSize))
-            BATUpdateBufferSize = (uint32)(VHD_Internal_SectorSize * ((sizeof(*hVHD->BAT) * NtoHl(hVHD->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1)/VHD_Internal_SectorSize) - (BATUpdateBufferAddress - ((uint8 *)hVHD->BAT)));
-        if (WriteFilePosition(hVHD->File,
-                              BATUpdateBufferAddress,
-                              BATUpdateBufferSize,
-                              NULL,
-                              BATUpdateStorageAddress))
-            goto Fatal_IO_Error;
-        if (hVHD->Parent)
-            { /* Need to populate data block contents from parent VHD */
-            BlockData = malloc (NtoHl (hVHD->Dynamic.BlockSize));
+        }
+    buf += bytes;
+    pos += bytes;
+    }
+SIMHX_UNLOCK (s);
+if (sectsread)
+    *sectsread = (t_seccnt)((pos - (t_offset)lba * ctx->sector_size) / ctx->sector_size);
+if ((r == SCPE_OK) && (pos < (t_offset)(lba + sects) * ctx->sector_size))
+    r = SCPE_IOERR;                             /* beyond the end of the disk */
+return r;
+}
 
-            if (ReadVirtualDisk(hVHD->Parent,
-                                (uint8*) BlockData,
-                                NtoHl (hVHD->Dynamic.BlockSize),
-                                NULL,
-                                (Offset / NtoHl (hVHD->Dynamic.BlockSize)) * NtoHl (hVHD->Dynamic.BlockSize)))
-                goto Fatal_IO_Error;
-            if (WriteVirtualDisk(hVHD,
-                                 (uint8*) BlockData,
-                                 NtoHl (hVHD->Dynamic.BlockSize),
-                                 NULL,
-                                 (Offset / NtoHl (hVHD->Dynamic.BlockSize)) * NtoHl (hVHD->Dynamic.BlockSize)))
-                goto Fatal_IO_Error;
-            free(BlockData);
+static t_stat sim_simhx_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)uptr->fileref;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+SIMHX_STORE *s = hx->Store;
+t_offset pos = (t_offset)lba * ctx->sector_size;
+t_offset end = pos + (t_offset)sects * ctx->sector_size;
+t_stat r = SCPE_OK;
+
+if (sectswritten)
+    *sectswritten = 0;
+if (end > hx->DiskSize)
+    end = hx->DiskSize;
+SIMHX_LOCK (s);
+while ((pos < end) && (r == SCPE_OK)) {
+    uint32 blk = (uint32)(pos / SIMHX_BLOCK_SIZE);
+    uint32 offset = (uint32)(pos % SIMHX_BLOCK_SIZE);
+    uint32 bytes = SIMHX_BLOCK_SIZE - offset;
+    const uint8 *data = buf;
+    uint32 old = hx->Map[blk], ref;
+
+    if ((t_offset)bytes > end - pos)
+        bytes = (uint32)(end - pos);
+    if (bytes != SIMHX_BLOCK_SIZE) {            /* merge with the current contents */
+        if (old == 0)
+            memset (hx->Block, 0, SIMHX_BLOCK_SIZE);
+        else
+            r = _simhx_read_block (s, old - 1, hx->Block);
+        memcpy (hx->Block + offset, buf, bytes);
+        data = hx->Block;
+        }
+    if (r == SCPE_OK)
+        r = _simhx_store_put (s, data, &ref);
+    if (r == SCPE_OK) {
+        if (ref != old) {
+            hx->Map[blk] = ref;
+            r = _simhx_write_map (hx, blk, 1);
+            if (r == SCPE_OK)
+                r = _simhx_store_release (s, old);
             }
-        continue;
-Fatal_IO_Error:
-        free (BitMap);
-        free (BlockData);
-        r = SCPE_IOERR;
+        else
+            r = _simhx_store_release (s, ref);  /* unchanged */
         }
-    else {
-        uint64 BlockOffset = VHD_Internal_SectorSize * ((uint64)(NtoHl(hVHD->BAT[BlockNumber]) + BitMapSectors)) + (Offset % DynamicBlockSize);
-
-        if (WriteFilePosition(hVHD->File,
-                              buf,
-                              BytesInWrite,
-                              &BytesThisWrite,
-                              BlockOffset))
-            r = SCPE_IOERR;
+    if (r == SCPE_OK) {
+        buf += bytes;
+        pos += bytes;
         }
-IO_Done:
-    BytesToWrite -= BytesThisWrite;
-    buf = (uint8 *)(((char *)buf) + BytesThisWrite);
-    Offset += BytesThisWrite;
-    TotalBytesWritten += BytesThisWrite;
     }
-if (BytesWritten)
-    *BytesWritten = TotalBytesWritten;
+SIMHX_UNLOCK (s);
+if (sectswritten)
+    *sectswritten = (t_seccnt)((pos - (t_offset)lba * ctx->sector_size) / ctx->sector_size);
+if ((r == SCPE_OK) && (pos < (t_offset)(lba + sects) * ctx->sector_size))
+    r = SCPE_IOERR;                             /* beyond the end of the disk */
 return r;
 }
 
-static t_stat
-WriteVirtualDiskSectors(VHDHANDLE hVHD,
-                        uint8 *buf,
-                        t_seccnt sects,
-                        t_seccnt *sectswritten,
-                        uint32 SectorSize,
-                        t_lba lba)
+static t_stat sim_simhx_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_element_size, const char *dname)
 {
-uint32 BytesWritten;
-t_stat r = WriteVirtualDisk(hVHD,
-                            buf,
-                            sects * SectorSize,
-                            &BytesWritten,
-                            SectorSize * (uint64)lba);
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
 
-if (sectswritten)
-    *sectswritten = BytesWritten / SectorSize;
-return r;
+memset (hx->Header.DriveType, 0, sizeof (hx->Header.DriveType));
+strlcpy ((char *)hx->Header.DriveType, dtype, sizeof (hx->Header.DriveType));
+memset (hx->Header.CreatingSimulator, 0, sizeof (hx->Header.CreatingSimulator));
+strlcpy ((char *)hx->Header.CreatingSimulator, sim_name, sizeof (hx->Header.CreatingSimulator));
+memset (hx->Header.DeviceName, 0, sizeof (hx->Header.DeviceName));
+if (dname)
+    strlcpy ((char *)hx->Header.DeviceName, dname, sizeof (hx->Header.DeviceName));
+hx->Header.SectorSize = NtoHl (SectorSize);
+hx->Header.TransferElementSize = NtoHl (xfer_element_size);
+if ((_simhx_write_header (hx) != SCPE_OK) ||
+    (fflush (hx->File) != 0))
+    return SCPE_IOERR;
+return SCPE_OK;
 }
 
-static t_stat sim_vhd_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+/* Fill in the drive description fields of a pseudo simh disk footer */
+
+static void sim_simhx_disk_get_footer (FILE *f, struct simh_disk_footer *footer)
 {
-VHDHANDLE hVHD = (VHDHANDLE)uptr->fileref;
-struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
 
-return WriteVirtualDiskSectors(hVHD, buf, sects, sectswritten, ctx->sector_size, lba);
+memcpy (footer->CreatingSimulator, hx->Header.CreatingSimulator, sizeof (footer->CreatingSimulator));
+footer->CreatingSimulator[sizeof (footer->CreatingSimulator) - 1] = '\0';
+memcpy (footer->DriveType, hx->Header.DriveType, sizeof (footer->DriveType));
+footer->DriveType[sizeof (footer->DriveType) - 1] = '\0';
+memcpy (footer->DeviceName, hx->Header.DeviceName, sizeof (footer->DeviceName));
+footer->DeviceName[sizeof (footer->DeviceName) - 1] = '\0';
+memcpy (footer->CreationTime, hx->Header.CreationTime, sizeof (footer->CreationTime));
+footer->CreationTime[sizeof (footer->CreationTime) - 1] = '\0';
+footer->SectorSize = hx->Header.SectorSize;
+footer->TransferElementSize = hx->Header.TransferElementSize;
+}
+
+static void sim_simhx_disk_info (FILE *f)
+{
+SIMHXHANDLE hx = (SIMHXHANDLE)f;
+SIMHX_STORE *s = hx->Store;
+uint32 i, mapped = 0, shared = 0, stored = 0, containers = 0;
+t_uint64 units = 0;
+
+for (i = 0; i < hx->BlockCount; i++) {
+    if (hx->Map[i] == 0)
+        continue;
+    ++mapped;
+    if (s->entries[hx->Map[i] - 1].refcount > 1)
+        ++shared;
+    }
+for (i = 0; i < s->count; i++) {
+    if (s->entries[i].refcount == 0)
+        continue;
+    if (s->entries[i].flags & SIMHX_F_CONTAINER) {
+        ++containers;
+        continue;
+        }
+    ++stored;
+    units += s->entries[i].units;
+    }
+sim_printf ("   Store:               %s\n", s->path);
+sim_printf ("   Blocks:              %u of %u allocated, %u shared\n", mapped, hx->BlockCount, shared);
+sim_printf ("   Store Blocks:        %u using %s bytes\n", stored, sim_fmt_numeric ((double)(units * SIMHX_UNIT_SIZE)));
+sim_printf ("   Store Containers:    %u\n", containers);
+}
+
+/* Recount a store's references */
+
+typedef struct {
+    SIMHX_STORE *store;
+    uint32      *counts;                        /* references found to each slot */
+    uint8       *found;                         /* container records whose container exists */
+    uint32      containers;
+    t_stat      stat;
+    } SIMHX_RECLAIM_CTX;
+
+static void _simhx_reclaim_entry (const char *directory,
+                                  const char *filename,
+                                  t_offset FileSize,
+                                  const struct stat *filestat,
+                                  void *context)
+{
+SIMHX_RECLAIM_CTX *ctx = (SIMHX_RECLAIM_CTX *)context;
+SIMHX_STORE *s = ctx->store;
+struct simhx_container_record rec;
+struct simhx_header h;
+char path[PATH_MAX + 1];
+uint32 i, ref, slot, count;
+FILE *f;
+
+if (ctx->stat != SCPE_OK)
+    return;
+snprintf (path, sizeof (path), "%s%s", directory, filename);
+f = sim_fopen (path, "rb");
+if (f == NULL)
+    return;
+if (!_simhx_read_header (f, &h)) {              /* not a container */
+    fclose (f);
+    return;
+    }
+h.StoreName[sizeof (h.StoreName) - 1] = '\0';
+if (strcmp ((char *)h.StoreName, SIMHX_STORE_NAME) != 0) {
+    fclose (f);                                 /* some other store's */
+    return;
+    }
+slot = _simhx_find_record (s, h.ContainerId, &rec);
+if (slot-- == 0) {
+    sim_printf ("Ignoring '%s', which isn't registered in the store\n", path);
+    fclose (f);
+    return;
+    }
+if (ctx->found[slot]) {
+    ctx->stat = sim_messagef (SCPE_ARG, "'%s' is a copy of another container, remove one of them\n", path);
+    fclose (f);
+    return;
+    }
+ctx->found[slot] = 1;
+++ctx->containers;
+count = NtoHl (h.BlockCount);
+if (sim_fseeko (f, SIMHX_HEADER_SIZE, SEEK_SET) != 0)
+    count = 0;
+for (i = 0; i < count; i++) {
+    if (fread (&ref, sizeof (ref), 1, f) != 1)
+        break;
+    ref = NtoHl (ref);
+    if (ref == 0)
+        continue;
+    if ((ref > s->count) || (s->entries[ref - 1].refcount == 0) ||
+        (s->entries[ref - 1].flags & SIMHX_F_CONTAINER))
+        break;
+    ++ctx->counts[ref - 1];
+    }
+fclose (f);
+if (i != count) {
+    ctx->stat = sim_messagef (SCPE_IOERR, "Can't read the block map of '%s'\n", path);
+    return;
+    }
+if (strcmp ((char *)rec.Name, filename) != 0)   /* renamed */
+    ctx->stat = _simhx_write_record (s, slot, h.ContainerId, filename);
+}
+
+static t_stat sim_simhx_store_reclaim (const char *szStorePath)
+{
+char *dir = sim_filepath_parts (szStorePath, "p");
+char *name = sim_filepath_parts (szStorePath, "nx");
+char *pattern = NULL;
+SIMHX_RECLAIM_CTX ctx;
+SIMHX_STORE *s = NULL;
+uint32 slot, forgotten = 0, released = 0;
+t_uint64 units = 0;
+t_stat r;
+
+memset (&ctx, 0, sizeof (ctx));
+if ((dir != NULL) && (name != NULL) &&
+    (NULL != (pattern = (char *)malloc (strlen (dir) + 2))))
+    sprintf (pattern, "%s*", dir);
+if (pattern != NULL)
+    s = _simhx_store_open (szStorePath, name, FALSE);
+free (name);
+free (dir);
+if (s == NULL) {
+    r = sim_messagef (SCPE_OPENERR, "Can't open SIMHX store '%s'\n", szStorePath);
+    free (pattern);
+    return r;
+    }
+if (s->users > 1) {
+    _simhx_store_close (s);
+    free (pattern);
+    return sim_messagef (SCPE_ALATT, "SIMHX store '%s' is in use by attached disks\n", szStorePath);
+    }
+ctx.store = s;
+ctx.counts = (uint32 *)calloc (s->count + 1, sizeof (*ctx.counts));
+ctx.found = (uint8 *)calloc (s->count + 1, sizeof (*ctx.found));
+if ((ctx.counts == NULL) || (ctx.found == NULL))
+    ctx.stat = SCPE_MEM;
+else
+    if (sim_dir_scan (pattern, _simhx_reclaim_entry, &ctx) != SCPE_OK)
+        ctx.stat = sim_messagef (SCPE_OPENERR, "Can't scan the directory of '%s'\n", szStorePath);
+if (ctx.stat == SCPE_OK) {                      /* nothing changes unless every map was read */
+    for (slot = 0; slot < s->count; slot++) {
+        SIMHX_ENTRY *e = &s->entries[slot];
+
+        if (e->refcount == 0)
+            continue;
+        if (e->flags & SIMHX_F_CONTAINER) {
+            if (!ctx.found[slot]) {             /* container was deleted */
+                _simhx_free_slot (s, slot);
+                ++forgotten;
+                }
+            continue;
+            }
+        if (ctx.counts[slot] == 0) {
+            _simhx_hash_remove (s, slot);
+            _simhx_free_slot (s, slot);
+            ++released;
+            units += e->units;
+            }
+        else
+            e->refcount = ctx.counts[slot];
+        }
+    ctx.stat = _simhx_write_index (s);
+    }
+r = ctx.stat;
+free (ctx.counts);
+free (ctx.found);
+free (pattern);
+_simhx_store_close (s);
+if (r != SCPE_OK)
+    return r;
+return sim_messagef (SCPE_OK, "%u containers, %u deleted containers forgotten, %u blocks (%s bytes) released\n",
+                     ctx.containers, forgotten, released, sim_fmt_numeric ((double)(units * SIMHX_UNIT_SIZE)));
 }
 #endif
 
@@ -6584,6 +9025,12 @@ if (info->flag) {        /* zap type */
         info->stat = sim_messagef (SCPE_OPENERR, "Cannot change the disk type of a VHD container file: %s\n", FullPath);
         return;
         }
+    container = sim_simhx_disk_open (FullPath, "rb");
+    if (container != NULL) {
+        sim_simhx_disk_close (container);
+        info->stat = sim_messagef (SCPE_OPENERR, "Cannot change the disk type of a SIMHX container file: %s\n", FullPath);
+        return;
+        }
     if (sim_stat (FullPath, &statb)) {
         info->stat = sim_messagef (SCPE_OPENERR, "Cannot stat file: '%s' - %s\n", FullPath, strerror (errno));
         return;
@@ -6658,15 +9105,21 @@ if (info->flag == 0) {
     sim_disk_set_fmt (uptr, 0, "VHD", NULL);
     container = sim_vhd_disk_open (FullPath, "r");
     if (container == NULL) {
-        sim_disk_set_fmt (uptr, 0, "SIMH", NULL);
-        container = sim_fopen (FullPath, "rb+");
-        close_function = fclose;
-        size_function = sim_fsize_ex;
+        sim_disk_set_fmt (uptr, 0, "SIMHX", NULL);
+        container = sim_simhx_disk_open (FullPath, "rb");
+        close_function = sim_simhx_disk_close;
+        size_function = sim_simhx_disk_size;
         }
     else {
         close_function = sim_vhd_disk_close;
         size_function = sim_vhd_disk_size;
         }
+    if (container == NULL) {
+        sim_disk_set_fmt (uptr, 0, "SIMH", NULL);
+        container = sim_fopen (FullPath, "rb+");
+        close_function = fclose;
+        size_function = sim_fsize_ex;
+        }
     if (container) {
         container_size = size_function (container);
         uptr->filename = strdup (FullPath);
@@ -6699,6 +9152,8 @@ if (info->flag == 0) {
             sim_printf ("Container Size: %s bytes\n", sim_fmt_numeric ((double)container_size));
             info->stat = SCPE_ARG|SCPE_NOMESSAGE;
             }
+        if (DK_GET_FMT (uptr) == DKUF_F_SIMHX)
+            sim_simhx_disk_info (container);
         free (f);
         free (uptr->filename);
         close_function (container);
@@ -6727,6 +9182,58 @@ if (stat == SCPE_OK)
 return sim_messagef (SCPE_OK, "No such file or directory: %s\n", cptr);
 }
 
+/* Snapshot the current contents of an attached SIMHX disk */
+
+t_stat sim_disk_snapshot_cmd (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+struct stat statb;
+DEVICE *dptr;
+UNIT *uptr;
+FILE *snap;
+
+if ((!cptr) || (*cptr == 0))
+    return SCPE_2FARG;
+GET_SWITCHES (cptr);                                    /* get switches */
+cptr = get_glyph (cptr, gbuf, 0);                       /* get unit name */
+if (*cptr == 0)                                         /* must be more */
+    return SCPE_2FARG;
+dptr = find_unit (gbuf, &uptr);                         /* locate unit */
+if ((dptr == NULL) || (uptr == NULL))
+    return sim_messagef (SCPE_NXUN, "Non-existent unit: %s\n", gbuf);
+if (((dptr->flags & DEV_DISK) == 0) || (uptr->disk_ctx == NULL) || !(uptr->flags & UNIT_ATT))
+    return sim_messagef (SCPE_UNATT, "%s: Not an attached disk\n", sim_uname (uptr));
+if (DK_GET_FMT (uptr) != DKUF_F_SIMHX)
+    return sim_messagef (SCPE_NOFNC, "%s: Only SIMHX format disks can be snapshot\n", sim_uname (uptr));
+cptr = get_glyph_nc (cptr, gbuf, 0);                    /* get snapshot file name */
+if (*cptr != 0)
+    return SCPE_2MARG;
+if (sim_stat (gbuf, &statb) == 0)
+    return sim_messagef (SCPE_ARG, "Snapshot file already exists: %s\n", gbuf);
+uptr->io_flush (uptr);                                  /* write any cached data */
+snap = sim_simhx_disk_snapshot (uptr->fileref, gbuf);
+if (snap == NULL)
+    return sim_messagef (SCPE_OPENERR, "%s: Cannot create snapshot '%s'\n", sim_uname (uptr), gbuf);
+if (sim_simhx_disk_close (snap) == EOF)
+    return sim_messagef (SCPE_IOERR, "%s: Error writing snapshot '%s'\n", sim_uname (uptr), gbuf);
+return sim_messagef (SCPE_OK, "%s: Snapshot written to '%s'\n", sim_uname (uptr), gbuf);
+}
+
+/* Release the SIMHX store blocks which no container refers to */
+
+t_stat sim_disk_reclaim_cmd (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+
+if ((!cptr) || (*cptr == 0))
+    return SCPE_2FARG;
+GET_SWITCHES (cptr);                                    /* get switches */
+cptr = get_glyph_nc (cptr, gbuf, 0);                    /* get store file name */
+if (*cptr != 0)
+    return SCPE_2MARG;
+return sim_simhx_store_reclaim (gbuf);
+}
+
 /* disk testing */
 
 #include <setjmp.h>
@@ -6740,6 +9247,66 @@ struct disk_test_coverage {
     uint32 *data;
     };
 
+#if defined (SIM_ASYNCH_IO)
+static uint32 disk_test_async_done;
+static t_stat disk_test_async_status;
+
+static void _disk_test_async_callback (UNIT *uptr, t_stat status)
+{
+if (status != SCPE_OK)
+    disk_test_async_status = status;
+++disk_test_async_done;
+}
+#endif
+
+/* Queue several reads at once and verify that every one completes with
+   the expected data (the sector number in each sector) */
+
+static t_stat sim_disk_test_async (UNIT *uptr, uint32 *data, t_lba total_sectors, t_seccnt max_xfer_sectors)
+{
+#if defined (SIM_ASYNCH_IO)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint32 uint32s_per_sector = (ctx->sector_size / sizeof (*data));
+t_seccnt sectors_read[8];
+t_seccnt sects = max_xfer_sectors / 8;
+t_lba lba;
+uint32 i, req, nreq = 8;
+
+if (!ctx->asynch_io)
+    return SCPE_OK;
+if (sects > total_sectors / nreq)
+    sects = total_sectors / nreq;
+if (sects == 0)
+    return SCPE_OK;
+disk_test_async_done = 0;
+disk_test_async_status = SCPE_OK;
+memset (data, 0, nreq * sects * ctx->sector_size);
+for (req = 0; req < nreq; req++)
+    sim_disk_rdsect_a (uptr, req * sects, (uint8 *)(data + req * sects * uint32s_per_sector), &sectors_read[req], sects, _disk_test_async_callback);
+_disk_cancel (uptr);                            /* wait for all of them */
+_disk_completion_dispatch (uptr);
+AIO_UPDATE_QUEUE;
+sim_cancel (uptr);
+if ((disk_test_async_done != nreq) || (disk_test_async_status != SCPE_OK) || (sim_disk_pending (uptr) != 0)) {
+    sim_printf ("Asynchronous reads: %u of %u completed - %s\n", disk_test_async_done, nreq, sim_error_text (disk_test_async_status));
+    return SCPE_IERR;
+    }
+for (lba = 0; lba < nreq * sects; lba++) {
+    if (sectors_read[lba / sects] != sects) {
+        sim_printf ("Asynchronous read at lba %u returned %u sectors instead of %u\n", (lba / sects) * sects, sectors_read[lba / sects], sects);
+        return SCPE_IERR;
+        }
+    for (i = 0; i < uint32s_per_sector; i++)
+        if (data[i + lba * uint32s_per_sector] != lba) {
+            sim_printf ("Asynchronous read of sector %u has unexpected data at offset 0x%X: 0x%08X\n", lba, i, data[i + lba * uint32s_per_sector]);
+            return SCPE_IERR;
+            }
+    }
+sim_printf("Queued Asynchronous Reading OK\n");
+#endif
+return SCPE_OK;
+}
+
 static t_stat sim_disk_test_exercise (UNIT *uptr)
 {
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
@@ -6838,6 +9405,8 @@ if (!(uptr->flags & UNIT_RO)) { /* Only test drives open Read/Write - Read Only
             r = SCPE_IERR;
             }
         }
+    if (r == SCPE_OK)
+        r = sim_disk_test_async (uptr, c->data, c->total_sectors, c->max_xfer_sectors);
     if (r == SCPE_OK) { /* If still good, then do EOF and beyond boundary test */
         t_offset current_unit_size = ((t_offset)uptr->capac)*ctx->capac_factor*((dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
         t_seccnt sectors_read, sectors_to_read;
@@ -6979,8 +9548,8 @@ if ((0 == strcmp ("RL", dptr->name)) ||
         if ((SCPE_BARE_STATUS (r) == SCPE_OK) && (((uptr->flags & UNIT_RO) != 0) != tests[i].unit_ro_attach))
             r = SCPE_OK; /* Error */
         sim_disk_detach (uptr);
-        if ((SCPE_OK == sim_disk_info_cmd (0, filename)) != tests[i].has_footer) {
-            if (tests[i].has_footer)
+        if ((SCPE_OK == sim_disk_info_cmd (0, filename)) != (tests[i].has_footer && disk_footers_written)) {
+            if (tests[i].has_footer && disk_footers_written)
                 sim_printf ("%d: Expected metadata missing\n", tests[i].testid);
             else
                 sim_printf ("%d: Unexpected metadata found\n", tests[i].testid);
@@ -7083,9 +9652,155 @@ sim_free_filelist (&tarfiles);
 return SCPE_OK;
 }
 
+/* SIMHX block sharing and snapshot testing */
+
+#define SIMHX_TEST_STORE "simhx.store"
+
+static void _sim_disk_test_remove_simhx_store (void)
+{
+(void)remove (SIMHX_TEST_STORE);
+(void)remove (SIMHX_TEST_STORE ".index");
+}
+
+#if defined (DONT_DO_SIMHX_SUPPORT)
+static t_stat sim_disk_simhx_test (DEVICE *dptr)
+{
+return SCPE_OK;
+}
+#else
+static t_stat sim_disk_simhx_test (DEVICE *dptr)
+{
+UNIT *uptr = &dptr->units[0];
+const char *container = "Test-Dedup.SIMHX";
+const char *snapshot = "Test-Dedup-Snap.SIMHX";
+const char *copy = "Test-Dedup-Copy.SIMHX";
+struct stat statb;
+t_bool fresh_store = (sim_stat (SIMHX_TEST_STORE, &statb) != 0);
+uint8 *pattern = (uint8 *)malloc (2 * SIMHX_BLOCK_SIZE);
+uint8 *data = pattern + SIMHX_BLOCK_SIZE;
+t_seccnt sects = SIMHX_BLOCK_SIZE / 512;
+SIMHXHANDLE hx;
+FILE *snap;
+uint32 i, shared;
+t_stat r;
+
+if (pattern == NULL)
+    return SCPE_MEM;
+sim_printf ("\n*** SIMHX block sharing and snapshot tests\n");
+for (i = 0; i < SIMHX_BLOCK_SIZE; i++)
+    pattern[i] = (uint8)((i * 7) ^ (i >> 9));
+(void)remove (container);
+(void)remove (snapshot);
+sim_switches = 0;
+sim_disk_set_fmt (uptr, 0, "SIMHX", NULL);
+r = sim_disk_attach_ex (uptr, container, 512, 1, TRUE, 0, NULL, 0, 0, NULL);
+if (r != SCPE_OK) {
+    free (pattern);
+    return r;
+    }
+hx = (SIMHXHANDLE)uptr->fileref;
+/* The same data written to two blocks is stored once */
+r = sim_disk_wrsect (uptr, 0, pattern, NULL, sects);
+if (r == SCPE_OK)
+    r = sim_disk_wrsect (uptr, 8 * sects, pattern, NULL, sects);
+if ((r == SCPE_OK) &&
+    ((hx->Map[0] == 0) || (hx->Map[0] != hx->Map[8]) ||
+     (hx->Store->entries[hx->Map[0] - 1].refcount != 2))) {
+    sim_printf ("Identical blocks were not shared\n");
+    r = SCPE_IERR;
+    }
+/* A snapshot shares every block of the disk */
+if (r == SCPE_OK) {
+    shared = hx->Map[0];
+    snap = sim_simhx_disk_snapshot (uptr->fileref, snapshot);
+    if ((snap == NULL) || (sim_simhx_disk_close (snap) != 0))
+        r = SCPE_OPENERR;
+    else
+        if (hx->Store->entries[shared - 1].refcount != 4) {
+            sim_printf ("Snapshot did not share the disk's blocks\n");
+            r = SCPE_IERR;
+            }
+    }
+/* A partial write to the disk leaves the snapshot unchanged */
+if (r == SCPE_OK) {
+    memset (data, 0xA5, 512);
+    r = sim_disk_wrsect (uptr, 1, data, NULL, 1);
+    if ((r == SCPE_OK) &&
+        ((hx->Map[0] == shared) || (hx->Store->entries[shared - 1].refcount != 3))) {
+        sim_printf ("Rewriting a shared block did not leave a private copy\n");
+        r = SCPE_IERR;
+        }
+    }
+if (r == SCPE_OK) {
+    r = sim_disk_rdsect (uptr, 0, data, NULL, sects);
+    if ((r == SCPE_OK) &&
+        ((memcmp (data, pattern, 512) != 0) || (data[512] != 0xA5) ||
+         (memcmp (data + 1024, pattern + 1024, SIMHX_BLOCK_SIZE - 1024) != 0))) {
+        sim_printf ("Partially rewritten block has unexpected data\n");
+        r = SCPE_IERR;
+        }
+    }
+sim_disk_detach (uptr);
+if (r == SCPE_OK) {
+    sim_switches = SWMASK ('R');
+    r = sim_disk_attach_ex (uptr, snapshot, 512, 1, TRUE, 0, NULL, 0, 0, NULL);
+    sim_switches = 0;
+    if (r == SCPE_OK) {
+        r = sim_disk_rdsect (uptr, 0, data, NULL, sects);
+        if ((r == SCPE_OK) && (memcmp (data, pattern, SIMHX_BLOCK_SIZE) != 0)) {
+            sim_printf ("Snapshot has unexpected data\n");
+            r = SCPE_IERR;
+            }
+        sim_disk_detach (uptr);
+        }
+    }
+/* A copy made with host tools can't be attached while the original exists */
+if (r == SCPE_OK) {
+    r = sim_copyfile (container, copy, TRUE);
+    if ((r == SCPE_OK) &&
+        (SCPE_OK == sim_disk_attach_ex (uptr, copy, 512, 1, TRUE, 0, NULL, 0, 0, NULL))) {
+        sim_printf ("A copy of a SIMHX container was attached\n");
+        sim_disk_detach (uptr);
+        r = SCPE_IERR;
+        }
+    (void)remove (copy);
+    }
+/* but once it has been renamed it can */
+if ((r == SCPE_OK) && (rename (container, copy) == 0)) {
+    r = sim_disk_attach_ex (uptr, copy, 512, 1, TRUE, 0, NULL, 0, 0, NULL);
+    if (r != SCPE_OK)
+        sim_printf ("A renamed SIMHX container could not be attached\n");
+    else
+        sim_disk_detach (uptr);
+    (void)rename (copy, container);
+    }
+/* Deleting the snapshot and reclaiming leaves only the disk's references */
+if ((r == SCPE_OK) && fresh_store) {
+    (void)remove (snapshot);
+    r = sim_simhx_store_reclaim (SIMHX_TEST_STORE);
+    if (r == SCPE_OK)
+        r = sim_disk_attach_ex (uptr, container, 512, 1, TRUE, 0, NULL, 0, 0, NULL);
+    if (r == SCPE_OK) {
+        hx = (SIMHXHANDLE)uptr->fileref;
+        if ((hx->Map[8] != shared) || (hx->Store->entries[shared - 1].refcount != 1)) {
+            sim_printf ("Reclaim did not drop the deleted snapshot's references\n");
+            r = SCPE_IERR;
+            }
+        sim_disk_detach (uptr);
+        }
+    }
+if (r == SCPE_OK)
+    sim_printf ("Block sharing, snapshot, copy and reclaim OK\n");
+(void)remove (container);
+(void)remove (snapshot);
+free (pattern);
+return r;
+}
+#endif
+
 t_stat sim_disk_test (DEVICE *dptr, const char *cptr)
 {
-const char *fmt[] = {"RAW", "VHD", "VHD", "SIMH", NULL};
+const char *fmt[] = {"RAW", "VHD", "VHD", "SIMH", "SIMH", "SIMH", "SIMHX", NULL};
 uint32 sect_size[] = {576, 4096, 1024, 512, 256, 128, 64, 0};
 uint32 xfr_size[] = {1, 2, 4, 8, 0};
 int x, s, f;
@@ -7093,6 +9808,8 @@ UNIT *uptr = &dptr->units[0];
 char filename[256];
 t_stat r;
 int32 saved_switches = sim_switches & ~SWMASK('T');
+struct stat statb;
+t_bool simhx_store_existed = (sim_stat (SIMHX_TEST_STORE, &statb) == 0);
 SIM_TEST_INIT;
 
 if (sim_switches & SWMASK ('M')) { /* Do meta first? */
@@ -7104,17 +9821,31 @@ else {
     SIM_TEST (sim_disk_sizing_test (dptr, cptr));
     SIM_TEST (sim_disk_meta_attach_test (dptr, cptr));
     }
+SIM_TEST (sim_disk_simhx_test (dptr));
+if (!simhx_store_existed)
+    _sim_disk_test_remove_simhx_store ();
 sim_printf ("\n*** Disk Format combination behavior tests\n");
 for (x = 0; xfr_size[x] != 0; x++) {
     for (f = 0; fmt[f] != 0; f++) {
         for (s = 0; sect_size[s] != 0; s++) {
             snprintf (filename, sizeof (filename), "Test-%u-%u.%s", sect_size[s], xfr_size[x], fmt[f]);
+            uptr->disk_cache = 0;
+            uptr->dynflags &= ~UNIT_DISK_MMAP;
             if ((f > 0) && (strcmp (fmt[f], "VHD") == 0) && (strcmp (fmt[f - 1], "VHD") == 0)) { /* Second VHD is Fixed */
                 sim_switches |= SWMASK('X');
                 snprintf (filename, sizeof (filename), "Test-%u-%u-Fixed.%s", sect_size[s], xfr_size[x], fmt[f]);
                 }
             else
                 sim_switches = saved_switches;
+            if ((f > 1) && (strcmp (fmt[f], "SIMH") == 0) && (strcmp (fmt[f - 2], "SIMH") == 0)) { /* Third SIMH is Memory Mapped */
+                uptr->dynflags |= UNIT_DISK_MMAP;
+                snprintf (filename, sizeof (filename), "Test-%u-%u-Mapped.%s", sect_size[s], xfr_size[x], fmt[f]);
+                }
+            else
+                if ((f > 0) && (strcmp (fmt[f], "SIMH") == 0) && (strcmp (fmt[f - 1], "SIMH") == 0)) { /* Second SIMH is Cached */
+                    uptr->disk_cache = 1;
+                    snprintf (filename, sizeof (filename), "Test-%u-%u-Cached.%s", sect_size[s], xfr_size[x], fmt[f]);
+                    }
             (void)remove (filename);        /* Remove any prior remnants */
             r = sim_disk_set_fmt (uptr, 0, fmt[f], NULL);
             if (r != SCPE_OK)
@@ -7133,8 +9864,12 @@ for (x = 0; xfr_size[x] != 0; x++) {
                 break;
             if (r == SCPE_OK)
                 SIM_TEST (sim_disk_test_exercise (uptr));
+            if ((strcmp (fmt[f], "SIMHX") == 0) && !simhx_store_existed)
+                _sim_disk_test_remove_simhx_store ();
             }
         }
     }
+uptr->disk_cache = 0;
+uptr->dynflags &= ~UNIT_DISK_MMAP;
 return SCPE_OK;
 }
@@ -48,6 +48,7 @@ typedef uint32          t_lba;                          /* disk logical block ad
 #define DKUF_F_STD       1                              /* SIMH format */
 #define DKUF_F_RAW       2                              /* Raw Physical Disk Access */
 #define DKUF_F_VHD       3                              /* VHD format */
+#define DKUF_F_SIMHX     4                              /* SIMHX container (UNIT_DISK_SIMHX) */
 #define DKUF_V_NOAUTOSIZE (DKUF_V_FMT + DKUF_W_FMT)     /* Don't Autosize disk option */
 #define DKUF_V_UF       (DKUF_V_NOAUTOSIZE + 1)
 #define DKUF_WLK        UNIT_WLK
@@ -59,7 +60,8 @@ typedef uint32          t_lba;                          /* disk logical block ad
 #define DK_F_RAW        (DKUF_F_RAW << DKUF_V_FMT)
 #define DK_F_VHD        (DKUF_F_VHD << DKUF_V_FMT)
 
-#define DK_GET_FMT(u)   (((u)->flags >> DKUF_V_FMT) & DKUF_M_FMT)
+#define DK_GET_FMT(u)   (((u)->dynflags & UNIT_DISK_SIMHX) ? DKUF_F_SIMHX : \
+                         (((u)->flags >> DKUF_V_FMT) & DKUF_M_FMT))
 
 /* Return status codes */
 
@@ -114,8 +116,13 @@ t_stat sim_disk_set_fmt (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat sim_disk_show_fmt (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat sim_disk_set_capac (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat sim_disk_show_capac (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat sim_disk_set_cache (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat sim_disk_show_cache (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat sim_disk_set_access (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat sim_disk_show_access (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat sim_disk_set_asynch (UNIT *uptr, int latency);
 t_stat sim_disk_clr_asynch (UNIT *uptr);
+uint32 sim_disk_pending (UNIT *uptr);
 t_stat sim_disk_reset (UNIT *uptr);
 t_stat sim_disk_perror (UNIT *uptr, const char *msg);
 t_stat sim_disk_clearerr (UNIT *uptr);
@@ -128,6 +135,8 @@ t_bool sim_disk_vhd_support (void);
 t_bool sim_disk_raw_support (void);
 void sim_disk_data_trace (UNIT *uptr, const uint8 *data, size_t lba, size_t len, const char* txt, int detail, uint32 reason);
 t_stat sim_disk_info_cmd (int32 flag, CONST char *ptr);
+t_stat sim_disk_snapshot_cmd (int32 flag, CONST char *ptr);
+t_stat sim_disk_reclaim_cmd (int32 flag, CONST char *ptr);
 t_stat sim_disk_set_noautosize (int32 flag, CONST char *cptr);
 t_stat sim_disk_test (DEVICE *dptr, const char *cptr);
 
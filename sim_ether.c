@@ -377,6 +377,7 @@
 #include <direct.h>
 #else
 #include <unistd.h>
+#include <signal.h>
 #endif
 
 #define MAX(a,b) (((a) > (b)) ? (a) : (b))
@@ -966,6 +967,10 @@ t_stat eth_write (ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine)
   {return SCPE_NOFNC;}
 int eth_read (ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine)
   {return SCPE_NOFNC;}
+ETH_PACK *eth_read_peek (ETH_DEV* dev)
+  {return NULL;}
+void eth_read_consume (ETH_DEV* dev)
+  {}
 t_stat eth_filter (ETH_DEV* dev, int addr_count, const ETH_MAC addresses[],
                    ETH_BOOL all_multicast, ETH_BOOL promiscuous)
   {return SCPE_NOFNC;}
@@ -1014,7 +1019,7 @@ const char *eth_capabilities(void)
 #if defined (HAVE_SLIRP_NETWORK)
      ":NAT"
 #endif
-     ":UDP";
+     ":UDP:SHM";
  }
 
 #if (defined (xBSD) || defined (__APPLE__)) && (defined (HAVE_TAP_NETWORK) || defined (HAVE_PCAP_NETWORK))
@@ -1212,6 +1217,13 @@ if (used < max) {
   ++used;
   }
 
+if (used < max) {
+  sprintf(list[used].name, "%s", "shm:switch-name");
+  sprintf(list[used].desc, "%s", "Integrated shared memory switch support");
+  list[used].eth_api = ETH_API_SHM;
+  ++used;
+  }
+
 /* return device count */
 return used;
 }
@@ -1931,6 +1943,9 @@ _eth_write(ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine);
 static void
 _eth_error(ETH_DEV* dev, const char* where);
 
+static void
+_eth_filter_push(ETH_DEV* dev);
+
 #if defined(HAVE_SLIRP_NETWORK)
 static void _slirp_callback (void *opaque, const unsigned char *buf, int len)
 {
@@ -1942,6 +1957,540 @@ _eth_callback((u_char *)opaque, &header, buf);
 }
 #endif
 
+/* Shared memory switch support
+
+   A shm:name device is a port on a virtual Ethernet switch which lives
+   in a shared memory region named after the switch.  Any number of
+   simulators on the same host (and any number of devices in a single
+   simulator) which open the same switch name are connected to each
+   other without involving the host's network stack.
+
+   Each port owns a ring of frame slots.  Any other port may append to
+   it (multiple producers) while only the owning port removes frames
+   from it (single consumer), so the rings are managed entirely with the
+   sim_shmem atomic primitives:
+     - a producer reserves a slot by advancing tail with compare and
+       swap, copies the frame into it and then publishes it by stamping
+       the slot with its sequence number (the tail value it reserved,
+       plus one),
+     - the consumer takes the frame at head once the slot carries the
+       stamp head + 1, and then advances head.
+   A full ring drops the frame, as a busy switch port would.
+
+   Each port has a doorbell, a UDP socket bound to an ephemeral port on
+   the loopback interface, whose port number is kept in the switch.  The
+   owner's reader thread sleeps in select() on it.  Before sleeping, the
+   reader sets the port's waiting flag and checks the ring once more.
+   A producer checks the flag after publishing and, if it is set, sends
+   a one byte datagram to the doorbell.  Both sides use full barriers, so
+   either the reader sees the frame or the producer sees the flag.  The
+   select() timeout remains as a backstop.
+
+   A simulator which dies without closing its ports leaves them marked
+   in use.  Each port records its owner's process id.  Whenever a device
+   opens a switch, ports whose owner no longer exists are released.  The
+   addresses learned on them are forgotten and their users are dropped,
+   so the switch region is still removed by the last real user.  (An
+   owner's process id reused by an unrelated process keeps its port held
+   until that process exits.)
+
+   A producer which dies between reserving a slot and publishing it
+   leaves a slot which will never be stamped.  Frames behind it would be
+   stuck.  When the slot at head stays unpublished for ETH_SHM_STALL_MSEC
+   while later slots are reserved, the consumer gives up on it by
+   changing its stamp to ETH_SHM_NOFRAME(sequence), and counts a drop.
+   A producer publishes with a compare and swap against the stamp it
+   saw when it reserved the slot, so a producer which was merely slow
+   fails to publish and its frame is dropped rather than read.
+   The frame data is guarded by the slot's busy word, which a producer
+   holds (as its port number + 1) while copying into the slot:
+     - a producer which takes the busy word after its reservation was
+       given up leaves the slot alone,
+     - a producer which finds the slot busy, because a late producer is
+       still copying into it, publishes ETH_SHM_NOFRAME for its sequence
+       instead of a frame and counts a drop.
+   So a published frame's copy is complete and nothing else is copying
+   into the slot while the consumer reads it.  The busy words held by a
+   producer which died are released along with its port.
+
+   The switch learns the source address of every frame it is given.
+   Frames for a learned unicast address go only to that port.  Frames
+   for multicast or not yet learned addresses go to every other port.
+   Learned addresses are kept in a small direct mapped table whose
+   entries are updated under a sequence count so that readers never
+   see a partially written entry.
+
+   A freshly created region is all zeros, which is a valid empty switch,
+   so there is no initialization race between simulators attaching at
+   the same moment.  The last device to close a switch changes users to
+   ETH_SHM_GONE, with a compare and swap, before it removes the region.
+   A device joins a switch by incrementing users the same way, and never
+   joins one which is gone.  It opens the name again instead, which gets
+   a new region once the old one has been removed, so simulators can't
+   end up split between the old region and a new one.
+ */
+
+#define ETH_SHM_MAGIC   0x53494D48                      /* "SIMH" */
+#define ETH_SHM_PORTS   16                              /* ports per switch */
+#define ETH_SHM_SLOTS   128                             /* frames per port ring (power of 2) */
+#define ETH_SHM_MACS    256                             /* learned address table size (power of 2) */
+#define ETH_SHM_STALL_MSEC 500                          /* unpublished slot given up after */
+#define ETH_SHM_NOFRAME(seq) (((seq) + 1) ^ 0x40000000) /* stamp of a reservation without a frame */
+#define ETH_SHM_GONE    -1                              /* users of a switch being removed */
+
+typedef struct {
+  int32     ready;                                      /* sequence + 1 of the published frame */
+  int32     busy;                                       /* port + 1 of the producer copying into it */
+  int32     len;
+  uint8     msg[ETH_MAX_PACKET];
+  } ETH_SHM_SLOT;
+
+typedef struct {
+  int32     in_use;                                     /* port owned by an open device */
+  int32     owner;                                      /* owner's process id, 0 while changing */
+  int32     bell;                                       /* owner's doorbell UDP port, 0 if none */
+  int32     waiting;                                    /* owner is waiting for its doorbell */
+  int32     head;                                       /* next slot the owner will read */
+  int32     tail;                                       /* next slot a producer will fill */
+  int32     drops;                                      /* frames lost to a full ring */
+  ETH_SHM_SLOT slot[ETH_SHM_SLOTS];
+  } ETH_SHM_PORT;
+
+typedef struct {
+  int32     seq;                                        /* odd while entry is being changed */
+  int32     port;                                       /* port number + 1, 0 if unused */
+  ETH_MAC   mac;
+  } ETH_SHM_MAC;
+
+typedef struct {
+  int32     magic;
+  int32     users;                                      /* count of attached devices */
+  ETH_SHM_MAC mac[ETH_SHM_MACS];
+  ETH_SHM_PORT port[ETH_SHM_PORTS];
+  } ETH_SHM_SWITCH;
+
+typedef struct {
+  SHMEM           *shmem;
+  ETH_SHM_SWITCH  *sw;
+  int             port;
+  SOCKET          bell;                                 /* this port's doorbell */
+  t_bool          stalled;                              /* slot at stall_head unpublished */
+  int32           stall_head;
+  uint32          stall_start;                          /* when it was first seen */
+  } ETH_SHM;
+
+static int _eth_shm_mac_hash (const uint8 *mac)
+{
+return (mac[3] ^ mac[4] ^ (mac[5] << 1) ^ mac[5] >> 7) & (ETH_SHM_MACS - 1);
+}
+
+/* Return the port a unicast address was learned on, or -1 */
+
+static int _eth_shm_lookup (ETH_SHM_SWITCH *sw, const uint8 *mac)
+{
+ETH_SHM_MAC *ent = &sw->mac[_eth_shm_mac_hash (mac)];
+ETH_MAC entmac;
+int32 seq, port;
+
+do {
+  seq = sim_shmem_atomic_add (&ent->seq, 0);
+  if (seq & 1)                                  /* being changed? */
+    return -1;                                  /* then treat as unknown */
+  port = ent->port;
+  memcpy (entmac, ent->mac, sizeof (entmac));
+  } while (seq != sim_shmem_atomic_add (&ent->seq, 0));
+if ((port == 0) || (memcmp (entmac, mac, sizeof (entmac)) != 0))
+  return -1;
+return port - 1;
+}
+
+static void _eth_shm_learn (ETH_SHM_SWITCH *sw, const uint8 *mac, int port)
+{
+ETH_SHM_MAC *ent = &sw->mac[_eth_shm_mac_hash (mac)];
+int32 seq;
+
+if ((mac[0] & 0x01) ||                          /* never learn group addresses */
+    (_eth_shm_lookup (sw, mac) == port))        /* already known here? */
+  return;
+seq = sim_shmem_atomic_add (&ent->seq, 0);
+if ((seq & 1) ||                                /* someone else updating? */
+    !sim_shmem_atomic_cas (&ent->seq, seq, seq + 1))
+  return;                                       /* let them, learn it next time */
+memcpy (ent->mac, mac, sizeof (ent->mac));
+ent->port = port + 1;
+sim_shmem_atomic_add (&ent->seq, 1);
+}
+
+/* Doorbells */
+
+static SOCKET _eth_shm_bell_open (int32 *bellport)
+{
+SOCKET bell = socket (AF_INET, SOCK_DGRAM, 0);
+struct sockaddr_in sin;
+#if defined (_WIN32)
+int len = sizeof (sin);
+u_long non_block = 1;
+#else
+socklen_t len = sizeof (sin);
+#endif
+
+*bellport = 0;
+if (bell == INVALID_SOCKET)
+  return bell;
+memset (&sin, 0, sizeof (sin));
+sin.sin_family = AF_INET;
+sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+sin.sin_port = 0;                               /* any free port */
+if ((bind (bell, (struct sockaddr *)&sin, sizeof (sin)) != 0) ||
+    (getsockname (bell, (struct sockaddr *)&sin, &len) != 0)) {
+  closesocket (bell);
+  return INVALID_SOCKET;
+  }
+#if defined (_WIN32)
+ioctlsocket (bell, FIONBIO, &non_block);
+#else
+fcntl (bell, F_SETFL, fcntl (bell, F_GETFL, 0) | O_NONBLOCK);
+#endif
+*bellport = ntohs (sin.sin_port);
+return bell;
+}
+
+static void _eth_shm_ring (ETH_SHM *shm, ETH_SHM_PORT *p)
+{
+int32 bellport = sim_shmem_atomic_add (&p->bell, 0);
+struct sockaddr_in sin;
+
+if ((bellport == 0) || (shm->bell == INVALID_SOCKET))
+  return;                                       /* reader will poll */
+memset (&sin, 0, sizeof (sin));
+sin.sin_family = AF_INET;
+sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+sin.sin_port = htons ((u_short)bellport);
+(void)sendto (shm->bell, "", 1, 0, (struct sockaddr *)&sin, sizeof (sin));
+}
+
+/* TRUE if the slot at head has been published (with or without a frame) */
+
+static t_bool _eth_shm_ready (ETH_SHM *shm)
+{
+ETH_SHM_PORT *p = &shm->sw->port[shm->port];
+int32 head = sim_shmem_atomic_add (&p->head, 0);
+int32 ready = sim_shmem_atomic_add (&p->slot[head & (ETH_SHM_SLOTS - 1)].ready, 0);
+
+return ((ready == head + 1) || (ready == ETH_SHM_NOFRAME (head)));
+}
+
+/* Get ready to wait for the doorbell.  Returns TRUE (and doesn't arm the
+   doorbell) if a frame is already waiting. */
+
+static t_bool _eth_shm_arm (ETH_SHM *shm)
+{
+ETH_SHM_PORT *p = &shm->sw->port[shm->port];
+
+sim_shmem_atomic_cas (&p->waiting, 0, 1);       /* full barrier */
+if (!_eth_shm_ready (shm))
+  return FALSE;
+sim_shmem_atomic_cas (&p->waiting, 1, 0);
+return TRUE;
+}
+
+static void _eth_shm_disarm (ETH_SHM *shm)
+{
+ETH_SHM_PORT *p = &shm->sw->port[shm->port];
+char buf[16];
+
+sim_shmem_atomic_cas (&p->waiting, 1, 0);
+while (recv (shm->bell, buf, sizeof (buf), 0) > 0)
+  ;                                             /* drain pending rings */
+}
+
+static void _eth_shm_deliver (ETH_SHM *shm, int port, const uint8 *msg, int len)
+{
+ETH_SHM_PORT *p = &shm->sw->port[port];
+ETH_SHM_SLOT *s;
+int32 head, tail, stamp;
+
+do {
+  tail = sim_shmem_atomic_add (&p->tail, 0);
+  head = sim_shmem_atomic_add (&p->head, 0);
+  if ((uint32)(tail - head) >= ETH_SHM_SLOTS) { /* ring full? */
+    sim_shmem_atomic_add (&p->drops, 1);
+    return;
+    }
+  } while (!sim_shmem_atomic_cas (&p->tail, tail, tail + 1));
+s = &p->slot[tail & (ETH_SHM_SLOTS - 1)];
+stamp = sim_shmem_atomic_add (&s->ready, 0);    /* changes only if we're given up on */
+if (!sim_shmem_atomic_cas (&s->busy, 0, shm->port + 1)) {   /* late producer copying? */
+  if (!sim_shmem_atomic_cas (&s->ready, stamp, ETH_SHM_NOFRAME (tail)))
+    return;                                     /* already given up on */
+  sim_shmem_atomic_add (&p->drops, 1);
+  }
+else {
+  if (sim_shmem_atomic_add (&s->ready, 0) != stamp) {      /* given up on? */
+    sim_shmem_atomic_cas (&s->busy, shm->port + 1, 0);
+    return;                                     /* then the slot isn't ours */
+    }
+  memcpy (s->msg, msg, len);
+  s->len = len;
+  sim_shmem_atomic_cas (&s->busy, shm->port + 1, 0);
+  if (!sim_shmem_atomic_cas (&s->ready, stamp, tail + 1))  /* publish (full barrier) */
+    return;                                     /* given up on while copying */
+  }
+if (sim_shmem_atomic_add (&p->waiting, 0))      /* owner asleep? */
+  _eth_shm_ring (shm, p);
+}
+
+static int _eth_shm_send (ETH_SHM *shm, const uint8 *msg, int len)
+{
+ETH_SHM_SWITCH *sw = shm->sw;
+int port;
+
+if ((len < 14) || (len > ETH_MAX_PACKET))
+  return -1;
+_eth_shm_learn (sw, &msg[6], shm->port);
+if (!(msg[0] & 0x01)) {                         /* unicast? */
+  port = _eth_shm_lookup (sw, msg);
+  if ((port >= 0) && sim_shmem_atomic_add (&sw->port[port].in_use, 0)) {
+    if (port != shm->port)
+      _eth_shm_deliver (shm, port, msg, len);
+    return 0;
+    }
+  }
+for (port = 0; port < ETH_SHM_PORTS; port++)    /* flood */
+  if ((port != shm->port) && sim_shmem_atomic_add (&sw->port[port].in_use, 0))
+    _eth_shm_deliver (shm, port, msg, len);
+return 0;
+}
+
+/* Pass the next frame waiting on this device's port to _eth_callback.
+   Returns 1 if a frame was processed, 0 if the port's ring is empty. */
+
+static int _eth_shm_recv (ETH_DEV *dev, ETH_SHM *shm)
+{
+ETH_SHM_PORT *p = &shm->sw->port[shm->port];
+int32 head = sim_shmem_atomic_add (&p->head, 0);
+ETH_SHM_SLOT *s = &p->slot[head & (ETH_SHM_SLOTS - 1)];
+int32 ready = sim_shmem_atomic_add (&s->ready, 0);
+struct pcap_pkthdr header;
+
+if (ready == ETH_SHM_NOFRAME (head)) {                  /* published without a frame? */
+  shm->stalled = FALSE;
+  sim_shmem_atomic_add (&p->head, 1);
+  return 1;
+  }
+if (ready != head + 1) {                                /* not published? */
+  uint32 now;
+
+  if (sim_shmem_atomic_add (&p->tail, 0) == head) {     /* ring empty */
+    shm->stalled = FALSE;
+    return 0;
+    }
+  now = sim_os_msec ();
+  if (!shm->stalled || (shm->stall_head != head)) {     /* newly reserved? */
+    shm->stalled = TRUE;
+    shm->stall_head = head;
+    shm->stall_start = now;
+    return 0;
+    }
+  if ((now - shm->stall_start) < ETH_SHM_STALL_MSEC)
+    return 0;
+  if (!sim_shmem_atomic_cas (&s->ready, ready, ETH_SHM_NOFRAME (head)))
+    return 1;                                           /* published just now */
+  shm->stalled = FALSE;                                 /* its producer is gone */
+  sim_shmem_atomic_add (&p->drops, 1);
+  sim_shmem_atomic_add (&p->head, 1);
+  return 1;
+  }
+shm->stalled = FALSE;
+memset (&header, 0, sizeof (header));
+header.caplen = header.len = s->len;
+_eth_callback ((u_char *)dev, &header, s->msg);
+sim_shmem_atomic_add (&p->head, 1);
+return 1;
+}
+
+/* TRUE if the process owning a port still exists */
+
+static t_bool _eth_shm_owner_alive (int32 pid)
+{
+#if defined (_WIN32)
+HANDLE hProcess = OpenProcess (SYNCHRONIZE, FALSE, (DWORD)pid);
+DWORD wait;
+
+if (hProcess == NULL)
+  return (GetLastError () == ERROR_ACCESS_DENIED);
+wait = WaitForSingleObject (hProcess, 0);
+CloseHandle (hProcess);
+return (wait == WAIT_TIMEOUT);
+#else
+return (kill ((pid_t)pid, 0) == 0) || (errno != ESRCH);
+#endif
+}
+
+static int32 _eth_shm_pid (void)
+{
+#if defined (_WIN32)
+return (int32)GetCurrentProcessId ();
+#else
+return (int32)getpid ();
+#endif
+}
+
+/* Forget the addresses learned on a port */
+
+static void _eth_shm_forget (ETH_SHM_SWITCH *sw, int port)
+{
+int i;
+
+for (i = 0; i < ETH_SHM_MACS; i++)
+  if (sw->mac[i].port == port + 1) {
+    int32 seq = sim_shmem_atomic_add (&sw->mac[i].seq, 0);
+
+    if (!(seq & 1) && sim_shmem_atomic_cas (&sw->mac[i].seq, seq, seq + 1)) {
+      sw->mac[i].port = 0;
+      sim_shmem_atomic_add (&sw->mac[i].seq, 1);
+      }
+    }
+}
+
+/* Release the ports of simulators which exited without closing them */
+
+static void _eth_shm_reclaim (ETH_SHM_SWITCH *sw)
+{
+int port, i, j;
+
+for (port = 0; port < ETH_SHM_PORTS; port++) {
+  ETH_SHM_PORT *p = &sw->port[port];
+  int32 owner = sim_shmem_atomic_add (&p->owner, 0);
+
+  if ((owner == 0) ||                           /* free or being set up */
+      !sim_shmem_atomic_add (&p->in_use, 0) ||
+      _eth_shm_owner_alive (owner) ||
+      !sim_shmem_atomic_cas (&p->owner, owner, 0))/* someone else reclaiming? */
+    continue;
+  _eth_shm_forget (sw, port);
+  for (i = 0; i < ETH_SHM_PORTS; i++)           /* copies it never finished */
+    for (j = 0; j < ETH_SHM_SLOTS; j++)
+      sim_shmem_atomic_cas (&sw->port[i].slot[j].busy, port + 1, 0);
+  sim_shmem_atomic_add (&p->bell, -sim_shmem_atomic_add (&p->bell, 0));
+  sim_shmem_atomic_add (&sw->users, -1);
+  sim_shmem_atomic_add (&p->in_use, -1);
+  }
+}
+
+/* Count a device as a user of a switch.  Fails if the switch's last
+   user has started removing it. */
+
+static t_bool _eth_shm_join (ETH_SHM_SWITCH *sw)
+{
+int32 users;
+
+do {
+  users = sim_shmem_atomic_add (&sw->users, 0);
+  if (users == ETH_SHM_GONE)
+    return FALSE;
+  } while (!sim_shmem_atomic_cas (&sw->users, users, users + 1));
+return TRUE;
+}
+
+/* Stop counting a device as a user of a switch, removing the switch if
+   it was the last one */
+
+static void _eth_shm_leave (ETH_SHM_SWITCH *sw, SHMEM *shmem)
+{
+int32 users;
+
+do {
+  users = sim_shmem_atomic_add (&sw->users, 0);
+  } while (!sim_shmem_atomic_cas (&sw->users, users, (users == 1) ? ETH_SHM_GONE : users - 1));
+if (users == 1)
+  sim_shmem_close (shmem);                      /* last one out removes the switch */
+else
+  sim_shmem_detach (shmem);
+}
+
+static t_stat _eth_shm_open (const char *swname, ETH_SHM **shm, char errbuf[PCAP_ERRBUF_SIZE])
+{
+char shmname[80];
+ETH_SHM_SWITCH *sw;
+ETH_SHM_PORT *p;
+void *addr;
+int port, tries;
+int32 bellport;
+t_stat r;
+
+if ((*swname == '\0') || (strlen (swname) > 64) || strpbrk (swname, "/\\:")) {
+  snprintf (errbuf, PCAP_ERRBUF_SIZE, "Invalid switch name: '%s'", swname);
+  return SCPE_OPENERR;
+  }
+*shm = (ETH_SHM *)calloc (1, sizeof (**shm));
+if (*shm == NULL)
+  return SCPE_MEM;
+snprintf (shmname, sizeof (shmname), "simh-eth-%s", swname);
+for (tries = 0; ; tries++) {
+  r = sim_shmem_open (shmname, sizeof (ETH_SHM_SWITCH), &(*shm)->shmem, &addr);
+  if (r != SCPE_OK) {
+    free (*shm);
+    *shm = NULL;
+    snprintf (errbuf, PCAP_ERRBUF_SIZE, "Can't open shared memory for switch '%s'", swname);
+    return r;
+    }
+  sw = (ETH_SHM_SWITCH *)addr;
+  if (!sim_shmem_atomic_cas (&sw->magic, 0, ETH_SHM_MAGIC) &&
+      (sim_shmem_atomic_add (&sw->magic, 0) != ETH_SHM_MAGIC)) {
+    sim_shmem_detach ((*shm)->shmem);
+    free (*shm);
+    *shm = NULL;
+    snprintf (errbuf, PCAP_ERRBUF_SIZE, "Shared memory '%s' is not a simh switch", shmname);
+    return SCPE_OPENERR;
+    }
+  if (_eth_shm_join (sw))
+    break;
+  sim_shmem_detach ((*shm)->shmem);             /* being removed, wait for it to go */
+  if (tries == 100) {
+    free (*shm);
+    *shm = NULL;
+    snprintf (errbuf, PCAP_ERRBUF_SIZE, "Switch '%s' is still being removed", swname);
+    return SCPE_OPENERR;
+    }
+  sim_os_ms_sleep (10);
+  }
+_eth_shm_reclaim (sw);
+for (port = 0; port < ETH_SHM_PORTS; port++)
+  if (sim_shmem_atomic_cas (&sw->port[port].in_use, 0, 1))
+    break;
+if (port == ETH_SHM_PORTS) {
+  _eth_shm_leave (sw, (*shm)->shmem);
+  free (*shm);
+  *shm = NULL;
+  snprintf (errbuf, PCAP_ERRBUF_SIZE, "All %d ports of switch '%s' are in use", ETH_SHM_PORTS, swname);
+  return SCPE_OPENERR;
+  }
+p = &sw->port[port];                            /* discard anything left by a previous owner */
+sim_shmem_atomic_add (&p->head, sim_shmem_atomic_add (&p->tail, 0) - sim_shmem_atomic_add (&p->head, 0));
+(*shm)->sw = sw;
+(*shm)->port = port;
+(*shm)->bell = _eth_shm_bell_open (&bellport);
+sim_shmem_atomic_add (&p->bell, bellport - sim_shmem_atomic_add (&p->bell, 0));
+sim_shmem_atomic_cas (&p->owner, 0, _eth_shm_pid ());
+return SCPE_OK;
+}
+
+static void _eth_shm_close (ETH_SHM *shm)
+{
+ETH_SHM_SWITCH *sw = shm->sw;
+ETH_SHM_PORT *p = &sw->port[shm->port];
+
+_eth_shm_forget (sw, shm->port);                /* forget addresses learned here */
+sim_shmem_atomic_add (&p->bell, -sim_shmem_atomic_add (&p->bell, 0));
+if (shm->bell != INVALID_SOCKET)
+  closesocket (shm->bell);
+sim_shmem_atomic_add (&p->owner, -sim_shmem_atomic_add (&p->owner, 0));
+sim_shmem_atomic_add (&p->in_use, -1);
+_eth_shm_leave (sw, shm->shmem);
+free (shm);
+}
+
 #if defined (USE_READER_THREAD)
 static void *
 _eth_reader(void *arg)
@@ -1971,6 +2520,10 @@ switch (dev->eth_api) {
     do_select = 1;
     select_fd = dev->fd_handle;
     break;
+  case ETH_API_SHM:
+    select_fd = ((ETH_SHM *)dev->handle)->bell;
+    do_select = (select_fd != INVALID_SOCKET);  /* else rings are polled */
+    break;
   }
 
 sim_debug(dev->dbit, dev->dptr, "Reader Thread Starting\n");
@@ -1986,7 +2539,7 @@ while (dev->handle) {
     if (WAIT_OBJECT_0 == WaitForSingleObject (hWait, 250))
       sel_ret = 1;
     }
-  if ((dev->eth_api == ETH_API_UDP) || (dev->eth_api == ETH_API_NAT))
+  if ((dev->eth_api == ETH_API_UDP) || (dev->eth_api == ETH_API_NAT) || (dev->eth_api == ETH_API_SHM))
 #endif /* _WIN32 */
   if (1) {
     if (do_select) {
@@ -1996,6 +2549,9 @@ while (dev->handle) {
         }
       else
 #endif
+      if ((dev->eth_api == ETH_API_SHM) && ((dev->handle == NULL) || _eth_shm_arm ((ETH_SHM *)dev->handle)))
+        sel_ret = 1;                        /* frame already waiting */
+      else
         {
         fd_set setl;
         struct timeval timeout;
@@ -2005,6 +2561,10 @@ while (dev->handle) {
         timeout.tv_sec = 0;
         timeout.tv_usec = 250*1000;
         sel_ret = select(1+select_fd, &setl, NULL, NULL, &timeout);
+        if ((dev->eth_api == ETH_API_SHM) && dev->handle) {
+          _eth_shm_disarm ((ETH_SHM *)dev->handle);
+          sel_ret = 1;                      /* check for a stalled slot even on timeout */
+          }
         }
       }
     else
@@ -2095,6 +2655,16 @@ while (dev->handle) {
             }
           }
         break;
+      case ETH_API_SHM:
+        if (1) {
+          ETH_SHM *shm = (ETH_SHM *)dev->handle;  /* stays valid until this thread is joined */
+
+          for (status = 0; shm && (status < ETH_SHM_SLOTS) && _eth_shm_recv (dev, shm); ++status)
+            ;
+          if ((status == 0) && !do_select)
+            sim_os_ms_sleep (1);    /* no doorbell, poll */
+          }
+        break;
       }
     if ((status > 0) && (dev->asynch_io)) {
       int wakeup_needed;
@@ -2151,6 +2721,9 @@ while (dev->handle) {
       break;
     /* Pull buffer off request list */
     dev->write_requests = request->next;
+    if (dev->write_requests == NULL)
+      dev->write_requests_tail = NULL;
+    --dev->write_queue_size;
     pthread_mutex_unlock (&dev->writer_lock);
 
     if (dev->throttle_delay != ETH_THROT_DISABLED_DELAY) {
@@ -2426,7 +2999,22 @@ else { /* !tap: */
         *eth_api = ETH_API_UDP;
         *handle = (void *)1;  /* Flag used to indicated open */
         }
-      else { /* not udp:, so attempt to open the parameter as if it were an explicit device name */
+      else if (0 == strncmp("shm:", savname, 4)) {
+        const char *devname = savname + 4;
+        ETH_SHM *shm;
+        t_stat r;
+
+        if (!strcmp(savname, "shm:switch-name"))
+          return sim_messagef (SCPE_OPENERR, "Eth: Must specify actual switch name (i.e. shm:lab)\n");
+        while (isspace(*devname))
+          ++devname;
+        r = _eth_shm_open (devname, &shm, errbuf);
+        if (r != SCPE_OK)
+          return sim_messagef (r, "Eth: %s\n", errbuf);
+        *eth_api = ETH_API_SHM;
+        *handle = (void *)shm;
+        }
+      else { /* not udp: or shm:, so attempt to open the parameter as if it were an explicit device name */
 #if defined(HAVE_PCAP_NETWORK)
         *handle = (void*) pcap_open_live(savname, bufsz, ETH_PROMISC, PCAP_READ_TIMEOUT, errbuf);
 #if !defined(__CYGWIN__) && !defined(__VMS) && !defined(_WIN32)
@@ -2658,6 +3246,9 @@ switch (eth_api) {
   case ETH_API_UDP:
     sim_close_sock(pcap_fd);
     break;
+  case ETH_API_SHM:
+    _eth_shm_close((ETH_SHM *)pcap);
+    break;
   }
 return SCPE_OK;
 }
@@ -2697,6 +3288,8 @@ if (1) {
     }
   }
 ethq_destroy (&dev->read_queue);         /* release FIFO queue */
+#else
+free (dev->peek_packet);
 #endif
 
 _eth_close_port (dev->eth_api, pcap, pcap_fd);
@@ -2751,6 +3344,7 @@ fprintf (st, "    eth2   vde:device{:switch-port-number}      (Integrated VDE su
 fprintf (st, "    eth3   nat:{optional-nat-parameters}        (Integrated NAT (SLiRP) support)\n");
 #endif
 fprintf (st, "    eth4   udp:sourceport:remotehost:remoteport (Integrated UDP bridge support)\n");
+fprintf (st, "    eth5   shm:switch-name                      (Integrated shared memory switch support)\n");
 fprintf (st, "   sim> ATTACH %s eth0\n\n", dptr->name);
 fprintf (st, "or equivalently:\n\n");
 fprintf (st, "   sim> ATTACH %s en0\n\n", dptr->name);
@@ -2967,6 +3561,9 @@ switch (dev->eth_api) {
   case ETH_API_NAT:
       netname = "nat";
       break;
+  case ETH_API_SHM:
+      netname = "shm";
+      break;
   }
 sprintf(msg, "%s(%s): ", where, netname);
 switch (dev->eth_api) {
@@ -3014,8 +3611,10 @@ if (dev->error_needs_reset) {
 
   r = _eth_open_port(dev->name, &dev->eth_api, &dev->handle, &dev->fd_handle, errbuf, dev->bpf_filter, (void *)dev, dev->dptr, dev->dbit);
   dev->error_needs_reset = FALSE;
-  if (r == SCPE_OK)
+  if (r == SCPE_OK) {
+    _eth_filter_push(dev);
     sim_printf ("%s ReOpened: %s \n", msg, dev->name);
+    }
   else
     sim_printf ("%s ReOpen Attempt Failed: %s - %s\n", msg, dev->name, errbuf);
   ++dev->error_reopen_count;
@@ -3099,6 +3698,9 @@ if ((packet->len >= ETH_MIN_PACKET) && (packet->len <= ETH_MAX_PACKET)) {
     case ETH_API_UDP:
       status = (((int32)packet->len == sim_write_sock (dev->fd_handle, (char *)packet->msg, (int32)packet->len)) ? 0 : -1);
       break;
+    case ETH_API_SHM:
+      status = _eth_shm_send ((ETH_SHM *)dev->handle, packet->msg, (int)packet->len);
+      break;
     }
   ++dev->packets_sent;              /* basic bookkeeping */
   /* On error, correct loopback bookkeeping */
@@ -3155,18 +3757,13 @@ memcpy(request->packet.msg, packet->msg, packet->len);
 
 /* Insert buffer at the end of the write list (to make sure that */
 /* packets make it to the wire in the order they were presented here) */
-{
-  int write_queue_size = 1;
-  ETH_WRITE_REQUEST **last_request = &dev->write_requests;
-
-  while (*last_request != NULL) {
-    last_request = &(*last_request)->next;
-    ++write_queue_size;
-    }
-  *last_request = request;
-  if (write_queue_size > dev->write_queue_peak)
-    dev->write_queue_peak = write_queue_size;
-  }
+if (dev->write_requests_tail)
+  dev->write_requests_tail->next = request;
+else
+  dev->write_requests = request;
+dev->write_requests_tail = request;
+if (++dev->write_queue_size > dev->write_queue_peak)
+  dev->write_queue_peak = dev->write_queue_size;
 
 /* Awaken writer thread to perform actual write */
 pthread_mutex_unlock (&dev->writer_lock);
@@ -3190,6 +3787,167 @@ key ^= 0x3f;
 return (hash[key>>3] & (1 << (key&0x7)));
 }
 
+/* Compiled address filter
+
+   eth_filter_hash_ex compiles the filter addresses into filter_table, an
+   open addressed hash table holding the index (+1) of each address in
+   filter_address.  A hash seed is searched for which gives every address
+   a slot of its own, so a received frame costs one hash and at most one
+   address compare rather than a compare against every filter address.
+   With ETH_FILTER_MAX addresses in ETH_FILTER_TABLE slots such a seed is
+   normally found within a few dozen tries; if none is, the table simply
+   uses linear probing with the last seed tried.
+
+   The multicast hash is reduced to whether it accepts every multicast
+   address (all bits set), none (no bits set) or must be consulted.
+ */
+
+static uint32
+_eth_filter_slot(uint32 seed, const u_char* mac)
+{
+uint32 h = ((uint32)mac[2] << 24) | ((uint32)mac[3] << 16) | ((uint32)mac[4] << 8) | mac[5];
+
+h ^= ((((uint32)mac[0] << 8) | mac[1]) * 0x9E3779B1) + (seed * 0x85EBCA6B);
+h *= 0xC2B2AE35;
+return (h >> 16) & (ETH_FILTER_TABLE - 1);
+}
+
+static void
+_eth_filter_compile(ETH_DEV* dev)
+{
+static const ETH_MULTIHASH none = {0, 0, 0, 0, 0, 0, 0, 0};
+static const ETH_MULTIHASH all = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+uint32 seed, slot;
+int i, idx, collisions;
+
+for (seed = 0; ; seed++) {
+  memset (dev->filter_table, 0, sizeof (dev->filter_table));
+  collisions = 0;
+  for (i = 0; i < dev->addr_count; i++) {
+    slot = _eth_filter_slot (seed, dev->filter_address[i]);
+    while (((idx = dev->filter_table[slot]) != 0) &&
+           eth_mac_cmp (dev->filter_address[idx - 1], dev->filter_address[i])) {
+      ++collisions;
+      slot = (slot + 1) & (ETH_FILTER_TABLE - 1);
+      }
+    if (idx == 0)                           /* duplicates need only one slot */
+      dev->filter_table[slot] = (uint8)(i + 1);
+    }
+  if ((collisions == 0) || (seed == 255))
+    break;
+  }
+dev->filter_seed = seed;
+dev->filter_all_multicast = dev->all_multicast ||
+                            (dev->hash_filter && !memcmp (dev->hash, all, sizeof (all)));
+dev->filter_hash = dev->hash_filter && memcmp (dev->hash, none, sizeof (none)) &&
+                   !dev->filter_all_multicast;
+}
+
+static int
+_eth_filter_match(ETH_DEV* dev, const u_char* mac)
+{
+uint32 slot = _eth_filter_slot (dev->filter_seed, mac);
+int idx;
+
+while ((idx = dev->filter_table[slot]) != 0) {
+  if (0 == eth_mac_cmp (dev->filter_address[idx - 1], mac))
+    return 1;
+  slot = (slot + 1) & (ETH_FILTER_TABLE - 1);
+  }
+return 0;
+}
+
+/* Where the host allows a classic BPF program to be attached to the file
+   descriptor frames arrive on (tap devices and UDP sockets on Linux), the
+   same filter is installed there too, so the host discards frames which
+   aren't for us before they are ever copied into the simulator.  pcap
+   devices get their filter from the BPF string built by eth_bpf_filter. */
+
+#if (defined(__linux) || defined(__linux__)) && !defined(_WIN32)
+#include <linux/filter.h>
+#endif
+
+#if defined(SO_ATTACH_FILTER) || (defined(HAVE_TAP_NETWORK) && defined(TUNATTACHFILTER))
+#define ETH_FILTER_BPF_MAX (3 + 4*(ETH_FILTER_MAX + 1) + 2)
+
+static int
+_eth_filter_bpf(ETH_DEV* dev, struct sock_filter* prog, uint32 base)
+{
+ETH_MAC addrs[ETH_FILTER_MAX + 1];
+int i, j, count = 0, n = 0, accept;
+int multicast = dev->filter_all_multicast || dev->filter_hash;
+
+for (i = 0; i < dev->addr_count; i++) {
+  if (multicast && (dev->filter_address[i][0] & 0x01))
+    continue;                               /* covered by the multicast test */
+  for (j = 0; j < count; j++)
+    if (0 == eth_mac_cmp (addrs[j], dev->filter_address[i]))
+      break;
+  if (j == count)
+    eth_copy_mac (addrs[count++], dev->filter_address[i]);
+  }
+if (dev->have_host_nic_phy_addr)            /* loopback responses arrive for this */
+  eth_copy_mac (addrs[count++], dev->host_nic_phy_hw_addr);
+accept = (multicast ? 2 : 0) + 4*count + 1;
+if (multicast) {                            /* any multicast destination is accepted */
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD+BPF_B+BPF_ABS, base);
+  prog[n] = (struct sock_filter)BPF_JUMP(BPF_JMP+BPF_JSET+BPF_K, 0x01, (u_char)(accept - n - 1), 0);
+  ++n;
+  }
+for (i = 0; i < count; i++) {               /* then each unicast address */
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD+BPF_W+BPF_ABS, base + 2);
+  prog[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K,
+                                           ((uint32)addrs[i][2] << 24) | ((uint32)addrs[i][3] << 16) |
+                                           ((uint32)addrs[i][4] << 8) | addrs[i][5], 0, 2);
+  prog[n++] = (struct sock_filter)BPF_STMT(BPF_LD+BPF_H+BPF_ABS, base);
+  prog[n] = (struct sock_filter)BPF_JUMP(BPF_JMP+BPF_JEQ+BPF_K,
+                                         ((uint32)addrs[i][0] << 8) | addrs[i][1],
+                                         (u_char)(accept - n - 1), 0);
+  ++n;
+  }
+prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET+BPF_K, 0);
+prog[n++] = (struct sock_filter)BPF_STMT(BPF_RET+BPF_K, 0x7FFFFFFF);
+return n;
+}
+#endif
+
+static void
+_eth_filter_push(ETH_DEV* dev)
+{
+#if defined(SO_ATTACH_FILTER) || (defined(HAVE_TAP_NETWORK) && defined(TUNATTACHFILTER))
+struct sock_filter prog[ETH_FILTER_BPF_MAX];
+struct sock_fprog fprog;
+
+dev->filter_pushed = FALSE;
+switch (dev->eth_api) {
+#if defined(HAVE_TAP_NETWORK) && defined(TUNATTACHFILTER)
+  case ETH_API_TAP:
+    if (dev->promiscuous) {
+      ioctl (dev->fd_handle, TUNDETACHFILTER, &fprog);
+      break;
+      }
+    fprog.filter = prog;
+    fprog.len = (unsigned short)_eth_filter_bpf (dev, prog, 0);
+    dev->filter_pushed = (0 == ioctl (dev->fd_handle, TUNATTACHFILTER, &fprog));
+    break;
+#endif
+#if defined(SO_ATTACH_FILTER)
+  case ETH_API_UDP:                         /* UDP socket filters see the UDP header first */
+    if (dev->promiscuous) {
+      setsockopt (dev->fd_handle, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+      break;
+      }
+    fprog.filter = prog;
+    fprog.len = (unsigned short)_eth_filter_bpf (dev, prog, 8);
+    dev->filter_pushed = (0 == setsockopt (dev->fd_handle, SOL_SOCKET, SO_ATTACH_FILTER, (char *)&fprog, sizeof (fprog)));
+    break;
+#endif
+  default:
+    break;
+  }
+#endif
+}
+
 #if 0
 static int
 _eth_hash_validate(ETH_MAC *MultiCastList, int count, ETH_MULTIHASH hash)
@@ -3685,7 +4443,6 @@ _eth_callback(u_char* info, const struct pcap_pkthdr* header, const u_char* data
 ETH_DEV*  dev = (ETH_DEV*) info;
 int to_me;
 int from_me = 0;
-int i;
 int bpf_used;
 
 if (LOOPBACK_PHYSICAL_RESPONSE(dev, data)) {
@@ -3709,30 +4466,39 @@ switch (dev->eth_api) {
     /* AUTODIN II hash mode? */
     if ((dev->hash_filter) && (data[0] & 0x01) && (!dev->promiscuous) && (!dev->all_multicast))
       to_me = _eth_hash_lookup(dev->hash, data);
+    if (!to_me)
+      ++dev->filter_rejected;
     break;
 #endif /* USE_BPF */
   case ETH_API_TAP:
   case ETH_API_VDE:
   case ETH_API_UDP:
   case ETH_API_NAT:
+  case ETH_API_SHM:
     bpf_used = 0;
     to_me = 0;
     eth_packet_trace (dev, data, header->len, "received");
 
-    for (i = 0; i < dev->addr_count; i++) {
-      if (memcmp(data, dev->filter_address[i], 6) == 0) to_me = 1;
-      if (memcmp(&data[6], dev->filter_address[i], 6) == 0) from_me = 1;
-    }
-
-    /* all multicast mode? */
-    if (dev->all_multicast && (data[0] & 0x01)) to_me = 1;
-
     /* promiscuous mode? */
-    if (dev->promiscuous) to_me = 1;
-
-    /* AUTODIN II hash mode? */
-    if ((dev->hash_filter) && (!to_me) && (data[0] & 0x01))
-      to_me = _eth_hash_lookup(dev->hash, data);
+    if (dev->promiscuous)
+      to_me = 1;
+    else {
+      if (data[0] & 0x01) {
+        /* all multicast mode or AUTODIN II hash mode? */
+        if (dev->filter_all_multicast)
+          to_me = 1;
+        else
+          if (dev->filter_hash)
+            to_me = _eth_hash_lookup(dev->hash, data);
+        }
+      if (!to_me)
+        to_me = _eth_filter_match(dev, data);
+      if (!to_me) {
+        ++dev->filter_rejected;
+        break;
+        }
+      }
+    from_me = _eth_filter_match(dev, &data[6]);
     break;
   default:
     bpf_used = to_me = 0;                           /* Should NEVER happen */
@@ -3780,14 +4546,13 @@ if (bpf_used ? to_me : (to_me && !from_me)) {
     int crc_len = 0;
     uint8 crc_data[4] = { 0, 0, 0, 0 };
     uint32 len = header->len;
-    u_char *moved_data = NULL;
+    u_char padded_data[ETH_MIN_PACKET];
 
     if (header->len < ETH_MIN_PACKET) {   /* Pad runt packets before CRC append */
-      moved_data = (u_char *)malloc(ETH_MIN_PACKET);
-      memcpy(moved_data, data, len);
-      memset(moved_data + len, 0, ETH_MIN_PACKET-len);
+      memcpy(padded_data, data, len);
+      memset(padded_data + len, 0, ETH_MIN_PACKET-len);
       len = ETH_MIN_PACKET;
-      data = moved_data;
+      data = padded_data;
       }
 
     /* If necessary, fix IP header checksums for packets originated locally */
@@ -3801,10 +4566,13 @@ if (bpf_used ? to_me : (to_me && !from_me)) {
     eth_packet_trace (dev, data, len, "rcvqd");
 
     pthread_mutex_lock (&dev->lock);
-    ethq_insert_data(&dev->read_queue, ETH_ITM_NORMAL, data, 0, len, crc_len, crc_data, 0);
+    if (dev->read_peeked &&               /* oldest packet held by eth_read_peek? */
+        (dev->read_queue.count == dev->read_queue.max))
+      ++dev->read_queue.loss;             /* drop this one instead */
+    else
+      ethq_insert_data(&dev->read_queue, ETH_ITM_NORMAL, data, 0, len, crc_len, crc_data, 0);
     ++dev->packets_received;
     pthread_mutex_unlock (&dev->lock);
-    free(moved_data);
     }
 #else /* !USE_READER_THREAD */
   /* set data in passed read packet */
@@ -3932,6 +4700,9 @@ do {
           }
         }
       break;
+    case ETH_API_SHM:
+      status = _eth_shm_recv (dev, (ETH_SHM *)dev->handle);
+      break;
     }
   } while ((status > 0) && (0 == packet->len));
 if (status < 0) {
@@ -3959,6 +4730,58 @@ if (status < 0) {
 return status;
 }
 
+/* eth_read_peek
+ *
+ * Return the next received packet without copying it, or NULL if none is
+ * available.  The packet stays where the reader thread queued it, so a
+ * controller can move it straight into simulated memory, and it remains
+ * valid until eth_read_consume is called.  Only one packet may be held
+ * at a time, and eth_read must not be used while one is.
+ */
+ETH_PACK *eth_read_peek (ETH_DEV* dev)
+{
+ETH_PACK *packet = NULL;
+
+/* make sure device exists */
+if ((!dev) || (dev->eth_api == ETH_API_NONE)) return NULL;
+
+#if defined (USE_READER_THREAD)
+pthread_mutex_lock (&dev->lock);
+if (dev->read_queue.count > 0) {
+  packet = &dev->read_queue.item[dev->read_queue.head].packet;
+  dev->read_peeked = 1;
+  }
+pthread_mutex_unlock (&dev->lock);
+#else
+if (!dev->peek_packet) {
+  dev->peek_packet = (ETH_PACK *)calloc (1, sizeof (*dev->peek_packet));
+  if (!dev->peek_packet)
+    return NULL;
+  }
+if (dev->peek_packet->len == 0)
+  eth_read (dev, dev->peek_packet, NULL);
+if (dev->peek_packet->len)
+  packet = dev->peek_packet;
+#endif
+return packet;
+}
+
+void eth_read_consume (ETH_DEV* dev)
+{
+if ((!dev) || (dev->eth_api == ETH_API_NONE)) return;
+
+#if defined (USE_READER_THREAD)
+pthread_mutex_lock (&dev->lock);
+if (dev->read_peeked)
+  ethq_remove (&dev->read_queue);
+dev->read_peeked = 0;
+pthread_mutex_unlock (&dev->lock);
+#else
+if (dev->peek_packet)
+  dev->peek_packet->len = 0;
+#endif
+}
+
 t_stat eth_bpf_filter (ETH_DEV* dev, int addr_count, ETH_MAC* const filter_address,
                        ETH_BOOL all_multicast, ETH_BOOL promiscuous,
                        int reflections,
@@ -4116,6 +4939,10 @@ if (hash) {
                                   dev->hash[4], dev->hash[5], dev->hash[6], dev->hash[7]);
   }
 
+/* compile the filter for _eth_callback and, where possible, the host */
+_eth_filter_compile(dev);
+_eth_filter_push(dev);
+
 /* print out filter information if debugging */
 if (dev->dptr->dctrl & dev->dbit) {
   sim_debug(dev->dbit, dev->dptr, "Filter Set\n");
@@ -4217,6 +5044,7 @@ if (dev->eth_api == ETH_API_PCAP) {
 #ifdef USE_READER_THREAD
   pthread_mutex_lock (&dev->lock);
   ethq_clear (&dev->read_queue); /* Empty FIFO Queue when filter list changes */
+  dev->read_peeked = 0;          /* nothing left to consume */
   pthread_mutex_unlock (&dev->lock);
 #endif
   }
@@ -4292,10 +5120,24 @@ if (dev->promiscuous)
   fprintf(st, "  Promiscuous mode:        Enabled\n");
 if (dev->bpf_filter)
   fprintf(st, "  BPF Filter: %s\n", dev->bpf_filter);
+if (dev->filter_pushed)
+  fprintf(st, "  Host Filter:             Installed\n");
+if (dev->filter_rejected)
+  fprintf(st, "  Filter Rejects:          %d\n", dev->filter_rejected);
 #if defined(HAVE_SLIRP_NETWORK)
 if (dev->eth_api == ETH_API_NAT)
   sim_slirp_show ((SLIRP *)dev->handle, st);
 #endif
+if ((dev->eth_api == ETH_API_SHM) && dev->handle) {
+  ETH_SHM *shm = (ETH_SHM *)dev->handle;
+
+  fprintf(st, "  Switch Port:             %d\n", shm->port);
+  fprintf(st, "  Switch Ports In Use:     %d\n", (int)shm->sw->users);
+  if (shm->sw->port[shm->port].drops)
+    fprintf(st, "  Switch Port Drops:       %d\n", (int)shm->sw->port[shm->port].drops);
+  if (shm->bell == INVALID_SOCKET)
+    fprintf(st, "  Switch Port Doorbell:    Unavailable, polling\n");
+  }
 }
 
 static
@@ -4413,7 +5255,8 @@ for (eth_num=0; eth_num<eth_device_count; eth_num++) {
   if ((0 == memcmp (eth_list[eth_num].name, "nat:", 4)) ||
       (0 == memcmp (eth_list[eth_num].name, "tap:", 4)) ||
       (0 == memcmp (eth_list[eth_num].name, "vde:", 4)) ||
-      (0 == memcmp (eth_list[eth_num].name, "udp:", 4)))
+      (0 == memcmp (eth_list[eth_num].name, "udp:", 4)) ||
+      (0 == memcmp (eth_list[eth_num].name, "shm:", 4)))
       continue;
   eth_name[sizeof (eth_name)-1] = '\0';
   snprintf (eth_name, sizeof (eth_name)-1, "eth%d", eth_num);
@@ -4492,8 +5335,344 @@ if (bpf_compile_skip_count)
 return (errors == 0) ? SCPE_OK : SCPE_IERR;
 }
 
+/* Pass packets between two UDP connected devices and receive them with
+   eth_read_peek/eth_read_consume, checking they arrive intact and in order */
+
+static
+t_stat eth_test_queue (DEVICE *dptr)
+{
+int errors = 0;
+ETH_DEV *a = (ETH_DEV *)calloc (1, sizeof (*a));
+ETH_DEV *b = (ETH_DEV *)calloc (1, sizeof (*b));
+ETH_MAC mac_a = {0x08, 0x00, 0x2B, 0x11, 0x22, 0x33};
+ETH_MAC mac_b = {0x08, 0x00, 0x2B, 0x44, 0x55, 0x66};
+ETH_PACK send, *recv;
+int i, sent, got;
+uint32 start;
+
+if ((SCPE_OK != eth_open (a, "udp:65510:localhost:65511", dptr, 0)) ||
+    (SCPE_OK != eth_open (b, "udp:65511:localhost:65510", dptr, 0))) {
+  sim_printf ("%s: Can't open UDP test devices\n", dptr->name);
+  if (a->eth_api != ETH_API_NONE)
+    eth_close (a);
+  free (a);
+  free (b);
+  return SCPE_OK;
+  }
+eth_filter (a, 1, &mac_a, 0, 0);
+eth_filter (b, 1, &mac_b, 0, 0);
+memset (&send, 0, sizeof (send));
+eth_copy_mac (&send.msg[0], mac_b);
+eth_copy_mac (&send.msg[6], mac_a);
+send.msg[12] = 0x60;                                /* DEC Customer Protocol */
+send.msg[13] = 0x06;
+send.len = ETH_MIN_PACKET + 40;
+start = sim_os_msec ();
+for (sent = got = 0; (got < 500) && ((sim_os_msec () - start) < 5000); ) {
+  if ((sent < 500) && (sent - got < 50)) {         /* keep some in flight */
+    for (i = 14; i < (int)send.len; i++)
+      send.msg[i] = (uint8)(sent + i);
+    eth_write (a, &send, NULL);                     /* status is from an earlier write */
+    ++sent;
+    }
+  while (NULL != (recv = eth_read_peek (b))) {
+    if ((recv->len != send.len) ||
+        (recv->msg[14] != (uint8)(got + 14)) ||
+        (recv->msg[send.len - 1] != (uint8)(got + send.len - 1))) {
+      sim_printf ("%s: packet %d received out of order or damaged\n", dptr->name, got);
+      ++errors;
+      }
+    eth_read_consume (b);
+    ++got;
+    }
+  if (sent - got >= 50)
+    sim_os_ms_sleep (1);
+  }
+if (got != 500) {
+  sim_printf ("%s: only %d of 500 packets received\n", dptr->name, got);
+  ++errors;
+  }
+eth_close (a);
+eth_close (b);
+free (a);
+free (b);
+return (errors == 0) ? SCPE_OK : SCPE_IERR;
+}
+
 #include <setjmp.h>
 
+static ETH_PACK *eth_test_shm_wait (ETH_DEV *dev, uint32 msec)
+{
+uint32 start = sim_os_msec ();
+ETH_PACK *pack;
+
+while ((NULL == (pack = eth_read_peek (dev))) && ((sim_os_msec () - start) < msec))
+  sim_os_ms_sleep (1);
+return pack;
+}
+
+/* Exercise the shared memory switch: a broadcast must reach every other
+   port, while unicast to a learned address must reach only its port.
+   The third device is promiscuous so that it would see any frame the
+   switch wrongly floods to it.  Then fake the leftovers of a simulator
+   which crashed: a port held by a process which no longer exists must
+   be released when another device opens, and a slot reserved but never
+   published must not block the frames behind it, nor accept a late
+   publish once skipped.  Finally, a slot still being copied into by
+   such a late producer must not be read. */
+
+static
+t_stat eth_test_shm (DEVICE *dptr)
+{
+int errors = 0;
+ETH_DEV *dev[4] = {NULL, NULL, NULL, NULL};
+ETH_MAC mac[4] = {{0x08, 0x00, 0x2B, 0x11, 0x22, 0x33},
+                  {0x08, 0x00, 0x2B, 0x44, 0x55, 0x66},
+                  {0x08, 0x00, 0x2B, 0x77, 0x88, 0x99},
+                  {0x08, 0x00, 0x2B, 0xAA, 0xBB, 0xCC}};
+ETH_MAC filter[2];
+ETH_PACK send, *recv;
+ETH_SHM *shm;
+ETH_SHM_PORT *p;
+ETH_SHM_SLOT *s;
+char name[32];
+int32 drops, seq, stamp;
+uint32 start;
+int i;
+
+snprintf (name, sizeof (name), "shm:test%u", (unsigned)sim_os_msec ());
+for (i = 0; i < 3; i++) {
+  dev[i] = (ETH_DEV *)calloc (1, sizeof (*dev[i]));
+  if ((dev[i] == NULL) || (SCPE_OK != eth_open (dev[i], name, dptr, 0))) {
+    sim_printf ("%s: Can't open shared memory switch test devices\n", dptr->name);
+    while (i >= 0) {
+      if (dev[i] && (dev[i]->eth_api != ETH_API_NONE))
+        eth_close (dev[i]);
+      free (dev[i--]);
+      }
+    return SCPE_OK;
+    }
+  eth_copy_mac (filter[0], mac[i]);
+  eth_copy_mac (filter[1], eth_mac_bcast);
+  eth_filter (dev[i], 2, filter, 0, (i == 2));
+  }
+memset (&send, 0, sizeof (send));
+send.msg[12] = 0x60;                                /* DEC Customer Protocol */
+send.msg[13] = 0x06;
+send.len = ETH_MIN_PACKET;
+/* Broadcast from 0 reaches 1 and 2 */
+eth_copy_mac (&send.msg[0], eth_mac_bcast);
+eth_copy_mac (&send.msg[6], mac[0]);
+eth_write (dev[0], &send, NULL);
+for (i = 1; i < 3; i++) {
+  if (NULL == (recv = eth_test_shm_wait (dev[i], 1000))) {
+    sim_printf ("%s: broadcast not received on port %d\n", dptr->name, i);
+    ++errors;
+    }
+  else
+    eth_read_consume (dev[i]);
+  }
+/* Unicast from 1 to 0 (learned by the broadcast) reaches only 0 */
+eth_copy_mac (&send.msg[0], mac[0]);
+eth_copy_mac (&send.msg[6], mac[1]);
+eth_write (dev[1], &send, NULL);
+if ((NULL == (recv = eth_test_shm_wait (dev[0], 1000))) ||
+    (eth_mac_cmp (&recv->msg[6], mac[1]) != 0)) {
+  sim_printf ("%s: unicast not received on its port\n", dptr->name);
+  ++errors;
+  }
+else
+  eth_read_consume (dev[0]);
+if (NULL != eth_test_shm_wait (dev[2], 50)) {
+  sim_printf ("%s: learned unicast was flooded to another port\n", dptr->name);
+  eth_read_consume (dev[2]);
+  ++errors;
+  }
+/* A port left in use by a process which is gone */
+shm = (ETH_SHM *)dev[0]->handle;
+p = &shm->sw->port[3];
+sim_shmem_atomic_add (&p->owner, 0x7FFFFFF0);
+sim_shmem_atomic_add (&p->in_use, 1);
+sim_shmem_atomic_add (&shm->sw->users, 1);
+_eth_shm_learn (shm->sw, mac[3], 3);
+s = &shm->sw->port[shm->port].slot[ETH_SHM_SLOTS - 1];
+sim_shmem_atomic_add (&s->busy, 3 + 1);             /* a copy it never finished */
+dev[3] = (ETH_DEV *)calloc (1, sizeof (*dev[3]));
+if ((dev[3] == NULL) || (SCPE_OK != eth_open (dev[3], name, dptr, 0))) {
+  sim_printf ("%s: crashed holder's port was not released\n", dptr->name);
+  ++errors;
+  }
+else {
+  if (((ETH_SHM *)dev[3]->handle)->port != 3) {
+    sim_printf ("%s: crashed holder's port was not reused\n", dptr->name);
+    ++errors;
+    }
+  if (_eth_shm_lookup (shm->sw, mac[3]) == 3) {
+    sim_printf ("%s: crashed holder's address was not forgotten\n", dptr->name);
+    ++errors;
+    }
+  if (shm->sw->users != 4) {
+    sim_printf ("%s: crashed holder still counted as a user: %d\n", dptr->name, (int)shm->sw->users);
+    ++errors;
+    }
+  if (s->busy != 0) {
+    sim_printf ("%s: crashed holder's busy slot was not released\n", dptr->name);
+    ++errors;
+    }
+  }
+/* A producer which died between reserving a slot and publishing it */
+p = &shm->sw->port[shm->port];
+drops = p->drops;
+seq = p->tail;
+s = &p->slot[seq & (ETH_SHM_SLOTS - 1)];
+stamp = s->ready;
+sim_shmem_atomic_add (&p->tail, 1);
+eth_copy_mac (&send.msg[0], mac[0]);
+eth_copy_mac (&send.msg[6], mac[1]);
+eth_write (dev[1], &send, NULL);
+start = sim_os_msec ();
+if (NULL == eth_test_shm_wait (dev[0], ETH_SHM_STALL_MSEC + 1000)) {
+  sim_printf ("%s: frame stuck behind an unpublished slot\n", dptr->name);
+  ++errors;
+  }
+else {
+  eth_read_consume (dev[0]);
+  if ((sim_os_msec () - start) < ETH_SHM_STALL_MSEC) {
+    sim_printf ("%s: unpublished slot skipped too soon\n", dptr->name);
+    ++errors;
+    }
+  if (p->drops != drops + 1) {
+    sim_printf ("%s: skipped slot not counted as a drop\n", dptr->name);
+    ++errors;
+    }
+  if (sim_shmem_atomic_cas (&s->ready, stamp, seq + 1)) {
+    sim_printf ("%s: late publish into a skipped slot was accepted\n", dptr->name);
+    ++errors;
+    }
+  }
+/* A slot which a late producer is still copying into */
+drops = p->drops;
+s = &p->slot[p->tail & (ETH_SHM_SLOTS - 1)];
+sim_shmem_atomic_add (&s->busy, ETH_SHM_PORTS);
+eth_write (dev[1], &send, NULL);
+if (NULL != eth_test_shm_wait (dev[0], 100)) {
+  sim_printf ("%s: frame read from a slot still being copied into\n", dptr->name);
+  eth_read_consume (dev[0]);
+  ++errors;
+  }
+else if (p->drops != drops + 1) {
+  sim_printf ("%s: frame for a busy slot not counted as a drop\n", dptr->name);
+  ++errors;
+  }
+sim_shmem_atomic_add (&s->busy, -ETH_SHM_PORTS);
+eth_write (dev[1], &send, NULL);
+if (NULL == eth_test_shm_wait (dev[0], 1000)) {
+  sim_printf ("%s: frame stuck behind a busy slot\n", dptr->name);
+  ++errors;
+  }
+else
+  eth_read_consume (dev[0]);
+for (i = 0; i < 4; i++) {
+  if (dev[i] && (dev[i]->eth_api != ETH_API_NONE))
+    eth_close (dev[i]);
+  free (dev[i]);
+  }
+return (errors == 0) ? SCPE_OK : SCPE_IERR;
+}
+
+/* Check the compiled address filter against a straightforward search of
+   the filter addresses, then check that UDP devices (whose filter may be
+   installed in the host) only deliver frames addressed to them. */
+
+static
+t_stat eth_test_filter (DEVICE *dptr)
+{
+int errors = 0;
+ETH_DEV *a = (ETH_DEV *)calloc (1, sizeof (*a));
+ETH_DEV *b = (ETH_DEV *)calloc (1, sizeof (*b));
+ETH_MAC mac_a = {0x08, 0x00, 0x2B, 0x11, 0x22, 0x33};
+ETH_MAC mac_b = {0x08, 0x00, 0x2B, 0x44, 0x55, 0x66};
+ETH_MAC mac_x = {0x08, 0x00, 0x2B, 0x77, 0x88, 0x99};
+ETH_MAC mcast = {0x09, 0x00, 0x2B, 0x00, 0x00, 0x0F};
+ETH_MAC mac;
+ETH_PACK send, *recv;
+uint32 r = 1;
+int i, j, member, got;
+
+a->addr_count = ETH_FILTER_MAX;
+for (i = 0; i < ETH_FILTER_MAX; i++)
+  for (j = 0; j < 6; j++)
+    a->filter_address[i][j] = (uint8)((r = r * 1103515245 + 12345) >> 16);
+eth_copy_mac (a->filter_address[5], a->filter_address[4]);     /* a duplicate */
+_eth_filter_compile (a);
+for (i = 0; i < 2000; i++) {
+  if (i < ETH_FILTER_MAX)
+    eth_copy_mac (mac, a->filter_address[i]);
+  else
+    for (j = 0; j < 6; j++)
+      mac[j] = (uint8)((r = r * 1103515245 + 12345) >> 16);
+  for (j = member = 0; j < ETH_FILTER_MAX; j++)
+    if (0 == eth_mac_cmp (mac, a->filter_address[j]))
+      member = 1;
+  if (member != _eth_filter_match (a, mac)) {
+    eth_mac_fmt (mac, (char *)send.msg);
+    sim_printf ("%s: compiled filter %s %s\n", dptr->name, member ? "missed" : "matched", (char *)send.msg);
+    ++errors;
+    }
+  }
+memset (a, 0, sizeof (*a));
+if ((SCPE_OK != eth_open (a, "udp:65512:localhost:65513", dptr, 0)) ||
+    (SCPE_OK != eth_open (b, "udp:65513:localhost:65512", dptr, 0))) {
+  sim_printf ("%s: Can't open UDP test devices\n", dptr->name);
+  if (a->eth_api != ETH_API_NONE)
+    eth_close (a);
+  free (a);
+  free (b);
+  return (errors == 0) ? SCPE_OK : SCPE_IERR;
+  }
+eth_filter (a, 1, &mac_a, 0, 0);
+eth_filter_hash_ex (b, 1, &mac_b, 0, 0, TRUE, NULL);
+memset (&send, 0, sizeof (send));
+eth_copy_mac (&send.msg[6], mac_a);
+send.msg[12] = 0x60;                                /* DEC Customer Protocol */
+send.msg[13] = 0x06;
+send.len = ETH_MIN_PACKET;
+eth_copy_mac (&send.msg[0], mac_x);                 /* not for b */
+eth_write (a, &send, NULL);
+eth_copy_mac (&send.msg[0], mcast);                 /* not for b */
+eth_write (a, &send, NULL);
+eth_copy_mac (&send.msg[0], mac_b);
+eth_write (a, &send, NULL);
+eth_copy_mac (&send.msg[0], eth_mac_bcast);
+eth_write (a, &send, NULL);
+for (got = 0, r = sim_os_msec (); (got < 2) && ((sim_os_msec () - r) < 2000); ) {
+  if (NULL == (recv = eth_read_peek (b))) {
+    sim_os_ms_sleep (1);
+    continue;
+    }
+  if (eth_mac_cmp (recv->msg, got ? eth_mac_bcast : mac_b)) {
+    sim_printf ("%s: frame received which the filter should have rejected\n", dptr->name);
+    ++errors;
+    }
+  eth_read_consume (b);
+  ++got;
+  }
+if (got != 2) {
+  sim_printf ("%s: only %d of 2 frames passed the filter\n", dptr->name, got);
+  ++errors;
+  }
+if (b->filter_rejected != (b->filter_pushed ? 0 : 2)) {
+  sim_printf ("%s: %d frames rejected by the %s filter\n", dptr->name, b->filter_rejected,
+              b->filter_pushed ? "host" : "simulator");
+  ++errors;
+  }
+eth_close (a);
+eth_close (b);
+free (a);
+free (b);
+return (errors == 0) ? SCPE_OK : SCPE_IERR;
+}
+
 t_stat sim_ether_test (DEVICE *dptr, const char *cptr)
 {
 t_stat stat = SCPE_OK;
@@ -4503,6 +5682,9 @@ sim_printf ("Testing %s device sim_ether APIs\n", dptr->name);
 
 SIM_TEST(eth_test_crc32 (dptr));
 SIM_TEST(eth_test_bpf (dptr));
+SIM_TEST(eth_test_queue (dptr));
+SIM_TEST(eth_test_shm (dptr));
+SIM_TEST(eth_test_filter (dptr));
 return stat;
 }
 #endif /* USE_NETWORK */
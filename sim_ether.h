@@ -158,6 +158,7 @@ extern "C" {
 #define ETH_PROMISC            1                        /* promiscuous mode = true */
 #define ETH_TIMEOUT           -1                        /* read timeout in milliseconds (immediate) */
 #define ETH_FILTER_MAX        20                        /* maximum address filters */
+#define ETH_FILTER_TABLE      64                        /* compiled address filter slots (power of 2) */
 #define ETH_DEV_NAME_MAX     256                        /* maximum device name size */
 #define ETH_DEV_DESC_MAX     256                        /* maximum device description size */
 #define ETH_MIN_PACKET        60                        /* minimum ethernet packet size */
@@ -265,6 +266,7 @@ struct eth_device {
 #define ETH_API_VDE  3                                  /* VDE API in use */
 #define ETH_API_UDP  4                                  /* UDP API in use */
 #define ETH_API_NAT  5                                  /* NAT (SLiRP) API in use */
+#define ETH_API_SHM  6                                  /* Shared memory switch in use */
   ETH_PCALLBACK read_callback;                          /* read callback function */
   ETH_PCALLBACK write_callback;                         /* write callback function */
   ETH_PACK*     read_packet;                            /* read packet */
@@ -274,6 +276,12 @@ struct eth_device {
   ETH_BOOL      all_multicast;                          /* receive all multicast messages */
   ETH_BOOL      hash_filter;                            /* filter using AUTODIN II multicast hash */
   ETH_MULTIHASH hash;                                   /* AUTODIN II multicast hash */
+  uint8         filter_table[ETH_FILTER_TABLE];         /* compiled filter: filter_address index+1 by MAC hash */
+  uint32        filter_seed;                            /* compiled filter: hash seed */
+  ETH_BOOL      filter_all_multicast;                   /* compiled filter: accept every multicast */
+  ETH_BOOL      filter_hash;                            /* compiled filter: multicast hash must be checked */
+  ETH_BOOL      filter_pushed;                          /* compiled filter also installed in host kernel */
+  uint32        filter_rejected;                        /* frames rejected by the filter */
   int32         loopback_self_sent;                     /* loopback packets sent but not seen */
   int32         loopback_self_sent_total;               /* total loopback packets sent */
   int32         loopback_self_rcvd_total;               /* total loopback packets seen */
@@ -321,9 +329,14 @@ struct eth_device {
   pthread_mutex_t     self_lock;
   pthread_cond_t      writer_cond;
   ETH_WRITE_REQUEST *write_requests;
+  ETH_WRITE_REQUEST *write_requests_tail;               /* last pending write request */
+  int write_queue_size;                                 /* pending write requests */
   int write_queue_peak;
   ETH_WRITE_REQUEST *write_buffers;
   t_stat write_status;
+  int           read_peeked;                            /* head of read_queue is held by eth_read_peek */
+#else
+  ETH_PACK*     peek_packet;                            /* packet returned by eth_read_peek */
 #endif
 };
 
@@ -339,6 +352,8 @@ t_stat eth_write  (ETH_DEV* dev, ETH_PACK* packet,      /* write synchronous pac
                    ETH_PCALLBACK routine);              /*  callback when done */
 int eth_read      (ETH_DEV* dev, ETH_PACK* packet,      /* read single packet; */
                    ETH_PCALLBACK routine);              /*  callback when done*/
+ETH_PACK *eth_read_peek (ETH_DEV* dev);                 /* next received packet, left in place */
+void eth_read_consume (ETH_DEV* dev);                   /* release packet from eth_read_peek */
 t_stat eth_filter (ETH_DEV* dev, int addr_count,        /* set filter on incoming packets */
                    const ETH_MAC addresses[],
                    ETH_BOOL all_multicast,
@@ -54,6 +54,7 @@
    sim_byte_swap_data -      swap data elements inplace in buffer
    sim_shmem_open            create or attach to a shared memory region
    sim_shmem_close           close a shared memory region
+   sim_shmem_detach          close a shared memory region leaving it for others
    sim_chdir                 change working directory
    sim_mkdir                 create a directory
    sim_rmdir                 remove a directory
@@ -757,6 +758,11 @@ free (shmem->shm_name);
 free (shmem);
 }
 
+void sim_shmem_detach (SHMEM *shmem)
+{
+sim_shmem_close (shmem);            /* mapping persists while others have it open */
+}
+
 int32 sim_shmem_atomic_add (int32 *p, int32 v)
 {
 return InterlockedExchangeAdd ((volatile long *) p,v) + (v);
@@ -955,6 +961,24 @@ free (shmem);
 #endif
 }
 
+/* Close a shared memory region without removing its name, so that other
+   simulators still using it (and any which attach later) see the same
+   region.  The last user should call sim_shmem_close instead. */
+
+void sim_shmem_detach (SHMEM *shmem)
+{
+#if defined (HAVE_SHM_OPEN)
+if (shmem == NULL)
+    return;
+if (shmem->shm_base != MAP_FAILED)
+    munmap (shmem->shm_base, shmem->shm_size);
+if (shmem->shm_fd != -1)
+    close (shmem->shm_fd);
+free (shmem->shm_name);
+free (shmem);
+#endif
+}
+
 int32 sim_shmem_atomic_add (int32 *p, int32 v)
 {
 #if defined (__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
@@ -989,6 +1013,10 @@ void sim_shmem_close (SHMEM *shmem)
 {
 }
 
+void sim_shmem_detach (SHMEM *shmem)
+{
+}
+
 int32 sim_shmem_atomic_add (int32 *p, int32 v)
 {
 return -1;
@@ -139,11 +139,21 @@ static t_addr sim_tape_tpc_fnd (UNIT *uptr, t_addr *map);
 static void sim_tape_data_trace (UNIT *uptr, const uint8 *data, size_t len, const char* txt, int detail, uint32 reason);
 static t_stat tape_erase_fwd (UNIT *uptr, t_mtrlnt gap_size);
 static t_stat tape_erase_rev (UNIT *uptr, t_mtrlnt gap_size);
+static void _sim_tape_index_free (UNIT *uptr);
+
+struct tape_index_entry {
+    t_addr              start;              /* position of the object's leading metadata */
+    t_addr              end;                /* position just past the object */
+    uint32              tmks;               /* tape marks up to and including this object */
+    };
 
 struct tape_context {
     DEVICE              *dptr;              /* Device for unit (access to debug flags) */
     uint32              dbit;               /* debugging bit for trace */
     uint32              auto_format;        /* Format determined dynamically */
+    struct tape_index_entry *idx;           /* index of known records and tape marks */
+    uint32              idx_count;          /* entries in use */
+    uint32              idx_size;           /* entries allocated */
 #if defined SIM_ASYNCH_IO
     t_bool              asynch_io;          /* Asynchronous Interrupt scheduling enabled */
     int                 asynch_io_latency;  /* instructions to delay pending interrupt */
@@ -1025,6 +1035,7 @@ uptr->tape_eom = 0;
 uptr->pos = 0;
 MT_CLR_PNU (uptr);
 MT_CLR_INMRK (uptr);                                    /* Not within a TAR tapemark */
+_sim_tape_index_free (uptr);
 free (uptr->tape_ctx);
 uptr->tape_ctx = NULL;
 uptr->io_flush = NULL;
@@ -1127,6 +1138,188 @@ if (MT_GET_FMT (uptr) < MTUF_F_ANSI)
 return uptr->tape_eom;                   /* Virtual tape images: record/TM count */
 }
 
+/* Tape object index (internal routines).
+
+   For the container formats which hold their record structure in the image
+   file itself (SIMH, E11, TPC, P7B and AWS) a per-unit in memory index of the
+   records and tape marks is maintained.  The index covers a contiguous prefix
+   of the tape starting at BOT and grows as objects are read or written at its
+   frontier.  The scan performed by sim_tape_validate_tape at attach time
+   therefore leaves a complete index behind.
+
+   Each entry records the position of the leading metadata of an object (the
+   position a reverse read of that object leaves the tape at), the position
+   just past the object (where a forward read leaves it) and the running count
+   of tape marks up to and including the object.  Runs of records between tape
+   marks can then be spaced over with a binary search and a single position
+   change.  Tape marks, the index frontier and any error conditions are still
+   handled by the regular record by record code, so the status and position
+   reported to the caller are unchanged.  Any timing the guest sees remains
+   modeled by the device simulator.
+
+   Writes discard the entries beyond the write position and then extend the
+   index with the object written.
+*/
+
+static t_bool _sim_tape_index_enabled (UNIT *uptr)
+{
+return (uptr->tape_ctx != NULL) && (MT_GET_FMT (uptr) <= MTUF_F_AWS);
+}
+
+static void _sim_tape_index_add (UNIT *uptr, t_addr scan_pos, t_addr start, t_addr end, t_bool tmk)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_index_entry *e;
+t_addr frontier;
+
+if (!_sim_tape_index_enabled (uptr))
+    return;
+frontier = (ctx->idx_count > 0) ? ctx->idx[ctx->idx_count - 1].end : 0;
+if ((scan_pos != frontier) || (end <= frontier))        /* not contiguous with what is known? */
+    return;
+if (ctx->idx_count == ctx->idx_size) {                  /* need more room? */
+    uint32 size = (ctx->idx_size > 0) ? 2 * ctx->idx_size : 256;
+    struct tape_index_entry *idx = (struct tape_index_entry *)realloc (ctx->idx, size * sizeof (*idx));
+
+    if (idx == NULL) {                                  /* can't grow? */
+        free (ctx->idx);                                /* just do without */
+        ctx->idx = NULL;
+        ctx->idx_count = ctx->idx_size = 0;
+        return;
+        }
+    ctx->idx = idx;
+    ctx->idx_size = size;
+    }
+e = &ctx->idx[ctx->idx_count];
+e->start = start;
+e->end = end;
+e->tmks = ((ctx->idx_count > 0) ? ctx->idx[ctx->idx_count - 1].tmks : 0) + (tmk ? 1 : 0);
+++ctx->idx_count;
+}
+
+static void _sim_tape_index_truncate (UNIT *uptr, t_addr pos)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if (ctx == NULL)
+    return;
+while ((ctx->idx_count > 0) && (ctx->idx[ctx->idx_count - 1].end > pos))
+    --ctx->idx_count;
+}
+
+static void _sim_tape_index_free (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if (ctx == NULL)
+    return;
+free (ctx->idx);
+ctx->idx = NULL;
+ctx->idx_count = ctx->idx_size = 0;
+}
+
+/* Locate the entry whose end (or start) is exactly pos, -1 if none */
+
+static int32 _sim_tape_index_find (struct tape_context *ctx, t_addr pos, t_bool by_end)
+{
+int32 lo = 0;
+int32 hi = (int32)ctx->idx_count - 1;
+
+while (lo <= hi) {
+    int32 mid = lo + (hi - lo) / 2;
+    t_addr p = by_end ? ctx->idx[mid].end : ctx->idx[mid].start;
+
+    if (p == pos)
+        return mid;
+    if (p < pos)
+        lo = mid + 1;
+    else
+        hi = mid - 1;
+    }
+return -1;
+}
+
+/* Index of the first entry in [lo, hi) with a tape mark count of at least tmks */
+
+static uint32 _sim_tape_index_lower_bound (struct tape_context *ctx, uint32 lo, uint32 hi, uint32 tmks)
+{
+while (lo < hi) {
+    uint32 mid = lo + (hi - lo) / 2;
+
+    if (ctx->idx[mid].tmks < tmks)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+return lo;
+}
+
+/* Space forward over up to count indexed records, stopping before any tape mark.
+   Returns the number of records spaced over. */
+
+static uint32 _sim_tape_index_sprecsf (UNIT *uptr, uint32 count)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+int32 j;
+uint32 i, k, n, tmks;
+
+if ((count == 0) || !_sim_tape_index_enabled (uptr) || (ctx->idx_count == 0))
+    return 0;
+if (uptr->pos == 0)                                     /* at BOT? */
+    i = 0;
+else {
+    j = _sim_tape_index_find (ctx, uptr->pos, TRUE);    /* just after a known object? */
+    if (j >= 0)
+        i = (uint32)j + 1;
+    else {
+        j = _sim_tape_index_find (ctx, uptr->pos, FALSE);/* at the start of one? */
+        if (j < 0)
+            return 0;
+        i = (uint32)j;
+        }
+    }
+if (i >= ctx->idx_count)                                /* at the frontier? */
+    return 0;
+tmks = (i > 0) ? ctx->idx[i - 1].tmks : 0;
+k = _sim_tape_index_lower_bound (ctx, i, ctx->idx_count, tmks + 1);/* next tape mark */
+n = (count < k - i) ? count : k - i;
+if (n == 0)
+    return 0;
+uptr->pos = ctx->idx[i + n - 1].end;
+MT_CLR_PNU (uptr);
+sim_debug_unit (MTSE_DBG_STR, uptr, "index_sprecsf: skipped: %u, pos: %" T_ADDR_FMT "u\n", n, uptr->pos);
+return n;
+}
+
+/* Space reverse over up to count indexed records, stopping after any tape mark.
+   Returns the number of records spaced over. */
+
+static uint32 _sim_tape_index_sprecsr (UNIT *uptr, uint32 count)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+int32 j;
+uint32 m, n, tmks;
+
+if ((count == 0) || !_sim_tape_index_enabled (uptr) || MT_TST_PNU (uptr))
+    return 0;
+j = _sim_tape_index_find (ctx, uptr->pos, TRUE);        /* just after a known object? */
+if (j < 0)
+    return 0;
+tmks = ctx->idx[j].tmks;
+if (tmks != ((j > 0) ? ctx->idx[j - 1].tmks : 0))       /* preceded by a tape mark? */
+    return 0;
+m = _sim_tape_index_lower_bound (ctx, 0, (uint32)j, tmks);
+if (tmks > 0)                                           /* m is the tape mark */
+    ++m;
+n = (count < (uint32)j + 1 - m) ? count : (uint32)j + 1 - m;
+if (n == 0)
+    return 0;
+uptr->pos = ctx->idx[(uint32)j + 1 - n].start;
+MT_CLR_PNU (uptr);
+sim_debug_unit (MTSE_DBG_STR, uptr, "index_sprecsr: skipped: %u, pos: %" T_ADDR_FMT "u\n", n, uptr->pos);
+return n;
+}
+
 /* Read record length forward (internal routine).
 
    Inputs:
@@ -1229,6 +1422,8 @@ t_awshdr awshdr;
 size_t   rdcnt;
 t_mtrlnt buffer [256];                                  /* local tape buffer */
 t_addr   saved_pos = uptr->pos;
+t_addr   scan_pos = uptr->pos;                          /* starting position */
+t_addr   object_pos = uptr->pos;                        /* position of the object's leading metadata */
 size_t   bufcntr, bufcap;                               /* buffer counter and capacity */
 int32    runaway_counter, sizeof_gap;                   /* bytes remaining before runaway and bytes per gap */
 t_stat   status = MTSE_OK;
@@ -1364,6 +1559,11 @@ switch (f) {                                       /* otherwise the read method
         if (runaway_counter <= 0)                       /* if a tape runaway occurred */
             status = MTSE_RUNAWAY;                      /*   then report it */
 
+        if (status == MTSE_TMK)                         /* locate the object past any gap */
+            object_pos = uptr->pos - sizeof (t_mtrlnt);
+        else if (status == MTSE_OK)
+            object_pos = saved_pos - sizeof (t_mtrlnt);
+
         if (status == MTSE_OK) {        /* Validate the reverse record size for data records */
             t_mtrlnt rev_lnt;
 
@@ -1536,6 +1736,8 @@ switch (f) {                                       /* otherwise the read method
         status = MTSE_FMT;
     }
 
+if ((status == MTSE_OK) || (status == MTSE_TMK))
+    _sim_tape_index_add (uptr, scan_pos, object_pos, uptr->pos, (status == MTSE_TMK));
 return status;
 }
 
@@ -2059,6 +2261,7 @@ t_stat sim_tape_wrrecf (UNIT *uptr, uint8 *buf, t_mtrlnt bc)
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 uint32 f = MT_GET_FMT (uptr);
 t_mtrlnt sbc;
+t_addr start_pos;
 t_stat status = MTSE_OK;
 
 if (ctx == NULL)                                        /* if not properly attached? */
@@ -2076,6 +2279,8 @@ if (sbc == 0)                                           /* nothing to do? */
     return MTSE_OK;
 if (sim_tape_seek (uptr, uptr->pos))                    /* set pos */
     return MTSE_IOERR;
+start_pos = uptr->pos;
+_sim_tape_index_truncate (uptr, start_pos);             /* anything beyond is overwritten */
 switch (f) {                                            /* case on format */
 
     case MTUF_F_STD:                                    /* standard */
@@ -2110,6 +2315,8 @@ switch (f) {                                            /* case on format */
         }
 if (uptr->pos > uptr->tape_eom)
     uptr->tape_eom = uptr->pos;         /* update EOM as needed */
+if (f != MTUF_F_P7B)                    /* P7B marks are only known when read */
+    _sim_tape_index_add (uptr, start_pos, start_pos, uptr->pos, FALSE);
 sim_tape_data_trace(uptr, buf, sbc, "Record Written", (uptr->dctrl | ctx->dptr->dctrl) & MTSE_DBG_DAT, MTSE_DBG_STR);
 return MTSE_OK;
 }
@@ -2198,6 +2405,8 @@ return MTSE_OK;
 t_stat sim_tape_wrtmk (UNIT *uptr)
 {
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+t_addr start_pos = uptr->pos;
+t_stat st;
 
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
@@ -2206,9 +2415,14 @@ if (MT_GET_FMT (uptr) == MTUF_F_P7B) {                  /* P7B? */
     uint8 buf = P7B_EOF;                                /* eof mark */
     return sim_tape_wrrecf (uptr, &buf, 1);             /* write char */
     }
+_sim_tape_index_truncate (uptr, start_pos);             /* anything beyond is overwritten */
 if (MT_GET_FMT (uptr) == MTUF_F_AWS)                    /* AWS? */
-    return sim_tape_aws_wrdata (uptr, NULL, 0);
-return sim_tape_wrdata (uptr, MTR_TMK);
+    st = sim_tape_aws_wrdata (uptr, NULL, 0);
+else
+    st = sim_tape_wrdata (uptr, MTR_TMK);
+if (st == MTSE_OK)
+    _sim_tape_index_add (uptr, start_pos, start_pos, uptr->pos, TRUE);
+return st;
 }
 
 t_stat sim_tape_wrtmk_a (UNIT *uptr, TAPE_PCALLBACK callback)
@@ -2234,6 +2448,7 @@ if (sim_tape_wrp (uptr))                                /* write prot? */
     return MTSE_WRP;
 if (MT_GET_FMT (uptr) == MTUF_F_P7B)                    /* cant do P7B */
     return MTSE_FMT;
+_sim_tape_index_truncate (uptr, uptr->pos);             /* nothing remains beyond */
 if (MT_GET_FMT (uptr) == MTUF_F_AWS) {
     sim_set_fsize (uptr->fileref, uptr->pos);
     result = MTSE_OK;
@@ -2429,6 +2644,8 @@ else if (sim_tape_wrp (uptr))                           /* otherwise if the unit
 else if (gap_size == 0 || format != MTUF_F_STD)         /* otherwise if zero length or gaps aren't supported */
     return MTSE_OK;                                     /*   then take no action */
 
+_sim_tape_index_truncate (uptr, gap_pos);               /* objects beyond the gap start are rewritten */
+
 file_size = sim_fsize (uptr->fileref);                  /* get the file size */
 
 if (sim_tape_seek (uptr, uptr->pos)) {                  /* position the tape; if it fails */
@@ -2631,6 +2848,8 @@ else if ((gap_size == 0) || (format != MTUF_F_STD))     /* otherwise if the gap
 
 gap_pos = uptr->pos;                                    /* save the starting position */
 
+_sim_tape_index_truncate (uptr, 0);                     /* preceding objects may be rewritten */
+
 if (gap_size == meta_size) {                            /* if the request is for a single metadatum */
     if (sim_tape_bot (uptr))                            /*   then if the unit is positioned at the BOT */
         return MTSE_BOT;                                /*     then erasing backward is not possible */
@@ -2871,6 +3090,9 @@ if (ctx == NULL)                                        /* if not properly attac
 sim_debug_unit (ctx->dbit, uptr, "sim_tape_sprecsf(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
 
 while (*skipped < count) {                              /* loop */
+    *skipped += _sim_tape_index_sprecsf (uptr, count - *skipped);/* skip what is already known */
+    if (*skipped == count)
+        break;
     st = sim_tape_sprecf (uptr, &tbc);                  /* spc rec */
     if (st != MTSE_OK)
         return st;
@@ -2968,6 +3190,9 @@ if (ctx == NULL)                                        /* if not properly attac
 sim_debug_unit (ctx->dbit, uptr, "sim_tape_sprecsr(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
 
 while (*skipped < count) {                              /* loop */
+    *skipped += _sim_tape_index_sprecsr (uptr, count - *skipped);/* skip what is already known */
+    if (*skipped == count)
+        break;
     st = sim_tape_sprecr (uptr, &tbc);                  /* spc rec rev */
     if (st != MTSE_OK)
         return st;
@@ -4145,6 +4370,71 @@ sim_switches = saved_switches;
 return stat;
 }
 
+/* Verify that indexed spacing matches record by record spacing */
+
+#define TAPE_INDEX_TEST_FILES 16
+
+typedef struct {
+    t_stat  st;
+    uint32  recs;
+    t_addr  pos;
+    } TAPE_SPACE_RESULT;
+
+static uint32 sim_tape_test_index_pass (UNIT *uptr, t_bool reverse, t_bool by_record, TAPE_SPACE_RESULT *res)
+{
+uint32 n;
+t_mtrlnt bc;
+
+for (n = 0; n < TAPE_INDEX_TEST_FILES; ) {
+    if (by_record) {
+        res[n].recs = 0;
+        while (MTSE_OK == (res[n].st = (reverse ? sim_tape_sprecr (uptr, &bc) : sim_tape_sprecf (uptr, &bc))))
+            ++res[n].recs;
+        }
+    else
+        res[n].st = (reverse ? sim_tape_sprecsr : sim_tape_sprecsf) (uptr, 0xFFFFFF, &res[n].recs);
+    res[n].pos = uptr->pos;
+    if (res[n++].st != MTSE_TMK)
+        break;
+    }
+return n;
+}
+
+static t_stat sim_tape_test_index (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+TAPE_SPACE_RESULT fast[TAPE_INDEX_TEST_FILES], slow[TAPE_INDEX_TEST_FILES];
+uint32 nfast, nslow, i, pnu;
+t_addr start_pos;
+t_bool reverse;
+
+if (!_sim_tape_index_enabled (uptr))
+    return SCPE_OK;
+if (ctx->idx_count == 0)
+    return sim_messagef (SCPE_IERR, "%s: No tape index was built for '%s'\n", sim_uname (uptr), uptr->filename);
+sim_tape_rewind (uptr);
+for (reverse = FALSE; reverse <= TRUE; reverse++) {
+    start_pos = uptr->pos;
+    pnu = MT_TST_PNU (uptr);
+    nfast = sim_tape_test_index_pass (uptr, reverse, FALSE, fast);
+    uptr->pos = start_pos;
+    if (pnu)
+        MT_SET_PNU (uptr);
+    else
+        MT_CLR_PNU (uptr);
+    nslow = sim_tape_test_index_pass (uptr, reverse, TRUE, slow);
+    for (i = 0; i < nslow; i++) {
+        if ((nfast != nslow) || (fast[i].st != slow[i].st) || (fast[i].recs != slow[i].recs) || (fast[i].pos != slow[i].pos))
+            return sim_messagef (SCPE_IERR, "%s: Indexed %s spacing of '%s' differs at file %u: %s, %u records, pos %" T_ADDR_FMT "u vs %s, %u records, pos %" T_ADDR_FMT "u\n",
+                                            sim_uname (uptr), reverse ? "reverse" : "forward", uptr->filename, i,
+                                            sim_tape_error_text (fast[i].st), fast[i].recs, fast[i].pos,
+                                            sim_tape_error_text (slow[i].st), slow[i].recs, slow[i].pos);
+        }
+    }
+sim_tape_rewind (uptr);
+return SCPE_OK;
+}
+
 static t_stat sim_tape_test_process_tape_file (UNIT *uptr, const char *filename, const char *format, t_awslnt recsize)
 {
 char args[256];
@@ -4164,8 +4454,11 @@ sim_switches |= SWMASK ('F') | SWMASK ('L');    /* specific-format and detailed
 stat = sim_tape_attach_ex (uptr, args, 0, 0);
 if (stat != SCPE_OK)
     return stat;
+stat = sim_tape_test_index (uptr);
 sim_tape_detach (uptr);
 sim_switches = 0;
+if (stat != SCPE_OK)
+    return stat;
 return SCPE_OK;
 }
 
@@ -72,9 +72,14 @@
    sim_os_msec  -           return elapsed time in msec
    sim_os_sleep -           sleep specified number of seconds
    sim_os_ms_sleep -        sleep specified number of milliseconds
+   sim_os_nsec -            return elapsed time in nsec
+   sim_os_ns_sleep -        sleep specified number of nanoseconds
    sim_idle_ms_sleep -      sleep specified number of milliseconds
                             or until awakened by an asynchronous
                             event
+   sim_idle_ns_sleep -      sleep specified number of nanoseconds
+                            or until awakened by an asynchronous
+                            event
    sim_timespec_diff        subtract two timespec values
    sim_timer_activate_after schedule unit for specific time
    sim_timer_activate_time  determine activation time
@@ -107,6 +112,7 @@
 #endif
 
 uint32 sim_idle_ms_sleep (unsigned int msec);
+t_uint64 sim_idle_ns_sleep (t_uint64 nsec);
 
 /* MS_MIN_GRANULARITY exists here so that timing behavior for hosts systems  */
 /* with slow clock ticks can be assessed and tested without actually having  */
@@ -116,6 +122,7 @@ uint32 sim_idle_ms_sleep (unsigned int msec);
 
 #if defined(MS_MIN_GRANULARITY) && (MS_MIN_GRANULARITY != 1)
 uint32 real_sim_idle_ms_sleep (unsigned int msec);
+t_uint64 real_sim_idle_ns_sleep (t_uint64 nsec);
 uint32 real_sim_os_msec (void);
 uint32 real_sim_os_ms_sleep (unsigned int msec);
 static uint32 real_sim_os_sleep_min_ms = 0;
@@ -141,6 +148,11 @@ else
 return (sim_os_msec () - start);
 }
 
+t_uint64 sim_idle_ns_sleep (t_uint64 nsec)
+{
+return ((t_uint64)sim_idle_ms_sleep ((unsigned int)((nsec + 999999) / 1000000))) * 1000000;
+}
+
 uint32 sim_os_msec (void)
 {
 return (real_sim_os_msec ()/MS_MIN_GRANULARITY)*MS_MIN_GRANULARITY;
@@ -168,8 +180,10 @@ static uint32 sim_stop_time = 0;                    /* time when sim_stop_timer_
 double sim_time_at_sim_prompt =  0;                 /* time spent processing commands from sim> prompt */
 
 static uint32 sim_idle_rate_ms = 0;                 /* Minimum Sleep time */
+static uint32 sim_idle_rate_ns = 0;                 /* Minimum Sleep time (nsec) */
 static uint32 sim_os_sleep_min_ms = 0;
 static uint32 sim_os_sleep_inc_ms = 0;
+static uint32 sim_os_sleep_min_ns = 0;
 static uint32 sim_os_clock_resoluton_ms = 0;
 static uint32 sim_os_tick_hz = 0;
 static uint32 sim_idle_stable = SIM_IDLE_STDFLT;
@@ -188,6 +202,7 @@ static double sim_throt_inst_start;
 static uint32 sim_throt_sleep_time = 0;
 static int32 sim_throt_wait = 0;
 static uint32 sim_throt_delay = 3;
+static t_bool sim_throt_suspended = FALSE;
 #define CLK_TPS 100
 #define CLK_INIT (sim_precalibrate_ips/CLK_TPS)
 static int32 sim_int_clk_tps;
@@ -227,6 +242,7 @@ typedef struct RTC {
     t_bool clock_catchup_pending;   /* clock tick catchup pending */
     t_bool clock_catchup_eligible;  /* clock tick catchup eligible */
     uint32 clock_time_idled;        /* total time idled */
+    t_uint64 clock_time_idled_ns;   /* total time idled (nsec) */
     uint32 clock_time_idled_last;   /* total time idled as of the previous second */
     uint32 clock_calib_skip_idle;   /* Calibrations skipped due to idling */
     uint32 clock_calib_gap2big;     /* Calibrations skipped Gap Too Big */
@@ -252,10 +268,12 @@ UNIT * volatile sim_wallclock_entry = NULL;
 #endif
 
 #define sleep1Samples       100
+#define sleepNsProbe        50000           /* shortest sleep to try (50 usecs) */
 
 static uint32 _compute_minimum_sleep (void)
 {
 uint32 i, tot, tim;
+t_uint64 ntot;
 
 sim_os_set_thread_priority (PRIORITY_ABOVE_NORMAL);
 #if defined(MS_MIN_GRANULARITY) && (MS_MIN_GRANULARITY != 1)
@@ -280,6 +298,12 @@ for (i = 0, tot = 0; i < sleep1Samples; i++)
     tot += sim_idle_ms_sleep (sim_os_sleep_min_ms + 1);
 tim = tot / sleep1Samples;          /* Truncated average */
 sim_os_sleep_inc_ms = tim - sim_os_sleep_min_ms;
+/* Hosts with high resolution timers can sleep for much less than 1ms */
+sim_idle_ns_sleep (sleepNsProbe);
+for (i = 0, ntot = 0; i < sleep1Samples; i++)
+    ntot += sim_idle_ns_sleep (sleepNsProbe);
+ntot = ntot / sleep1Samples;
+sim_os_sleep_min_ns = (ntot < 1000000000) ? (uint32)ntot : 1000000000;
 sim_os_set_thread_priority (PRIORITY_NORMAL);
 return sim_os_sleep_min_ms;
 }
@@ -287,22 +311,26 @@ return sim_os_sleep_min_ms;
 #if defined(MS_MIN_GRANULARITY) && (MS_MIN_GRANULARITY != 1)
 
 #define sim_idle_ms_sleep   real_sim_idle_ms_sleep
+#define sim_idle_ns_sleep   real_sim_idle_ns_sleep
 #define sim_os_msec         real_sim_os_msec
 #define sim_os_ms_sleep     real_sim_os_ms_sleep
 
 #endif /* defined(MS_MIN_GRANULARITY) && (MS_MIN_GRANULARITY != 1) */
 
 #if defined(SIM_ASYNCH_IO)
-uint32 sim_idle_ms_sleep (unsigned int msec)
+/* Idle waits must be ended by asynchronous I/O completions, so they wait
+   on the condition variable those completions signal.  Its timeout is an
+   absolute time with nanosecond resolution. */
+
+t_uint64 sim_idle_ns_sleep (t_uint64 nsec)
 {
 struct timespec start_time, end_time, done_time, delta_time;
-uint32 delta_ms;
 t_bool timedout = FALSE;
 
 clock_gettime(CLOCK_REALTIME, &start_time);
 end_time = start_time;
-end_time.tv_sec += (msec/1000);
-end_time.tv_nsec += 1000000*(msec%1000);
+end_time.tv_sec += (time_t)(nsec/1000000000);
+end_time.tv_nsec += (long)(nsec%1000000000);
 if (end_time.tv_nsec >= 1000000000) {
   end_time.tv_sec += end_time.tv_nsec/1000000000;
   end_time.tv_nsec = end_time.tv_nsec%1000000000;
@@ -320,10 +348,53 @@ if (!timedout) {
     AIO_UPDATE_QUEUE;
     }
 sim_timespec_diff (&delta_time, &done_time, &start_time);
-delta_ms = (uint32)((delta_time.tv_sec * 1000) + ((delta_time.tv_nsec + 500000) / 1000000));
-return delta_ms;
+return (((t_uint64)delta_time.tv_sec) * 1000000000) + (t_uint64)delta_time.tv_nsec;
+}
+
+uint32 sim_idle_ms_sleep (unsigned int msec)
+{
+return (uint32)((sim_idle_ns_sleep (((t_uint64)msec) * 1000000) + 500000) / 1000000);
 }
 #else
+#if defined(__linux) || defined(__linux__)
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/* Without asynchronous I/O nothing can end an idle wait early, so on
+   Linux it is a read of a one shot timerfd, which the kernel expires
+   with its high resolution timers. */
+
+static int sim_idle_timerfd = -2;                   /* -2 not yet created, -1 unavailable */
+
+t_uint64 sim_idle_ns_sleep (t_uint64 nsec)
+{
+t_uint64 start = sim_os_nsec ();
+struct itimerspec its;
+uint64_t expirations;
+
+if (sim_idle_timerfd == -2)
+    sim_idle_timerfd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+if (sim_idle_timerfd < 0)
+    return sim_os_ns_sleep (nsec);
+memset (&its, 0, sizeof (its));
+its.it_value.tv_sec = (time_t)(nsec / 1000000000);
+its.it_value.tv_nsec = (long)(nsec % 1000000000);
+if ((its.it_value.tv_sec == 0) && (its.it_value.tv_nsec == 0))
+    its.it_value.tv_nsec = 1;                       /* zero would disarm the timer */
+if ((timerfd_settime (sim_idle_timerfd, 0, &its, NULL) != 0) ||
+    (read (sim_idle_timerfd, &expirations, sizeof (expirations)) < 0)) {
+    if (errno != EINTR)                             /* not just interrupted? */
+        return sim_os_ns_sleep (nsec);
+    }
+return sim_os_nsec () - start;
+}
+#else
+t_uint64 sim_idle_ns_sleep (t_uint64 nsec)
+{
+return sim_os_ns_sleep (nsec);
+}
+#endif
+
 uint32 sim_idle_ms_sleep (unsigned int msec)
 {
 return sim_os_ms_sleep (msec);
@@ -453,6 +524,28 @@ sys$waitfr (2);
 return sim_os_msec () - stime;
 }
 
+t_uint64 sim_os_nsec (void)
+{
+uint32 tod[2];
+
+sys$gettim (tod);                                       /* time 0.1usec */
+return ((((t_uint64)tod[1]) << 32) | tod[0]) * 100;
+}
+
+t_uint64 sim_os_ns_sleep (t_uint64 nsec)
+{
+t_uint64 stime = sim_os_nsec ();
+uint32 qtime[2];
+t_uint64 delta = (nsec + 99) / 100;                     /* 0.1usec units */
+
+delta = ~delta + 1;                                     /* negative is relative */
+qtime[0] = (uint32)delta;
+qtime[1] = (uint32)(delta >> 32);
+sys$setimr (2, qtime, 0, 0);
+sys$waitfr (2);
+return sim_os_nsec () - stime;
+}
+
 #ifdef NEED_CLOCK_GETTIME
 int clock_gettime(int clk_id, struct timespec *tp)
 {
@@ -524,6 +617,26 @@ Sleep (msec);
 return sim_os_msec () - stime;
 }
 
+t_uint64 sim_os_nsec (void)
+{
+static LARGE_INTEGER freq;
+LARGE_INTEGER now;
+
+if (freq.QuadPart == 0)
+    QueryPerformanceFrequency (&freq);
+QueryPerformanceCounter (&now);
+return (t_uint64)((now.QuadPart / freq.QuadPart) * 1000000000) +
+       (t_uint64)(((now.QuadPart % freq.QuadPart) * 1000000000) / freq.QuadPart);
+}
+
+t_uint64 sim_os_ns_sleep (t_uint64 nsec)
+{
+t_uint64 stime = sim_os_nsec ();
+
+Sleep ((DWORD)((nsec + 999999) / 1000000));             /* Sleep only has ms resolution */
+return sim_os_nsec () - stime;
+}
+
 #if defined(NEED_CLOCK_GETTIME)
 int clock_gettime(int clk_id, struct timespec *tp)
 {
@@ -549,6 +662,7 @@ return 0;
 #include <sys/time.h>
 #include <unistd.h>
 #define NANOS_PER_MILLI     1000000
+#define NANOS_PER_SEC       1000000000
 #define MILLIS_PER_SEC      1000
 
 const t_bool rtc_avail = TRUE;
@@ -603,6 +717,32 @@ treq.tv_nsec = (milliseconds % MILLIS_PER_SEC) * NANOS_PER_MILLI;
 return sim_os_msec () - stime;
 }
 
+t_uint64 sim_os_nsec (void)
+{
+#if defined(CLOCK_MONOTONIC)
+struct timespec now;
+
+clock_gettime (CLOCK_MONOTONIC, &now);
+return (((t_uint64)now.tv_sec) * NANOS_PER_SEC) + (t_uint64)now.tv_nsec;
+#else
+struct timeval cur;
+
+gettimeofday (&cur, NULL);
+return (((t_uint64)cur.tv_sec) * NANOS_PER_SEC) + (((t_uint64)cur.tv_usec) * 1000);
+#endif
+}
+
+t_uint64 sim_os_ns_sleep (t_uint64 nsec)
+{
+t_uint64 stime = sim_os_nsec ();
+struct timespec treq;
+
+treq.tv_sec = (time_t)(nsec / NANOS_PER_SEC);
+treq.tv_nsec = (long)(nsec % NANOS_PER_SEC);
+(void) nanosleep (&treq, NULL);
+return sim_os_nsec () - stime;
+}
+
 #if defined(NEED_THREAD_PRIORITY)
 #undef NEED_THREAD_PRIORITY
 #include <sys/time.h>
@@ -972,8 +1112,8 @@ if (tmr != SIM_NTIMERS) {
 new_gtime = sim_gtime();
 if ((last_idle_pct == 0) && (delta_rtime != 0)) {
     sim_idle_cyc_ms = (uint32)((new_gtime - rtc->gtime) / delta_rtime);
-    if ((sim_idle_rate_ms != 0) && (delta_rtime > 1))
-        sim_idle_cyc_sleep = (uint32)((new_gtime - rtc->gtime) / (delta_rtime / sim_idle_rate_ms));
+    if ((sim_idle_rate_ns != 0) && (delta_rtime > 1))
+        sim_idle_cyc_sleep = (uint32)(((new_gtime - rtc->gtime) * (sim_idle_rate_ns / 1000000.0)) / delta_rtime);
     }
 if (sim_asynch_timer || (catchup_ticks_curr > 0)) {
     /* An asynchronous clock or when catchup ticks have  */
@@ -1071,6 +1211,11 @@ sim_throttle_unit.action = &sim_throt_svc;
 sim_register_clock_unit_tmr (&SIM_INTERNAL_UNIT, SIM_INTERNAL_CLK);
 sim_idle_enab = FALSE;                                  /* init idle off */
 sim_idle_rate_ms = sim_os_ms_sleep_init ();             /* get OS timer rate */
+sim_idle_rate_ns = sim_idle_rate_ms * 1000000;
+if ((sim_idle_rate_ms != 0) &&                          /* sub millisecond sleeps work? */
+    (sim_os_sleep_min_ns != 0) &&
+    (sim_os_sleep_min_ns < sim_idle_rate_ns))
+    sim_idle_rate_ns = sim_os_sleep_min_ns;             /* then idle in those */
 sim_set_rom_delay_factor (sim_get_rom_delay_factor ()); /* initialize ROM delay factor */
 
 sim_stop_time = clock_last = clock_start = sim_os_msec ();
@@ -1119,6 +1264,8 @@ fprintf (st, "Minimum Host Sleep Time:        %d ms (%dHz)\n", sim_os_sleep_min_
 if (sim_os_sleep_min_ms != sim_os_sleep_inc_ms)
     fprintf (st, "Minimum Host Sleep Incr Time:   %d ms\n", sim_os_sleep_inc_ms);
 fprintf (st, "Host Clock Resolution:          %d ms\n", sim_os_clock_resoluton_ms);
+if (sim_idle_rate_ns < sim_idle_rate_ms * 1000000)
+    fprintf (st, "Minimum Idle Sleep Time:        %.1f usecs\n", sim_idle_rate_ns / 1000.0);
 fprintf (st, "Execution Rate:                 %s %s/sec\n", sim_fmt_numeric (inst_per_sec), sim_vm_interval_units);
 if (sim_idle_enab) {
     fprintf (st, "Idling:                         Enabled\n");
@@ -1309,6 +1456,7 @@ return SCPE_OK;
 REG sim_timer_reg[] = {
     { DRDATAD (IDLE_CYC_MS,      sim_idle_cyc_ms,        32, "Cycles Per Millisecond"), PV_RSPC|REG_RO},
     { DRDATAD (IDLE_CYC_SLEEP,   sim_idle_cyc_sleep,     32, "Cycles Per Minimum Sleep"), PV_RSPC|REG_RO},
+    { DRDATAD (IDLE_RATE_NS,     sim_idle_rate_ns,       32, "Minimum Idle Sleep (nsecs)"), PV_RSPC|REG_RO},
     { DRDATAD (IDLE_STABLE,      sim_idle_stable,        32, "IDLE stability delay"), PV_RSPC},
     { DRDATAD (ROM_DELAY,        sim_rom_delay,          32, "ROM memory reference delay"), PV_RSPC|REG_RO},
     { DRDATAD (TICK_RATE_0,      rtcs[0].hz,             32, "Timer 0 Ticks Per Second") },
@@ -1536,15 +1684,19 @@ return SCPE_OK;
 
    Must solve the linear equation
 
-        ms_to_wait = w * ms_per_wait
+        ns_to_wait = w * ns_per_wait
 
    Or
-        w = ms_to_wait / ms_per_wait
+        w = ns_to_wait / ns_per_wait
+
+   Times are kept in nanoseconds so that hosts which can sleep for less
+   than a millisecond idle in correspondingly smaller steps.
 */
 
 t_bool sim_idle (uint32 tmr, int sin_cyc)
 {
-uint32 w_ms, w_idle, act_ms;
+uint32 w_idle;
+t_uint64 w_ns, act_ns;
 int32 act_cyc;
 static t_bool in_nowait = FALSE;
 double cyc_since_idle;
@@ -1602,15 +1754,15 @@ if ((!sim_idle_enab)                             ||     /* idling disabled */
 sim_debug (DBG_TRC, &sim_timer_dev, "sim_idle(tmr=%d, sin_cyc=%d)\n", tmr, sin_cyc);
 if (sim_idle_cyc_ms == 0) {
     sim_idle_cyc_ms = (rtc->currd * rtc->hz) / 1000;/* cycles per msec */
-    if (sim_idle_rate_ms != 0)
-        sim_idle_cyc_sleep = (rtc->currd * rtc->hz) / (1000 / sim_idle_rate_ms);/* cycles per minimum sleep */
+    if (sim_idle_rate_ns != 0)                      /* cycles per minimum sleep */
+        sim_idle_cyc_sleep = (uint32)((((double)rtc->currd) * rtc->hz * sim_idle_rate_ns) / 1000000000.0);
     }
-if ((sim_idle_rate_ms == 0) || (sim_idle_cyc_ms == 0)) {/* not possible? */
+if ((sim_idle_rate_ns == 0) || (sim_idle_cyc_ms == 0)) {/* not possible? */
     sim_interval -= sin_cyc;
-    sim_debug (DBG_IDL, &sim_timer_dev, "not possible idle_rate_ms=%d - cyc/ms=%d\n", sim_idle_rate_ms, sim_idle_cyc_ms);
+    sim_debug (DBG_IDL, &sim_timer_dev, "not possible idle_rate_ns=%u - cyc/ms=%d\n", sim_idle_rate_ns, sim_idle_cyc_ms);
     return FALSE;
     }
-w_ms = (uint32) sim_interval / sim_idle_cyc_ms;         /* ms to wait */
+w_ns = (((t_uint64)(uint32)sim_interval) * 1000000) / sim_idle_cyc_ms;/* ns to wait */
 /* When the host system has a clock tick which is less frequent than the    */
 /* simulated system's clock, idling will cause delays which will miss       */
 /* simulated clock ticks.  To accomodate this, and still allow idling, if   */
@@ -1619,25 +1771,26 @@ w_ms = (uint32) sim_interval / sim_idle_cyc_ms;         /* ms to wait */
 if (rtc->clock_catchup_eligible)
     w_idle = (sim_interval * 1000) / rtc->currd;        /* 1000 * pending fraction of tick */
 else
-    w_idle = (w_ms * 1000) / sim_idle_rate_ms;          /* 1000 * intervals to wait */
-if ((w_idle < 500) || (w_ms == 0)) {                    /* shorter than 1/2 the interval or */
+    w_idle = (uint32)((w_ns * 1000) / sim_idle_rate_ns);/* 1000 * intervals to wait */
+if ((w_idle < 500) || (w_ns < sim_idle_rate_ns)) {      /* shorter than 1/2 the interval or */
     sim_interval -= sin_cyc;                            /* minimal sleep time? */
     if (!in_nowait)
         sim_debug (DBG_IDL, &sim_timer_dev, "no wait, too short: %d usecs\n", w_idle);
     in_nowait = TRUE;
     return FALSE;
     }
-if (w_ms > 1000)                                        /* too long a wait (runaway calibration) */
-    sim_debug (DBG_TIK, &sim_timer_dev, "waiting too long: w_ms=%d usecs, w_idle=%d usecs, sim_interval=%d, rtc->currd=%d\n", w_ms, w_idle, sim_interval, rtc->currd);
+if (w_ns > 1000000000)                                  /* too long a wait (runaway calibration) */
+    sim_debug (DBG_TIK, &sim_timer_dev, "waiting too long: w_ns=%.0f nsecs, w_idle=%d usecs, sim_interval=%d, rtc->currd=%d\n", (double)w_ns, w_idle, sim_interval, rtc->currd);
 in_nowait = FALSE;
 if (sim_clock_queue == QUEUE_LIST_END)
-    sim_debug (DBG_IDL, &sim_timer_dev, "sleeping for %d ms - pending event in %d %s\n", w_ms, sim_interval, sim_vm_interval_units);
+    sim_debug (DBG_IDL, &sim_timer_dev, "sleeping for %.0f usecs - pending event in %d %s\n", w_ns / 1000.0, sim_interval, sim_vm_interval_units);
 else
-    sim_debug (DBG_IDL, &sim_timer_dev, "sleeping for %d ms - pending event on %s in %d %s\n", w_ms, sim_uname(sim_clock_queue), sim_interval, sim_vm_interval_units);
+    sim_debug (DBG_IDL, &sim_timer_dev, "sleeping for %.0f usecs - pending event on %s in %d %s\n", w_ns / 1000.0, sim_uname(sim_clock_queue), sim_interval, sim_vm_interval_units);
 cyc_since_idle = sim_gtime() - sim_idle_end_time;       /* time since prior idle */
-act_ms = sim_idle_ms_sleep (w_ms);                      /* wait */
-rtc->clock_time_idled += act_ms;
-act_cyc = act_ms * sim_idle_cyc_ms;
+act_ns = sim_idle_ns_sleep (w_ns);                      /* wait */
+rtc->clock_time_idled_ns += act_ns;
+rtc->clock_time_idled = (uint32)(rtc->clock_time_idled_ns / 1000000);
+act_cyc = (int32)((act_ns * sim_idle_cyc_ms) / 1000000);
 if (cyc_since_idle > sim_idle_cyc_sleep)
     act_cyc -= sim_idle_cyc_sleep / 2;                  /* account for half an interval's worth of cycles */
 else
@@ -1645,9 +1798,9 @@ else
 sim_interval = sim_interval - act_cyc;                  /* count down sim_interval to reflect idle period */
 sim_idle_end_time = sim_gtime();                        /* save idle completed time */
 if (sim_clock_queue == QUEUE_LIST_END)
-    sim_debug (DBG_IDL, &sim_timer_dev, "slept for %d ms - pending event in %d %s\n", act_ms, sim_interval, sim_vm_interval_units);
+    sim_debug (DBG_IDL, &sim_timer_dev, "slept for %.0f usecs - pending event in %d %s\n", act_ns / 1000.0, sim_interval, sim_vm_interval_units);
 else
-    sim_debug (DBG_IDL, &sim_timer_dev, "slept for %d ms - pending event on %s in %d %s\n", act_ms, sim_uname(sim_clock_queue), sim_interval, sim_vm_interval_units);
+    sim_debug (DBG_IDL, &sim_timer_dev, "slept for %.0f usecs - pending event on %s in %d %s\n", act_ns / 1000.0, sim_uname(sim_clock_queue), sim_interval, sim_vm_interval_units);
 return TRUE;
 }
 
@@ -1809,7 +1962,7 @@ return SCPE_OK;
 
 void sim_throt_sched (void)
 {
-if (sim_throt_type != SIM_THROT_NONE) {
+if ((sim_throt_type != SIM_THROT_NONE) && (!sim_throt_suspended)) {
     if (sim_throt_state == SIM_THROT_STATE_THROTTLE) {  /* Previously calibrated? */
         /* Reset recalibration reference times */
         sim_throt_ms_start = sim_os_msec ();
@@ -1830,6 +1983,13 @@ void sim_throt_cancel (void)
 sim_cancel (&sim_throttle_unit);
 }
 
+/* Suspend or resume throttling without changing the throttle settings */
+
+void sim_throt_suspend (t_bool suspend)
+{
+sim_throt_suspended = suspend;
+}
+
 /* Throttle service
 
    Throttle service has three distinct states used while dynamically
@@ -2343,7 +2503,7 @@ while (sim_asynch_timer && sim_is_running) {
         /* due time adjusted by 1/2 a minimal sleep interval */
         /* the goal being to let the last fractional part of the due time */
         /* be done by counting instructions */
-        _double_to_timespec (&due_time, sim_wallclock_queue->a_due_time-(((double)sim_idle_rate_ms)*0.0005));
+        _double_to_timespec (&due_time, sim_wallclock_queue->a_due_time-(((double)sim_idle_rate_ns)*0.0000000005));
         }
     else {
         due_time.tv_sec = 0x7FFFFFFF;                   /* Sometime when 32 bit time_t wraps */
@@ -2806,7 +2966,7 @@ if (inst_delay_d > (double)0x7fffffff)
 inst_delay = (int32)inst_delay_d;
 #if defined(SIM_ASYNCH_CLOCKS)
 if ((sim_asynch_timer) &&
-    (usec_delay > sim_idle_rate_ms*1000.0)) {
+    (usec_delay > sim_idle_rate_ns/1000.0)) {
     double d_now = sim_timenow_double ();
     UNIT *cptr, *prvptr;
 
@@ -344,6 +344,11 @@
 #include <ctype.h>
 #include <math.h>
 
+#if defined(__linux__) && !defined(TMXR_NO_EPOLL)
+#include <sys/epoll.h>
+#define TMXR_EPOLL 1
+#endif
+
 /* Telnet protocol constants - negatives are for init'ing signed char data */
 
 /* Commands */
@@ -488,6 +493,8 @@ static int  tmxr_framer_read (TMLN *line, char *buf, int nbytes);
 static int  tmxr_framer_write (TMLN *line, const char *buf, int32 length);
 
 static void tmxr_add_to_open_list (TMXR* mux);
+static void tmxr_rxpoll_add (TMLN *lp);
+static void tmxr_rxpoll_remove (TMLN *lp);
 
 /* Initialize the line state.
 
@@ -790,25 +797,6 @@ return written;
 }
 
 
-/* Remove a character from the read buffer.
-
-   The character at position "p" in the read buffer associated with line "lp" is
-   removed by moving all of the following received characters down one position.
-   The receive break status array is adjusted accordingly.
-*/
-
-static void tmxr_rmvrc (TMLN *lp, int32 p)
-{
-for ( ; p < lp->rxbpi; p++) {                           /* work from "p" through end of buffer */
-    lp->rxb[p] = lp->rxb[p + 1];                        /* slide following character down */
-    lp->rbr[p] = lp->rbr[p + 1];                        /* adjust break status too */
-    }
-
-lp->rbr[p] = 0;                                         /* clear potential break from vacated slot */
-lp->rxbpi = lp->rxbpi - 1;                              /* drop buffer insert index */
-}
-
-
 /* Find a line descriptor indicated by unit or number.
 
    If "uptr" is NULL, then the line descriptor is determined by the line number
@@ -1227,6 +1215,7 @@ if (mp->master) {
                 lp = mp->ldsc + i;                          /* get line desc */
                 lp->conn = TRUE;                            /* record connection */
                 lp->sock = newsock;                         /* save socket */
+                tmxr_rxpoll_add (lp);                       /* watch for input */
                 lp->ipad = address;                         /* ip address */
                 tmxr_init_line (lp);                        /* init line */
                 lp->notelnet = mp->notelnet;                /* apply mux default telnet setting */
@@ -1295,6 +1284,7 @@ for (i = 0; i < mp->lines; i++) {                       /* check each line in se
                             lp->conn = TRUE;                    /* record connection */
                             lp->sock = lp->connecting;          /* it now looks normal */
                             lp->connecting = 0;
+                            tmxr_rxpoll_add (lp);               /* watch for input */
                             lp->ipad = (char *)realloc (lp->ipad, 1+strlen (lp->destination));
                             strcpy (lp->ipad, lp->destination);
                             lp->cnms = sim_os_msec ();
@@ -1364,6 +1354,7 @@ for (i = 0; i < mp->lines; i++) {                       /* check each line in se
                             if ((!lp->modem_control) || (lp->modembits & TMXR_MDM_DTR)) {
                                 lp->conn = TRUE;                    /* record connection */
                                 lp->sock = newsock;                 /* save socket */
+                                tmxr_rxpoll_add (lp);               /* watch for input */
                                 lp->ipad = address;                 /* ip address */
                                 tmxr_init_line (lp);                /* init line */
                                 if (!lp->notelnet) {
@@ -1453,6 +1444,7 @@ if (lp->serport) {
     }
 else                                                    /* Telnet connection */
     if (lp->sock) {
+        tmxr_rxpoll_remove (lp);                        /* stop watching */
         sim_close_sock (lp->sock);                      /* close socket */
         free (lp->telnet_sent_opts);
         lp->telnet_sent_opts = NULL;
@@ -1855,6 +1847,7 @@ else {
             lp->conn = TRUE;                            /* record connection */
             lp->sock = lp->mp->ring_sock;               /* save socket */
             lp->mp->ring_sock = INVALID_SOCKET;
+            tmxr_rxpoll_add (lp);                       /* watch for input */
             lp->ipad = lp->mp->ring_ipad;               /* ip address */
             lp->mp->ring_ipad = NULL;
             lp->mp->ring_start_time = 0;
@@ -2166,6 +2159,70 @@ if (lp->conn)
 return SCPE_LOST;
 }
 
+/* Line socket readiness
+
+   Where epoll is available, each connected line socket is registered with
+   a per multiplexer epoll set when its connection is established and
+   removed just before the socket is closed.  tmxr_poll_rx then collects
+   the readable (or failed) sockets with one non-blocking epoll_wait and
+   reads only those lines, rather than issuing a read on every connected
+   line.  Lines without a registered socket (serial, loopback, framer, or
+   if epoll is unavailable) are read on every poll as before.
+*/
+
+static void tmxr_rxpoll_add (TMLN *lp)
+{
+#if defined(TMXR_EPOLL)
+TMXR *mp = lp->mp;
+struct epoll_event ev;
+
+if ((mp == NULL) || (lp->sock == 0) || lp->rxpolled)
+    return;
+if (mp->rxpollfd <= 0) {                                /* first socket? */
+    mp->rxpollfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (mp->rxpollfd <= 0) {
+        mp->rxpollfd = 0;                               /* read every poll */
+        return;
+        }
+    }
+memset (&ev, 0, sizeof (ev));
+ev.events = EPOLLIN | EPOLLRDHUP;                       /* level triggered */
+ev.data.u32 = (uint32)(lp - mp->ldsc);
+if (epoll_ctl (mp->rxpollfd, EPOLL_CTL_ADD, lp->sock, &ev) == 0) {
+    lp->rxpolled = TRUE;
+    lp->rxready = TRUE;                                 /* read once anyway */
+    }
+#endif
+}
+
+static void tmxr_rxpoll_remove (TMLN *lp)
+{
+#if defined(TMXR_EPOLL)
+if (lp->rxpolled)
+    epoll_ctl (lp->mp->rxpollfd, EPOLL_CTL_DEL, lp->sock, NULL);
+#endif
+lp->rxpolled = lp->rxready = FALSE;
+}
+
+static void tmxr_rxpoll_ready (TMXR *mp)
+{
+#if defined(TMXR_EPOLL)
+struct epoll_event ev[64];
+int32 i, n, passes;
+
+if (mp->rxpollfd <= 0)
+    return;
+for (passes = (mp->lines + 63) / 64; passes > 0; passes--) {
+    n = epoll_wait (mp->rxpollfd, ev, 64, 0);
+    for (i = 0; i < n; i++)
+        if (ev[i].data.u32 < (uint32)mp->lines)
+            mp->ldsc[ev[i].data.u32].rxready = TRUE;
+    if (n < 64)                                         /* all collected? */
+        break;
+    }
+#endif
+}
+
 /* Poll for input
 
    Inputs:
@@ -2175,15 +2232,22 @@ return SCPE_LOST;
 
 void tmxr_poll_rx (TMXR *mp)
 {
-int32 i, nbytes, j;
+int32 i, nbytes, j, k, n;
 TMLN *lp;
+char *p;
 
 tmxr_debug_trace (mp, "tmxr_poll_rx()");
+tmxr_rxpoll_ready (mp);                                 /* find readable sockets */
 for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
     lp = mp->ldsc + i;                                  /* get line desc */
     if (!(lp->sock || lp->serport || lp->loopback || lp->framer) ||
         !(lp->rcve))                                    /* skip if not connected */
         continue;
+    if (lp->rxpolled && !lp->loopback) {                /* readiness known? */
+        if (!lp->rxready)                               /* nothing to read? */
+            continue;
+        lp->rxready = FALSE;
+        }
 
     nbytes = 0;
     if (lp->rxbpi == 0)                                 /* need input? */
@@ -2211,35 +2275,54 @@ for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
         lp->rxbpi = lp->rxbpi + nbytes;                 /* adv pointers */
         lp->rxcnt = lp->rxcnt + nbytes;
 
-/* Examine new data, remove TELNET cruft before making input available */
+/* Examine new data, remove TELNET cruft before making input available.
+
+   The new data is compacted in place in a single pass: j is the next
+   received character to examine and k is where the next character kept
+   for the simulator is stored.  Runs of ordinary data between IACs (and
+   CRs when not in binary mode) are located with memchr and moved as a
+   block, so the cost is linear in the amount of data received no matter
+   how many Telnet sequences it contains.
+*/
 
         if (!lp->notelnet) {                            /* Are we looking for telnet interpretation? */
-            for (; j < lp->rxbpi; ) {                   /* loop thru char */
+            for (k = j; j < lp->rxbpi; ) {              /* loop thru char */
                 u_char tmp = (u_char)lp->rxb[j];        /* get char */
                 switch (lp->tsta) {                     /* case tlnt state */
 
                 case TNS_NORM:                          /* normal */
+                    n = lp->rxbpi - j;                  /* find run of plain data */
+                    if ((p = (char *)memchr (&lp->rxb[j], TN_IAC, n)))
+                        n = (int32)(p - &lp->rxb[j]);
+                    if (lp->dstb && (p = (char *)memchr (&lp->rxb[j], TN_CR, n)))
+                        n = (int32)(p - &lp->rxb[j]);
+                    if (n > 0) {                        /* keep the run */
+                        if (k != j)
+                            memmove (&lp->rxb[k], &lp->rxb[j], n);
+                        j = j + n;
+                        k = k + n;
+                        break;
+                        }
                     if (tmp == TN_IAC) {                /* IAC? */
                         lp->tsta = TNS_IAC;             /* change state */
-                        tmxr_rmvrc (lp, j);             /* remove char */
+                        j = j + 1;                      /* remove char */
                         break;
                         }
-                    if ((tmp == TN_CR) && lp->dstb)     /* CR, no bin */
-                        lp->tsta = TNS_CRPAD;           /* skip pad char */
-                    j = j + 1;                          /* advance j */
+                    lp->tsta = TNS_CRPAD;               /* CR, no bin: skip pad char */
+                    lp->rxb[k++] = lp->rxb[j++];        /* keep CR */
                     break;
 
                 case TNS_IAC:                           /* IAC prev */
                     if (tmp == TN_IAC) {                /* IAC + IAC */
                         lp->tsta = TNS_NORM;            /* treat as normal */
-                        j = j + 1;                      /* advance j */
-                        break;                          /* keep IAC */
+                        lp->rxb[k++] = lp->rxb[j++];    /* keep IAC */
+                        break;
                         }
                     if (tmp == TN_BRK) {                /* IAC + BRK? */
                         lp->tsta = TNS_NORM;            /* treat as normal */
-                        lp->rxb[j] = 0;                 /* char is null */
-                        lp->rbr[j] = 1;                 /* flag break */
-                        j = j + 1;                      /* advance j */
+                        lp->rxb[k] = 0;                 /* char is null */
+                        lp->rbr[k++] = 1;               /* flag break */
+                        j = j + 1;
                         break;
                         }
                     switch (tmp) {
@@ -2267,7 +2350,7 @@ for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
                         lp->tsta = TNS_NORM;            /* ignore */
                         break;
                         }
-                    tmxr_rmvrc (lp, j);                 /* remove char */
+                    j = j + 1;                          /* remove char */
                     break;
 
                 case TNS_WILL:                          /* IAC+WILL prev */
@@ -2324,7 +2407,7 @@ for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
                             lp->dstb = 1;
                             }
                         }
-                    tmxr_rmvrc (lp, j);                 /* remove it */
+                    j = j + 1;                          /* remove it */
                     lp->tsta = TNS_NORM;                /* next normal */
                     break;
 
@@ -2346,7 +2429,7 @@ for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
                     lp->tsta = TNS_NORM;                /* next normal */
                     if ((tmp == TN_LF) ||               /* CR + LF ? */
                         (tmp == TN_NUL))                /* CR + NUL? */
-                        tmxr_rmvrc (lp, j);             /* remove it */
+                        j = j + 1;                      /* remove it */
                     break;
 
                 case TNS_DO:                            /* pending DO request */
@@ -2396,11 +2479,15 @@ for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
                         }
                     /* fall through */
                 case TNS_SKIP: default:                 /* skip char */
-                    tmxr_rmvrc (lp, j);                 /* remove char */
+                    j = j + 1;                          /* remove char */
                     lp->tsta = TNS_NORM;                /* next normal */
                     break;
                     }                                   /* end case state */
                 }                                       /* end for char */
+            if (k < lp->rxbpi) {                        /* anything removed? */
+                memset (&lp->rbr[k], 0, lp->rxbpi - k); /* clear vacated break status */
+                lp->rxbpi = k;                          /* drop buffer insert index */
+                }
             if (nbytes != (lp->rxbpi-lp->rxbpr)) {
                 tmxr_debug (TMXR_DBG_RCV, lp, "Remaining", &(lp->rxb[lp->rxbpr]), lp->rxbpi-lp->rxbpr);
                 }
@@ -2509,6 +2596,66 @@ if ((lp->conn && (TXBUF_AVAIL(lp) > 1)) ||              /* connected and room fo
 return SCPE_STALL;                                      /* char not sent */
 }
 
+/* Store a block of characters in line buffer
+
+   Inputs:
+        *lp     =       pointer to line descriptor
+        *buf    =       pointer to data
+        size    =       count of characters
+   Outputs:
+        count   =       number of characters stored
+
+   Implementation notes:
+
+    1. This is the bulk equivalent of calling tmxr_putc_ln for each
+       character.  Runs of data between IACs are copied into the transmit
+       buffer as a block, and each IAC is doubled in a Telnet session.
+    2. Only as much data as fits without reaching the buffer guard is
+       stored, and nothing is stored if the line needs per character
+       handling (logging, expect rules, rate limiting, or output outside
+       of simulation).  The caller is expected to pass the remainder to
+       tmxr_putc_ln, which handles those cases and stalls.
+*/
+
+static int32 tmxr_putbuf_ln (TMLN *lp, const uint8 *buf, int32 size)
+{
+int32 done = 0, room, run, first;
+const uint8 *iac;
+
+if ((!lp->conn) || lp->txlog || lp->expect.rules ||     /* per char handling needed? */
+    lp->txbps || !sim_is_running)
+    return 0;
+room = TXBUF_AVAIL (lp) - TMXR_GUARD - 1;               /* space above the guard */
+if ((room > 0) && (lp->xmte == 0))
+    lp->xmte = 1;                                       /* enable line transmit */
+while ((done < size) && (room > 0)) {
+    run = size - done;
+    if ((!lp->notelnet) &&                              /* Telnet session? */
+        (iac = (const uint8 *)memchr (buf + done, TN_IAC, run)))
+        run = (int32)(iac - (buf + done));              /* stop at next IAC */
+    if (run == 0) {                                     /* IAC to escape? */
+        if (room < 2)
+            break;
+        TXBUF_CHAR (lp, TN_IAC);                        /* stuff extra IAC char */
+        TXBUF_CHAR (lp, TN_IAC);
+        room = room - 2;
+        done = done + 1;
+        continue;
+        }
+    if (run > room)
+        run = room;
+    first = lp->txbsz - lp->txbpi;                      /* space before wrap */
+    if (first > run)
+        first = run;
+    memcpy (&lp->txb[lp->txbpi], buf + done, first);
+    memcpy (lp->txb, buf + done + first, run - first);
+    lp->txbpi = (lp->txbpi + run) % lp->txbsz;
+    room = room - run;
+    done = done + run;
+    }
+return done;
+}
+
 /* Store packet in line buffer
 
    Inputs:
@@ -2557,6 +2704,7 @@ lp->txppsize = size + pktlen_size + fc_size;
 lp->txppoffset = 0;
 tmxr_debug (TMXR_DBG_PXMT, lp, "Sending Packet", (char *)&lp->txpb[pktlen_size+fc_size], size);
 ++lp->txpcnt;
+lp->txppoffset += tmxr_putbuf_ln (lp, lp->txpb, (int32)lp->txppsize);
 while ((lp->txppoffset < lp->txppsize) &&
        (SCPE_OK == (r = tmxr_putc_ln (lp, lp->txpb[lp->txppoffset]))))
    ++lp->txppoffset;
@@ -2583,6 +2731,11 @@ for (i = 0; i < mp->lines; i++) {                       /* loop thru lines */
     lp = mp->ldsc + i;                                  /* get line desc */
     if ((!lp->conn) && (!lp->txbfd))                    /* skip if !conn and !buffered */
         continue;
+#if !defined(SIM_ASYNCH_MUX)
+    if (lp->xmte &&                                     /* skip if idle */
+        (tmxr_tqln (lp) == 0) && (tmxr_tpqln (lp) == 0))
+        continue;
+#endif
     nbytes = tmxr_send_buffered_data (lp);              /* buffered bytes */
     if (nbytes == 0) {                                  /* buf empty? enab line */
 #if defined(SIM_ASYNCH_MUX)
@@ -2649,6 +2802,9 @@ if (nbytes) {                                           /* >0? write */
             }
         }
     }                                                   /* end if nbytes */
+if (lp->txppoffset < lp->txppsize)                      /* buffered packet data? */
+    lp->txppoffset += tmxr_putbuf_ln (lp, lp->txpb + lp->txppoffset,
+                                      (int32)(lp->txppsize - lp->txppoffset));
 while ((lp->txppoffset < lp->txppsize) &&               /* buffered packet data? */
        (lp->txbsz > nbytes) &&                          /* and room in xmt buffer */
        (SCPE_OK == (r = tmxr_putc_ln (lp, lp->txpb[lp->txppoffset]))))
@@ -4722,6 +4878,11 @@ if (mp->ring_sock != INVALID_SOCKET) {
     mp->ring_ipad = NULL;
     mp->ring_start_time = 0;
     }
+#if defined(TMXR_EPOLL)
+if (mp->rxpollfd > 0)
+    close (mp->rxpollfd);                               /* release readiness set */
+#endif
+mp->rxpollfd = 0;
 _tmxr_remove_from_open_list (mp);
 return SCPE_OK;
 }
@@ -6143,13 +6304,57 @@ return SCPE_OK;
 
 #include <setjmp.h>
 
+/* Measure receive throughput of a connected line
+
+   Pushes 8MB of data containing every byte value through "sock" to line
+   "lp", in Telnet (with IACs escaped) or NOTELNET mode, and checks that
+   the data is delivered intact.
+*/
+
+static t_stat tmxr_rx_throughput (TMXR *mp, TMLN *lp, SOCKET sock, t_bool notelnet)
+{
+uint8 blk[2 * 4096];
+int32 i, blen, sent, got, want, total = 8 * 1024 * 1024;
+uint32 start, ms, idle;
+int n;
+
+lp->notelnet = notelnet;
+for (i = blen = 0; i < 4096; i++) {                     /* build data block */
+    if (((uint8)i == TN_IAC) && !notelnet)
+        blk[blen++] = TN_IAC;
+    blk[blen++] = (uint8)i;
+    }
+start = sim_os_msec ();
+for (got = 0; got < total; ) {
+    for (sent = 0; sent < blen; sent += n)              /* send a block */
+        if ((n = sim_write_sock (sock, (char *)blk + sent, blen - sent)) < 0)
+            return SCPE_IOERR;
+    for (idle = sim_os_msec (), want = got + 4096; got < want; ) {/* receive it */
+        tmxr_poll_rx (mp);
+        if (lp->rxbpi == lp->rxbpr) {
+            if ((sim_os_msec () - idle) > 5000)         /* stalled? */
+                return SCPE_IERR;
+            continue;
+            }
+        for (i = lp->rxbpr; i < lp->rxbpi; i++, got++)
+            if (((uint8)lp->rxb[i] != (uint8)got) || lp->rbr[i])
+                return SCPE_IERR;
+        lp->rxbpi = lp->rxbpr = 0;
+        }
+    }
+ms = sim_os_msec () - start;
+sim_printf ("  %s receive: %d bytes in %u ms (%.1f MB/sec)\n", notelnet ? "NOTELNET" : "Telnet",
+            total, ms, ms ? ((double)total / (1024.0 * 1024.0)) / (ms / 1000.0) : 0.0);
+return SCPE_OK;
+}
+
 t_stat tmxr_sock_test (DEVICE *dptr, const char *cptr)
 {
 char cmd[CBUFSIZE], host[CBUFSIZE], port[CBUFSIZE];
 int line;
 TMXR *tmxr;
 TMLN *ln;
-int32 tmp1, tmp2;
+int32 tmp1, tmp2, tries;
 t_stat stat = SCPE_OK;
 SOCKET sock_mux = INVALID_SOCKET;
 SOCKET sock_line = INVALID_SOCKET;
@@ -6196,6 +6401,27 @@ if (tmxr->lines > 1) {
     sock_mux = sim_connect_sock ("", "localhost", "65500");
     sim_os_ms_sleep (100);
     SIM_TEST(((tmp2 = tmxr_poll_conn (tmxr)) == 0) || (tmp2 == 2) ? SCPE_OK : SCPE_IERR);
+    for (line=0; line < tmxr->lines; line++)
+        tmxr->ldsc[line].rcve = 1;
+    tmxr_poll_rx (tmxr);                            /* drain any input */
+    for (line=tmp1=0; line < tmxr->lines; line++)
+        tmp1 += tmxr->ldsc[line].rxcnt;
+    SIM_TEST((sim_write_sock (sock_mux, "ready", 5) == 5) ? SCPE_OK : SCPE_IERR);
+    for (tmp2 = tmp1, tries = 0; (tmp2 != tmp1 + 5) && (tries < 20); tries++) {
+        sim_os_ms_sleep (10);
+        tmxr_poll_conn (tmxr);                      /* accept any stragglers */
+        tmxr_poll_rx (tmxr);                        /* input must be seen */
+        for (line=tmp2=0; line < tmxr->lines; line++)
+            tmp2 += tmxr->ldsc[line].rxcnt;
+        }
+    SIM_TEST((tmp2 == tmp1 + 5) ? SCPE_OK : SCPE_IERR);
+    for (line=0; line < tmxr->lines; line++)        /* find the line sock_mux reached */
+        if (tmxr->ldsc[line].rxcnt && tmxr->ldsc[line].sock)
+            break;
+    SIM_TEST((line < tmxr->lines) ? SCPE_OK : SCPE_IERR);
+    tmxr->ldsc[line].rxbpi = tmxr->ldsc[line].rxbpr = 0;
+    SIM_TEST(tmxr_rx_throughput (tmxr, &tmxr->ldsc[line], sock_mux, TRUE));
+    SIM_TEST(tmxr_rx_throughput (tmxr, &tmxr->ldsc[line], sock_mux, FALSE));
     show_cmd (0, "MUX");
     sim_close_sock (sock_mux);
     sock_mux = INVALID_SOCKET;
@@ -212,6 +212,8 @@ struct tmln {
     EXPECT              expect;                         /* Expect rules */
     SEND                send;                           /* Send input state */
     struct framer_data  *framer;                        /* ddcmp framer data */
+    t_bool              rxpolled;                       /* socket registered for readiness */
+    t_bool              rxready;                        /* socket reported readable */
     };
 
 struct tmxr {
@@ -240,6 +242,7 @@ struct tmxr {
     t_bool              port_speed_control;             /* multiplexer programmatically sets port speed */
     t_bool              packet;                         /* Lines are packet oriented */
     t_bool              datagram;                       /* Lines use datagram packet transport */
+    int                 rxpollfd;                       /* line readiness (epoll) descriptor */
     };
 
 int32 tmxr_poll_conn (TMXR *mp);
@@ -27,7 +27,7 @@
    11-Jun-2013  MB      First version
 */
 
-#if defined(HAVE_LIBPNG) && defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)
+#if defined(HAVE_LIBPNG)
 #include <png.h>
 #endif
 #include "sim_video.h"
@@ -355,6 +355,8 @@ static void vid_beep_setup (int duration_ms, int tone_frequency);
 static void vid_beep_cleanup (void);
 static void vid_controllers_setup (DEVICE *dptr);
 static void vid_controllers_cleanup (void);
+static t_stat vid_alloc_frame (VID_DISPLAY *vptr);
+static void vid_free_frame (VID_DISPLAY *vptr);
 
 struct VID_DISPLAY {
 t_bool vid_active_window;
@@ -379,6 +381,12 @@ t_bool vid_blending;
 SDL_Rect *vid_dst_last;
 SDL_Rect vid_rect;
 uint32 *vid_data_last;
+uint32 *vid_frame;                                      /* frame buffer */
+uint32 *vid_dirty;                                      /* dirty row bitmap */
+uint32 *vid_dirty_flush;                                /* dirty rows being flushed */
+int32 vid_dirty_x0;                                     /* dirty column range */
+int32 vid_dirty_x1;
+t_bool vid_damage_posted;                               /* damage flush event queued */
 };
 
 SDL_Thread *vid_thread_handle = NULL;                   /* event thread handle */
@@ -726,6 +734,10 @@ vptr->vid_mouse_captured = FALSE;
 vptr->vid_cursor_visible = (vptr->vid_flags & SIM_VID_INPUTCAPTURED);
 vptr->vid_blending = FALSE;
 vptr->vid_ready = FALSE;
+if (vid_alloc_frame (vptr) != SCPE_OK) {
+    vid_free_frame (vptr);
+    return SCPE_MEM;
+    }
 
 if (!vid_active) {
     vid_key_events.head = 0;
@@ -744,8 +756,10 @@ memset (motion_callback, 0, sizeof motion_callback);
 memset (button_callback, 0, sizeof button_callback);
 
 stat = vid_create_window (vptr);
-if (stat != SCPE_OK)
+if (stat != SCPE_OK) {
+    vid_free_frame (vptr);
     return stat;
+    }
 
 sim_debug (SIM_VID_DBG_VIDEO|SIM_VID_DBG_KEY|SIM_VID_DBG_MOUSE, vptr->vid_dev, "vid_open() - Success\n");
 
@@ -801,6 +815,7 @@ if (vid_thread_handle && vid_active <= 1) {
 while (vptr->vid_ready)
     sim_os_ms_sleep (10);
 
+vid_free_frame (vptr);
 vptr->vid_active_window = FALSE;
 if (!vid_active && vid_mouse_events.sem) {
     SDL_DestroySemaphore(vid_mouse_events.sem);
@@ -892,14 +907,114 @@ uint32 vid_map_rgba_window (VID_DISPLAY *vptr, uint8 r, uint8 g, uint8 b, uint8
 return SDL_MapRGBA (vptr->vid_format, r, g, b, a);
 }
 
-void vid_draw_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h, uint32 *buf)
+/* Frame buffer and damage tracking
+
+   Each window has a frame buffer of vid_width x vid_height pixels which the
+   simulator thread draws into, either directly (vid_get_framebuffer_window)
+   or by way of vid_draw_window.  Changed areas are recorded with
+   vid_damage_window in a bitmap of dirty rows together with the range of
+   dirty columns.  Only one draw event is outstanding at a time, so any
+   number of drawing calls between video thread wakeups are coalesced into
+   a single pass which copies just the runs of dirty rows into the texture.
+
+   Windows using alpha blending composite each drawn region onto the
+   renderer as it arrives, so their vid_draw_window calls still queue each
+   region individually.
+*/
+
+static t_stat vid_alloc_frame (VID_DISPLAY *vptr)
+{
+size_t words = (vptr->vid_height + 31) / 32;
+
+vptr->vid_frame = (uint32 *)calloc ((size_t)vptr->vid_width * vptr->vid_height, sizeof (*vptr->vid_frame));
+vptr->vid_dirty = (uint32 *)calloc (words, sizeof (*vptr->vid_dirty));
+vptr->vid_dirty_flush = (uint32 *)calloc (words, sizeof (*vptr->vid_dirty_flush));
+vptr->vid_dirty_x0 = vptr->vid_width;
+vptr->vid_dirty_x1 = 0;
+vptr->vid_damage_posted = FALSE;
+if ((vptr->vid_frame == NULL) || (vptr->vid_dirty == NULL) || (vptr->vid_dirty_flush == NULL))
+    return SCPE_MEM;
+return SCPE_OK;
+}
+
+static void vid_free_frame (VID_DISPLAY *vptr)
+{
+free (vptr->vid_frame);
+vptr->vid_frame = NULL;
+free (vptr->vid_dirty);
+vptr->vid_dirty = NULL;
+free (vptr->vid_dirty_flush);
+vptr->vid_dirty_flush = NULL;
+}
+
+uint32 *vid_get_framebuffer_window (VID_DISPLAY *vptr)
+{
+return vptr->vid_frame;
+}
+
+uint32 *vid_get_framebuffer (void)
+{
+return vid_get_framebuffer_window (&vid_first);
+}
+
+void vid_damage_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h)
+{
+SDL_Event user_event;
+t_bool post;
+int32 row;
+
+if (x < 0) {                                            /* clip to the frame */
+    w += x;
+    x = 0;
+    }
+if (y < 0) {
+    h += y;
+    y = 0;
+    }
+if (x + w > vptr->vid_width)
+    w = vptr->vid_width - x;
+if (y + h > vptr->vid_height)
+    h = vptr->vid_height - y;
+if ((w <= 0) || (h <= 0))
+    return;
+
+SDL_LockMutex (vptr->vid_draw_mutex);
+for (row = y; row < y + h; row++)
+    vptr->vid_dirty[row >> 5] |= 1u << (row & 0x1F);
+if (x < vptr->vid_dirty_x0)
+    vptr->vid_dirty_x0 = x;
+if (x + w > vptr->vid_dirty_x1)
+    vptr->vid_dirty_x1 = x + w;
+post = !vptr->vid_damage_posted;                        /* no draw event outstanding? */
+vptr->vid_damage_posted = TRUE;
+SDL_UnlockMutex (vptr->vid_draw_mutex);
+if (!post)
+    return;
+
+user_event.type = SDL_USEREVENT;
+user_event.user.windowID = vptr->vid_windowID;
+user_event.user.code = EVENT_DRAW;
+user_event.user.data1 = NULL;                           /* flush damage */
+user_event.user.data2 = NULL;
+if (SDL_PushEvent (&user_event) < 0) {
+    sim_printf ("%s: vid_damage() SDL_PushEvent error: %s\n", vid_dname(vptr->vid_dev), SDL_GetError());
+    SDL_LockMutex (vptr->vid_draw_mutex);
+    vptr->vid_damage_posted = FALSE;
+    SDL_UnlockMutex (vptr->vid_draw_mutex);
+    }
+}
+
+void vid_damage (int32 x, int32 y, int32 w, int32 h)
+{
+vid_damage_window (&vid_first, x, y, w, h);
+}
+
+static void vid_draw_blended (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h, uint32 *buf)
 {
 SDL_Event user_event;
 SDL_Rect *vid_dst, *last;
 uint32 *vid_data;
 
-sim_debug (SIM_VID_DBG_VIDEO, vptr->vid_dev, "vid_draw(%d, %d, %d, %d)\n", x, y, w, h);
-
 SDL_LockMutex (vptr->vid_draw_mutex);                         /* Synchronize to check region dimensions */
 last = vptr->vid_dst_last;
 if (last                               &&               /* As yet unprocessed draw rectangle? */
@@ -943,6 +1058,25 @@ if (SDL_PushEvent (&user_event) < 0) {
     }
 }
 
+void vid_draw_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h, uint32 *buf)
+{
+int32 row, col0, col1;
+
+sim_debug (SIM_VID_DBG_VIDEO, vptr->vid_dev, "vid_draw(%d, %d, %d, %d)\n", x, y, w, h);
+
+if (vptr->vid_blending) {
+    vid_draw_blended (vptr, x, y, w, h, buf);
+    return;
+    }
+col0 = (x < 0) ? -x : 0;                                /* columns of buf within the frame */
+col1 = (x + w > vptr->vid_width) ? vptr->vid_width - x : w;
+if (col0 < col1) {
+    for (row = (y < 0) ? -y : 0; (row < h) && (y + row < vptr->vid_height); row++)
+        memcpy (&vptr->vid_frame[(y + row) * vptr->vid_width + x + col0], &buf[row * w + col0], (col1 - col0) * sizeof (*buf));
+    }
+vid_damage_window (vptr, x, y, w, h);
+}
+
 void vid_draw (int32 x, int32 y, int32 w, int32 h, uint32 *buf)
 {
 vid_draw_window (&vid_first, x, y, w, h, buf);
@@ -1738,9 +1872,51 @@ if (vptr->vid_flags & SIM_VID_IGNORE_VBAR) {
     }
 }
 
+static void vid_flush_damage (VID_DISPLAY *vptr)
+{
+SDL_Rect r;
+int32 row, first, x0, x1, runs = 0;
+size_t words = (vptr->vid_height + 31) / 32;
+
+SDL_LockMutex (vptr->vid_draw_mutex);
+x0 = vptr->vid_dirty_x0;
+x1 = vptr->vid_dirty_x1;
+memcpy (vptr->vid_dirty_flush, vptr->vid_dirty, words * sizeof (*vptr->vid_dirty));
+memset (vptr->vid_dirty, 0, words * sizeof (*vptr->vid_dirty));
+vptr->vid_dirty_x0 = vptr->vid_width;
+vptr->vid_dirty_x1 = 0;
+vptr->vid_damage_posted = FALSE;                        /* later damage needs a new event */
+SDL_UnlockMutex (vptr->vid_draw_mutex);
+if (x0 >= x1)                                           /* nothing changed? */
+    return;
+
+r.x = x0;
+r.w = x1 - x0;
+for (row = 0; row < vptr->vid_height; ) {
+    if (vptr->vid_dirty_flush[row >> 5] == 0) {         /* skip clean rows 32 at a time */
+        row = (row | 0x1F) + 1;
+        continue;
+        }
+    if (!(vptr->vid_dirty_flush[row >> 5] & (1u << (row & 0x1F)))) {
+        ++row;
+        continue;
+        }
+    for (first = row; (row < vptr->vid_height) && (vptr->vid_dirty_flush[row >> 5] & (1u << (row & 0x1F))); row++)
+        ;
+    r.y = first;
+    r.h = row - first;
+    if (SDL_UpdateTexture (vptr->vid_texture, &r, &vptr->vid_frame[first * vptr->vid_width + x0], vptr->vid_width * sizeof (*vptr->vid_frame)))
+        sim_printf ("%s: vid_flush_damage() - SDL_UpdateTexture error: %s\n", vid_dname(vptr->vid_dev), SDL_GetError());
+    ++runs;
+    }
+sim_debug (SIM_VID_DBG_VIDEO, vptr->vid_dev, "Damage Flush: columns %d-%d, %d row runs\n", x0, x1 - 1, runs);
+}
+
 void vid_update (VID_DISPLAY *vptr)
 {
 SDL_Rect vid_dst;
+if (!vptr->vid_blending)
+    vid_flush_damage (vptr);                            /* bring the texture up to date */
 vid_stretch(vptr, &vid_dst);
 sim_debug (SIM_VID_DBG_VIDEO, vptr->vid_dev, "Video Update Event: \n");
 if (sim_deb)
@@ -1786,6 +1962,10 @@ void vid_draw_region (VID_DISPLAY *vptr, SDL_UserEvent *event)
 SDL_Rect *vid_dst = (SDL_Rect *)event->data1;
 uint32 *buf = (uint32 *)event->data2;
 
+if (vid_dst == NULL) {                                  /* frame buffer damage? */
+    vid_flush_damage (vptr);
+    return;
+    }
 sim_debug (SIM_VID_DBG_VIDEO, vptr->vid_dev, "Draw Region Event: (%d,%d,%d,%d)\n", vid_dst->x, vid_dst->x, vid_dst->w, vid_dst->h);
 
 SDL_LockMutex (vptr->vid_draw_mutex);
@@ -2601,6 +2781,11 @@ while (_show_stat == -1)
 return _show_stat;
 }
 
+t_stat vid_set (int32 flag, CONST char *cptr)
+{
+return sim_messagef (SCPE_NOFNC, "Headless video is only available in simulators built without SDL\n");
+}
+
 static t_stat _vid_screenshot (VID_DISPLAY *vptr, const char *filename)
 {
 int stat;
@@ -2792,22 +2977,379 @@ vid_beep_event ();
 SDL_Delay (vid_beep_duration + 100);/* Wait for sound to finish */
 }
 
+/* Windows can always be opened in builds with SDL */
+
+t_stat vid_can_open (void)
+{
+return SCPE_OK;
+}
+
+/* Frames are only captured by the headless video of builds without SDL */
+
+t_stat vid_test (void)
+{
+return SCPE_OK;
+}
+
 #else /* !(defined(USE_SIM_VIDEO) && defined(HAVE_LIBSDL)) */
-/* Non-implemented versions */
+/* Headless video
+
+   Builds without SDL have no window system to display into, but video
+   devices can still be run with their displays kept in memory.  After a SET
+   VIDEO HEADLESS command, opening a window creates a frame buffer of
+   ARGB8888 pixels which vid_draw_window, vid_get_framebuffer_window and
+   vid_damage_window maintain just as they do in SDL builds.  Each call to
+   vid_refresh_window completes a frame.  Without SET VIDEO HEADLESS
+   opening a window fails, as it always has in these builds.
+
+   The number of frames, draw calls and damaged pixels are counted per
+   window and displayed by SHOW VIDEO, which makes the cost of the video
+   device emulation measurable without a display.  SET VIDEO CAPTURE=file
+   writes every frame which changed to a numbered file, either as a PNG
+   (when built with libpng; a BMP otherwise) or, for a .raw file name, as
+   bare 24-bit RGB pixels.  SCREENSHOT saves the current frames.  There is
+   no keyboard or mouse input.
+*/
+
+struct VID_DISPLAY {
+t_bool vid_active_window;
+DEVICE *vid_dev;
+char vid_title[128];
+int32 vid_width;
+int32 vid_height;
+int vid_flags;
+uint32 *vid_frame;                                      /* frame buffer */
+t_bool vid_damaged;                                     /* changed since last capture */
+uint32 vid_start;                                       /* msec time window was opened */
+t_uint64 vid_frames;                                    /* refreshes */
+t_uint64 vid_draw_calls;                                /* vid_draw_window calls */
+t_uint64 vid_dirty_pixels;                              /* damaged pixels */
+t_uint64 vid_captured;                                  /* frames written */
+VID_DISPLAY *next;
+};
+
+static VID_DISPLAY vid_first;
+static t_bool vid_headless = FALSE;                     /* windows may be opened */
+static char *vid_capture_name = NULL;                   /* frame capture file name */
+
+#define VID_FMT_PNG     0                               /* image file formats */
+#define VID_FMT_BMP     1
+#define VID_FMT_RAW     2
+
+static int vid_image_format (const char *filename)
+{
+if (match_ext (filename, "raw"))
+    return VID_FMT_RAW;
+#if defined(HAVE_LIBPNG)
+if (!match_ext (filename, "bmp"))
+    return VID_FMT_PNG;
+#endif
+return VID_FMT_BMP;
+}
+
+#if defined(HAVE_LIBPNG)
+static t_stat vid_write_png (VID_DISPLAY *vptr, FILE *f, png_bytep row)
+{
+png_structp png_ptr;
+png_infop info_ptr;
+int32 x, y;
+
+png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+if (png_ptr == NULL)
+    return SCPE_MEM;
+info_ptr = png_create_info_struct (png_ptr);
+if (info_ptr == NULL) {
+    png_destroy_write_struct (&png_ptr, NULL);
+    return SCPE_MEM;
+    }
+if (setjmp (png_jmpbuf (png_ptr))) {
+    png_destroy_write_struct (&png_ptr, &info_ptr);
+    return SCPE_IOERR;
+    }
+png_init_io (png_ptr, f);
+png_set_IHDR (png_ptr, info_ptr, vptr->vid_width, vptr->vid_height, 8, PNG_COLOR_TYPE_RGB,
+              PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+png_write_info (png_ptr, info_ptr);
+for (y = 0; y < vptr->vid_height; y++) {
+    uint32 *pixel = &vptr->vid_frame[y * vptr->vid_width];
+
+    for (x = 0; x < vptr->vid_width; x++) {
+        row[3*x]     = (png_byte)(pixel[x] >> 16);
+        row[3*x + 1] = (png_byte)(pixel[x] >> 8);
+        row[3*x + 2] = (png_byte)pixel[x];
+        }
+    png_write_row (png_ptr, row);
+    }
+png_write_end (png_ptr, info_ptr);
+png_destroy_write_struct (&png_ptr, &info_ptr);
+return SCPE_OK;
+}
+#endif /* defined(HAVE_LIBPNG) */
+
+static void vid_put_le (uint8 *p, uint32 val, int bytes)
+{
+while (bytes-- > 0) {
+    *p++ = (uint8)val;
+    val >>= 8;
+    }
+}
+
+/* Write the frame buffer of a window to filename in the given format */
+
+static t_stat vid_write_frame (VID_DISPLAY *vptr, const char *filename, int format)
+{
+FILE *f;
+uint8 *row;
+size_t pitch = (3 * (size_t)vptr->vid_width + 3) & ~(size_t)3; /* BMP rows are 32 bit aligned */
+int32 x, y;
+t_stat r = SCPE_OK;
+
+row = (uint8 *)calloc (pitch, 1);
+if (row == NULL)
+    return SCPE_MEM;
+f = sim_fopen (filename, "wb");
+if (f == NULL) {
+    free (row);
+    return SCPE_OPENERR;
+    }
+switch (format) {
+#if defined(HAVE_LIBPNG)
+    case VID_FMT_PNG:
+        r = vid_write_png (vptr, f, row);
+        break;
+#endif
+    case VID_FMT_BMP: {
+        uint8 hdr[54];
+
+        memset (hdr, 0, sizeof (hdr));
+        hdr[0] = 'B';
+        hdr[1] = 'M';
+        vid_put_le (&hdr[2], (uint32)(sizeof (hdr) + pitch * vptr->vid_height), 4);/* file size */
+        vid_put_le (&hdr[10], sizeof (hdr), 4);         /* pixel data offset */
+        vid_put_le (&hdr[14], 40, 4);                   /* info header size */
+        vid_put_le (&hdr[18], vptr->vid_width, 4);
+        vid_put_le (&hdr[22], vptr->vid_height, 4);     /* bottom up */
+        vid_put_le (&hdr[26], 1, 2);                    /* planes */
+        vid_put_le (&hdr[28], 24, 2);                   /* bits per pixel */
+        vid_put_le (&hdr[34], (uint32)(pitch * vptr->vid_height), 4);
+        if (fwrite (hdr, sizeof (hdr), 1, f) != 1)
+            r = SCPE_IOERR;
+        for (y = vptr->vid_height - 1; (y >= 0) && (r == SCPE_OK); y--) {
+            uint32 *pixel = &vptr->vid_frame[y * vptr->vid_width];
+
+            for (x = 0; x < vptr->vid_width; x++)
+                vid_put_le (&row[3*x], pixel[x], 3);    /* blue, green, red */
+            if (fwrite (row, pitch, 1, f) != 1)
+                r = SCPE_IOERR;
+            }
+        break;
+        }
+    default:                                            /* raw RGB */
+        for (y = 0; (y < vptr->vid_height) && (r == SCPE_OK); y++) {
+            uint32 *pixel = &vptr->vid_frame[y * vptr->vid_width];
+
+            for (x = 0; x < vptr->vid_width; x++) {
+                row[3*x]     = (uint8)(pixel[x] >> 16);
+                row[3*x + 1] = (uint8)(pixel[x] >> 8);
+                row[3*x + 2] = (uint8)pixel[x];
+                }
+            if (fwrite (row, 3 * (size_t)vptr->vid_width, 1, f) != 1)
+                r = SCPE_IOERR;
+            }
+        break;
+    }
+if ((fclose (f) != 0) && (r == SCPE_OK))
+    r = SCPE_IOERR;
+free (row);
+return r;
+}
+
+/* Supply the extension of the format written when the name lacks it */
+
+static void vid_image_name (char *name, int format)
+{
+if ((format == VID_FMT_PNG) && !match_ext (name, "png"))
+    strcat (name, ".png");
+if ((format == VID_FMT_BMP) && !match_ext (name, "bmp"))
+    strcat (name, ".bmp");
+}
+
+/* Window number used to distinguish the files of several windows */
+
+static int vid_window_index (VID_DISPLAY *vptr)
+{
+VID_DISPLAY *wptr;
+int i = 0;
+
+for (wptr = &vid_first; (wptr != NULL) && (wptr != vptr); wptr = wptr->next)
+    if (wptr->vid_active_window)
+        ++i;
+return i;
+}
+
+static void vid_capture_frame (VID_DISPLAY *vptr)
+{
+char *name;
+const char *extension = strrchr (vid_capture_name, '.');
+size_t n = extension ? (size_t)(extension - vid_capture_name) : strlen (vid_capture_name);
+t_stat r;
+
+name = (char *)malloc (strlen (vid_capture_name) + 48);
+if (name == NULL)
+    return;
+memcpy (name, vid_capture_name, n);
+if (vid_active > 1)
+    sprintf (name + n, "%d", vid_window_index (vptr));
+else
+    name[n] = '\0';
+sprintf (name + strlen (name), "-%06.0f%s", (double)vptr->vid_frames, extension ? extension : "");
+vid_image_name (name, vid_image_format (vid_capture_name));
+r = vid_write_frame (vptr, name, vid_image_format (vid_capture_name));
+if (r != SCPE_OK) {                                     /* don't keep failing on each frame */
+    sim_printf ("Frame capture to %s failed: %s, capture stopped\n", name, sim_error_text (r));
+    free (vid_capture_name);
+    vid_capture_name = NULL;
+    }
+else
+    ++vptr->vid_captured;
+free (name);
+}
+
+t_stat vid_set (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+char *value;
+
+if ((cptr == NULL) || (*cptr == 0))
+    return SCPE_2FARG;
+while (*cptr != 0) {
+    cptr = get_glyph_nc (cptr, gbuf, ',');
+    value = strchr (gbuf, '=');
+    if (value != NULL)
+        *value++ = '\0';
+    if (MATCH_CMD (gbuf, "HEADLESS") == 0) {
+        if (value != NULL)
+            return SCPE_ARG;
+        vid_headless = TRUE;
+        }
+    else if (MATCH_CMD (gbuf, "NOHEADLESS") == 0) {
+        if (value != NULL)
+            return SCPE_ARG;
+        if (vid_active)
+            return sim_messagef (SCPE_ALATT, "Video windows are open\n");
+        vid_headless = FALSE;
+        }
+    else if (MATCH_CMD (gbuf, "CAPTURE") == 0) {
+        if ((value == NULL) || (*value == 0))
+            return SCPE_2FARG;
+        free (vid_capture_name);
+        vid_capture_name = (char *)malloc (strlen (value) + 1);
+        if (vid_capture_name == NULL)
+            return SCPE_MEM;
+        strcpy (vid_capture_name, value);
+        }
+    else if (MATCH_CMD (gbuf, "NOCAPTURE") == 0) {
+        if (value != NULL)
+            return SCPE_ARG;
+        free (vid_capture_name);
+        vid_capture_name = NULL;
+        }
+    else
+        return sim_messagef (SCPE_ARG, "Unknown video setting: %s\n", gbuf);
+    }
+return SCPE_OK;
+}
+
+/* Video devices are only usable here after SET VIDEO HEADLESS */
+
+t_stat vid_can_open (void)
+{
+if (!vid_headless)
+    return sim_messagef (SCPE_NOFNC, "Simulator built without a display, SET VIDEO HEADLESS first\n");
+return SCPE_OK;
+}
+
+static t_stat vid_init_window (VID_DISPLAY *vptr, DEVICE *dptr, const char *title, uint32 width, uint32 height, int flags)
+{
+if (!vid_headless)
+    return SCPE_NOFNC;
+vptr->vid_frame = (uint32 *)calloc ((size_t)width * height, sizeof (*vptr->vid_frame));
+if (vptr->vid_frame == NULL)
+    return SCPE_MEM;
+if ((strlen(sim_name) + 7 + (dptr ? strlen (dptr->name) : 0) + (title ? strlen (title) : 0)) < sizeof (vptr->vid_title))
+    sprintf (vptr->vid_title, "%s%s%s%s%s", sim_name, dptr ? " - " : "", dptr ? dptr->name : "", title ? " - " : "", title ? title : "");
+else
+    sprintf (vptr->vid_title, "%s", sim_name);
+vptr->vid_active_window = TRUE;
+vptr->vid_dev = dptr;
+vptr->vid_width = width;
+vptr->vid_height = height;
+vptr->vid_flags = flags;
+vptr->vid_damaged = TRUE;                               /* capture the initial frame */
+vptr->vid_start = sim_os_msec ();
+vptr->vid_frames = vptr->vid_draw_calls = vptr->vid_dirty_pixels = vptr->vid_captured = 0;
+vid_active++;
+sim_debug (SIM_VID_DBG_VIDEO, dptr, "vid_open() - Headless %d by %d window\n", width, height);
+return SCPE_OK;
+}
+
+t_stat vid_open_window (VID_DISPLAY **vptr, DEVICE *dptr, const char *title, uint32 width, uint32 height, int flags)
+{
+t_stat r;
+
+*vptr = (VID_DISPLAY *)calloc (1, sizeof (VID_DISPLAY));
+if (*vptr == NULL)
+    return SCPE_NXM;
+r = vid_init_window (*vptr, dptr, title, width, height, flags);
+if (r != SCPE_OK) {
+    free (*vptr);
+    *vptr = NULL;
+    return r;
+    }
+(*vptr)->next = vid_first.next;
+vid_first.next = *vptr;
+return SCPE_OK;
+}
 
 t_stat vid_open (DEVICE *dptr, const char *title, uint32 width, uint32 height, int flags)
 {
-return SCPE_NOFNC;
+if (!vid_first.vid_active_window)
+    return vid_init_window (&vid_first, dptr, title, width, height, flags);
+return SCPE_OK;
 }
 
-t_stat vid_close (void)
+t_stat vid_close_window (VID_DISPLAY *vptr)
 {
+VID_DISPLAY **pptr;
+
+if ((vptr == NULL) || !vptr->vid_active_window)
+    return SCPE_OK;
+sim_debug (SIM_VID_DBG_VIDEO, vptr->vid_dev, "vid_close() - %.0f frames\n", (double)vptr->vid_frames);
+free (vptr->vid_frame);
+vptr->vid_frame = NULL;
+vptr->vid_active_window = FALSE;
+vid_active--;
+if (vptr != &vid_first) {                               /* dynamically allocated? */
+    for (pptr = &vid_first.next; *pptr != NULL; pptr = &(*pptr)->next)
+        if (*pptr == vptr) {
+            *pptr = vptr->next;
+            break;
+            }
+    free (vptr);
+    }
 return SCPE_OK;
 }
 
+t_stat vid_close (void)
+{
+return vid_close_window (&vid_first);
+}
+
 t_stat vid_close_all (void)
 {
-return SCPE_OK;
+while (vid_first.next != NULL)
+    vid_close_window (vid_first.next);
+return vid_close ();
 }
 
 t_stat vid_poll_kb (SIM_KEY_EVENT *ev)
@@ -2820,19 +3362,117 @@ t_stat vid_poll_mouse (SIM_MOUSE_EVENT *ev)
 return SCPE_EOF;
 }
 
+uint32 vid_map_rgb_window (VID_DISPLAY *vptr, uint8 r, uint8 g, uint8 b)
+{
+return 0xFF000000 | ((uint32)r << 16) | ((uint32)g << 8) | b;
+}
+
 uint32 vid_map_rgb (uint8 r, uint8 g, uint8 b)
 {
-return 0;
+return vid_map_rgb_window (&vid_first, r, g, b);
+}
+
+uint32 vid_map_rgba_window (VID_DISPLAY *vptr, uint8 r, uint8 g, uint8 b, uint8 a)
+{
+return ((uint32)a << 24) | ((uint32)r << 16) | ((uint32)g << 8) | b;
+}
+
+/* Frames are kept as drawn; the blend mode only matters when rendering */
+
+t_stat vid_set_alpha_mode (VID_DISPLAY *vptr, int mode)
+{
+switch (mode) {
+    case SIM_ALPHA_NONE:
+    case SIM_ALPHA_BLEND:
+    case SIM_ALPHA_ADD:
+    case SIM_ALPHA_MOD:
+        return SCPE_OK;
+    default:
+        return SCPE_ARG;
+    }
+}
+
+uint32 *vid_get_framebuffer_window (VID_DISPLAY *vptr)
+{
+return vptr ? vptr->vid_frame : NULL;
+}
+
+uint32 *vid_get_framebuffer (void)
+{
+return vid_get_framebuffer_window (&vid_first);
+}
+
+void vid_damage_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h)
+{
+if ((vptr == NULL) || (vptr->vid_frame == NULL))
+    return;
+if (x < 0) {                                            /* clip to the frame */
+    w += x;
+    x = 0;
+    }
+if (y < 0) {
+    h += y;
+    y = 0;
+    }
+if (x + w > vptr->vid_width)
+    w = vptr->vid_width - x;
+if (y + h > vptr->vid_height)
+    h = vptr->vid_height - y;
+if ((w <= 0) || (h <= 0))
+    return;
+vptr->vid_dirty_pixels += (t_uint64)w * h;
+vptr->vid_damaged = TRUE;
+}
+
+void vid_damage (int32 x, int32 y, int32 w, int32 h)
+{
+vid_damage_window (&vid_first, x, y, w, h);
+}
+
+void vid_draw_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h, uint32 *buf)
+{
+int32 row, col0, col1;
+
+if ((vptr == NULL) || (vptr->vid_frame == NULL))
+    return;
+++vptr->vid_draw_calls;
+col0 = (x < 0) ? -x : 0;                                /* columns of buf within the frame */
+col1 = (x + w > vptr->vid_width) ? vptr->vid_width - x : w;
+if (col0 < col1) {
+    for (row = (y < 0) ? -y : 0; (row < h) && (y + row < vptr->vid_height); row++)
+        memcpy (&vptr->vid_frame[(y + row) * vptr->vid_width + x + col0], &buf[row * w + col0], (col1 - col0) * sizeof (*buf));
+    }
+vid_damage_window (vptr, x, y, w, h);
 }
 
 void vid_draw (int32 x, int32 y, int32 w, int32 h, uint32 *buf)
 {
-return;
+vid_draw_window (&vid_first, x, y, w, h, buf);
+}
+
+void vid_refresh_window (VID_DISPLAY *vptr)
+{
+if ((vptr == NULL) || (vptr->vid_frame == NULL))
+    return;
+++vptr->vid_frames;
+if ((vid_capture_name != NULL) && vptr->vid_damaged)
+    vid_capture_frame (vptr);
+vptr->vid_damaged = FALSE;
+}
+
+void vid_refresh (void)
+{
+vid_refresh_window (&vid_first);
 }
 
 t_stat vid_set_cursor (t_bool visible, uint32 width, uint32 height, uint8 *data, uint8 *mask, uint32 hot_x, uint32 hot_y)
 {
-return SCPE_NOFNC;
+return vid_set_cursor_window (&vid_first, visible, width, height, data, mask, hot_x, hot_y);
+}
+
+t_stat vid_set_cursor_window (VID_DISPLAY *vptr, t_bool visible, uint32 width, uint32 height, uint8 *data, uint8 *mask, uint32 hot_x, uint32 hot_y)
+{
+return (vptr && vptr->vid_active_window) ? SCPE_OK : SCPE_NOFNC; /* no cursor is displayed */
 }
 
 void vid_set_cursor_position (int32 x, int32 y)
@@ -2840,7 +3480,7 @@ void vid_set_cursor_position (int32 x, int32 y)
 return;
 }
 
-void vid_refresh (void)
+void vid_set_cursor_position_window (VID_DISPLAY *vptr, int32 x, int32 y)
 {
 return;
 }
@@ -2868,14 +3508,84 @@ return SCPE_OK;
 
 t_stat vid_show_video (FILE* st, UNIT* uptr, int32 val, CONST void* desc)
 {
-fprintf (st, "video support unavailable\n");
+VID_DISPLAY *vptr;
+
+if (!vid_headless) {
+    fprintf (st, "video support unavailable\n");
+    return SCPE_OK;
+    }
+fprintf (st, "Headless video (no display)\n");
+if (vid_capture_name)
+    fprintf (st, "  Capturing changed frames to %s\n", vid_capture_name);
+for (vptr = &vid_first; vptr != NULL; vptr = vptr->next) {
+    double secs, frames;
+
+    if (!vptr->vid_active_window)
+        continue;
+    secs = (sim_os_msec () - vptr->vid_start) / 1000.0;
+    frames = (double)vptr->vid_frames;
+    fprintf (st, "  Video Window: %s (%d by %d pixels)\n", vptr->vid_title, vptr->vid_width, vptr->vid_height);
+    fprintf (st, "    Frames:        %12.0f", frames);
+    if (secs > 0.0)
+        fprintf (st, "  (%.1f per second)", frames / secs);
+    fprintf (st, "\n");
+    fprintf (st, "    Draw calls:    %12.0f", (double)vptr->vid_draw_calls);
+    if (frames > 0.0)
+        fprintf (st, "  (%.1f per frame)", (double)vptr->vid_draw_calls / frames);
+    fprintf (st, "\n");
+    fprintf (st, "    Dirty pixels:  %12.0f", (double)vptr->vid_dirty_pixels);
+    if (frames > 0.0)
+        fprintf (st, "  (%.1f%% of the frame per frame)", (100.0 * (double)vptr->vid_dirty_pixels) / (frames * vptr->vid_width * vptr->vid_height));
+    fprintf (st, "\n");
+    if (vptr->vid_captured)
+        fprintf (st, "    Captured:      %12.0f\n", (double)vptr->vid_captured);
+    }
+if (!vid_active)
+    fprintf (st, "  No video windows are open\n");
 return SCPE_OK;
 }
 
 t_stat vid_screenshot (const char *filename)
 {
-sim_printf ("video support unavailable\n");
-return SCPE_NOFNC|SCPE_NOMESSAGE;
+VID_DISPLAY *vptr;
+const char *extension = strrchr (filename, '.');
+size_t n = extension ? (size_t)(extension - filename) : strlen (filename);
+char *name;
+int format, i = 0;
+t_stat r = SCPE_OK;
+
+if (!vid_headless) {
+    sim_printf ("video support unavailable\n");
+    return SCPE_NOFNC|SCPE_NOMESSAGE;
+    }
+if (!vid_active) {
+    sim_printf ("No video display is active\n");
+    return SCPE_UDIS | SCPE_NOMESSAGE;
+    }
+format = vid_image_format (filename);
+if (format == VID_FMT_RAW)
+    return sim_messagef (SCPE_ARG, "Screenshots can't be saved as raw pixels\n");
+name = (char *)malloc (strlen (filename) + 20);
+if (name == NULL)
+    return SCPE_MEM;
+for (vptr = &vid_first; (vptr != NULL) && (r == SCPE_OK); vptr = vptr->next) {
+    if (!vptr->vid_active_window)
+        continue;
+    memcpy (name, filename, n);
+    name[n] = '\0';
+    if (vid_active > 1)
+        sprintf (name + n, "%d", i++);
+    strcat (name, extension ? extension : "");
+    vid_image_name (name, format);
+    r = vid_write_frame (vptr, name, format);
+    if (r != SCPE_OK)
+        sim_printf ("Error saving screenshot to %s: %s\n", name, sim_error_text (r));
+    else
+        if (!sim_quiet)
+            sim_printf ("Screenshot saved to %s\n", name);
+    }
+free (name);
+return (r == SCPE_OK) ? SCPE_OK : (r | SCPE_NOMESSAGE);
 }
 
 t_bool vid_is_fullscreen (void)
@@ -2890,37 +3600,6 @@ sim_printf ("video support unavailable\n");
 return SCPE_OK;
 }
 
-t_stat vid_open_window (VID_DISPLAY **vptr, DEVICE *dptr, const char *title, uint32 width, uint32 height, int flags)
-{
-*vptr = NULL;
-return SCPE_NOFNC;
-}
-
-t_stat vid_close_window (VID_DISPLAY *vptr)
-{
-return SCPE_OK;
-}
-
-uint32 vid_map_rgb_window (VID_DISPLAY *vptr, uint8 r, uint8 g, uint8 b)
-{
-return 0;
-}
-
-void vid_draw_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h, uint32 *buf)
-{
-return;
-}
-
-void vid_refresh_window (VID_DISPLAY *vptr)
-{
-return;
-}
-
-t_stat vid_set_cursor_window (VID_DISPLAY *vptr, t_bool visible, uint32 width, uint32 height, uint8 *data, uint8 *mask, uint32 hot_x, uint32 hot_y)
-{
-return SCPE_NOFNC;
-}
-
 t_bool vid_is_fullscreen_window (VID_DISPLAY *vptr)
 {
 sim_printf ("video support unavailable\n");
@@ -2933,11 +3612,6 @@ sim_printf ("video support unavailable\n");
 return SCPE_OK;
 }
 
-void vid_set_cursor_position_window (VID_DISPLAY *vptr, int32 x, int32 y)
-{
-return;
-}
-
 void vid_set_window_size (VID_DISPLAY *vptr, int32 w, int32 h)
 {
 return;
@@ -2953,4 +3627,145 @@ const char *vid_key_name (uint32 key)
 return "";
 }
 
+/* Library test
+
+   Renders a known frame into a headless window by drawing (including
+   draws clipped at the frame edges) and by writing the frame buffer
+   directly, then checks the counters, that only changed frames are
+   captured, and the pixels of the captured .raw frame and of a .bmp
+   screenshot.
+*/
+
+#define VID_TEST_W      8
+#define VID_TEST_H      4
+
+static uint8 *vid_test_read (const char *filename, size_t *size)
+{
+FILE *f = sim_fopen (filename, "rb");
+uint8 *buf;
+
+*size = 0;
+if (f == NULL)
+    return NULL;
+*size = (size_t)sim_fsize_ex (f);
+buf = (uint8 *)malloc (*size + 1);
+if ((buf != NULL) && (fread (buf, 1, *size, f) != *size)) {
+    free (buf);
+    buf = NULL;
+    }
+fclose (f);
+return buf;
+}
+
+t_stat vid_test (void)
+{
+const char *frame_file = "TestVideo-000001.raw";
+const char *unchanged_file = "TestVideo-000002.raw";
+const char *screenshot_file = "TestVideo.bmp";
+t_bool saved_headless = vid_headless;
+char *saved_capture_name = vid_capture_name;
+int32 saved_quiet = sim_quiet;
+uint32 expected[VID_TEST_W * VID_TEST_H];
+uint32 block[6], clip[6], edge[2];
+VID_DISPLAY *vptr = NULL;
+uint8 *data = NULL;
+size_t size;
+FILE *f;
+int32 x, y, i;
+t_stat r;
+
+if (vid_active) {
+    sim_printf ("Video tests skipped, video windows are open\n");
+    return SCPE_OK;
+    }
+vid_headless = FALSE;
+r = vid_open_window (&vptr, NULL, "Test", VID_TEST_W, VID_TEST_H, 0);
+if ((r != SCPE_NOFNC) || (vptr != NULL)) {
+    vid_close_window (vptr);
+    vid_headless = saved_headless;
+    return sim_messagef (SCPE_IERR, "Video window opened without SET VIDEO HEADLESS\n");
+    }
+vid_headless = TRUE;
+vid_capture_name = (char *)malloc (strlen ("TestVideo.raw") + 1);
+if (vid_capture_name == NULL) {
+    vid_headless = saved_headless;
+    vid_capture_name = saved_capture_name;
+    return SCPE_MEM;
+    }
+strcpy (vid_capture_name, "TestVideo.raw");
+r = vid_open_window (&vptr, NULL, "Test", VID_TEST_W, VID_TEST_H, 0);
+if (r == SCPE_OK) {
+    for (i = 0; i < 6; i++) {
+        block[i] = vid_map_rgb_window (vptr, (uint8)(0x10 * i + 1), (uint8)(0x80 + i), (uint8)(0xF0 - i));
+        clip[i] = vid_map_rgb_window (vptr, (uint8)(0xC0 + i), (uint8)(0x20 * i), 0x55);
+        }
+    edge[0] = vid_map_rgb_window (vptr, 0xFF, 0x00, 0x00);
+    edge[1] = vid_map_rgb_window (vptr, 0x00, 0xFF, 0x00);
+    memset (expected, 0, sizeof (expected));
+    for (y = 0; y < 2; y++)                             /* 3 by 2 block at 2,1 */
+        for (x = 0; x < 3; x++)
+            expected[(1 + y) * VID_TEST_W + 2 + x] = block[y * 3 + x];
+    expected[3 * VID_TEST_W + 6] = clip[0];             /* 3 by 2 at 6,3 clipped to 2 by 1 */
+    expected[3 * VID_TEST_W + 7] = clip[1];
+    expected[2 * VID_TEST_W + 0] = edge[1];             /* 2 by 1 at -1,2 clipped to 1 by 1 */
+    expected[0] = vid_map_rgb_window (vptr, 0x12, 0x34, 0x56);/* written directly */
+    vid_draw_window (vptr, 2, 1, 3, 2, block);
+    vid_draw_window (vptr, 6, 3, 3, 2, clip);
+    vid_draw_window (vptr, -1, 2, 2, 1, edge);
+    vid_get_framebuffer_window (vptr)[0] = expected[0];
+    vid_damage_window (vptr, 0, 0, 1, 1);
+    vid_refresh_window (vptr);
+    vid_refresh_window (vptr);                          /* unchanged, not captured */
+    if ((vptr->vid_frames != 2) || (vptr->vid_draw_calls != 3) ||
+        (vptr->vid_dirty_pixels != 10) || (vptr->vid_captured != 1))
+        r = sim_messagef (SCPE_IERR, "Video counters wrong: %.0f frames, %.0f draw calls, %.0f dirty pixels, %.0f captured\n",
+                          (double)vptr->vid_frames, (double)vptr->vid_draw_calls, (double)vptr->vid_dirty_pixels, (double)vptr->vid_captured);
+    }
+if ((r == SCPE_OK) && ((f = sim_fopen (unchanged_file, "rb")))) {
+    fclose (f);
+    r = sim_messagef (SCPE_IERR, "Unchanged video frame was captured\n");
+    }
+if (r == SCPE_OK) {
+    data = vid_test_read (frame_file, &size);
+    if ((data == NULL) || (size != 3 * VID_TEST_W * VID_TEST_H))
+        r = sim_messagef (SCPE_IERR, "Captured video frame %s missing or wrong size\n", frame_file);
+    for (i = 0; (r == SCPE_OK) && (i < VID_TEST_W * VID_TEST_H); i++)
+        if ((data[3*i] != (uint8)(expected[i] >> 16)) || (data[3*i + 1] != (uint8)(expected[i] >> 8)) ||
+            (data[3*i + 2] != (uint8)expected[i]))
+            r = sim_messagef (SCPE_IERR, "Captured video frame pixel %d,%d is %02X%02X%02X, expected %06X\n",
+                              i % VID_TEST_W, i / VID_TEST_W, data[3*i], data[3*i + 1], data[3*i + 2], expected[i] & 0xFFFFFF);
+    free (data);
+    data = NULL;
+    }
+if (r == SCPE_OK) {
+    sim_quiet = 1;
+    r = vid_screenshot (screenshot_file);
+    sim_quiet = saved_quiet;
+    if (r == SCPE_OK)
+        data = vid_test_read (screenshot_file, &size);
+    if ((r == SCPE_OK) &&
+        ((data == NULL) || (size != 54 + 3 * VID_TEST_W * VID_TEST_H) || (data[0] != 'B') || (data[1] != 'M')))
+        r = sim_messagef (SCPE_IERR, "Video screenshot %s missing or wrong size\n", screenshot_file);
+    for (i = 0; (r == SCPE_OK) && (i < VID_TEST_W * VID_TEST_H); i++) {
+        uint8 *bgr = &data[54 + 3 * ((VID_TEST_H - 1 - i / VID_TEST_W) * VID_TEST_W + i % VID_TEST_W)];
+
+        if ((bgr[2] != (uint8)(expected[i] >> 16)) || (bgr[1] != (uint8)(expected[i] >> 8)) ||
+            (bgr[0] != (uint8)expected[i]))
+            r = sim_messagef (SCPE_IERR, "Video screenshot pixel %d,%d is %02X%02X%02X, expected %06X\n",
+                              i % VID_TEST_W, i / VID_TEST_W, bgr[2], bgr[1], bgr[0], expected[i] & 0xFFFFFF);
+        }
+    free (data);
+    }
+vid_close_window (vptr);
+free (vid_capture_name);
+vid_capture_name = saved_capture_name;
+vid_headless = saved_headless;
+if (r == SCPE_OK) {
+    remove (frame_file);
+    remove (screenshot_file);
+    sim_printf ("Headless video frame capture successful.\n");
+    }
+return r;
+}
+
 #endif /* defined(USE_SIM_VIDEO) */
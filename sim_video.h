@@ -201,6 +201,8 @@ t_stat vid_poll_kb (SIM_KEY_EVENT *ev);
 t_stat vid_poll_mouse (SIM_MOUSE_EVENT *ev);
 uint32 vid_map_rgb (uint8 r, uint8 g, uint8 b);
 void vid_draw (int32 x, int32 y, int32 w, int32 h, uint32 *buf);
+uint32 *vid_get_framebuffer (void);                     /* width x height pixels, drawn into directly */
+void vid_damage (int32 x, int32 y, int32 w, int32 h);   /* mark a changed frame buffer region */
 void vid_beep (void);
 void vid_refresh (void);
 const char *vid_version (void);
@@ -210,7 +212,10 @@ t_stat vid_set_release_key (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat vid_show_release_key (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat vid_show_video (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat vid_show (FILE* st, DEVICE *dptr,  UNIT* uptr, int32 val, CONST char* desc);
+t_stat vid_set (int32 flag, CONST char *cptr);
 t_stat vid_screenshot (const char *filename);
+t_stat vid_test (void);
+t_stat vid_can_open (void);
 t_bool vid_is_fullscreen (void);
 t_stat vid_set_fullscreen (t_bool flag);
 
@@ -225,6 +230,8 @@ t_stat vid_close_all (void);
 uint32 vid_map_rgb_window (VID_DISPLAY *vptr, uint8 r, uint8 g, uint8 b);
 uint32 vid_map_rgba_window (VID_DISPLAY *vptr, uint8 r, uint8 g, uint8 b, uint8 a);
 void vid_draw_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h, uint32 *buf);
+uint32 *vid_get_framebuffer_window (VID_DISPLAY *vptr);
+void vid_damage_window (VID_DISPLAY *vptr, int32 x, int32 y, int32 w, int32 h);
 void vid_refresh_window (VID_DISPLAY *vptr);
 t_stat vid_set_cursor_window (VID_DISPLAY *vptr, t_bool visible, uint32 width, uint32 height, uint8 *data, uint8 *mask, uint32 hot_x, uint32 hot_y);
 t_bool vid_is_fullscreen_window (VID_DISPLAY *vptr);
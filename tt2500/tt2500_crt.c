@@ -45,7 +45,8 @@ static DEBTAB crt_deb[] = {
   { NULL, 0 }
 };
 
-#ifdef USE_DISPLAY
+/* Without SDL the display only works after SET VIDEO HEADLESS */
+#if defined(USE_DISPLAY) && defined(HAVE_LIBSDL)
 #define CRT_DIS  0
 #else
 #define CRT_DIS  DEV_DIS
@@ -83,8 +84,16 @@ crt_reset (DEVICE *dptr)
     display_close (dptr);
     sim_cancel (&crt_unit);
   } else {
+    t_stat r = vid_can_open ();
+    if (r != SCPE_OK) {
+      dptr->flags |= DEV_DIS;
+      return r;
+    }
     display_reset ();
-    display_init (DIS_TT2500, 1, dptr);
+    if (!display_init (DIS_TT2500, 1, dptr)) {
+      dptr->flags |= DEV_DIS;
+      return sim_messagef (SCPE_NOFNC, "Display initialization failed\n");
+    }
     vid_register_quit_callback (&dpy_quit_callback);
   }
 #endif